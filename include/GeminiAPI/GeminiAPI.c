@@ -6,14 +6,100 @@
 */
 #include "esp_event.h"
 #include "esp_log.h"
-#include "cJSON.h"
 #include "GeminiAPI.h"
-#include "esp_http_client.h"
 #include "esp_netif.h"
-#include "esp_crt_bundle.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_wifi.h"
+#include "lwip/netdb.h"
+#include "Arena.h"
+#include "GeminiSession.h"
+#include "GeminiPrewarm.h"
+#include "GeminiSse.h"
+#include "GeminiJson.h"
+#include "GeminiPayload.h"
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "GeminiAPIhandler";
 
+// one arena for the whole request: payload, reply state and the strings
+// handed back
+static Arena *request_arena = NULL;
+
+// the connection to gemini stays open between calls, see GeminiSession.h
+static gemini_session_t gemini_session;
+static gemini_esp_tls_t gemini_tls;
+static bool gemini_session_ready = false;
+
+// the button press prewarm, see GeminiPrewarm.h. the task sleeps until the
+// record button's interrupt wakes it
+#define GEMINI_PREWARM_STACK 8192 // the tls handshake runs on it
+static gemini_prewarm_t gemini_prewarm;
+static bool gemini_prewarm_ready = false;
+static TaskHandle_t gemini_prewarm_task = NULL;
+static wifi_ps_type_t gemini_saved_ps = WIFI_PS_MIN_MODEM;
+
+// state for one reply. the body goes through the json extractor as it
+// arrives, straight in for generateContent and each event's data as it
+// comes when streamed, so neither the reply nor an event is held in memory
+typedef struct {
+    gemini_json_t json;
+    gemini_sse_parser_t sse;
+    http_response_buffer_t text; // everything said so far
+    gemini_text_cb_t on_text;    // streaming only
+    void *ctx;
+    bool stopped;                // the caller's callback asked to stop
+    char error_head[256];        // start of the body, logged on an error status
+    size_t error_len;
+    char event_head[201];        // start of the streamed event, logged when it is an error
+    size_t event_len;
+    int event_text_start;        // text.data_len when the event began
+} gemini_reply_t;
+
+// request body pulled through the session's buffer a piece at a time, so
+// it never has to be in memory whole
+typedef struct {
+    gemini_body_read_t read;
+    bool (*rewind)(void *ctx); // NULL when it can't be sent twice
+    void *ctx;
+    size_t len;                // or GEMINI_BODY_LEN_CHUNKED
+} gemini_upload_t;
+
+esp_err_t Gemini_Prewarm_Ini(void);
+void Gemini_Prewarm_From_Isr(void);
+void Gemini_Prewarm_Cancel(void);
+void Gemini_Prewarm_Done(void);
+static void gemini_prewarm_loop(void *arg);
+static void gemini_radio_wake(void *ctx);
+static void gemini_radio_sleep(void *ctx);
+static int gemini_resolve(void *ctx, const char *host);
+static bool request_arena_begin(void);
+static void request_arena_end(void);
+static gemini_session_t *gemini_get_session(void);
+static bool gemini_append_text(http_response_buffer_t *text, const char *data, size_t len);
+static esp_err_t gemini_post(const char *path, const char *api_key, const gemini_upload_t *upload,
+                             gemini_body_cb_t on_body, void *ctx, int *status);
+static esp_err_t gemini_generate(const gemini_upload_t *upload, parsed_response_t *result, const char *model_name,
+                                 const char *api_key);
+static esp_err_t gemini_stream(const gemini_upload_t *upload, parsed_response_t *result, const char *model_name,
+                               const char *api_key, gemini_text_cb_t on_text, void *ctx);
+static parsed_response_t *gemini_audio_request(const GeminiAudioQuestion *audio_question, gemini_text_cb_t on_text,
+                                               void *ctx);
+static gemini_upload_t gemini_question_upload(const GeminiQuestionInfo *question_info, gemini_payload_t *payload);
+static gemini_upload_t gemini_audio_upload(const GeminiAudioQuestion *audio_question, gemini_payload_t *payload);
+static int gemini_payload_pull(void *ctx, uint8_t *buf, size_t size);
+static bool gemini_payload_restart(void *ctx);
+static gemini_reply_t *gemini_reply_begin(gemini_text_cb_t on_text, void *ctx);
+static void gemini_reply_finish(gemini_reply_t *reply, parsed_response_t *result);
+static void gemini_reply_keep_head(gemini_reply_t *reply, const char *data, size_t len);
+static bool gemini_reply_text(void *ctx, const char *text, size_t len);
+static bool gemini_reply_body(void *ctx, const char *data, size_t len);
+static bool gemini_stream_body(void *ctx, const char *data, size_t len);
+static bool gemini_stream_data(void *ctx, const char *data, size_t len);
+static bool gemini_stream_event(void *ctx, const char *event, const char *data, size_t len);
+
 /*
   @brief The main public function to interact with the Gemini API.
  */
@@ -25,189 +111,500 @@ parsed_response_t *Gemini_Api_Call(const GeminiQuestionInfo *question_info) {
         return NULL;
     }
 
-    // 2. Make the API call
-    char *raw_response = NULL;
-    esp_err_t err = make_gemini_api_call(question_info, &raw_response, MODEL_NAME, GEMINI_API_KEY);
+    if (!request_arena_begin()) {
+        ESP_LOGE(TAG, "Failed to set up the request arena.");
+        return NULL;
+    }
 
-    // 3. Parse the response
-    if (err == ESP_OK && raw_response != NULL) {
-        parsed_response_t parsed = parse_gemini_response(raw_response);
-        free(raw_response); // Clean up the raw response string
+    // 2. Make the API call, the reply is parsed as it arrives and the
+    // strings in the result stay in the arena with it
+    parsed_response_t *result = Arena_Alloc(request_arena, sizeof(parsed_response_t));
+    if (result) {
+        *result = (parsed_response_t){ .text = NULL, .cache_name = NULL };
+        if (make_gemini_api_call(question_info, result, MODEL_NAME, GEMINI_API_KEY) == ESP_OK) {
+            ESP_LOGD(TAG, "Request used %u bytes of arena", (unsigned)request_arena->Total_Used);
+            return result;
+        }
+    } else {
+        ESP_LOGE(TAG, "Failed to allocate memory for parsed response result.");
+    }
 
-        // Allocate memory for the result and copy the parsed data
-        parsed_response_t *result = malloc(sizeof(parsed_response_t));
-        if (!result) {
-            ESP_LOGE(TAG, "Failed to allocate memory for parsed response result.");
-            // Free the strings inside the temporary parsed struct if allocation fails
-            if (parsed.text) free(parsed.text);
-            if (parsed.cache_name) free(parsed.cache_name);
-            return NULL;
+    // 3. Handle errors, everything the request allocated goes in one go
+    request_arena_end();
+    ESP_LOGE(TAG, "Gemini API call failed.");
+    return NULL;
+}
+
+/*
+  @brief Same as Gemini_Api_Call but the answer is streamed, on_text gets
+  each piece of text as soon as the server sends it
+ */
+parsed_response_t *Gemini_Api_Stream(const GeminiQuestionInfo *question_info, gemini_text_cb_t on_text, void *ctx) {
+    if (!question_info || !question_info->question || !on_text) {
+        ESP_LOGE(TAG, "Input question_info, its members or on_text are NULL.");
+        return NULL;
+    }
+    if (!request_arena_begin()) {
+        ESP_LOGE(TAG, "Failed to set up the request arena.");
+        return NULL;
+    }
+    parsed_response_t *result = Arena_Alloc(request_arena, sizeof(parsed_response_t));
+    if (result) {
+        *result = (parsed_response_t){ .text = NULL, .cache_name = NULL };
+        if (make_gemini_stream_call(question_info, result, MODEL_NAME, GEMINI_API_KEY, on_text, ctx) == ESP_OK) {
+            ESP_LOGD(TAG, "Stream used %u bytes of arena", (unsigned)request_arena->Total_Used);
+            return result;
         }
-        *result = parsed;
-        return result;
     }
+    request_arena_end();
+    ESP_LOGE(TAG, "Gemini API stream failed.");
+    return NULL;
+}
+
+/*
+  @brief Asks about a clip that may still be recording. the pcm is pulled
+  from read_pcm and goes out as the request body while it arrives, so the
+  upload is done moments after the recording stops
+ */
+parsed_response_t *Gemini_Api_Audio_Call(const GeminiAudioQuestion *audio_question) {
+    return gemini_audio_request(audio_question, NULL, NULL);
+}
 
-    // 4. Handle errors
-    if (raw_response) {
-        free(raw_response);
+parsed_response_t *Gemini_Api_Audio_Stream(const GeminiAudioQuestion *audio_question, gemini_text_cb_t on_text, void *ctx) {
+    if (!on_text) {
+        ESP_LOGE(TAG, "on_text is NULL.");
+        return NULL;
     }
-    ESP_LOGE(TAG, "Gemini API call failed.");
+    return gemini_audio_request(audio_question, on_text, ctx);
+}
+
+static parsed_response_t *gemini_audio_request(const GeminiAudioQuestion *audio_question, gemini_text_cb_t on_text,
+                                               void *ctx) {
+    if (!audio_question || (!audio_question->read_pcm && !audio_question->read_encoded) ||
+        audio_question->sample_rate == 0) {
+        ESP_LOGE(TAG, "Input audio_question, its pcm source or sample rate are missing.");
+        return NULL;
+    }
+    if (!request_arena_begin()) {
+        ESP_LOGE(TAG, "Failed to set up the request arena.");
+        return NULL;
+    }
+    parsed_response_t *result = Arena_Alloc(request_arena, sizeof(parsed_response_t));
+    if (result) {
+        *result = (parsed_response_t){ .text = NULL, .cache_name = NULL };
+        gemini_payload_t payload;
+        const gemini_upload_t upload = gemini_audio_upload(audio_question, &payload);
+        esp_err_t err = on_text ? gemini_stream(&upload, result, MODEL_NAME, GEMINI_API_KEY, on_text, ctx)
+                                : gemini_generate(&upload, result, MODEL_NAME, GEMINI_API_KEY);
+        if (err == ESP_OK) {
+            ESP_LOGD(TAG, "Audio request used %u bytes of arena", (unsigned)request_arena->Total_Used);
+            return result;
+        }
+        if (payload.failed) {
+            ESP_LOGE(TAG, "Recording gave up, the clip was not sent.");
+        }
+    }
+    request_arena_end();
+    ESP_LOGE(TAG, "Gemini API audio call failed.");
     return NULL;
 }
 
+void Gemini_Free_Response(parsed_response_t *response) {
+    if (response == NULL) {
+        return;
+    }
+    request_arena_end();
+}
+
+static bool request_arena_begin(void) {
+    if (request_arena == NULL) {
+        request_arena = Arena_Ini(GEMINI_ARENA_CHUNK_SIZE);
+        if (request_arena == NULL) {
+            return false;
+        }
+    }
+    Arena_Reset(request_arena); // drops a response the caller never freed
+    return true;
+}
+
+static void request_arena_end(void) {
+    Arena_Reset(request_arena);
+}
+
 parsed_response_t parse_gemini_response(const char* json_string) {
     parsed_response_t response = { .text = NULL, .cache_name = NULL };
-    cJSON *root = cJSON_Parse(json_string);
-    if (root == NULL) {
-        ESP_LOGE(TAG, "Failed to parse JSON: %s", cJSON_GetErrorPtr());
+    gemini_reply_t *reply = gemini_reply_begin(NULL, NULL);
+    if (reply == NULL) {
+        return response;
+    }
+    if (gemini_json_feed(&reply->json, json_string, strlen(json_string)) != GEMINI_JSON_DONE) {
+        ESP_LOGE(TAG, "Failed to parse JSON near byte %u", (unsigned)reply->json.consumed);
         return response;
     }
+    gemini_reply_finish(reply, &response);
+    return response;
+}
+
+
+// the body is written straight into the arena at its exact size, compact
+// and with nothing built up first, see GeminiPayload.h
+extern char* create_gemini_json_payload(const char* new_question, const char* cached_content_name) {
+    gemini_payload_t payload;
+    gemini_payload_init(&payload, new_question, cached_content_name);
+    size_t len = gemini_payload_len(&payload);
+    char *json_string = Arena_Alloc(request_arena, len + 1);
+    if (json_string == NULL) return NULL;
+    json_string[gemini_payload_read(&payload, json_string, len)] = '\0';
+    return json_string;
+}
 
-    const cJSON *cached_content = cJSON_GetObjectItem(root, "cachedContent");
-    if (cJSON_IsString(cached_content) && cached_content->valuestring != NULL) {
-        response.cache_name = strdup(cached_content->valuestring);
+
+// text arrives in pieces, grow the buffer in the arena to fit
+static bool gemini_append_text(http_response_buffer_t *text, const char *data, size_t len) {
+    if (text->buffer_size < text->data_len + (int)len + 1) {
+        int new_size = text->buffer_size * 2;
+        while (new_size < text->data_len + (int)len + 1) {
+            new_size *= 2;
+        }
+        char *new_buffer = Arena_Realloc(text->arena, text->buffer, text->buffer_size, new_size);
+        if (new_buffer == NULL) { return false; }
+        text->buffer = new_buffer;
+        text->buffer_size = new_size;
     }
+    memcpy(text->buffer + text->data_len, data, len);
+    text->data_len += len;
+    text->buffer[text->data_len] = '\0';
+    return true;
+}
 
-    const cJSON *candidates = cJSON_GetObjectItem(root, "candidates");
-    if (!cJSON_IsArray(candidates) || cJSON_GetArraySize(candidates) == 0) {
-        goto end;
+static gemini_session_t *gemini_get_session(void) {
+    if (!gemini_session_ready) {
+        gemini_transport_t transport;
+        const gemini_session_policy_t policy = GEMINI_SESSION_POLICY_DEFAULT;
+        gemini_transport_esp_tls(&transport, &gemini_tls);
+        gemini_session_init(&gemini_session, &transport, GEMINI_API_HOST, 443, &policy);
+        gemini_session_ready = true;
     }
+    return &gemini_session;
+}
+
+void Gemini_Set_Session_Policy(const gemini_session_policy_t *policy) {
+    gemini_session_set_policy(gemini_get_session(), policy);
+}
 
-    const cJSON *first_candidate = cJSON_GetArrayItem(candidates, 0);
-    const cJSON *content = cJSON_GetObjectItem(first_candidate, "content");
-    const cJSON *parts = cJSON_GetObjectItem(content, "parts");
-    const cJSON *first_part = cJSON_GetArrayItem(parts, 0);
-    const cJSON *text = cJSON_GetObjectItem(first_part, "text");
+void Gemini_Close_Session(void) {
+    gemini_session_close(gemini_get_session());
+}
 
-    if (cJSON_IsString(text) && text->valuestring != NULL) {
-        response.text = strdup(text->valuestring);
+esp_err_t Gemini_Prewarm_Ini(void) {
+    if (gemini_prewarm_ready) {
+        return ESP_OK;
+    }
+    const gemini_prewarm_ops_t ops = {gemini_radio_wake, gemini_radio_sleep, gemini_resolve, NULL};
+    if (!gemini_prewarm_init(&gemini_prewarm, gemini_get_session(), &ops)) {
+        return ESP_ERR_NO_MEM;
+    }
+    // core 0 with the wifi, below the capture stages so it can't cost a frame
+    if (xTaskCreatePinnedToCore(gemini_prewarm_loop, "gemini_prewarm", GEMINI_PREWARM_STACK, NULL,
+                                configMAX_PRIORITIES - 5, &gemini_prewarm_task, 0) != pdPASS) {
+        gemini_prewarm_deinit(&gemini_prewarm);
+        return ESP_ERR_NO_MEM;
     }
+    gemini_prewarm_ready = true;
+    return ESP_OK;
+}
 
-    end:
-    cJSON_Delete(root);
-    return response;
+// in the button's gpio isr, all it does is wake the task
+void IRAM_ATTR Gemini_Prewarm_From_Isr(void) {
+    BaseType_t woken = pdFALSE;
+    if (gemini_prewarm_task != NULL) {
+        vTaskNotifyGiveFromISR(gemini_prewarm_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
 }
 
+void Gemini_Prewarm_Cancel(void) {
+    if (gemini_prewarm_ready) {
+        gemini_prewarm_cancel(&gemini_prewarm);
+    }
+}
 
-extern char* create_gemini_json_payload(const char* new_question, const char* cached_content_name) {
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return NULL;
-        
-        cJSON *contents = cJSON_AddArrayToObject(root, "contents");
-        cJSON *content_item = cJSON_CreateObject();
-        cJSON_AddItemToArray(contents, content_item);
-        cJSON *parts = cJSON_AddArrayToObject(content_item, "parts");
-        cJSON *part_item = cJSON_CreateObject();
-        cJSON_AddItemToArray(parts, part_item);
-        cJSON_AddStringToObject(part_item, "text", new_question);
-        
-        cJSON_AddStringToObject(root, "cachedContent", cached_content_name);
-
-
-        // **FIX:** Add tools section to enable grounding with Google Search
-        cJSON *tools = cJSON_AddArrayToObject(root, "tools");
-        cJSON *tool_item = cJSON_CreateObject();
-        cJSON_AddItemToObject(tool_item, "googleSearchRetrieval", cJSON_CreateObject());
-        cJSON_AddItemToArray(tools, tool_item);
-
-
-        cJSON *safety_settings = cJSON_AddArrayToObject(root, "safetySettings");
-        const char* categories[] = {
-            "HARM_CATEGORY_DANGEROUS_CONTENT", "HARM_CATEGORY_HATE_SPEECH",
-            "HARM_CATEGORY_HARASSMENT", "HARM_CATEGORY_SEXUALLY_EXPLICIT"
-    };
-    for (int i = 0; i < sizeof(categories)/sizeof(categories[0]); i++) {
-        cJSON *setting_item = cJSON_CreateObject();
-        cJSON_AddStringToObject(setting_item, "category", categories[i]);
-        cJSON_AddStringToObject(setting_item, "threshold", "BLOCK_NONE");
-        cJSON_AddItemToArray(safety_settings, setting_item);
+void Gemini_Prewarm_Done(void) {
+    if (gemini_prewarm_ready) {
+        gemini_prewarm_done(&gemini_prewarm);
     }
+}
 
-    cJSON *generation_config = cJSON_CreateObject();
-    cJSON_AddNumberToObject(generation_config, "temperature", 0.9);
-    cJSON_AddItemToObject(root, "generationConfig", generation_config);
+static void gemini_prewarm_loop(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // presses while it runs fold into one
+        if (gemini_prewarm_run(&gemini_prewarm)) {
+            ESP_LOGI(TAG, "Prewarmed in %lld ms: wake %lld ms, dns %lld ms, %s %lld ms",
+                     gemini_prewarm.timing.total_us / 1000, gemini_prewarm.timing.wake_us / 1000,
+                     gemini_prewarm.timing.dns_us / 1000,
+                     gemini_prewarm.timing.connect_us == 0 ? "still connected"
+                     : gemini_prewarm.timing.resumed     ? "resumed handshake"
+                                                         : "full handshake",
+                     gemini_prewarm.timing.connect_us / 1000);
+        } else {
+            ESP_LOGW(TAG, "Prewarm %s", gemini_prewarm_state_name(gemini_prewarm.state));
+        }
+    }
+}
 
-    char *json_string = cJSON_Print(root);
-    cJSON_Delete(root);
-    return json_string;
+// modem sleep holds traffic until the next beacon, a handshake's round
+// trips each wait for one
+static void gemini_radio_wake(void *ctx) {
+    if (esp_wifi_get_ps(&gemini_saved_ps) != ESP_OK) {
+        gemini_saved_ps = WIFI_PS_MIN_MODEM; // the station default
+    }
+    esp_wifi_set_ps(WIFI_PS_NONE);
 }
 
+static void gemini_radio_sleep(void *ctx) { esp_wifi_set_ps(gemini_saved_ps); }
 
-esp_err_t http_event_handler(esp_http_client_event_t *evt) {
-    http_response_buffer_t *response_buffer = (http_response_buffer_t *)evt->user_data;
-    switch(evt->event_id) {
-        case HTTP_EVENT_ON_DATA:
-            if (response_buffer->buffer_size < response_buffer->data_len + evt->data_len + 1) {
-                int new_size = response_buffer->buffer_size * 2;
-                char *new_buffer = realloc(response_buffer->buffer, new_size);
-                if (new_buffer == NULL) { return ESP_FAIL; }
-                response_buffer->buffer = new_buffer;
-                response_buffer->buffer_size = new_size;
-            }
-            memcpy(response_buffer->buffer + response_buffer->data_len, evt->data, evt->data_len);
-            response_buffer->data_len += evt->data_len;
-            break;
-        case HTTP_EVENT_ON_FINISH:
-            if (response_buffer->buffer != NULL) {
-                response_buffer->buffer[response_buffer->data_len] = '\0';
-            }
-            break;
-        default:
-            break;
+// the answer is kept by lwip's dns cache, esp_tls finds it there on connect
+static int gemini_resolve(void *ctx, const char *host) {
+    const struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *found = NULL;
+    int err = getaddrinfo(host, "443", &hints, &found);
+    if (err == 0) {
+        freeaddrinfo(found);
     }
-    return ESP_OK;
+    return err;
+}
+
+esp_err_t make_gemini_api_call(const GeminiQuestionInfo *question_info, parsed_response_t *result, const char *model_name, const char *api_key) {
+    gemini_payload_t payload;
+    const gemini_upload_t upload = gemini_question_upload(question_info, &payload);
+    return gemini_generate(&upload, result, model_name, api_key);
 }
 
+esp_err_t make_gemini_stream_call(const GeminiQuestionInfo *question_info, parsed_response_t *result, const char *model_name, const char *api_key, gemini_text_cb_t on_text, void *ctx) {
+    gemini_payload_t payload;
+    const gemini_upload_t upload = gemini_question_upload(question_info, &payload);
+    return gemini_stream(&upload, result, model_name, api_key, on_text, ctx);
+}
 
+static esp_err_t gemini_generate(const gemini_upload_t *upload, parsed_response_t *result, const char *model_name,
+                                 const char *api_key) {
+    gemini_reply_t *reply = gemini_reply_begin(NULL, NULL);
+    if (reply == NULL) return ESP_ERR_NO_MEM;
+
+    char gemini_path[128];
+    snprintf(gemini_path, sizeof(gemini_path), "/v1beta/models/%s:generateContent", model_name);
+    int status = 0;
+    esp_err_t err = gemini_post(gemini_path, api_key, upload, gemini_reply_body, reply, &status);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-esp_err_t make_gemini_api_call(const char *question, char **response_data, const char *MODEL_NAME, const char *GEMINI_API_KEY) {
-    *response_data = NULL;
-    char *post_data = create_gemini_json_payload(question); // need to find a way to not need to parse cached content.
-    if (post_data == NULL) return ESP_ERR_NO_MEM;
+    // the reply state goes back with the arena
+    if (status != 200) {
+        reply->error_head[reply->error_len] = '\0';
+        ESP_LOGE(TAG, "HTTP Status = %d", status);
+        ESP_LOGE(TAG, "Response: %s", reply->error_head);
+        return ESP_FAIL;
+    }
+    if (reply->json.status != GEMINI_JSON_DONE) {
+        ESP_LOGE(TAG, "Failed to parse JSON near byte %u", (unsigned)reply->json.consumed);
+        return ESP_FAIL;
+    }
+    gemini_reply_finish(reply, result);
+    return ESP_OK;
+}
 
-    http_response_buffer_t response_buffer = {0};
-    response_buffer.buffer = malloc(2048);
-    if (response_buffer.buffer == NULL) {
-        free(post_data);
-        return ESP_ERR_NO_MEM;
+static esp_err_t gemini_stream(const gemini_upload_t *upload, parsed_response_t *result, const char *model_name,
+                               const char *api_key, gemini_text_cb_t on_text, void *ctx) {
+    gemini_reply_t *reply = gemini_reply_begin(on_text, ctx);
+    if (reply == NULL) return ESP_ERR_NO_MEM;
+    // the last event carries grounding and usage and can be several KB,
+    // its data goes through the extractor as it arrives like the text ones
+    gemini_sse_init_streamed(&reply->sse, gemini_stream_data, gemini_stream_event, reply);
+
+    char gemini_path[128];
+    snprintf(gemini_path, sizeof(gemini_path), "/v1beta/models/%s:streamGenerateContent?alt=sse", model_name);
+    int status = 0;
+    esp_err_t err = gemini_post(gemini_path, api_key, upload, gemini_stream_body, reply, &status);
+    if (err != ESP_OK && !reply->stopped) {
+        return err;
+    }
+    if (status != 200) {
+        reply->error_head[reply->error_len] = '\0';
+        ESP_LOGE(TAG, "HTTP Status = %d", status);
+        ESP_LOGE(TAG, "Response: %s", reply->error_head);
+        return ESP_FAIL;
     }
-    response_buffer.buffer_size = 2048;
-
-    char gemini_url[256];
-    snprintf(gemini_url, sizeof(gemini_url), "https://generativelanguage.googleapis.com/v1beta/models/%s:generateContent", MODEL_NAME);
-    
-    esp_http_client_config_t config = {
-        .url = gemini_url,
-        .method = HTTP_METHOD_POST,
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .timeout_ms = 30000,
-        .user_data = &response_buffer,
-        .event_handler = http_event_handler,
+    gemini_reply_finish(reply, result);
+    return ESP_OK;
+}
+
+// the question goes out with its exact Content-Length, written a piece at a
+// time into the session's buffer
+static gemini_upload_t gemini_question_upload(const GeminiQuestionInfo *question_info, gemini_payload_t *payload) {
+    gemini_payload_init(payload, question_info->question, question_info->cached_content_name);
+    return (gemini_upload_t){
+        .read = gemini_payload_pull,
+        .rewind = gemini_payload_restart,
+        .ctx = payload,
+        .len = gemini_payload_len(payload),
+    };
+}
+
+// a clip goes out chunked while it is recorded, unless the caller already
+// knows how long it will be. it can't be recorded again for a retry
+static gemini_upload_t gemini_audio_upload(const GeminiAudioQuestion *audio_question, gemini_payload_t *payload) {
+    const gemini_payload_audio_t audio = {
+        .sample_rate = audio_question->sample_rate,
+        .total_samples = audio_question->total_samples,
+        .read = audio_question->read_pcm,
+        .ctx = audio_question->ctx,
+        .read_encoded = audio_question->read_encoded,
+        .mime_type = audio_question->mime_type,
     };
+    gemini_payload_init_audio(payload, audio_question->prompt, &audio, audio_question->cached_content_name);
+    size_t len = gemini_payload_len(payload);
+    return (gemini_upload_t){
+        .read = gemini_payload_pull,
+        .rewind = NULL,
+        .ctx = payload,
+        .len = len == GEMINI_PAYLOAD_LEN_UNKNOWN ? GEMINI_BODY_LEN_CHUNKED : len,
+    };
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_header(client, "x-goog-api-key", GEMINI_API_KEY);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
+// a recording that gave up must not end the chunked body as if it was whole
+static int gemini_payload_pull(void *ctx, uint8_t *buf, size_t size) {
+    gemini_payload_t *payload = (gemini_payload_t *)ctx;
+    size_t written = gemini_payload_read(payload, (char *)buf, size);
+    return payload->failed ? -1 : (int)written;
+}
 
-    esp_err_t err = esp_http_client_perform(client);
+static bool gemini_payload_restart(void *ctx) {
+    return gemini_payload_rewind((gemini_payload_t *)ctx);
+}
 
-    if (err == ESP_OK) {
-        if (esp_http_client_get_status_code(client) == 200) {
-            *response_data = response_buffer.buffer;
-        } else {
-            ESP_LOGE(TAG, "HTTP Status = %d", esp_http_client_get_status_code(client));
-            ESP_LOGE(TAG, "Response: %s", response_buffer.buffer);
-            free(response_buffer.buffer);
-            err = ESP_FAIL;
+// one request on the kept-alive session, the reply body goes to on_body
+static esp_err_t gemini_post(const char *path, const char *api_key, const gemini_upload_t *upload,
+                             gemini_body_cb_t on_body, void *ctx, int *status) {
+    const gemini_header_t headers[] = {
+        { "x-goog-api-key", api_key },
+        { "Content-Type", "application/json" },
+    };
+    const gemini_request_t request = {
+        .method = "POST",
+        .path = path,
+        .headers = headers,
+        .header_count = sizeof(headers) / sizeof(headers[0]),
+        .body_len = upload->len,
+        .on_body = on_body,
+        .ctx = ctx,
+        .body_read = upload->read,
+        .body_ctx = upload->ctx,
+        .body_rewind = upload->rewind,
+    };
+
+    gemini_session_t *session = gemini_get_session();
+    // a prewarm from the button press may still be handshaking, the request waits for it
+    const gemini_prewarm_state_t prewarm = gemini_prewarm_ready ? gemini_prewarm_claim(&gemini_prewarm)
+                                                                : GEMINI_PREWARM_IDLE;
+    gemini_session_err_t session_err = gemini_session_request(session, &request, status);
+    if (gemini_prewarm_ready) {
+        gemini_prewarm_release(&gemini_prewarm);
+    }
+    if (session_err != GEMINI_SESSION_OK) {
+        if (session_err != GEMINI_SESSION_ERR_ABORTED) { // our own callbacks stopped it
+            ESP_LOGE(TAG, "Request failed: %s", gemini_session_err_name(session_err));
         }
-    } else {
-        free(response_buffer.buffer);
+        return session_err == GEMINI_SESSION_ERR_TIMEOUT ? ESP_ERR_TIMEOUT : ESP_FAIL;
     }
-    
-    esp_http_client_cleanup(client);
-    free(post_data);
-    return err;
+    ESP_LOGI(TAG, "%s connection%s, connect %lld ms, first byte %lld ms",
+             session->timing.reused ? "Warm" : session->timing.resumed ? "Resumed" : "Cold",
+             prewarm == GEMINI_PREWARM_WARM ? " (prewarmed)" : "",
+             session->timing.connect_us / 1000, session->timing.ttfb_us / 1000);
+    return ESP_OK;
+}
+
+static gemini_reply_t *gemini_reply_begin(gemini_text_cb_t on_text, void *ctx) {
+    gemini_reply_t *reply = Arena_Alloc(request_arena, sizeof(gemini_reply_t));
+    char *text_buffer = Arena_Alloc(request_arena, 512);
+    if (reply == NULL || text_buffer == NULL) {
+        return NULL;
+    }
+    memset(reply, 0, sizeof(*reply));
+    gemini_json_init(&reply->json, NULL, 0, gemini_reply_text, reply);
+    reply->text = (http_response_buffer_t){ .buffer = text_buffer, .buffer_size = 512, .arena = request_arena };
+    text_buffer[0] = '\0';
+    reply->on_text = on_text;
+    reply->ctx = ctx;
+    return reply;
+}
+
+static void gemini_reply_finish(gemini_reply_t *reply, parsed_response_t *result) {
+    result->text = reply->text.data_len > 0 ? reply->text.buffer : NULL;
+    result->cache_name = reply->json.cache_name_len > 0 ? Arena_Strdup(request_arena, reply->json.cache_name) : NULL;
 }
 
+static void gemini_reply_keep_head(gemini_reply_t *reply, const char *data, size_t len) {
+    if (reply->error_len < sizeof(reply->error_head) - 1) {
+        size_t room = sizeof(reply->error_head) - 1 - reply->error_len;
+        size_t copy = len < room ? len : room;
+        memcpy(reply->error_head + reply->error_len, data, copy);
+        reply->error_len += copy;
+    }
+}
+
+// every piece of answer text the extractor finds
+static bool gemini_reply_text(void *ctx, const char *text, size_t len) {
+    gemini_reply_t *reply = (gemini_reply_t *)ctx;
+    if (!gemini_append_text(&reply->text, text, len)) {
+        return false;
+    }
+    if (reply->on_text != NULL && !reply->on_text(reply->ctx, text, len)) {
+        reply->stopped = true;
+        return false;
+    }
+    return true;
+}
+
+// a body that isn't json is still read to the end so the connection can
+// be reused, the extractor just stops looking at it
+static bool gemini_reply_body(void *ctx, const char *data, size_t len) {
+    gemini_reply_t *reply = (gemini_reply_t *)ctx;
+    gemini_reply_keep_head(reply, data, len);
+    return gemini_json_feed(&reply->json, data, len) != GEMINI_JSON_ABORTED;
+}
+
+static bool gemini_stream_body(void *ctx, const char *data, size_t len) {
+    gemini_reply_t *reply = (gemini_reply_t *)ctx;
+    gemini_reply_keep_head(reply, data, len);
+    return gemini_sse_feed(&reply->sse, data, len);
+}
+
+// every event is a whole GenerateContentResponse holding only the new text,
+// its data is fed in as it arrives whatever size the event is
+static bool gemini_stream_data(void *ctx, const char *data, size_t len) {
+    gemini_reply_t *reply = (gemini_reply_t *)ctx;
+    if (reply->event_len < sizeof(reply->event_head) - 1) {
+        size_t room = sizeof(reply->event_head) - 1 - reply->event_len;
+        size_t copy = len < room ? len : room;
+        memcpy(reply->event_head + reply->event_len, data, copy);
+        reply->event_len += copy;
+    }
+    return gemini_json_feed(&reply->json, data, len) != GEMINI_JSON_ABORTED;
+}
+
+// the event's data has all been fed by now, data is NULL
+static bool gemini_stream_event(void *ctx, const char *event, const char *data, size_t len) {
+    gemini_reply_t *reply = (gemini_reply_t *)ctx;
+    reply->event_head[reply->event_len] = '\0';
+    if (reply->json.status != GEMINI_JSON_DONE) {
+        ESP_LOGW(TAG, "Skipping stream event that isn't JSON");
+    } else if (reply->text.data_len == reply->event_text_start && strstr(reply->event_head, "\"error\"") != NULL) {
+        // the extractor doesn't keep error objects, show the start of it
+        ESP_LOGE(TAG, "Stream error: %s", reply->event_head);
+    }
+    gemini_json_reset(&reply->json);
+    reply->event_len = 0;
+    reply->event_text_start = reply->text.data_len;
+    return true;
+}
@@ -7,6 +7,17 @@
 #ifndef GEMINI_API_H
 #define GEMINI_API_H
 
+#include "esp_err.h"
+#include "Arena.h"
+#include "GeminiSession.h"
+#include "GeminiPayload.h"
+
+#define GEMINI_API_HOST "generativelanguage.googleapis.com"
+
+// everything one request allocates comes out of a single arena, this is
+// the size it grows by. big enough for a typical payload and reply
+#define GEMINI_ARENA_CHUNK_SIZE 16384
+
 extern const char* GEMINI_API_KEY;
 extern const char* MODEL_NAME;
 
@@ -19,6 +30,7 @@ extern const char* MODEL_NAME;
         char *buffer;
         int buffer_size;
         int data_len;
+        Arena *arena; // buffer grows in here
     } http_response_buffer_t;
 
     typedef struct {
@@ -26,6 +38,23 @@ extern const char* MODEL_NAME;
         char *question;
     } GeminiQuestionInfo;
 
+    // a spoken question, 16-bit mono pcm pulled from read_pcm while it is
+    // being recorded. see gemini_pcm_read_t for how the source ends. or an
+    // encoded file from read_encoded instead, see AudioCodec.h
+    typedef struct {
+        char *cached_content_name;
+        const char *prompt;          // optional text sent ahead of the clip
+        uint32_t sample_rate;
+        uint32_t total_samples;      // 0 when the length isn't known up front
+        gemini_pcm_read_t read_pcm;
+        void *ctx;
+        gemini_bytes_read_t read_encoded; // used over read_pcm when set
+        const char *mime_type;       // of the encoded file, NULL for audio/wav
+    } GeminiAudioQuestion;
+
+    // streamed text as it arrives, return false to stop the stream early
+    typedef bool (*gemini_text_cb_t)(void *ctx, const char *text, size_t len);
+
 /*#
 what i will be doing 
 Give it 1 function and make it 1 function for cleaning up the memory
@@ -34,10 +63,37 @@ Give it 1 function and make it 1 function for cleaning up the memory
 
 
     //Function definitions
+    // the response and its strings live in the request arena. they stay
+    // valid until Gemini_Free_Response or the next Gemini_Api_Call, and only
+    // one call can be in flight at a time
     parsed_response_t* Gemini_Api_Call(const GeminiQuestionInfo *question_info);
+    // streaming version, on_text runs on the calling task for every piece of
+    // text. the result holds the whole answer once the stream has ended
+    parsed_response_t* Gemini_Api_Stream(const GeminiQuestionInfo *question_info, gemini_text_cb_t on_text, void *ctx);
+    // the clip is uploaded while read_pcm still hands it over, these block
+    // until the recording has stopped and the reply is in
+    parsed_response_t* Gemini_Api_Audio_Call(const GeminiAudioQuestion *audio_question);
+    parsed_response_t* Gemini_Api_Audio_Stream(const GeminiAudioQuestion *audio_question, gemini_text_cb_t on_text, void *ctx);
+    void Gemini_Free_Response(parsed_response_t *response);
+    // the https connection is kept open between calls. the policy decides
+    // when an idle one is dropped instead of reused
+    void Gemini_Set_Session_Policy(const gemini_session_policy_t *policy);
+    void Gemini_Close_Session(void);
+    // speculative connect from the record button, see GeminiPrewarm.h.
+    // Ini starts the task once wifi is up, From_Isr goes in the button's
+    // gpio interrupt and wakes it to take the radio out of power save,
+    // resolve the host and handshake while the question is recorded. the
+    // next call waits for it and goes out on that connection. Cancel when
+    // the recording is thrown away, Done once the answer is over
+    esp_err_t Gemini_Prewarm_Ini(void);
+    void Gemini_Prewarm_From_Isr(void);
+    void Gemini_Prewarm_Cancel(void);
+    void Gemini_Prewarm_Done(void);
+    // these expect to run inside Gemini_Api_Call, the payload and the reply
+    // state allocate from the request arena
     parsed_response_t parse_gemini_response(const char* json_string);
     extern char* create_gemini_json_payload(const char* new_question, const char* cached_content_name);
-    esp_err_t http_event_handler(esp_http_client_event_t *evt);
-    esp_err_t make_gemini_api_call(const char *question, char **response_data, const char *MODEL_NAME, const char *GEMINI_API_KEY);
+    esp_err_t make_gemini_api_call(const GeminiQuestionInfo *question_info, parsed_response_t *result, const char *model_name, const char *api_key);
+    esp_err_t make_gemini_stream_call(const GeminiQuestionInfo *question_info, parsed_response_t *result, const char *model_name, const char *api_key, gemini_text_cb_t on_text, void *ctx);
 
-#endif // GEMINI_API_H
\ No newline at end of file
+#endif // GEMINI_API_H
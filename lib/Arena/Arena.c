@@ -0,0 +1,190 @@
+#include "Arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// every block starts on the same boundary malloc gives
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ARENA_HEADER_SIZE                                                      \
+  ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+#define ARENA_HANDLE_SIZE                                                      \
+  ((sizeof(Arena) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+// PROTOTYPES
+Arena *Arena_Ini(size_t Chunk_Size);
+void *Arena_Alloc(Arena *handle, size_t Size);
+void *Arena_Realloc(Arena *handle, void *Old, size_t Old_Size,
+                    size_t New_Size);
+char *Arena_Strdup(Arena *handle, const char *String);
+int Arena_Owns(const Arena *handle, const void *Memory);
+void Arena_Reset(Arena *handle);
+void Arena_Destroy(Arena *handle);
+
+static ArenaChunk *Internal_Arena_Next_Chunk(Arena *handle, size_t Size);
+static uint8_t *Internal_Arena_Data(const ArenaChunk *Chunk);
+static size_t Internal_Arena_Round_Up(size_t Value);
+static void Internal_Arena_Count(Arena *handle, size_t Old_Size,
+                                 size_t New_Size);
+
+// FUNCTIONS
+// the handle and the first chunk are one claim, so a small arena that never
+// outgrows its first chunk costs a single malloc for its whole life
+Arena *Arena_Ini(size_t Chunk_Size) {
+  if (Chunk_Size == 0 ||
+      Chunk_Size > SIZE_MAX - ARENA_HANDLE_SIZE - ARENA_HEADER_SIZE) {
+    return NULL;
+  }
+  Arena *handle = malloc(ARENA_HANDLE_SIZE + ARENA_HEADER_SIZE + Chunk_Size);
+  if (handle == NULL) {
+    return NULL; // allocation failed
+  }
+  ArenaChunk *First = (ArenaChunk *)((uint8_t *)handle + ARENA_HANDLE_SIZE);
+  First->Next = NULL;
+  First->Size = Chunk_Size;
+  First->Used = 0;
+  handle->First = First;
+  handle->Current = First;
+  handle->Chunk_Size = Chunk_Size;
+  handle->Last_Alloc = NULL;
+  handle->Total_Used = 0;
+  handle->High_Water = 0;
+  return handle;
+}
+
+void *Arena_Alloc(Arena *handle, size_t Size) {
+  if (handle == NULL || Size == 0) {
+    return NULL;
+  }
+  ArenaChunk *Chunk = handle->Current;
+  size_t Offset = Internal_Arena_Round_Up(Chunk->Used);
+  if (Offset > Chunk->Size || Size > Chunk->Size - Offset) {
+    Chunk = Internal_Arena_Next_Chunk(handle, Size);
+    if (Chunk == NULL) {
+      return NULL; // allocation failed
+    }
+    Offset = 0;
+  }
+  Chunk->Used = Offset + Size;
+  void *Block = Internal_Arena_Data(Chunk) + Offset;
+  handle->Last_Alloc = Block;
+  Internal_Arena_Count(handle, 0, Size);
+  return Block;
+}
+
+// there is no per block size, so the caller says how big Old was. the
+// newest block grows in place while its chunk has room, which is what a
+// buffer filled a piece at a time wants
+void *Arena_Realloc(Arena *handle, void *Old, size_t Old_Size,
+                    size_t New_Size) {
+  if (Old == NULL) {
+    return Arena_Alloc(handle, New_Size);
+  }
+  if (handle == NULL || New_Size == 0) {
+    return NULL;
+  }
+  if (Old == handle->Last_Alloc) {
+    ArenaChunk *Chunk = handle->Current;
+    size_t Offset = (size_t)((uint8_t *)Old - Internal_Arena_Data(Chunk));
+    if (New_Size <= Chunk->Size - Offset) {
+      Chunk->Used = Offset + New_Size;
+      Internal_Arena_Count(handle, Old_Size, New_Size);
+      return Old;
+    }
+  }
+  void *Fresh = Arena_Alloc(handle, New_Size);
+  if (Fresh != NULL) {
+    memcpy(Fresh, Old, Old_Size < New_Size ? Old_Size : New_Size);
+  }
+  return Fresh;
+}
+
+char *Arena_Strdup(Arena *handle, const char *String) {
+  if (String == NULL) {
+    return NULL;
+  }
+  size_t Length = strlen(String) + 1;
+  char *Copy = Arena_Alloc(handle, Length);
+  if (Copy != NULL) {
+    memcpy(Copy, String, Length);
+  }
+  return Copy;
+}
+
+// 1 if Memory sits in any chunk of the arena, spare chunks included
+int Arena_Owns(const Arena *handle, const void *Memory) {
+  if (handle == NULL || Memory == NULL) {
+    return 0;
+  }
+  for (const ArenaChunk *Chunk = handle->First; Chunk != NULL;
+       Chunk = Chunk->Next) {
+    if ((uintptr_t)Memory - (uintptr_t)Internal_Arena_Data(Chunk) <
+        Chunk->Size) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// later chunks are emptied as the bump pointer reaches them again, so this
+// is O(1) however many chunks the last request needed
+void Arena_Reset(Arena *handle) {
+  if (handle == NULL) {
+    return;
+  }
+  handle->Current = handle->First;
+  handle->First->Used = 0;
+  handle->Last_Alloc = NULL;
+  handle->Total_Used = 0;
+}
+
+void Arena_Destroy(Arena *handle) {
+  if (handle == NULL) {
+    return;
+  }
+  ArenaChunk *Chunk = handle->First->Next;
+  while (Chunk != NULL) {
+    ArenaChunk *Next = Chunk->Next;
+    free(Chunk);
+    Chunk = Next;
+  }
+  free(handle); // takes the first chunk with it
+}
+
+// move on to the spare chunk after Current if it is big enough, otherwise
+// put a new one in front of it. oversize requests get a chunk of their own
+static ArenaChunk *Internal_Arena_Next_Chunk(Arena *handle, size_t Size) {
+  ArenaChunk *Next = handle->Current->Next;
+  if (Next == NULL || Next->Size < Size) {
+    size_t Data_Size = Size > handle->Chunk_Size ? Size : handle->Chunk_Size;
+    if (Data_Size > SIZE_MAX - ARENA_HEADER_SIZE) {
+      return NULL;
+    }
+    ArenaChunk *Fresh = malloc(ARENA_HEADER_SIZE + Data_Size);
+    if (Fresh == NULL) {
+      return NULL;
+    }
+    Fresh->Size = Data_Size;
+    Fresh->Next = Next;
+    handle->Current->Next = Fresh;
+    Next = Fresh;
+  }
+  Next->Used = 0;
+  handle->Current = Next;
+  return Next;
+}
+
+static uint8_t *Internal_Arena_Data(const ArenaChunk *Chunk) {
+  return (uint8_t *)Chunk + ARENA_HEADER_SIZE;
+}
+
+static size_t Internal_Arena_Round_Up(size_t Value) {
+  return (Value + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static void Internal_Arena_Count(Arena *handle, size_t Old_Size,
+                                 size_t New_Size) {
+  handle->Total_Used = handle->Total_Used - Old_Size + New_Size;
+  if (handle->Total_Used > handle->High_Water) {
+    handle->High_Water = handle->Total_Used;
+  }
+}
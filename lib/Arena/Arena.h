@@ -0,0 +1,39 @@
+// Arena.h
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bump allocator for memory that all dies at the same time, like everything
+// one gemini request touches. allocs are a pointer bump, there is no free,
+// and Arena_Reset hands the lot back in O(1). chunks are kept across resets
+// so a steady stream of requests stops touching the heap after the first
+
+typedef struct ArenaChunk { // one block of backing memory
+  struct ArenaChunk *Next;
+  size_t Size; // usable bytes after the header
+  size_t Used;
+} ArenaChunk;
+
+typedef struct {
+  ArenaChunk *First;   // lives in the same claim as the handle
+  ArenaChunk *Current; // chunk being bumped, later ones are spare
+  size_t Chunk_Size;   // usable bytes in a normal chunk
+  void *Last_Alloc;    // newest block, the only one that can grow in place
+  size_t Total_Used;   // bytes handed out since the last reset
+  size_t High_Water;   // most Total_Used has ever been
+} Arena;
+
+// The PUBLIC functions that users can call
+Arena *Arena_Ini(size_t Chunk_Size);
+void *Arena_Alloc(Arena *handle, size_t Size);
+void *Arena_Realloc(Arena *handle, void *Old, size_t Old_Size,
+                    size_t New_Size);
+char *Arena_Strdup(Arena *handle, const char *String);
+int Arena_Owns(const Arena *handle, const void *Memory);
+void Arena_Reset(Arena *handle);
+void Arena_Destroy(Arena *handle);
+
+#endif // ARENA_H
@@ -0,0 +1,197 @@
+/*
+    Description: the codec independent half of the encoder, see
+    AudioCodec.h. pcm is gathered into whole blocks here so each codec
+    only ever sees a full block, or the short one at the end. also the
+    plain wav codec and the pull adapter for the payload
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioCodec.h"
+#include <string.h>
+
+#define WAV_HEADER_SIZE 44
+
+// PROTOTYPES
+int Audio_Encoder_Ini(AudioEncoder *Encoder, const AudioEncoderConfig *Config);
+size_t Audio_Encoder_Push(AudioEncoder *Encoder, const int16_t *Pcm,
+                          size_t Count, uint8_t *Out);
+size_t Audio_Encoder_Finish(AudioEncoder *Encoder, uint8_t *Out);
+int Audio_Encode_Stream_Ini(AudioEncodeStream *Stream,
+                            const AudioEncoderConfig *Config,
+                            AudioPcmRead Read, void *Ctx);
+int Audio_Encode_Stream_Read(void *Ctx, uint8_t *Buf, size_t Size);
+static size_t Audio_Encoder_Header(AudioEncoder *Encoder, uint8_t *Out);
+static size_t Audio_Encoder_Block(AudioEncoder *Encoder, const int16_t *Pcm,
+                                  size_t Count, uint8_t *Out);
+static int Wav_Ini(AudioEncoder *Encoder);
+static size_t Wav_Header(AudioEncoder *Encoder, uint8_t *Out);
+static size_t Wav_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                         size_t Count, uint8_t *Out);
+static void Put_Le32(uint8_t *Out, uint32_t Value);
+
+const AudioCodec Audio_Codec_Wav = {
+    .Name = "wav",
+    .Mime_Type = "audio/wav",
+    .Default_Block = 320,
+    .Ini = Wav_Ini,
+    .Header = Wav_Header,
+    .Encode = Wav_Encode,
+};
+
+int Audio_Encoder_Ini(AudioEncoder *Encoder, const AudioEncoderConfig *Config) {
+  memset(Encoder, 0, sizeof(*Encoder));
+  if (Config->Codec == NULL || Config->Sample_Rate == 0 ||
+      Config->Drop_Bits > 8) {
+    return -1;
+  }
+  Encoder->Config = *Config;
+  Encoder->Block_Samples = Config->Block_Samples
+                               ? Config->Block_Samples
+                               : Config->Codec->Default_Block;
+  if (Encoder->Block_Samples > AUDIO_CODEC_MAX_BLOCK) {
+    return -1;
+  }
+  return Config->Codec->Ini(Encoder);
+}
+
+size_t Audio_Encoder_Push(AudioEncoder *Encoder, const int16_t *Pcm,
+                          size_t Count, uint8_t *Out) {
+  size_t Written = Audio_Encoder_Header(Encoder, Out);
+  Encoder->Samples_In += Count;
+  // a whole block straight from the caller's frame when nothing is waiting
+  if (Encoder->Pending == 0 && Count == Encoder->Block_Samples) {
+    return Written + Audio_Encoder_Block(Encoder, Pcm, Count, Out + Written);
+  }
+  size_t Room = Encoder->Block_Samples - Encoder->Pending;
+  size_t Take = Count < Room ? Count : Room;
+  memcpy(Encoder->Block + Encoder->Pending, Pcm, Take * sizeof(int16_t));
+  Encoder->Pending += Take;
+  if (Encoder->Pending == Encoder->Block_Samples) {
+    Written += Audio_Encoder_Block(Encoder, Encoder->Block,
+                                   Encoder->Block_Samples, Out + Written);
+    Encoder->Pending = Count - Take;
+    memcpy(Encoder->Block, Pcm + Take, Encoder->Pending * sizeof(int16_t));
+  }
+  return Written;
+}
+
+size_t Audio_Encoder_Finish(AudioEncoder *Encoder, uint8_t *Out) {
+  size_t Written = Audio_Encoder_Header(Encoder, Out);
+  if (Encoder->Pending > 0) {
+    Written += Audio_Encoder_Block(Encoder, Encoder->Block, Encoder->Pending,
+                                   Out + Written);
+    Encoder->Pending = 0;
+  }
+  return Written;
+}
+
+int Audio_Encode_Stream_Ini(AudioEncodeStream *Stream,
+                            const AudioEncoderConfig *Config,
+                            AudioPcmRead Read, void *Ctx) {
+  // Out is the big part and is written before it is read
+  memset(Stream, 0, offsetof(AudioEncodeStream, Out));
+  Stream->Out_Len = 0;
+  Stream->Out_Pos = 0;
+  Stream->Finished = false;
+  Stream->Read = Read;
+  Stream->Ctx = Ctx;
+  return Read == NULL ? -1 : Audio_Encoder_Ini(&Stream->Encoder, Config);
+}
+
+// a block's worth of pcm is read at a time so Out never has to hold more
+// than one block
+int Audio_Encode_Stream_Read(void *Ctx, uint8_t *Buf, size_t Size) {
+  AudioEncodeStream *Stream = (AudioEncodeStream *)Ctx;
+  while (Stream->Out_Pos == Stream->Out_Len) {
+    if (Stream->Finished) {
+      return 0;
+    }
+    Stream->Out_Pos = 0;
+    AudioEncoder *Encoder = &Stream->Encoder;
+    size_t Want = Encoder->Block_Samples - Encoder->Pending;
+    int Got = Stream->Read(Stream->Ctx, Encoder->Block + Encoder->Pending,
+                           Want);
+    if (Got < 0 || (size_t)Got > Want) {
+      return -1;
+    }
+    if (Got == 0) {
+      Stream->Out_Len = Audio_Encoder_Finish(Encoder, Stream->Out);
+      Stream->Finished = true;
+      continue;
+    }
+    // already in place, counted and blocked up the way a push would
+    Stream->Out_Len = Audio_Encoder_Header(Encoder, Stream->Out);
+    Encoder->Samples_In += (size_t)Got;
+    Encoder->Pending += (size_t)Got;
+    if (Encoder->Pending == Encoder->Block_Samples) {
+      Stream->Out_Len +=
+          Audio_Encoder_Block(Encoder, Encoder->Block, Encoder->Block_Samples,
+                              Stream->Out + Stream->Out_Len);
+      Encoder->Pending = 0;
+    }
+  }
+  size_t Left = Stream->Out_Len - Stream->Out_Pos;
+  size_t Give = Left < Size ? Left : Size;
+  memcpy(Buf, Stream->Out + Stream->Out_Pos, Give);
+  Stream->Out_Pos += Give;
+  return (int)Give;
+}
+
+static size_t Audio_Encoder_Header(AudioEncoder *Encoder, uint8_t *Out) {
+  if (Encoder->Header_Done) {
+    return 0;
+  }
+  Encoder->Header_Done = true;
+  size_t Written = Encoder->Config.Codec->Header(Encoder, Out);
+  Encoder->Bytes_Out += Written;
+  return Written;
+}
+
+static size_t Audio_Encoder_Block(AudioEncoder *Encoder, const int16_t *Pcm,
+                                  size_t Count, uint8_t *Out) {
+  size_t Written = Encoder->Config.Codec->Encode(Encoder, Pcm, Count, Out);
+  Encoder->Blocks++;
+  Encoder->Bytes_Out += Written;
+  return Written;
+}
+
+// WAV
+static int Wav_Ini(AudioEncoder *Encoder) {
+  return Encoder->Config.Drop_Bits == 0 ? 0 : -1;
+}
+
+// a clip still being recorded says it runs to the end of the stream
+static size_t Wav_Header(AudioEncoder *Encoder, uint8_t *Out) {
+  uint32_t Total = Encoder->Config.Total_Samples;
+  uint32_t Rate = Encoder->Config.Sample_Rate;
+  uint32_t Data_Size = Total ? Total * 2 : UINT32_MAX;
+  memcpy(Out, "RIFF", 4);
+  Put_Le32(Out + 4, Total ? Data_Size + 36 : UINT32_MAX);
+  memcpy(Out + 8, "WAVEfmt ", 8);
+  Put_Le32(Out + 16, 16);
+  Put_Le32(Out + 20, 1 | (1u << 16)); // pcm, mono
+  Put_Le32(Out + 24, Rate);
+  Put_Le32(Out + 28, Rate * 2);
+  Put_Le32(Out + 32, 2 | (16u << 16)); // block align, bits per sample
+  memcpy(Out + 36, "data", 4);
+  Put_Le32(Out + 40, Data_Size);
+  return WAV_HEADER_SIZE;
+}
+
+static size_t Wav_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                         size_t Count, uint8_t *Out) {
+  (void)Encoder;
+  for (size_t i = 0; i < Count; i++) {
+    uint16_t Sample = (uint16_t)Pcm[i];
+    Out[2 * i] = (uint8_t)Sample;
+    Out[2 * i + 1] = (uint8_t)(Sample >> 8);
+  }
+  return Count * 2;
+}
+
+static void Put_Le32(uint8_t *Out, uint32_t Value) {
+  Out[0] = (uint8_t)Value;
+  Out[1] = (uint8_t)(Value >> 8);
+  Out[2] = (uint8_t)(Value >> 16);
+  Out[3] = (uint8_t)(Value >> 24);
+}
@@ -0,0 +1,106 @@
+/*
+    Description: codec stage between the voice detector and the upload.
+    an encoder takes 16-bit mono pcm a frame at a time and gives back the
+    bytes of a complete file, container header first, that GeminiPayload
+    sends as inline_data with the codec's mime type. nothing is held back
+    apart from the samples of a block not yet full, so the upload can go
+    out while the question is still being recorded. the codecs are
+    - Audio_Codec_Wav, plain pcm wav, what the payload sent before
+    - Audio_Codec_Ima_Adpcm, ima adpcm wav, 4 bits a sample, a few
+      instructions a sample to encode
+    - Audio_Codec_Flac, lossless, fixed predictors and rice codes. with
+      Drop_Bits the low bits are rounded off first and flac stores the
+      samples that much narrower, a lossy mode with a higher ratio than
+      adpcm that gemini still takes as audio/flac
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// longest block any codec takes, in samples
+#define AUDIO_CODEC_MAX_BLOCK 1152
+// most bytes a header, a whole block and the end of a file can come to
+#define AUDIO_CODEC_OUT_MAX (64 + 32 + AUDIO_CODEC_MAX_BLOCK * 2)
+
+typedef struct AudioEncoder AudioEncoder;
+
+typedef struct {
+  const char *Name;
+  const char *Mime_Type;
+  size_t Default_Block; // samples
+  // -1 when the block length doesn't suit the codec
+  int (*Ini)(AudioEncoder *Encoder);
+  size_t (*Header)(AudioEncoder *Encoder, uint8_t *Out);
+  // Count is the block length, less only for the last block of a clip
+  size_t (*Encode)(AudioEncoder *Encoder, const int16_t *Pcm, size_t Count,
+                   uint8_t *Out);
+} AudioCodec;
+
+extern const AudioCodec Audio_Codec_Wav;
+extern const AudioCodec Audio_Codec_Ima_Adpcm;
+extern const AudioCodec Audio_Codec_Flac;
+
+typedef struct {
+  const AudioCodec *Codec;
+  uint32_t Sample_Rate;
+  uint32_t Total_Samples; // 0 while the length isn't known, the usual case
+  size_t Block_Samples;   // 0 for the codec's default
+  uint8_t Drop_Bits;      // flac only, low bits rounded off, up to 8
+} AudioEncoderConfig;
+
+struct AudioEncoder {
+  AudioEncoderConfig Config;
+  size_t Block_Samples;
+  size_t Pending; // samples waiting in Block for the rest of it
+  int16_t Block[AUDIO_CODEC_MAX_BLOCK];
+  bool Header_Done;
+  uint32_t Blocks; // encoded so far, flac numbers its frames with it
+  uint64_t Samples_In;
+  uint64_t Bytes_Out;
+  union { // codec state
+    struct {
+      int32_t Predictor;
+      int32_t Index;
+      size_t Block_Align;
+    } Adpcm;
+  } State;
+};
+
+// -1 when a codec is missing, the rate is 0 or the block length doesn't
+// suit the codec
+int Audio_Encoder_Ini(AudioEncoder *Encoder, const AudioEncoderConfig *Config);
+// Count up to the block length. whatever is ready goes into Out, which has
+// to hold AUDIO_CODEC_OUT_MAX. the header comes out with the first call
+size_t Audio_Encoder_Push(AudioEncoder *Encoder, const int16_t *Pcm,
+                          size_t Count, uint8_t *Out);
+// the partial block left, and the header for a clip with no samples at all
+size_t Audio_Encoder_Finish(AudioEncoder *Encoder, uint8_t *Out);
+
+// pulls pcm from a source and hands out the encoded file a piece at a
+// time, the shape GeminiPayload's read_encoded wants. for when the encode
+// runs on the task doing the upload
+typedef int (*AudioPcmRead)(void *Ctx, int16_t *Samples, size_t Max_Samples);
+
+typedef struct {
+  AudioEncoder Encoder;
+  AudioPcmRead Read; // same contract as gemini_pcm_read_t
+  void *Ctx;
+  uint8_t Out[AUDIO_CODEC_OUT_MAX];
+  size_t Out_Len;
+  size_t Out_Pos;
+  bool Finished;
+} AudioEncodeStream;
+
+int Audio_Encode_Stream_Ini(AudioEncodeStream *Stream,
+                            const AudioEncoderConfig *Config,
+                            AudioPcmRead Read, void *Ctx);
+// Ctx is the AudioEncodeStream. up to Size bytes of the file, 0 once it
+// has all gone, <0 if the source gave up
+int Audio_Encode_Stream_Read(void *Ctx, uint8_t *Buf, size_t Size);
+
+#endif // AUDIO_CODEC_H
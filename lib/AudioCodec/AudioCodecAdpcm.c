@@ -0,0 +1,158 @@
+/*
+    Description: ima adpcm in a wav file (format 0x11), see AudioCodec.h.
+    each block opens with its first sample in full and the step index,
+    the rest go 4 bits a sample, two to a byte with the earlier sample in
+    the low nibble. the predictor and step index run on from one block to
+    the next. the last block of a clip is held at its final sample to the
+    full block length since readers expect every block to be whole
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioCodec.h"
+#include <string.h>
+
+#define ADPCM_HEADER_SIZE 60
+#define ADPCM_BLOCK_HEADER 4
+
+// PROTOTYPES
+static int Adpcm_Ini(AudioEncoder *Encoder);
+static size_t Adpcm_Header(AudioEncoder *Encoder, uint8_t *Out);
+static size_t Adpcm_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                           size_t Count, uint8_t *Out);
+static uint8_t Adpcm_Nibble(int32_t *Predictor, int32_t *Index,
+                            int32_t Sample);
+static void Put_Le16(uint8_t *Out, uint16_t Value);
+static void Put_Le32(uint8_t *Out, uint32_t Value);
+
+static const int16_t Adpcm_Steps[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t Adpcm_Index_Step[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+// 505 samples is a 256 byte block, the size most readers were written for
+const AudioCodec Audio_Codec_Ima_Adpcm = {
+    .Name = "ima-adpcm",
+    .Mime_Type = "audio/wav",
+    .Default_Block = 505,
+    .Ini = Adpcm_Ini,
+    .Header = Adpcm_Header,
+    .Encode = Adpcm_Encode,
+};
+
+// the header sample and then whole bytes of two samples
+static int Adpcm_Ini(AudioEncoder *Encoder) {
+  if (Encoder->Config.Drop_Bits != 0 || Encoder->Block_Samples < 3 ||
+      Encoder->Block_Samples % 2 == 0) {
+    return -1;
+  }
+  Encoder->State.Adpcm.Predictor = 0;
+  Encoder->State.Adpcm.Index = 0;
+  Encoder->State.Adpcm.Block_Align =
+      ADPCM_BLOCK_HEADER + (Encoder->Block_Samples - 1) / 2;
+  return 0;
+}
+
+static size_t Adpcm_Header(AudioEncoder *Encoder, uint8_t *Out) {
+  uint32_t Rate = Encoder->Config.Sample_Rate;
+  uint32_t Total = Encoder->Config.Total_Samples;
+  uint32_t Block_Samples = (uint32_t)Encoder->Block_Samples;
+  uint32_t Block_Align = (uint32_t)Encoder->State.Adpcm.Block_Align;
+  uint32_t Data_Size =
+      Total ? (Total + Block_Samples - 1) / Block_Samples * Block_Align
+            : UINT32_MAX;
+  memcpy(Out, "RIFF", 4);
+  Put_Le32(Out + 4, Total ? Data_Size + ADPCM_HEADER_SIZE - 8 : UINT32_MAX);
+  memcpy(Out + 8, "WAVEfmt ", 8);
+  Put_Le32(Out + 16, 20);
+  Put_Le16(Out + 20, 0x11); // ima adpcm
+  Put_Le16(Out + 22, 1);    // mono
+  Put_Le32(Out + 24, Rate);
+  Put_Le32(Out + 28,
+           (uint32_t)((uint64_t)Rate * Block_Align / Block_Samples));
+  Put_Le16(Out + 32, (uint16_t)Block_Align);
+  Put_Le16(Out + 34, 4); // bits per sample
+  Put_Le16(Out + 36, 2); // extra format bytes
+  Put_Le16(Out + 38, (uint16_t)Block_Samples);
+  memcpy(Out + 40, "fact", 4);
+  Put_Le32(Out + 44, 4);
+  Put_Le32(Out + 48, Total ? Total : UINT32_MAX);
+  memcpy(Out + 52, "data", 4);
+  Put_Le32(Out + 56, Data_Size);
+  return ADPCM_HEADER_SIZE;
+}
+
+static size_t Adpcm_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                           size_t Count, uint8_t *Out) {
+  int32_t Predictor = Pcm[0];
+  int32_t Index = Encoder->State.Adpcm.Index;
+  Put_Le16(Out, (uint16_t)Pcm[0]);
+  Out[2] = (uint8_t)Index;
+  Out[3] = 0;
+  uint8_t *Data = Out + ADPCM_BLOCK_HEADER;
+  const int32_t Hold = Pcm[Count - 1];
+  for (size_t i = 1; i < Encoder->Block_Samples; i += 2) {
+    int32_t First = i < Count ? Pcm[i] : Hold;
+    int32_t Second = i + 1 < Count ? Pcm[i + 1] : Hold;
+    uint8_t Low = Adpcm_Nibble(&Predictor, &Index, First);
+    uint8_t High = Adpcm_Nibble(&Predictor, &Index, Second);
+    *Data++ = (uint8_t)(Low | High << 4);
+  }
+  Encoder->State.Adpcm.Predictor = Predictor;
+  Encoder->State.Adpcm.Index = Index;
+  return Encoder->State.Adpcm.Block_Align;
+}
+
+// one sample against the prediction, the step halves for each bit so the
+// decoder's reconstruction is exactly what Predictor becomes
+static uint8_t Adpcm_Nibble(int32_t *Predictor, int32_t *Index,
+                            int32_t Sample) {
+  int32_t Step = Adpcm_Steps[*Index];
+  int32_t Diff = Sample - *Predictor;
+  uint8_t Code = 0;
+  if (Diff < 0) {
+    Code = 8;
+    Diff = -Diff;
+  }
+  int32_t Delta = Step >> 3;
+  if (Diff >= Step) {
+    Code |= 4;
+    Diff -= Step;
+    Delta += Step;
+  }
+  Step >>= 1;
+  if (Diff >= Step) {
+    Code |= 2;
+    Diff -= Step;
+    Delta += Step;
+  }
+  Step >>= 1;
+  if (Diff >= Step) {
+    Code |= 1;
+    Delta += Step;
+  }
+  int32_t Next = (Code & 8) ? *Predictor - Delta : *Predictor + Delta;
+  *Predictor = Next > INT16_MAX ? INT16_MAX : Next < INT16_MIN ? INT16_MIN : Next;
+  int32_t Next_Index = *Index + Adpcm_Index_Step[Code & 7];
+  *Index = Next_Index < 0 ? 0 : Next_Index > 88 ? 88 : Next_Index;
+  return Code;
+}
+
+static void Put_Le16(uint8_t *Out, uint16_t Value) {
+  Out[0] = (uint8_t)Value;
+  Out[1] = (uint8_t)(Value >> 8);
+}
+
+static void Put_Le32(uint8_t *Out, uint32_t Value) {
+  Out[0] = (uint8_t)Value;
+  Out[1] = (uint8_t)(Value >> 8);
+  Out[2] = (uint8_t)(Value >> 16);
+  Out[3] = (uint8_t)(Value >> 24);
+}
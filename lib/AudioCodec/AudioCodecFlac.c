@@ -0,0 +1,437 @@
+/*
+    Description: flac encoder for 16-bit mono, see AudioCodec.h. every
+    block is one flac frame of one subframe, whichever of constant, the
+    fixed predictors of order 0 to 4 or verbatim is smallest. residuals
+    are rice coded with the partition order and the parameters picked from
+    the sums of the residuals, the way libFLAC estimates them, so nothing
+    is written twice. low bits that are zero in every sample of a block are
+    stored as wasted bits, which is what Drop_Bits relies on. the stream
+    stays inside the streamable subset and the stream info leaves the
+    length, frame sizes and md5 unknown so it can be written before the
+    first sample is in
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioCodec.h"
+#include <string.h>
+
+#define FLAC_HEADER_SIZE 42
+#define FLAC_MAX_ORDER 4
+#define FLAC_MAX_PARTITION_ORDER 8
+#define FLAC_MAX_RICE 14 // 15 is the escape code
+#define FLAC_SUBFRAME_CONSTANT 0x00
+#define FLAC_SUBFRAME_VERBATIM 0x01
+#define FLAC_SUBFRAME_FIXED 0x08
+
+typedef struct { // msb first into Out
+  uint8_t *Out;
+  size_t Pos;
+  uint64_t Acc;
+  unsigned Bits; // in Acc, always under 8 between calls
+} FlacBits;
+
+typedef struct { // how the residual of the chosen predictor is coded
+  unsigned Partition_Order;
+  uint8_t Rice[1 << FLAC_MAX_PARTITION_ORDER];
+  uint64_t Bits;
+} FlacRice;
+
+// PROTOTYPES
+static int Flac_Ini(AudioEncoder *Encoder);
+static size_t Flac_Header(AudioEncoder *Encoder, uint8_t *Out);
+static size_t Flac_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                          size_t Count, uint8_t *Out);
+static unsigned Flac_Best_Order(const int32_t *X, size_t Count);
+static void Flac_Residual(const int32_t *X, size_t Count, unsigned Order,
+                          uint32_t *U);
+static void Flac_Best_Rice(const uint32_t *U, size_t Count, unsigned Order,
+                           FlacRice *Rice);
+static unsigned Flac_Rice_Parameter(uint64_t Sum, size_t Count,
+                                    uint64_t *Bits);
+static void Flac_Frame_Header(AudioEncoder *Encoder, size_t Count,
+                              FlacBits *Bits);
+static void Bits_Put(FlacBits *Bits, uint32_t Value, unsigned Count);
+static void Bits_Put_Rice(FlacBits *Bits, uint32_t Value, unsigned Rice);
+static void Bits_Align(FlacBits *Bits);
+static uint8_t Flac_Crc8(const uint8_t *Data, size_t Len);
+static uint16_t Flac_Crc16(const uint8_t *Data, size_t Len);
+
+// crc-16 with the polynomial 0x8005, one step per byte
+static const uint16_t Flac_Crc16_Table[256] = {
+    0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011,
+    0x8033, 0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022,
+    0x8063, 0x0066, 0x006c, 0x8069, 0x0078, 0x807d, 0x8077, 0x0072,
+    0x0050, 0x8055, 0x805f, 0x005a, 0x804b, 0x004e, 0x0044, 0x8041,
+    0x80c3, 0x00c6, 0x00cc, 0x80c9, 0x00d8, 0x80dd, 0x80d7, 0x00d2,
+    0x00f0, 0x80f5, 0x80ff, 0x00fa, 0x80eb, 0x00ee, 0x00e4, 0x80e1,
+    0x00a0, 0x80a5, 0x80af, 0x00aa, 0x80bb, 0x00be, 0x00b4, 0x80b1,
+    0x8093, 0x0096, 0x009c, 0x8099, 0x0088, 0x808d, 0x8087, 0x0082,
+    0x8183, 0x0186, 0x018c, 0x8189, 0x0198, 0x819d, 0x8197, 0x0192,
+    0x01b0, 0x81b5, 0x81bf, 0x01ba, 0x81ab, 0x01ae, 0x01a4, 0x81a1,
+    0x01e0, 0x81e5, 0x81ef, 0x01ea, 0x81fb, 0x01fe, 0x01f4, 0x81f1,
+    0x81d3, 0x01d6, 0x01dc, 0x81d9, 0x01c8, 0x81cd, 0x81c7, 0x01c2,
+    0x0140, 0x8145, 0x814f, 0x014a, 0x815b, 0x015e, 0x0154, 0x8151,
+    0x8173, 0x0176, 0x017c, 0x8179, 0x0168, 0x816d, 0x8167, 0x0162,
+    0x8123, 0x0126, 0x012c, 0x8129, 0x0138, 0x813d, 0x8137, 0x0132,
+    0x0110, 0x8115, 0x811f, 0x011a, 0x810b, 0x010e, 0x0104, 0x8101,
+    0x8303, 0x0306, 0x030c, 0x8309, 0x0318, 0x831d, 0x8317, 0x0312,
+    0x0330, 0x8335, 0x833f, 0x033a, 0x832b, 0x032e, 0x0324, 0x8321,
+    0x0360, 0x8365, 0x836f, 0x036a, 0x837b, 0x037e, 0x0374, 0x8371,
+    0x8353, 0x0356, 0x035c, 0x8359, 0x0348, 0x834d, 0x8347, 0x0342,
+    0x03c0, 0x83c5, 0x83cf, 0x03ca, 0x83db, 0x03de, 0x03d4, 0x83d1,
+    0x83f3, 0x03f6, 0x03fc, 0x83f9, 0x03e8, 0x83ed, 0x83e7, 0x03e2,
+    0x83a3, 0x03a6, 0x03ac, 0x83a9, 0x03b8, 0x83bd, 0x83b7, 0x03b2,
+    0x0390, 0x8395, 0x839f, 0x039a, 0x838b, 0x038e, 0x0384, 0x8381,
+    0x0280, 0x8285, 0x828f, 0x028a, 0x829b, 0x029e, 0x0294, 0x8291,
+    0x82b3, 0x02b6, 0x02bc, 0x82b9, 0x02a8, 0x82ad, 0x82a7, 0x02a2,
+    0x82e3, 0x02e6, 0x02ec, 0x82e9, 0x02f8, 0x82fd, 0x82f7, 0x02f2,
+    0x02d0, 0x82d5, 0x82df, 0x02da, 0x82cb, 0x02ce, 0x02c4, 0x82c1,
+    0x8243, 0x0246, 0x024c, 0x8249, 0x0258, 0x825d, 0x8257, 0x0252,
+    0x0270, 0x8275, 0x827f, 0x027a, 0x826b, 0x026e, 0x0264, 0x8261,
+    0x0220, 0x8225, 0x822f, 0x022a, 0x823b, 0x023e, 0x0234, 0x8231,
+    0x8213, 0x0216, 0x021c, 0x8219, 0x0208, 0x820d, 0x8207, 0x0202,
+};
+
+// one capture frame per flac frame
+const AudioCodec Audio_Codec_Flac = {
+    .Name = "flac",
+    .Mime_Type = "audio/flac",
+    .Default_Block = 320,
+    .Ini = Flac_Ini,
+    .Header = Flac_Header,
+    .Encode = Flac_Encode,
+};
+
+// the subset allows 16 to 16384 samples a block and rates up to 655350
+static int Flac_Ini(AudioEncoder *Encoder) {
+  if (Encoder->Block_Samples < 16 || Encoder->Config.Sample_Rate > 655350) {
+    return -1;
+  }
+  return 0;
+}
+
+static size_t Flac_Header(AudioEncoder *Encoder, uint8_t *Out) {
+  FlacBits Bits = {.Out = Out};
+  memcpy(Out, "fLaC", 4);
+  Bits.Pos = 4;
+  Bits_Put(&Bits, 0x80, 8); // last metadata block, stream info
+  Bits_Put(&Bits, 34, 24);
+  Bits_Put(&Bits, (uint32_t)Encoder->Block_Samples, 16); // min block
+  Bits_Put(&Bits, (uint32_t)Encoder->Block_Samples, 16); // max block
+  Bits_Put(&Bits, 0, 24); // frame sizes unknown
+  Bits_Put(&Bits, 0, 24);
+  Bits_Put(&Bits, Encoder->Config.Sample_Rate, 20);
+  Bits_Put(&Bits, 0, 3);  // one channel
+  Bits_Put(&Bits, 15, 5); // 16 bits a sample
+  Bits_Put(&Bits, 0, 4);  // top of the 36-bit sample count
+  Bits_Put(&Bits, Encoder->Config.Total_Samples, 32);
+  memset(Out + Bits.Pos, 0, 16); // md5 unknown
+  return FLAC_HEADER_SIZE;
+}
+
+static size_t Flac_Encode(AudioEncoder *Encoder, const int16_t *Pcm,
+                          size_t Count, uint8_t *Out) {
+  int32_t X[AUDIO_CODEC_MAX_BLOCK];
+  uint32_t U[AUDIO_CODEC_MAX_BLOCK];
+  // round off the dropped bits, the top is kept in range
+  const unsigned Drop = Encoder->Config.Drop_Bits;
+  uint32_t Ored = 0;
+  for (size_t i = 0; i < Count; i++) {
+    int32_t Sample = Pcm[i];
+    if (Drop > 0) {
+      Sample = (Sample + (1 << (Drop - 1))) >> Drop;
+      Sample = Sample > (INT16_MAX >> Drop) ? INT16_MAX >> Drop : Sample;
+      Sample *= 1 << Drop;
+    }
+    X[i] = Sample;
+    Ored |= (uint32_t)Sample;
+  }
+  unsigned Wasted = 0;
+  if (Ored != 0) {
+    while (((Ored >> Wasted) & 1) == 0) {
+      Wasted++;
+    }
+    for (size_t i = 0; i < Count; i++) {
+      X[i] >>= Wasted;
+    }
+  }
+  const unsigned Bps = 16 - Wasted;
+  bool Constant = true;
+  for (size_t i = 1; i < Count && Constant; i++) {
+    Constant = X[i] == X[0];
+  }
+
+  FlacBits Bits = {.Out = Out};
+  Flac_Frame_Header(Encoder, Count, &Bits);
+  if (Constant) {
+    Bits_Put(&Bits, FLAC_SUBFRAME_CONSTANT << 1, 8);
+    Bits_Put(&Bits, (uint32_t)X[0] << Wasted, 16);
+  } else {
+    unsigned Order = Flac_Best_Order(X, Count);
+    Flac_Residual(X, Count, Order, U);
+    FlacRice Rice;
+    Flac_Best_Rice(U, Count, Order, &Rice);
+    bool Fixed = (uint64_t)Order * Bps + Rice.Bits < (uint64_t)Count * Bps;
+    uint32_t Type = Fixed ? FLAC_SUBFRAME_FIXED | Order : FLAC_SUBFRAME_VERBATIM;
+    Bits_Put(&Bits, Type << 1 | (Wasted > 0), 8);
+    if (Wasted > 0) {
+      Bits_Put(&Bits, 1, Wasted); // wasted - 1 in unary
+    }
+    const uint32_t Mask = (1u << Bps) - 1;
+    size_t Raw = Fixed ? Order : Count;
+    for (size_t i = 0; i < Raw; i++) {
+      Bits_Put(&Bits, (uint32_t)X[i] & Mask, Bps);
+    }
+    if (Fixed) {
+      const unsigned Partitions = 1u << Rice.Partition_Order;
+      Bits_Put(&Bits, 0, 2); // 4-bit rice parameters
+      Bits_Put(&Bits, Rice.Partition_Order, 4);
+      size_t Pos = Order;
+      for (unsigned p = 0; p < Partitions; p++) {
+        size_t End = (Count >> Rice.Partition_Order) * (p + 1);
+        Bits_Put(&Bits, Rice.Rice[p], 4);
+        for (; Pos < End; Pos++) {
+          Bits_Put_Rice(&Bits, U[Pos], Rice.Rice[p]);
+        }
+      }
+    }
+  }
+  Bits_Align(&Bits);
+  uint16_t Crc = Flac_Crc16(Out, Bits.Pos);
+  Out[Bits.Pos++] = (uint8_t)(Crc >> 8);
+  Out[Bits.Pos++] = (uint8_t)Crc;
+  return Bits.Pos;
+}
+
+// the order whose residual has the smallest sum of magnitudes. each order
+// is the difference of the one below so they all come out of one pass
+static unsigned Flac_Best_Order(const int32_t *X, size_t Count) {
+  unsigned Max_Order = Count - 1 < FLAC_MAX_ORDER ? Count - 1 : FLAC_MAX_ORDER;
+  uint64_t Sum[FLAC_MAX_ORDER + 1] = {0};
+  for (size_t i = FLAC_MAX_ORDER; i < Count; i++) {
+    int32_t E0 = X[i];
+    int32_t E1 = E0 - X[i - 1];
+    int32_t E2 = E1 - (X[i - 1] - X[i - 2]);
+    int32_t E3 = E2 - (X[i - 1] - 2 * X[i - 2] + X[i - 3]);
+    int32_t E4 =
+        E3 - (X[i - 1] - 3 * X[i - 2] + 3 * X[i - 3] - X[i - 4]);
+    Sum[0] += (uint32_t)(E0 < 0 ? -E0 : E0);
+    Sum[1] += (uint32_t)(E1 < 0 ? -E1 : E1);
+    Sum[2] += (uint32_t)(E2 < 0 ? -E2 : E2);
+    Sum[3] += (uint32_t)(E3 < 0 ? -E3 : E3);
+    Sum[4] += (uint32_t)(E4 < 0 ? -E4 : E4);
+  }
+  unsigned Best = 0;
+  for (unsigned Order = 1; Order <= Max_Order; Order++) {
+    if (Sum[Order] < Sum[Best]) {
+      Best = Order;
+    }
+  }
+  return Best;
+}
+
+// zigzagged so the rice codes see 0, -1, 1, -2 as 0, 1, 2, 3
+static void Flac_Residual(const int32_t *X, size_t Count, unsigned Order,
+                          uint32_t *U) {
+  for (size_t i = Order; i < Count; i++) {
+    int32_t E;
+    switch (Order) {
+    case 0:
+      E = X[i];
+      break;
+    case 1:
+      E = X[i] - X[i - 1];
+      break;
+    case 2:
+      E = X[i] - 2 * X[i - 1] + X[i - 2];
+      break;
+    case 3:
+      E = X[i] - 3 * X[i - 1] + 3 * X[i - 2] - X[i - 3];
+      break;
+    default:
+      E = X[i] - 4 * X[i - 1] + 6 * X[i - 2] - 4 * X[i - 3] + X[i - 4];
+      break;
+    }
+    U[i] = (uint32_t)E << 1 ^ (uint32_t)(E >> 31);
+  }
+}
+
+// sums for the finest partitioning first, each coarser one adds pairs
+static void Flac_Best_Rice(const uint32_t *U, size_t Count, unsigned Order,
+                           FlacRice *Rice) {
+  unsigned Max_Order = 0;
+  while (Max_Order < FLAC_MAX_PARTITION_ORDER &&
+         Count % (2u << Max_Order) == 0 && (Count >> (Max_Order + 1)) > Order) {
+    Max_Order++;
+  }
+  uint64_t Sums[1 << FLAC_MAX_PARTITION_ORDER];
+  const size_t Finest = Count >> Max_Order;
+  for (unsigned p = 0; p < (1u << Max_Order); p++) {
+    size_t Pos = p == 0 ? Order : Finest * p;
+    uint64_t Sum = 0;
+    for (; Pos < Finest * (p + 1); Pos++) {
+      Sum += U[Pos];
+    }
+    Sums[p] = Sum;
+  }
+  Rice->Bits = UINT64_MAX;
+  for (int Partition_Order = (int)Max_Order; Partition_Order >= 0;
+       Partition_Order--) {
+    const unsigned Partitions = 1u << Partition_Order;
+    const size_t Length = Count >> Partition_Order;
+    uint8_t Params[1 << FLAC_MAX_PARTITION_ORDER];
+    uint64_t Total = 6; // coding method and partition order
+    for (unsigned p = 0; p < Partitions; p++) {
+      uint64_t Bits;
+      Params[p] = (uint8_t)Flac_Rice_Parameter(
+          Sums[p], p == 0 ? Length - Order : Length, &Bits);
+      Total += 4 + Bits;
+    }
+    if (Total < Rice->Bits) {
+      Rice->Bits = Total;
+      Rice->Partition_Order = (unsigned)Partition_Order;
+      memcpy(Rice->Rice, Params, Partitions);
+    }
+    for (unsigned p = 0; p < Partitions / 2; p++) {
+      Sums[p] = Sums[2 * p] + Sums[2 * p + 1];
+    }
+  }
+}
+
+// n * (k + 1) + sum >> k is never below the bits rice k really takes, so
+// the estimate is safe to hold against verbatim
+static unsigned Flac_Rice_Parameter(uint64_t Sum, size_t Count,
+                                    uint64_t *Bits) {
+  unsigned Best = 0;
+  *Bits = UINT64_MAX;
+  for (unsigned k = 0; k <= FLAC_MAX_RICE; k++) {
+    uint64_t Cost = (uint64_t)Count * (k + 1) + (Sum >> k);
+    if (Cost < *Bits) {
+      *Bits = Cost;
+      Best = k;
+    }
+  }
+  return Best;
+}
+
+// sync, block size and rate codes from the subset tables where they fit,
+// utf-8 style frame number, then the crc-8 of all of it
+static void Flac_Frame_Header(AudioEncoder *Encoder, size_t Count,
+                              FlacBits *Bits) {
+  static const uint32_t Rates[] = {0,     88200, 176400, 192000,
+                                   8000,  16000, 22050,  24000,
+                                   32000, 44100, 48000,  96000};
+  const uint32_t Rate = Encoder->Config.Sample_Rate;
+  uint32_t Rate_Code = 0;
+  for (uint32_t c = 1; c < sizeof(Rates) / sizeof(Rates[0]); c++) {
+    if (Rates[c] == Rate) {
+      Rate_Code = c;
+    }
+  }
+  if (Rate_Code == 0) {
+    Rate_Code = Rate % 1000 == 0 && Rate / 1000 <= 255 ? 12
+                : Rate <= 65535                         ? 13
+                                                        : 14;
+  }
+  uint32_t Size_Code = Count <= 256 ? 6 : 7;
+  if (Count == 192) {
+    Size_Code = 1;
+  } else {
+    for (uint32_t c = 0; c < 4; c++) {
+      if (Count == 576u << c) {
+        Size_Code = 2 + c;
+      }
+    }
+    for (uint32_t c = 0; c < 8; c++) {
+      if (Count == 256u << c) {
+        Size_Code = 8 + c;
+      }
+    }
+  }
+
+  Bits_Put(Bits, 0xfff8, 16); // sync, fixed block size
+  Bits_Put(Bits, Size_Code << 4 | Rate_Code, 8);
+  Bits_Put(Bits, 0x08, 8); // mono, 16 bits
+  uint32_t Frame = Encoder->Blocks;
+  if (Frame < 0x80) {
+    Bits_Put(Bits, Frame, 8);
+  } else {
+    unsigned Extra = Frame < 0x800       ? 1
+                     : Frame < 0x10000   ? 2
+                     : Frame < 0x200000  ? 3
+                     : Frame < 0x4000000 ? 4
+                                         : 5;
+    uint32_t Lead = (0xff00u >> (Extra + 1)) & 0xff;
+    Bits_Put(Bits, Lead | Frame >> (6 * Extra), 8);
+    for (unsigned i = Extra; i-- > 0;) {
+      Bits_Put(Bits, 0x80 | ((Frame >> (6 * i)) & 0x3f), 8);
+    }
+  }
+  if (Size_Code == 6) {
+    Bits_Put(Bits, (uint32_t)Count - 1, 8);
+  } else if (Size_Code == 7) {
+    Bits_Put(Bits, (uint32_t)Count - 1, 16);
+  }
+  if (Rate_Code == 12) {
+    Bits_Put(Bits, Rate / 1000, 8);
+  } else if (Rate_Code == 13) {
+    Bits_Put(Bits, Rate, 16);
+  } else if (Rate_Code == 14) {
+    Bits_Put(Bits, Rate / 10, 16);
+  }
+  Bits_Put(Bits, Flac_Crc8(Bits->Out, Bits->Pos), 8);
+}
+
+// Count up to 32
+static void Bits_Put(FlacBits *Bits, uint32_t Value, unsigned Count) {
+  if (Count == 0) {
+    return;
+  }
+  Bits->Acc = Bits->Acc << Count | (Value & (UINT32_MAX >> (32 - Count)));
+  Bits->Bits += Count;
+  while (Bits->Bits >= 8) {
+    Bits->Bits -= 8;
+    Bits->Out[Bits->Pos++] = (uint8_t)(Bits->Acc >> Bits->Bits);
+  }
+}
+
+// the quotient in unary as zeros and a one, then the low Rice bits
+static void Bits_Put_Rice(FlacBits *Bits, uint32_t Value, unsigned Rice) {
+  uint32_t Quotient = Value >> Rice;
+  while (Quotient >= 32) {
+    Bits_Put(Bits, 0, 32);
+    Quotient -= 32;
+  }
+  if (Quotient + 1 + Rice <= 32) {
+    Bits_Put(Bits, 1u << Rice | (Value & ((1u << Rice) - 1)),
+             Quotient + 1 + Rice);
+  } else {
+    Bits_Put(Bits, 1, Quotient + 1);
+    Bits_Put(Bits, Value, Rice);
+  }
+}
+
+static void Bits_Align(FlacBits *Bits) {
+  if (Bits->Bits > 0) {
+    Bits_Put(Bits, 0, 8 - Bits->Bits);
+  }
+}
+
+static uint8_t Flac_Crc8(const uint8_t *Data, size_t Len) {
+  uint8_t Crc = 0;
+  for (size_t i = 0; i < Len; i++) {
+    Crc ^= Data[i];
+    for (int b = 0; b < 8; b++) {
+      Crc = Crc & 0x80 ? (uint8_t)(Crc << 1 ^ 0x07) : (uint8_t)(Crc << 1);
+    }
+  }
+  return Crc;
+}
+
+static uint16_t Flac_Crc16(const uint8_t *Data, size_t Len) {
+  uint16_t Crc = 0;
+  for (size_t i = 0; i < Len; i++) {
+    Crc = (uint16_t)(Crc << 8) ^ Flac_Crc16_Table[(Crc >> 8) ^ Data[i]];
+  }
+  return Crc;
+}
@@ -0,0 +1,219 @@
+/*
+    Description: encode task, see AudioEncodeTask.h. the encoder and its
+    output block are static so the task stack stays small, one block of
+    encoded bytes is queued at a time. the time each frame takes is kept
+    so the per frame cost on the board can be set against the host bench
+    Creator: Matthew Ayestaran
+*/
+
+#ifdef ESP_PLATFORM
+
+#include "AudioEncodeTask.h"
+#include "I2S_Audio_Controller.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "Audio_Encode";
+
+#define AUDIO_ENCODE_TASK_STACK 4096
+// how long a wait for a frame or for room in the stream can go before the
+// flags are looked at again
+#define AUDIO_ENCODE_POLL_MS 20
+
+typedef struct {
+  AudioEncodeTaskConfig Config;
+  size_t Frame_Samples;
+  AudioEncoder Encoder;
+  AudioVad Vad;
+  uint8_t Out[AUDIO_CODEC_OUT_MAX];
+  StreamBufferHandle_t Stream;
+  TaskHandle_t Task;
+  SemaphoreHandle_t Stopped; // given when the task has finished the file
+  volatile bool Running;     // cleared by Stop, the recording is over
+  volatile bool Aborted;     // set by Deinit, nobody reads any more
+  volatile bool Done;        // the whole file is in the stream
+  volatile bool Failed;
+  AudioEncodeStats Stats;
+} AudioEncodeState;
+
+static AudioEncodeState Encode;
+
+// PROTOTYPES
+esp_err_t Audio_Encode_Task_Start(const AudioEncodeTaskConfig *Config,
+                                  PoolMemoryInfo *Pool, size_t Frame_Samples);
+void Audio_Encode_Task_Stop(void);
+int Audio_Encode_Task_Read(void *Ctx, uint8_t *Buf, size_t Size);
+const char *Audio_Encode_Task_Mime_Type(void);
+void Audio_Encode_Task_Get_Stats(AudioEncodeStats *Stats);
+void Audio_Encode_Task_Deinit(void);
+static void Audio_Encode_Task(void *Argument);
+static void Audio_Encode_Frame(AudioFrame *Frame);
+static void Audio_Encode_Send(size_t Len);
+
+esp_err_t Audio_Encode_Task_Start(const AudioEncodeTaskConfig *Config,
+                                  PoolMemoryInfo *Pool, size_t Frame_Samples) {
+  if (Encode.Task != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&Encode.Stats, 0, sizeof(Encode.Stats));
+  Encode.Config = *Config;
+  Encode.Frame_Samples = Frame_Samples;
+  Encode.Done = false;
+  Encode.Failed = false;
+  Encode.Aborted = false;
+  if (Audio_Encoder_Ini(&Encode.Encoder, &Config->Encoder) != 0 ||
+      (Config->Use_Vad &&
+       Audio_Vad_Ini(&Encode.Vad, &Config->Vad, Pool,
+                     Config->Encoder.Sample_Rate, Frame_Samples) != 0)) {
+    ESP_LOGE(TAG, "Bad encoder or vad config");
+    return ESP_ERR_INVALID_ARG;
+  }
+  Encode.Stream = xStreamBufferCreate(Config->Stream_Bytes, 1);
+  Encode.Stopped = xSemaphoreCreateBinary();
+  if (Encode.Stream == NULL || Encode.Stopped == NULL) {
+    Audio_Encode_Task_Deinit();
+    return ESP_ERR_NO_MEM;
+  }
+  Encode.Running = true;
+  if (xTaskCreatePinnedToCore(Audio_Encode_Task, "audio_encode",
+                              AUDIO_ENCODE_TASK_STACK, NULL,
+                              Config->Task_Priority, &Encode.Task,
+                              Config->Task_Core) != pdPASS) {
+    Encode.Running = false;
+    Audio_Encode_Task_Deinit();
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+void Audio_Encode_Task_Stop(void) { Encode.Running = false; }
+
+// Done is read before the stream so an empty read after it really is the end
+int Audio_Encode_Task_Read(void *Ctx, uint8_t *Buf, size_t Size) {
+  if (Encode.Stream == NULL) {
+    return -1;
+  }
+  for (;;) {
+    bool Done = Encode.Done;
+    size_t Got =
+        xStreamBufferReceive(Encode.Stream, Buf, Size,
+                             Done ? 0 : pdMS_TO_TICKS(AUDIO_ENCODE_POLL_MS));
+    if (Got > 0) {
+      return (int)Got;
+    }
+    if (Done) {
+      return Encode.Failed ? -1 : 0;
+    }
+  }
+}
+
+const char *Audio_Encode_Task_Mime_Type(void) {
+  return Encode.Config.Encoder.Codec->Mime_Type;
+}
+
+void Audio_Encode_Task_Get_Stats(AudioEncodeStats *Stats) {
+  *Stats = Encode.Stats;
+}
+
+void Audio_Encode_Task_Deinit(void) {
+  Encode.Running = false;
+  Encode.Aborted = true;
+  if (Encode.Task != NULL) {
+    xSemaphoreTake(Encode.Stopped, portMAX_DELAY);
+    Encode.Task = NULL;
+  }
+  if (Encode.Stream != NULL) {
+    vStreamBufferDelete(Encode.Stream);
+    Encode.Stream = NULL;
+  }
+  if (Encode.Stopped != NULL) {
+    vSemaphoreDelete(Encode.Stopped);
+    Encode.Stopped = NULL;
+  }
+}
+
+// after Stop the ring is emptied before the file is finished
+static void Audio_Encode_Task(void *Argument) {
+  const TickType_t Poll = pdMS_TO_TICKS(AUDIO_ENCODE_POLL_MS);
+  while (!Encode.Aborted) {
+    bool Running = Encode.Running;
+    AudioFrame *Frame = I2S_Audio_Take_Frame(Running ? Poll : 0);
+    if (Frame == NULL) {
+      if (!Running) {
+        break;
+      }
+      continue;
+    }
+    AudioFrame *Out[AUDIO_VAD_MAX_OUT];
+    uint32_t Events = 0;
+    size_t Count = 1;
+    Out[0] = Frame;
+    if (Encode.Config.Use_Vad) {
+      Count = Audio_Vad_Push(&Encode.Vad, Frame, Out, &Events);
+    }
+    for (size_t i = 0; i < Count; i++) {
+      Audio_Encode_Frame(Out[i]);
+    }
+    if (Events & AUDIO_VAD_EVENT_END) {
+      break; // the question is over
+    }
+  }
+  if (Encode.Config.Use_Vad) {
+    Audio_Vad_Finish(&Encode.Vad);
+  }
+  Audio_Encode_Send(Audio_Encoder_Finish(&Encode.Encoder, Encode.Out));
+  Encode.Stats.Bytes_Out = Encode.Encoder.Bytes_Out;
+  Encode.Done = true;
+  ESP_LOGI(TAG, "%s: %u frames, %lld us a frame (max %lld), %llu to %llu B",
+           Encode.Config.Encoder.Codec->Name, (unsigned)Encode.Stats.Frames,
+           Encode.Stats.Frames ? Encode.Stats.Encode_us / Encode.Stats.Frames
+                               : 0,
+           Encode.Stats.Max_Frame_us, Encode.Stats.Samples_In * 2,
+           Encode.Stats.Bytes_Out);
+  xSemaphoreGive(Encode.Stopped);
+  vTaskDelete(NULL);
+}
+
+// frames longer than a block go in a block at a time. only the encode is
+// timed, not the wait for the upload
+static void Audio_Encode_Frame(AudioFrame *Frame) {
+  const int16_t *Pcm = Audio_Frame_Pcm16(Frame);
+  int64_t Took = 0;
+  for (size_t Done = 0; Done < Frame->Sample_Count;) {
+    size_t Count = Frame->Sample_Count - Done;
+    if (Count > Encode.Encoder.Block_Samples) {
+      Count = Encode.Encoder.Block_Samples;
+    }
+    const int64_t Start = esp_timer_get_time();
+    size_t Len =
+        Audio_Encoder_Push(&Encode.Encoder, Pcm + Done, Count, Encode.Out);
+    Took += esp_timer_get_time() - Start;
+    Done += Count;
+    Audio_Encode_Send(Len);
+  }
+  Encode.Stats.Frames++;
+  Encode.Stats.Samples_In += Frame->Sample_Count;
+  Encode.Stats.Encode_us += Took;
+  if (Took > Encode.Stats.Max_Frame_us) {
+    Encode.Stats.Max_Frame_us = Took;
+  }
+  I2S_Audio_Release_Frame(Frame);
+}
+
+// waits for the upload to make room, unless nobody is reading any more
+static void Audio_Encode_Send(size_t Len) {
+  size_t Sent = 0;
+  while (Sent < Len && !Encode.Aborted) {
+    Sent += xStreamBufferSend(Encode.Stream, Encode.Out + Sent, Len - Sent,
+                              pdMS_TO_TICKS(AUDIO_ENCODE_POLL_MS));
+  }
+  if (Sent < Len) {
+    Encode.Failed = true;
+  }
+}
+
+#endif
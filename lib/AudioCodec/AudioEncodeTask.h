@@ -0,0 +1,68 @@
+/*
+    Description: the encode stage on the second core. a task pinned to
+    Task_Core takes each frame from the capture ring, runs it through the
+    voice detector when Use_Vad is set and the encoder a frame at a time,
+    gives the frame back to the pool and queues the encoded bytes in a
+    stream buffer. the upload reads them out with Audio_Encode_Task_Read,
+    which is a gemini_bytes_read_t, so GeminiAudioQuestion can take it as
+    read_encoded with the codec's mime type. capture and wifi stay on core
+    0 and the encode never holds up either
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_ENCODE_TASK_H
+#define AUDIO_ENCODE_TASK_H
+
+#include "AudioCodec.h"
+#include "AudioVad.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  AudioEncoderConfig Encoder;
+  bool Use_Vad;         // drop silence, the file ends when speech does
+  AudioVadConfig Vad;
+  size_t Stream_Bytes;  // encoded bytes the upload can fall behind by
+  UBaseType_t Task_Priority;
+  BaseType_t Task_Core;
+} AudioEncodeTaskConfig;
+
+// flac at 16 kHz after the vad, seconds of it queued. with 6 bits dropped
+// it beats adpcm on both size and noise on the fixture clips, see
+// test/Bench_AudioCodec.c. Encoder.Codec can be any of the AudioCodec.h codecs
+#define AUDIO_ENCODE_TASK_CONFIG_DEFAULT                                       \
+  {                                                                            \
+    .Encoder = {.Codec = &Audio_Codec_Flac, .Sample_Rate = 16000,              \
+                .Drop_Bits = 6},                                               \
+    .Use_Vad = true, .Vad = AUDIO_VAD_CONFIG_DEFAULT, .Stream_Bytes = 16384,   \
+    .Task_Priority = configMAX_PRIORITIES - 3, .Task_Core = 1,                 \
+  }
+
+typedef struct {
+  uint32_t Frames;     // encoded, after the vad
+  uint64_t Samples_In;
+  uint64_t Bytes_Out;  // header included
+  int64_t Encode_us;   // all frames together
+  int64_t Max_Frame_us;
+} AudioEncodeStats;
+
+// The PUBLIC functions that users can call
+// the capture has to be set up with I2S_Audio_Ini and started already.
+// Pool is the capture pool, the vad hands dropped frames back to it
+esp_err_t Audio_Encode_Task_Start(const AudioEncodeTaskConfig *Config,
+                                  PoolMemoryInfo *Pool, size_t Frame_Samples);
+// the recording is over, the task encodes what is left in the ring and
+// finishes the file. returns straight away
+void Audio_Encode_Task_Stop(void);
+// gemini_bytes_read_t, Ctx is unused. blocks until bytes are queued, 0
+// after the last of the file, <0 if the encoder failed
+int Audio_Encode_Task_Read(void *Ctx, uint8_t *Buf, size_t Size);
+const char *Audio_Encode_Task_Mime_Type(void);
+void Audio_Encode_Task_Get_Stats(AudioEncodeStats *Stats);
+// once the upload is done with it, or to give up on it
+void Audio_Encode_Task_Deinit(void);
+#endif
+
+#endif // AUDIO_ENCODE_TASK_H
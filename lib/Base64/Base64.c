@@ -0,0 +1,165 @@
+/*
+    Description: base64 encoder, see Base64.h. the scalar kernel looks up
+    one character per 6 bits. the word kernel loads 12 bytes as three big
+    endian words and looks up two characters per 12 bits in a 4096 entry
+    table, half the lookups and no byte at a time loads
+    Creator: Matthew Ayestaran
+*/
+
+#include "Base64.h"
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+// the tables are read on every group, kept out of flash so a cache miss
+// doesn't stall the encode
+#define BASE64_TABLE_ATTR DRAM_ATTR
+#else
+#define BASE64_TABLE_ATTR
+#endif
+
+// character for a 6 bit value, a constant expression so the pair table can
+// be built by the compiler
+#define BASE64_CHAR(v)                                                                                       \
+    ((v) < 26 ? 'A' + (v) : (v) < 52 ? 'a' + (v) - 26 : (v) < 62 ? '0' + (v) - 52 : (v) == 62 ? '+' : '/')
+
+// one row of the pair table is the 64 entries sharing the first character
+#define BASE64_PAIR(hi, lo) {BASE64_CHAR(hi), BASE64_CHAR(lo)},
+#define BASE64_LO4(hi, lo) BASE64_PAIR(hi, lo) BASE64_PAIR(hi, lo + 1) BASE64_PAIR(hi, lo + 2) BASE64_PAIR(hi, lo + 3)
+#define BASE64_LO16(hi, lo) BASE64_LO4(hi, lo) BASE64_LO4(hi, lo + 4) BASE64_LO4(hi, lo + 8) BASE64_LO4(hi, lo + 12)
+#define BASE64_ROW(hi) BASE64_LO16(hi, 0) BASE64_LO16(hi, 16) BASE64_LO16(hi, 32) BASE64_LO16(hi, 48)
+#define BASE64_ROW4(hi) BASE64_ROW(hi) BASE64_ROW(hi + 1) BASE64_ROW(hi + 2) BASE64_ROW(hi + 3)
+#define BASE64_ROW16(hi) BASE64_ROW4(hi) BASE64_ROW4(hi + 4) BASE64_ROW4(hi + 8) BASE64_ROW4(hi + 12)
+
+static const char BASE64_TABLE_ATTR BASE64_DIGITS[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// both characters for 12 bits, 8 KB
+static const char BASE64_TABLE_ATTR BASE64_PAIRS[4096][2] = {
+    BASE64_ROW16(0) BASE64_ROW16(16) BASE64_ROW16(32) BASE64_ROW16(48)
+};
+
+//PROTOTYPES
+size_t base64_encode(const uint8_t *in, size_t len, char *out);
+void base64_stream_init(base64_stream_t *stream);
+size_t base64_stream_update(base64_stream_t *stream, const uint8_t *in, size_t len, char *out);
+size_t base64_stream_final(base64_stream_t *stream, char *out);
+void base64_encode_groups(const uint8_t *in, size_t groups, char *out);
+void base64_encode_groups_scalar(const uint8_t *in, size_t groups, char *out);
+void base64_encode_groups_word(const uint8_t *in, size_t groups, char *out);
+static void base64_tail(const uint8_t *in, size_t len, char out[4]);
+static uint32_t base64_load_be32(const uint8_t *in);
+static void base64_put_word(uint32_t bits, char *out);
+
+size_t base64_encode(const uint8_t *in, size_t len, char *out) {
+    size_t groups = len / 3;
+    base64_encode_groups(in, groups, out);
+    if (len % 3 == 0) {
+        return groups * 4;
+    }
+    base64_tail(in + groups * 3, len % 3, out + groups * 4);
+    return groups * 4 + 4;
+}
+
+void base64_stream_init(base64_stream_t *stream) {
+    stream->carry_len = 0;
+}
+
+size_t base64_stream_update(base64_stream_t *stream, const uint8_t *in, size_t len, char *out) {
+    size_t written = 0;
+    if (stream->carry_len > 0) {
+        // top up the carried group first
+        size_t need = 3 - stream->carry_len;
+        if (len < need) {
+            memcpy(stream->carry + stream->carry_len, in, len);
+            stream->carry_len += (uint8_t)len;
+            return 0;
+        }
+        uint8_t group[3];
+        memcpy(group, stream->carry, stream->carry_len);
+        memcpy(group + stream->carry_len, in, need);
+        base64_encode_groups_scalar(group, 1, out);
+        written = 4;
+        in += need;
+        len -= need;
+        stream->carry_len = 0;
+    }
+    size_t groups = len / 3;
+    base64_encode_groups(in, groups, out + written);
+    written += groups * 4;
+    stream->carry_len = (uint8_t)(len - groups * 3);
+    memcpy(stream->carry, in + groups * 3, stream->carry_len);
+    return written;
+}
+
+size_t base64_stream_final(base64_stream_t *stream, char *out) {
+    if (stream->carry_len == 0) {
+        return 0;
+    }
+    base64_tail(stream->carry, stream->carry_len, out);
+    stream->carry_len = 0;
+    return 4;
+}
+
+void base64_encode_groups(const uint8_t *in, size_t groups, char *out) {
+#ifdef BASE64_PIE
+    size_t blocks = groups * 3 / BASE64_PIE_BLOCK;
+    if (blocks > 0) {
+        base64_encode_groups_pie(in, blocks, out);
+        in += blocks * BASE64_PIE_BLOCK;
+        out += blocks * BASE64_PIE_BLOCK / 3 * 4;
+        groups -= blocks * BASE64_PIE_BLOCK / 3;
+    }
+#endif
+    base64_encode_groups_word(in, groups, out);
+}
+
+void base64_encode_groups_scalar(const uint8_t *in, size_t groups, char *out) {
+    for (size_t g = 0; g < groups; g++, in += 3, out += 4) {
+        uint32_t bits = (uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2];
+        out[0] = BASE64_DIGITS[bits >> 18];
+        out[1] = BASE64_DIGITS[(bits >> 12) & 0x3f];
+        out[2] = BASE64_DIGITS[(bits >> 6) & 0x3f];
+        out[3] = BASE64_DIGITS[bits & 0x3f];
+    }
+}
+
+// 4 groups a step out of three words, whatever is left goes through the
+// same table a group at a time
+void base64_encode_groups_word(const uint8_t *in, size_t groups, char *out) {
+    for (; groups >= 4; groups -= 4, in += 12, out += 16) {
+        uint32_t w0 = base64_load_be32(in);
+        uint32_t w1 = base64_load_be32(in + 4);
+        uint32_t w2 = base64_load_be32(in + 8);
+        base64_put_word(w0 >> 8, out);
+        base64_put_word((w0 << 16 | w1 >> 16) & 0xffffff, out + 4);
+        base64_put_word((w1 << 8 | w2 >> 24) & 0xffffff, out + 8);
+        base64_put_word(w2 & 0xffffff, out + 12);
+    }
+    for (; groups > 0; groups--, in += 3, out += 4) {
+        base64_put_word((uint32_t)in[0] << 16 | (uint32_t)in[1] << 8 | in[2], out);
+    }
+}
+
+// 1 or 2 bytes padded out to a group
+static void base64_tail(const uint8_t *in, size_t len, char out[4]) {
+    uint8_t group[3] = {in[0], len > 1 ? in[1] : 0, 0};
+    base64_encode_groups_scalar(group, 1, out);
+    out[3] = '=';
+    if (len == 1) {
+        out[2] = '=';
+    }
+}
+
+static uint32_t base64_load_be32(const uint8_t *in) {
+    uint32_t word;
+    memcpy(&word, in, sizeof(word)); // any alignment, one load where it is allowed
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+// 24 bits as 4 characters
+static void base64_put_word(uint32_t bits, char *out) {
+    memcpy(out, BASE64_PAIRS[bits >> 12], 2);
+    memcpy(out + 2, BASE64_PAIRS[bits & 0xfff], 2);
+}
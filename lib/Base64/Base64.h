@@ -0,0 +1,52 @@
+/*
+    Description: base64 encoder (rfc 4648, standard alphabet, padded) for
+    the audio going up as inline_data. whole 3 byte groups go through a
+    kernel, the streaming calls carry the 0 to 2 bytes short of a group
+    from one chunk to the next so a clip can be encoded as it is recorded.
+    the default kernel reads the input a word at a time and writes two
+    characters per lookup. build with BASE64_PIE on the esp32-s3 to hand
+    big runs to a simd kernel, see base64_encode_groups_pie
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// characters for len bytes once padded
+#define BASE64_ENCODED_LEN(len) (((len) + 2) / 3 * 4)
+// bytes the pie kernel takes per step, it is only called with multiples
+#define BASE64_PIE_BLOCK 48
+
+// 3 bytes in, 4 characters out, no padding and no nul
+typedef void (*base64_kernel_t)(const uint8_t *in, size_t groups, char *out);
+
+typedef struct {
+    uint8_t carry[2]; // bytes short of a whole group
+    uint8_t carry_len;
+} base64_stream_t;
+
+//Function definitions
+// whole of in, padded. out needs BASE64_ENCODED_LEN(len), no nul is added.
+// returns the characters written
+size_t base64_encode(const uint8_t *in, size_t len, char *out);
+void base64_stream_init(base64_stream_t *stream);
+// encodes the carried bytes then in, whole groups only, the rest is carried.
+// out needs (carry_len + len) / 3 * 4. returns the characters written
+size_t base64_stream_update(base64_stream_t *stream, const uint8_t *in, size_t len, char *out);
+// the last group, padded. out needs 4, returns 0 when nothing was carried
+size_t base64_stream_final(base64_stream_t *stream, char *out);
+// fastest kernel this build has
+void base64_encode_groups(const uint8_t *in, size_t groups, char *out);
+// the kernels on their own, for the tests and the benchmark
+void base64_encode_groups_scalar(const uint8_t *in, size_t groups, char *out);
+void base64_encode_groups_word(const uint8_t *in, size_t groups, char *out);
+#ifdef BASE64_PIE
+// esp32-s3 simd kernel, supplied in assembly alongside the build that sets
+// BASE64_PIE. takes blocks of BASE64_PIE_BLOCK bytes, 16 groups each
+void base64_encode_groups_pie(const uint8_t *in, size_t blocks, char *out);
+#endif
+
+#endif // BASE64_H
@@ -1,82 +1,187 @@
 /*
-    Description: wifi manager for esp32 C projects
+    Description: wifi manager for esp32 C projects. a full connect scans
+    for the ssid itself and then connects to the strongest access point by
+    bssid, so the scan is timed on its own, a fast connect skips the scan
+    and goes to the one in the nvs record, see WifiFastConnect.h. when to
+    try again is up to the state machine in WifiLink.h, the events from
+    esp_wifi are fed to it and it drives the radio through the link ops.
+    the event loop task and the esp_timer task both call into it, so every
+    call is made holding s_link_lock
     Creator: Matthew Ayestaran
     date:19/10/2025
 */
+#ifdef ESP_PLATFORM
+
 #include "Esp32WifiManager.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include <string.h>
 
 //event handler and flags
 static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0 // This is just 1
-#define WIFI_FAIL_BIT      BIT1
+#define WIFI_CONNECTED_BIT BIT0 // set while the link is up
+#define WARM_WAIT_SLICE_MS 250 // wait_warm checks the link is still worth waiting for this often
+
+//fast connect record in nvs
+#define FAST_NVS_NAMESPACE "wifi_fast"
+#define FAST_NVS_KEY "record"
+#define SCAN_MAX_APS 8 // strongest of these is picked, the rest are dropped
 
 //PROTOTYPES
 esp_err_t wifi_manager_wait_for_connection(TickType_t xTicksToWait);
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 void wifi_manager_init_station(const wifi_manager_config_t* config);
+esp_err_t wifi_manager_get_timing(wifi_connect_timing_t *timing);
+void wifi_manager_forget_fast_connect(void);
+wifi_link_state_t wifi_manager_get_state(void);
+bool wifi_manager_subscribe(wifi_link_cb_t cb, void *ctx);
+esp_err_t wifi_manager_wait_warm(int64_t deadline_us);
 static void handle_sta_start();
-static void handle_sta_disconnected();
+static void handle_scan_done();
+static void handle_sta_connected();
+static void handle_sta_disconnected(void* event_data);
 static void handle_sta_got_ip(void* event_data);
+static void handle_sta_lost_ip();
+static void start_scan(void);
+static void start_connect(void);
+static void link_connect(void *ctx);
+static void link_disconnect(void *ctx);
+static void link_arm_timer(void *ctx, uint32_t ms);
+static void link_cancel_timer(void *ctx);
+static uint32_t link_random(void *ctx);
+static int64_t link_now_us(void *ctx);
+static void link_timer_cb(void *arg);
+static void link_state_changed(void *ctx, wifi_link_state_t from, wifi_link_state_t to);
+static void apply_ip_mode(void);
+static bool fast_record_load(wifi_fast_record_t *record);
+static void fast_record_save(const ip_event_got_ip_t *event);
 
-//Log and error count variables
+//Log variables
 static const char *TAG = "WIFI HANDLE";
-static int s_retry_num = 0;
-#define WIFI_MAXIMUM_RETRY  5
 
-typedef struct {
-    const char* ssid;
-    const char* password;
-} wifi_manager_config_t;
+//reconnect state machine and its timer
+static wifi_link_t s_link;
+static SemaphoreHandle_t s_link_lock; // recursive, a subscriber may ask for the state
+static esp_timer_handle_t s_link_timer;
+static int64_t s_link_timer_due_us = INT64_MAX; // a stale firing is early and is dropped
+
+//connection state, only touched holding s_link_lock once started
+static esp_netif_t *s_sta_netif;
+static wifi_config_t s_wifi_config;
+static wifi_ip_config_t s_static_ip;
+static bool s_has_static_ip;
+static wifi_fast_record_t s_record; // as loaded from nvs, or last saved
+static bool s_has_record;
+static wifi_fast_plan_t s_plan;
+static bool s_fast_attempt; // directed connect to the cached access point in flight
+static wifi_connect_timing_t s_timing;
+static bool s_has_timing;
+static int64_t s_start_us;
+static int64_t s_scan_start_us;
+static int64_t s_connect_start_us;
+static int64_t s_connected_us;
 
 esp_err_t wifi_manager_wait_for_connection(TickType_t xTicksToWait) {
-    // Wait for the connected bit OR the fail bit to be set
+    // it never gives up now, so there is no fail bit, only the wait running out
     EventBits_t bits = xEventGroupWaitBits(
         s_wifi_event_group,        // The flag holder to watch
-        WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, // Wait for these flags
+        WIFI_CONNECTED_BIT,        // Wait for this flag
         pdFALSE,                   // pdFALSE = Don't clear the flags on exit
-        pdFALSE,                   // pdFALSE = Wait for EITHER bit (not both)
+        pdFALSE,
         xTicksToWait               // How long to wait (e.g., portMAX_DELAY)
     );
 
     if (bits & WIFI_CONNECTED_BIT) {
         ESP_LOGI(TAG, "Wait: Connection successful!");
         return ESP_OK;
-    } 
-    else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGE(TAG, "Wait: Connection failed!");
-        return ESP_FAIL;
-    } 
-    else {
-        ESP_LOGW(TAG, "Wait: Timeout.");
-        return ESP_ERR_TIMEOUT;
     }
+    ESP_LOGW(TAG, "Wait: Timeout, link %s.", wifi_link_state_name(wifi_manager_get_state()));
+    return ESP_ERR_TIMEOUT;
+}
+
+//up now, or ESP_ERR_TIMEOUT as soon as the link can't be up by the deadline,
+//a backoff running past it gives up at once rather than waiting it out
+esp_err_t wifi_manager_wait_warm(int64_t deadline_us) {
+    for (;;) {
+        xSemaphoreTakeRecursive(s_link_lock, portMAX_DELAY);
+        const bool up = s_link.state == WIFI_LINK_UP;
+        const bool may_be_up = wifi_link_may_be_up_by(&s_link, deadline_us);
+        xSemaphoreGiveRecursive(s_link_lock);
+        if (up) {
+            return ESP_OK;
+        }
+        const int64_t left_us = deadline_us - esp_timer_get_time();
+        if (!may_be_up || left_us <= 0) {
+            return ESP_ERR_TIMEOUT;
+        }
+        const int64_t slice_ms = left_us / 1000 < WARM_WAIT_SLICE_MS ? left_us / 1000 + 1 : WARM_WAIT_SLICE_MS;
+        xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(slice_ms));
+    }
+}
+
+wifi_link_state_t wifi_manager_get_state(void) {
+    xSemaphoreTakeRecursive(s_link_lock, portMAX_DELAY);
+    const wifi_link_state_t state = s_link.state;
+    xSemaphoreGiveRecursive(s_link_lock);
+    return state;
+}
+
+bool wifi_manager_subscribe(wifi_link_cb_t cb, void *ctx) {
+    xSemaphoreTakeRecursive(s_link_lock, portMAX_DELAY);
+    const bool ok = wifi_link_subscribe(&s_link, cb, ctx);
+    xSemaphoreGiveRecursive(s_link_lock);
+    return ok;
 }
+
 //Event handler and Dispatcher to go to correct function when event takes place
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data){
+    xSemaphoreTakeRecursive(s_link_lock, portMAX_DELAY);
     if (event_base == WIFI_EVENT) {
             switch (event_id) {//switch for what function to call
                 case WIFI_EVENT_STA_START:
                     handle_sta_start();
                     break;
+                case WIFI_EVENT_SCAN_DONE:
+                    handle_scan_done();
+                    break;
+                case WIFI_EVENT_STA_CONNECTED:
+                    handle_sta_connected();
+                    break;
                 case WIFI_EVENT_STA_DISCONNECTED:
-                    handle_sta_disconnected();
+                    handle_sta_disconnected(event_data);
                     break;
                 default:
                     break; // Other wifi events we don't care about until expansion
             }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         handle_sta_got_ip(event_data);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        handle_sta_lost_ip();
     }
+    xSemaphoreGiveRecursive(s_link_lock);
 }
 //what functions do I need and how can I write them for unit testing
 void wifi_manager_init_station(const wifi_manager_config_t* config){
+    s_start_us = esp_timer_get_time();
     s_wifi_event_group = xEventGroupCreate();//Flag holder
-    
+    s_link_lock = xSemaphoreCreateRecursiveMutex();
+    const esp_timer_create_args_t timer_args = {
+        .callback = link_timer_cb,
+        .name = "wifi_link",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_link_timer));
+    const wifi_link_ops_t ops = {link_connect, link_disconnect, link_arm_timer, link_cancel_timer,
+                                 link_random, link_now_us, NULL};
+    wifi_link_init(&s_link, &ops, config->backoff);
+    wifi_link_subscribe(&s_link, link_state_changed, NULL);
+
     //checks to see if the nvs has an error and if recoverable just rewrite over it
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -89,60 +194,329 @@ void wifi_manager_init_station(const wifi_manager_config_t* config){
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
-    //wifi driver  intitiation 
+    //wifi driver  intitiation
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    // the config changes with every scan, the driver would write each one to flash
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
 
     //register all event handlers to bits
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, &wifi_event_handler, NULL));
+
 
-    
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            // swapping to version where not hard coded values
-            .ssid = config->ssid,
-            .password = config->password,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    // swapping to version where not hard coded values
+    memset(&s_wifi_config, 0, sizeof(s_wifi_config));
+    strlcpy((char *)s_wifi_config.sta.ssid, config->ssid, sizeof(s_wifi_config.sta.ssid));
+    strlcpy((char *)s_wifi_config.sta.password, config->password, sizeof(s_wifi_config.sta.password));
+    s_has_static_ip = config->static_ip != NULL;
+    if (s_has_static_ip) {
+        s_static_ip = *config->static_ip;
+    }
+
+    //plan the connect from what the last good one left in nvs
+    s_has_record = fast_record_load(&s_record);
+    s_plan = wifi_fast_plan(s_has_record ? &s_record : NULL, config->ssid, config->fast_connect,
+                            config->reuse_lease, s_has_static_ip);
+    memset(&s_timing, 0, sizeof(s_timing));
+    s_has_timing = false;
+    s_fast_attempt = s_plan.directed;
+    if (s_plan.directed) {
+        memcpy(s_wifi_config.sta.bssid, s_record.bssid, sizeof(s_wifi_config.sta.bssid));
+        s_wifi_config.sta.bssid_set = true;
+        s_wifi_config.sta.channel = s_record.channel;
+        ESP_LOGI(TAG, "Fast connect to " MACSTR " on channel %d, %s", MAC2STR(s_record.bssid),
+                 s_record.channel, wifi_ip_mode_name(s_plan.ip_mode));
+    }
+    apply_ip_mode();
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config));
 
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
-    
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_LOGI(TAG, "wifi_manager_init_station finished.");
 
 }
 
-//log that the wifi station has started
+esp_err_t wifi_manager_get_timing(wifi_connect_timing_t *timing) {
+    if (!s_has_timing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *timing = s_timing;
+    return ESP_OK;
+}
+
+void wifi_manager_forget_fast_connect(void) {
+    nvs_handle_t nvs;
+    s_has_record = false;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, FAST_NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+//log that the wifi station has started, the first attempt goes to the
+//cached access point when the plan has one
 static void handle_sta_start(){
     ESP_LOGI(TAG, "Handler: WIFI_EVENT_STA_START. Attempting to connect.");
-    esp_wifi_connect();
+    wifi_link_start(&s_link);
+}
+
+//connect to the strongest access point the scan found
+static void handle_scan_done(){
+    static wifi_ap_record_t aps[SCAN_MAX_APS]; // too big for the event task's stack
+    uint16_t count = SCAN_MAX_APS;
+    if (s_link.state != WIFI_LINK_CONNECTING) {
+        esp_wifi_clear_ap_list();
+        return; // a scan stopped by link_disconnect
+    }
+    s_timing.scan_us += esp_timer_get_time() - s_scan_start_us;
+    if (esp_wifi_scan_get_ap_records(&count, aps) != ESP_OK || count == 0) {
+        ESP_LOGW(TAG, "Handler: WIFI_EVENT_SCAN_DONE. %s not found.", (char *)s_wifi_config.sta.ssid);
+        wifi_link_lost(&s_link);
+        return;
+    }
+    const wifi_ap_record_t *best = &aps[0];
+    for (uint16_t i = 1; i < count; i++) {
+        if (aps[i].rssi > best->rssi) {
+            best = &aps[i];
+        }
+    }
+    ESP_LOGI(TAG, "Handler: WIFI_EVENT_SCAN_DONE. " MACSTR " on channel %d, rssi %d", MAC2STR(best->bssid),
+             best->primary, best->rssi);
+    memcpy(s_wifi_config.sta.bssid, best->bssid, sizeof(s_wifi_config.sta.bssid));
+    s_wifi_config.sta.bssid_set = true;
+    s_wifi_config.sta.channel = best->primary;
+    esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+    start_connect();
+}
+
+//auth, assoc and the wpa handshake are done, esp_wifi has no event between them
+static void handle_sta_connected(){
+    s_connected_us = esp_timer_get_time();
+    s_timing.connect_us = s_connected_us - s_connect_start_us;
+    wifi_link_associated(&s_link);
 }
 
 //log that a wifi IP address has been obtained
-static void handle_sta_got_ip(void* event_data){  
+static void handle_sta_got_ip(void* event_data){
     ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
     ESP_LOGI(TAG, "Handler: IP_EVENT_STA_GOT_IP. Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
 
-    s_retry_num = 0; // Reset retry counter
-    xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT); // Signal success
+    int64_t now = esp_timer_get_time();
+    s_timing.dhcp_us = now - s_connected_us;
+    s_timing.total_us = now - s_start_us;
+    s_timing.directed = s_fast_attempt;
+    s_timing.ip_mode = s_plan.ip_mode;
+    s_has_timing = true;
+    s_fast_attempt = false;
+    ESP_LOGI(TAG, "Connected in %lld ms%s: scan %lld ms, auth and assoc %lld ms, %s %lld ms",
+             s_timing.total_us / 1000, s_timing.directed ? " (fast)" : s_timing.fell_back ? " (fell back)" : "",
+             s_timing.scan_us / 1000, s_timing.connect_us / 1000, wifi_ip_mode_name(s_timing.ip_mode),
+             s_timing.dhcp_us / 1000);
+    fast_record_save(event);
+    wifi_link_got_ip(&s_link); // sets WIFI_CONNECTED_BIT
 }
 
-static void handle_sta_disconnected(){
-     // Signal total failure
-    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    // Attempt to reconnect
-    if (s_retry_num < WIFI_MAXIMUM_RETRY) {
-        s_retry_num++;
-        ESP_LOGI(TAG, "Handler: WIFI_EVENT_STA_DISCONNECTED. Retrying connection (%d/%d)...", s_retry_num, WIFI_MAXIMUM_RETRY);
-        esp_wifi_connect();
-    } else {//throw error
-        ESP_LOGE(TAG, "Handler: WIFI_EVENT_STA_DISCONNECTED. Failed to connect after %d attempts.", WIFI_MAXIMUM_RETRY);
-        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT); // Signal total failure
+//the address went with the lease, drop the association and come back in
+//through the reconnect like any other drop
+static void handle_sta_lost_ip(){
+    ESP_LOGW(TAG, "Handler: IP_EVENT_STA_LOST_IP.");
+    if (s_link.state == WIFI_LINK_UP) {
+        esp_wifi_disconnect();
     }
 }
+
+static void handle_sta_disconnected(void* event_data){
+    wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
+    if (s_fast_attempt && s_link.state == WIFI_LINK_CONNECTING) {
+        // the cached access point has gone or moved channel, scan like a first boot
+        ESP_LOGW(TAG, "Handler: WIFI_EVENT_STA_DISCONNECTED. Fast connect failed (reason %d), scanning.",
+                 event->reason);
+        s_fast_attempt = false;
+        s_timing.fell_back = true;
+        wifi_manager_forget_fast_connect();
+        if (s_plan.ip_mode == WIFI_IP_LEASE) {
+            s_plan.ip_mode = WIFI_IP_DHCP;
+            esp_netif_dhcpc_start(s_sta_netif);
+        }
+        s_wifi_config.sta.bssid_set = false;
+        s_wifi_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+        start_scan(); // still the same attempt
+        return;
+    }
+    ESP_LOGI(TAG, "Handler: WIFI_EVENT_STA_DISCONNECTED. Reason %d, link %s.", event->reason,
+             wifi_link_state_name(s_link.state));
+    if (s_link.state == WIFI_LINK_CONNECTING || s_link.state == WIFI_LINK_GETTING_IP) {
+        // the access point it picked wouldn't have it, the next attempt scans again
+        s_wifi_config.sta.bssid_set = false;
+        s_wifi_config.sta.channel = 0;
+        esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+    }
+    wifi_link_lost(&s_link); // ignored when it was asked for
+}
+
+static void start_scan(void) {
+    wifi_scan_config_t scan = {
+        .ssid = s_wifi_config.sta.ssid, // only answers from this network
+        .show_hidden = true,
+    };
+    s_scan_start_us = esp_timer_get_time();
+    if (esp_wifi_scan_start(&scan, false) != ESP_OK) {
+        ESP_LOGE(TAG, "Couldn't start a scan.");
+        wifi_link_lost(&s_link);
+    }
+}
+
+static void start_connect(void) {
+    s_connect_start_us = esp_timer_get_time();
+    if (esp_wifi_connect() != ESP_OK) {
+        ESP_LOGE(TAG, "Couldn't start a connect.");
+        wifi_link_lost(&s_link);
+    }
+}
+
+//an attempt, to the access point already picked when there is one. the
+//first one is timed from init, a reconnect from here
+static void link_connect(void *ctx) {
+    if (s_link.attempts > 1) {
+        s_start_us = esp_timer_get_time();
+        memset(&s_timing, 0, sizeof(s_timing));
+    }
+    if (s_wifi_config.sta.bssid_set) {
+        start_connect();
+    } else {
+        start_scan();
+    }
+}
+
+//the attempt timed out or the link was stopped, the cached access point
+//isn't tried again on its own and the disconnect event this raises is ignored
+static void link_disconnect(void *ctx) {
+    s_fast_attempt = false;
+    esp_wifi_scan_stop();
+    esp_wifi_disconnect();
+}
+
+static void link_arm_timer(void *ctx, uint32_t ms) {
+    esp_timer_stop(s_link_timer); // fails when it isn't running, that's fine
+    s_link_timer_due_us = esp_timer_get_time() + (int64_t)ms * 1000;
+    esp_timer_start_once(s_link_timer, (uint64_t)ms * 1000);
+}
+
+static void link_cancel_timer(void *ctx) {
+    esp_timer_stop(s_link_timer);
+    s_link_timer_due_us = INT64_MAX;
+}
+
+static uint32_t link_random(void *ctx) { return esp_random(); }
+
+static int64_t link_now_us(void *ctx) { return esp_timer_get_time(); }
+
+//on the esp_timer task. a firing that was already waiting on the lock when
+//the timer was cancelled or armed again is early, and is dropped
+static void link_timer_cb(void *arg) {
+    xSemaphoreTakeRecursive(s_link_lock, portMAX_DELAY);
+    if (esp_timer_get_time() >= s_link_timer_due_us) {
+        s_link_timer_due_us = INT64_MAX;
+        wifi_link_timer(&s_link);
+    }
+    xSemaphoreGiveRecursive(s_link_lock);
+}
+
+//keeps the connected bit in step with the link, it is what wait_warm waits on
+static void link_state_changed(void *ctx, wifi_link_state_t from, wifi_link_state_t to) {
+    if (to == WIFI_LINK_UP) {
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    } else if (from == WIFI_LINK_UP) {
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    }
+    if (to == WIFI_LINK_BACKOFF) {
+        ESP_LOGW(TAG, "Link %s -> backoff, %lu failed in a row, next attempt in %lld ms",
+                 wifi_link_state_name(from), (unsigned long)s_link.failures,
+                 (s_link.next_attempt_us - esp_timer_get_time()) / 1000);
+    } else {
+        ESP_LOGI(TAG, "Link %s -> %s", wifi_link_state_name(from), wifi_link_state_name(to));
+    }
+}
+
+//a static address or the old lease, the dhcp client stays off so there is no dhcp phase
+static void apply_ip_mode(void) {
+    if (s_plan.ip_mode == WIFI_IP_DHCP) {
+        return; // the default sta netif starts its dhcp client itself
+    }
+    const wifi_ip_config_t *ip = s_plan.ip_mode == WIFI_IP_STATIC ? &s_static_ip : &s_record.lease;
+    esp_netif_ip_info_t info = {0};
+    info.ip.addr = ip->ip;
+    info.netmask.addr = ip->netmask;
+    info.gw.addr = ip->gw;
+    esp_err_t err = esp_netif_dhcpc_stop(s_sta_netif);
+    if ((err == ESP_OK || err == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) &&
+        esp_netif_set_ip_info(s_sta_netif, &info) == ESP_OK) {
+        if (ip->dns != 0) {
+            esp_netif_dns_info_t dns = {0};
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            dns.ip.u_addr.ip4.addr = ip->dns;
+            esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+        }
+        return;
+    }
+    ESP_LOGW(TAG, "Couldn't set a %s address, using dhcp.", wifi_ip_mode_name(s_plan.ip_mode));
+    s_plan.ip_mode = WIFI_IP_DHCP;
+    esp_netif_dhcpc_start(s_sta_netif);
+}
+
+static bool fast_record_load(wifi_fast_record_t *record) {
+    nvs_handle_t nvs;
+    size_t len = sizeof(*record);
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(nvs, FAST_NVS_KEY, record, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*record);
+}
+
+//only written when something changed, it is the same access point on most boots
+static void fast_record_save(const ip_event_got_ip_t *event) {
+    wifi_ap_record_t ap;
+    wifi_fast_record_t record;
+    wifi_ip_config_t lease = {0};
+    const wifi_ip_config_t *kept = NULL;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    if (s_plan.ip_mode == WIFI_IP_DHCP) {
+        esp_netif_dns_info_t dns;
+        lease.ip = event->ip_info.ip.addr;
+        lease.netmask = event->ip_info.netmask.addr;
+        lease.gw = event->ip_info.gw.addr;
+        if (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+            lease.dns = dns.ip.u_addr.ip4.addr;
+        }
+        kept = &lease;
+    } else if (s_plan.ip_mode == WIFI_IP_LEASE) {
+        kept = &s_record.lease;
+    }
+    if (!wifi_fast_record_fill(&record, (const char *)s_wifi_config.sta.ssid, ap.bssid, ap.primary, kept) ||
+        (s_has_record && wifi_fast_record_same(&record, &s_record))) {
+        return;
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(FAST_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_set_blob(nvs, FAST_NVS_KEY, &record, sizeof(record)) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+            ESP_LOGW(TAG, "Couldn't save the fast connect record to nvs");
+        } else {
+            s_record = record;
+            s_has_record = true;
+        }
+        nvs_close(nvs);
+    }
+}
+
+#endif
@@ -4,13 +4,48 @@
     date:19/10/2025
 */
 
-// #ifdef ESP32WIFIMANAGER_H
+#ifndef ESP32WIFIMANAGER_H
 #define ESP32WIFIMANAGER_H
 
+#include "WifiFastConnect.h"
+#include "WifiLink.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 
+typedef struct {
+    const char* ssid;
+    const char* password;
+    // try the access point from the last good connection first, without a
+    // scan. it falls back to a scan when that access point can't be reached
+    bool fast_connect;
+    // on a fast connect, take the last dhcp address again instead of asking
+    // for one. only for a router that keeps a device's address, most do
+    bool reuse_lease;
+    const wifi_ip_config_t* static_ip; // optional, no dhcp at all
+    const wifi_backoff_policy_t* backoff; // optional, WIFI_BACKOFF_POLICY_DEFAULT
+} wifi_manager_config_t;
+
 void wifi_manager_init_station(const wifi_manager_config_t *config);
+// ESP_OK once up, ESP_ERR_TIMEOUT otherwise. it keeps trying after a
+// timeout, there is no giving up
 esp_err_t wifi_manager_wait_for_connection(TickType_t xTicksToWait);
+// the warm signal for a request with a deadline (esp_timer_get_time),
+// ESP_OK when the link is up by then. ESP_ERR_TIMEOUT comes back early
+// when it can't be, stopped or backing off past the deadline
+esp_err_t wifi_manager_wait_warm(int64_t deadline_us);
+wifi_link_state_t wifi_manager_get_state(void);
+// cb is told every change of state, on the event loop or esp_timer task
+// with the manager locked, so it mustn't block. call after init, false
+// when they're all taken
+bool wifi_manager_subscribe(wifi_link_cb_t cb, void *ctx);
+// how long each phase of the last connection took, ESP_ERR_INVALID_STATE
+// until there has been one
+esp_err_t wifi_manager_get_timing(wifi_connect_timing_t *timing);
+// drops the cached access point and lease, the next boot scans
+void wifi_manager_forget_fast_connect(void);
+#endif
 
-// #endif
+#endif
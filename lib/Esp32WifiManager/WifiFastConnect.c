@@ -0,0 +1,84 @@
+/*
+    Description: wifi fast connect record and plan, see WifiFastConnect.h.
+    the record is compared field by field rather than with memcmp so the
+    padding in the struct doesn't cause a flash write on every boot
+    Creator: Matthew Ayestaran
+*/
+#include "WifiFastConnect.h"
+#include <string.h>
+
+//PROTOTYPES
+bool wifi_fast_record_valid(const wifi_fast_record_t *record, const char *ssid);
+wifi_fast_plan_t wifi_fast_plan(const wifi_fast_record_t *record, const char *ssid, bool fast_connect,
+                                bool reuse_lease, bool has_static_ip);
+bool wifi_fast_record_fill(wifi_fast_record_t *record, const char *ssid, const uint8_t bssid[6],
+                           uint8_t channel, const wifi_ip_config_t *lease);
+bool wifi_fast_record_same(const wifi_fast_record_t *a, const wifi_fast_record_t *b);
+const char *wifi_ip_mode_name(wifi_ip_mode_t mode);
+static bool wifi_channel_valid(uint8_t channel);
+
+bool wifi_fast_record_valid(const wifi_fast_record_t *record, const char *ssid) {
+    static const uint8_t no_bssid[6] = {0};
+    if (!record || !ssid || record->version != WIFI_FAST_RECORD_VERSION) {
+        return false;
+    }
+    // the nul might be missing from a blob that was cut short
+    if (memchr(record->ssid, '\0', sizeof(record->ssid)) == NULL || strcmp(record->ssid, ssid) != 0) {
+        return false;
+    }
+    if (!wifi_channel_valid(record->channel) || memcmp(record->bssid, no_bssid, sizeof(no_bssid)) == 0) {
+        return false;
+    }
+    return !record->has_lease || (record->lease.ip != 0 && record->lease.netmask != 0);
+}
+
+wifi_fast_plan_t wifi_fast_plan(const wifi_fast_record_t *record, const char *ssid, bool fast_connect,
+                                bool reuse_lease, bool has_static_ip) {
+    wifi_fast_plan_t plan = {.directed = false, .ip_mode = WIFI_IP_DHCP};
+    plan.directed = fast_connect && wifi_fast_record_valid(record, ssid);
+    if (has_static_ip) {
+        plan.ip_mode = WIFI_IP_STATIC;
+    } else if (plan.directed && reuse_lease && record->has_lease) {
+        plan.ip_mode = WIFI_IP_LEASE;
+    }
+    return plan;
+}
+
+bool wifi_fast_record_fill(wifi_fast_record_t *record, const char *ssid, const uint8_t bssid[6],
+                           uint8_t channel, const wifi_ip_config_t *lease) {
+    memset(record, 0, sizeof(*record));
+    if (!ssid || strlen(ssid) > WIFI_FAST_SSID_MAX || !wifi_channel_valid(channel)) {
+        return false;
+    }
+    record->version = WIFI_FAST_RECORD_VERSION;
+    strcpy(record->ssid, ssid);
+    memcpy(record->bssid, bssid, sizeof(record->bssid));
+    record->channel = channel;
+    record->has_lease = lease != NULL;
+    if (lease) {
+        record->lease = *lease;
+    }
+    return true;
+}
+
+bool wifi_fast_record_same(const wifi_fast_record_t *a, const wifi_fast_record_t *b) {
+    if (a->version != b->version || strcmp(a->ssid, b->ssid) != 0 ||
+        memcmp(a->bssid, b->bssid, sizeof(a->bssid)) != 0 || a->channel != b->channel ||
+        a->has_lease != b->has_lease) {
+        return false;
+    }
+    return !a->has_lease || (a->lease.ip == b->lease.ip && a->lease.netmask == b->lease.netmask &&
+                             a->lease.gw == b->lease.gw && a->lease.dns == b->lease.dns);
+}
+
+const char *wifi_ip_mode_name(wifi_ip_mode_t mode) {
+    switch (mode) {
+        case WIFI_IP_DHCP:   return "dhcp";
+        case WIFI_IP_STATIC: return "static";
+        case WIFI_IP_LEASE:  return "reused lease";
+    }
+    return "unknown";
+}
+
+// 2.4 GHz channels, 14 is japan only but the radio takes it
+static bool wifi_channel_valid(uint8_t channel) { return channel >= 1 && channel <= 14; }
@@ -0,0 +1,72 @@
+/*
+    Description: the parts of the wifi fast connect that don't need the
+    radio. after each good connection the access point (bssid and channel)
+    and the dhcp lease are kept in a record in nvs, the next boot checks
+    the record still belongs to the configured network and plans a directed
+    connect to it, no scan, with a static address or the old lease so dhcp
+    is skipped too. a failed directed connect falls back to a scan and dhcp
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef WIFI_FAST_CONNECT_H
+#define WIFI_FAST_CONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WIFI_FAST_RECORD_VERSION 1
+#define WIFI_FAST_SSID_MAX 32 // bytes, as in an 802.11 ssid
+
+typedef struct { // ipv4 addresses as esp_netif keeps them, network order
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_ip_config_t;
+
+typedef struct { // kept in nvs as a blob, written whole
+    uint32_t version;
+    char ssid[WIFI_FAST_SSID_MAX + 1];
+    uint8_t bssid[6];
+    uint8_t channel;
+    bool has_lease;
+    wifi_ip_config_t lease; // the last address dhcp gave out
+} wifi_fast_record_t;
+
+typedef enum {
+    WIFI_IP_DHCP = 0,
+    WIFI_IP_STATIC, // the configured address
+    WIFI_IP_LEASE,  // the record's lease, set as if it were static
+} wifi_ip_mode_t;
+
+typedef struct {
+    bool directed; // bssid and channel from the record, no scan
+    wifi_ip_mode_t ip_mode;
+} wifi_fast_plan_t;
+
+typedef struct { // how the last connection went, microseconds
+    int64_t scan_us;    // 0 on a directed connect
+    int64_t connect_us; // auth, assoc and the wpa handshake
+    int64_t dhcp_us;    // connected to an address, next to nothing without dhcp
+    int64_t total_us;   // start to an address, a failed directed try included
+    bool directed;      // connected to the cached access point without a scan
+    bool fell_back;     // the directed try failed and a scan was needed
+    wifi_ip_mode_t ip_mode;
+} wifi_connect_timing_t;
+
+//Function definitions
+// true when record can be used for a directed connect to ssid
+bool wifi_fast_record_valid(const wifi_fast_record_t *record, const char *ssid);
+// record may be NULL. a static address wins over the lease, the lease is
+// only used on a directed connect to the access point that gave it out
+wifi_fast_plan_t wifi_fast_plan(const wifi_fast_record_t *record, const char *ssid, bool fast_connect,
+                                bool reuse_lease, bool has_static_ip);
+// lease NULL when the address wasn't from dhcp. false if the ssid is too
+// long or the channel out of range
+bool wifi_fast_record_fill(wifi_fast_record_t *record, const char *ssid, const uint8_t bssid[6],
+                           uint8_t channel, const wifi_ip_config_t *lease);
+// the record in nvs only needs writing when this is false
+bool wifi_fast_record_same(const wifi_fast_record_t *a, const wifi_fast_record_t *b);
+const char *wifi_ip_mode_name(wifi_ip_mode_t mode);
+
+#endif // WIFI_FAST_CONNECT_H
@@ -0,0 +1,186 @@
+/*
+    Description: wifi reconnect state machine, see WifiLink.h. the state is
+    changed before an op is called, so an event the op raises straight
+    away (a disconnect echoing back) finds the new state and is dropped
+    Creator: Matthew Ayestaran
+*/
+#include "WifiLink.h"
+#include <string.h>
+
+//PROTOTYPES
+void wifi_link_init(wifi_link_t *link, const wifi_link_ops_t *ops, const wifi_backoff_policy_t *policy);
+bool wifi_link_subscribe(wifi_link_t *link, wifi_link_cb_t cb, void *ctx);
+void wifi_link_start(wifi_link_t *link);
+void wifi_link_stop(wifi_link_t *link);
+void wifi_link_associated(wifi_link_t *link);
+void wifi_link_got_ip(wifi_link_t *link);
+void wifi_link_lost(wifi_link_t *link);
+void wifi_link_timer(wifi_link_t *link);
+bool wifi_link_may_be_up_by(const wifi_link_t *link, int64_t deadline_us);
+uint32_t wifi_backoff_delay_ms(const wifi_backoff_policy_t *policy, uint32_t failures, uint32_t random);
+const char *wifi_link_state_name(wifi_link_state_t state);
+static void wifi_link_set_state(wifi_link_t *link, wifi_link_state_t state);
+static void wifi_link_attempt(wifi_link_t *link);
+static void wifi_link_back_off(wifi_link_t *link);
+
+void wifi_link_init(wifi_link_t *link, const wifi_link_ops_t *ops, const wifi_backoff_policy_t *policy) {
+    const wifi_backoff_policy_t default_policy = WIFI_BACKOFF_POLICY_DEFAULT;
+    memset(link, 0, sizeof(*link));
+    link->ops = *ops;
+    link->policy = policy ? *policy : default_policy;
+    if (link->policy.base_ms == 0) {
+        link->policy.base_ms = 1;
+    }
+    if (link->policy.max_ms < link->policy.base_ms) {
+        link->policy.max_ms = link->policy.base_ms;
+    }
+}
+
+bool wifi_link_subscribe(wifi_link_t *link, wifi_link_cb_t cb, void *ctx) {
+    if (!cb || link->subscriber_count == WIFI_LINK_MAX_SUBSCRIBERS) {
+        return false;
+    }
+    link->subscribers[link->subscriber_count].cb = cb;
+    link->subscribers[link->subscriber_count].ctx = ctx;
+    link->subscriber_count++;
+    return true;
+}
+
+void wifi_link_start(wifi_link_t *link) {
+    if (link->state != WIFI_LINK_STOPPED) {
+        return;
+    }
+    link->failures = 0;
+    wifi_link_attempt(link);
+}
+
+void wifi_link_stop(wifi_link_t *link) {
+    wifi_link_state_t was = link->state;
+    if (was == WIFI_LINK_STOPPED) {
+        return;
+    }
+    link->ops.cancel_timer(link->ops.ctx);
+    wifi_link_set_state(link, WIFI_LINK_STOPPED);
+    if (was != WIFI_LINK_BACKOFF) {
+        link->ops.disconnect(link->ops.ctx);
+    }
+}
+
+void wifi_link_associated(wifi_link_t *link) {
+    if (link->state == WIFI_LINK_CONNECTING) {
+        wifi_link_set_state(link, WIFI_LINK_GETTING_IP);
+    }
+}
+
+// a static address can come in before the associated event has been handled
+void wifi_link_got_ip(wifi_link_t *link) {
+    if (link->state != WIFI_LINK_CONNECTING && link->state != WIFI_LINK_GETTING_IP) {
+        return;
+    }
+    link->ops.cancel_timer(link->ops.ctx);
+    link->up_since_us = link->ops.now_us(link->ops.ctx);
+    wifi_link_set_state(link, WIFI_LINK_UP);
+}
+
+void wifi_link_lost(wifi_link_t *link) {
+    switch (link->state) {
+        case WIFI_LINK_UP: {
+            const int64_t up_us = link->ops.now_us(link->ops.ctx) - link->up_since_us;
+            link->drops++;
+            if (up_us >= (int64_t)link->policy.stable_ms * 1000) {
+                link->failures = 0;
+                wifi_link_attempt(link);
+            } else {
+                wifi_link_back_off(link); // flapping, treat it like a failed attempt
+            }
+            break;
+        }
+        case WIFI_LINK_CONNECTING:
+        case WIFI_LINK_GETTING_IP:
+            link->ops.cancel_timer(link->ops.ctx);
+            wifi_link_back_off(link);
+            break;
+        case WIFI_LINK_STOPPED:
+        case WIFI_LINK_BACKOFF:
+            break; // the echo of a disconnect asked for, or a late one
+    }
+}
+
+// the backoff is over, or the attempt ran out of time
+void wifi_link_timer(wifi_link_t *link) {
+    switch (link->state) {
+        case WIFI_LINK_BACKOFF:
+            wifi_link_attempt(link);
+            break;
+        case WIFI_LINK_CONNECTING:
+        case WIFI_LINK_GETTING_IP:
+            wifi_link_back_off(link);
+            link->ops.disconnect(link->ops.ctx);
+            break;
+        case WIFI_LINK_STOPPED:
+        case WIFI_LINK_UP:
+            break; // cancelled too late
+    }
+}
+
+bool wifi_link_may_be_up_by(const wifi_link_t *link, int64_t deadline_us) {
+    switch (link->state) {
+        case WIFI_LINK_UP:
+            return true;
+        case WIFI_LINK_STOPPED:
+            return false;
+        case WIFI_LINK_BACKOFF:
+            return link->next_attempt_us < deadline_us;
+        default:
+            return link->ops.now_us(link->ops.ctx) < deadline_us;
+    }
+}
+
+uint32_t wifi_backoff_delay_ms(const wifi_backoff_policy_t *policy, uint32_t failures, uint32_t random) {
+    uint64_t delay = policy->base_ms;
+    for (uint32_t i = 1; i < failures && delay < policy->max_ms; i++) {
+        delay *= 2;
+    }
+    if (delay > policy->max_ms) {
+        delay = policy->max_ms;
+    }
+    const uint32_t half = (uint32_t)delay / 2;
+    return (uint32_t)delay - half + random % (half + 1);
+}
+
+const char *wifi_link_state_name(wifi_link_state_t state) {
+    switch (state) {
+        case WIFI_LINK_STOPPED:    return "stopped";
+        case WIFI_LINK_CONNECTING: return "connecting";
+        case WIFI_LINK_GETTING_IP: return "getting ip";
+        case WIFI_LINK_UP:         return "up";
+        case WIFI_LINK_BACKOFF:    return "backoff";
+    }
+    return "unknown";
+}
+
+static void wifi_link_set_state(wifi_link_t *link, wifi_link_state_t state) {
+    const wifi_link_state_t from = link->state;
+    if (from == state) {
+        return;
+    }
+    link->state = state;
+    for (int i = 0; i < link->subscriber_count; i++) {
+        link->subscribers[i].cb(link->subscribers[i].ctx, from, state);
+    }
+}
+
+static void wifi_link_attempt(wifi_link_t *link) {
+    link->attempts++;
+    wifi_link_set_state(link, WIFI_LINK_CONNECTING);
+    link->ops.arm_timer(link->ops.ctx, link->policy.attempt_timeout_ms);
+    link->ops.connect(link->ops.ctx);
+}
+
+static void wifi_link_back_off(wifi_link_t *link) {
+    link->failures++;
+    const uint32_t delay_ms = wifi_backoff_delay_ms(&link->policy, link->failures, link->ops.random(link->ops.ctx));
+    link->next_attempt_us = link->ops.now_us(link->ops.ctx) + (int64_t)delay_ms * 1000;
+    wifi_link_set_state(link, WIFI_LINK_BACKOFF);
+    link->ops.arm_timer(link->ops.ctx, delay_ms);
+}
@@ -0,0 +1,92 @@
+/*
+    Description: the wifi reconnect state machine without esp_wifi. the
+    radio, the one shot timer, the clock and the random numbers come in
+    through wifi_link_ops_t, the radio's results go back in as events, so
+    the whole thing runs against fakes on the host. it never gives up, a
+    failed attempt waits an exponential backoff with jitter before the
+    next one, a link that was up for a while is retried at once when it
+    drops and one that keeps dropping soon after coming up backs off like
+    a failed attempt, so a flaky access point can't cause a reconnect
+    storm. every change of state is handed to the subscribers
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WIFI_LINK_MAX_SUBSCRIBERS 4
+
+typedef enum {
+    WIFI_LINK_STOPPED = 0, // not started, or stopped on purpose
+    WIFI_LINK_CONNECTING,  // an attempt is in flight, scan, auth and assoc
+    WIFI_LINK_GETTING_IP,  // associated, waiting for an address
+    WIFI_LINK_UP,          // has an address, the connection is warm
+    WIFI_LINK_BACKOFF,     // waiting to try again
+} wifi_link_state_t;
+
+typedef struct {
+    uint32_t base_ms;            // wait after the first failure, doubled after each one
+    uint32_t max_ms;             // the doubling stops here
+    uint32_t attempt_timeout_ms; // an attempt not up by then is dropped and counts as a failure
+    uint32_t stable_ms;          // up this long and a drop starts over without waiting
+} wifi_backoff_policy_t;
+
+#define WIFI_BACKOFF_POLICY_DEFAULT                                            \
+    { .base_ms = 500, .max_ms = 60000, .attempt_timeout_ms = 15000,            \
+      .stable_ms = 30000 }
+
+// called on the task the events come in on, keep it short
+typedef void (*wifi_link_cb_t)(void *ctx, wifi_link_state_t from, wifi_link_state_t to);
+
+typedef struct {
+    void (*connect)(void *ctx);    // start an attempt, how it went comes back as events
+    void (*disconnect)(void *ctx); // drop the attempt or the link, any event it causes is ignored
+    void (*arm_timer)(void *ctx, uint32_t ms); // one shot, replaces one already armed
+    void (*cancel_timer)(void *ctx);
+    uint32_t (*random)(void *ctx);
+    int64_t (*now_us)(void *ctx);
+    void *ctx;
+} wifi_link_ops_t;
+
+typedef struct {
+    wifi_link_cb_t cb;
+    void *ctx;
+} wifi_link_subscriber_t;
+
+typedef struct {
+    wifi_link_ops_t ops;
+    wifi_backoff_policy_t policy;
+    wifi_link_state_t state;
+    uint32_t failures;       // in a row, picks the next backoff
+    int64_t next_attempt_us; // while backing off
+    int64_t up_since_us;
+    uint32_t attempts;       // over the link's life
+    uint32_t drops;          // times it went down from up
+    wifi_link_subscriber_t subscribers[WIFI_LINK_MAX_SUBSCRIBERS];
+    int subscriber_count;
+} wifi_link_t;
+
+//Function definitions
+// policy NULL for WIFI_BACKOFF_POLICY_DEFAULT
+void wifi_link_init(wifi_link_t *link, const wifi_link_ops_t *ops, const wifi_backoff_policy_t *policy);
+// false when all WIFI_LINK_MAX_SUBSCRIBERS are taken
+bool wifi_link_subscribe(wifi_link_t *link, wifi_link_cb_t cb, void *ctx);
+// the events, all from the one task
+void wifi_link_start(wifi_link_t *link);
+void wifi_link_stop(wifi_link_t *link);
+void wifi_link_associated(wifi_link_t *link);
+void wifi_link_got_ip(wifi_link_t *link);
+void wifi_link_lost(wifi_link_t *link); // attempt failed, or the link dropped
+void wifi_link_timer(wifi_link_t *link);
+// false when it can't be up by deadline_us, stopped or backing off past it,
+// so a caller with a deadline can give up at once instead of waiting it out
+bool wifi_link_may_be_up_by(const wifi_link_t *link, int64_t deadline_us);
+// the wait after failures failed attempts in a row, between half and all
+// of the doubled delay so retries from many devices don't line up
+uint32_t wifi_backoff_delay_ms(const wifi_backoff_policy_t *policy, uint32_t failures, uint32_t random);
+const char *wifi_link_state_name(wifi_link_state_t state);
+
+#endif // WIFI_LINK_H
@@ -0,0 +1,398 @@
+/*
+    Description: incremental json extractor, see GeminiJson.h. a small state
+    machine with a stack of open containers, each tagged with where it sits
+    in the reply so only the strings we want are ever copied. numbers and
+    literals are skipped by character class, not fully validated
+    Creator: Matthew Ayestaran
+*/
+
+#include "GeminiJson.h"
+#include <string.h>
+
+// where a container or string sits in a GenerateContentResponse
+enum {
+    ROLE_OTHER = 0,
+    ROLE_ROOT,       // the response object
+    ROLE_CANDIDATES, // "candidates" array
+    ROLE_CANDIDATE,  // candidates[0]
+    ROLE_CONTENT,    // candidates[0].content
+    ROLE_PARTS,      // candidates[0].content.parts
+    ROLE_PART,       // any element of parts
+    ROLE_TEXT,       // parts[*].text
+    ROLE_CACHE,      // top level cachedContent
+};
+
+enum { TARGET_NONE = 0, TARGET_KEY, TARGET_TEXT, TARGET_CACHE };
+
+//PROTOTYPES
+void gemini_json_init(gemini_json_t *json, char *text, size_t text_size,
+                      gemini_json_text_cb_t on_text, void *ctx);
+void gemini_json_reset(gemini_json_t *json);
+gemini_json_status_t gemini_json_feed(gemini_json_t *json, const char *bytes, size_t len);
+static bool json_begin_value(gemini_json_t *json, char c);
+static uint8_t json_value_role(const gemini_json_t *json);
+static void json_key_done(gemini_json_t *json);
+static void json_value_done(gemini_json_t *json);
+static bool json_after_value(gemini_json_t *json, char c);
+static bool json_emit(gemini_json_t *json, const char *bytes, size_t len);
+static bool json_emit_code_point(gemini_json_t *json, uint32_t code_point);
+static bool json_unicode_done(gemini_json_t *json);
+static bool json_flush_surrogate(gemini_json_t *json);
+static bool json_is_space(char c);
+static int json_hex(char c);
+
+void gemini_json_init(gemini_json_t *json, char *text, size_t text_size,
+                      gemini_json_text_cb_t on_text, void *ctx) {
+    memset(json, 0, sizeof(*json));
+    json->text = text;
+    json->text_size = text_size;
+    json->on_text = on_text;
+    json->ctx = ctx;
+    if (text && text_size) {
+        text[0] = '\0';
+    }
+    gemini_json_reset(json);
+}
+
+void gemini_json_reset(gemini_json_t *json) {
+    json->state = GEMINI_JSON_VALUE;
+    json->status = GEMINI_JSON_MORE;
+    json->depth = 0;
+    json->consumed = 0;
+    json->high_surrogate = 0;
+}
+
+gemini_json_status_t gemini_json_feed(gemini_json_t *json, const char *bytes, size_t len) {
+    size_t i = 0;
+    while (i < len && (json->status == GEMINI_JSON_MORE || json->status == GEMINI_JSON_DONE)) {
+        char c = bytes[i];
+        bool ok = true;
+        switch (json->state) {
+            case GEMINI_JSON_STRING: {
+                // copy the plain run up to the next quote or escape in one go
+                size_t end = i;
+                while (end < len && bytes[end] != '"' && bytes[end] != '\\' && (uint8_t)bytes[end] >= 0x20) {
+                    end++;
+                }
+                if (end > i) {
+                    ok = json_flush_surrogate(json) && json_emit(json, bytes + i, end - i);
+                    i = end;
+                    break;
+                }
+                if (c == '"') {
+                    ok = json_flush_surrogate(json);
+                    if (json->string_target == TARGET_KEY) {
+                        json_key_done(json);
+                    } else {
+                        json_value_done(json);
+                    }
+                } else if (c == '\\') {
+                    json->state = GEMINI_JSON_ESCAPE;
+                } else {
+                    json->status = GEMINI_JSON_ERROR; // raw control character
+                }
+                i++;
+                break;
+            }
+            case GEMINI_JSON_ESCAPE: {
+                static const char escaped[] = "\"\\/bfnrt";
+                static const char decoded[] = "\"\\/\b\f\n\r\t";
+                const char *found = c ? strchr(escaped, c) : NULL;
+                if (c == 'u') {
+                    json->state = GEMINI_JSON_UNICODE;
+                    json->unicode = 0;
+                    json->unicode_digits = 0;
+                } else if (found) {
+                    ok = json_flush_surrogate(json) && json_emit(json, &decoded[found - escaped], 1);
+                    json->state = GEMINI_JSON_STRING;
+                } else {
+                    json->status = GEMINI_JSON_ERROR;
+                }
+                i++;
+                break;
+            }
+            case GEMINI_JSON_UNICODE: {
+                int digit = json_hex(c);
+                if (digit < 0) {
+                    json->status = GEMINI_JSON_ERROR;
+                    break;
+                }
+                json->unicode = (json->unicode << 4) | (uint32_t)digit;
+                if (++json->unicode_digits == 4) {
+                    ok = json_unicode_done(json);
+                    json->state = GEMINI_JSON_STRING;
+                }
+                i++;
+                break;
+            }
+            case GEMINI_JSON_SCALAR:
+                if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    c == '.' || c == '+' || c == '-') {
+                    i++;
+                } else {
+                    json_value_done(json); // c belongs to whatever comes next
+                }
+                break;
+            default:
+                if (json_is_space(c)) {
+                    do { // replies are pretty printed, indentation comes in runs
+                        i++;
+                    } while (i < len && json_is_space(bytes[i]));
+                    break;
+                }
+                switch (json->state) {
+                    case GEMINI_JSON_FIRST_VALUE:
+                        if (c == ']') {
+                            json->depth--;
+                            json_value_done(json);
+                            break;
+                        }
+                        // fall through
+                    case GEMINI_JSON_VALUE:
+                        ok = json_begin_value(json, c);
+                        break;
+                    case GEMINI_JSON_FIRST_KEY:
+                        if (c == '}') {
+                            json->depth--;
+                            json_value_done(json);
+                            break;
+                        }
+                        // fall through
+                    case GEMINI_JSON_KEY:
+                        if (c != '"') {
+                            ok = false;
+                            break;
+                        }
+                        json->state = GEMINI_JSON_STRING;
+                        json->string_target = TARGET_KEY;
+                        json->key_len = 0;
+                        json->key_overflow = false;
+                        break;
+                    case GEMINI_JSON_COLON:
+                        if (c != ':') {
+                            ok = false;
+                            break;
+                        }
+                        json->state = GEMINI_JSON_VALUE;
+                        break;
+                    case GEMINI_JSON_AFTER_VALUE:
+                        ok = json_after_value(json, c);
+                        break;
+                    default: // GEMINI_JSON_END, only whitespace is left
+                        ok = false;
+                        break;
+                }
+                i++;
+                break;
+        }
+        if (!ok && json->status != GEMINI_JSON_ABORTED) {
+            json->status = GEMINI_JSON_ERROR;
+        }
+    }
+    json->consumed += i;
+    return json->status;
+}
+
+static bool json_begin_value(gemini_json_t *json, char c) {
+    uint8_t role = json_value_role(json);
+    if (c == '{' || c == '[') {
+        if (json->depth == GEMINI_JSON_DEPTH_MAX) {
+            return false;
+        }
+        bool wanted = c == '{' ? (role == ROLE_ROOT || role == ROLE_CANDIDATE || role == ROLE_CONTENT ||
+                                  role == ROLE_PART)
+                               : (role == ROLE_CANDIDATES || role == ROLE_PARTS);
+        json->stack[json->depth++] = (gemini_json_frame_t){(uint8_t)c, wanted ? role : ROLE_OTHER, 0};
+        json->state = c == '{' ? GEMINI_JSON_FIRST_KEY : GEMINI_JSON_FIRST_VALUE;
+        return true;
+    }
+    if (c == '"') {
+        json->state = GEMINI_JSON_STRING;
+        json->string_target = role == ROLE_TEXT ? TARGET_TEXT : role == ROLE_CACHE ? TARGET_CACHE : TARGET_NONE;
+        if (json->string_target == TARGET_CACHE) {
+            json->cache_name_len = 0; // the last one wins
+        }
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        json->state = GEMINI_JSON_SCALAR;
+        return true;
+    }
+    return false;
+}
+
+static uint8_t json_value_role(const gemini_json_t *json) {
+    if (json->depth == 0) {
+        return ROLE_ROOT;
+    }
+    const gemini_json_frame_t *top = &json->stack[json->depth - 1];
+    if (top->container == '{') {
+        return json->pending_role;
+    }
+    if (top->role == ROLE_CANDIDATES) {
+        return top->index == 0 ? ROLE_CANDIDATE : ROLE_OTHER;
+    }
+    return top->role == ROLE_PARTS ? ROLE_PART : ROLE_OTHER;
+}
+
+// decide what the value after this key is for
+static void json_key_done(gemini_json_t *json) {
+    json->state = GEMINI_JSON_COLON;
+    json->pending_role = ROLE_OTHER;
+    if (json->key_overflow) {
+        return;
+    }
+    json->key[json->key_len] = '\0';
+    switch (json->stack[json->depth - 1].role) {
+        case ROLE_ROOT:
+            if (strcmp(json->key, "candidates") == 0) {
+                json->pending_role = ROLE_CANDIDATES;
+            } else if (strcmp(json->key, "cachedContent") == 0) {
+                json->pending_role = ROLE_CACHE;
+            }
+            break;
+        case ROLE_CANDIDATE:
+            json->pending_role = strcmp(json->key, "content") == 0 ? ROLE_CONTENT : ROLE_OTHER;
+            break;
+        case ROLE_CONTENT:
+            json->pending_role = strcmp(json->key, "parts") == 0 ? ROLE_PARTS : ROLE_OTHER;
+            break;
+        case ROLE_PART:
+            json->pending_role = strcmp(json->key, "text") == 0 ? ROLE_TEXT : ROLE_OTHER;
+            break;
+    }
+}
+
+static void json_value_done(gemini_json_t *json) {
+    if (json->depth == 0) {
+        json->state = GEMINI_JSON_END;
+        json->status = GEMINI_JSON_DONE;
+    } else {
+        json->state = GEMINI_JSON_AFTER_VALUE;
+    }
+}
+
+static bool json_after_value(gemini_json_t *json, char c) {
+    gemini_json_frame_t *top = &json->stack[json->depth - 1];
+    if (c == ',') {
+        if (top->container == '{') {
+            json->state = GEMINI_JSON_KEY;
+        } else {
+            top->index++;
+            json->state = GEMINI_JSON_VALUE;
+        }
+        return true;
+    }
+    if ((c == '}' && top->container == '{') || (c == ']' && top->container == '[')) {
+        json->depth--;
+        json_value_done(json);
+        return true;
+    }
+    return false;
+}
+
+// decoded string bytes to wherever the current string goes
+static bool json_emit(gemini_json_t *json, const char *bytes, size_t len) {
+    switch (json->string_target) {
+        case TARGET_KEY:
+            if (json->key_len + len >= GEMINI_JSON_KEY_MAX) {
+                json->key_overflow = true; // longer than any key we match
+            } else {
+                memcpy(json->key + json->key_len, bytes, len);
+                json->key_len += len;
+            }
+            break;
+        case TARGET_CACHE: {
+            size_t room = GEMINI_JSON_CACHE_NAME_MAX - 1 - json->cache_name_len;
+            size_t copy = len < room ? len : room;
+            memcpy(json->cache_name + json->cache_name_len, bytes, copy);
+            json->cache_name_len += copy;
+            json->cache_name[json->cache_name_len] = '\0';
+            break;
+        }
+        case TARGET_TEXT:
+            if (json->text && json->text_size) {
+                size_t room = json->text_size - 1 - json->text_len;
+                size_t copy = len < room ? len : room;
+                memcpy(json->text + json->text_len, bytes, copy);
+                json->text_len += copy;
+                json->text[json->text_len] = '\0';
+                json->text_truncated |= copy < len;
+            }
+            if (json->on_text && !json->on_text(json->ctx, bytes, len)) {
+                json->status = GEMINI_JSON_ABORTED;
+                return false;
+            }
+            break;
+    }
+    return true;
+}
+
+static bool json_emit_code_point(gemini_json_t *json, uint32_t code_point) {
+    char utf8[4];
+    size_t len;
+    if (code_point < 0x80) {
+        utf8[0] = (char)code_point;
+        len = 1;
+    } else if (code_point < 0x800) {
+        utf8[0] = (char)(0xC0 | (code_point >> 6));
+        utf8[1] = (char)(0x80 | (code_point & 0x3F));
+        len = 2;
+    } else if (code_point < 0x10000) {
+        utf8[0] = (char)(0xE0 | (code_point >> 12));
+        utf8[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code_point & 0x3F));
+        len = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (code_point >> 18));
+        utf8[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code_point & 0x3F));
+        len = 4;
+    }
+    return json_emit(json, utf8, len);
+}
+
+// characters outside the basic plane come as two \u escapes, a half without
+// its partner becomes U+FFFD
+static bool json_unicode_done(gemini_json_t *json) {
+    uint32_t unit = json->unicode;
+    if (json->high_surrogate) {
+        if (unit >= 0xDC00 && unit <= 0xDFFF) {
+            uint32_t code_point = 0x10000 + (((uint32_t)json->high_surrogate - 0xD800) << 10) + (unit - 0xDC00);
+            json->high_surrogate = 0;
+            return json_emit_code_point(json, code_point);
+        }
+        if (!json_flush_surrogate(json)) {
+            return false;
+        }
+    }
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        json->high_surrogate = (uint16_t)unit;
+        return true;
+    }
+    return json_emit_code_point(json, unit >= 0xDC00 && unit <= 0xDFFF ? 0xFFFD : unit);
+}
+
+static bool json_flush_surrogate(gemini_json_t *json) {
+    if (!json->high_surrogate) {
+        return true;
+    }
+    json->high_surrogate = 0;
+    return json_emit_code_point(json, 0xFFFD);
+}
+
+static bool json_is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+static int json_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
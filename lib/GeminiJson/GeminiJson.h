@@ -0,0 +1,84 @@
+/*
+    Description: incremental json extractor for gemini replies. bytes go in as
+    they arrive, split anywhere, and only candidates[0].content.parts[*].text
+    and the top level cachedContent come out. nothing else in the reply
+    (grounding, safety ratings, usage) is kept, so there is no tree and no heap
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef GEMINI_JSON_H
+#define GEMINI_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GEMINI_JSON_DEPTH_MAX 32      // deeper documents are rejected
+#define GEMINI_JSON_KEY_MAX 16        // longest key we match, "cachedContent"
+#define GEMINI_JSON_CACHE_NAME_MAX 128
+
+typedef enum {
+    GEMINI_JSON_MORE = 0, // document not finished, keep feeding
+    GEMINI_JSON_DONE,     // top level value closed
+    GEMINI_JSON_ERROR,    // not json, or nested deeper than GEMINI_JSON_DEPTH_MAX
+    GEMINI_JSON_ABORTED,  // text callback asked to stop
+} gemini_json_status_t;
+
+// decoded answer text as it is found, utf-8. return false to stop
+typedef bool (*gemini_json_text_cb_t)(void *ctx, const char *text, size_t len);
+
+typedef enum {
+    GEMINI_JSON_VALUE,       // expecting a value
+    GEMINI_JSON_FIRST_VALUE, // just after '[', ']' is allowed
+    GEMINI_JSON_KEY,         // expecting a key
+    GEMINI_JSON_FIRST_KEY,   // just after '{', '}' is allowed
+    GEMINI_JSON_COLON,
+    GEMINI_JSON_AFTER_VALUE, // expecting ',' or the end of the container
+    GEMINI_JSON_STRING,
+    GEMINI_JSON_ESCAPE,      // after a backslash
+    GEMINI_JSON_UNICODE,     // reading the 4 hex digits of \u
+    GEMINI_JSON_SCALAR,      // number, true, false or null
+    GEMINI_JSON_END,         // only whitespace may follow
+} gemini_json_state_t;
+
+typedef struct {
+    uint8_t container; // '{' or '['
+    uint8_t role;      // where this container sits in the reply, see GeminiJson.c
+    uint32_t index;    // element number inside an array
+} gemini_json_frame_t;
+
+typedef struct {
+    // output
+    char *text;            // optional, answer text kept nul terminated
+    size_t text_size;
+    size_t text_len;
+    bool text_truncated;   // more text than text_size could hold
+    gemini_json_text_cb_t on_text; // optional, sees all of it
+    void *ctx;
+    char cache_name[GEMINI_JSON_CACHE_NAME_MAX];
+    size_t cache_name_len;
+    size_t consumed;       // bytes fed so far, the error position on ERROR
+
+    // tokenizer
+    gemini_json_state_t state;
+    gemini_json_status_t status;
+    uint8_t string_target; // what the string being read is for
+    uint8_t pending_role;  // role of the value after the current key
+    bool key_overflow;
+    char key[GEMINI_JSON_KEY_MAX];
+    size_t key_len;
+    uint32_t unicode;      // \u digits so far
+    uint8_t unicode_digits;
+    uint16_t high_surrogate; // first half of a utf-16 surrogate pair
+    size_t depth;
+    gemini_json_frame_t stack[GEMINI_JSON_DEPTH_MAX];
+} gemini_json_t;
+
+//Function definitions
+void gemini_json_init(gemini_json_t *json, char *text, size_t text_size,
+                      gemini_json_text_cb_t on_text, void *ctx);
+// ready for another document, text found so far is kept
+void gemini_json_reset(gemini_json_t *json);
+gemini_json_status_t gemini_json_feed(gemini_json_t *json, const char *bytes, size_t len);
+
+#endif // GEMINI_JSON_H
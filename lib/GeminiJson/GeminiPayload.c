@@ -0,0 +1,444 @@
+/*
+    Description: request body writer, see GeminiPayload.h. strings are
+    escaped per rfc 8259 and anything that isn't valid utf-8 becomes U+FFFD,
+    so whatever the question holds the body is valid json. the audio clip is
+    base64 in whole 4 character groups, the bytes short of a group wait in
+    the stream for the next pcm
+    Creator: Matthew Ayestaran
+*/
+
+#include "GeminiPayload.h"
+#include <string.h>
+
+#define PAYLOAD_SAFETY(category) "{\"category\":\"" category "\",\"threshold\":\"BLOCK_NONE\"}"
+
+#define PAYLOAD_PARTS_OPEN "{\"contents\":[{\"parts\":["
+#define PAYLOAD_AUDIO_OPEN "{\"inline_data\":{\"mime_type\":\""
+#define PAYLOAD_RAW_CHUNK 192 // pcm bytes encoded per step, 256 characters
+
+// how a piece is read out
+enum {
+    PIECE_COPIED = 0,
+    PIECE_ESCAPED,
+    PIECE_AUDIO,
+};
+
+// the fixed parts of the body, in the order cJSON used to print them
+static const char PAYLOAD_PREFIX[] = PAYLOAD_PARTS_OPEN "{\"text\":\"";
+static const char PAYLOAD_AFTER_QUESTION[] = "\"}]}]";
+static const char PAYLOAD_AUDIO_PREFIX[] = PAYLOAD_PARTS_OPEN PAYLOAD_AUDIO_OPEN;
+static const char PAYLOAD_PROMPT_THEN_AUDIO[] = "\"}," PAYLOAD_AUDIO_OPEN;
+static const char PAYLOAD_AUDIO_DATA[] = "\",\"data\":\"";
+static const char PAYLOAD_WAV_MIME[] = "audio/wav";
+static const char PAYLOAD_AFTER_AUDIO[] = "\"}}]}]";
+static const char PAYLOAD_CACHE_KEY[] = ",\"cachedContent\":\"";
+static const char PAYLOAD_QUOTE[] = "\"";
+static const char PAYLOAD_SUFFIX[] =
+    ",\"tools\":[{\"googleSearchRetrieval\":{}}]"
+    ",\"safetySettings\":["
+    PAYLOAD_SAFETY("HARM_CATEGORY_DANGEROUS_CONTENT") ","
+    PAYLOAD_SAFETY("HARM_CATEGORY_HATE_SPEECH") ","
+    PAYLOAD_SAFETY("HARM_CATEGORY_HARASSMENT") ","
+    PAYLOAD_SAFETY("HARM_CATEGORY_SEXUALLY_EXPLICIT") "]"
+    ",\"generationConfig\":{\"temperature\":0.9}}";
+
+//PROTOTYPES
+void gemini_payload_init(gemini_payload_t *payload, const char *question, const char *cache_name);
+void gemini_payload_init_audio(gemini_payload_t *payload, const char *prompt,
+                               const gemini_payload_audio_t *audio, const char *cache_name);
+size_t gemini_payload_len(const gemini_payload_t *payload);
+size_t gemini_payload_read(gemini_payload_t *payload, char *buf, size_t size);
+bool gemini_payload_rewind(gemini_payload_t *payload);
+size_t gemini_payload_write(const char *question, const char *cache_name, char *buf, size_t size);
+void gemini_payload_wav_header(uint8_t header[GEMINI_PAYLOAD_WAV_HEADER_SIZE], uint32_t sample_rate,
+                               uint32_t total_samples);
+size_t gemini_payload_escape(const char *text, char *out, size_t size);
+static void payload_add(gemini_payload_t *payload, const char *text, uint8_t kind);
+static void payload_add_tail(gemini_payload_t *payload, const char *cache_name);
+static size_t payload_read_text(gemini_payload_t *payload, const gemini_payload_piece_t *piece, char *buf,
+                                size_t size, bool *finished);
+static size_t payload_read_audio(gemini_payload_t *payload, char *buf, size_t size, bool *finished);
+static int payload_audio_bytes(gemini_payload_t *payload, uint8_t *buf, size_t size);
+static size_t payload_put_split(gemini_payload_t *payload, char *buf, size_t room, const char *token,
+                                size_t token_len);
+static void payload_put_le32(uint8_t *out, uint32_t value);
+static size_t payload_escape_one(const char *s, char out[GEMINI_PAYLOAD_ESCAPE_MAX], size_t *used);
+static size_t payload_utf8_len(const uint8_t *s);
+static bool payload_is_plain(char c);
+
+void gemini_payload_init(gemini_payload_t *payload, const char *question, const char *cache_name) {
+    memset(payload, 0, sizeof(*payload));
+    payload_add(payload, PAYLOAD_PREFIX, PIECE_COPIED);
+    payload_add(payload, question ? question : "", PIECE_ESCAPED);
+    payload_add(payload, PAYLOAD_AFTER_QUESTION, PIECE_COPIED);
+    payload_add_tail(payload, cache_name);
+}
+
+void gemini_payload_init_audio(gemini_payload_t *payload, const char *prompt,
+                               const gemini_payload_audio_t *audio, const char *cache_name) {
+    memset(payload, 0, sizeof(*payload));
+    if (prompt != NULL) {
+        payload_add(payload, PAYLOAD_PREFIX, PIECE_COPIED);
+        payload_add(payload, prompt, PIECE_ESCAPED);
+        payload_add(payload, PAYLOAD_PROMPT_THEN_AUDIO, PIECE_COPIED);
+    } else {
+        payload_add(payload, PAYLOAD_AUDIO_PREFIX, PIECE_COPIED);
+    }
+    payload_add(payload, audio->mime_type ? audio->mime_type : PAYLOAD_WAV_MIME, PIECE_ESCAPED);
+    payload_add(payload, PAYLOAD_AUDIO_DATA, PIECE_COPIED);
+    payload_add(payload, "", PIECE_AUDIO);
+    payload_add(payload, PAYLOAD_AFTER_AUDIO, PIECE_COPIED);
+    payload_add_tail(payload, cache_name);
+    payload->audio = *audio;
+    gemini_payload_wav_header(payload->wav_header, audio->sample_rate, audio->total_samples);
+    base64_stream_init(&payload->base64);
+}
+
+size_t gemini_payload_len(const gemini_payload_t *payload) {
+    size_t len = 0;
+    for (uint8_t p = 0; p < payload->piece_count; p++) {
+        const char *s = payload->pieces[p].text;
+        if (payload->pieces[p].kind == PIECE_AUDIO) {
+            if (payload->audio.total_samples == 0 || payload->audio.read_encoded != NULL) {
+                return GEMINI_PAYLOAD_LEN_UNKNOWN;
+            }
+            size_t raw = GEMINI_PAYLOAD_WAV_HEADER_SIZE + 2 * (size_t)payload->audio.total_samples;
+            len += (raw + 2) / 3 * 4;
+            continue;
+        }
+        if (payload->pieces[p].kind == PIECE_COPIED) {
+            len += strlen(s);
+            continue;
+        }
+        char scratch[GEMINI_PAYLOAD_ESCAPE_MAX];
+        while (*s) {
+            size_t used;
+            len += payload_escape_one(s, scratch, &used);
+            s += used;
+        }
+    }
+    return len;
+}
+
+size_t gemini_payload_read(gemini_payload_t *payload, char *buf, size_t size) {
+    size_t written = 0;
+    while (payload->split_pos < payload->split_len && written < size) {
+        buf[written++] = payload->split[payload->split_pos++];
+    }
+    while (written < size && payload->piece < payload->piece_count && !payload->failed) {
+        const gemini_payload_piece_t *piece = &payload->pieces[payload->piece];
+        bool finished;
+        if (piece->kind == PIECE_AUDIO) {
+            written += payload_read_audio(payload, buf + written, size - written, &finished);
+        } else {
+            written += payload_read_text(payload, piece, buf + written, size - written, &finished);
+        }
+        if (!finished) {
+            break;
+        }
+        payload->piece++;
+        payload->offset = 0;
+    }
+    return payload->failed ? 0 : written;
+}
+
+bool gemini_payload_rewind(gemini_payload_t *payload) {
+    for (uint8_t p = 0; p < payload->piece_count; p++) {
+        if (payload->pieces[p].kind == PIECE_AUDIO) {
+            return false;
+        }
+    }
+    payload->piece = 0;
+    payload->offset = 0;
+    payload->split_len = 0;
+    payload->split_pos = 0;
+    return true;
+}
+
+size_t gemini_payload_write(const char *question, const char *cache_name, char *buf, size_t size) {
+    gemini_payload_t payload;
+    gemini_payload_init(&payload, question, cache_name);
+    size_t len = gemini_payload_len(&payload);
+    if (size < len + 1) {
+        return 0;
+    }
+    size_t written = gemini_payload_read(&payload, buf, len);
+    buf[written] = '\0';
+    return written;
+}
+
+void gemini_payload_wav_header(uint8_t header[GEMINI_PAYLOAD_WAV_HEADER_SIZE], uint32_t sample_rate,
+                               uint32_t total_samples) {
+    // a clip still being recorded says it runs to the end of the stream
+    uint32_t data_size = total_samples ? total_samples * 2 : UINT32_MAX;
+    uint32_t riff_size = total_samples ? data_size + 36 : UINT32_MAX;
+    memcpy(header, "RIFF", 4);
+    payload_put_le32(header + 4, riff_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    payload_put_le32(header + 16, 16);
+    payload_put_le32(header + 20, 1 | (1u << 16)); // pcm, mono
+    payload_put_le32(header + 24, sample_rate);
+    payload_put_le32(header + 28, sample_rate * 2);
+    payload_put_le32(header + 32, 2 | (16u << 16)); // block align, bits per sample
+    memcpy(header + 36, "data", 4);
+    payload_put_le32(header + 40, data_size);
+}
+
+size_t gemini_payload_escape(const char *text, char *out, size_t size) {
+    size_t written = 0;
+    while (*text != '\0') {
+        char escape[GEMINI_PAYLOAD_ESCAPE_MAX];
+        size_t used;
+        size_t len = payload_escape_one(text, escape, &used);
+        if (written + len + 1 > size) {
+            if (size > 0) {
+                out[0] = '\0';
+            }
+            return 0;
+        }
+        memcpy(out + written, escape, len);
+        written += len;
+        text += used;
+    }
+    if (size > 0) {
+        out[written] = '\0';
+    }
+    return written;
+}
+
+static void payload_add(gemini_payload_t *payload, const char *text, uint8_t kind) {
+    payload->pieces[payload->piece_count].text = text;
+    payload->pieces[payload->piece_count].kind = kind;
+    payload->piece_count++;
+}
+
+static void payload_add_tail(gemini_payload_t *payload, const char *cache_name) {
+    if (cache_name != NULL) {
+        payload_add(payload, PAYLOAD_CACHE_KEY, PIECE_COPIED);
+        payload_add(payload, cache_name, PIECE_ESCAPED);
+        payload_add(payload, PAYLOAD_QUOTE, PIECE_COPIED);
+    }
+    payload_add(payload, PAYLOAD_SUFFIX, PIECE_COPIED);
+}
+
+static size_t payload_read_text(gemini_payload_t *payload, const gemini_payload_piece_t *piece, char *buf,
+                                size_t size, bool *finished) {
+    size_t written = 0;
+    *finished = false;
+    for (;;) {
+        const char *s = piece->text + payload->offset;
+        if (*s == '\0') {
+            *finished = true;
+            return written;
+        }
+        size_t room = size - written;
+        if (room == 0) {
+            return written;
+        }
+        // plain runs go across in one copy, only the odd byte needs escaping.
+        // the scan stops at room so small reads of a long question stay cheap
+        size_t run = 0;
+        while (run < room && s[run] && (piece->kind == PIECE_COPIED || payload_is_plain(s[run]))) {
+            run++;
+        }
+        if (run > 0) {
+            memcpy(buf + written, s, run);
+            written += run;
+            payload->offset += run;
+            continue;
+        }
+        char token[GEMINI_PAYLOAD_ESCAPE_MAX];
+        size_t used;
+        size_t token_len = payload_escape_one(s, token, &used);
+        payload->offset += used;
+        written += payload_put_split(payload, buf + written, room, token, token_len);
+    }
+}
+
+// base64 of the wav header and the pcm after it, as far as the pcm has come.
+// only whole groups go out until the clip ends and the last one is padded
+static size_t payload_read_audio(gemini_payload_t *payload, char *buf, size_t size, bool *finished) {
+    size_t written = 0;
+    *finished = false;
+    while (written < size) {
+        size_t room = size - written;
+        uint8_t raw[PAYLOAD_RAW_CHUNK];
+        // what encodes to no more than room once the carried bytes go first
+        size_t want = room < 4 ? 3 : room / 4 * 3;
+        if (want > sizeof(raw)) {
+            want = sizeof(raw);
+        }
+        want -= payload->base64.carry_len;
+        size_t have = 0;
+        while (have < want && !payload->pcm_done) {
+            int got = payload_audio_bytes(payload, raw + have, want - have);
+            if (got < 0) {
+                payload->failed = true;
+                return written;
+            }
+            if (got == 0) {
+                payload->pcm_done = true;
+            }
+            have += (size_t)got;
+        }
+        if (have == 0) {
+            // the end of the clip, the last group is padded
+            char group[4];
+            size_t tail = base64_stream_final(&payload->base64, group);
+            if (tail == 0) {
+                *finished = true;
+                return written;
+            }
+            written += payload_put_split(payload, buf + written, room, group, tail);
+        } else if (room < 4) {
+            char group[4];
+            size_t len = base64_stream_update(&payload->base64, raw, have, group);
+            written += payload_put_split(payload, buf + written, room, group, len);
+        } else {
+            written += base64_stream_update(&payload->base64, raw, have, buf + written);
+        }
+    }
+    return written;
+}
+
+// up to size raw bytes of the clip, the header first then the pcm little
+// endian, or straight from the encoder. 0 once the recording is over, <0
+// when the source gave up
+static int payload_audio_bytes(gemini_payload_t *payload, uint8_t *buf, size_t size) {
+    if (payload->audio.read_encoded != NULL) {
+        int got = payload->audio.read_encoded(payload->audio.ctx, buf, size);
+        return got > (int)size ? -1 : got;
+    }
+    size_t n = 0;
+    if (payload->offset < GEMINI_PAYLOAD_WAV_HEADER_SIZE) {
+        size_t left = GEMINI_PAYLOAD_WAV_HEADER_SIZE - payload->offset;
+        n = left < size ? left : size;
+        memcpy(buf, payload->wav_header + payload->offset, n);
+        payload->offset += n;
+    }
+    if (n < size && payload->spill_len > 0) {
+        buf[n++] = payload->spill[0];
+        payload->spill_len = 0;
+        payload->offset++;
+    }
+    if (n > 0) {
+        return (int)n;
+    }
+    int16_t samples[PAYLOAD_RAW_CHUNK / 2];
+    size_t max = size / 2 > 0 ? size / 2 : 1;
+    if (max > PAYLOAD_RAW_CHUNK / 2) {
+        max = PAYLOAD_RAW_CHUNK / 2;
+    }
+    int got = payload->audio.read(payload->audio.ctx, samples, max);
+    if (got <= 0) {
+        return got;
+    }
+    if ((size_t)got > max) {
+        return -1;
+    }
+    for (int i = 0; i < got; i++) {
+        uint16_t sample = (uint16_t)samples[i];
+        if (n + 2 <= size) {
+            buf[n++] = (uint8_t)sample;
+            buf[n++] = (uint8_t)(sample >> 8);
+        } else {
+            // only when a single byte was asked for
+            buf[n++] = (uint8_t)sample;
+            payload->spill[0] = (uint8_t)(sample >> 8);
+            payload->spill_len = 1;
+        }
+    }
+    payload->offset += n;
+    return (int)n;
+}
+
+// token into buf as far as room allows, what doesn't fit goes out at the
+// start of the next read
+static size_t payload_put_split(gemini_payload_t *payload, char *buf, size_t room, const char *token,
+                                size_t token_len) {
+    if (token_len <= room) {
+        memcpy(buf, token, token_len);
+        return token_len;
+    }
+    memcpy(buf, token, room);
+    memcpy(payload->split, token, token_len);
+    payload->split_len = (uint8_t)token_len;
+    payload->split_pos = (uint8_t)room;
+    return room;
+}
+
+static void payload_put_le32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+// escapes the character at s into out, *used is how many bytes of s it took
+static size_t payload_escape_one(const char *s, char out[GEMINI_PAYLOAD_ESCAPE_MAX], size_t *used) {
+    static const char hex[] = "0123456789abcdef";
+    uint8_t c = (uint8_t)*s;
+    *used = 1;
+    switch (c) {
+        case '"': memcpy(out, "\\\"", 2); return 2;
+        case '\\': memcpy(out, "\\\\", 2); return 2;
+        case '\b': memcpy(out, "\\b", 2); return 2;
+        case '\f': memcpy(out, "\\f", 2); return 2;
+        case '\n': memcpy(out, "\\n", 2); return 2;
+        case '\r': memcpy(out, "\\r", 2); return 2;
+        case '\t': memcpy(out, "\\t", 2); return 2;
+        default: break;
+    }
+    if (c < 0x20) {
+        memcpy(out, "\\u00", 4);
+        out[4] = hex[c >> 4];
+        out[5] = hex[c & 0xf];
+        return 6;
+    }
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    size_t len = payload_utf8_len((const uint8_t *)s);
+    if (len == 0) {
+        memcpy(out, "\xef\xbf\xbd", 3); // U+FFFD for the stray byte
+        return 3;
+    }
+    memcpy(out, s, len);
+    *used = len;
+    return len;
+}
+
+// length of the well formed utf-8 sequence at s, 0 when it isn't one.
+// overlong forms, surrogates and anything past U+10FFFF are rejected
+static size_t payload_utf8_len(const uint8_t *s) {
+    uint8_t c = s[0];
+    size_t len;
+    uint8_t low = 0x80, high = 0xbf; // allowed range of the second byte
+    if (c >= 0xc2 && c <= 0xdf) {
+        len = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        len = 3;
+        if (c == 0xe0) { low = 0xa0; }
+        if (c == 0xed) { high = 0x9f; }
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        len = 4;
+        if (c == 0xf0) { low = 0x90; }
+        if (c == 0xf4) { high = 0x8f; }
+    } else {
+        return 0;
+    }
+    if (s[1] < low || s[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+static bool payload_is_plain(char c) {
+    return (uint8_t)c >= 0x20 && (uint8_t)c < 0x80 && c != '"' && c != '\\';
+}
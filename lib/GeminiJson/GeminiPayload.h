@@ -0,0 +1,96 @@
+/*
+    Description: generateContent request body writer. everything but the
+    question and the cache name is the same on every request, so it is kept
+    as compact string constants and the two strings are escaped in between
+    them as the body is read out. an audio question carries a wav clip as
+    base64 inline_data instead, encoded as the pcm arrives so the upload can
+    start while recording is still going. a clip already encoded some other
+    way, see AudioCodec.h, goes in the same way under its own mime type. no
+    tree, no heap
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef GEMINI_PAYLOAD_H
+#define GEMINI_PAYLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "Base64.h"
+
+#define GEMINI_PAYLOAD_PIECE_MAX 11
+#define GEMINI_PAYLOAD_ESCAPE_MAX 6 // longest single escape, \u001f
+#define GEMINI_PAYLOAD_WAV_HEADER_SIZE 44
+// gemini_payload_len of an audio body still being recorded
+#define GEMINI_PAYLOAD_LEN_UNKNOWN SIZE_MAX
+
+// 16-bit mono pcm for an audio question. fill samples with up to
+// max_samples and return how many, blocking while recording goes on.
+// 0 once recording has stopped and everything was handed over, <0 to give up
+typedef int (*gemini_pcm_read_t)(void *ctx, int16_t *samples, size_t max_samples);
+// the bytes of an encoded audio file, container header and all, the same
+// way round. up to size bytes, 0 at the end, <0 to give up
+typedef int (*gemini_bytes_read_t)(void *ctx, uint8_t *buf, size_t size);
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t total_samples; // 0 while the length isn't known yet
+    gemini_pcm_read_t read;
+    void *ctx;
+    // set for a clip that is encoded already, read and the wav header go
+    // unused then and the length is never known up front
+    gemini_bytes_read_t read_encoded;
+    const char *mime_type; // NULL for audio/wav
+} gemini_payload_audio_t;
+
+typedef struct {
+    const char *text;
+    uint8_t kind; // copied, escaped or the audio clip, see GeminiPayload.c
+} gemini_payload_piece_t;
+
+typedef struct {
+    gemini_payload_piece_t pieces[GEMINI_PAYLOAD_PIECE_MAX];
+    uint8_t piece_count;
+    uint8_t piece;  // piece being read
+    size_t offset;  // bytes of it already read
+    char split[GEMINI_PAYLOAD_ESCAPE_MAX]; // escape that didn't fit the last read
+    uint8_t split_len;
+    uint8_t split_pos;
+
+    // audio clip, a wav header then the pcm as it is recorded
+    gemini_payload_audio_t audio;
+    uint8_t wav_header[GEMINI_PAYLOAD_WAV_HEADER_SIZE];
+    base64_stream_t base64; // carries the bytes short of a whole group
+    uint8_t spill[2];   // rest of a sample that didn't fit the last pull
+    uint8_t spill_len;
+    bool pcm_done;
+    bool failed;        // read gave up, the body is cut short
+} gemini_payload_t;
+
+//Function definitions
+// cache_name can be NULL, cachedContent is left out then
+void gemini_payload_init(gemini_payload_t *payload, const char *question, const char *cache_name);
+// prompt can be NULL for the clip on its own
+void gemini_payload_init_audio(gemini_payload_t *payload, const char *prompt,
+                               const gemini_payload_audio_t *audio, const char *cache_name);
+// exact length of the whole body for Content-Length, or
+// GEMINI_PAYLOAD_LEN_UNKNOWN for a clip without total_samples
+size_t gemini_payload_len(const gemini_payload_t *payload);
+// next part of the body, any size works. returns the bytes written, 0 once
+// it's all out or when failed is set
+size_t gemini_payload_read(gemini_payload_t *payload, char *buf, size_t size);
+// back to the start, for sending the same body again. a clip can't be
+// recorded twice, false for those
+bool gemini_payload_rewind(gemini_payload_t *payload);
+// whole body into buf, nul terminated. returns its length, or 0 when it
+// doesn't fit
+size_t gemini_payload_write(const char *question, const char *cache_name, char *buf, size_t size);
+// 16-bit mono wav header, total_samples 0 leaves the sizes at their
+// largest the way streamed wav does
+void gemini_payload_wav_header(uint8_t header[GEMINI_PAYLOAD_WAV_HEADER_SIZE], uint32_t sample_rate,
+                               uint32_t total_samples);
+// text as the inside of a json string, escaped the same way as the
+// question, nul terminated. returns its length, or 0 when it doesn't fit
+size_t gemini_payload_escape(const char *text, char *out, size_t size);
+
+#endif // GEMINI_PAYLOAD_H
@@ -0,0 +1,250 @@
+/*
+    Description: button press prewarm of the gemini session, see
+    GeminiPrewarm.h. the lock is only held for the state, never across the
+    resolve or the handshake, so cancel and claim don't wait on the network
+    behind it. run has the session to itself while warming, the claim
+    waits for that to end and the upload has it to itself after
+    Creator: Matthew Ayestaran
+*/
+#include "GeminiPrewarm.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#define PREWARM_SETTLED_BIT BIT0
+#endif
+
+//PROTOTYPES
+bool gemini_prewarm_init(gemini_prewarm_t *prewarm, gemini_session_t *session, const gemini_prewarm_ops_t *ops);
+void gemini_prewarm_deinit(gemini_prewarm_t *prewarm);
+bool gemini_prewarm_run(gemini_prewarm_t *prewarm);
+void gemini_prewarm_cancel(gemini_prewarm_t *prewarm);
+gemini_prewarm_state_t gemini_prewarm_claim(gemini_prewarm_t *prewarm);
+void gemini_prewarm_release(gemini_prewarm_t *prewarm);
+void gemini_prewarm_done(gemini_prewarm_t *prewarm);
+const char *gemini_prewarm_state_name(gemini_prewarm_state_t state);
+static bool prewarm_lock_init(gemini_prewarm_t *prewarm);
+static void prewarm_lock(gemini_prewarm_t *prewarm);
+static void prewarm_unlock(gemini_prewarm_t *prewarm);
+static void prewarm_set_warming(gemini_prewarm_t *prewarm, bool warming);
+static void prewarm_wait_settled(gemini_prewarm_t *prewarm);
+static bool prewarm_cancelled(gemini_prewarm_t *prewarm);
+static void prewarm_radio_sleep(gemini_prewarm_t *prewarm);
+
+bool gemini_prewarm_init(gemini_prewarm_t *prewarm, gemini_session_t *session, const gemini_prewarm_ops_t *ops) {
+    if (!prewarm || !session) {
+        return false;
+    }
+    memset(prewarm, 0, sizeof(*prewarm));
+    prewarm->session = session;
+    if (ops) {
+        prewarm->ops = *ops;
+    }
+    return prewarm_lock_init(prewarm);
+}
+
+void gemini_prewarm_deinit(gemini_prewarm_t *prewarm) {
+#ifdef ESP_PLATFORM
+    vSemaphoreDelete((SemaphoreHandle_t)prewarm->lock);
+    vEventGroupDelete((EventGroupHandle_t)prewarm->settled);
+#else
+    pthread_cond_destroy(&prewarm->settled);
+    pthread_mutex_destroy(&prewarm->lock);
+#endif
+}
+
+bool gemini_prewarm_run(gemini_prewarm_t *prewarm) {
+    gemini_session_t *session = prewarm->session;
+    prewarm_lock(prewarm);
+    if (prewarm->state == GEMINI_PREWARM_WARMING || prewarm->claimed) {
+        prewarm_unlock(prewarm);
+        return false; // a second press, or the last question is still going
+    }
+    const int64_t begin = session->now_us();
+    memset(&prewarm->timing, 0, sizeof(prewarm->timing));
+    prewarm->cancel = false;
+    prewarm->runs++;
+    prewarm_set_warming(prewarm, true);
+    if (prewarm->ops.radio_wake && !prewarm->radio_awake) {
+        prewarm->ops.radio_wake(prewarm->ops.ctx);
+        prewarm->radio_awake = true;
+    }
+    prewarm_unlock(prewarm);
+    prewarm->timing.wake_us = session->now_us() - begin;
+
+    bool ok = true;
+    if (prewarm->ops.resolve && !prewarm_cancelled(prewarm)) {
+        const int64_t dns_begin = session->now_us();
+        ok = prewarm->ops.resolve(prewarm->ops.ctx, session->host) == 0;
+        prewarm->timing.dns_us = session->now_us() - dns_begin;
+    }
+    if (ok && !prewarm_cancelled(prewarm)) {
+        const int64_t connect_begin = session->now_us();
+        const uint32_t connects = session->connects;
+        ok = gemini_session_connect(session) == GEMINI_SESSION_OK;
+        if (session->connects != connects) {
+            prewarm->timing.connect_us = session->now_us() - connect_begin;
+            prewarm->timing.resumed = session->timing.resumed;
+        }
+    }
+
+    prewarm_lock(prewarm);
+    prewarm->timing.total_us = session->now_us() - begin;
+    if (prewarm->cancel) {
+        gemini_session_close(session);
+        prewarm_radio_sleep(prewarm);
+        prewarm->state = GEMINI_PREWARM_CANCELLED;
+    } else {
+        prewarm->state = ok ? GEMINI_PREWARM_WARM : GEMINI_PREWARM_FAILED;
+    }
+    prewarm_set_warming(prewarm, false);
+    const bool warm = prewarm->state == GEMINI_PREWARM_WARM;
+    prewarm_unlock(prewarm);
+    return warm;
+}
+
+void gemini_prewarm_cancel(gemini_prewarm_t *prewarm) {
+    prewarm_lock(prewarm);
+    if (prewarm->state == GEMINI_PREWARM_WARMING) {
+        prewarm->cancel = true; // the handshake can't be interrupted, run closes it after
+    } else if (!prewarm->claimed) {
+        gemini_session_close(prewarm->session);
+        prewarm_radio_sleep(prewarm);
+        if (prewarm->state != GEMINI_PREWARM_IDLE) {
+            prewarm->state = GEMINI_PREWARM_CANCELLED;
+        }
+    }
+    prewarm_unlock(prewarm);
+}
+
+gemini_prewarm_state_t gemini_prewarm_claim(gemini_prewarm_t *prewarm) {
+    prewarm_wait_settled(prewarm);
+    const gemini_prewarm_state_t state = prewarm->state;
+    prewarm_unlock(prewarm);
+    return state;
+}
+
+void gemini_prewarm_release(gemini_prewarm_t *prewarm) {
+    prewarm_lock(prewarm);
+    prewarm->claimed = false;
+    prewarm->state = GEMINI_PREWARM_IDLE;
+    prewarm_unlock(prewarm);
+}
+
+void gemini_prewarm_done(gemini_prewarm_t *prewarm) {
+    prewarm_lock(prewarm);
+    if (prewarm->state != GEMINI_PREWARM_WARMING && !prewarm->claimed) {
+        prewarm_radio_sleep(prewarm); // a press that came in since keeps it awake
+    }
+    prewarm_unlock(prewarm);
+}
+
+const char *gemini_prewarm_state_name(gemini_prewarm_state_t state) {
+    switch (state) {
+        case GEMINI_PREWARM_IDLE:      return "idle";
+        case GEMINI_PREWARM_WARMING:   return "warming";
+        case GEMINI_PREWARM_WARM:      return "warm";
+        case GEMINI_PREWARM_FAILED:    return "failed";
+        case GEMINI_PREWARM_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+// the esp build waits on an event group bit, the host on a condition
+#ifdef ESP_PLATFORM
+static bool prewarm_lock_init(gemini_prewarm_t *prewarm) {
+    prewarm->lock = xSemaphoreCreateMutex();
+    prewarm->settled = xEventGroupCreate();
+    if (!prewarm->lock || !prewarm->settled) {
+        if (prewarm->lock) {
+            vSemaphoreDelete((SemaphoreHandle_t)prewarm->lock);
+        }
+        if (prewarm->settled) {
+            vEventGroupDelete((EventGroupHandle_t)prewarm->settled);
+        }
+        return false;
+    }
+    xEventGroupSetBits((EventGroupHandle_t)prewarm->settled, PREWARM_SETTLED_BIT);
+    return true;
+}
+
+static void prewarm_lock(gemini_prewarm_t *prewarm) {
+    xSemaphoreTake((SemaphoreHandle_t)prewarm->lock, portMAX_DELAY);
+}
+
+static void prewarm_unlock(gemini_prewarm_t *prewarm) { xSemaphoreGive((SemaphoreHandle_t)prewarm->lock); }
+
+// holding the lock, so the bit and the state change together
+static void prewarm_set_warming(gemini_prewarm_t *prewarm, bool warming) {
+    if (warming) {
+        prewarm->state = GEMINI_PREWARM_WARMING;
+        xEventGroupClearBits((EventGroupHandle_t)prewarm->settled, PREWARM_SETTLED_BIT);
+    } else {
+        xEventGroupSetBits((EventGroupHandle_t)prewarm->settled, PREWARM_SETTLED_BIT);
+    }
+}
+
+// returns holding the lock with the session claimed
+static void prewarm_wait_settled(gemini_prewarm_t *prewarm) {
+    for (;;) {
+        prewarm_lock(prewarm);
+        if (prewarm->state != GEMINI_PREWARM_WARMING) {
+            prewarm->claimed = true;
+            return;
+        }
+        prewarm_unlock(prewarm);
+        xEventGroupWaitBits((EventGroupHandle_t)prewarm->settled, PREWARM_SETTLED_BIT, pdFALSE, pdTRUE,
+                            portMAX_DELAY);
+    }
+}
+#else
+static bool prewarm_lock_init(gemini_prewarm_t *prewarm) {
+    if (pthread_mutex_init(&prewarm->lock, NULL) != 0) {
+        return false;
+    }
+    if (pthread_cond_init(&prewarm->settled, NULL) != 0) {
+        pthread_mutex_destroy(&prewarm->lock);
+        return false;
+    }
+    return true;
+}
+
+static void prewarm_lock(gemini_prewarm_t *prewarm) { pthread_mutex_lock(&prewarm->lock); }
+
+static void prewarm_unlock(gemini_prewarm_t *prewarm) { pthread_mutex_unlock(&prewarm->lock); }
+
+static void prewarm_set_warming(gemini_prewarm_t *prewarm, bool warming) {
+    if (warming) {
+        prewarm->state = GEMINI_PREWARM_WARMING;
+    } else {
+        pthread_cond_broadcast(&prewarm->settled);
+    }
+}
+
+static void prewarm_wait_settled(gemini_prewarm_t *prewarm) {
+    prewarm_lock(prewarm);
+    while (prewarm->state == GEMINI_PREWARM_WARMING) {
+        pthread_cond_wait(&prewarm->settled, &prewarm->lock);
+    }
+    prewarm->claimed = true;
+}
+#endif
+
+static bool prewarm_cancelled(gemini_prewarm_t *prewarm) {
+    prewarm_lock(prewarm);
+    const bool cancel = prewarm->cancel;
+    prewarm_unlock(prewarm);
+    return cancel;
+}
+
+// holding the lock
+static void prewarm_radio_sleep(gemini_prewarm_t *prewarm) {
+    if (prewarm->radio_awake) {
+        if (prewarm->ops.radio_sleep) {
+            prewarm->ops.radio_sleep(prewarm->ops.ctx);
+        }
+        prewarm->radio_awake = false;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+    Description: speculative prewarm of a gemini session from the button
+    press. the network is only needed once the button is let go, but the
+    press comes seconds before that, so the press wakes the radio out of
+    power save, resolves the host and opens the connection, tls handshake
+    and all, while the question is still being recorded. the upload then
+    claims the session and finds it already connected. the work runs on
+    its own task (gemini_prewarm_run) and touches the session only until
+    the claim, an aborted recording cancels it and the connection goes
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef GEMINI_PREWARM_H
+#define GEMINI_PREWARM_H
+
+#include "GeminiSession.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef ESP_PLATFORM
+#include <pthread.h>
+#endif
+
+typedef enum {
+    GEMINI_PREWARM_IDLE = 0,  // nothing asked for, or the upload is done with it
+    GEMINI_PREWARM_WARMING,   // run is waking, resolving or connecting
+    GEMINI_PREWARM_WARM,      // connected and waiting for the claim
+    GEMINI_PREWARM_FAILED,    // the name or the connect failed, the upload connects itself
+    GEMINI_PREWARM_CANCELLED, // the recording was aborted, nothing left open
+} gemini_prewarm_state_t;
+
+// the platform's part, any of them may be NULL
+typedef struct {
+    void (*radio_wake)(void *ctx);  // out of power save until radio_sleep
+    void (*radio_sleep)(void *ctx); // back to how radio_wake found it
+    // 0 when host resolved, the answer is left in the resolver's cache for
+    // the transport's connect
+    int (*resolve)(void *ctx, const char *host);
+    void *ctx;
+} gemini_prewarm_ops_t;
+
+typedef struct { // the last run, microseconds from its start
+    int64_t wake_us;
+    int64_t dns_us;
+    int64_t connect_us; // tcp and tls, 0 when the session was still connected
+    int64_t total_us;
+    bool resumed;
+} gemini_prewarm_timing_t;
+
+typedef struct {
+    gemini_session_t *session;
+    gemini_prewarm_ops_t ops;
+    gemini_prewarm_state_t state;
+    bool cancel;      // asked for while warming, run finishes it off
+    bool claimed;     // the upload has the session, run leaves it alone
+    bool radio_awake;
+    uint32_t runs;
+    gemini_prewarm_timing_t timing;
+#ifdef ESP_PLATFORM
+    void *lock;    // SemaphoreHandle_t, kept opaque like the esp_tls handle
+    void *settled; // EventGroupHandle_t, bit 0 set while not warming
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t settled;
+#endif
+} gemini_prewarm_t;
+
+//Function definitions
+// false when the lock couldn't be made. session must outlive it
+bool gemini_prewarm_init(gemini_prewarm_t *prewarm, gemini_session_t *session, const gemini_prewarm_ops_t *ops);
+void gemini_prewarm_deinit(gemini_prewarm_t *prewarm);
+// the prewarm itself, on its own task, blocks for the handshake. true
+// when the session is left warm. does nothing while one is already
+// running or the session is claimed
+bool gemini_prewarm_run(gemini_prewarm_t *prewarm);
+// the recording was aborted. a run in flight closes what it opened when
+// its connect comes back, a warm session is closed now
+void gemini_prewarm_cancel(gemini_prewarm_t *prewarm);
+// before the upload touches the session, waits for a run in flight (the
+// session's connect timeout bounds it) and returns how it ended
+gemini_prewarm_state_t gemini_prewarm_claim(gemini_prewarm_t *prewarm);
+// after the request, the next press can prewarm again. the radio stays
+// awake, the answer may still be downloading on other connections
+void gemini_prewarm_release(gemini_prewarm_t *prewarm);
+// the question is over, the radio goes back to power save
+void gemini_prewarm_done(gemini_prewarm_t *prewarm);
+const char *gemini_prewarm_state_name(gemini_prewarm_state_t state);
+
+#endif // GEMINI_PREWARM_H
@@ -0,0 +1,529 @@
+/*
+    Description: keep-alive https session for the gemini api. speaks just
+    enough http/1.1 for the gemini endpoints over whatever transport it is
+    given, and keeps that transport open between requests
+    Creator: Matthew Ayestaran
+*/
+#include "GeminiSession.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+// room left in front of each piece of a chunked body for its size line, the
+// size is written with a fixed 4 hex digits so the piece never moves
+#define SESSION_CHUNK_HEAD 6
+
+//PROTOTYPES
+void gemini_session_init(gemini_session_t *session, const gemini_transport_t *transport,
+                         const char *host, int port, const gemini_session_policy_t *policy);
+void gemini_session_set_policy(gemini_session_t *session, const gemini_session_policy_t *policy);
+gemini_session_err_t gemini_session_connect(gemini_session_t *session);
+gemini_session_err_t gemini_session_request(gemini_session_t *session,
+                                            const gemini_request_t *request, int *status);
+void gemini_session_close(gemini_session_t *session);
+const char *gemini_session_err_name(gemini_session_err_t err);
+
+static bool session_should_recycle(const gemini_session_t *session, int64_t now);
+static gemini_session_err_t session_open(gemini_session_t *session);
+static gemini_session_err_t session_send(gemini_session_t *session, const gemini_request_t *request);
+static gemini_session_err_t session_send_pulled(gemini_session_t *session, const gemini_request_t *request,
+                                                size_t len);
+static gemini_session_err_t session_receive(gemini_session_t *session, const gemini_request_t *request,
+                                            int *status, bool *keep_alive);
+static gemini_session_err_t session_read_line(gemini_session_t *session, char **line);
+static gemini_session_err_t session_read_body(gemini_session_t *session, const gemini_request_t *request,
+                                              uint64_t length);
+static gemini_session_err_t session_read_chunked(gemini_session_t *session, const gemini_request_t *request);
+static gemini_session_err_t session_read_to_close(gemini_session_t *session, const gemini_request_t *request);
+static gemini_session_err_t session_fill(gemini_session_t *session);
+static gemini_session_err_t session_deliver(gemini_session_t *session, const gemini_request_t *request,
+                                            size_t len);
+static gemini_session_err_t session_write_all(gemini_session_t *session, const uint8_t *data, size_t len);
+static bool session_has_token(const char *value, const char *token);
+static int64_t session_default_now_us(void);
+
+void gemini_session_init(gemini_session_t *session, const gemini_transport_t *transport,
+                         const char *host, int port, const gemini_session_policy_t *policy) {
+    const gemini_session_policy_t default_policy = GEMINI_SESSION_POLICY_DEFAULT;
+    memset(session, 0, sizeof(*session));
+    session->transport = *transport;
+    snprintf(session->host, sizeof(session->host), "%s", host);
+    session->port = port;
+    session->policy = policy ? *policy : default_policy;
+    session->now_us = session_default_now_us;
+}
+
+// takes effect from the next request, an open connection is kept
+void gemini_session_set_policy(gemini_session_t *session, const gemini_session_policy_t *policy) {
+    if (session && policy) {
+        session->policy = *policy;
+    }
+}
+
+// open the connection ahead of the first request so a press doesn't wait
+// on the handshake. a connection that is still good is left alone
+gemini_session_err_t gemini_session_connect(gemini_session_t *session) {
+    if (!session) {
+        return GEMINI_SESSION_ERR_ARG;
+    }
+    if (session->connected && !session_should_recycle(session, session->now_us())) {
+        return GEMINI_SESSION_OK;
+    }
+    gemini_session_close(session);
+    session->timing.connect_us = 0;
+    return session_open(session);
+}
+
+// a reused connection the server has already dropped shows up as the write
+// failing or the read seeing a close before any reply. that request never
+// reached the server, so it is sent once more on a fresh connection
+gemini_session_err_t gemini_session_request(gemini_session_t *session,
+                                            const gemini_request_t *request, int *status) {
+    if (!session || !request || !request->method || !request->path || !status ||
+        (request->body_len > 0 && !request->body && !request->body_read)) {
+        return GEMINI_SESSION_ERR_ARG;
+    }
+    int64_t start = session->now_us();
+    session->request_start_us = start;
+    memset(&session->timing, 0, sizeof(session->timing));
+    if (session->connected && session_should_recycle(session, start)) {
+        gemini_session_close(session);
+    }
+    session->timing.reused = session->connected;
+
+    gemini_session_err_t err = GEMINI_SESSION_OK;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!session->connected) {
+            err = session_open(session);
+            if (err != GEMINI_SESSION_OK) {
+                return err;
+            }
+        }
+        session->got_response_byte = false;
+        session->rx_pos = 0;
+        session->rx_len = 0;
+        bool keep_alive = true;
+        err = session_send(session, request);
+        if (err == GEMINI_SESSION_OK) {
+            err = session_receive(session, request, status, &keep_alive);
+        }
+        if (err == GEMINI_SESSION_OK) {
+            session->requests_on_connection++;
+            session->last_used_us = session->now_us();
+            session->timing.total_us = session->last_used_us - start;
+            if (!keep_alive) {
+                gemini_session_close(session);
+            }
+            return GEMINI_SESSION_OK;
+        }
+        bool stale = session->timing.reused && !session->got_response_byte && err == GEMINI_SESSION_ERR_IO;
+        gemini_session_close(session); // whatever is left on the wire can't be trusted
+        if (!stale) {
+            return err;
+        }
+        if (request->body_read &&
+            (!request->body_rewind || !request->body_rewind(request->body_ctx))) {
+            return err; // the body can't be made a second time
+        }
+        session->timing.reused = false;
+    }
+    return err;
+}
+
+void gemini_session_close(gemini_session_t *session) {
+    if (!session || !session->connected) {
+        return;
+    }
+    session->transport.close(session->transport.ctx);
+    session->connected = false;
+}
+
+const char *gemini_session_err_name(gemini_session_err_t err) {
+    switch (err) {
+        case GEMINI_SESSION_OK:           return "ok";
+        case GEMINI_SESSION_ERR_ARG:      return "bad argument";
+        case GEMINI_SESSION_ERR_CONNECT:  return "connect failed";
+        case GEMINI_SESSION_ERR_IO:       return "connection dropped";
+        case GEMINI_SESSION_ERR_TIMEOUT:  return "timed out";
+        case GEMINI_SESSION_ERR_PROTOCOL: return "bad http response";
+        case GEMINI_SESSION_ERR_ABORTED:  return "aborted";
+    }
+    return "unknown";
+}
+
+static bool session_should_recycle(const gemini_session_t *session, int64_t now) {
+    if (session->policy.max_requests != 0 &&
+        session->requests_on_connection >= session->policy.max_requests) {
+        return true;
+    }
+    return session->policy.idle_timeout_ms != 0 &&
+           now - session->last_used_us >= (int64_t)session->policy.idle_timeout_ms * 1000;
+}
+
+static gemini_session_err_t session_open(gemini_session_t *session) {
+    int64_t begin = session->now_us();
+    if (session->transport.connect(session->transport.ctx, session->host, session->port,
+                                   session->policy.connect_timeout_ms) != 0) {
+        return GEMINI_SESSION_ERR_CONNECT;
+    }
+    session->connected = true;
+    session->connects++;
+    session->requests_on_connection = 0;
+    session->last_used_us = session->now_us();
+    session->timing.connect_us += session->last_used_us - begin;
+    session->timing.resumed = session->transport.resumed != NULL &&
+                              session->transport.resumed(session->transport.ctx);
+    return GEMINI_SESSION_OK;
+}
+
+// headers go out in one write, with the body too when it fits, so a small
+// request is a single tls record
+static gemini_session_err_t session_send(gemini_session_t *session, const gemini_request_t *request) {
+    char *header = (char *)session->rx;
+    size_t size = GEMINI_SESSION_TX_HEADER_MAX;
+    int len;
+    if (session->port == 443) {
+        len = snprintf(header, size, "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n",
+                       request->method, request->path, session->host);
+    } else {
+        len = snprintf(header, size, "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n",
+                       request->method, request->path, session->host, session->port);
+    }
+    if (len > 0 && (size_t)len < size) {
+        if (request->body_read && request->body_len == GEMINI_BODY_LEN_CHUNKED) {
+            len += snprintf(header + len, size - len, "Transfer-Encoding: chunked\r\n");
+        } else if (request->body_len > 0 || request->body_read || strcmp(request->method, "GET") != 0) {
+            len += snprintf(header + len, size - len, "Content-Length: %u\r\n", (unsigned)request->body_len);
+        }
+    }
+    for (size_t i = 0; i < request->header_count && len > 0 && (size_t)len < size; i++) {
+        len += snprintf(header + len, size - len, "%s: %s\r\n",
+                        request->headers[i].name, request->headers[i].value);
+    }
+    if (len > 0 && (size_t)len < size) {
+        len += snprintf(header + len, size - len, "\r\n");
+    }
+    if (len <= 0 || (size_t)len >= size) {
+        return GEMINI_SESSION_ERR_ARG; // headers don't fit GEMINI_SESSION_TX_HEADER_MAX
+    }
+
+    if (request->body_read) {
+        return session_send_pulled(session, request, len);
+    }
+    if (request->body_len <= sizeof(session->rx) - len) {
+        if (request->body_len > 0) {
+            memcpy(header + len, request->body, request->body_len);
+        }
+        return session_write_all(session, session->rx, len + request->body_len);
+    }
+    gemini_session_err_t err = session_write_all(session, session->rx, len);
+    if (err != GEMINI_SESSION_OK) {
+        return err;
+    }
+    return session_write_all(session, (const uint8_t *)request->body, request->body_len);
+}
+
+// body_read fills the buffer behind the headers, then the buffer goes out
+// and is filled again, so the body only ever takes the receive buffer
+static gemini_session_err_t session_send_pulled(gemini_session_t *session, const gemini_request_t *request,
+                                                size_t len) {
+    bool chunked = request->body_len == GEMINI_BODY_LEN_CHUNKED;
+    uint64_t total = 0;
+    bool finished = false;
+    while (!finished) {
+        size_t start = len + (chunked ? SESSION_CHUNK_HEAD : 0);
+        size_t end = sizeof(session->rx) - (chunked ? 2 : 0); // chunks end in \r\n
+        size_t fill = start;
+        while (fill < end) { // a full buffer per write keeps tls records big
+            int got = request->body_read(request->body_ctx, session->rx + fill, end - fill);
+            if (got < 0) {
+                return GEMINI_SESSION_ERR_ABORTED;
+            }
+            if (got == 0) {
+                finished = true;
+                break;
+            }
+            if ((size_t)got > end - fill) {
+                return GEMINI_SESSION_ERR_ARG;
+            }
+            fill += got;
+        }
+        total += fill - start;
+        if (!chunked && total > request->body_len) {
+            return GEMINI_SESSION_ERR_ARG; // more body than Content-Length said
+        }
+        if (chunked) {
+            if (fill > start) {
+                char head[SESSION_CHUNK_HEAD + 1];
+                snprintf(head, sizeof(head), "%04x\r\n", (unsigned)(fill - start));
+                memcpy(session->rx + len, head, SESSION_CHUNK_HEAD);
+                memcpy(session->rx + fill, "\r\n", 2);
+                fill += 2;
+            } else {
+                fill = len; // an empty chunk would end the body early
+            }
+            if (finished && fill + 5 > sizeof(session->rx)) {
+                gemini_session_err_t err = session_write_all(session, session->rx, fill);
+                if (err != GEMINI_SESSION_OK) {
+                    return err;
+                }
+                fill = 0;
+            }
+            if (finished) {
+                memcpy(session->rx + fill, "0\r\n\r\n", 5);
+                fill += 5;
+            }
+        }
+        gemini_session_err_t err = session_write_all(session, session->rx, fill);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        len = 0;
+    }
+    if (!chunked && total != request->body_len) {
+        return GEMINI_SESSION_ERR_ARG; // less body than Content-Length said
+    }
+    return GEMINI_SESSION_OK;
+}
+
+static gemini_session_err_t session_receive(gemini_session_t *session, const gemini_request_t *request,
+                                            int *status, bool *keep_alive) {
+    char *line;
+    long long content_length;
+    bool chunked;
+    gemini_session_err_t err;
+    do { // 1xx replies are interim, the real one follows
+        err = session_read_line(session, &line);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        int major, minor;
+        if (sscanf(line, "HTTP/%d.%d %d", &major, &minor, status) != 3) {
+            return GEMINI_SESSION_ERR_PROTOCOL;
+        }
+        *keep_alive = major == 1 && minor >= 1;
+        content_length = -1;
+        chunked = false;
+        for (;;) {
+            err = session_read_line(session, &line);
+            if (err != GEMINI_SESSION_OK) {
+                return err;
+            }
+            if (line[0] == '\0') {
+                break; // end of headers
+            }
+            char *value = strchr(line, ':');
+            if (!value) {
+                continue;
+            }
+            *value++ = '\0';
+            value += strspn(value, " \t");
+            if (strcasecmp(line, "Content-Length") == 0) {
+                content_length = strtoll(value, NULL, 10);
+            } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+                chunked = session_has_token(value, "chunked");
+            } else if (strcasecmp(line, "Connection") == 0) {
+                if (session_has_token(value, "close")) {
+                    *keep_alive = false;
+                } else if (session_has_token(value, "keep-alive")) {
+                    *keep_alive = true;
+                }
+            }
+        }
+    } while (*status >= 100 && *status < 200);
+
+    if (strcmp(request->method, "HEAD") == 0 || *status == 204 || *status == 304) {
+        return GEMINI_SESSION_OK;
+    }
+    if (chunked) {
+        return session_read_chunked(session, request);
+    }
+    if (content_length >= 0) {
+        return session_read_body(session, request, (uint64_t)content_length);
+    }
+    *keep_alive = false; // body runs until the server closes
+    return session_read_to_close(session, request);
+}
+
+// next line of the reply with the line ending cut off. it points into the
+// receive buffer so it is only good until the next read
+static gemini_session_err_t session_read_line(gemini_session_t *session, char **line) {
+    for (;;) {
+        uint8_t *start = session->rx + session->rx_pos;
+        uint8_t *end = memchr(start, '\n', session->rx_len - session->rx_pos);
+        if (end) {
+            size_t len = end - start;
+            if (len > 0 && start[len - 1] == '\r') {
+                len--;
+            }
+            start[len] = '\0';
+            session->rx_pos = (end - session->rx) + 1;
+            *line = (char *)start;
+            return GEMINI_SESSION_OK;
+        }
+        if (session->rx_pos > 0) {
+            memmove(session->rx, start, session->rx_len - session->rx_pos);
+            session->rx_len -= session->rx_pos;
+            session->rx_pos = 0;
+        }
+        if (session->rx_len == sizeof(session->rx)) {
+            return GEMINI_SESSION_ERR_PROTOCOL; // line longer than the buffer
+        }
+        gemini_session_err_t err = session_fill(session);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+    }
+}
+
+static gemini_session_err_t session_read_body(gemini_session_t *session, const gemini_request_t *request,
+                                              uint64_t length) {
+    while (length > 0) {
+        if (session->rx_pos == session->rx_len) {
+            session->rx_pos = 0;
+            session->rx_len = 0;
+            gemini_session_err_t err = session_fill(session);
+            if (err != GEMINI_SESSION_OK) {
+                return err;
+            }
+        }
+        size_t available = session->rx_len - session->rx_pos;
+        size_t len = length < available ? (size_t)length : available;
+        gemini_session_err_t err = session_deliver(session, request, len);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        length -= len;
+    }
+    return GEMINI_SESSION_OK;
+}
+
+static gemini_session_err_t session_read_chunked(gemini_session_t *session, const gemini_request_t *request) {
+    char *line;
+    gemini_session_err_t err;
+    for (;;) {
+        err = session_read_line(session, &line);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        char *end;
+        unsigned long long size = strtoull(line, &end, 16); // chunk extensions are ignored
+        if (end == line) {
+            return GEMINI_SESSION_ERR_PROTOCOL;
+        }
+        if (size == 0) {
+            break;
+        }
+        err = session_read_body(session, request, size);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        err = session_read_line(session, &line);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        if (line[0] != '\0') {
+            return GEMINI_SESSION_ERR_PROTOCOL; // chunk longer than it said
+        }
+    }
+    do { // trailers, not used for anything
+        err = session_read_line(session, &line);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+    } while (line[0] != '\0');
+    return GEMINI_SESSION_OK;
+}
+
+static gemini_session_err_t session_read_to_close(gemini_session_t *session, const gemini_request_t *request) {
+    for (;;) {
+        gemini_session_err_t err = session_deliver(session, request, session->rx_len - session->rx_pos);
+        if (err != GEMINI_SESSION_OK) {
+            return err;
+        }
+        session->rx_pos = 0;
+        session->rx_len = 0;
+        int got = session->transport.read(session->transport.ctx, session->rx, sizeof(session->rx),
+                                          session->policy.io_timeout_ms);
+        if (got == 0) {
+            return GEMINI_SESSION_OK;
+        }
+        if (got == GEMINI_TRANSPORT_TIMEOUT) {
+            return GEMINI_SESSION_ERR_TIMEOUT;
+        }
+        if (got < 0) {
+            return GEMINI_SESSION_ERR_IO;
+        }
+        session->rx_len = got;
+    }
+}
+
+// read whatever is waiting into the free end of the receive buffer
+static gemini_session_err_t session_fill(gemini_session_t *session) {
+    int got = session->transport.read(session->transport.ctx, session->rx + session->rx_len,
+                                      sizeof(session->rx) - session->rx_len, session->policy.io_timeout_ms);
+    if (got == GEMINI_TRANSPORT_TIMEOUT) {
+        return GEMINI_SESSION_ERR_TIMEOUT;
+    }
+    if (got <= 0) {
+        return GEMINI_SESSION_ERR_IO;
+    }
+    if (!session->got_response_byte) {
+        session->got_response_byte = true;
+        session->timing.ttfb_us = session->now_us() - session->request_start_us;
+    }
+    session->rx_len += got;
+    return GEMINI_SESSION_OK;
+}
+
+static gemini_session_err_t session_deliver(gemini_session_t *session, const gemini_request_t *request,
+                                            size_t len) {
+    if (len > 0 && request->on_body &&
+        !request->on_body(request->ctx, (const char *)session->rx + session->rx_pos, len)) {
+        return GEMINI_SESSION_ERR_ABORTED;
+    }
+    session->rx_pos += len;
+    return GEMINI_SESSION_OK;
+}
+
+static gemini_session_err_t session_write_all(gemini_session_t *session, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        int sent = session->transport.write(session->transport.ctx, data, len);
+        if (sent <= 0) {
+            return GEMINI_SESSION_ERR_IO;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return GEMINI_SESSION_OK;
+}
+
+// is token one of the comma separated values in a header
+static bool session_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    while (*value) {
+        value += strspn(value, " \t,");
+        size_t len = strcspn(value, " \t,");
+        if (len == token_len && strncasecmp(value, token, len) == 0) {
+            return true;
+        }
+        value += len;
+    }
+    return false;
+}
+
+static int64_t session_default_now_us(void) {
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
@@ -0,0 +1,152 @@
+/*
+    Description: keep-alive https session for the gemini api. one connection
+    is held open between button presses so only the first request pays for
+    dns, the tcp handshake and the tls handshake
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef GEMINI_SESSION_H
+#define GEMINI_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GEMINI_SESSION_HOST_MAX 64
+#define GEMINI_SESSION_RX_BUFFER_SIZE 1024 // also the longest header line
+#define GEMINI_SESSION_TX_HEADER_MAX 768   // request line plus headers
+
+// body_len for a body_read request whose length isn't known up front, it
+// goes out with chunked transfer encoding
+#define GEMINI_BODY_LEN_CHUNKED SIZE_MAX
+
+// read result when nothing arrived inside the timeout
+#define GEMINI_TRANSPORT_TIMEOUT (-2)
+
+typedef enum {
+    GEMINI_SESSION_OK = 0,
+    GEMINI_SESSION_ERR_ARG,
+    GEMINI_SESSION_ERR_CONNECT,  // dns, tcp or tls handshake failed
+    GEMINI_SESSION_ERR_IO,       // connection dropped part way through
+    GEMINI_SESSION_ERR_TIMEOUT,
+    GEMINI_SESSION_ERR_PROTOCOL, // reply wasn't http/1.1 we understand
+    GEMINI_SESSION_ERR_ABORTED,  // body callback or body_read asked to stop
+} gemini_session_err_t;
+
+// byte stream the session speaks http over. the esp32 build gets one on top
+// of esp_tls below, host tests plug in openssl or an in-memory fake
+typedef struct {
+    int (*connect)(void *ctx, const char *host, int port, int timeout_ms); // 0 on success
+    int (*write)(void *ctx, const uint8_t *data, size_t len); // bytes written, <0 on error
+    // bytes read, 0 once the peer has closed, GEMINI_TRANSPORT_TIMEOUT or <0 on error
+    int (*read)(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+    void (*close)(void *ctx);
+    void *ctx;
+    // optional, true when the last connect resumed an earlier tls session
+    // instead of doing the full handshake
+    bool (*resumed)(void *ctx);
+} gemini_transport_t;
+
+// when an open connection is thrown away instead of reused. servers drop
+// idle connections on their own schedule, closing ours first saves a write
+// into a dead socket and the retry that follows it
+typedef struct {
+    uint32_t idle_timeout_ms; // reconnect if idle this long, 0 reuses forever
+    uint32_t max_requests;    // requests per connection, 0 for no limit
+    int connect_timeout_ms;
+    int io_timeout_ms;        // longest wait for any single read
+} gemini_session_policy_t;
+
+#define GEMINI_SESSION_POLICY_DEFAULT                                          \
+    { .idle_timeout_ms = 60000, .max_requests = 0,                             \
+      .connect_timeout_ms = 10000, .io_timeout_ms = 30000 }
+
+typedef struct { // how the last request went, microseconds
+    int64_t connect_us; // dns, tcp and tls, 0 when the connection was reused
+    int64_t ttfb_us;    // request start to the first response byte
+    int64_t total_us;   // request start to the end of the body
+    bool reused;
+    bool resumed; // new connection, abbreviated tls handshake
+} gemini_session_timing_t;
+
+typedef struct {
+    const char *name;
+    const char *value;
+} gemini_header_t;
+
+// response body as it arrives, return false to abort the request
+typedef bool (*gemini_body_cb_t)(void *ctx, const char *data, size_t len);
+
+// request body pulled a piece at a time, so it never has to be in memory
+// whole. fill buf with up to size bytes and return how many, 0 once the
+// body is finished or <0 to abort the request
+typedef int (*gemini_body_read_t)(void *ctx, uint8_t *buf, size_t size);
+
+typedef struct {
+    const char *method;
+    const char *path;
+    const gemini_header_t *headers;
+    size_t header_count;
+    const char *body;
+    size_t body_len;
+    gemini_body_cb_t on_body;
+    void *ctx;
+    // optional, replaces body. body_len is then its exact length or
+    // GEMINI_BODY_LEN_CHUNKED, and it is staged through the receive buffer
+    gemini_body_read_t body_read;
+    void *body_ctx;
+    // optional, starts body_read from the beginning again. without it a
+    // request that went out on a dead kept-alive connection isn't retried
+    bool (*body_rewind)(void *body_ctx);
+} gemini_request_t;
+
+typedef struct {
+    gemini_transport_t transport;
+    char host[GEMINI_SESSION_HOST_MAX];
+    int port;
+    gemini_session_policy_t policy;
+    int64_t (*now_us)(void); // clock, tests swap in their own
+    bool connected;
+    int64_t last_used_us;
+    uint32_t requests_on_connection;
+    uint32_t connects; // connections opened over the session's life
+    gemini_session_timing_t timing;
+    int64_t request_start_us;
+    bool got_response_byte;
+    size_t rx_pos;
+    size_t rx_len;
+    // nothing is read until the request is out, so it is staged in here too
+    uint8_t rx[GEMINI_SESSION_RX_BUFFER_SIZE];
+} gemini_session_t;
+
+//Function definitions
+void gemini_session_init(gemini_session_t *session, const gemini_transport_t *transport,
+                         const char *host, int port, const gemini_session_policy_t *policy);
+void gemini_session_set_policy(gemini_session_t *session, const gemini_session_policy_t *policy);
+gemini_session_err_t gemini_session_connect(gemini_session_t *session);
+gemini_session_err_t gemini_session_request(gemini_session_t *session,
+                                            const gemini_request_t *request, int *status);
+void gemini_session_close(gemini_session_t *session);
+const char *gemini_session_err_name(gemini_session_err_t err);
+
+#ifdef ESP_PLATFORM
+typedef struct {
+    void *tls;    // esp_tls_t, kept opaque so this header doesn't pull in esp_tls
+    void *ticket; // esp_tls_client_session_t offered on the next connect
+    bool resumed;
+    bool ticket_loaded; // nvs has been checked for a ticket from before a reboot
+    uint32_t ticket_slot; // hash of the host connected to, names its nvs keys
+} gemini_esp_tls_t;
+
+// transport over esp_tls, verified against the certificate bundle. with
+// CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS reconnects resume the last session
+// and the session is kept in nvs so it outlives deep sleep and reboots.
+// nvs keeps one session per host, so connections to different hosts
+// don't overwrite each other's
+void gemini_transport_esp_tls(gemini_transport_t *transport, gemini_esp_tls_t *ctx);
+// drops this connection's session, or every saved one before it has
+// connected anywhere
+void gemini_esp_tls_forget_ticket(gemini_esp_tls_t *ctx);
+#endif
+
+#endif // GEMINI_SESSION_H
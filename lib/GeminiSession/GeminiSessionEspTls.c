@@ -0,0 +1,296 @@
+/*
+    Description: esp_tls transport for the gemini session. certificates are
+    checked against the esp-idf certificate bundle. the tls session from the
+    last full handshake is offered again on reconnect and saved in nvs, a
+    resumed handshake skips the certificate chain and the key exchange.
+    each host has its own pair of nvs keys, so the gemini and the text to
+    speech connections both resume after a reboot
+    Creator: Matthew Ayestaran
+*/
+#ifdef ESP_PLATFORM
+
+#include "GeminiSession.h"
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "lwip/sockets.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#include "mbedtls/ssl.h"
+#include "nvs.h"
+#include <inttypes.h>
+#include <stdio.h>
+#endif
+
+static const char *TAG = "GeminiSessionTls";
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#define TICKET_NVS_NAMESPACE "gemini_tls"
+// nvs keys are 15 characters at most, a host's pair is named after its
+// hash and the host is kept next to the ticket to catch a collision
+#define TICKET_NVS_KEY_FORMAT "t%08" PRIx32
+#define TICKET_NVS_HOST_KEY_FORMAT "h%08" PRIx32
+#define TICKET_NVS_KEY_MAX 16
+#define TICKET_NVS_OLD_KEY "ticket" // the single slot before there was one per host
+#define TICKET_NVS_OLD_HOST_KEY "host"
+
+// esp_tls doesn't export its session struct, the mbedtls session is its
+// only member and esp_tls_free_client_session frees it with free()
+typedef struct {
+    mbedtls_ssl_session saved_session;
+} stored_ticket_t;
+#endif
+
+//PROTOTYPES
+void gemini_transport_esp_tls(gemini_transport_t *transport, gemini_esp_tls_t *ctx);
+static int esp_tls_transport_connect(void *ctx, const char *host, int port, int timeout_ms);
+static int esp_tls_transport_write(void *ctx, const uint8_t *data, size_t len);
+static int esp_tls_transport_read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void esp_tls_transport_close(void *ctx);
+static bool esp_tls_transport_resumed(void *ctx);
+void gemini_esp_tls_forget_ticket(gemini_esp_tls_t *ctx);
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+static void ticket_update(gemini_esp_tls_t *tls_ctx, esp_tls_t *tls, const char *host);
+static bool ticket_same_session(const stored_ticket_t *offered, const stored_ticket_t *got);
+static void ticket_load(gemini_esp_tls_t *tls_ctx, const char *host);
+static void ticket_save(const stored_ticket_t *ticket, const char *host, uint32_t slot);
+static uint32_t ticket_slot(const char *host);
+static void ticket_keys(uint32_t slot, char *ticket_key, char *host_key);
+#endif
+
+void gemini_transport_esp_tls(gemini_transport_t *transport, gemini_esp_tls_t *ctx) {
+    ctx->tls = NULL;
+    ctx->ticket = NULL;
+    ctx->resumed = false;
+    ctx->ticket_loaded = false;
+    ctx->ticket_slot = 0;
+    transport->connect = esp_tls_transport_connect;
+    transport->write = esp_tls_transport_write;
+    transport->read = esp_tls_transport_read;
+    transport->close = esp_tls_transport_close;
+    transport->ctx = ctx;
+    transport->resumed = esp_tls_transport_resumed;
+}
+
+// next connect does the full handshake, for when the saved session is
+// suspected of being the problem
+void gemini_esp_tls_forget_ticket(gemini_esp_tls_t *ctx) {
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (ctx->ticket) {
+        esp_tls_free_client_session((esp_tls_client_session_t *)ctx->ticket);
+        ctx->ticket = NULL;
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(TICKET_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (ctx->ticket_loaded) {
+            char ticket_key[TICKET_NVS_KEY_MAX];
+            char host_key[TICKET_NVS_KEY_MAX];
+            ticket_keys(ctx->ticket_slot, ticket_key, host_key);
+            nvs_erase_key(nvs, ticket_key);
+            nvs_erase_key(nvs, host_key);
+        } else {
+            nvs_erase_all(nvs);
+        }
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+#endif
+}
+
+static int esp_tls_transport_connect(void *ctx, const char *host, int port, int timeout_ms) {
+    gemini_esp_tls_t *tls_ctx = (gemini_esp_tls_t *)ctx;
+    tls_ctx->resumed = false;
+    esp_tls_t *tls = esp_tls_init();
+    if (!tls) {
+        return -1;
+    }
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms = timeout_ms,
+    };
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (!tls_ctx->ticket_loaded) {
+        ticket_load(tls_ctx, host);
+    }
+    cfg.client_session = (esp_tls_client_session_t *)tls_ctx->ticket;
+#endif
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tls) != 1) {
+        ESP_LOGE(TAG, "Connection to %s:%d failed", host, port);
+        esp_tls_conn_destroy(tls);
+        return -1;
+    }
+    tls_ctx->tls = tls;
+    // requests and streamed replies are small writes, don't let nagle hold
+    // one back waiting for the ack of the handshake or the last record
+    int fd;
+    if (esp_tls_get_conn_sockfd(tls, &fd) == ESP_OK) {
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    }
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    ticket_update(tls_ctx, tls, host);
+#endif
+    return 0;
+}
+
+static int esp_tls_transport_write(void *ctx, const uint8_t *data, size_t len) {
+    esp_tls_t *tls = (esp_tls_t *)((gemini_esp_tls_t *)ctx)->tls;
+    ssize_t sent;
+    do {
+        sent = esp_tls_conn_write(tls, data, len);
+    } while (sent == ESP_TLS_ERR_SSL_WANT_WRITE || sent == ESP_TLS_ERR_SSL_WANT_READ);
+    return sent < 0 ? -1 : (int)sent;
+}
+
+// wait on the socket only when mbedtls has nothing buffered, and keep waiting
+// while a record is still arriving in pieces
+static int esp_tls_transport_read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    esp_tls_t *tls = (esp_tls_t *)((gemini_esp_tls_t *)ctx)->tls;
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    for (;;) {
+        if (esp_tls_get_bytes_avail(tls) <= 0) {
+            int64_t remaining = deadline - esp_timer_get_time();
+            if (remaining <= 0) {
+                return GEMINI_TRANSPORT_TIMEOUT;
+            }
+            int fd;
+            if (esp_tls_get_conn_sockfd(tls, &fd) != ESP_OK) {
+                return -1;
+            }
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(fd, &readable);
+            struct timeval wait = { .tv_sec = remaining / 1000000, .tv_usec = remaining % 1000000 };
+            int ready = select(fd + 1, &readable, NULL, NULL, &wait);
+            if (ready == 0) {
+                return GEMINI_TRANSPORT_TIMEOUT;
+            }
+            if (ready < 0) {
+                return -1;
+            }
+        }
+        ssize_t got = esp_tls_conn_read(tls, buf, len);
+        if (got == ESP_TLS_ERR_SSL_WANT_READ || got == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        return got < 0 ? -1 : (int)got; // 0 once the server has closed
+    }
+}
+
+static void esp_tls_transport_close(void *ctx) {
+    gemini_esp_tls_t *tls_ctx = (gemini_esp_tls_t *)ctx;
+    if (tls_ctx->tls) {
+        esp_tls_conn_destroy((esp_tls_t *)tls_ctx->tls);
+        tls_ctx->tls = NULL;
+    }
+}
+
+static bool esp_tls_transport_resumed(void *ctx) { return ((gemini_esp_tls_t *)ctx)->resumed; }
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+// keep the session this handshake ended with. only a full handshake is
+// written to nvs, resumptions would wear the flash for no gain
+static void ticket_update(gemini_esp_tls_t *tls_ctx, esp_tls_t *tls, const char *host) {
+    stored_ticket_t *got = (stored_ticket_t *)esp_tls_get_client_session(tls);
+    if (!got) {
+        return;
+    }
+    stored_ticket_t *offered = (stored_ticket_t *)tls_ctx->ticket;
+    tls_ctx->resumed = offered && ticket_same_session(offered, got);
+    if (!tls_ctx->resumed) {
+        ticket_save(got, host, tls_ctx->ticket_slot);
+    }
+    if (offered) {
+        esp_tls_free_client_session((esp_tls_client_session_t *)offered);
+    }
+    tls_ctx->ticket = got;
+}
+
+// a server that accepts the ticket echoes the session id the client sent
+// with it, a full handshake gets a fresh one
+static bool ticket_same_session(const stored_ticket_t *offered, const stored_ticket_t *got) {
+    size_t id_len = offered->saved_session.MBEDTLS_PRIVATE(id_len);
+    return id_len != 0 && id_len == got->saved_session.MBEDTLS_PRIVATE(id_len) &&
+           memcmp(offered->saved_session.MBEDTLS_PRIVATE(id), got->saved_session.MBEDTLS_PRIVATE(id),
+                  id_len) == 0;
+}
+
+// session from before the last reboot, only offered to the host it came from
+static void ticket_load(gemini_esp_tls_t *tls_ctx, const char *host) {
+    tls_ctx->ticket_loaded = true;
+    tls_ctx->ticket_slot = ticket_slot(host);
+    nvs_handle_t nvs;
+    if (nvs_open(TICKET_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    char ticket_key[TICKET_NVS_KEY_MAX];
+    char host_key[TICKET_NVS_KEY_MAX];
+    ticket_keys(tls_ctx->ticket_slot, ticket_key, host_key);
+    char saved_host[GEMINI_SESSION_HOST_MAX];
+    size_t host_len = sizeof(saved_host);
+    size_t blob_len = 0;
+    if (nvs_get_str(nvs, host_key, saved_host, &host_len) != ESP_OK ||
+        strcmp(saved_host, host) != 0 || nvs_get_blob(nvs, ticket_key, NULL, &blob_len) != ESP_OK) {
+        nvs_close(nvs);
+        return;
+    }
+    unsigned char *blob = malloc(blob_len);
+    stored_ticket_t *ticket = calloc(1, sizeof(stored_ticket_t));
+    if (blob && ticket && nvs_get_blob(nvs, ticket_key, blob, &blob_len) == ESP_OK) {
+        mbedtls_ssl_session_init(&ticket->saved_session);
+        if (mbedtls_ssl_session_load(&ticket->saved_session, blob, blob_len) == 0) {
+            tls_ctx->ticket = ticket;
+            ticket = NULL;
+            ESP_LOGI(TAG, "Loaded tls session for %s from nvs", host);
+        } else {
+            mbedtls_ssl_session_free(&ticket->saved_session);
+        }
+    }
+    free(ticket);
+    free(blob);
+    nvs_close(nvs);
+}
+
+static void ticket_save(const stored_ticket_t *ticket, const char *host, uint32_t slot) {
+    size_t blob_len = 0;
+    mbedtls_ssl_session_save(&ticket->saved_session, NULL, 0, &blob_len); // asks for the size
+    unsigned char *blob = blob_len ? malloc(blob_len) : NULL;
+    if (!blob) {
+        return;
+    }
+    char ticket_key[TICKET_NVS_KEY_MAX];
+    char host_key[TICKET_NVS_KEY_MAX];
+    ticket_keys(slot, ticket_key, host_key);
+    nvs_handle_t nvs;
+    if (mbedtls_ssl_session_save(&ticket->saved_session, blob, blob_len, &blob_len) == 0 &&
+        nvs_open(TICKET_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        // a ticket left in the old single slot is never read again
+        nvs_erase_key(nvs, TICKET_NVS_OLD_KEY);
+        nvs_erase_key(nvs, TICKET_NVS_OLD_HOST_KEY);
+        if (nvs_set_str(nvs, host_key, host) != ESP_OK ||
+            nvs_set_blob(nvs, ticket_key, blob, blob_len) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+            ESP_LOGW(TAG, "Couldn't save the tls session to nvs");
+        }
+        nvs_close(nvs);
+    }
+    free(blob);
+}
+
+// fnv-1a, spreads host names well enough for the few a device talks to
+static uint32_t ticket_slot(const char *host) {
+    uint32_t hash = 2166136261u;
+    for (const char *c = host; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static void ticket_keys(uint32_t slot, char *ticket_key, char *host_key) {
+    snprintf(ticket_key, TICKET_NVS_KEY_MAX, TICKET_NVS_KEY_FORMAT, slot);
+    snprintf(host_key, TICKET_NVS_KEY_MAX, TICKET_NVS_HOST_KEY_FORMAT, slot);
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+/*
+    Description: server-sent events parser, see GeminiSse.h. follows the
+    whatwg event stream rules: lines end in \r\n, \n or \r, data lines are
+    joined with \n, a blank line dispatches and lines starting ':' are comments
+    Creator: Matthew Ayestaran
+*/
+
+#include "GeminiSse.h"
+#include <string.h>
+
+//PROTOTYPES
+void gemini_sse_init(gemini_sse_parser_t *parser, char *buffer, size_t buffer_size,
+                     gemini_sse_event_cb_t on_event, void *ctx);
+void gemini_sse_init_streamed(gemini_sse_parser_t *parser, gemini_sse_data_cb_t on_data,
+                              gemini_sse_event_cb_t on_event, void *ctx);
+bool gemini_sse_feed(gemini_sse_parser_t *parser, const char *bytes, size_t len);
+static void sse_begin_value(gemini_sse_parser_t *parser);
+static bool sse_end_line(gemini_sse_parser_t *parser);
+static bool sse_dispatch(gemini_sse_parser_t *parser);
+static void sse_append_data(gemini_sse_parser_t *parser, const char *bytes, size_t len);
+
+void gemini_sse_init(gemini_sse_parser_t *parser, char *buffer, size_t buffer_size,
+                     gemini_sse_event_cb_t on_event, void *ctx) {
+    memset(parser, 0, sizeof(*parser));
+    parser->on_event = on_event;
+    parser->ctx = ctx;
+    parser->data = buffer;
+    parser->data_cap = buffer_size;
+    parser->state = GEMINI_SSE_FIELD;
+}
+
+void gemini_sse_init_streamed(gemini_sse_parser_t *parser, gemini_sse_data_cb_t on_data,
+                              gemini_sse_event_cb_t on_event, void *ctx) {
+    gemini_sse_init(parser, NULL, 0, on_event, ctx);
+    parser->on_data = on_data;
+}
+
+bool gemini_sse_feed(gemini_sse_parser_t *parser, const char *bytes, size_t len) {
+    size_t i = 0;
+    while (i < len && !parser->stopped) {
+        char c = bytes[i];
+        if (parser->after_cr) {
+            parser->after_cr = false;
+            if (c == '\n') {
+                i++;
+                continue;
+            }
+        }
+        if (c == '\r' || c == '\n') {
+            parser->after_cr = c == '\r';
+            i++;
+            if (!sse_end_line(parser)) {
+                parser->stopped = true;
+            }
+            continue;
+        }
+        switch (parser->state) {
+            case GEMINI_SSE_FIELD:
+                if (c == ':') {
+                    if (parser->field_len == 0) {
+                        parser->state = GEMINI_SSE_SKIP; // comment, servers send these as keep-alives
+                    } else {
+                        sse_begin_value(parser);
+                        parser->state = GEMINI_SSE_VALUE_START;
+                    }
+                } else if (parser->field_len < GEMINI_SSE_FIELD_MAX - 1) {
+                    parser->field[parser->field_len++] = c;
+                } else {
+                    parser->state = GEMINI_SSE_SKIP;
+                }
+                i++;
+                break;
+            case GEMINI_SSE_VALUE_START:
+                parser->state = GEMINI_SSE_VALUE;
+                if (c == ' ') {
+                    i++;
+                }
+                break;
+            case GEMINI_SSE_VALUE: {
+                // copy up to the end of the line in one go, data lines are
+                // whole json documents
+                size_t end = i;
+                while (end < len && bytes[end] != '\r' && bytes[end] != '\n') {
+                    end++;
+                }
+                if (parser->value_is_data) {
+                    sse_append_data(parser, bytes + i, end - i);
+                } else if (parser->value_is_event) {
+                    size_t room = GEMINI_SSE_EVENT_MAX - 1 - parser->event_len;
+                    size_t copy = end - i < room ? end - i : room;
+                    memcpy(parser->event + parser->event_len, bytes + i, copy);
+                    parser->event_len += copy;
+                }
+                i = end;
+                break;
+            }
+            case GEMINI_SSE_SKIP:
+                i++;
+                break;
+        }
+    }
+    return !parser->stopped;
+}
+
+static void sse_begin_value(gemini_sse_parser_t *parser) {
+    parser->field[parser->field_len] = '\0';
+    parser->value_is_data = strcmp(parser->field, "data") == 0;
+    parser->value_is_event = strcmp(parser->field, "event") == 0;
+    if (parser->value_is_data) {
+        if (parser->data_seen) {
+            sse_append_data(parser, "\n", 1);
+        }
+        parser->data_seen = true;
+    } else if (parser->value_is_event) {
+        parser->event_len = 0;
+    }
+}
+
+// false when the event callback asked to stop
+static bool sse_end_line(gemini_sse_parser_t *parser) {
+    bool keep_going = true;
+    if (parser->state == GEMINI_SSE_FIELD) {
+        if (parser->field_len == 0) {
+            keep_going = sse_dispatch(parser); // blank line
+        } else {
+            sse_begin_value(parser); // field with no colon, value is empty
+        }
+    }
+    parser->state = GEMINI_SSE_FIELD;
+    parser->field_len = 0;
+    return keep_going;
+}
+
+static bool sse_dispatch(gemini_sse_parser_t *parser) {
+    bool keep_going = true;
+    if (parser->data_seen) {
+        if (parser->overflow) {
+            parser->dropped++;
+        } else {
+            if (parser->on_data == NULL) {
+                parser->data[parser->data_len] = '\0';
+            }
+            parser->event[parser->event_len] = '\0';
+            parser->events++;
+            keep_going = parser->on_event(parser->ctx, parser->event_len ? parser->event : "message",
+                                          parser->on_data ? NULL : parser->data, parser->data_len);
+        }
+    }
+    parser->data_len = 0;
+    parser->data_seen = false;
+    parser->overflow = false;
+    parser->event_len = 0;
+    return keep_going;
+}
+
+// a data callback that says stop stops the feed straight after
+static void sse_append_data(gemini_sse_parser_t *parser, const char *bytes, size_t len) {
+    if (parser->on_data != NULL) {
+        if (len > 0 && !parser->stopped) {
+            parser->data_len += len;
+            parser->stopped = !parser->on_data(parser->ctx, bytes, len);
+        }
+        return;
+    }
+    if (parser->overflow || parser->data_len + len + 1 > parser->data_cap) {
+        parser->overflow = true; // room for the nul is always kept
+        return;
+    }
+    memcpy(parser->data + parser->data_len, bytes, len);
+    parser->data_len += len;
+}
@@ -0,0 +1,65 @@
+/*
+    Description: server-sent events parser for streamGenerateContent?alt=sse.
+    bytes go in as the body arrives, split anywhere, and each complete event
+    comes out through a callback without the body ever being buffered whole.
+    the streamed init hands the data on a piece at a time instead, so no
+    event is too big and none has to be held in memory either
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef GEMINI_SSE_H
+#define GEMINI_SSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GEMINI_SSE_FIELD_MAX 16 // longest field name we care about is "event"
+#define GEMINI_SSE_EVENT_MAX 32
+
+// one complete event, data is nul terminated. data is NULL when it went
+// through the data callback, len is still all of it. return false to stop
+// the stream
+typedef bool (*gemini_sse_event_cb_t)(void *ctx, const char *event, const char *data, size_t len);
+// a piece of the event's data as it arrives, the \n joining data lines
+// included. return false to stop the stream
+typedef bool (*gemini_sse_data_cb_t)(void *ctx, const char *bytes, size_t len);
+
+typedef enum {
+    GEMINI_SSE_FIELD,       // reading the field name
+    GEMINI_SSE_VALUE_START, // just after the colon, one space is dropped
+    GEMINI_SSE_VALUE,
+    GEMINI_SSE_SKIP,        // comment or a field we don't keep
+} gemini_sse_state_t;
+
+typedef struct {
+    gemini_sse_event_cb_t on_event;
+    gemini_sse_data_cb_t on_data; // set by the streamed init, data isn't kept
+    void *ctx;
+    char *data; // caller's buffer, the biggest event that can be delivered
+    size_t data_cap;
+    size_t data_len;
+    bool data_seen;  // event has at least one data line
+    bool overflow;   // event outgrew the buffer, it is dropped
+    gemini_sse_state_t state;
+    bool value_is_data;
+    bool value_is_event;
+    bool after_cr;   // a \n straight after \r ends the same line
+    bool stopped;
+    char field[GEMINI_SSE_FIELD_MAX];
+    size_t field_len;
+    char event[GEMINI_SSE_EVENT_MAX];
+    size_t event_len;
+    unsigned events;  // delivered
+    unsigned dropped; // too big for the buffer, never when streamed
+} gemini_sse_parser_t;
+
+//Function definitions
+void gemini_sse_init(gemini_sse_parser_t *parser, char *buffer, size_t buffer_size,
+                     gemini_sse_event_cb_t on_event, void *ctx);
+// data goes to on_data as it arrives, on_event follows at the blank line
+void gemini_sse_init_streamed(gemini_sse_parser_t *parser, gemini_sse_data_cb_t on_data,
+                              gemini_sse_event_cb_t on_event, void *ctx);
+// false once the callback has asked to stop
+bool gemini_sse_feed(gemini_sse_parser_t *parser, const char *bytes, size_t len);
+
+#endif // GEMINI_SSE_H
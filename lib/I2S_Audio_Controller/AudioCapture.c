@@ -0,0 +1,162 @@
+/*
+    Description: frame ring and capture counters, see AudioCapture.h. the
+    producer publishes a slot with a release store of Head and the consumer
+    frees it with a release store of Tail, each side loads the other's index
+    with acquire so the frame pointer and its samples are visible before
+    the index that hands them over
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioCapture.h"
+#include <string.h>
+
+// PROTOTYPES
+int Audio_Ring_Ini(AudioRing *Ring, size_t Capacity);
+bool Audio_Ring_Push(AudioRing *Ring, AudioFrame *Frame);
+AudioFrame *Audio_Ring_Pop(AudioRing *Ring);
+size_t Audio_Ring_Count(AudioRing *Ring);
+int Audio_Capture_Ini(AudioCapture *Capture, PoolMemoryInfo *Pool,
+                      size_t Frame_Samples, size_t Ring_Frames);
+AudioFrame *Audio_Capture_Frame_Get(AudioCapture *Capture);
+bool Audio_Capture_Frame_Commit(AudioCapture *Capture, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us);
+void Audio_Capture_Frame_Abort(AudioCapture *Capture, AudioFrame *Frame);
+AudioFrame *Audio_Capture_Frame_Take(AudioCapture *Capture);
+void Audio_Capture_Frame_Release(AudioCapture *Capture, AudioFrame *Frame);
+void Audio_Capture_Flush(AudioCapture *Capture);
+void Audio_Capture_Get_Counters(AudioCapture *Capture,
+                                AudioCaptureCounters *Counters);
+static void Audio_Capture_Count(atomic_uint_least32_t *Counter);
+
+int Audio_Ring_Ini(AudioRing *Ring, size_t Capacity) {
+  if (Capacity == 0 || Capacity > AUDIO_RING_MAX_FRAMES ||
+      (Capacity & (Capacity - 1)) != 0) {
+    return -1;
+  }
+  memset(Ring->Slot, 0, sizeof(Ring->Slot));
+  Ring->Mask = Capacity - 1;
+  atomic_init(&Ring->Head, 0);
+  atomic_init(&Ring->Tail, 0);
+  return 0;
+}
+
+// Head and Tail only ever count up, their difference is the fill level
+bool Audio_Ring_Push(AudioRing *Ring, AudioFrame *Frame) {
+  size_t Head = atomic_load_explicit(&Ring->Head, memory_order_relaxed);
+  size_t Tail = atomic_load_explicit(&Ring->Tail, memory_order_acquire);
+  if (Head - Tail > Ring->Mask) {
+    return false;
+  }
+  Ring->Slot[Head & Ring->Mask] = Frame;
+  atomic_store_explicit(&Ring->Head, Head + 1, memory_order_release);
+  return true;
+}
+
+AudioFrame *Audio_Ring_Pop(AudioRing *Ring) {
+  size_t Tail = atomic_load_explicit(&Ring->Tail, memory_order_relaxed);
+  size_t Head = atomic_load_explicit(&Ring->Head, memory_order_acquire);
+  if (Head == Tail) {
+    return NULL;
+  }
+  AudioFrame *Frame = Ring->Slot[Tail & Ring->Mask];
+  atomic_store_explicit(&Ring->Tail, Tail + 1, memory_order_release);
+  return Frame;
+}
+
+size_t Audio_Ring_Count(AudioRing *Ring) {
+  size_t Tail = atomic_load_explicit(&Ring->Tail, memory_order_acquire);
+  size_t Head = atomic_load_explicit(&Ring->Head, memory_order_acquire);
+  return Head - Tail;
+}
+
+int Audio_Capture_Ini(AudioCapture *Capture, PoolMemoryInfo *Pool,
+                      size_t Frame_Samples, size_t Ring_Frames) {
+  memset(Capture, 0, sizeof(*Capture));
+  if (Pool == NULL || Frame_Samples == 0 ||
+      Audio_Ring_Ini(&Capture->Ring, Ring_Frames) != 0) {
+    return -1;
+  }
+  Capture->Pool = Pool;
+  Capture->Frame_Samples = Frame_Samples;
+  Capture->Frame_Bytes = sizeof(AudioFrame) + Frame_Samples * sizeof(int32_t);
+  // find out now rather than on the first frame if no class is big enough
+  void *Probe = Pool_Alloc(Capture->Frame_Bytes, Pool);
+  if (Probe == NULL) {
+    return -1;
+  }
+  Pool_Free(Probe, Pool);
+  atomic_init(&Capture->Frames, 0);
+  atomic_init(&Capture->Ring_Full, 0);
+  atomic_init(&Capture->Pool_Empty, 0);
+  atomic_init(&Capture->Read_Errors, 0);
+  atomic_init(&Capture->High_Water, 0);
+  return 0;
+}
+
+AudioFrame *Audio_Capture_Frame_Get(AudioCapture *Capture) {
+  AudioFrame *Frame = Pool_Alloc(Capture->Frame_Bytes, Capture->Pool);
+  if (Frame == NULL) {
+    Capture->Sequence++;
+    Audio_Capture_Count(&Capture->Pool_Empty);
+    return NULL;
+  }
+  Frame->Format = AUDIO_FORMAT_I2S32;
+  return Frame;
+}
+
+bool Audio_Capture_Frame_Commit(AudioCapture *Capture, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us) {
+  Frame->Sequence = Capture->Sequence++;
+  Frame->Sample_Count = (uint32_t)Sample_Count;
+  Frame->Timestamp_us = Timestamp_us;
+  if (!Audio_Ring_Push(&Capture->Ring, Frame)) {
+    Pool_Free(Frame, Capture->Pool);
+    Audio_Capture_Count(&Capture->Ring_Full);
+    return false;
+  }
+  Audio_Capture_Count(&Capture->Frames);
+  uint32_t Level = (uint32_t)Audio_Ring_Count(&Capture->Ring);
+  if (Level >
+      atomic_load_explicit(&Capture->High_Water, memory_order_relaxed)) {
+    atomic_store_explicit(&Capture->High_Water, Level, memory_order_relaxed);
+  }
+  return true;
+}
+
+void Audio_Capture_Frame_Abort(AudioCapture *Capture, AudioFrame *Frame) {
+  Capture->Sequence++;
+  Pool_Free(Frame, Capture->Pool);
+  Audio_Capture_Count(&Capture->Read_Errors);
+}
+
+AudioFrame *Audio_Capture_Frame_Take(AudioCapture *Capture) {
+  return Audio_Ring_Pop(&Capture->Ring);
+}
+
+void Audio_Capture_Frame_Release(AudioCapture *Capture, AudioFrame *Frame) {
+  Pool_Free(Frame, Capture->Pool);
+}
+
+void Audio_Capture_Flush(AudioCapture *Capture) {
+  AudioFrame *Frame;
+  while ((Frame = Audio_Ring_Pop(&Capture->Ring)) != NULL) {
+    Pool_Free(Frame, Capture->Pool);
+  }
+}
+
+void Audio_Capture_Get_Counters(AudioCapture *Capture,
+                                AudioCaptureCounters *Counters) {
+  memset(Counters, 0, sizeof(*Counters));
+  Counters->Frames = atomic_load(&Capture->Frames);
+  Counters->Ring_Full = atomic_load(&Capture->Ring_Full);
+  Counters->Pool_Empty = atomic_load(&Capture->Pool_Empty);
+  Counters->Read_Errors = atomic_load(&Capture->Read_Errors);
+  Counters->Ring_High_Water = atomic_load(&Capture->High_Water);
+}
+
+// only the producer stores, so a load and a store is enough
+static void Audio_Capture_Count(atomic_uint_least32_t *Counter) {
+  atomic_store_explicit(
+      Counter, atomic_load_explicit(Counter, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+}
@@ -0,0 +1,98 @@
+/*
+    Description: the capture side of the audio pipeline without the
+    hardware. the producer (the i2s task, or a simulated one on the host)
+    fills fixed size frames taken from a MemoryPool and commits them to a
+    single producer single consumer ring. the consumer takes the same frame
+    out and hands it back to the pool once done with it, only the pointer
+    ever moves. the ring is lock free so the producer never waits on the
+    consumer, a frame that finds the ring full is dropped and counted
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include "MemoryPool.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// most frames a ring holds, the ring size must be a power of two up to it
+#define AUDIO_RING_MAX_FRAMES 64
+
+typedef enum {
+  AUDIO_FORMAT_I2S32 = 0, // 32-bit i2s slots as the mic sent them
+  AUDIO_FORMAT_PCM16,     // converted in place to 16-bit pcm
+} AudioFormat;
+
+typedef struct { // one pool block, the samples follow the header
+  uint32_t Sequence;     // frame number since capture started, gaps are drops
+  uint32_t Sample_Count;
+  int64_t Timestamp_us;  // when the last sample came in
+  AudioFormat Format;
+  int32_t Data[];
+} AudioFrame;
+
+typedef struct { // snapshot of the producer side counters
+  uint32_t Frames;       // committed to the ring
+  uint32_t Ring_Full;    // dropped because the consumer fell behind
+  uint32_t Pool_Empty;   // no block for the next frame, that audio was lost
+  uint32_t Read_Errors;  // the source failed to fill a frame
+  uint32_t Dma_Overruns; // dma buffers the driver lost, the i2s task fills it
+  uint32_t Ring_High_Water;
+} AudioCaptureCounters;
+
+typedef struct {
+  AudioFrame *Slot[AUDIO_RING_MAX_FRAMES];
+  size_t Mask;
+  atomic_size_t Head; // next slot to fill, only the producer stores it
+  atomic_size_t Tail; // next slot to take, only the consumer stores it
+} AudioRing;
+
+typedef struct {
+  PoolMemoryInfo *Pool; // frames come from here, build with POOL_THREAD_SAFE
+  size_t Frame_Samples;
+  size_t Frame_Bytes;   // header and samples, what a frame takes from the pool
+  uint32_t Sequence;    // producer only
+  AudioRing Ring;
+  // stored by the producer only, atomic so the consumer can read them
+  atomic_uint_least32_t Frames;
+  atomic_uint_least32_t Ring_Full;
+  atomic_uint_least32_t Pool_Empty;
+  atomic_uint_least32_t Read_Errors;
+  atomic_uint_least32_t High_Water;
+} AudioCapture;
+
+// ring on its own. Capacity is a power of two up to AUDIO_RING_MAX_FRAMES,
+// returns -1 otherwise
+int Audio_Ring_Ini(AudioRing *Ring, size_t Capacity);
+// producer only. false when the ring is full, the frame stays the caller's
+bool Audio_Ring_Push(AudioRing *Ring, AudioFrame *Frame);
+// consumer only. NULL when the ring is empty
+AudioFrame *Audio_Ring_Pop(AudioRing *Ring);
+size_t Audio_Ring_Count(AudioRing *Ring);
+
+// -1 when Ring_Frames isn't a valid ring size or the pool has no class that
+// fits a frame
+int Audio_Capture_Ini(AudioCapture *Capture, PoolMemoryInfo *Pool,
+                      size_t Frame_Samples, size_t Ring_Frames);
+// producer. an empty frame to fill, NULL when the pool is out of blocks.
+// that frame's time is lost then and the sequence skips it
+AudioFrame *Audio_Capture_Frame_Get(AudioCapture *Capture);
+// producer. hands the filled frame to the consumer, or drops it back to the
+// pool when the ring is full and returns false
+bool Audio_Capture_Frame_Commit(AudioCapture *Capture, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us);
+// producer. the source failed to fill the frame
+void Audio_Capture_Frame_Abort(AudioCapture *Capture, AudioFrame *Frame);
+// consumer. the oldest frame, NULL when there is none yet
+AudioFrame *Audio_Capture_Frame_Take(AudioCapture *Capture);
+// consumer. back to the pool
+void Audio_Capture_Frame_Release(AudioCapture *Capture, AudioFrame *Frame);
+// consumer. releases every frame still waiting, once the producer stopped
+void Audio_Capture_Flush(AudioCapture *Capture);
+void Audio_Capture_Get_Counters(AudioCapture *Capture,
+                                AudioCaptureCounters *Counters);
+
+#endif // AUDIO_CAPTURE_H
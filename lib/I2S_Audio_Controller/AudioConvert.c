@@ -0,0 +1,104 @@
+/*
+    Description: sample conversion kernels, see AudioConvert.h. converting
+    in place is safe front to back because sample i is written over bytes
+    2i to 2i+1, which belong to a slot already read. the block kernel reads
+    a whole block into a local before it stores any of it, so its inner
+    loop has no aliasing for the compiler to worry about
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioConvert.h"
+#include <string.h>
+
+// PROTOTYPES
+void Audio_Convert(const int32_t *In, int16_t *Out, size_t Count,
+                   const AudioConvertParams *Params);
+void Audio_Convert_Scalar(const int32_t *In, int16_t *Out, size_t Count,
+                          const AudioConvertParams *Params);
+void Audio_Convert_Block(const int32_t *In, int16_t *Out, size_t Count,
+                         const AudioConvertParams *Params);
+int Audio_Frame_To_Pcm16(AudioFrame *Frame, const AudioConvertParams *Params);
+int32_t Audio_Convert_Dc_Estimate(const int32_t *Slots, size_t Count,
+                                  uint8_t Shift);
+static inline void Audio_Convert_Run(const int32_t *In, int16_t *Block,
+                                     size_t Count, int Shift,
+                                     int32_t Dc_Offset);
+
+void Audio_Convert(const int32_t *In, int16_t *Out, size_t Count,
+                   const AudioConvertParams *Params) {
+#ifdef AUDIO_CONVERT_PIE
+  size_t Blocks = Count / AUDIO_CONVERT_PIE_BLOCK;
+  if (Blocks > 0) {
+    Audio_Convert_Pie(In, Out, Blocks, Params);
+    In += Blocks * AUDIO_CONVERT_PIE_BLOCK;
+    Out += Blocks * AUDIO_CONVERT_PIE_BLOCK;
+    Count -= Blocks * AUDIO_CONVERT_PIE_BLOCK;
+  }
+#endif
+  Audio_Convert_Block(In, Out, Count, Params);
+}
+
+// the reference the other kernels are tested against, one sample at a time
+void Audio_Convert_Scalar(const int32_t *In, int16_t *Out, size_t Count,
+                          const AudioConvertParams *Params) {
+  for (size_t i = 0; i < Count; i++) {
+    int32_t Sample = (In[i] >> Params->Shift) - Params->Dc_Offset;
+    if (Sample > INT16_MAX) {
+      Sample = INT16_MAX;
+    } else if (Sample < INT16_MIN) {
+      Sample = INT16_MIN;
+    }
+    Out[i] = (int16_t)Sample;
+  }
+}
+
+void Audio_Convert_Block(const int32_t *In, int16_t *Out, size_t Count,
+                         const AudioConvertParams *Params) {
+  int16_t Block[AUDIO_CONVERT_BLOCK];
+  const int Shift = Params->Shift;
+  const int32_t Dc_Offset = Params->Dc_Offset;
+  for (; Count >= AUDIO_CONVERT_BLOCK; Count -= AUDIO_CONVERT_BLOCK) {
+    Audio_Convert_Run(In, Block, AUDIO_CONVERT_BLOCK, Shift, Dc_Offset);
+    memcpy(Out, Block, sizeof(Block));
+    In += AUDIO_CONVERT_BLOCK;
+    Out += AUDIO_CONVERT_BLOCK;
+  }
+  Audio_Convert_Run(In, Block, Count, Shift, Dc_Offset);
+  memcpy(Out, Block, Count * sizeof(int16_t));
+}
+
+int Audio_Frame_To_Pcm16(AudioFrame *Frame, const AudioConvertParams *Params) {
+  if (Frame->Format != AUDIO_FORMAT_I2S32) {
+    return -1;
+  }
+  Audio_Convert(Frame->Data, Audio_Frame_Pcm16(Frame), Frame->Sample_Count,
+                Params);
+  Frame->Format = AUDIO_FORMAT_PCM16;
+  return 0;
+}
+
+int32_t Audio_Convert_Dc_Estimate(const int32_t *Slots, size_t Count,
+                                  uint8_t Shift) {
+  if (Count == 0) {
+    return 0;
+  }
+  int64_t Sum = 0;
+  for (size_t i = 0; i < Count; i++) {
+    Sum += Slots[i] >> Shift;
+  }
+  // rounded to nearest, halves away from zero
+  int64_t Half = (int64_t)(Count / 2);
+  return (int32_t)((Sum >= 0 ? Sum + Half : Sum - Half) / (int64_t)Count);
+}
+
+// the clip is a min and a max so it stays branch free once vectorised
+static inline void Audio_Convert_Run(const int32_t *In, int16_t *Block,
+                                     size_t Count, int Shift,
+                                     int32_t Dc_Offset) {
+  for (size_t i = 0; i < Count; i++) {
+    int32_t Sample = (In[i] >> Shift) - Dc_Offset;
+    Sample = Sample < INT16_MAX ? Sample : INT16_MAX;
+    Sample = Sample > INT16_MIN ? Sample : INT16_MIN;
+    Block[i] = (int16_t)Sample;
+  }
+}
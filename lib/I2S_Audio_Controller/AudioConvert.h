@@ -0,0 +1,66 @@
+/*
+    Description: turns the SPH0645's i2s slots into 16-bit pcm. the mic
+    sends 18 bits left justified in a 32-bit slot, each sample is shifted
+    down, has the mic's dc offset taken off, is clipped and narrowed. the
+    output is half the size of the input so a frame converts in place in
+    its own pool block. the default kernel works a block at a time without
+    branches so the compiler can vectorise it on the host. build with
+    AUDIO_CONVERT_PIE on the esp32-s3 to hand whole blocks to a simd
+    kernel, see Audio_Convert_Pie
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_CONVERT_H
+#define AUDIO_CONVERT_H
+
+#include "AudioCapture.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// samples the block kernel converts per step
+#define AUDIO_CONVERT_BLOCK 32
+// samples the pie kernel takes per step, it is only called with multiples
+#define AUDIO_CONVERT_PIE_BLOCK 16
+
+typedef struct {
+  uint8_t Shift;     // 8 to 31, 14 keeps all 18 bits and clips the top 2
+  int32_t Dc_Offset; // after the shift, within +-(1 << 23)
+} AudioConvertParams;
+
+// the offset differs from part to part, measure it on a quiet frame with
+// Audio_Convert_Dc_Estimate at bring-up
+#define AUDIO_CONVERT_SPH0645                                                  \
+  { .Shift = 14, .Dc_Offset = 0 }
+
+// In and Out may be the same buffer, never otherwise overlapping
+typedef void (*AudioConvertKernel)(const int32_t *In, int16_t *Out,
+                                   size_t Count,
+                                   const AudioConvertParams *Params);
+
+// fastest kernel this build has
+void Audio_Convert(const int32_t *In, int16_t *Out, size_t Count,
+                   const AudioConvertParams *Params);
+// the kernels on their own, for the tests and the benchmark
+void Audio_Convert_Scalar(const int32_t *In, int16_t *Out, size_t Count,
+                          const AudioConvertParams *Params);
+void Audio_Convert_Block(const int32_t *In, int16_t *Out, size_t Count,
+                         const AudioConvertParams *Params);
+#ifdef AUDIO_CONVERT_PIE
+// esp32-s3 simd kernel, supplied in assembly alongside the build that sets
+// AUDIO_CONVERT_PIE. takes blocks of AUDIO_CONVERT_PIE_BLOCK samples and
+// must load each block before it stores it, In and Out can be the same
+void Audio_Convert_Pie(const int32_t *In, int16_t *Out, size_t Blocks,
+                       const AudioConvertParams *Params);
+#endif
+
+// a frame's samples once it is AUDIO_FORMAT_PCM16
+static inline int16_t *Audio_Frame_Pcm16(AudioFrame *Frame) {
+  return (int16_t *)Frame->Data;
+}
+// converts an AUDIO_FORMAT_I2S32 frame in place, -1 if it already isn't one
+int Audio_Frame_To_Pcm16(AudioFrame *Frame, const AudioConvertParams *Params);
+// mean of the shifted slots, the Dc_Offset for a frame of silence
+int32_t Audio_Convert_Dc_Estimate(const int32_t *Slots, size_t Count,
+                                  uint8_t Shift);
+
+#endif // AUDIO_CONVERT_H
@@ -0,0 +1,173 @@
+/*
+    Description: sample ring for playback, see AudioPlayback.h. Head, Tail
+    and End only ever count up, the same way as the AudioCapture ring. the
+    producer publishes samples with a release store of Head and an end mark
+    with a release store of End, the consumer frees room with a release
+    store of Tail
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioPlayback.h"
+#include <string.h>
+
+// PROTOTYPES
+int Audio_Playback_Ini(AudioPlayback *Playback, int16_t *Buffer,
+                       size_t Capacity, size_t Start_Samples);
+size_t Audio_Playback_Write(AudioPlayback *Playback, const int16_t *Samples,
+                            size_t Count);
+void Audio_Playback_Mark_End(AudioPlayback *Playback);
+size_t Audio_Playback_Space(AudioPlayback *Playback);
+size_t Audio_Playback_Level(AudioPlayback *Playback);
+bool Audio_Playback_Idle(AudioPlayback *Playback);
+size_t Audio_Playback_Read(AudioPlayback *Playback, int16_t *Out,
+                           size_t Count);
+void Audio_Playback_Drop(AudioPlayback *Playback);
+void Audio_Playback_Get_Counters(AudioPlayback *Playback,
+                                 AudioPlaybackCounters *Counters);
+static bool Audio_Playback_At_End(size_t End, size_t Tail, size_t Head);
+static void Audio_Playback_Count(atomic_uint_least32_t *Counter,
+                                 uint32_t Amount);
+
+int Audio_Playback_Ini(AudioPlayback *Playback, int16_t *Buffer,
+                       size_t Capacity, size_t Start_Samples) {
+  if (Buffer == NULL || Capacity == 0 || (Capacity & (Capacity - 1)) != 0 ||
+      Start_Samples > Capacity) {
+    return -1;
+  }
+  Playback->Samples = Buffer;
+  Playback->Mask = Capacity - 1;
+  Playback->Start_Samples = Start_Samples;
+  atomic_init(&Playback->Head, 0);
+  atomic_init(&Playback->Tail, 0);
+  atomic_init(&Playback->End, 0);
+  atomic_init(&Playback->Playing, false);
+  atomic_init(&Playback->Played, 0);
+  atomic_init(&Playback->Starts, 0);
+  atomic_init(&Playback->Underruns, 0);
+  atomic_init(&Playback->High_Water, 0);
+  return 0;
+}
+
+// in up to two copies, the part that fits before the wrap and the rest
+size_t Audio_Playback_Write(AudioPlayback *Playback, const int16_t *Samples,
+                            size_t Count) {
+  const size_t Head = atomic_load_explicit(&Playback->Head,
+                                           memory_order_relaxed);
+  const size_t Tail = atomic_load_explicit(&Playback->Tail,
+                                           memory_order_acquire);
+  const size_t Space = Playback->Mask + 1 - (Head - Tail);
+  if (Count > Space) {
+    Count = Space;
+  }
+  const size_t Start = Head & Playback->Mask;
+  const size_t First =
+      Count < Playback->Mask + 1 - Start ? Count : Playback->Mask + 1 - Start;
+  memcpy(Playback->Samples + Start, Samples, First * sizeof(int16_t));
+  memcpy(Playback->Samples, Samples + First, (Count - First) * sizeof(int16_t));
+  atomic_store_explicit(&Playback->Head, Head + Count, memory_order_release);
+  const size_t Level = Head + Count - Tail;
+  if (Level >
+      atomic_load_explicit(&Playback->High_Water, memory_order_relaxed)) {
+    atomic_store_explicit(&Playback->High_Water, (uint_least32_t)Level,
+                          memory_order_relaxed);
+  }
+  return Count;
+}
+
+void Audio_Playback_Mark_End(AudioPlayback *Playback) {
+  atomic_store_explicit(
+      &Playback->End,
+      atomic_load_explicit(&Playback->Head, memory_order_relaxed),
+      memory_order_release);
+}
+
+size_t Audio_Playback_Space(AudioPlayback *Playback) {
+  return Playback->Mask + 1 - Audio_Playback_Level(Playback);
+}
+
+size_t Audio_Playback_Level(AudioPlayback *Playback) {
+  const size_t Tail = atomic_load_explicit(&Playback->Tail,
+                                           memory_order_acquire);
+  return atomic_load_explicit(&Playback->Head, memory_order_acquire) - Tail;
+}
+
+bool Audio_Playback_Idle(AudioPlayback *Playback) {
+  return Audio_Playback_Level(Playback) == 0 &&
+         !atomic_load_explicit(&Playback->Playing, memory_order_acquire);
+}
+
+size_t Audio_Playback_Read(AudioPlayback *Playback, int16_t *Out,
+                           size_t Count) {
+  const size_t Tail = atomic_load_explicit(&Playback->Tail,
+                                           memory_order_relaxed);
+  const size_t End = atomic_load_explicit(&Playback->End,
+                                          memory_order_acquire);
+  const size_t Head = atomic_load_explicit(&Playback->Head,
+                                           memory_order_acquire);
+  const size_t Level = Head - Tail;
+  bool Playing = atomic_load_explicit(&Playback->Playing,
+                                      memory_order_relaxed);
+  if (!Playing) {
+    // an end mark with audio before it plays that audio out at once
+    if (Level == 0 || (Level < Playback->Start_Samples &&
+                       (End == Tail || !Audio_Playback_At_End(End, Tail,
+                                                              Head)))) {
+      memset(Out, 0, Count * sizeof(int16_t));
+      return 0;
+    }
+    Playing = true;
+    atomic_store_explicit(&Playback->Playing, true, memory_order_release);
+    Audio_Playback_Count(&Playback->Starts, 1);
+  }
+  const size_t Take = Level < Count ? Level : Count;
+  const size_t Start = Tail & Playback->Mask;
+  const size_t First =
+      Take < Playback->Mask + 1 - Start ? Take : Playback->Mask + 1 - Start;
+  memcpy(Out, Playback->Samples + Start, First * sizeof(int16_t));
+  memcpy(Out + First, Playback->Samples, (Take - First) * sizeof(int16_t));
+  memset(Out + Take, 0, (Count - Take) * sizeof(int16_t));
+  atomic_store_explicit(&Playback->Tail, Tail + Take, memory_order_release);
+  Audio_Playback_Count(&Playback->Played, (uint32_t)Take);
+  if (Take < Count) {
+    // dry. at an end mark that is the sentence finishing, anywhere else
+    // the download fell behind
+    if (!Audio_Playback_At_End(End, Tail + Take, Head)) {
+      Audio_Playback_Count(&Playback->Underruns, 1);
+    }
+    atomic_store_explicit(&Playback->Playing, false, memory_order_release);
+  }
+  return Take;
+}
+
+void Audio_Playback_Drop(AudioPlayback *Playback) {
+  atomic_store_explicit(
+      &Playback->Tail,
+      atomic_load_explicit(&Playback->Head, memory_order_acquire),
+      memory_order_release);
+  atomic_store_explicit(&Playback->Playing, false, memory_order_release);
+}
+
+void Audio_Playback_Get_Counters(AudioPlayback *Playback,
+                                 AudioPlaybackCounters *Counters) {
+  memset(Counters, 0, sizeof(*Counters));
+  Counters->Written =
+      (uint32_t)atomic_load(&Playback->Head); // wraps with the counter
+  Counters->Played = atomic_load(&Playback->Played);
+  Counters->Starts = atomic_load(&Playback->Starts);
+  Counters->Underruns = atomic_load(&Playback->Underruns);
+  Counters->High_Water = atomic_load(&Playback->High_Water);
+}
+
+// End lies between Tail and Head, both ends included. all three count up
+// and wrap together so the differences stay right
+static bool Audio_Playback_At_End(size_t End, size_t Tail, size_t Head) {
+  return End - Tail <= Head - Tail;
+}
+
+// one side only stores each counter, a plain load and store is enough
+static void Audio_Playback_Count(atomic_uint_least32_t *Counter,
+                                 uint32_t Amount) {
+  atomic_store_explicit(
+      Counter, atomic_load_explicit(Counter, memory_order_relaxed) + Amount,
+      memory_order_relaxed);
+}
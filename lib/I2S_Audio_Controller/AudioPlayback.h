@@ -0,0 +1,69 @@
+/*
+    Description: the playback side of the audio without the hardware. the
+    producer (the text to speech client) writes 16-bit pcm into a single
+    producer single consumer sample ring as it downloads, the consumer (the
+    i2s tx task, or a simulated one on the host) reads a dma buffer's worth
+    at a time and always gets a full buffer, silence where there was no
+    audio. playback starts once Start_Samples are buffered so the network
+    can fall a little behind without a gap, or at once when the producer
+    marks the end of what it has, so a short sentence isn't held back. a
+    ring that runs dry mid sentence counts an underrun and buffers again
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_PLAYBACK_H
+#define AUDIO_PLAYBACK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct { // snapshot of both sides' counters
+  uint32_t Written;    // samples, producer
+  uint32_t Played;     // samples of audio, not the silence around it
+  uint32_t Starts;     // times playback started from silence
+  uint32_t Underruns;  // times the ring ran dry before an end mark
+  uint32_t High_Water; // samples
+} AudioPlaybackCounters;
+
+typedef struct {
+  int16_t *Samples;
+  size_t Mask;
+  size_t Start_Samples;
+  atomic_size_t Head;    // next sample to write, only the producer stores it
+  atomic_size_t Tail;    // next sample to play, only the consumer stores it
+  atomic_size_t End;     // Head at the last end mark, producer
+  atomic_bool Playing;   // consumer, false while buffering
+  // each stored by one side only, atomic so the other can read them
+  atomic_uint_least32_t Played;
+  atomic_uint_least32_t Starts;
+  atomic_uint_least32_t Underruns;
+  atomic_uint_least32_t High_Water;
+} AudioPlayback;
+
+// Buffer holds Capacity samples, a power of two. Start_Samples up to
+// Capacity, 0 plays as soon as anything is written. -1 otherwise
+int Audio_Playback_Ini(AudioPlayback *Playback, int16_t *Buffer,
+                       size_t Capacity, size_t Start_Samples);
+// producer. as much of Samples as fits, returns how many went in
+size_t Audio_Playback_Write(AudioPlayback *Playback, const int16_t *Samples,
+                            size_t Count);
+// producer. nothing more is coming for now, what was written plays out
+// even under Start_Samples and running dry after it isn't an underrun
+void Audio_Playback_Mark_End(AudioPlayback *Playback);
+// producer. room left in samples
+size_t Audio_Playback_Space(AudioPlayback *Playback);
+// either side. samples waiting to be played
+size_t Audio_Playback_Level(AudioPlayback *Playback);
+// either side. nothing waiting and nothing playing
+bool Audio_Playback_Idle(AudioPlayback *Playback);
+// consumer. Out always gets Count samples, returns how many were audio
+size_t Audio_Playback_Read(AudioPlayback *Playback, int16_t *Out,
+                           size_t Count);
+// consumer. drops everything waiting, for an answer that was cut off
+void Audio_Playback_Drop(AudioPlayback *Playback);
+void Audio_Playback_Get_Counters(AudioPlayback *Playback,
+                                 AudioPlaybackCounters *Counters);
+
+#endif // AUDIO_PLAYBACK_H
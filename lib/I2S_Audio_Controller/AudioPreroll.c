@@ -0,0 +1,180 @@
+/*
+    Description: pre-roll ring, see AudioPreroll.h. the held frames are a
+    ring of pointers oldest first, the empty blocks a stack. every block
+    the pre-roll owns is in one or the other, or is the frame the producer
+    is filling. after a press the blocks handed over are taken back from
+    the pool one at a time as frames come in, so the pre-roll is whole
+    again a pre-roll's length after the recording stops
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioPreroll.h"
+#include <string.h>
+
+// PROTOTYPES
+size_t Audio_Preroll_Frames_For(uint32_t Sample_Rate, size_t Frame_Samples,
+                                uint32_t Preroll_ms);
+int Audio_Preroll_Ini(AudioPreroll *Preroll, AudioCapture *Capture,
+                      size_t Frames);
+AudioFrame *Audio_Preroll_Frame_Get(AudioPreroll *Preroll);
+void Audio_Preroll_Frame_Commit(AudioPreroll *Preroll, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us);
+void Audio_Preroll_Frame_Abort(AudioPreroll *Preroll, AudioFrame *Frame);
+size_t Audio_Preroll_Release(AudioPreroll *Preroll,
+                             const AudioConvertParams *Convert);
+void Audio_Preroll_Discard(AudioPreroll *Preroll);
+void Audio_Preroll_Flush(AudioPreroll *Preroll);
+void Audio_Preroll_Get_Counters(AudioPreroll *Preroll,
+                                AudioPrerollCounters *Counters);
+static size_t Audio_Preroll_Owned(const AudioPreroll *Preroll);
+static void Audio_Preroll_Count(atomic_uint_least32_t *Counter, uint32_t By);
+
+size_t Audio_Preroll_Frames_For(uint32_t Sample_Rate, size_t Frame_Samples,
+                                uint32_t Preroll_ms) {
+  if (Frame_Samples == 0) {
+    return 0;
+  }
+  uint64_t Samples = ((uint64_t)Sample_Rate * Preroll_ms + 999) / 1000;
+  return (size_t)((Samples + Frame_Samples - 1) / Frame_Samples);
+}
+
+int Audio_Preroll_Ini(AudioPreroll *Preroll, AudioCapture *Capture,
+                      size_t Frames) {
+  memset(Preroll, 0, sizeof(*Preroll));
+  if (Capture == NULL || Frames == 0 || Frames > AUDIO_PREROLL_MAX_FRAMES ||
+      Frames >= Capture->Ring.Mask + 1) {
+    return -1;
+  }
+  Preroll->Capture = Capture;
+  Preroll->Frames = Frames;
+  for (size_t i = 0; i < Frames + 1; i++) {
+    AudioFrame *Frame = Pool_Alloc(Capture->Frame_Bytes, Capture->Pool);
+    if (Frame == NULL) {
+      Audio_Preroll_Flush(Preroll);
+      return -1;
+    }
+    Preroll->Spare[Preroll->Spare_Count++] = Frame;
+  }
+  return 0;
+}
+
+// a spare, else a block from the pool to make up for the ones a press
+// handed over, else the oldest held frame when the pool has run dry
+AudioFrame *Audio_Preroll_Frame_Get(AudioPreroll *Preroll) {
+  AudioFrame *Frame = NULL;
+  if (Preroll->Spare_Count > 0) {
+    Frame = Preroll->Spare[--Preroll->Spare_Count];
+  } else if (Audio_Preroll_Owned(Preroll) < Preroll->Frames + 1 &&
+             (Frame = Pool_Alloc(Preroll->Capture->Frame_Bytes,
+                                 Preroll->Capture->Pool)) == NULL) {
+    Audio_Preroll_Count(&Preroll->Blocks_Short, 1);
+  }
+  if (Frame == NULL && Preroll->Count > 0) {
+    Frame = Preroll->Held[Preroll->Oldest];
+    Preroll->Oldest = (Preroll->Oldest + 1) % AUDIO_PREROLL_MAX_FRAMES;
+    Preroll->Count--;
+    Audio_Preroll_Count(&Preroll->Recycled, 1);
+  }
+  if (Frame != NULL) {
+    Frame->Format = AUDIO_FORMAT_I2S32;
+  }
+  return Frame;
+}
+
+void Audio_Preroll_Frame_Commit(AudioPreroll *Preroll, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us) {
+  if (Preroll->Count == Preroll->Frames) {
+    Preroll->Spare[Preroll->Spare_Count++] = Preroll->Held[Preroll->Oldest];
+    Preroll->Oldest = (Preroll->Oldest + 1) % AUDIO_PREROLL_MAX_FRAMES;
+    Preroll->Count--;
+    Audio_Preroll_Count(&Preroll->Recycled, 1);
+  }
+  Frame->Sequence = 0; // numbered when it is released
+  Frame->Sample_Count = (uint32_t)Sample_Count;
+  Frame->Timestamp_us = Timestamp_us;
+  Preroll->Held[(Preroll->Oldest + Preroll->Count) % AUDIO_PREROLL_MAX_FRAMES] =
+      Frame;
+  Preroll->Count++;
+  Audio_Preroll_Count(&Preroll->Frames_Held, 1);
+}
+
+void Audio_Preroll_Frame_Abort(AudioPreroll *Preroll, AudioFrame *Frame) {
+  Preroll->Spare[Preroll->Spare_Count++] = Frame;
+  Audio_Preroll_Count(&Preroll->Read_Errors, 1);
+}
+
+// the recording starts with the oldest frame held, the live frames after
+// these carry on from their sequence
+size_t Audio_Preroll_Release(AudioPreroll *Preroll,
+                             const AudioConvertParams *Convert) {
+  size_t Released = 0;
+  Preroll->Capture->Sequence = 0;
+  while (Preroll->Count > 0) {
+    AudioFrame *Frame = Preroll->Held[Preroll->Oldest];
+    Preroll->Oldest = (Preroll->Oldest + 1) % AUDIO_PREROLL_MAX_FRAMES;
+    Preroll->Count--;
+    if (Convert != NULL && Frame->Format == AUDIO_FORMAT_I2S32) {
+      Audio_Convert(Frame->Data, Audio_Frame_Pcm16(Frame), Frame->Sample_Count,
+                    Convert);
+      Frame->Format = AUDIO_FORMAT_PCM16;
+    }
+    // a full ring frees the block and counts it like any late frame
+    Released += Audio_Capture_Frame_Commit(Preroll->Capture, Frame,
+                                           Frame->Sample_Count,
+                                           Frame->Timestamp_us);
+  }
+  Preroll->Oldest = 0;
+  Audio_Preroll_Count(&Preroll->Released, (uint32_t)Released);
+  return Released;
+}
+
+void Audio_Preroll_Discard(AudioPreroll *Preroll) {
+  while (Preroll->Count > 0) {
+    Preroll->Spare[Preroll->Spare_Count++] = Preroll->Held[Preroll->Oldest];
+    Preroll->Oldest = (Preroll->Oldest + 1) % AUDIO_PREROLL_MAX_FRAMES;
+    Preroll->Count--;
+  }
+  Preroll->Oldest = 0;
+}
+
+void Audio_Preroll_Flush(AudioPreroll *Preroll) {
+  if (Preroll->Capture == NULL) {
+    return;
+  }
+  while (Preroll->Count > 0) {
+    Pool_Free(Preroll->Held[Preroll->Oldest], Preroll->Capture->Pool);
+    Preroll->Oldest = (Preroll->Oldest + 1) % AUDIO_PREROLL_MAX_FRAMES;
+    Preroll->Count--;
+  }
+  while (Preroll->Spare_Count > 0) {
+    Pool_Free(Preroll->Spare[--Preroll->Spare_Count], Preroll->Capture->Pool);
+  }
+  Preroll->Oldest = 0;
+}
+
+void Audio_Preroll_Get_Counters(AudioPreroll *Preroll,
+                                AudioPrerollCounters *Counters) {
+  Counters->Frames_Held =
+      atomic_load_explicit(&Preroll->Frames_Held, memory_order_relaxed);
+  Counters->Recycled =
+      atomic_load_explicit(&Preroll->Recycled, memory_order_relaxed);
+  Counters->Released =
+      atomic_load_explicit(&Preroll->Released, memory_order_relaxed);
+  Counters->Read_Errors =
+      atomic_load_explicit(&Preroll->Read_Errors, memory_order_relaxed);
+  Counters->Blocks_Short =
+      atomic_load_explicit(&Preroll->Blocks_Short, memory_order_relaxed);
+}
+
+// blocks held and spare, the one being filled isn't known here so a top up
+// can run one over while a frame is out. Frame_Get never has two out
+static size_t Audio_Preroll_Owned(const AudioPreroll *Preroll) {
+  return Preroll->Count + Preroll->Spare_Count;
+}
+
+// the producer is the only writer, no need for a locked add
+static void Audio_Preroll_Count(atomic_uint_least32_t *Counter, uint32_t By) {
+  atomic_store_explicit(
+      Counter, atomic_load_explicit(Counter, memory_order_relaxed) + By,
+      memory_order_relaxed);
+}
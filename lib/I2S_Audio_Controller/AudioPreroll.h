@@ -0,0 +1,82 @@
+/*
+    Description: pre-roll for the capture task. while nobody is recording
+    the mic keeps running and the last Frames frames are held here instead
+    of going to the consumer, each new frame takes the block of the oldest
+    so the pool isn't touched and nothing is converted or woken up. when
+    the button is pressed the frames held go into the capture ring oldest
+    first, converted then, and numbered from 0 as the start of the
+    recording, so the syllable said as the button went down is already
+    there. the blocks are taken from the capture pool when the pre-roll is
+    set up and show there as in use for as long as it lives
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_PREROLL_H
+#define AUDIO_PREROLL_H
+
+#include "AudioCapture.h"
+#include "AudioConvert.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// most frames of audio held
+#define AUDIO_PREROLL_MAX_FRAMES 32
+
+typedef struct { // snapshot of the counters
+  uint32_t Frames_Held;   // committed to the pre-roll
+  uint32_t Recycled;      // oldest frames written over, that audio was never needed
+  uint32_t Released;      // handed to the capture ring on a press
+  uint32_t Read_Errors;   // frames the source failed to fill
+  uint32_t Blocks_Short;  // a top up found the pool empty
+} AudioPrerollCounters;
+
+typedef struct {
+  AudioCapture *Capture; // blocks come from its pool, released frames go to its ring
+  size_t Frames;         // of audio kept
+  size_t Oldest;
+  size_t Count;          // filled frames held
+  AudioFrame *Held[AUDIO_PREROLL_MAX_FRAMES];
+  size_t Spare_Count;    // empty blocks owned, one is the frame being filled
+  AudioFrame *Spare[AUDIO_PREROLL_MAX_FRAMES + 1];
+  // stored by the producer only, atomic so the consumer can read them
+  atomic_uint_least32_t Frames_Held;
+  atomic_uint_least32_t Recycled;
+  atomic_uint_least32_t Released;
+  atomic_uint_least32_t Read_Errors;
+  atomic_uint_least32_t Blocks_Short;
+} AudioPreroll;
+
+// frames that cover Preroll_ms, rounded up. the pool class for frames
+// needs this many blocks and one more on top of the capture's own
+size_t Audio_Preroll_Frames_For(uint32_t Sample_Rate, size_t Frame_Samples,
+                                uint32_t Preroll_ms);
+// takes Frames + 1 blocks from the capture pool. -1 if Frames is 0, above
+// AUDIO_PREROLL_MAX_FRAMES or doesn't leave room in the capture ring for a
+// live frame after a press, or the pool can't give the blocks
+int Audio_Preroll_Ini(AudioPreroll *Preroll, AudioCapture *Capture,
+                      size_t Frames);
+// producer. an empty frame to fill, NULL only when every block was handed
+// over by a press and the pool has none to top up with
+AudioFrame *Audio_Preroll_Frame_Get(AudioPreroll *Preroll);
+// producer. the newest frame, the oldest block goes back to the spares when
+// Frames are already held
+void Audio_Preroll_Frame_Commit(AudioPreroll *Preroll, AudioFrame *Frame,
+                                size_t Sample_Count, int64_t Timestamp_us);
+// producer. the source failed to fill the frame
+void Audio_Preroll_Frame_Abort(AudioPreroll *Preroll, AudioFrame *Frame);
+// producer. the press, the frames held are converted with Convert unless it
+// is NULL and committed to the capture ring from sequence 0. returns how
+// many went in, the blocks are the consumer's from then on
+size_t Audio_Preroll_Release(AudioPreroll *Preroll,
+                             const AudioConvertParams *Convert);
+// the frames held go back to the spares, for an arm after a stop where
+// they would be stale. not while the producer runs
+void Audio_Preroll_Discard(AudioPreroll *Preroll);
+// every block back to the pool, once the producer stopped
+void Audio_Preroll_Flush(AudioPreroll *Preroll);
+void Audio_Preroll_Get_Counters(AudioPreroll *Preroll,
+                                AudioPrerollCounters *Counters);
+
+#endif // AUDIO_PREROLL_H
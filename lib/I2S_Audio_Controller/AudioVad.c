@@ -0,0 +1,152 @@
+/*
+    Description: energy and zero crossing voice activity detection, see
+    AudioVad.h. the energy is compared as a mean square against the rms
+    threshold squared so no square root is taken per frame
+    Creator: Matthew Ayestaran
+*/
+
+#include "AudioVad.h"
+#include "AudioConvert.h"
+#include <string.h>
+
+// PROTOTYPES
+int Audio_Vad_Ini(AudioVad *Vad, const AudioVadConfig *Config,
+                  PoolMemoryInfo *Pool, uint32_t Sample_Rate,
+                  size_t Frame_Samples);
+void Audio_Vad_Measure(const int16_t *Pcm, size_t Count,
+                       AudioVadMeasure *Measure);
+size_t Audio_Vad_Push(AudioVad *Vad, AudioFrame *Frame, AudioFrame **Out,
+                      uint32_t *Events);
+bool Audio_Vad_Finish(AudioVad *Vad);
+void Audio_Vad_Get_Counters(AudioVad *Vad, AudioVadCounters *Counters);
+static bool Audio_Vad_Is_Speech(const AudioVad *Vad, AudioFrame *Frame);
+static void Audio_Vad_Drop(AudioVad *Vad, AudioFrame *Frame);
+static void Audio_Vad_Drop_Onset(AudioVad *Vad);
+
+int Audio_Vad_Ini(AudioVad *Vad, const AudioVadConfig *Config,
+                  PoolMemoryInfo *Pool, uint32_t Sample_Rate,
+                  size_t Frame_Samples) {
+  memset(Vad, 0, sizeof(*Vad));
+  if (Pool == NULL || Sample_Rate == 0 || Frame_Samples == 0 ||
+      Config->Stop_Rms > Config->Start_Rms) {
+    return -1;
+  }
+  Vad->Pool = Pool;
+  Vad->Config = *Config;
+  // whole frames, rounded up so a short Start_ms still needs one
+  uint64_t Frame_us = (uint64_t)Frame_Samples * 1000000 / Sample_Rate;
+  Vad->Start_Frames =
+      (uint32_t)(((uint64_t)Config->Start_ms * 1000 + Frame_us - 1) /
+                 Frame_us);
+  if (Vad->Start_Frames == 0) {
+    Vad->Start_Frames = 1;
+  } else if (Vad->Start_Frames > AUDIO_VAD_MAX_ONSET_FRAMES) {
+    Vad->Start_Frames = AUDIO_VAD_MAX_ONSET_FRAMES;
+  }
+  Vad->Hangover_Frames =
+      (uint32_t)(((uint64_t)Config->Hangover_ms * 1000 + Frame_us - 1) /
+                 Frame_us);
+  return 0;
+}
+
+void Audio_Vad_Measure(const int16_t *Pcm, size_t Count,
+                       AudioVadMeasure *Measure) {
+  memset(Measure, 0, sizeof(*Measure));
+  if (Count == 0) {
+    return;
+  }
+  uint64_t Sum = 0;
+  uint32_t Crossings = 0;
+  for (size_t i = 0; i < Count; i++) {
+    Sum += (uint64_t)((int32_t)Pcm[i] * Pcm[i]);
+    if (i > 0) {
+      Crossings += (Pcm[i] < 0) != (Pcm[i - 1] < 0);
+    }
+  }
+  Measure->Mean_Square = (uint32_t)(Sum / Count);
+  Measure->Crossings = (uint32_t)((uint64_t)Crossings * 1000 / Count);
+}
+
+size_t Audio_Vad_Push(AudioVad *Vad, AudioFrame *Frame, AudioFrame **Out,
+                      uint32_t *Events) {
+  size_t Passed = 0;
+  *Events = 0;
+  Vad->Counters.Frames_In++;
+  bool Speech = Audio_Vad_Is_Speech(Vad, Frame);
+
+  switch (Vad->State) {
+  case AUDIO_VAD_SILENCE:
+  case AUDIO_VAD_ONSET:
+    if (!Speech) {
+      // a click or a cough too short to be speech
+      Audio_Vad_Drop_Onset(Vad);
+      Audio_Vad_Drop(Vad, Frame);
+      Vad->State = AUDIO_VAD_SILENCE;
+      break;
+    }
+    Vad->Onset[Vad->Onset_Count++] = Frame;
+    if (Vad->Onset_Count < Vad->Start_Frames) {
+      Vad->State = AUDIO_VAD_ONSET;
+      break;
+    }
+    memcpy(Out, Vad->Onset, Vad->Onset_Count * sizeof(AudioFrame *));
+    Passed = Vad->Onset_Count;
+    Vad->Onset_Count = 0;
+    Vad->State = AUDIO_VAD_SPEECH;
+    Vad->Quiet_Run = 0;
+    Vad->Counters.Segments++;
+    *Events |= AUDIO_VAD_EVENT_START;
+    break;
+  case AUDIO_VAD_SPEECH:
+    if (Speech) {
+      Vad->Quiet_Run = 0;
+    } else if (++Vad->Quiet_Run > Vad->Hangover_Frames) {
+      Audio_Vad_Drop(Vad, Frame);
+      Vad->State = AUDIO_VAD_SILENCE;
+      *Events |= AUDIO_VAD_EVENT_END;
+      break;
+    }
+    Out[Passed++] = Frame;
+    break;
+  }
+  Vad->Counters.Frames_Passed += (uint32_t)Passed;
+  return Passed;
+}
+
+bool Audio_Vad_Finish(AudioVad *Vad) {
+  bool Was_Speech = Vad->State == AUDIO_VAD_SPEECH;
+  Audio_Vad_Drop_Onset(Vad);
+  Vad->State = AUDIO_VAD_SILENCE;
+  Vad->Quiet_Run = 0;
+  return Was_Speech;
+}
+
+void Audio_Vad_Get_Counters(AudioVad *Vad, AudioVadCounters *Counters) {
+  *Counters = Vad->Counters;
+}
+
+// once speech has started the lower Stop_Rms is enough to carry it
+static bool Audio_Vad_Is_Speech(const AudioVad *Vad, AudioFrame *Frame) {
+  AudioVadMeasure Measure;
+  Audio_Vad_Measure(Audio_Frame_Pcm16(Frame), Frame->Sample_Count, &Measure);
+  uint32_t Rms = Vad->State == AUDIO_VAD_SPEECH ? Vad->Config.Stop_Rms
+                                                 : Vad->Config.Start_Rms;
+  if (Measure.Mean_Square >= Rms * Rms) {
+    return true;
+  }
+  uint32_t Hiss = Vad->Config.Hiss_Rms;
+  return Measure.Mean_Square >= Hiss * Hiss &&
+         Measure.Crossings >= Vad->Config.Hiss_Crossings;
+}
+
+static void Audio_Vad_Drop(AudioVad *Vad, AudioFrame *Frame) {
+  Pool_Free(Frame, Vad->Pool);
+  Vad->Counters.Frames_Dropped++;
+}
+
+static void Audio_Vad_Drop_Onset(AudioVad *Vad) {
+  for (size_t i = 0; i < Vad->Onset_Count; i++) {
+    Audio_Vad_Drop(Vad, Vad->Onset[i]);
+  }
+  Vad->Onset_Count = 0;
+}
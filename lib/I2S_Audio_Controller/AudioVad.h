@@ -0,0 +1,95 @@
+/*
+    Description: voice activity detection between capture and the encoder.
+    each 16-bit pcm frame is measured for energy and zero crossings, a
+    loud frame or a quieter one that crosses zero often (the hiss of an s
+    or f) counts as speech. speech starts after Start_ms of speech frames
+    in a row, the frames it took to decide are handed on too so the first
+    syllable isn't clipped, and it ends after Hangover_ms without any.
+    frames outside speech go straight back to the pool, only the ones the
+    uploader needs are passed on
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef AUDIO_VAD_H
+#define AUDIO_VAD_H
+
+#include "AudioCapture.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// most frames held back while deciding if a sound is speech
+#define AUDIO_VAD_MAX_ONSET_FRAMES 8
+// most frames one Audio_Vad_Push can hand back
+#define AUDIO_VAD_MAX_OUT (AUDIO_VAD_MAX_ONSET_FRAMES + 1)
+
+typedef struct {
+  uint16_t Start_Rms;      // a frame at least this loud is speech
+  uint16_t Stop_Rms;       // enough once speech started, up to Start_Rms
+  uint16_t Hiss_Rms;       // a quieter frame is speech if it is this loud
+  uint16_t Hiss_Crossings; // and crosses zero this often per 1000 samples
+  uint16_t Start_ms;       // speech frames in a row before speech starts
+  uint16_t Hangover_ms;    // quiet kept after speech before it ends
+} AudioVadConfig;
+
+// starting points at the AUDIO_CONVERT_SPH0645 gain, tune them against what
+// Audio_Vad_Measure reads from the room the device lives in
+#define AUDIO_VAD_CONFIG_DEFAULT                                               \
+  {                                                                            \
+    .Start_Rms = 600, .Stop_Rms = 300, .Hiss_Rms = 150,                        \
+    .Hiss_Crossings = 300, .Start_ms = 60, .Hangover_ms = 400,                 \
+  }
+
+typedef enum {
+  AUDIO_VAD_SILENCE = 0,
+  AUDIO_VAD_ONSET,  // speech frames seen, not yet enough of them
+  AUDIO_VAD_SPEECH,
+} AudioVadState;
+
+// what a push changed, or'd together
+#define AUDIO_VAD_EVENT_START 0x1
+#define AUDIO_VAD_EVENT_END 0x2
+
+typedef struct {
+  uint32_t Mean_Square; // of the samples, compared against the rms squared
+  uint32_t Crossings;   // sign changes per 1000 samples
+} AudioVadMeasure;
+
+typedef struct {
+  uint32_t Frames_In;
+  uint32_t Frames_Passed;
+  uint32_t Frames_Dropped; // silence and onsets that didn't become speech
+  uint32_t Segments;       // times speech started
+} AudioVadCounters;
+
+typedef struct {
+  PoolMemoryInfo *Pool; // dropped frames go back here
+  AudioVadConfig Config;
+  uint32_t Start_Frames;
+  uint32_t Hangover_Frames;
+  AudioVadState State;
+  uint32_t Quiet_Run; // quiet frames since the last speech frame
+  size_t Onset_Count;
+  AudioFrame *Onset[AUDIO_VAD_MAX_ONSET_FRAMES];
+  AudioVadCounters Counters;
+} AudioVad;
+
+// the frame length sets how many frames Start_ms and Hangover_ms are,
+// Start_ms is capped at AUDIO_VAD_MAX_ONSET_FRAMES frames. -1 if the
+// frame length is 0 or Stop_Rms is above Start_Rms
+int Audio_Vad_Ini(AudioVad *Vad, const AudioVadConfig *Config,
+                  PoolMemoryInfo *Pool, uint32_t Sample_Rate,
+                  size_t Frame_Samples);
+void Audio_Vad_Measure(const int16_t *Pcm, size_t Count,
+                       AudioVadMeasure *Measure);
+// takes an AUDIO_FORMAT_PCM16 frame. the frames to pass on, oldest first,
+// are put in Out (AUDIO_VAD_MAX_OUT of them at most) and are the caller's.
+// returns how many, Events gets the AUDIO_VAD_EVENT_ bits
+size_t Audio_Vad_Push(AudioVad *Vad, AudioFrame *Frame, AudioFrame **Out,
+                      uint32_t *Events);
+// the recording stopped. an onset still held is dropped, returns true if
+// speech was going on
+bool Audio_Vad_Finish(AudioVad *Vad);
+void Audio_Vad_Get_Counters(AudioVad *Vad, AudioVadCounters *Counters);
+
+#endif // AUDIO_VAD_H
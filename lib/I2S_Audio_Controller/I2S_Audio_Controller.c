@@ -0,0 +1,292 @@
+/*
+    Description: the i2s rx task behind I2S_Audio_Controller.h. the channel
+    is set up with one dma buffer per frame so every read returns as soon as
+    the dma has filled one, and the read copies it straight into the pool
+    frame the consumer will get. dma buffers the driver had to drop because
+    the task was late are counted from its overflow interrupt. the task
+    converts each frame to pcm in place before it commits it, so the
+    conversion runs on the capture core and not the consumer's. armed, the
+    task fills the pre-roll instead and converts nothing until the start
+    hands the frames held to the ring
+    Creator: Matthew Ayestaran
+*/
+#ifdef ESP_PLATFORM
+
+#include "I2S_Audio_Controller.h"
+#include "driver/i2s_std.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "I2S_Audio";
+
+#define I2S_AUDIO_TASK_STACK 3072
+// a read that takes longer than this many frames means the clock stopped
+#define I2S_AUDIO_READ_TIMEOUT_FRAMES 4
+
+typedef struct {
+  I2SAudioConfig Config;
+  AudioCapture Capture;
+  i2s_chan_handle_t Rx;
+  TaskHandle_t Task;
+  SemaphoreHandle_t Frame_Ready; // given on every committed frame
+  SemaphoreHandle_t Stopped;     // given when the task leaves its loop
+  AudioPreroll Preroll;
+  volatile bool Running;
+  volatile bool Recording; // false while armed, frames go to the pre-roll
+  volatile uint32_t Dma_Overruns;
+  int32_t *Scratch; // drains the dma when the pool is out of frames
+} I2SAudioState;
+
+static I2SAudioState Audio;
+
+// PROTOTYPES
+esp_err_t I2S_Audio_Ini(const I2SAudioConfig *Config);
+esp_err_t I2S_Audio_Arm(void);
+esp_err_t I2S_Audio_Start(void);
+esp_err_t I2S_Audio_Stop(void);
+void I2S_Audio_Deinit(void);
+AudioFrame *I2S_Audio_Take_Frame(TickType_t Timeout);
+void I2S_Audio_Release_Frame(AudioFrame *Frame);
+void I2S_Audio_Get_Counters(AudioCaptureCounters *Counters);
+void I2S_Audio_Get_Preroll_Counters(AudioPrerollCounters *Counters);
+static esp_err_t I2S_Audio_Run(bool Recording);
+static void I2S_Audio_Task(void *Argument);
+static bool IRAM_ATTR I2S_Audio_On_Overflow(i2s_chan_handle_t Handle,
+                                            i2s_event_data_t *Event,
+                                            void *Context);
+
+esp_err_t I2S_Audio_Ini(const I2SAudioConfig *Config) {
+  if (Audio.Rx != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&Audio, 0, sizeof(Audio));
+  Audio.Config = *Config;
+  if (Audio_Capture_Ini(&Audio.Capture, Config->Pool, Config->Frame_Samples,
+                        Config->Ring_Frames) != 0) {
+    ESP_LOGE(TAG, "Pool can't hold %u sample frames or bad ring size %u",
+             (unsigned)Config->Frame_Samples, (unsigned)Config->Ring_Frames);
+    return ESP_ERR_INVALID_ARG;
+  }
+  Audio.Frame_Ready = xSemaphoreCreateBinary();
+  Audio.Stopped = xSemaphoreCreateBinary();
+  Audio.Scratch = Pool_Alloc(Config->Frame_Samples * sizeof(int32_t),
+                             Config->Pool);
+  if (Audio.Frame_Ready == NULL || Audio.Stopped == NULL ||
+      Audio.Scratch == NULL) {
+    I2S_Audio_Deinit();
+    return ESP_ERR_NO_MEM;
+  }
+  if (Config->Preroll_ms > 0 &&
+      Audio_Preroll_Ini(&Audio.Preroll, &Audio.Capture,
+                        Audio_Preroll_Frames_For(Config->Sample_Rate,
+                                                 Config->Frame_Samples,
+                                                 Config->Preroll_ms)) != 0) {
+    ESP_LOGE(TAG, "No room for %u ms of pre-roll in the pool or ring",
+             (unsigned)Config->Preroll_ms);
+    I2S_Audio_Deinit();
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  i2s_chan_config_t Channel =
+      I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+  Channel.dma_desc_num = Config->Dma_Buffers;
+  Channel.dma_frame_num = Config->Frame_Samples;
+  esp_err_t Err = i2s_new_channel(&Channel, NULL, &Audio.Rx);
+  if (Err != ESP_OK) {
+    ESP_LOGE(TAG, "No i2s channel: %s", esp_err_to_name(Err));
+    I2S_Audio_Deinit();
+    return Err;
+  }
+  // the SPH0645 sends 18 bits left justified in a 32-bit philips slot, on
+  // the left channel with SEL tied low
+  i2s_std_config_t Standard = {
+      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(Config->Sample_Rate),
+      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
+                                                      I2S_SLOT_MODE_MONO),
+      .gpio_cfg =
+          {
+              .mclk = I2S_GPIO_UNUSED,
+              .bclk = Config->Bclk_Pin,
+              .ws = Config->Ws_Pin,
+              .dout = I2S_GPIO_UNUSED,
+              .din = Config->Din_Pin,
+          },
+  };
+  Standard.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+  const i2s_event_callbacks_t Callbacks = {
+      .on_recv_q_ovf = I2S_Audio_On_Overflow,
+  };
+  Err = i2s_channel_init_std_mode(Audio.Rx, &Standard);
+  if (Err == ESP_OK) {
+    Err = i2s_channel_register_event_callback(Audio.Rx, &Callbacks, NULL);
+  }
+  if (Err != ESP_OK) {
+    ESP_LOGE(TAG, "i2s setup failed: %s", esp_err_to_name(Err));
+    I2S_Audio_Deinit();
+  }
+  return Err;
+}
+
+esp_err_t I2S_Audio_Arm(void) {
+  if (Audio.Preroll.Frames == 0 || Audio.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Audio_Preroll_Discard(&Audio.Preroll); // left from an arm before the stop
+  return I2S_Audio_Run(false);
+}
+
+esp_err_t I2S_Audio_Start(void) {
+  if (Audio.Running && !Audio.Recording) {
+    // the task releases the pre-roll at the top of its next frame
+    Audio.Recording = true;
+    return ESP_OK;
+  }
+  if (Audio.Rx == NULL || Audio.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Audio.Capture.Sequence = 0;
+  return I2S_Audio_Run(true);
+}
+
+static esp_err_t I2S_Audio_Run(bool Recording) {
+  esp_err_t Err = i2s_channel_enable(Audio.Rx);
+  if (Err != ESP_OK) {
+    return Err;
+  }
+  Audio.Recording = Recording;
+  Audio.Running = true;
+  if (xTaskCreatePinnedToCore(I2S_Audio_Task, "i2s_audio",
+                              I2S_AUDIO_TASK_STACK, NULL,
+                              Audio.Config.Task_Priority, &Audio.Task,
+                              Audio.Config.Task_Core) != pdPASS) {
+    Audio.Running = false;
+    i2s_channel_disable(Audio.Rx);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t I2S_Audio_Stop(void) {
+  if (!Audio.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Audio.Running = false;
+  xSemaphoreTake(Audio.Stopped, portMAX_DELAY);
+  Audio.Task = NULL;
+  return i2s_channel_disable(Audio.Rx);
+}
+
+void I2S_Audio_Deinit(void) {
+  if (Audio.Running) {
+    I2S_Audio_Stop();
+  }
+  if (Audio.Rx != NULL) {
+    i2s_del_channel(Audio.Rx);
+  }
+  if (Audio.Capture.Pool != NULL) {
+    Audio_Preroll_Flush(&Audio.Preroll);
+    Audio_Capture_Flush(&Audio.Capture);
+    if (Audio.Scratch != NULL) {
+      Pool_Free(Audio.Scratch, Audio.Capture.Pool);
+    }
+  }
+  if (Audio.Frame_Ready != NULL) {
+    vSemaphoreDelete(Audio.Frame_Ready);
+  }
+  if (Audio.Stopped != NULL) {
+    vSemaphoreDelete(Audio.Stopped);
+  }
+  memset(&Audio, 0, sizeof(Audio));
+}
+
+AudioFrame *I2S_Audio_Take_Frame(TickType_t Timeout) {
+  AudioFrame *Frame;
+  while ((Frame = Audio_Capture_Frame_Take(&Audio.Capture)) == NULL) {
+    if (xSemaphoreTake(Audio.Frame_Ready, Timeout) != pdTRUE) {
+      return NULL;
+    }
+  }
+  return Frame;
+}
+
+void I2S_Audio_Release_Frame(AudioFrame *Frame) {
+  Audio_Capture_Frame_Release(&Audio.Capture, Frame);
+}
+
+void I2S_Audio_Get_Counters(AudioCaptureCounters *Counters) {
+  Audio_Capture_Get_Counters(&Audio.Capture, Counters);
+  Counters->Dma_Overruns = Audio.Dma_Overruns;
+}
+
+void I2S_Audio_Get_Preroll_Counters(AudioPrerollCounters *Counters) {
+  Audio_Preroll_Get_Counters(&Audio.Preroll, Counters);
+}
+
+static void I2S_Audio_Task(void *Argument) {
+  const size_t Frame_Bytes = Audio.Config.Frame_Samples * sizeof(int32_t);
+  const TickType_t Timeout = pdMS_TO_TICKS(
+      1000 * I2S_AUDIO_READ_TIMEOUT_FRAMES * Audio.Config.Frame_Samples /
+          Audio.Config.Sample_Rate +
+      1);
+  bool Holding = !Audio.Recording;
+  while (Audio.Running) {
+    if (Holding && Audio.Recording) {
+      Holding = false;
+      if (Audio_Preroll_Release(&Audio.Preroll, Audio.Config.Keep_Slots
+                                                    ? NULL
+                                                    : &Audio.Config.Convert) >
+          0) {
+        xSemaphoreGive(Audio.Frame_Ready);
+      }
+    }
+    AudioFrame *Frame = Holding ? Audio_Preroll_Frame_Get(&Audio.Preroll)
+                                : Audio_Capture_Frame_Get(&Audio.Capture);
+    size_t Bytes = 0;
+    if (Frame == NULL) {
+      // keep the dma drained so the frames after this one are on time
+      i2s_channel_read(Audio.Rx, Audio.Scratch, Frame_Bytes, &Bytes, Timeout);
+      continue;
+    }
+    esp_err_t Err =
+        i2s_channel_read(Audio.Rx, Frame->Data, Frame_Bytes, &Bytes, Timeout);
+    if (Err != ESP_OK || Bytes == 0) {
+      if (Holding) {
+        Audio_Preroll_Frame_Abort(&Audio.Preroll, Frame);
+      } else {
+        Audio_Capture_Frame_Abort(&Audio.Capture, Frame);
+      }
+      ESP_LOGW(TAG, "i2s read failed: %s", esp_err_to_name(Err));
+      continue;
+    }
+    const size_t Samples = Bytes / sizeof(int32_t);
+    if (Holding) {
+      Audio_Preroll_Frame_Commit(&Audio.Preroll, Frame, Samples,
+                                 esp_timer_get_time());
+      continue;
+    }
+    if (!Audio.Config.Keep_Slots) {
+      Audio_Convert(Frame->Data, Audio_Frame_Pcm16(Frame), Samples,
+                    &Audio.Config.Convert);
+      Frame->Format = AUDIO_FORMAT_PCM16;
+    }
+    if (Audio_Capture_Frame_Commit(&Audio.Capture, Frame, Samples,
+                                   esp_timer_get_time())) {
+      xSemaphoreGive(Audio.Frame_Ready);
+    }
+  }
+  xSemaphoreGive(Audio.Stopped);
+  vTaskDelete(NULL);
+}
+
+static bool IRAM_ATTR I2S_Audio_On_Overflow(i2s_chan_handle_t Handle,
+                                            i2s_event_data_t *Event,
+                                            void *Context) {
+  Audio.Dma_Overruns++;
+  return false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+    Description: SPH0645 microphone capture over i2s. a task reads the rx
+    channel one dma buffer at a time straight into frames from the
+    MemoryPool and commits them to the AudioCapture ring, the consumer
+    takes them out on its own task without any copy. everything but the
+    driver lives in AudioCapture so it can be tested on the host. frames
+    are converted to 16-bit pcm in their own block before the hand-off
+    unless Keep_Slots is set. I2S_Audio_Arm runs the mic ahead of the
+    button into an AudioPreroll, so a recording started with I2S_Audio_Start
+    opens with the Preroll_ms said before the press
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef I2S_AUDIO_CONTROLLER_H
+#define I2S_AUDIO_CONTROLLER_H
+
+#include "AudioCapture.h"
+#include "AudioConvert.h"
+#include "AudioPreroll.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  int Bclk_Pin;
+  int Ws_Pin;          // LRCL on the SPH0645 board
+  int Din_Pin;         // DOUT on the SPH0645 board
+  uint32_t Sample_Rate;
+  size_t Frame_Samples; // samples per frame and per dma buffer
+  size_t Dma_Buffers;   // how long the task can be late before the driver drops
+  size_t Ring_Frames;   // power of two, up to AUDIO_RING_MAX_FRAMES
+  // needs a class of sizeof(AudioFrame) + 4 per sample with a block for each
+  // ring slot, the pre-roll's frames and one more, and one for the task
+  PoolMemoryInfo *Pool;
+  UBaseType_t Task_Priority;
+  BaseType_t Task_Core;
+  AudioConvertParams Convert;
+  bool Keep_Slots; // hand over the raw AUDIO_FORMAT_I2S32 slots instead
+  uint32_t Preroll_ms; // audio kept from before a start, 0 for none
+} I2SAudioConfig;
+
+// 20 ms frames at 16 kHz on the pins main.c wires the mic to, 300 ms of
+// pre-roll is 15 of them. Pool has to be set before it is used
+#define I2S_AUDIO_CONFIG_DEFAULT                                               \
+  {                                                                            \
+    .Bclk_Pin = 6, .Ws_Pin = 5, .Din_Pin = 7, .Sample_Rate = 16000,            \
+    .Frame_Samples = 320, .Dma_Buffers = 4, .Ring_Frames = 32, .Pool = NULL,   \
+    .Task_Priority = configMAX_PRIORITIES - 2, .Task_Core = 0,                 \
+    .Convert = AUDIO_CONVERT_SPH0645, .Keep_Slots = false,                     \
+    .Preroll_ms = 300,                                                         \
+  }
+
+// The PUBLIC functions that users can call
+esp_err_t I2S_Audio_Ini(const I2SAudioConfig *Config);
+// the mic runs into the pre-roll and nothing reaches the consumer until
+// I2S_Audio_Start. frames stay raw slots and the pool isn't touched while
+// it waits. ESP_ERR_INVALID_STATE without Preroll_ms or when running
+esp_err_t I2S_Audio_Arm(void);
+// the sequence starts again from 0 on every start. when armed the frames
+// held go to the consumer first, frame 0 is the oldest of them
+esp_err_t I2S_Audio_Start(void);
+// waits for the capture task to finish its frame, frames already in the ring
+// stay there for the consumer
+esp_err_t I2S_Audio_Stop(void);
+void I2S_Audio_Deinit(void);
+// consumer side, one task only. the next frame, waiting up to Timeout for
+// one. NULL on timeout
+AudioFrame *I2S_Audio_Take_Frame(TickType_t Timeout);
+void I2S_Audio_Release_Frame(AudioFrame *Frame);
+void I2S_Audio_Get_Counters(AudioCaptureCounters *Counters);
+void I2S_Audio_Get_Preroll_Counters(AudioPrerollCounters *Counters);
+#endif
+
+#endif // I2S_AUDIO_CONTROLLER_H
@@ -0,0 +1,221 @@
+/*
+    Description: the i2s tx task behind I2S_Audio_Speaker.h. the channel
+    has one dma buffer per frame, so each write returns once the dma has
+    taken the frame before and the task reads the ring one frame ahead of
+    the speaker. the writer waits on Room, given after every frame the
+    task took from the ring, instead of polling it
+    Creator: Matthew Ayestaran
+*/
+#ifdef ESP_PLATFORM
+
+#include "I2S_Audio_Speaker.h"
+#include "driver/i2s_std.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "I2S_Speaker";
+
+#define I2S_SPEAKER_TASK_STACK 3072
+
+typedef struct {
+  I2SSpeakerConfig Config;
+  AudioPlayback Playback;
+  i2s_chan_handle_t Tx;
+  TaskHandle_t Task;
+  SemaphoreHandle_t Room;    // given on every frame taken from the ring
+  SemaphoreHandle_t Stopped; // given when the task leaves its loop
+  volatile bool Running;
+  volatile bool Drop;
+  int16_t *Ring;
+  int16_t *Frame;
+} I2SSpeakerState;
+
+static I2SSpeakerState Speaker;
+
+// PROTOTYPES
+esp_err_t I2S_Speaker_Ini(const I2SSpeakerConfig *Config);
+esp_err_t I2S_Speaker_Start(void);
+esp_err_t I2S_Speaker_Stop(void);
+void I2S_Speaker_Deinit(void);
+size_t I2S_Speaker_Write(const int16_t *Samples, size_t Count,
+                         TickType_t Timeout);
+void I2S_Speaker_Mark_End(void);
+bool I2S_Speaker_Wait_Idle(TickType_t Timeout);
+void I2S_Speaker_Drop(void);
+void I2S_Speaker_Get_Counters(AudioPlaybackCounters *Counters);
+static void I2S_Speaker_Task(void *Argument);
+
+esp_err_t I2S_Speaker_Ini(const I2SSpeakerConfig *Config) {
+  if (Speaker.Tx != NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&Speaker, 0, sizeof(Speaker));
+  Speaker.Config = *Config;
+  if (Config->Pool == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  Speaker.Ring = Pool_Alloc(Config->Ring_Samples * sizeof(int16_t),
+                            Config->Pool);
+  Speaker.Frame = Pool_Alloc(Config->Frame_Samples * sizeof(int16_t),
+                             Config->Pool);
+  Speaker.Room = xSemaphoreCreateBinary();
+  Speaker.Stopped = xSemaphoreCreateBinary();
+  if (Speaker.Ring == NULL || Speaker.Frame == NULL || Speaker.Room == NULL ||
+      Speaker.Stopped == NULL) {
+    I2S_Speaker_Deinit();
+    return ESP_ERR_NO_MEM;
+  }
+  if (Audio_Playback_Ini(&Speaker.Playback, Speaker.Ring, Config->Ring_Samples,
+                         (size_t)Config->Sample_Rate * Config->Start_ms /
+                             1000) != 0) {
+    ESP_LOGE(TAG, "Ring of %u samples isn't a power of two above %u ms",
+             (unsigned)Config->Ring_Samples, (unsigned)Config->Start_ms);
+    I2S_Speaker_Deinit();
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  i2s_chan_config_t Channel =
+      I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+  Channel.dma_desc_num = Config->Dma_Buffers;
+  Channel.dma_frame_num = Config->Frame_Samples;
+  Channel.auto_clear = true; // silence, not the last buffer again, if late
+  esp_err_t Err = i2s_new_channel(&Channel, &Speaker.Tx, NULL);
+  if (Err != ESP_OK) {
+    ESP_LOGE(TAG, "No i2s channel: %s", esp_err_to_name(Err));
+    I2S_Speaker_Deinit();
+    return Err;
+  }
+  // the MAX98357A plays (left + right) / 2 with SD floating, mono 16-bit
+  // philips puts the sample in both slots
+  i2s_std_config_t Standard = {
+      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(Config->Sample_Rate),
+      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT,
+                                                      I2S_SLOT_MODE_MONO),
+      .gpio_cfg =
+          {
+              .mclk = I2S_GPIO_UNUSED,
+              .bclk = Config->Bclk_Pin,
+              .ws = Config->Ws_Pin,
+              .dout = Config->Dout_Pin,
+              .din = I2S_GPIO_UNUSED,
+          },
+  };
+  Err = i2s_channel_init_std_mode(Speaker.Tx, &Standard);
+  if (Err != ESP_OK) {
+    ESP_LOGE(TAG, "i2s setup failed: %s", esp_err_to_name(Err));
+    I2S_Speaker_Deinit();
+  }
+  return Err;
+}
+
+esp_err_t I2S_Speaker_Start(void) {
+  if (Speaker.Tx == NULL || Speaker.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  esp_err_t Err = i2s_channel_enable(Speaker.Tx);
+  if (Err != ESP_OK) {
+    return Err;
+  }
+  Speaker.Running = true;
+  if (xTaskCreatePinnedToCore(I2S_Speaker_Task, "i2s_speaker",
+                              I2S_SPEAKER_TASK_STACK, NULL,
+                              Speaker.Config.Task_Priority, &Speaker.Task,
+                              Speaker.Config.Task_Core) != pdPASS) {
+    Speaker.Running = false;
+    i2s_channel_disable(Speaker.Tx);
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t I2S_Speaker_Stop(void) {
+  if (!Speaker.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Speaker.Running = false;
+  xSemaphoreTake(Speaker.Stopped, portMAX_DELAY);
+  Speaker.Task = NULL;
+  return i2s_channel_disable(Speaker.Tx);
+}
+
+void I2S_Speaker_Deinit(void) {
+  if (Speaker.Running) {
+    I2S_Speaker_Stop();
+  }
+  if (Speaker.Tx != NULL) {
+    i2s_del_channel(Speaker.Tx);
+  }
+  if (Speaker.Ring != NULL) {
+    Pool_Free(Speaker.Ring, Speaker.Config.Pool);
+  }
+  if (Speaker.Frame != NULL) {
+    Pool_Free(Speaker.Frame, Speaker.Config.Pool);
+  }
+  if (Speaker.Room != NULL) {
+    vSemaphoreDelete(Speaker.Room);
+  }
+  if (Speaker.Stopped != NULL) {
+    vSemaphoreDelete(Speaker.Stopped);
+  }
+  memset(&Speaker, 0, sizeof(Speaker));
+}
+
+size_t I2S_Speaker_Write(const int16_t *Samples, size_t Count,
+                         TickType_t Timeout) {
+  size_t Done = Audio_Playback_Write(&Speaker.Playback, Samples, Count);
+  while (Done < Count && Speaker.Running &&
+         xSemaphoreTake(Speaker.Room, Timeout) == pdTRUE) {
+    Done += Audio_Playback_Write(&Speaker.Playback, Samples + Done,
+                                 Count - Done);
+  }
+  return Done;
+}
+
+void I2S_Speaker_Mark_End(void) { Audio_Playback_Mark_End(&Speaker.Playback); }
+
+// the ring is checked once a frame, as often as it can change
+bool I2S_Speaker_Wait_Idle(TickType_t Timeout) {
+  const TickType_t Frame_Ticks = pdMS_TO_TICKS(
+      1000 * Speaker.Config.Frame_Samples / Speaker.Config.Sample_Rate + 1);
+  TickType_t Waited = 0;
+  while (!Audio_Playback_Idle(&Speaker.Playback)) {
+    if (!Speaker.Running || Waited >= Timeout) {
+      return false;
+    }
+    vTaskDelay(Frame_Ticks);
+    Waited += Frame_Ticks;
+  }
+  return true;
+}
+
+void I2S_Speaker_Drop(void) { Speaker.Drop = true; }
+
+void I2S_Speaker_Get_Counters(AudioPlaybackCounters *Counters) {
+  Audio_Playback_Get_Counters(&Speaker.Playback, Counters);
+}
+
+static void I2S_Speaker_Task(void *Argument) {
+  const size_t Frame_Bytes = Speaker.Config.Frame_Samples * sizeof(int16_t);
+  while (Speaker.Running) {
+    if (Speaker.Drop) {
+      Speaker.Drop = false;
+      Audio_Playback_Drop(&Speaker.Playback);
+    }
+    if (Audio_Playback_Read(&Speaker.Playback, Speaker.Frame,
+                            Speaker.Config.Frame_Samples) > 0) {
+      xSemaphoreGive(Speaker.Room);
+    }
+    size_t Bytes = 0;
+    esp_err_t Err = i2s_channel_write(Speaker.Tx, Speaker.Frame, Frame_Bytes,
+                                      &Bytes, portMAX_DELAY);
+    if (Err != ESP_OK) {
+      ESP_LOGW(TAG, "i2s write failed: %s", esp_err_to_name(Err));
+    }
+  }
+  xSemaphoreGive(Speaker.Stopped);
+  vTaskDelete(NULL);
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+    Description: speaker output over i2s (a MAX98357A or any 16-bit i2s
+    amp) fed from an AudioPlayback ring. the writer, usually the text to
+    speech client, puts pcm in as it downloads and a task on the tx channel
+    takes a dma buffer's worth at a time, silence when there is nothing,
+    so the first sentence plays while the next ones are still on the way.
+    everything but the driver lives in AudioPlayback so it can be tested
+    on the host
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef I2S_AUDIO_SPEAKER_H
+#define I2S_AUDIO_SPEAKER_H
+
+#include "AudioPlayback.h"
+#include "MemoryPool.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+  int Bclk_Pin;
+  int Ws_Pin;           // LRC on the MAX98357A board
+  int Dout_Pin;         // DIN on the MAX98357A board
+  uint32_t Sample_Rate; // what the text to speech service sends
+  size_t Frame_Samples; // samples per dma buffer and per ring read
+  size_t Dma_Buffers;
+  size_t Ring_Samples;  // power of two
+  uint32_t Start_ms;    // buffered before playback starts
+  // needs a class of 2 bytes per ring sample and one of 2 per frame sample
+  PoolMemoryInfo *Pool;
+  UBaseType_t Task_Priority;
+  BaseType_t Task_Core;
+} I2SSpeakerConfig;
+
+// 24 kHz speech, 20 ms dma buffers, 1.3 s of ring and 100 ms buffered
+// before the first sample plays. Pool has to be set before it is used
+#define I2S_SPEAKER_CONFIG_DEFAULT                                             \
+  {                                                                            \
+    .Bclk_Pin = 15, .Ws_Pin = 16, .Dout_Pin = 17, .Sample_Rate = 24000,        \
+    .Frame_Samples = 480, .Dma_Buffers = 4, .Ring_Samples = 32768,             \
+    .Start_ms = 100, .Pool = NULL,                                             \
+    .Task_Priority = configMAX_PRIORITIES - 2, .Task_Core = 1,                 \
+  }
+
+// The PUBLIC functions that users can call
+esp_err_t I2S_Speaker_Ini(const I2SSpeakerConfig *Config);
+// the tx task runs from here on, silent until something is written
+esp_err_t I2S_Speaker_Start(void);
+esp_err_t I2S_Speaker_Stop(void);
+void I2S_Speaker_Deinit(void);
+// writer side, one task only. waits up to Timeout for room, returns the
+// samples that went in
+size_t I2S_Speaker_Write(const int16_t *Samples, size_t Count,
+                         TickType_t Timeout);
+// writer side, what was written plays out now, see Audio_Playback_Mark_End
+void I2S_Speaker_Mark_End(void);
+// any task. true once everything written has been played
+bool I2S_Speaker_Wait_Idle(TickType_t Timeout);
+// any task. what hasn't been played yet is dropped at the next dma buffer
+void I2S_Speaker_Drop(void);
+void I2S_Speaker_Get_Counters(AudioPlaybackCounters *Counters);
+#endif
+
+#endif // I2S_AUDIO_SPEAKER_H
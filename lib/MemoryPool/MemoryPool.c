@@ -1,80 +1,324 @@
-
 #include "MemoryPool.h"
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#define POOL_LOG(...) ESP_LOGI("MemoryPool", __VA_ARGS__)
+#define POOL_LOG_ERROR(...) ESP_LOGE("MemoryPool", __VA_ARGS__)
+#else
+#include <stdio.h>
+#define POOL_LOG(...) (printf(__VA_ARGS__), printf("\n"))
+#define POOL_LOG_ERROR(...)                                                    \
+  (fprintf(stderr, __VA_ARGS__), fprintf(stderr, "\n"))
+#endif
+
+// smallest alignment a block gets, the same guarantee malloc gives
+#define POOL_MIN_ALIGNMENT _Alignof(max_align_t)
+
+// largest alignment a class may ask for, a page is already generous
+#define POOL_MAX_ALIGNMENT 4096
 
-// block size declaration
-#define SMALL_BLOCK_SIZE 64
-#define MEDIUM_BLOCK_SIZE 512
-#define LARGE_BLOCK_SIZE 2048
+// lock around the shared free lists, compiled out of single task builds
+#ifdef POOL_THREAD_SAFE
+#ifdef ESP_PLATFORM
+#define POOL_LOCK_INI(Lock) portMUX_INITIALIZE(Lock)
+#define POOL_LOCK(Lock) portENTER_CRITICAL_SAFE(Lock)
+#define POOL_UNLOCK(Lock) portEXIT_CRITICAL_SAFE(Lock)
+#else
+#include <sched.h>
+#define POOL_LOCK_INI(Lock) atomic_flag_clear(Lock)
+#define POOL_LOCK(Lock)                                                        \
+  while (atomic_flag_test_and_set_explicit(Lock, memory_order_acquire))       \
+  sched_yield()
+#define POOL_UNLOCK(Lock) atomic_flag_clear_explicit(Lock, memory_order_release)
+#endif
+#else
+#define POOL_LOCK_INI(Lock)
+#define POOL_LOCK(Lock)
+#define POOL_UNLOCK(Lock)
+#endif
+
+// hardened checks as blocks cross the api, CHECK_IN is false when a free
+// has to be refused. NEXT follows a free list link, hardened builds cut the
+// list rather than follow a link that was written over after free
+#ifdef POOL_HARDENED
+#define POOL_CHECK_IN(handle, Class_Index, Packet)                             \
+  Internal_Pool_Check_In(handle, Class_Index, Packet)
+#define POOL_CHECK_OUT(handle, Class_Index, Block)                             \
+  Internal_Pool_Check_Out(handle, Class_Index, Block)
+#define POOL_NEXT(Pool_Info, Block) Internal_Pool_Next(Pool_Info, Block)
+#else
+#define POOL_CHECK_IN(handle, Class_Index, Packet) 1
+#define POOL_CHECK_OUT(handle, Class_Index, Block) ((void)0)
+#define POOL_NEXT(Pool_Info, Block) ((Block)->next)
+#endif
 
 // PROTOTYPES
 PoolMemoryInfo *Pool_Ini(size_t num_small_blocks, size_t num_medium_blocks,
                          size_t num_large_blocks);
+PoolMemoryInfo *Pool_Ini_Config(const PoolClassConfig *Classes,
+                                size_t Class_Count);
+PoolMemoryInfo *Pool_Ini_Config_Backing(const PoolClassConfig *Classes,
+                                        size_t Class_Count,
+                                        const PoolBackingAllocator *Backing);
 void Pool_Destroy(PoolMemoryInfo *handle);
 void *Pool_Alloc(size_t Memory_Size, PoolMemoryInfo *handle);
 void Pool_Free(void *Packet, PoolMemoryInfo *handle);
+void Pool_Cache_Ini(PoolTaskCache *cache, PoolMemoryInfo *handle);
+void *Pool_Cache_Alloc(size_t Memory_Size, PoolTaskCache *cache);
+void Pool_Cache_Free(void *Packet, PoolTaskCache *cache);
+void Pool_Cache_Flush(PoolTaskCache *cache);
+int Pool_Get_Stats(PoolMemoryInfo *handle, PoolStats *Stats);
+void Pool_Log_Stats(PoolMemoryInfo *handle, const char *Name);
+int Pool_Start_Stats_Log(PoolMemoryInfo *handle, const char *Name,
+                         uint32_t Period_ms);
+void Pool_Stop_Stats_Log(PoolMemoryInfo *handle);
 
 static void *Internal_Pool_Memory_Block_Ini(size_t Block_Number,
                                             size_t Block_Size,
                                             void *First_Memory_Block);
-static void *Internal_Pool_Allocation(PoolInfo *First_Memory_Block);
+static void *Internal_Pool_Allocation(PoolInfo *First_Memory_Block,
+                                      size_t Memory_Size);
+static void Internal_Pool_Release(PoolInfo *Pool_Info, void *Packet);
+static void Internal_Pool_Count_Out(PoolInfo *Pool_Info, size_t Blocks);
+static void Internal_Pool_Count_Oversize(PoolMemoryInfo *handle);
+static void Internal_Pool_Fold_Cache(PoolInfo *Pool_Info,
+                                     PoolMagazine *Magazine);
+static size_t Internal_Pool_Class_Index(const PoolMemoryInfo *handle,
+                                        size_t Memory_Size);
+static size_t Internal_Pool_Owner_Index(const PoolMemoryInfo *handle,
+                                        const PoolRegion *Region,
+                                        uintptr_t Address);
+static size_t Internal_Pool_Find_Owner(const PoolMemoryInfo *handle,
+                                       void *Packet);
+static size_t Internal_Pool_Refill(PoolInfo *Pool_Info,
+                                   PoolMagazine *Magazine, size_t Batch);
+static void Internal_Pool_Spill(PoolMemoryInfo *handle, size_t Class_Index,
+                                PoolMagazine *Magazine, size_t Keep);
+static size_t Internal_Pool_Round_Up(size_t Value, size_t Alignment);
+static int Internal_Pool_Sort_Config(const PoolClassConfig *Classes,
+                                     size_t Class_Count,
+                                     PoolClassConfig *Sorted);
+static void *Internal_Pool_Backing_Alloc(size_t Size, PoolCapability Capability,
+                                         void *Context);
+static void Internal_Pool_Backing_Free(void *Memory, PoolCapability Capability,
+                                       void *Context);
+#ifdef POOL_HARDENED
+static size_t Internal_Pool_Block_Index(const PoolInfo *Pool_Info,
+                                        const void *Address);
+static int Internal_Pool_Check_In(PoolMemoryInfo *handle, size_t Class_Index,
+                                  void *Packet);
+static void Internal_Pool_Check_Out(PoolMemoryInfo *handle,
+                                    size_t Class_Index, void *Block);
+static FreeBlock *Internal_Pool_Next(PoolInfo *Pool_Info, FreeBlock *Block);
+static void Internal_Pool_Report(uint64_t *Counter, const char *What,
+                                 void *Block);
+#endif
+
+// used when Pool_Ini_Config_Backing is given no allocator
+static const PoolBackingAllocator Pool_Default_Backing = {
+    Internal_Pool_Backing_Alloc, Internal_Pool_Backing_Free, NULL};
 
 // FUNCTIONS
+// the original three class pool, kept as a thin wrapper over the config api
 PoolMemoryInfo *Pool_Ini(size_t num_small_blocks, size_t num_medium_blocks,
                          size_t num_large_blocks) {
-  PoolMemoryInfo *Memory_Handler = malloc(sizeof(PoolMemoryInfo));
+  const PoolClassConfig Default_Classes[] = {
+      {POOL_DEFAULT_SMALL_BLOCK_SIZE, num_small_blocks, 0, POOL_CAP_ANY},
+      {POOL_DEFAULT_MEDIUM_BLOCK_SIZE, num_medium_blocks, 0, POOL_CAP_ANY},
+      {POOL_DEFAULT_LARGE_BLOCK_SIZE, num_large_blocks, 0, POOL_CAP_ANY},
+  };
+  return Pool_Ini_Config(Default_Classes,
+                         sizeof(Default_Classes) / sizeof(Default_Classes[0]));
+}
+
+PoolMemoryInfo *Pool_Ini_Config(const PoolClassConfig *Classes,
+                                size_t Class_Count) {
+  return Pool_Ini_Config_Backing(Classes, Class_Count, NULL);
+}
+
+PoolMemoryInfo *Pool_Ini_Config_Backing(const PoolClassConfig *Classes,
+                                        size_t Class_Count,
+                                        const PoolBackingAllocator *Backing) {
+  if (Classes == NULL || Class_Count == 0 || Class_Count > POOL_MAX_CLASSES) {
+    return NULL;
+  }
+  if (Backing == NULL) {
+    Backing = &Pool_Default_Backing;
+  } else if (Backing->Alloc == NULL || Backing->Free == NULL) {
+    return NULL;
+  }
+  PoolClassConfig Sorted[POOL_MAX_CLASSES];
+  if (!Internal_Pool_Sort_Config(Classes, Class_Count, Sorted)) {
+    return NULL; // bad alignment or capability, zero or repeated block size
+  }
+
+  // the handle is read on every alloc and free so keep it in internal ram
+  size_t Handle_Size = sizeof(PoolMemoryInfo) +
+                       Class_Count * (sizeof(PoolInfo) + sizeof(PoolRegion));
+#ifdef POOL_HARDENED
+  size_t Map_Words = 0;
+  for (size_t i = 0; i < Class_Count; i++) {
+    Map_Words += Sorted[i].Block_Count / 32 + 1;
+  }
+  Handle_Size += Map_Words * sizeof(uint32_t);
+#endif
+  PoolMemoryInfo *Memory_Handler =
+      Backing->Alloc(Handle_Size, POOL_CAP_INTERNAL, Backing->Context);
   if (Memory_Handler == NULL) {
     return NULL; // allocation failed
-    // free main memory allocation
   }
+  Memory_Handler->Class_Count = Class_Count;
+  Memory_Handler->Backing = *Backing;
+  Memory_Handler->Region =
+      (PoolRegion *)&Memory_Handler->Pool_Storage[Class_Count];
+  Memory_Handler->Region_Count = 0;
+  Memory_Handler->Total_Pool_Size = 0;
+  Memory_Handler->Oversize_Allocs = 0;
+  Memory_Handler->Stats_Timer = NULL;
+  Memory_Handler->Stats_Name = NULL;
+#ifdef POOL_HARDENED
+  Memory_Handler->Rejected_Frees = 0;
+  uint32_t *Alloc_Map = (uint32_t *)&Memory_Handler->Region[Class_Count];
+  memset(Alloc_Map, 0, Map_Words * sizeof(uint32_t));
+#endif
+  POOL_LOCK_INI(&Memory_Handler->Lock);
 
-  Memory_Handler->Total_Pool_Size = (num_small_blocks * SMALL_BLOCK_SIZE) +
-                                    (num_medium_blocks * MEDIUM_BLOCK_SIZE) +
-                                    (num_large_blocks * LARGE_BLOCK_SIZE);
-  Memory_Handler->Memory_Claim_Address =
-      malloc(Memory_Handler->Total_Pool_Size);
-  // check that malloc worked correctly
-  if (Memory_Handler->Memory_Claim_Address == NULL) {
-    free(Memory_Handler); // free memory of struct on exit
-    return NULL;
+  // work out the stride and offset of every pool from its region base. a
+  // new region starts whenever the capability changes, inside a region each
+  // pool starts where the previous one ends, padded up to its alignment, so
+  // the owner of a block can be worked out from its address alone
+  size_t Pool_Offset[POOL_MAX_CLASSES];
+  size_t Region_Alignment[POOL_MAX_CLASSES];
+  PoolRegion *Region = NULL;
+  for (size_t i = 0; i < Class_Count; i++) {
+    PoolInfo *Pool = &Memory_Handler->Pool_Storage[i];
+    size_t Alignment = Sorted[i].Alignment > POOL_MIN_ALIGNMENT
+                           ? Sorted[i].Alignment
+                           : POOL_MIN_ALIGNMENT;
+    size_t Block_Size = Sorted[i].Block_Size < sizeof(FreeBlock)
+                            ? sizeof(FreeBlock)
+                            : Sorted[i].Block_Size;
+    Pool->Request_Size = Sorted[i].Block_Size;
+    Pool->Block_Size = Internal_Pool_Round_Up(Block_Size, Alignment);
+    Pool->Total_Blocks = Sorted[i].Block_Count;
+    Pool->Pool_Start_Address = NULL;
+    Pool->Free_Block_Location = NULL;
+    Pool->Counters = (PoolCounters){0};
+#ifdef POOL_HARDENED
+    Pool->Alloc_Map = Alloc_Map;
+    Alloc_Map += Sorted[i].Block_Count / 32 + 1;
+#endif
+    // keep every pool well under SIZE_MAX so the running total can't wrap
+    if (Pool->Total_Blocks >
+        (SIZE_MAX / 2 / POOL_MAX_CLASSES) / Pool->Block_Size) {
+      Pool_Destroy(Memory_Handler);
+      return NULL;
+    }
+    if (Region == NULL || Region->Capability != Sorted[i].Capability) {
+      Region = &Memory_Handler->Region[Memory_Handler->Region_Count];
+      Region_Alignment[Memory_Handler->Region_Count] = POOL_MIN_ALIGNMENT;
+      Memory_Handler->Region_Count++;
+      Region->Memory_Claim_Address = NULL;
+      Region->Start = 0;
+      Region->Size = 0;
+      Region->First_Class = i;
+      Region->Capability = Sorted[i].Capability;
+    }
+    Region->Last_Class = i;
+    Pool_Offset[i] = Internal_Pool_Round_Up(Region->Size, Alignment);
+    Region->Size = Pool_Offset[i] + Pool->Total_Blocks * Pool->Block_Size;
+    if (Alignment > Region_Alignment[Memory_Handler->Region_Count - 1]) {
+      Region_Alignment[Memory_Handler->Region_Count - 1] = Alignment;
+    }
   }
 
-  // filling in the struct will all relevant information
-  Memory_Handler->Small_Pool_Storage.Total_Blocks = num_small_blocks;
-  Memory_Handler->Medium_Pool_Storage.Total_Blocks = num_medium_blocks;
-  Memory_Handler->Large_Pool_Storage.Total_Blocks = num_large_blocks;
-  // initial start position of each Pool
-  Memory_Handler->Small_Pool_Storage.Pool_Start_Address =
-      Memory_Handler->Memory_Claim_Address;
-  Memory_Handler->Medium_Pool_Storage.Pool_Start_Address =
-      (Memory_Handler->Memory_Claim_Address +
-       (num_small_blocks * SMALL_BLOCK_SIZE));
-  Memory_Handler->Large_Pool_Storage.Pool_Start_Address =
-      (Memory_Handler->Memory_Claim_Address +
-       (num_medium_blocks * MEDIUM_BLOCK_SIZE) +
-       (num_small_blocks * SMALL_BLOCK_SIZE));
-  // Allocate the pools and return the next free block as a location
-  Memory_Handler->Small_Pool_Storage.Free_Block_Location =
-      Internal_Pool_Memory_Block_Ini(
-          Memory_Handler->Small_Pool_Storage.Total_Blocks, SMALL_BLOCK_SIZE,
-          Memory_Handler->Small_Pool_Storage.Pool_Start_Address);
-  Memory_Handler->Medium_Pool_Storage.Free_Block_Location =
-      Internal_Pool_Memory_Block_Ini(
-          Memory_Handler->Medium_Pool_Storage.Total_Blocks, MEDIUM_BLOCK_SIZE,
-          Memory_Handler->Medium_Pool_Storage.Pool_Start_Address);
-  Memory_Handler->Large_Pool_Storage.Free_Block_Location =
-      Internal_Pool_Memory_Block_Ini(
-          Memory_Handler->Large_Pool_Storage.Total_Blocks, LARGE_BLOCK_SIZE,
-          Memory_Handler->Large_Pool_Storage.Pool_Start_Address);
+  for (size_t r = 0; r < Memory_Handler->Region_Count; r++) {
+    Region = &Memory_Handler->Region[r];
+    if (Region->Size == 0) {
+      continue; // every class in the run has no blocks, nothing to claim
+    }
+    // the backing only promises POOL_MIN_ALIGNMENT, claim a bit extra to
+    // line up the base when a class asks for more
+    Region->Memory_Claim_Address = Backing->Alloc(
+        Region->Size + Region_Alignment[r] - POOL_MIN_ALIGNMENT,
+        Region->Capability, Backing->Context);
+    // check that the claim worked correctly
+    if (Region->Memory_Claim_Address == NULL) {
+      Pool_Destroy(Memory_Handler); // hand back the regions claimed so far
+      return NULL;
+    }
+    Region->Start = Internal_Pool_Round_Up(
+        (uintptr_t)Region->Memory_Claim_Address, Region_Alignment[r]);
+    Memory_Handler->Total_Pool_Size += Region->Size;
+
+    for (size_t i = Region->First_Class; i <= Region->Last_Class; i++) {
+      PoolInfo *Pool = &Memory_Handler->Pool_Storage[i];
+      Pool->Pool_Start_Address = (uint8_t *)Region->Start + Pool_Offset[i];
+#ifdef POOL_HARDENED
+      // start poisoned so the first alloc of each block is checked too
+      memset(Pool->Pool_Start_Address, POOL_POISON_BYTE,
+             Pool->Total_Blocks * Pool->Block_Size);
+#endif
+      // Allocate the pool and return the next free block as a location
+      Pool->Free_Block_Location = Internal_Pool_Memory_Block_Ini(
+          Pool->Total_Blocks, Pool->Block_Size, Pool->Pool_Start_Address);
+    }
+  }
+
+  for (size_t i = 0; i < Class_Count; i++) {
+    PoolInfo *Pool = &Memory_Handler->Pool_Storage[i];
+    Memory_Handler->Class_Limit[i] = Pool->Request_Size;
+    Memory_Handler->Class_Start[i] = (uintptr_t)Pool->Pool_Start_Address;
+  }
 
   return Memory_Handler;
 }
 
+// copy the classes smallest first and check each one makes sense
+static int Internal_Pool_Sort_Config(const PoolClassConfig *Classes,
+                                     size_t Class_Count,
+                                     PoolClassConfig *Sorted) {
+  for (size_t i = 0; i < Class_Count; i++) {
+    size_t Alignment = Classes[i].Alignment;
+    // sizes this close to SIZE_MAX would wrap once rounded up to alignment
+    if (Classes[i].Block_Size == 0 || (Alignment & (Alignment - 1)) != 0 ||
+        Alignment > POOL_MAX_ALIGNMENT ||
+        Classes[i].Block_Size > SIZE_MAX / 2 - POOL_MAX_ALIGNMENT ||
+        (unsigned)Classes[i].Capability >= POOL_CAPABILITY_COUNT) {
+      return 0;
+    }
+    // insertion sort, there are never more than POOL_MAX_CLASSES
+    size_t j = i;
+    while (j > 0 && Sorted[j - 1].Block_Size > Classes[i].Block_Size) {
+      Sorted[j] = Sorted[j - 1];
+      j--;
+    }
+    Sorted[j] = Classes[i];
+  }
+  for (size_t i = 1; i < Class_Count; i++) {
+    if (Sorted[i].Block_Size == Sorted[i - 1].Block_Size) {
+      return 0; // the second class could never be picked
+    }
+  }
+  return 1;
+}
+
+static size_t Internal_Pool_Round_Up(size_t Value, size_t Alignment) {
+  return (Value + Alignment - 1) & ~(Alignment - 1);
+}
+
 // function for pool allocation and size
 static void *Internal_Pool_Memory_Block_Ini(size_t Block_Number,
                                             size_t Block_Size,
                                             void *First_Memory_Block) {
+  if (Block_Number == 0) {
+    return NULL; // nothing to hand out from an empty pool
+  }
   uint8_t *start_addr = (uint8_t *)First_Memory_Block;
   for (size_t i = 0; i < Block_Number; i++) {
     uint8_t *current_addr_raw = start_addr + (i * Block_Size);
@@ -93,41 +337,169 @@ static void *Internal_Pool_Memory_Block_Ini(size_t Block_Number,
 void Pool_Destroy(PoolMemoryInfo *handle) {
   if (handle == NULL)
     return;
-  free(handle->Memory_Claim_Address); // Free the main storage
-  free(handle);                       // Free the handle itself
+  Pool_Stop_Stats_Log(handle);
+  PoolBackingAllocator Backing = handle->Backing;
+  for (size_t r = 0; r < handle->Region_Count; r++) { // Free the main storage
+    if (handle->Region[r].Memory_Claim_Address != NULL) {
+      Backing.Free(handle->Region[r].Memory_Claim_Address,
+                   handle->Region[r].Capability, Backing.Context);
+    }
+  }
+  Backing.Free(handle, POOL_CAP_INTERNAL, Backing.Context); // and the handle
+}
+
+// default backing memory
+#ifdef ESP_PLATFORM
+static const uint32_t Pool_Capability_Flags[POOL_CAPABILITY_COUNT] = {
+    [POOL_CAP_ANY] = MALLOC_CAP_DEFAULT,
+    [POOL_CAP_INTERNAL] = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    [POOL_CAP_DMA] = MALLOC_CAP_DMA | MALLOC_CAP_8BIT,
+    [POOL_CAP_PSRAM] = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+};
+
+static void *Internal_Pool_Backing_Alloc(size_t Size, PoolCapability Capability,
+                                         void *Context) {
+  (void)Context;
+  return heap_caps_malloc(Size, Pool_Capability_Flags[Capability]);
+}
+
+static void Internal_Pool_Backing_Free(void *Memory, PoolCapability Capability,
+                                       void *Context) {
+  (void)Capability;
+  (void)Context;
+  heap_caps_free(Memory);
+}
+#else
+// host builds only have the one heap, every capability comes from malloc
+static void *Internal_Pool_Backing_Alloc(size_t Size, PoolCapability Capability,
+                                         void *Context) {
+  (void)Capability;
+  (void)Context;
+  return malloc(Size);
+}
+
+static void Internal_Pool_Backing_Free(void *Memory, PoolCapability Capability,
+                                       void *Context) {
+  (void)Capability;
+  (void)Context;
+  free(Memory);
 }
+#endif
 
-// Memory handler
-static void *Internal_Pool_Allocation(PoolInfo *First_Memory_Block) {
+// Memory handler, called with the lock held
+static void *Internal_Pool_Allocation(PoolInfo *First_Memory_Block,
+                                      size_t Memory_Size) {
   if (First_Memory_Block->Free_Block_Location == NULL) {
+    First_Memory_Block->Counters.Failed_Allocs++;
     return NULL; // Pool is empty, allocation fails
   }
+  Internal_Pool_Count_Out(First_Memory_Block, 1);
+  First_Memory_Block->Counters.Total_Allocs++;
+  First_Memory_Block->Counters.Bytes_Wasted +=
+      First_Memory_Block->Block_Size - Memory_Size;
   // get next free block from small pool storage location
   FreeBlock *block_to_return =
       (FreeBlock *)First_Memory_Block->Free_Block_Location;
   // read location stored in next block
-  void *new_head = (void *)block_to_return->next;
+  void *new_head = (void *)POOL_NEXT(First_Memory_Block, block_to_return);
   First_Memory_Block->Free_Block_Location = new_head;
   // correct next free block in linked list
   return (void *)block_to_return;
 }
 
+// size class for a request is the number of classes that are too small for
+// it. the loop body is a compare and an add so the only branch is the loop
+// itself, which runs the same count every call. Class_Count means nothing
+// is big enough
+static size_t Internal_Pool_Class_Index(const PoolMemoryInfo *handle,
+                                        size_t Memory_Size) {
+  size_t Class_Index = 0;
+  for (size_t i = 0; i < handle->Class_Count; i++) {
+    Class_Index += (Memory_Size > handle->Class_Limit[i]);
+  }
+  return Class_Index;
+}
+
+// owning class of an address already known to be inside a region. the
+// pools in a region are contiguous so it is the first class of the region
+// plus the number of its other pools starting at or below the address
+static size_t Internal_Pool_Owner_Index(const PoolMemoryInfo *handle,
+                                        const PoolRegion *Region,
+                                        uintptr_t Address) {
+  size_t Class_Index = Region->First_Class;
+  for (size_t i = Region->First_Class + 1; i <= Region->Last_Class; i++) {
+    Class_Index += (Address >= handle->Class_Start[i]);
+  }
+  return Class_Index;
+}
+
+// class a returned pointer belongs to, Class_Count if it isn't one of ours
+static size_t Internal_Pool_Find_Owner(const PoolMemoryInfo *handle,
+                                       void *Packet) {
+  // one unsigned compare covers both ends of a region, anything below the
+  // start wraps round to a huge offset. mostly there is only one region
+  uintptr_t Address = (uintptr_t)Packet;
+  for (size_t r = 0; r < handle->Region_Count; r++) {
+    const PoolRegion *Region = &handle->Region[r];
+    if (Address - Region->Start < Region->Size) {
+      return Internal_Pool_Owner_Index(handle, Region, Address);
+    }
+  }
+  return handle->Class_Count;
+}
+
+// push a block back on the front of a shared free list
+static void Internal_Pool_Release(PoolInfo *Pool_Info, void *Packet) {
+  FreeBlock *Return_Block_Free = (FreeBlock *)Packet;
+  Return_Block_Free->next = Pool_Info->Free_Block_Location;
+  Pool_Info->Free_Block_Location = Return_Block_Free;
+  if (Pool_Info->Counters.In_Use != 0) {
+    Pool_Info->Counters.In_Use--; // a double free can't wrap the count
+  }
+}
+
+// COUNTERS, all called with the lock held
+static void Internal_Pool_Count_Out(PoolInfo *Pool_Info, size_t Blocks) {
+  Pool_Info->Counters.In_Use += Blocks;
+  if (Pool_Info->Counters.In_Use > Pool_Info->Counters.High_Water) {
+    Pool_Info->Counters.High_Water = Pool_Info->Counters.In_Use;
+  }
+}
+
+static void Internal_Pool_Count_Oversize(PoolMemoryInfo *handle) {
+  POOL_LOCK(&handle->Lock);
+  handle->Oversize_Allocs++;
+  POOL_UNLOCK(&handle->Lock);
+}
+
+// add the hits a task cache has served since its last trip to the pool
+static void Internal_Pool_Fold_Cache(PoolInfo *Pool_Info,
+                                     PoolMagazine *Magazine) {
+  Pool_Info->Counters.Total_Allocs += Magazine->Allocs;
+  Pool_Info->Counters.Bytes_Wasted += Magazine->Bytes_Wasted;
+  Magazine->Allocs = 0;
+  Magazine->Bytes_Wasted = 0;
+}
+
 // function for pool allocation and size
 void *Pool_Alloc(size_t Memory_Size, PoolMemoryInfo *handle) {
   // Get the size that needs to be allocated
-  if (Memory_Size <= 0) {
+  if (handle == NULL || Memory_Size == 0) {
     return NULL;
   }
-  // need to update with the new pool freeblock location adress
-  if (Memory_Size <= SMALL_BLOCK_SIZE) {
-    return Internal_Pool_Allocation(&handle->Small_Pool_Storage);
-  } else if (Memory_Size <= MEDIUM_BLOCK_SIZE) {
-    return Internal_Pool_Allocation(&handle->Medium_Pool_Storage);
-  } else if (Memory_Size <= LARGE_BLOCK_SIZE) {
-    return Internal_Pool_Allocation(&handle->Large_Pool_Storage);
-  } else {
+  size_t Class_Index = Internal_Pool_Class_Index(handle, Memory_Size);
+  if (Class_Index >= handle->Class_Count) {
+    Internal_Pool_Count_Oversize(handle);
     return NULL; // Size too large
   }
+  PoolInfo *Pool_Info = &handle->Pool_Storage[Class_Index];
+  POOL_LOCK(&handle->Lock);
+  void *Block = Internal_Pool_Allocation(Pool_Info, Memory_Size);
+  POOL_UNLOCK(&handle->Lock);
+  if (Block != NULL) {
+    POOL_CHECK_OUT(handle, Class_Index, Block);
+  }
+  return Block;
 }
 
 // function for pool deallocation
@@ -135,49 +507,387 @@ void Pool_Free(void *Packet, PoolMemoryInfo *handle) {
   if (handle == NULL || Packet == NULL) {
     return;
   }
-  // compare the address range of the returned pointer to the start address of
-  // each pool cast for all the pointer arithmatic
-  uint8_t *pointer = (uint8_t *)Packet;
-  PoolInfo *SmallPoolInfo = &handle->Small_Pool_Storage;
-  uint8_t *Small_Pool_Start_Pointer =
-      handle->Small_Pool_Storage.Pool_Start_Address;
-  size_t Small_Pool_Size =
-      handle->Small_Pool_Storage.Total_Blocks * SMALL_BLOCK_SIZE;
-  // get the pointer as a value. range each value against each one
-  if (pointer >= Small_Pool_Start_Pointer &&
-      pointer < (Small_Pool_Start_Pointer + Small_Pool_Size)) {
-    FreeBlock *Return_Block_Free = (FreeBlock *)Packet;
-    Return_Block_Free->next = SmallPoolInfo->Free_Block_Location;
-    SmallPoolInfo->Free_Block_Location = Return_Block_Free;
+  size_t Class_Index = Internal_Pool_Find_Owner(handle, Packet);
+  if (!POOL_CHECK_IN(handle, Class_Index, Packet)) {
+    return; // hardened builds refuse bad frees here
+  }
+  if (Class_Index >= handle->Class_Count) {
+    return; // not one of ours, leave the free lists alone
+  }
+  POOL_LOCK(&handle->Lock);
+  Internal_Pool_Release(&handle->Pool_Storage[Class_Index], Packet);
+  POOL_UNLOCK(&handle->Lock);
+}
+
+// TASK CACHE
+void Pool_Cache_Ini(PoolTaskCache *cache, PoolMemoryInfo *handle) {
+  if (cache == NULL) {
     return;
   }
+  cache->Pool = handle;
+  for (size_t i = 0; i < POOL_MAX_CLASSES; i++) {
+    PoolMagazine *Magazine = &cache->Magazine[i];
+    Magazine->Head = NULL;
+    Magazine->Count = 0;
+    Magazine->Allocs = 0;
+    Magazine->Bytes_Wasted = 0;
+    // a cache keeps at most an eighth of a class, so a few large blocks
+    // can't all end up parked in one task while another runs dry
+    size_t Capacity = 0;
+    if (handle != NULL && i < handle->Class_Count) {
+      Capacity = handle->Pool_Storage[i].Total_Blocks / 8;
+    }
+    Magazine->Capacity =
+        Capacity > POOL_MAGAZINE_SIZE ? POOL_MAGAZINE_SIZE : Capacity;
+  }
+}
 
-  PoolInfo *Medium_Pool_Info = &handle->Medium_Pool_Storage;
-  size_t Medium_Pool_Size = Medium_Pool_Info->Total_Blocks * MEDIUM_BLOCK_SIZE;
-  uint8_t *Medium_Pool_Start_Pointer =
-      handle->Medium_Pool_Storage.Pool_Start_Address;
-  // go to return function providing the struct size that needs to be returned
-  if (pointer >= Medium_Pool_Start_Pointer &&
-      pointer < (Medium_Pool_Start_Pointer + Medium_Pool_Size)) {
-    FreeBlock *Return_Block_Free = (FreeBlock *)Packet;
-    Return_Block_Free->next = Medium_Pool_Info->Free_Block_Location;
-    Medium_Pool_Info->Free_Block_Location = Return_Block_Free;
+void *Pool_Cache_Alloc(size_t Memory_Size, PoolTaskCache *cache) {
+  if (cache == NULL || cache->Pool == NULL || Memory_Size == 0) {
+    return NULL;
+  }
+  PoolMemoryInfo *handle = cache->Pool;
+  size_t Class_Index = Internal_Pool_Class_Index(handle, Memory_Size);
+  if (Class_Index >= handle->Class_Count) {
+    Internal_Pool_Count_Oversize(handle);
+    return NULL; // Size too large
+  }
+  PoolInfo *Pool_Info = &handle->Pool_Storage[Class_Index];
+  PoolMagazine *Magazine = &cache->Magazine[Class_Index];
+  if (Magazine->Head == NULL) {
+    if (Magazine->Capacity == 0) {
+      // class too small to cache, go straight to the shared list
+      POOL_LOCK(&handle->Lock);
+      void *Block = Internal_Pool_Allocation(Pool_Info, Memory_Size);
+      POOL_UNLOCK(&handle->Lock);
+      if (Block != NULL) {
+        POOL_CHECK_OUT(handle, Class_Index, Block);
+      }
+      return Block;
+    }
+    // refill half the magazine in one trip to the shared list
+    POOL_LOCK(&handle->Lock);
+    size_t Taken =
+        Internal_Pool_Refill(Pool_Info, Magazine, (Magazine->Capacity + 1) / 2);
+    if (Taken == 0) {
+      Pool_Info->Counters.Failed_Allocs++;
+    }
+    POOL_UNLOCK(&handle->Lock);
+    if (Taken == 0) {
+      return NULL; // Pool is empty, allocation fails
+    }
+  }
+  FreeBlock *block_to_return = Magazine->Head;
+  Magazine->Head = POOL_NEXT(Pool_Info, block_to_return);
+  Magazine->Count--;
+#ifdef POOL_HARDENED
+  if (Magazine->Head == NULL) {
+    Magazine->Count = 0; // the rest was cut off at a bad link
+  }
+#endif
+  Magazine->Allocs++;
+  Magazine->Bytes_Wasted += Pool_Info->Block_Size - Memory_Size;
+  POOL_CHECK_OUT(handle, Class_Index, block_to_return);
+  return (void *)block_to_return;
+}
+
+void Pool_Cache_Free(void *Packet, PoolTaskCache *cache) {
+  if (cache == NULL || cache->Pool == NULL || Packet == NULL) {
     return;
   }
+  PoolMemoryInfo *handle = cache->Pool;
+  size_t Class_Index = Internal_Pool_Find_Owner(handle, Packet);
+  if (!POOL_CHECK_IN(handle, Class_Index, Packet)) {
+    return; // hardened builds refuse bad frees here
+  }
+  if (Class_Index >= handle->Class_Count) {
+    return; // not one of ours, leave the free lists alone
+  }
+  PoolMagazine *Magazine = &cache->Magazine[Class_Index];
+  if (Magazine->Capacity == 0) {
+    POOL_LOCK(&handle->Lock);
+    Internal_Pool_Release(&handle->Pool_Storage[Class_Index], Packet);
+    POOL_UNLOCK(&handle->Lock);
+    return;
+  }
+  FreeBlock *Return_Block_Free = (FreeBlock *)Packet;
+  Return_Block_Free->next = Magazine->Head;
+  Magazine->Head = Return_Block_Free;
+  Magazine->Count++;
+  if (Magazine->Count >= Magazine->Capacity) {
+    // full, keep the hottest half and give the rest back
+    Internal_Pool_Spill(handle, Class_Index, Magazine, Magazine->Count / 2);
+  }
+}
 
-  PoolInfo *Large_Pool_Info = &handle->Large_Pool_Storage;
-  size_t Large_Pool_Size = Large_Pool_Info->Total_Blocks * LARGE_BLOCK_SIZE;
-  uint8_t *Large_Pool_Start_Pointer =
-      handle->Large_Pool_Storage.Pool_Start_Address;
-  // go to return function providing the struct size that needs to be returned
-  if (pointer >= Large_Pool_Start_Pointer &&
-      pointer < (Large_Pool_Start_Pointer + Large_Pool_Size)) {
-    FreeBlock *Return_Block_Free = (FreeBlock *)Packet;
-    Return_Block_Free->next = Large_Pool_Info->Free_Block_Location;
-    Large_Pool_Info->Free_Block_Location = Return_Block_Free;
+// hand every cached block back to the shared lists
+void Pool_Cache_Flush(PoolTaskCache *cache) {
+  if (cache == NULL || cache->Pool == NULL) {
     return;
   }
+  for (size_t i = 0; i < cache->Pool->Class_Count; i++) {
+    Internal_Pool_Spill(cache->Pool, i, &cache->Magazine[i], 0);
+  }
+}
+
+// move up to Batch blocks from the front of a shared list into a magazine,
+// called with the lock held. returns how many were moved
+static size_t Internal_Pool_Refill(PoolInfo *Pool_Info,
+                                   PoolMagazine *Magazine, size_t Batch) {
+  FreeBlock *First = (FreeBlock *)Pool_Info->Free_Block_Location;
+  FreeBlock *Last = NULL;
+  FreeBlock *Cursor = First;
+  size_t Taken = 0;
+  while (Cursor != NULL && Taken < Batch) {
+    Last = Cursor;
+    Cursor = POOL_NEXT(Pool_Info, Cursor);
+    Taken++;
+  }
+  Internal_Pool_Fold_Cache(Pool_Info, Magazine);
+  if (Taken == 0) {
+    return 0;
+  }
+  Pool_Info->Free_Block_Location = Cursor;
+  Last->next = Magazine->Head;
+  Magazine->Head = First;
+  Magazine->Count += Taken;
+  Internal_Pool_Count_Out(Pool_Info, Taken);
+  return Taken;
+}
+
+// give all but the first Keep blocks of a magazine back to the shared list.
+// the chain is cut outside the lock so only the splice is done under it
+static void Internal_Pool_Spill(PoolMemoryInfo *handle, size_t Class_Index,
+                                PoolMagazine *Magazine, size_t Keep) {
+  PoolInfo *Pool_Info = &handle->Pool_Storage[Class_Index];
+  FreeBlock *Spill_First = NULL;
+  FreeBlock *Spill_Last = NULL;
+  size_t Spilled = 0;
+  if (Magazine->Count > Keep) {
+    if (Keep == 0) {
+      Spill_First = Magazine->Head;
+      Magazine->Head = NULL;
+    } else {
+      // only comes up short when a hardened build cut a bad link
+      FreeBlock *Keep_Last = Magazine->Head;
+      for (size_t i = 1; i < Keep && Keep_Last != NULL; i++) {
+        Keep_Last = POOL_NEXT(Pool_Info, Keep_Last);
+      }
+      if (Keep_Last != NULL) {
+        Spill_First = POOL_NEXT(Pool_Info, Keep_Last);
+        Keep_Last->next = NULL;
+      }
+    }
+    // count the chain as it is walked rather than trust Count
+    for (FreeBlock *Cursor = Spill_First; Cursor != NULL;
+         Cursor = POOL_NEXT(Pool_Info, Cursor)) {
+      Spill_Last = Cursor;
+      Spilled++;
+    }
+    Magazine->Count = Keep;
+  }
+  if (Spilled == 0 && Magazine->Allocs == 0) {
+    return; // nothing to hand back or report
+  }
+
+  POOL_LOCK(&handle->Lock);
+  if (Spilled != 0) {
+    Spill_Last->next = Pool_Info->Free_Block_Location;
+    Pool_Info->Free_Block_Location = Spill_First;
+    Pool_Info->Counters.In_Use -= Spilled;
+  }
+  Internal_Pool_Fold_Cache(Pool_Info, Magazine);
+  POOL_UNLOCK(&handle->Lock);
+}
+
+// STATISTICS
+// copy every counter out under the lock so the snapshot is consistent
+int Pool_Get_Stats(PoolMemoryInfo *handle, PoolStats *Stats) {
+  if (handle == NULL || Stats == NULL) {
+    return 0;
+  }
+  Stats->Class_Count = handle->Class_Count;
+  POOL_LOCK(&handle->Lock);
+  Stats->Oversize_Allocs = handle->Oversize_Allocs;
+#ifdef POOL_HARDENED
+  Stats->Rejected_Frees = handle->Rejected_Frees;
+#endif
+  for (size_t i = 0; i < handle->Class_Count; i++) {
+    Stats->Class[i].Counters = handle->Pool_Storage[i].Counters;
+  }
+  POOL_UNLOCK(&handle->Lock);
+  for (size_t i = 0; i < handle->Class_Count; i++) {
+    Stats->Class[i].Request_Size = handle->Pool_Storage[i].Request_Size;
+    Stats->Class[i].Block_Size = handle->Pool_Storage[i].Block_Size;
+    Stats->Class[i].Total_Blocks = handle->Pool_Storage[i].Total_Blocks;
+  }
+  return 1;
+}
+
+// one line per class, enough to size the block counts from field logs
+void Pool_Log_Stats(PoolMemoryInfo *handle, const char *Name) {
+  PoolStats Stats;
+  if (!Pool_Get_Stats(handle, &Stats)) {
+    return;
+  }
+  if (Name == NULL) {
+    Name = "pool";
+  }
+  POOL_LOG("%s: %" PRIu64 " requests above the largest class", Name,
+           Stats.Oversize_Allocs);
+#ifdef POOL_HARDENED
+  POOL_LOG("%s: %" PRIu64 " bad frees refused", Name, Stats.Rejected_Frees);
+#endif
+  for (size_t i = 0; i < Stats.Class_Count; i++) {
+    const PoolClassStats *Class = &Stats.Class[i];
+    POOL_LOG("%s %zuB: %zu/%zu in use, high water %zu, allocs %" PRIu64
+             ", failed %" PRIu64 ", wasted %" PRIu64 "B",
+             Name, Class->Request_Size, Class->Counters.In_Use,
+             Class->Total_Blocks, Class->Counters.High_Water,
+             Class->Counters.Total_Allocs, Class->Counters.Failed_Allocs,
+             Class->Counters.Bytes_Wasted);
+#ifdef POOL_HARDENED
+    if (Class->Counters.Corrupt_Blocks != 0) {
+      POOL_LOG("%s %zuB: %" PRIu64 " blocks written after free", Name,
+               Class->Request_Size, Class->Counters.Corrupt_Blocks);
+    }
+#endif
+  }
+}
+
+#ifdef ESP_PLATFORM
+static void Internal_Pool_Stats_Timer(void *Argument) {
+  PoolMemoryInfo *handle = (PoolMemoryInfo *)Argument;
+  Pool_Log_Stats(handle, handle->Stats_Name);
+}
+#endif
+
+// dump the stats every Period_ms from the esp_timer task. returns 0 when
+// it can't be started, which is always the case on the host
+int Pool_Start_Stats_Log(PoolMemoryInfo *handle, const char *Name,
+                         uint32_t Period_ms) {
+  if (handle == NULL || Period_ms == 0 || handle->Stats_Timer != NULL) {
+    return 0;
+  }
+#ifdef ESP_PLATFORM
+  handle->Stats_Name = Name;
+  const esp_timer_create_args_t Timer_Args = {
+      .callback = Internal_Pool_Stats_Timer,
+      .arg = handle,
+      .name = "pool_stats",
+  };
+  esp_timer_handle_t Timer;
+  if (esp_timer_create(&Timer_Args, &Timer) != ESP_OK) {
+    return 0;
+  }
+  if (esp_timer_start_periodic(Timer, (uint64_t)Period_ms * 1000) != ESP_OK) {
+    esp_timer_delete(Timer);
+    return 0;
+  }
+  handle->Stats_Timer = Timer;
+  return 1;
+#else
+  (void)Name;
+  return 0; // no timer service here, call Pool_Log_Stats directly
+#endif
+}
+
+void Pool_Stop_Stats_Log(PoolMemoryInfo *handle) {
+  if (handle == NULL || handle->Stats_Timer == NULL) {
+    return;
+  }
+#ifdef ESP_PLATFORM
+  esp_timer_handle_t Timer = (esp_timer_handle_t)handle->Stats_Timer;
+  esp_timer_stop(Timer);
+  esp_timer_delete(Timer);
+#endif
+  handle->Stats_Timer = NULL;
+}
+
+// HARDENED CHECKS
+#ifdef POOL_HARDENED
+// index of the block starting at Address, Total_Blocks if no block of this
+// class starts there. anything below the pool wraps round to a huge offset
+static size_t Internal_Pool_Block_Index(const PoolInfo *Pool_Info,
+                                        const void *Address) {
+  uintptr_t Offset =
+      (uintptr_t)Address - (uintptr_t)Pool_Info->Pool_Start_Address;
+  if (Offset % Pool_Info->Block_Size != 0 ||
+      Offset / Pool_Info->Block_Size >= Pool_Info->Total_Blocks) {
+    return Pool_Info->Total_Blocks;
+  }
+  return Offset / Pool_Info->Block_Size;
+}
+
+// a block coming back from the user. the bitmap words and counters are
+// shared with other tasks and the lock may already be held when they
+// change, so they are updated with atomics instead
+static int Internal_Pool_Check_In(PoolMemoryInfo *handle, size_t Class_Index,
+                                  void *Packet) {
+  if (Class_Index >= handle->Class_Count) {
+    Internal_Pool_Report(&handle->Rejected_Frees,
+                         "free of a pointer from outside the pool", Packet);
+    return 0;
+  }
+  PoolInfo *Pool_Info = &handle->Pool_Storage[Class_Index];
+  size_t Index = Internal_Pool_Block_Index(Pool_Info, Packet);
+  if (Index >= Pool_Info->Total_Blocks) {
+    Internal_Pool_Report(&handle->Rejected_Frees,
+                         "free of a pointer into the middle of a block",
+                         Packet);
+    return 0;
+  }
+  uint32_t Bit = 1u << (Index % 32);
+  if ((__atomic_fetch_and(&Pool_Info->Alloc_Map[Index / 32], ~Bit,
+                          __ATOMIC_RELAXED) &
+       Bit) == 0) {
+    Internal_Pool_Report(&handle->Rejected_Frees, "double free", Packet);
+    return 0;
+  }
+  // everything past the free list link, so a late write shows up on alloc
+  memset((uint8_t *)Packet + sizeof(FreeBlock), POOL_POISON_BYTE,
+         Pool_Info->Block_Size - sizeof(FreeBlock));
+  return 1;
+}
+
+// a block about to be handed to the user
+static void Internal_Pool_Check_Out(PoolMemoryInfo *handle,
+                                    size_t Class_Index, void *Block) {
+  PoolInfo *Pool_Info = &handle->Pool_Storage[Class_Index];
+  size_t Index = Internal_Pool_Block_Index(Pool_Info, Block);
+  uint32_t Bit = 1u << (Index % 32);
+  if (__atomic_fetch_or(&Pool_Info->Alloc_Map[Index / 32], Bit,
+                        __ATOMIC_RELAXED) &
+      Bit) {
+    Internal_Pool_Report(&Pool_Info->Counters.Corrupt_Blocks,
+                         "block handed out while already in use", Block);
+  }
+  const uint8_t *Bytes = (const uint8_t *)Block;
+  for (size_t i = sizeof(FreeBlock); i < Pool_Info->Block_Size; i++) {
+    if (Bytes[i] != POOL_POISON_BYTE) {
+      Internal_Pool_Report(&Pool_Info->Counters.Corrupt_Blocks,
+                           "block written after it was freed", Block);
+      break;
+    }
+  }
+}
+
+// a free block's link has to point at another block of the same class.
+// can run inside the lock so it only counts, the stats show the damage
+static FreeBlock *Internal_Pool_Next(PoolInfo *Pool_Info, FreeBlock *Block) {
+  FreeBlock *Next = Block->next;
+  if (Next != NULL &&
+      Internal_Pool_Block_Index(Pool_Info, Next) >= Pool_Info->Total_Blocks) {
+    __atomic_fetch_add(&Pool_Info->Counters.Corrupt_Blocks, 1,
+                       __ATOMIC_RELAXED);
+    return NULL; // leak the rest of the list rather than follow it
+  }
+  return Next;
+}
 
-  // work out the maximum pointer value and if above that throw an error?
-  return;
+static void Internal_Pool_Report(uint64_t *Counter, const char *What,
+                                 void *Block) {
+  __atomic_fetch_add(Counter, 1, __ATOMIC_RELAXED);
+  POOL_LOG_ERROR("%s at %p", What, Block);
 }
+#endif
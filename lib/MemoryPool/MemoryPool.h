@@ -6,18 +6,119 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// build with POOL_THREAD_SAFE to share one pool between tasks on both cores.
+// the shared free lists are then guarded by a spinlock, a critical section
+// on the esp32 so it is also safe against the other core and interrupts
+#ifdef POOL_THREAD_SAFE
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+typedef portMUX_TYPE PoolLock;
+#else
+#include <stdatomic.h>
+typedef atomic_flag PoolLock;
+#endif
+#endif
+
+// build with POOL_HARDENED for soak testing. every free is checked against a
+// per block allocation bitmap so double frees, foreign and interior pointers
+// are rejected, freed blocks are poison filled and the poison is checked
+// again on alloc to catch writes after free. release builds pay nothing
+#ifdef POOL_HARDENED
+#define POOL_POISON_BYTE 0xA5
+#endif
+
+// most size classes a single pool can be configured with
+#define POOL_MAX_CLASSES 8
+
+// most free blocks a task cache holds per class before handing half back
+#define POOL_MAGAZINE_SIZE 8
+
+// block sizes used by the three class Pool_Ini
+#define POOL_DEFAULT_SMALL_BLOCK_SIZE 64
+#define POOL_DEFAULT_MEDIUM_BLOCK_SIZE 512
+#define POOL_DEFAULT_LARGE_BLOCK_SIZE 2048
+
+typedef enum { // which memory a size class is carved out of
+  POOL_CAP_ANY = 0,  // default heap, psram too when SPIRAM_USE_MALLOC is on
+  POOL_CAP_INTERNAL, // internal sram, for latency critical small blocks
+  POOL_CAP_DMA,      // dma capable internal sram, for i2s and spi buffers
+  POOL_CAP_PSRAM,    // external psram, for big slow buffers
+  POOL_CAPABILITY_COUNT
+} PoolCapability;
+
+// where a pool gets its memory from. Alloc only needs to return
+// malloc-aligned memory, the pool pads and aligns inside it. the pool
+// handle itself is claimed through it as POOL_CAP_INTERNAL
+typedef struct {
+  void *(*Alloc)(size_t Size, PoolCapability Capability, void *Context);
+  void (*Free)(void *Memory, PoolCapability Capability, void *Context);
+  void *Context;
+} PoolBackingAllocator;
+
+typedef struct { // one size class handed to Pool_Ini_Config
+  size_t Block_Size;  // largest request this class serves
+  size_t Block_Count; // number of blocks to carve out
+  size_t Alignment;   // power of two, 0 for plain pointer alignment
+  PoolCapability Capability; // left out of an initialiser it is ANY
+} PoolClassConfig;
+
+typedef struct { // running counters for one size class
+  size_t In_Use;     // blocks off the shared list, task caches count as in use
+  size_t High_Water; // most In_Use has ever been
+  uint64_t Total_Allocs;
+  uint64_t Failed_Allocs; // class was empty
+  uint64_t Bytes_Wasted;  // block stride minus the size asked for, summed
+#ifdef POOL_HARDENED
+  uint64_t Corrupt_Blocks; // free blocks written to after they were freed
+#endif
+} PoolCounters;
+
 typedef struct { // genertic pool info
   void *Free_Block_Location;
   uint8_t *Pool_Start_Address;
   size_t Total_Blocks;
+  size_t Block_Size; // stride between blocks, may be above the asked size
+  size_t Request_Size; // Block_Size from the config
+  PoolCounters Counters;
+#ifdef POOL_HARDENED
+  uint32_t *Alloc_Map; // bit per block, set while the user holds it
+#endif
 } PoolInfo;
 
+typedef struct { // one backing claim holding a run of classes
+  uint8_t *Memory_Claim_Address; // raw allocation, may sit below the pools
+  uintptr_t Start;               // start of the first pool in the run
+  size_t Size;                   // bytes from Start to the end of the last
+  size_t First_Class;
+  size_t Last_Class;
+  PoolCapability Capability;
+} PoolRegion;
+
 typedef struct { // nested structs for storage information
-  PoolInfo Small_Pool_Storage;
-  PoolInfo Medium_Pool_Storage;
-  PoolInfo Large_Pool_Storage;
-  size_t Total_Pool_Size;
-  uint8_t *Memory_Claim_Address;
+  size_t Class_Count;
+  // packed copies of Request_Size and the pool start addresses so the
+  // alloc and free lookups stay in one or two cache lines
+  size_t Class_Limit[POOL_MAX_CLASSES];
+  uintptr_t Class_Start[POOL_MAX_CLASSES];
+  size_t Total_Pool_Size; // bytes of pools across every region
+  // classes next to each other in size order that share a capability share
+  // a region, so the default single capability pool is one claim
+  size_t Region_Count;
+  PoolRegion *Region; // Class_Count entries stored after Pool_Storage,
+                      // hardened builds keep the bitmaps after them
+  PoolBackingAllocator Backing;
+  uint64_t Oversize_Allocs; // requests bigger than every class
+  void *Stats_Timer;        // periodic log dump, esp32 only
+  const char *Stats_Name;
+#ifdef POOL_HARDENED
+  uint64_t Rejected_Frees; // double, foreign and interior pointer frees
+#endif
+#ifdef POOL_THREAD_SAFE
+  PoolLock Lock; // guards every Free_Block_Location and the counters
+#endif
+  // one entry per size class, smallest first. the classes in a region are
+  // laid out back to back in the same order. sized to Class_Count
+  PoolInfo Pool_Storage[];
 } PoolMemoryInfo;
 
 // Define a struct to overlay on each block to create the linked list
@@ -25,11 +126,64 @@ typedef struct FreeBlock {
   struct FreeBlock *next; // pointer pointing to the next free memory block
 } FreeBlock;
 
+typedef struct { // small private stack of free blocks for one class
+  FreeBlock *Head;
+  size_t Count;
+  size_t Capacity; // 0 means the class skips the cache
+  // counts from cache hits, added to the pool counters on the next trip
+  // to the shared list so hits stay lock free
+  size_t Allocs;
+  size_t Bytes_Wasted;
+} PoolMagazine;
+
+// per task cache in front of the shared free lists. each task that hits
+// the pool hard (audio capture, http) keeps its own, so most allocs and
+// frees never touch the lock. a cache must only be used by one task and
+// must be flushed before the pool is destroyed
+typedef struct {
+  PoolMemoryInfo *Pool;
+  PoolMagazine Magazine[POOL_MAX_CLASSES];
+} PoolTaskCache;
+
+typedef struct { // snapshot of one size class
+  size_t Request_Size;
+  size_t Block_Size;
+  size_t Total_Blocks;
+  PoolCounters Counters;
+} PoolClassStats;
+
+typedef struct { // snapshot of a whole pool from Pool_Get_Stats
+  size_t Class_Count;
+  uint64_t Oversize_Allocs;
+#ifdef POOL_HARDENED
+  uint64_t Rejected_Frees;
+#endif
+  PoolClassStats Class[POOL_MAX_CLASSES];
+} PoolStats;
+
 // The PUBLIC functions that users can call
 PoolMemoryInfo *Pool_Ini(size_t num_small_blocks, size_t num_medium_blocks,
                          size_t num_large_blocks);
+PoolMemoryInfo *Pool_Ini_Config(const PoolClassConfig *Classes,
+                                size_t Class_Count);
+PoolMemoryInfo *Pool_Ini_Config_Backing(const PoolClassConfig *Classes,
+                                        size_t Class_Count,
+                                        const PoolBackingAllocator *Backing);
 void *Pool_Alloc(size_t MemorySize, PoolMemoryInfo *handle);
 void Pool_Free(void *Packet, PoolMemoryInfo *handle);
 void Pool_Destroy(PoolMemoryInfo *handle);
 
+void Pool_Cache_Ini(PoolTaskCache *cache, PoolMemoryInfo *handle);
+void *Pool_Cache_Alloc(size_t Memory_Size, PoolTaskCache *cache);
+void Pool_Cache_Free(void *Packet, PoolTaskCache *cache);
+void Pool_Cache_Flush(PoolTaskCache *cache);
+
+// statistics. task cache hits show up once that cache next refills, spills
+// or is flushed
+int Pool_Get_Stats(PoolMemoryInfo *handle, PoolStats *Stats);
+void Pool_Log_Stats(PoolMemoryInfo *handle, const char *Name);
+int Pool_Start_Stats_Log(PoolMemoryInfo *handle, const char *Name,
+                         uint32_t Period_ms);
+void Pool_Stop_Stats_Log(PoolMemoryInfo *handle);
+
 #endif // MEMORY_POOL
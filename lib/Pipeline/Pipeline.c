@@ -0,0 +1,519 @@
+/*
+    Description: stage graph, see Pipeline.h. each stage task loops on its
+    input queue and times everything it does, the time waiting on the queue
+    before it, on the queue after it or the pool, and the rest as busy. the
+    end of the input is a message with no block. a stage that stops early
+    closes its input queue so the stages before it see their sends fail and
+    stop as well. the queues are FreeRTOS queues on the esp32, polled so a
+    close is seen, and a mutex and condition on the host
+    Creator: Matthew Ayestaran
+*/
+
+#include "Pipeline.h"
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
+
+#ifdef ESP_PLATFORM
+static const char *TAG = "Pipeline";
+#define PIPE_DEFAULT_STACK 4096
+#endif
+
+// PROTOTYPES
+int Pipeline_Ini(Pipeline *Pipe, PoolMemoryInfo *Pool,
+                 const PipeStageConfig *Stages, size_t Stage_Count);
+int Pipeline_Start(Pipeline *Pipe);
+int Pipeline_Wait(Pipeline *Pipe);
+void Pipeline_Abort(Pipeline *Pipe);
+void Pipeline_Get_Stats(Pipeline *Pipe, size_t Stage, PipeStageStats *Stats);
+void Pipeline_Deinit(Pipeline *Pipe);
+void *Pipe_Alloc(PipeStage *Stage, size_t Size);
+bool Pipe_Send(PipeStage *Stage, void *Block, uint32_t Length);
+bool Pipe_Send_At(PipeStage *Stage, void *Block, uint32_t Length,
+                  int64_t Born_us);
+void Pipe_Keep(PipeStage *Stage);
+bool Pipe_Receive(PipeStage *Stage, PipeMsg *Msg);
+void Pipe_Free(PipeStage *Stage, void *Block);
+int64_t Pipe_Now_us(void);
+static void Pipe_Stage_Run(PipeStage *Stage);
+static PipeResult Pipe_Stage_Call(PipeStage *Stage, PipeMsg *In);
+static void Pipe_Stage_Finish(PipeStage *Stage, PipeResult Result);
+static void Pipe_Stage_Count_Out(PipeStage *Stage, int64_t Born_us,
+                                 int64_t Now);
+static bool Pipe_Too_Big(PoolMemoryInfo *Pool, size_t Size);
+static int Pipe_Queue_Ini(PipeQueue *Queue, size_t Depth);
+static bool Pipe_Queue_Push(PipeQueue *Queue, const PipeMsg *Msg,
+                            Pipeline *Pipe);
+static bool Pipe_Queue_Pop(PipeQueue *Queue, PipeMsg *Msg, Pipeline *Pipe);
+static void Pipe_Queue_Close(PipeQueue *Queue, PoolMemoryInfo *Pool);
+static void Pipe_Queue_Wake(PipeQueue *Queue);
+static void Pipe_Queue_Deinit(PipeQueue *Queue, PoolMemoryInfo *Pool);
+static int Pipe_Task_Start(PipeStage *Stage);
+static void Pipe_Task_Join(Pipeline *Pipe, size_t Count);
+static void Pipe_Sleep_ms(uint32_t Milliseconds);
+
+int Pipeline_Ini(Pipeline *Pipe, PoolMemoryInfo *Pool,
+                 const PipeStageConfig *Stages, size_t Stage_Count) {
+  memset(Pipe, 0, sizeof(*Pipe));
+  if (Pool == NULL || Stage_Count == 0 || Stage_Count > PIPE_MAX_STAGES) {
+    return -1;
+  }
+  for (size_t i = 0; i < Stage_Count; i++) {
+    if (Stages[i].Process == NULL ||
+        (i + 1 < Stage_Count && (Stages[i].Queue_Depth == 0 ||
+                                 Stages[i].Queue_Depth > PIPE_QUEUE_MAX))) {
+      return -1;
+    }
+  }
+  Pipe->Pool = Pool;
+  atomic_init(&Pipe->Aborted, false);
+  for (size_t i = 0; i + 1 < Stage_Count; i++) {
+    if (Pipe_Queue_Ini(&Pipe->Queue[i], Stages[i].Queue_Depth) != 0) {
+      Pipeline_Deinit(Pipe);
+      return -1;
+    }
+    Pipe->Stage_Count = i + 2; // so Deinit knows which queues exist
+  }
+#ifdef ESP_PLATFORM
+  Pipe->Finished = xSemaphoreCreateCountingStatic(
+      PIPE_MAX_STAGES, 0, &Pipe->Finished_Storage);
+#endif
+  for (size_t i = 0; i < Stage_Count; i++) {
+    PipeStage *Stage = &Pipe->Stage[i];
+    Stage->Config = Stages[i];
+    Stage->Pipe = Pipe;
+    Stage->In_Queue = i > 0 ? &Pipe->Queue[i - 1] : NULL;
+    Stage->Out_Queue = i + 1 < Stage_Count ? &Pipe->Queue[i] : NULL;
+    Stage->Born_us = -1;
+    Stage->Stats.First_Out_us = -1;
+  }
+  Pipe->Stage_Count = Stage_Count;
+  return 0;
+}
+
+int Pipeline_Start(Pipeline *Pipe) {
+  Pipe->Start_us = Pipe_Now_us();
+  Pipe->Started = true;
+  for (size_t i = 0; i < Pipe->Stage_Count; i++) {
+    if (Pipe_Task_Start(&Pipe->Stage[i]) != 0) {
+      Pipeline_Abort(Pipe);
+      Pipe_Task_Join(Pipe, i);
+      Pipe->Started = false;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int Pipeline_Wait(Pipeline *Pipe) {
+  if (!Pipe->Started) {
+    return -1;
+  }
+  Pipe_Task_Join(Pipe, Pipe->Stage_Count);
+  Pipe->Started = false;
+  return atomic_load(&Pipe->Aborted) ? -1 : 0;
+}
+
+void Pipeline_Abort(Pipeline *Pipe) {
+  atomic_store(&Pipe->Aborted, true);
+  for (size_t i = 0; i + 1 < Pipe->Stage_Count; i++) {
+    Pipe_Queue_Wake(&Pipe->Queue[i]);
+  }
+}
+
+void Pipeline_Get_Stats(Pipeline *Pipe, size_t Stage, PipeStageStats *Stats) {
+  *Stats = Pipe->Stage[Stage].Stats;
+  if (Pipe->Stage[Stage].Out_Queue != NULL) {
+    Stats->Queue_High_Water = Pipe->Stage[Stage].Out_Queue->High_Water;
+  }
+}
+
+void Pipeline_Deinit(Pipeline *Pipe) {
+  if (Pipe->Started) {
+    Pipeline_Abort(Pipe);
+    Pipeline_Wait(Pipe);
+  }
+  for (size_t i = 0; i + 1 < Pipe->Stage_Count; i++) {
+    Pipe_Queue_Deinit(&Pipe->Queue[i], Pipe->Pool);
+  }
+#ifdef ESP_PLATFORM
+  if (Pipe->Finished != NULL) {
+    vSemaphoreDelete(Pipe->Finished);
+  }
+#endif
+  Pipe->Stage_Count = 0;
+}
+
+// the pool is looked at again every millisecond, a stage waiting here is
+// held back by blocks the stages after it haven't freed yet
+void *Pipe_Alloc(PipeStage *Stage, size_t Size) {
+  Pipeline *Pipe = Stage->Pipe;
+  void *Block = Pool_Alloc(Size, Pipe->Pool);
+  if (Block != NULL) {
+    return Block;
+  }
+  if (Pipe_Too_Big(Pipe->Pool, Size)) {
+    return NULL;
+  }
+  Stage->Stats.Pool_Waits++;
+  const int64_t Wait_Start = Pipe_Now_us();
+  while (Block == NULL && !atomic_load(&Pipe->Aborted) &&
+         (Stage->Out_Queue == NULL || !atomic_load(&Stage->Out_Queue->Closed))) {
+    Pipe_Sleep_ms(1);
+    Block = Pool_Alloc(Size, Pipe->Pool);
+  }
+  Stage->Stats.Blocked_us += Pipe_Now_us() - Wait_Start;
+  return Block;
+}
+
+bool Pipe_Send(PipeStage *Stage, void *Block, uint32_t Length) {
+  return Pipe_Send_At(Stage, Block, Length,
+                      Stage->Born_us >= 0 ? Stage->Born_us : Pipe_Now_us());
+}
+
+bool Pipe_Send_At(PipeStage *Stage, void *Block, uint32_t Length,
+                  int64_t Born_us) {
+  if (Block == Stage->In_Block) {
+    Stage->Kept = true;
+  }
+  if (Stage->Out_Queue == NULL) { // the last stage has nowhere to send
+    Pipe_Free(Stage, Block);
+    return false;
+  }
+  const PipeMsg Msg = {Block, Length, Stage->Stats.Out, Born_us};
+  const int64_t Wait_Start = Pipe_Now_us();
+  const bool Sent = Pipe_Queue_Push(Stage->Out_Queue, &Msg, Stage->Pipe);
+  const int64_t Now = Pipe_Now_us();
+  Stage->Stats.Blocked_us += Now - Wait_Start;
+  if (!Sent) {
+    Pipe_Free(Stage, Block);
+    return false;
+  }
+  Pipe_Stage_Count_Out(Stage, Born_us, Now);
+  return true;
+}
+
+void Pipe_Keep(PipeStage *Stage) { Stage->Kept = true; }
+
+bool Pipe_Receive(PipeStage *Stage, PipeMsg *Msg) {
+  if (Stage->In_Queue == NULL || Stage->Input_Ended) {
+    return false;
+  }
+  const int64_t Wait_Start = Pipe_Now_us();
+  const bool Got = Pipe_Queue_Pop(Stage->In_Queue, Msg, Stage->Pipe);
+  Stage->Stats.Starved_us += Pipe_Now_us() - Wait_Start;
+  if (!Got || Msg->Block == NULL) {
+    Stage->Input_Ended = true;
+    return false;
+  }
+  Stage->Stats.In++;
+  Stage->Born_us = Msg->Born_us;
+  return true;
+}
+
+void Pipe_Free(PipeStage *Stage, void *Block) {
+  Pool_Free(Block, Stage->Pipe->Pool);
+}
+
+int64_t Pipe_Now_us(void) {
+#ifdef ESP_PLATFORM
+  return esp_timer_get_time();
+#else
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (int64_t)Now.tv_sec * 1000000 + Now.tv_nsec / 1000;
+#endif
+}
+
+// the body of every stage task
+static void Pipe_Stage_Run(PipeStage *Stage) {
+  Pipeline *Pipe = Stage->Pipe;
+  PipeResult Result = PIPE_MORE;
+  if (Stage->In_Queue == NULL || Stage->Config.Pull) {
+    while (Result == PIPE_MORE && !atomic_load(&Pipe->Aborted)) {
+      Result = Pipe_Stage_Call(Stage, NULL);
+    }
+  } else {
+    while (Result == PIPE_MORE) {
+      PipeMsg Msg;
+      const int64_t Wait_Start = Pipe_Now_us();
+      const bool Got = Pipe_Queue_Pop(Stage->In_Queue, &Msg, Pipe);
+      Stage->Stats.Starved_us += Pipe_Now_us() - Wait_Start;
+      if (!Got) {
+        break; // aborted
+      }
+      if (Msg.Block == NULL) {
+        // whatever the stage still holds goes out now
+        Result = Pipe_Stage_Call(Stage, NULL);
+        if (Result == PIPE_MORE) {
+          Result = PIPE_END;
+        }
+        break;
+      }
+      Stage->Stats.In++;
+      Stage->Born_us = Msg.Born_us;
+      Result = Pipe_Stage_Call(Stage, &Msg);
+    }
+  }
+  Pipe_Stage_Finish(Stage, atomic_load(&Pipe->Aborted) ? PIPE_ERROR : Result);
+}
+
+// the waits inside Process are already counted, the rest of its time is busy
+static PipeResult Pipe_Stage_Call(PipeStage *Stage, PipeMsg *In) {
+  Stage->In_Block = In != NULL ? In->Block : NULL;
+  Stage->Kept = false;
+  const int64_t Waits = Stage->Stats.Starved_us + Stage->Stats.Blocked_us;
+  const int64_t Start = Pipe_Now_us();
+  PipeResult Result = Stage->Config.Process(Stage, In);
+  Stage->Stats.Busy_us += Pipe_Now_us() - Start -
+                          (Stage->Stats.Starved_us + Stage->Stats.Blocked_us -
+                           Waits);
+  if (In != NULL && Stage->Out_Queue == NULL) {
+    Pipe_Stage_Count_Out(Stage, In->Born_us, Pipe_Now_us());
+  }
+  if (In != NULL && !Stage->Kept) {
+    Pipe_Free(Stage, In->Block);
+  }
+  Stage->In_Block = NULL;
+  // nobody after it is taking any more
+  if (Result == PIPE_MORE && Stage->Out_Queue != NULL &&
+      atomic_load(&Stage->Out_Queue->Closed)) {
+    Result = PIPE_END;
+  }
+  return Result;
+}
+
+// an error stops everything. otherwise the stages before are told to stop
+// sending and the one after is told the input is over
+static void Pipe_Stage_Finish(PipeStage *Stage, PipeResult Result) {
+  Pipeline *Pipe = Stage->Pipe;
+  Stage->Result = Result;
+  if (Result == PIPE_ERROR) {
+    Pipeline_Abort(Pipe);
+  } else {
+    if (Stage->In_Queue != NULL) {
+      Pipe_Queue_Close(Stage->In_Queue, Pipe->Pool);
+    }
+    if (Stage->Out_Queue != NULL) {
+      const PipeMsg End = {NULL, 0, Stage->Stats.Out, Stage->Born_us};
+      Pipe_Queue_Push(Stage->Out_Queue, &End, Pipe);
+    }
+  }
+  Stage->Stats.Ended_us = Pipe_Now_us() - Pipe->Start_us;
+}
+
+// the last stage counts each message it has finished with as sent
+static void Pipe_Stage_Count_Out(PipeStage *Stage, int64_t Born_us,
+                                 int64_t Now) {
+  Stage->Stats.Out++;
+  Stage->Stats.Latency_us += Now - Born_us;
+  if (Now - Born_us > Stage->Stats.Max_Latency_us) {
+    Stage->Stats.Max_Latency_us = Now - Born_us;
+  }
+  if (Stage->Stats.First_Out_us < 0) {
+    Stage->Stats.First_Out_us = Now - Stage->Pipe->Start_us;
+  }
+}
+
+// only asked once the pool has come up empty
+static bool Pipe_Too_Big(PoolMemoryInfo *Pool, size_t Size) {
+  PoolStats Stats;
+  return Pool_Get_Stats(Pool, &Stats) && Stats.Class_Count > 0 &&
+         Size > Stats.Class[Stats.Class_Count - 1].Request_Size;
+}
+
+#ifdef ESP_PLATFORM
+// the queue keeps its messages in Slot
+static int Pipe_Queue_Ini(PipeQueue *Queue, size_t Depth) {
+  Queue->Depth = Depth;
+  atomic_init(&Queue->Closed, false);
+  Queue->Handle = xQueueCreateStatic(Depth, sizeof(PipeMsg),
+                                     (uint8_t *)Queue->Slot, &Queue->Storage);
+  return Queue->Handle != NULL ? 0 : -1;
+}
+
+static bool Pipe_Queue_Push(PipeQueue *Queue, const PipeMsg *Msg,
+                            Pipeline *Pipe) {
+  while (!atomic_load(&Queue->Closed) && !atomic_load(&Pipe->Aborted)) {
+    if (xQueueSend(Queue->Handle, Msg, pdMS_TO_TICKS(PIPE_POLL_MS)) ==
+        pdTRUE) {
+      // the end marker holds no block, it doesn't count towards the mark
+      size_t Waiting = uxQueueMessagesWaiting(Queue->Handle);
+      if (Msg->Block != NULL && Waiting > Queue->High_Water) {
+        Queue->High_Water = Waiting;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool Pipe_Queue_Pop(PipeQueue *Queue, PipeMsg *Msg, Pipeline *Pipe) {
+  while (!atomic_load(&Pipe->Aborted)) {
+    if (xQueueReceive(Queue->Handle, Msg, pdMS_TO_TICKS(PIPE_POLL_MS)) ==
+        pdTRUE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// a send already past the Closed check can still land, Deinit frees it
+static void Pipe_Queue_Close(PipeQueue *Queue, PoolMemoryInfo *Pool) {
+  atomic_store(&Queue->Closed, true);
+  PipeMsg Msg;
+  while (xQueueReceive(Queue->Handle, &Msg, 0) == pdTRUE) {
+    if (Msg.Block != NULL) {
+      Pool_Free(Msg.Block, Pool);
+    }
+  }
+}
+
+// the waits are polled, nothing to wake
+static void Pipe_Queue_Wake(PipeQueue *Queue) {}
+
+static void Pipe_Queue_Deinit(PipeQueue *Queue, PoolMemoryInfo *Pool) {
+  if (Queue->Handle != NULL) {
+    Pipe_Queue_Close(Queue, Pool);
+    vQueueDelete(Queue->Handle);
+    Queue->Handle = NULL;
+  }
+}
+
+static void Pipe_Task(void *Argument) {
+  PipeStage *Stage = (PipeStage *)Argument;
+  Pipe_Stage_Run(Stage);
+  xSemaphoreGive(Stage->Pipe->Finished);
+  vTaskDelete(NULL);
+}
+
+static int Pipe_Task_Start(PipeStage *Stage) {
+  const PipeStageConfig *Config = &Stage->Config;
+  if (xTaskCreatePinnedToCore(
+          Pipe_Task, Config->Name,
+          Config->Stack ? Config->Stack : PIPE_DEFAULT_STACK, Stage,
+          Config->Priority, &Stage->Task,
+          Config->Core < 0 ? tskNO_AFFINITY : Config->Core) != pdPASS) {
+    ESP_LOGE(TAG, "No task for stage %s", Config->Name);
+    return -1;
+  }
+  return 0;
+}
+
+static void Pipe_Task_Join(Pipeline *Pipe, size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    xSemaphoreTake(Pipe->Finished, portMAX_DELAY);
+    Pipe->Stage[i].Task = NULL;
+  }
+}
+
+static void Pipe_Sleep_ms(uint32_t Milliseconds) {
+  vTaskDelay(pdMS_TO_TICKS(Milliseconds) > 0 ? pdMS_TO_TICKS(Milliseconds)
+                                             : 1);
+}
+#else
+static int Pipe_Queue_Ini(PipeQueue *Queue, size_t Depth) {
+  Queue->Depth = Depth;
+  atomic_init(&Queue->Closed, false);
+  if (pthread_mutex_init(&Queue->Lock, NULL) != 0) {
+    return -1;
+  }
+  if (pthread_cond_init(&Queue->Changed, NULL) != 0) {
+    pthread_mutex_destroy(&Queue->Lock);
+    return -1;
+  }
+  return 0;
+}
+
+static bool Pipe_Queue_Push(PipeQueue *Queue, const PipeMsg *Msg,
+                            Pipeline *Pipe) {
+  pthread_mutex_lock(&Queue->Lock);
+  while (Queue->Count == Queue->Depth && !atomic_load(&Queue->Closed) &&
+         !atomic_load(&Pipe->Aborted)) {
+    pthread_cond_wait(&Queue->Changed, &Queue->Lock);
+  }
+  const bool Sent =
+      !atomic_load(&Queue->Closed) && !atomic_load(&Pipe->Aborted);
+  if (Sent) {
+    Queue->Slot[(Queue->Head + Queue->Count) % PIPE_QUEUE_MAX] = *Msg;
+    Queue->Count++;
+    // same as the esp side, only blocks count
+    if (Msg->Block != NULL && Queue->Count > Queue->High_Water) {
+      Queue->High_Water = Queue->Count;
+    }
+    pthread_cond_broadcast(&Queue->Changed);
+  }
+  pthread_mutex_unlock(&Queue->Lock);
+  return Sent;
+}
+
+static bool Pipe_Queue_Pop(PipeQueue *Queue, PipeMsg *Msg, Pipeline *Pipe) {
+  pthread_mutex_lock(&Queue->Lock);
+  while (Queue->Count == 0 && !atomic_load(&Pipe->Aborted)) {
+    pthread_cond_wait(&Queue->Changed, &Queue->Lock);
+  }
+  const bool Got = Queue->Count > 0 && !atomic_load(&Pipe->Aborted);
+  if (Got) {
+    *Msg = Queue->Slot[Queue->Head];
+    Queue->Head = (Queue->Head + 1) % PIPE_QUEUE_MAX;
+    Queue->Count--;
+    pthread_cond_broadcast(&Queue->Changed);
+  }
+  pthread_mutex_unlock(&Queue->Lock);
+  return Got;
+}
+
+static void Pipe_Queue_Close(PipeQueue *Queue, PoolMemoryInfo *Pool) {
+  pthread_mutex_lock(&Queue->Lock);
+  atomic_store(&Queue->Closed, true);
+  while (Queue->Count > 0) {
+    if (Queue->Slot[Queue->Head].Block != NULL) {
+      Pool_Free(Queue->Slot[Queue->Head].Block, Pool);
+    }
+    Queue->Head = (Queue->Head + 1) % PIPE_QUEUE_MAX;
+    Queue->Count--;
+  }
+  pthread_cond_broadcast(&Queue->Changed);
+  pthread_mutex_unlock(&Queue->Lock);
+}
+
+// the lock is taken so a waiter can't miss the flag between its check and
+// its wait
+static void Pipe_Queue_Wake(PipeQueue *Queue) {
+  pthread_mutex_lock(&Queue->Lock);
+  pthread_cond_broadcast(&Queue->Changed);
+  pthread_mutex_unlock(&Queue->Lock);
+}
+
+static void Pipe_Queue_Deinit(PipeQueue *Queue, PoolMemoryInfo *Pool) {
+  Pipe_Queue_Close(Queue, Pool);
+  pthread_cond_destroy(&Queue->Changed);
+  pthread_mutex_destroy(&Queue->Lock);
+}
+
+static void *Pipe_Thread(void *Argument) {
+  Pipe_Stage_Run((PipeStage *)Argument);
+  return NULL;
+}
+
+static int Pipe_Task_Start(PipeStage *Stage) {
+  return pthread_create(&Stage->Thread, NULL, Pipe_Thread, Stage) == 0 ? 0
+                                                                       : -1;
+}
+
+static void Pipe_Task_Join(Pipeline *Pipe, size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    pthread_join(Pipe->Stage[i].Thread, NULL);
+  }
+}
+
+static void Pipe_Sleep_ms(uint32_t Milliseconds) {
+  const struct timespec Sleep = {Milliseconds / 1000,
+                                 (long)(Milliseconds % 1000) * 1000000};
+  nanosleep(&Sleep, NULL);
+}
+#endif
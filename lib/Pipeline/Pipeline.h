@@ -0,0 +1,172 @@
+/*
+    Description: a chain of stages, each on its own task, joined by bounded
+    queues of pool blocks. a stage takes a message from the stage before,
+    works on it and sends blocks on to the next one. when the next queue is
+    full the send waits, and when the pool is empty so does the alloc, so a
+    slow stage holds the ones before it back instead of anything growing.
+    the same code runs on the esp32 with FreeRTOS tasks pinned to cores and
+    on the host with pthreads, where every stage's time and latency can be
+    measured without the board. see VoiceStages.h for the voice stages
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "MemoryPool.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#else
+#include <pthread.h>
+#endif
+
+#define PIPE_MAX_STAGES 8
+// most messages one queue holds
+#define PIPE_QUEUE_MAX 32
+// how long a wait on a queue goes before a close or abort is looked for,
+// esp32 only, the host wakes up straight away
+#define PIPE_POLL_MS 20
+
+typedef struct { // one message, copied into the queue by value
+  void *Block;       // from the pipeline's pool, whoever takes it frees it
+  uint32_t Length;   // bytes used
+  uint32_t Sequence; // per stage, from 0
+  int64_t Born_us;   // when the audio or text it came from arrived
+} PipeMsg;
+
+typedef struct {
+  PipeMsg Slot[PIPE_QUEUE_MAX];
+  size_t Depth;
+  size_t High_Water;
+  atomic_bool Closed; // nothing more goes in, sends fail
+#ifdef ESP_PLATFORM
+  QueueHandle_t Handle;
+  StaticQueue_t Storage;
+#else
+  pthread_mutex_t Lock;
+  pthread_cond_t Changed;
+  size_t Head;
+  size_t Count;
+#endif
+} PipeQueue;
+
+typedef enum {
+  PIPE_MORE = 0, // call again
+  PIPE_END,      // the stage is done, the end goes on to the next one
+  PIPE_ERROR,    // the whole pipeline stops
+} PipeResult;
+
+typedef struct PipeStage PipeStage;
+typedef struct Pipeline Pipeline;
+
+// a source (the first stage) gets In NULL and is called until it stops
+// returning PIPE_MORE. the others get each message in turn, its block is
+// freed after the call unless Pipe_Send passed it on or Pipe_Keep kept it.
+// once the stage before has ended they get one more call with In NULL to
+// send what they still hold. a Pull stage is called like a source and
+// takes its own messages with Pipe_Receive. a stage whose next one has
+// stopped taking is ended after the call
+typedef PipeResult (*PipeProcess)(PipeStage *Stage, PipeMsg *In);
+
+typedef struct {
+  const char *Name;
+  PipeProcess Process;
+  void *Ctx;
+  bool Pull;
+  size_t Queue_Depth; // messages that can wait for the next stage, unused
+                      // on the last
+  size_t Stack;       // esp32 only, bytes
+  int Priority;       // esp32 only
+  int Core;           // esp32 only, -1 for either
+} PipeStageConfig;
+
+typedef struct {
+  uint32_t In;           // messages taken
+  uint32_t Out;          // messages sent, or finished with by the last stage
+  uint32_t Pool_Waits;   // allocs that found the pool empty
+  size_t Queue_High_Water; // most blocks ever waiting in the next queue
+  int64_t Busy_us;       // in Process, less the waits below
+  int64_t Starved_us;    // waiting on the stage before
+  int64_t Blocked_us;    // waiting on the next queue or the pool, backpressure
+  int64_t Latency_us;    // summed over Out, from Born_us to the send or finish
+  int64_t Max_Latency_us;
+  int64_t First_Out_us;  // from the pipeline start, -1 before the first send
+  int64_t Ended_us;      // from the pipeline start
+} PipeStageStats;
+
+struct PipeStage {
+  PipeStageConfig Config;
+  Pipeline *Pipe;
+  PipeQueue *In_Queue;  // NULL for the source
+  PipeQueue *Out_Queue; // NULL for the last stage
+  void *In_Block;       // block of the message being worked on
+  int64_t Born_us;      // of the message being worked on, sends inherit it
+  bool Kept;            // In_Block was sent on or kept
+  bool Input_Ended;     // Pull stages, the end has been received
+  PipeResult Result;
+  PipeStageStats Stats; // written by the stage's task only
+#ifdef ESP_PLATFORM
+  TaskHandle_t Task;
+#else
+  pthread_t Thread;
+#endif
+};
+
+struct Pipeline {
+  PoolMemoryInfo *Pool; // every block in the chain, build with POOL_THREAD_SAFE
+  size_t Stage_Count;
+  PipeStage Stage[PIPE_MAX_STAGES];
+  PipeQueue Queue[PIPE_MAX_STAGES - 1];
+  atomic_bool Aborted;
+  bool Started;
+  int64_t Start_us;
+#ifdef ESP_PLATFORM
+  SemaphoreHandle_t Finished; // given by each stage as it returns
+  StaticSemaphore_t Finished_Storage;
+#endif
+};
+
+// The PUBLIC functions that users can call
+// -1 without stages or with more than PIPE_MAX_STAGES, a stage without a
+// Process or a queue depth outside 1 to PIPE_QUEUE_MAX
+int Pipeline_Ini(Pipeline *Pipe, PoolMemoryInfo *Pool,
+                 const PipeStageConfig *Stages, size_t Stage_Count);
+// every stage's task, -1 if one couldn't be made and the rest were stopped
+int Pipeline_Start(Pipeline *Pipe);
+// until every stage has returned. 0 when they all ended, -1 after an error
+// or an abort
+int Pipeline_Wait(Pipeline *Pipe);
+// from any task, every stage returns at its next wait
+void Pipeline_Abort(Pipeline *Pipe);
+// once Pipeline_Wait has returned
+void Pipeline_Get_Stats(Pipeline *Pipe, size_t Stage, PipeStageStats *Stats);
+// blocks still queued go back to the pool
+void Pipeline_Deinit(Pipeline *Pipe);
+
+// for the stages. a block of Size from the pool, waiting while it is
+// empty. NULL once the pipeline is aborted or the next stage has gone
+void *Pipe_Alloc(PipeStage *Stage, size_t Size);
+// Block to the next stage, which frees it. waits while the queue is full.
+// false and the block is freed once the pipeline is aborted or the next
+// stage has stopped taking, the stage should then return PIPE_END
+bool Pipe_Send(PipeStage *Stage, void *Block, uint32_t Length);
+// same with the time its data arrived, for a source
+bool Pipe_Send_At(PipeStage *Stage, void *Block, uint32_t Length,
+                  int64_t Born_us);
+// the message's block stays with the stage, it frees or sends it later
+void Pipe_Keep(PipeStage *Stage);
+// Pull stages. the next message, the block is the stage's and the stage
+// frees it. false at the end or after an abort
+bool Pipe_Receive(PipeStage *Stage, PipeMsg *Msg);
+void Pipe_Free(PipeStage *Stage, void *Block);
+int64_t Pipe_Now_us(void);
+
+#endif // PIPELINE_H
@@ -0,0 +1,249 @@
+/*
+    Description: the voice pipeline on the board, see VoicePipeline.h. the
+    capture stage is a source polling the i2s ring, the upload stage pulls
+    the encoded blocks itself because the gemini call reads its body
+    through a callback. the pool has to hold, on top of the capture ring
+    and pre-roll, a frame for every slot in the first two queues and the
+    vad onset, an AUDIO_CODEC_OUT_MAX block for every slot after encode and
+    small blocks for the text queues, plus one of each in the stages' hands
+    Creator: Matthew Ayestaran
+*/
+
+#ifdef ESP_PLATFORM
+
+#include "VoicePipeline.h"
+#include "GeminiAPI.h"
+#include "I2S_Audio_Controller.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "Voice_Pipeline";
+
+// reply text is cut into blocks no bigger than this
+#define VOICE_TEXT_BLOCK 256
+
+typedef struct {
+  VoicePipelineConfig Config;
+  Pipeline Pipe;
+  VoiceConvertCtx Convert;
+  VoiceEncodeCtx Encode;
+  VoiceSentenceCtx Sentence;
+  VoiceSpeechCtx Speech;
+  volatile bool Recording; // cleared by the button, capture drains the ring
+  volatile bool Running;
+  PipeMsg Upload_Msg; // encoded block the upload is part way through
+  size_t Upload_Pos;
+  bool Upload_Holding;
+} VoicePipelineState;
+
+static VoicePipelineState Voice;
+
+// PROTOTYPES
+esp_err_t Voice_Pipeline_Run(const VoicePipelineConfig *Config,
+                             PoolMemoryInfo *Pool, size_t Frame_Samples);
+void Voice_Pipeline_Stop_Recording(void);
+void Voice_Pipeline_Abort(void);
+void Voice_Pipeline_Log_Stats(void);
+static PipeResult Voice_Capture_Stage(PipeStage *Stage, PipeMsg *In);
+static PipeResult Voice_Upload_Stage(PipeStage *Stage, PipeMsg *In);
+static int Voice_Upload_Read(void *Ctx, uint8_t *Buf, size_t Size);
+static bool Voice_Upload_Text(void *Ctx, const char *Text, size_t Len);
+
+// core 0 has the i2s task and the wifi, so capture, convert and upload
+// sit there. encode is the heaviest per frame and gets core 1 with the
+// text stages, which only wake up once the answer comes
+static const PipeStageConfig Voice_Stages[VOICE_STAGE_COUNT] = {
+    [VOICE_STAGE_CAPTURE] = {.Name = "voice_capture",
+                             .Process = Voice_Capture_Stage,
+                             .Queue_Depth = 8,
+                             .Stack = 2048,
+                             .Priority = configMAX_PRIORITIES - 3,
+                             .Core = 0},
+    [VOICE_STAGE_CONVERT] = {.Name = "voice_convert",
+                             .Process = Voice_Convert_Stage,
+                             .Ctx = &Voice.Convert,
+                             .Queue_Depth = 8,
+                             .Stack = 3072,
+                             .Priority = configMAX_PRIORITIES - 4,
+                             .Core = 0},
+    [VOICE_STAGE_ENCODE] = {.Name = "voice_encode",
+                            .Process = Voice_Encode_Stage,
+                            .Ctx = &Voice.Encode,
+                            .Queue_Depth = 8,
+                            .Stack = 4096,
+                            .Priority = configMAX_PRIORITIES - 4,
+                            .Core = 1},
+    [VOICE_STAGE_UPLOAD] = {.Name = "voice_upload",
+                            .Process = Voice_Upload_Stage,
+                            .Pull = true,
+                            .Queue_Depth = 16,
+                            .Stack = 10240, // tls
+                            .Priority = configMAX_PRIORITIES - 5,
+                            .Core = 0},
+    [VOICE_STAGE_SENTENCE] = {.Name = "voice_sentence",
+                              .Process = Voice_Sentence_Stage,
+                              .Ctx = &Voice.Sentence,
+                              .Queue_Depth = 4,
+                              .Stack = 3072,
+                              .Priority = configMAX_PRIORITIES - 5,
+                              .Core = 1},
+    [VOICE_STAGE_SPEECH] = {.Name = "voice_speech",
+                            .Process = Voice_Speech_Stage,
+                            .Ctx = &Voice.Speech,
+                            .Stack = 4096,
+                            .Priority = configMAX_PRIORITIES - 5,
+                            .Core = 1},
+};
+
+esp_err_t Voice_Pipeline_Run(const VoicePipelineConfig *Config,
+                             PoolMemoryInfo *Pool, size_t Frame_Samples) {
+  if (Voice.Running) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&Voice, 0, sizeof(Voice));
+  Voice.Config = *Config;
+  Voice.Convert.Convert = Config->Convert;
+  Voice.Convert.Use_Vad = Config->Use_Vad;
+  Voice.Speech.Speak = Config->Speak;
+  Voice.Speech.Ctx = Config->Speak_Ctx;
+  if (Config->Speak == NULL ||
+      Audio_Encoder_Ini(&Voice.Encode.Encoder, &Config->Encoder) != 0 ||
+      (Config->Use_Vad &&
+       Audio_Vad_Ini(&Voice.Convert.Vad, &Config->Vad, Pool,
+                     Config->Encoder.Sample_Rate, Frame_Samples) != 0) ||
+      Pipeline_Ini(&Voice.Pipe, Pool, Voice_Stages, VOICE_STAGE_COUNT) != 0) {
+    ESP_LOGE(TAG, "Bad pipeline config");
+    return ESP_ERR_INVALID_ARG;
+  }
+  Voice.Recording = true;
+  Voice.Running = true;
+  esp_err_t Err = ESP_OK;
+  if (Pipeline_Start(&Voice.Pipe) != 0) {
+    Err = ESP_ERR_NO_MEM;
+  } else if (Pipeline_Wait(&Voice.Pipe) != 0) {
+    Err = ESP_FAIL;
+  }
+  Pipeline_Deinit(&Voice.Pipe);
+  Voice.Running = false;
+  Gemini_Prewarm_Done(); // the radio can go back to power save
+  return Err;
+}
+
+void Voice_Pipeline_Stop_Recording(void) { Voice.Recording = false; }
+
+void Voice_Pipeline_Abort(void) {
+  if (Voice.Running) {
+    Pipeline_Abort(&Voice.Pipe);
+  }
+  Gemini_Prewarm_Cancel(); // a prewarm the upload hasn't claimed yet
+}
+
+void Voice_Pipeline_Log_Stats(void) {
+  for (size_t i = 0; i < VOICE_STAGE_COUNT; i++) {
+    PipeStageStats Stats;
+    Pipeline_Get_Stats(&Voice.Pipe, i, &Stats);
+    ESP_LOGI(TAG,
+             "%-14s in %4u out %4u busy %5lld ms starved %5lld ms blocked "
+             "%5lld ms latency %5lld ms (max %5lld) first out %5lld ms",
+             Voice_Stages[i].Name, (unsigned)Stats.In, (unsigned)Stats.Out,
+             Stats.Busy_us / 1000, Stats.Starved_us / 1000,
+             Stats.Blocked_us / 1000,
+             Stats.Out ? Stats.Latency_us / Stats.Out / 1000 : 0,
+             Stats.Max_Latency_us / 1000, Stats.First_Out_us / 1000);
+  }
+}
+
+// after the button the ring is emptied before the end goes on
+static PipeResult Voice_Capture_Stage(PipeStage *Stage, PipeMsg *In) {
+  const bool Recording = Voice.Recording;
+  AudioFrame *Frame =
+      I2S_Audio_Take_Frame(Recording ? pdMS_TO_TICKS(PIPE_POLL_MS) : 0);
+  if (Frame == NULL) {
+    return Recording ? PIPE_MORE : PIPE_END;
+  }
+  return Pipe_Send_At(Stage, Frame,
+                      (uint32_t)(Frame->Sample_Count * sizeof(int32_t)),
+                      Frame->Timestamp_us)
+             ? PIPE_MORE
+             : PIPE_END;
+}
+
+// the whole exchange, the body is read from the queue as it fills. the
+// encoded blocks wait in the queue while the network comes up
+static PipeResult Voice_Upload_Stage(PipeStage *Stage, PipeMsg *In) {
+  if (Voice.Config.Network_Ready != NULL &&
+      !Voice.Config.Network_Ready(
+          Voice.Config.Network_Ctx,
+          esp_timer_get_time() +
+              (int64_t)Voice.Config.Network_Wait_ms * 1000)) {
+    ESP_LOGE(TAG, "Network not up within %lu ms, question dropped",
+             (unsigned long)Voice.Config.Network_Wait_ms);
+    return PIPE_ERROR;
+  }
+  const GeminiAudioQuestion Question = {
+      .cached_content_name = Voice.Config.Cached_Content_Name,
+      .prompt = Voice.Config.Prompt,
+      .sample_rate = Voice.Config.Encoder.Sample_Rate,
+      .ctx = Stage,
+      .read_encoded = Voice_Upload_Read,
+      .mime_type = Voice.Config.Encoder.Codec->Mime_Type,
+  };
+  parsed_response_t *Response =
+      Gemini_Api_Audio_Stream(&Question, Voice_Upload_Text, Stage);
+  if (Voice.Upload_Holding) {
+    Pipe_Free(Stage, Voice.Upload_Msg.Block);
+    Voice.Upload_Holding = false;
+  }
+  if (Response == NULL) {
+    ESP_LOGE(TAG, "Upload failed");
+    return PIPE_ERROR;
+  }
+  Gemini_Free_Response(Response);
+  return PIPE_END;
+}
+
+// gemini_bytes_read_t
+static int Voice_Upload_Read(void *Ctx, uint8_t *Buf, size_t Size) {
+  PipeStage *Stage = (PipeStage *)Ctx;
+  if (!Voice.Upload_Holding) {
+    if (!Pipe_Receive(Stage, &Voice.Upload_Msg)) {
+      return atomic_load(&Stage->Pipe->Aborted) ? -1 : 0;
+    }
+    Voice.Upload_Holding = true;
+    Voice.Upload_Pos = 0;
+  }
+  size_t Take = Voice.Upload_Msg.Length - Voice.Upload_Pos;
+  if (Take > Size) {
+    Take = Size;
+  }
+  memcpy(Buf, (const uint8_t *)Voice.Upload_Msg.Block + Voice.Upload_Pos,
+         Take);
+  Voice.Upload_Pos += Take;
+  if (Voice.Upload_Pos == Voice.Upload_Msg.Length) {
+    Pipe_Free(Stage, Voice.Upload_Msg.Block);
+    Voice.Upload_Holding = false;
+  }
+  return (int)Take;
+}
+
+// gemini_text_cb_t, false stops the stream once nobody is listening
+static bool Voice_Upload_Text(void *Ctx, const char *Text, size_t Len) {
+  PipeStage *Stage = (PipeStage *)Ctx;
+  for (size_t Done = 0; Done < Len;) {
+    const size_t Take =
+        Len - Done < VOICE_TEXT_BLOCK ? Len - Done : VOICE_TEXT_BLOCK;
+    char *Block = Pipe_Alloc(Stage, Take);
+    if (Block == NULL) {
+      return false;
+    }
+    memcpy(Block, Text + Done, Take);
+    if (!Pipe_Send(Stage, Block, (uint32_t)Take)) {
+      return false;
+    }
+    Done += Take;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+    Description: one spoken question as a Pipeline on both cores instead of
+    record, then send, then wait, then speak. capture takes the frames
+    from I2S_Audio_Controller, convert and the voice detector run next to
+    it on core 0, encode runs on core 1, upload streams the file to gemini
+    while it is still being recorded and sends the reply text on as it
+    arrives, on core 0 with the wifi, and sentence and speech hand the
+    answer to Speak on core 1 a sentence at a time, so the first one is
+    spoken while the rest is still coming in
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef VOICE_PIPELINE_H
+#define VOICE_PIPELINE_H
+
+#include "VoiceStages.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+
+typedef enum {
+  VOICE_STAGE_CAPTURE = 0,
+  VOICE_STAGE_CONVERT,
+  VOICE_STAGE_ENCODE,
+  VOICE_STAGE_UPLOAD,
+  VOICE_STAGE_SENTENCE,
+  VOICE_STAGE_SPEECH,
+  VOICE_STAGE_COUNT,
+} VoiceStageIndex;
+
+// true when the network is up by Deadline_us (esp_timer_get_time), false
+// as soon as it can't be. wifi_manager_wait_warm fits behind it
+typedef bool (*VoiceNetworkFn)(void *Ctx, int64_t Deadline_us);
+
+typedef struct {
+  AudioConvertParams Convert; // the i2s capture should run with Keep_Slots
+  bool Use_Vad;
+  AudioVadConfig Vad;
+  AudioEncoderConfig Encoder;
+  const char *Prompt;         // optional text sent ahead of the clip
+  char *Cached_Content_Name;  // optional
+  VoiceSpeakFn Speak;
+  void *Speak_Ctx;
+  // optional, asked before the upload. a question that can't be sent in
+  // Network_Wait_ms fails straight away instead of in the http timeout
+  VoiceNetworkFn Network_Ready;
+  void *Network_Ctx;
+  uint32_t Network_Wait_ms;
+} VoicePipelineConfig;
+
+#define VOICE_PIPELINE_CONFIG_DEFAULT                                          \
+  {                                                                            \
+    .Convert = AUDIO_CONVERT_SPH0645, .Use_Vad = true,                         \
+    .Vad = AUDIO_VAD_CONFIG_DEFAULT,                                           \
+    .Encoder = {.Codec = &Audio_Codec_Flac, .Sample_Rate = 16000,              \
+                .Drop_Bits = 6},                                               \
+    .Network_Wait_ms = 3000,                                                   \
+  }
+
+// The PUBLIC functions that users can call
+// one question and its answer. the capture has to be set up with
+// I2S_Audio_Ini on Pool and armed or started. returns once the answer has
+// been handed to Speak, ESP_FAIL if a stage failed. with Voice_Tts_Speak
+// the end may still be playing, I2S_Speaker_Wait_Idle waits for it. Pool
+// needs room for the frames the queues hold on top of the capture's, see
+// VoicePipeline.c
+esp_err_t Voice_Pipeline_Run(const VoicePipelineConfig *Config,
+                             PoolMemoryInfo *Pool, size_t Frame_Samples);
+// from the button task, the recording is over. capture sends what is left
+// in the ring and ends
+void Voice_Pipeline_Stop_Recording(void);
+// from any task, drops the question
+void Voice_Pipeline_Abort(void);
+// per stage times and latency of the last run, in the log
+void Voice_Pipeline_Log_Stats(void);
+#endif
+
+#endif // VOICE_PIPELINE_H
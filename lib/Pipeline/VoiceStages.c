@@ -0,0 +1,181 @@
+/*
+    Description: voice stages, see VoiceStages.h. a frame travels from
+    capture to encode as the same pool block, converted in place, and the
+    vad keeps the frames of an onset itself until it knows they are speech
+    Creator: Matthew Ayestaran
+*/
+
+#include "VoiceStages.h"
+#include <string.h>
+
+// PROTOTYPES
+PipeResult Voice_Convert_Stage(PipeStage *Stage, PipeMsg *In);
+PipeResult Voice_Encode_Stage(PipeStage *Stage, PipeMsg *In);
+PipeResult Voice_Sentence_Stage(PipeStage *Stage, PipeMsg *In);
+PipeResult Voice_Speech_Stage(PipeStage *Stage, PipeMsg *In);
+static bool Voice_Send_Frame(PipeStage *Stage, AudioFrame *Frame);
+static bool Voice_Send_Encoded(PipeStage *Stage, VoiceEncodeCtx *Ctx,
+                               const int16_t *Pcm, size_t Count);
+static bool Voice_Sentence_End(const VoiceSentenceCtx *Ctx, char Next);
+static bool Voice_Send_Sentence(PipeStage *Stage, VoiceSentenceCtx *Ctx,
+                                size_t Len);
+
+PipeResult Voice_Convert_Stage(PipeStage *Stage, PipeMsg *In) {
+  VoiceConvertCtx *Ctx = (VoiceConvertCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    if (Ctx->Use_Vad) {
+      Audio_Vad_Finish(&Ctx->Vad); // an onset still held goes back
+    }
+    return PIPE_END;
+  }
+  AudioFrame *Frame = (AudioFrame *)In->Block;
+  if (Frame->Format == AUDIO_FORMAT_I2S32) {
+    Audio_Convert(Frame->Data, Audio_Frame_Pcm16(Frame), Frame->Sample_Count,
+                  &Ctx->Convert);
+    Frame->Format = AUDIO_FORMAT_PCM16;
+  }
+  if (!Ctx->Use_Vad) {
+    return Voice_Send_Frame(Stage, Frame) ? PIPE_MORE : PIPE_END;
+  }
+  Pipe_Keep(Stage); // the vad frees or hands back every frame
+  AudioFrame *Out[AUDIO_VAD_MAX_OUT];
+  uint32_t Events = 0;
+  const size_t Count = Audio_Vad_Push(&Ctx->Vad, Frame, Out, &Events);
+  bool Sent = true;
+  for (size_t i = 0; i < Count; i++) {
+    if (Sent) {
+      Sent = Voice_Send_Frame(Stage, Out[i]);
+    } else {
+      Pipe_Free(Stage, Out[i]);
+    }
+  }
+  return Sent && !(Events & AUDIO_VAD_EVENT_END) ? PIPE_MORE : PIPE_END;
+}
+
+PipeResult Voice_Encode_Stage(PipeStage *Stage, PipeMsg *In) {
+  VoiceEncodeCtx *Ctx = (VoiceEncodeCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    return Voice_Send_Encoded(Stage, Ctx, NULL, 0) ? PIPE_END : PIPE_ERROR;
+  }
+  const AudioFrame *Frame = (const AudioFrame *)In->Block;
+  const int16_t *Pcm = Audio_Frame_Pcm16((AudioFrame *)Frame);
+  for (size_t Done = 0; Done < Frame->Sample_Count;) {
+    size_t Count = Frame->Sample_Count - Done;
+    if (Count > Ctx->Encoder.Block_Samples) {
+      Count = Ctx->Encoder.Block_Samples;
+    }
+    if (!Voice_Send_Encoded(Stage, Ctx, Pcm + Done, Count)) {
+      return PIPE_END;
+    }
+    Done += Count;
+  }
+  return PIPE_MORE;
+}
+
+// a sentence ends at a line break, or at a stop with a space after it so
+// 3.5 stays whole. a sentence that won't fit is cut at its last
+// space and the rest carries on
+PipeResult Voice_Sentence_Stage(PipeStage *Stage, PipeMsg *In) {
+  VoiceSentenceCtx *Ctx = (VoiceSentenceCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    return Ctx->Len == 0 || Voice_Send_Sentence(Stage, Ctx, Ctx->Len)
+               ? PIPE_END
+               : PIPE_ERROR;
+  }
+  const char *Text = (const char *)In->Block;
+  for (size_t i = 0; i < In->Length; i++) {
+    const char Next = Text[i];
+    if (Next == '*' || Next == '#' || Next == '`') {
+      continue;
+    }
+    if (Voice_Sentence_End(Ctx, Next)) {
+      if (!Voice_Send_Sentence(Stage, Ctx, Ctx->Len)) {
+        return PIPE_END;
+      }
+      continue;
+    }
+    if (Ctx->Len == 0 && (Next == ' ' || Next == '\t' || Next == '\r' ||
+                          Next == '\n')) {
+      continue;
+    }
+    if (Ctx->Len == VOICE_SENTENCE_MAX - 1) {
+      size_t Cut = Ctx->Len;
+      while (Cut > 0 && Ctx->Text[Cut - 1] != ' ') {
+        Cut--;
+      }
+      if (!Voice_Send_Sentence(Stage, Ctx, Cut > 0 ? Cut : Ctx->Len)) {
+        return PIPE_END;
+      }
+    }
+    Ctx->Text[Ctx->Len++] = Next;
+  }
+  return PIPE_MORE;
+}
+
+PipeResult Voice_Speech_Stage(PipeStage *Stage, PipeMsg *In) {
+  VoiceSpeechCtx *Ctx = (VoiceSpeechCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    return PIPE_END;
+  }
+  return Ctx->Speak(Ctx->Ctx, (const char *)In->Block, In->Length)
+             ? PIPE_MORE
+             : PIPE_END;
+}
+
+static bool Voice_Send_Frame(PipeStage *Stage, AudioFrame *Frame) {
+  return Pipe_Send_At(Stage, Frame,
+                      (uint32_t)(Frame->Sample_Count * sizeof(int16_t)),
+                      Frame->Timestamp_us);
+}
+
+// Pcm NULL finishes the file. an encoder that had nothing to put out yet
+// gives its block straight back
+static bool Voice_Send_Encoded(PipeStage *Stage, VoiceEncodeCtx *Ctx,
+                               const int16_t *Pcm, size_t Count) {
+  uint8_t *Out = Pipe_Alloc(Stage, AUDIO_CODEC_OUT_MAX);
+  if (Out == NULL) {
+    return false;
+  }
+  const size_t Len = Pcm != NULL
+                         ? Audio_Encoder_Push(&Ctx->Encoder, Pcm, Count, Out)
+                         : Audio_Encoder_Finish(&Ctx->Encoder, Out);
+  if (Len == 0) {
+    Pipe_Free(Stage, Out);
+    return true;
+  }
+  return Pipe_Send(Stage, Out, (uint32_t)Len);
+}
+
+static bool Voice_Sentence_End(const VoiceSentenceCtx *Ctx, char Next) {
+  if (Next == '\n') {
+    return Ctx->Len > 0;
+  }
+  if (Ctx->Len == 0 || (Next != ' ' && Next != '\t')) {
+    return false;
+  }
+  const char Last = Ctx->Text[Ctx->Len - 1];
+  return Last == '.' || Last == '!' || Last == '?' || Last == ':' ||
+         Last == ';';
+}
+
+// the first Len characters go, what is left moves to the front
+static bool Voice_Send_Sentence(PipeStage *Stage, VoiceSentenceCtx *Ctx,
+                                size_t Len) {
+  size_t Send_Len = Len;
+  while (Send_Len > 0 && Ctx->Text[Send_Len - 1] == ' ') {
+    Send_Len--;
+  }
+  bool Sent = true;
+  if (Send_Len > 0) {
+    char *Sentence = Pipe_Alloc(Stage, Send_Len + 1);
+    if (Sentence == NULL) {
+      return false;
+    }
+    memcpy(Sentence, Ctx->Text, Send_Len);
+    Sentence[Send_Len] = '\0';
+    Sent = Pipe_Send(Stage, Sentence, (uint32_t)Send_Len);
+  }
+  Ctx->Len -= Len;
+  memmove(Ctx->Text, Ctx->Text + Len, Ctx->Len);
+  return Sent;
+}
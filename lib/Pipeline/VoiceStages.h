@@ -0,0 +1,58 @@
+/*
+    Description: the stages of a spoken question that don't need the board,
+    for a Pipeline. frames go through convert (with the voice detector),
+    encode, and the reply text through sentence, which cuts it where a
+    speech engine can start, and speech, which hands each sentence over.
+    the capture and upload stages around them are in VoicePipeline.h, the
+    host test and bench put fakes there instead. every block is from the
+    pipeline's pool, the capture frames and the vad's included
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef VOICE_STAGES_H
+#define VOICE_STAGES_H
+
+#include "AudioCapture.h"
+#include "AudioCodec.h"
+#include "AudioConvert.h"
+#include "AudioVad.h"
+#include "Pipeline.h"
+
+// longest sentence handed to speech, a longer one is cut at a space
+#define VOICE_SENTENCE_MAX 256
+
+// Ctx of the speech stage. false stops the answer
+typedef bool (*VoiceSpeakFn)(void *Ctx, const char *Text, size_t Len);
+
+typedef struct { // Ctx of the convert stage
+  AudioConvertParams Convert;
+  bool Use_Vad; // the question ends when speech does
+  AudioVad Vad; // set up by the caller with Audio_Vad_Ini
+} VoiceConvertCtx;
+
+typedef struct { // Ctx of the encode stage
+  AudioEncoder Encoder; // set up by the caller with Audio_Encoder_Ini
+} VoiceEncodeCtx;
+
+typedef struct { // Ctx of the sentence stage, zeroed before the start
+  char Text[VOICE_SENTENCE_MAX];
+  size_t Len;
+} VoiceSentenceCtx;
+
+typedef struct { // Ctx of the speech stage
+  VoiceSpeakFn Speak;
+  void *Ctx;
+} VoiceSpeechCtx;
+
+// frames in, AUDIO_FORMAT_I2S32 ones are converted in place. frames out,
+// oldest first, with the time they were captured
+PipeResult Voice_Convert_Stage(PipeStage *Stage, PipeMsg *In);
+// pcm frames in, encoded bytes out in AUDIO_CODEC_OUT_MAX blocks
+PipeResult Voice_Encode_Stage(PipeStage *Stage, PipeMsg *In);
+// reply text in, split anywhere. nul terminated sentences out, without the
+// markdown marks that would be read aloud
+PipeResult Voice_Sentence_Stage(PipeStage *Stage, PipeMsg *In);
+// sentences in, last stage
+PipeResult Voice_Speech_Stage(PipeStage *Stage, PipeMsg *In);
+
+#endif // VOICE_STAGES_H
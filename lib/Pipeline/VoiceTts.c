@@ -0,0 +1,90 @@
+/*
+    Description: text to speech into the speaker, see VoiceTts.h. a
+    sentence the service turned down is skipped and the answer goes on, a
+    connection that can't be made ends it
+    Creator: Matthew Ayestaran
+*/
+
+#ifdef ESP_PLATFORM
+
+#include "VoiceTts.h"
+#include "I2S_Audio_Speaker.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "Voice_Tts";
+
+typedef struct {
+  gemini_session_t Session;
+  gemini_esp_tls_t Tls;
+  tts_client_t Client;
+  bool Ready;
+} VoiceTtsState;
+
+static VoiceTtsState Tts;
+
+// PROTOTYPES
+esp_err_t Voice_Tts_Ini(const char *Host, int Port, const tts_config_t *Config);
+esp_err_t Voice_Tts_Connect(void);
+bool Voice_Tts_Speak(void *Ctx, const char *Text, size_t Len);
+void Voice_Tts_Deinit(void);
+static bool Voice_Tts_Pcm(void *Ctx, const int16_t *Samples, size_t Count);
+
+esp_err_t Voice_Tts_Ini(const char *Host, int Port, const tts_config_t *Config) {
+  if (Host == NULL || Config == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (Tts.Ready) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&Tts, 0, sizeof(Tts));
+  gemini_transport_t Transport;
+  const gemini_session_policy_t Policy = GEMINI_SESSION_POLICY_DEFAULT;
+  gemini_transport_esp_tls(&Transport, &Tts.Tls);
+  gemini_session_init(&Tts.Session, &Transport, Host, Port, &Policy);
+  tts_client_init(&Tts.Client, &Tts.Session, Config);
+  Tts.Ready = true;
+  return ESP_OK;
+}
+
+esp_err_t Voice_Tts_Connect(void) {
+  if (!Tts.Ready) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return gemini_session_connect(&Tts.Session) == GEMINI_SESSION_OK
+             ? ESP_OK
+             : ESP_FAIL;
+}
+
+bool Voice_Tts_Speak(void *Ctx, const char *Text, size_t Len) {
+  if (!Tts.Ready) {
+    return false;
+  }
+  tts_err_t Err = tts_client_speak(&Tts.Client, Text, Len, Voice_Tts_Pcm, NULL);
+  I2S_Speaker_Mark_End(); // what came plays out, whole or not
+  if (Err != TTS_OK) {
+    ESP_LOGW(TAG, "Sentence not spoken: %s", tts_err_name(Err));
+    return Err == TTS_ERR_STATUS || Err == TTS_ERR_ARG;
+  }
+  ESP_LOGI(TAG,
+           "%s connection, first audio %lld ms, %u samples in %lld ms",
+           Tts.Client.timing.reused ? "Warm" : "Cold",
+           Tts.Client.timing.first_audio_us / 1000,
+           (unsigned)Tts.Client.timing.samples,
+           Tts.Client.timing.total_us / 1000);
+  return true;
+}
+
+void Voice_Tts_Deinit(void) {
+  if (Tts.Ready) {
+    gemini_session_close(&Tts.Session);
+  }
+  memset(&Tts, 0, sizeof(Tts));
+}
+
+// tts_pcm_cb_t, waits for the speaker to make room
+static bool Voice_Tts_Pcm(void *Ctx, const int16_t *Samples, size_t Count) {
+  return I2S_Speaker_Write(Samples, Count, portMAX_DELAY) == Count;
+}
+
+#endif
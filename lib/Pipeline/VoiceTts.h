@@ -0,0 +1,34 @@
+/*
+    Description: the speech end of the voice pipeline on the board. each
+    sentence from the speech stage goes to the text to speech service on
+    its own kept-alive connection and the audio is written to the
+    I2S_Audio_Speaker ring as it downloads. the speak call returns once the
+    sentence is all in the ring, not once it has been heard, so the next
+    sentence is requested while this one is still playing. its tls session
+    is kept in nvs apart from the gemini connection's, both resume after a
+    reboot
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef VOICE_TTS_H
+#define VOICE_TTS_H
+
+#include "TtsClient.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+
+// The PUBLIC functions that users can call
+// the speaker has to be set up with I2S_Audio_Speaker at Config's sample
+// rate and started. Config and its strings must outlive it.
+// ESP_ERR_INVALID_STATE when it is already set up
+esp_err_t Voice_Tts_Ini(const char *Host, int Port, const tts_config_t *Config);
+// opens the connection ahead of the first sentence, from the button press
+// so the handshake is done while the question is still being asked
+esp_err_t Voice_Tts_Connect(void);
+// a VoiceSpeakFn, Ctx unused. false if the service can't be reached
+bool Voice_Tts_Speak(void *Ctx, const char *Text, size_t Len);
+void Voice_Tts_Deinit(void);
+#endif
+
+#endif // VOICE_TTS_H
@@ -0,0 +1,165 @@
+/*
+    Description: text to speech client, see TtsClient.h. the status line is
+    in before the body starts, so the body callback already knows whether
+    it is reading audio or an error to log. samples are put back together
+    from little endian bytes through a small buffer on the stack, the reads
+    split them anywhere
+    Creator: Matthew Ayestaran
+*/
+#include "TtsClient.h"
+#include "GeminiPayload.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#endif
+
+// samples handed on per callback at most
+#define TTS_PCM_STEP 128
+
+#ifdef ESP_PLATFORM
+static const char *TAG = "TtsClient";
+#endif
+
+//PROTOTYPES
+void tts_client_init(tts_client_t *client, gemini_session_t *session, const tts_config_t *config);
+tts_err_t tts_client_speak(tts_client_t *client, const char *text, size_t len, tts_pcm_cb_t on_pcm,
+                           void *ctx);
+const char *tts_err_name(tts_err_t err);
+static bool tts_write_body(tts_client_t *client, const char *text, size_t len);
+static bool tts_on_body(void *ctx, const char *data, size_t len);
+static bool tts_hand_on(tts_client_t *client, const int16_t *samples, size_t count);
+
+void tts_client_init(tts_client_t *client, gemini_session_t *session, const tts_config_t *config) {
+    const tts_config_t default_config = TTS_CONFIG_DEFAULT;
+    memset(client, 0, sizeof(*client));
+    client->session = session;
+    client->config = config ? *config : default_config;
+    if (client->config.api_key) {
+        snprintf(client->auth, sizeof(client->auth), "Bearer %s", client->config.api_key);
+    }
+}
+
+tts_err_t tts_client_speak(tts_client_t *client, const char *text, size_t len, tts_pcm_cb_t on_pcm,
+                           void *ctx) {
+    if (!client || !client->session || !text || len == 0 || !on_pcm || !tts_write_body(client, text, len)) {
+        return TTS_ERR_ARG;
+    }
+    const gemini_header_t headers[] = {
+        { "Content-Type", "application/json" },
+        { "Authorization", client->auth },
+    };
+    const gemini_request_t request = {
+        .method = "POST",
+        .path = client->config.path,
+        .headers = headers,
+        .header_count = client->auth[0] ? 2 : 1,
+        .body = client->body,
+        .body_len = strlen(client->body),
+        .on_body = tts_on_body,
+        .ctx = client,
+    };
+    client->on_pcm = on_pcm;
+    client->ctx = ctx;
+    client->status = 0;
+    client->has_carry = false;
+    client->error_len = 0;
+    memset(&client->timing, 0, sizeof(client->timing));
+
+    client->session_err = gemini_session_request(client->session, &request, &client->status);
+    const gemini_session_timing_t *timing = &client->session->timing;
+    client->timing.ttfb_us = timing->ttfb_us;
+    client->timing.total_us = timing->total_us;
+    client->timing.reused = timing->reused;
+    if (client->session_err == GEMINI_SESSION_ERR_ABORTED && client->status == 200) {
+        return TTS_ERR_ABORTED;
+    }
+    if (client->session_err != GEMINI_SESSION_OK) {
+#ifdef ESP_PLATFORM
+        ESP_LOGE(TAG, "Request failed: %s", gemini_session_err_name(client->session_err));
+#endif
+        return TTS_ERR_SESSION;
+    }
+    if (client->status != 200) {
+        client->error_head[client->error_len] = '\0';
+#ifdef ESP_PLATFORM
+        ESP_LOGE(TAG, "HTTP Status = %d: %s", client->status, client->error_head);
+#endif
+        return TTS_ERR_STATUS;
+    }
+    client->sentences++;
+    return TTS_OK;
+}
+
+const char *tts_err_name(tts_err_t err) {
+    switch (err) {
+        case TTS_OK:          return "ok";
+        case TTS_ERR_ARG:     return "bad argument";
+        case TTS_ERR_SESSION: return "request failed";
+        case TTS_ERR_STATUS:  return "error status";
+        case TTS_ERR_ABORTED: return "aborted";
+    }
+    return "unknown";
+}
+
+// the text is escaped the same way gemini questions are, false when it
+// won't fit
+static bool tts_write_body(tts_client_t *client, const char *text, size_t len) {
+    char plain[TTS_TEXT_MAX + 1];
+    char escaped[TTS_TEXT_MAX + 1];
+    if (len > TTS_TEXT_MAX) {
+        return false;
+    }
+    memcpy(plain, text, len);
+    plain[len] = '\0';
+    if (gemini_payload_escape(plain, escaped, sizeof(escaped)) == 0) {
+        return false;
+    }
+    int written = snprintf(client->body, sizeof(client->body),
+                           "{\"model\":\"%s\",\"voice\":\"%s\",\"response_format\":\"pcm\",\"input\":\"%s\"}",
+                           client->config.model, client->config.voice, escaped);
+    return written > 0 && (size_t)written < sizeof(client->body);
+}
+
+// gemini_body_cb_t
+static bool tts_on_body(void *ctx, const char *data, size_t len) {
+    tts_client_t *client = (tts_client_t *)ctx;
+    const uint8_t *bytes = (const uint8_t *)data;
+    if (client->status != 200) {
+        size_t room = sizeof(client->error_head) - 1 - client->error_len;
+        size_t copy = len < room ? len : room;
+        memcpy(client->error_head + client->error_len, data, copy);
+        client->error_len += copy;
+        return true;
+    }
+    int16_t samples[TTS_PCM_STEP];
+    size_t count = 0;
+    size_t pos = 0;
+    if (client->has_carry && len > 0) {
+        samples[count++] = (int16_t)(client->carry | (uint16_t)bytes[0] << 8);
+        client->has_carry = false;
+        pos = 1;
+    }
+    for (; pos + 1 < len; pos += 2) {
+        samples[count++] = (int16_t)(bytes[pos] | (uint16_t)bytes[pos + 1] << 8);
+        if (count == TTS_PCM_STEP) {
+            if (!tts_hand_on(client, samples, count)) {
+                return false;
+            }
+            count = 0;
+        }
+    }
+    if (pos < len) {
+        client->carry = bytes[pos];
+        client->has_carry = true;
+    }
+    return count == 0 || tts_hand_on(client, samples, count);
+}
+
+static bool tts_hand_on(tts_client_t *client, const int16_t *samples, size_t count) {
+    if (client->timing.samples == 0) {
+        client->timing.first_audio_us = client->session->now_us() - client->session->request_start_us;
+    }
+    client->timing.samples += count;
+    return client->on_pcm(client->ctx, samples, count);
+}
@@ -0,0 +1,81 @@
+/*
+    Description: text to speech over http, one request per sentence on a
+    kept-alive GeminiSession. the service is sent the text as json and
+    answers with raw 16-bit little endian mono pcm (the openai style
+    /v1/audio/speech with response_format pcm), which is handed on as it
+    downloads so playback can start long before the sentence is all in.
+    the client never holds more than one read of audio
+    Creator: Matthew Ayestaran
+*/
+
+#ifndef TTS_CLIENT_H
+#define TTS_CLIENT_H
+
+#include "GeminiSession.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TTS_TEXT_MAX 512 // longest text one request takes, escaped
+#define TTS_BODY_MAX (TTS_TEXT_MAX + 256)
+#define TTS_AUTH_MAX 160 // "Bearer " and the key
+#define TTS_ERROR_HEAD_MAX 128
+
+// audio as it arrives, return false to stop the sentence
+typedef bool (*tts_pcm_cb_t)(void *ctx, const int16_t *samples, size_t count);
+
+typedef struct {
+    const char *path;
+    const char *model;
+    const char *voice;
+    const char *api_key; // optional, sent as a bearer token
+    uint32_t sample_rate; // of the pcm the service sends, for the speaker
+} tts_config_t;
+
+#define TTS_CONFIG_DEFAULT                                                     \
+    { .path = "/v1/audio/speech", .model = "tts-1", .voice = "alloy",          \
+      .api_key = NULL, .sample_rate = 24000 }
+
+typedef enum {
+    TTS_OK = 0,
+    TTS_ERR_ARG,     // no text, or more than TTS_TEXT_MAX once escaped
+    TTS_ERR_SESSION, // the request failed, see session_err
+    TTS_ERR_STATUS,  // the service answered with something other than 200
+    TTS_ERR_ABORTED, // the pcm callback asked to stop
+} tts_err_t;
+
+typedef struct { // how the last sentence went, microseconds
+    int64_t ttfb_us;        // request start to the first response byte
+    int64_t first_audio_us; // request start to the first sample handed on
+    int64_t total_us;
+    size_t samples;
+    bool reused;            // went out on the connection already open
+} tts_timing_t;
+
+typedef struct {
+    gemini_session_t *session; // the caller's, not shared with gemini calls
+    tts_config_t config;
+    char auth[TTS_AUTH_MAX];
+    char body[TTS_BODY_MAX];
+    int status;
+    gemini_session_err_t session_err;
+    tts_pcm_cb_t on_pcm;
+    void *ctx;
+    uint8_t carry; // low byte of a sample split across two reads
+    bool has_carry;
+    char error_head[TTS_ERROR_HEAD_MAX]; // start of an error reply
+    size_t error_len;
+    tts_timing_t timing;
+    uint32_t sentences; // spoken over the client's life
+} tts_client_t;
+
+//Function definitions
+// the config's strings must outlive the client
+void tts_client_init(tts_client_t *client, gemini_session_t *session, const tts_config_t *config);
+// text need not be nul terminated. blocks until the whole sentence was
+// handed to on_pcm, which runs on the calling task
+tts_err_t tts_client_speak(tts_client_t *client, const char *text, size_t len, tts_pcm_cb_t on_pcm,
+                           void *ctx);
+const char *tts_err_name(tts_err_t err);
+
+#endif // TTS_CLIENT_H
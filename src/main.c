@@ -20,13 +20,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-// Driver for I2S for Mic Mic used is SPH0645
-#include "driver/i2s.h"
 
 // Header calls
 //- calling all my header files to allow my function calls
 #include "GeminiAPI.h"
 #include "I2S_Audio_Controller.h"
+#include "I2S_Audio_Speaker.h"
+#include "VoicePipeline.h"
+#include "VoiceTts.h"
 #include "include/MemoryPool/MemoryPool.h"
 
 // Configuration
@@ -66,12 +67,29 @@ void app_main(void) {
   // 2 - wifi subsystem initialization
   // 3 - wifi connection settup
   // 4 - wifi connection manager
+  // wifi_manager_init_station with fast_connect and reuse_lease, a press
+  // from deep sleep goes straight to the last access point and address
+  // without a scan or dhcp, wifi_manager_get_timing shows where time went
+  // after that it reconnects on its own with a jittered backoff and never
+  // gives up, Network_Ready in the pipeline config wraps
+  // wifi_manager_wait_warm so a question asked while it is down fails fast
 
   // it should wait for a button press to start forming the audio input
   // while the button is pressed it should listen to the audio stream and make a
   // audio buffer when a seperate button is pressed the audio buffer (not the
   // question) should be sent to gemini This response at the moment should be in
   // the form of text
+  // the question runs through Voice_Pipeline_Run (lib/Pipeline) so the
+  // upload starts while it is still being recorded and the answer is spoken
+  // a sentence at a time as it streams back. Speak is Voice_Tts_Speak, each
+  // sentence is fetched from the text to speech service while the one
+  // before plays out of I2S_Audio_Speaker, Voice_Tts_Connect goes with the
+  // button press so its handshake is out of the way too
+  // the record button's gpio isr calls Gemini_Prewarm_From_Isr (after
+  // Gemini_Prewarm_Ini once wifi is up), the radio leaves power save and
+  // the gemini connection is resolved and handshaken while the question
+  // is still being asked. a recording thrown away calls
+  // Gemini_Prewarm_Cancel, Voice_Pipeline_Abort does it too
 
   // ok the start should be the wifi connect functions and setting up the rtos
 }
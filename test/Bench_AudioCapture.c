@@ -0,0 +1,167 @@
+/*Audio capture ring benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: reports ns per bare ring push and pop, ns per whole frame trip
+    (pool block out, commit, take, back to the pool) on one thread, and
+    frames/s with the producer and consumer on their own pthreads, so the
+    hand-off cost can be held against the 20 ms a frame lasts
+    run with: pio test -e native_audio_capture_bench
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_AUDIO_CAPTURE)
+
+#ifndef POOL_THREAD_SAFE
+#error "frames are freed on the consumer thread, build with POOL_THREAD_SAFE"
+#endif
+
+#include "AudioCapture.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#define FRAME_SAMPLES 320
+#define RING_FRAMES 16
+static PoolMemoryInfo *Memory_Handler;
+static AudioCapture Capture;
+static const PoolClassConfig Audio_Classes[] = {
+    {sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t), RING_FRAMES + 4,
+     0}};
+const size_t Bench_Iterations = 1000000;
+const uint32_t Bench_Threaded_Frames = 200000;
+
+// keeps the compiler from dropping the loops
+static volatile uintptr_t Bench_Sink;
+static atomic_bool Producer_Done;
+
+// PROTOTYPING HELPERS
+static uint64_t helper_Now_ns(void);
+static void helper_Report_ns(const char *Name, uint64_t Elapsed_ns,
+                             size_t Operations);
+static void *helper_Producer_Thread(void *Argument);
+
+// PROTOTYPING TESTS
+void bench_Ring_Push_Pop();
+void bench_Frame_Round_Trip();
+void bench_Threaded_Hand_Off();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Audio_Classes, 1);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+  TEST_ASSERT_EQUAL_INT(0, Audio_Capture_Ini(&Capture, Memory_Handler,
+                                             FRAME_SAMPLES, RING_FRAMES));
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(bench_Ring_Push_Pop);
+  RUN_TEST(bench_Frame_Round_Trip);
+  RUN_TEST(bench_Threaded_Hand_Off);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+// half full so neither side ever sees it empty or full
+void bench_Ring_Push_Pop() {
+  AudioRing Ring;
+  AudioFrame Frames[RING_FRAMES];
+  Audio_Ring_Ini(&Ring, RING_FRAMES);
+  for (size_t i = 0; i < RING_FRAMES / 2; i++) {
+    Audio_Ring_Push(&Ring, &Frames[i]);
+  }
+  uint64_t Start = helper_Now_ns();
+  for (size_t i = 0; i < Bench_Iterations; i++) {
+    Audio_Ring_Push(&Ring, &Frames[i % RING_FRAMES]);
+    Bench_Sink ^= (uintptr_t)Audio_Ring_Pop(&Ring);
+  }
+  helper_Report_ns("push+pop", helper_Now_ns() - Start, Bench_Iterations);
+}
+
+// everything the i2s task and the consumer do per frame apart from the read
+void bench_Frame_Round_Trip() {
+  uint64_t Start = helper_Now_ns();
+  for (size_t i = 0; i < Bench_Iterations; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+    Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, (int64_t)i);
+    Frame = Audio_Capture_Frame_Take(&Capture);
+    Bench_Sink ^= Frame->Sequence;
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  helper_Report_ns("frame trip", helper_Now_ns() - Start, Bench_Iterations);
+}
+
+// the producer waits for room here instead of dropping, so this is the
+// most frames the hand-off carries between two threads
+void bench_Threaded_Hand_Off() {
+  pthread_t Producer;
+  uint32_t Received = 0;
+  atomic_store(&Producer_Done, false);
+  uint64_t Start = helper_Now_ns();
+  pthread_create(&Producer, NULL, helper_Producer_Thread, NULL);
+  for (;;) {
+    bool Done = atomic_load(&Producer_Done);
+    AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+    if (Frame == NULL) {
+      if (Done) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    Bench_Sink ^= (uintptr_t)Frame->Data[Received % FRAME_SAMPLES];
+    Received++;
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  pthread_join(Producer, NULL);
+  uint64_t Elapsed_ns = helper_Now_ns() - Start;
+
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(Counters.Frames, Received);
+  char Line[160];
+  snprintf(Line, sizeof(Line),
+           "threaded   %10.0f frames/s, %u of %u dropped",
+           (double)Received * 1e9 / (double)Elapsed_ns,
+           (unsigned)(Counters.Ring_Full + Counters.Pool_Empty),
+           (unsigned)Bench_Threaded_Frames);
+  TEST_MESSAGE(Line);
+}
+
+// HELPER FUNCTIONS
+static uint64_t helper_Now_ns(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+static void helper_Report_ns(const char *Name, uint64_t Elapsed_ns,
+                             size_t Operations) {
+  char Line[128];
+  snprintf(Line, sizeof(Line), "%-10s %8.1f ns each", Name,
+           (double)Elapsed_ns / (double)Operations);
+  TEST_MESSAGE(Line);
+}
+
+static void *helper_Producer_Thread(void *Argument) {
+  for (uint32_t i = 0; i < Bench_Threaded_Frames; i++) {
+    while (Audio_Ring_Count(&Capture.Ring) > Capture.Ring.Mask) {
+      sched_yield();
+    }
+    AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+    if (Frame != NULL) {
+      Frame->Data[i % FRAME_SAMPLES] = (int32_t)i;
+      Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, i);
+    }
+  }
+  atomic_store(&Producer_Done, true);
+  return NULL;
+}
+
+#endif
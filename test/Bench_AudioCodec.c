@@ -0,0 +1,166 @@
+/*Audio codec benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: pushes the wav clips in test/fixtures/vad through each codec
+    a 20 ms frame at a time, the way the encode task does, and reports
+    the encode time per frame and the compression ratio against plain wav
+    for each, flac at a few Drop_Bits settings as well. the board runs
+    the same code on the second core, scale the times by the clock
+    difference to see how much of a frame the encode takes there
+    run with: pio test -e native_audio_codec_bench
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_AUDIO_CODEC)
+
+#include "AudioCodec.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#ifndef CODEC_FIXTURE_DIR
+#define CODEC_FIXTURE_DIR "test/fixtures/vad"
+#endif
+#define SAMPLE_RATE 16000
+#define FRAME_SAMPLES 320 // 20 ms
+#define MAX_CLIP_SAMPLES (4 * SAMPLE_RATE)
+const size_t Bench_Passes = 20;
+static int16_t Clip[MAX_CLIP_SAMPLES];
+static size_t Clip_Samples;
+static AudioEncoder Encoder;
+static uint8_t Out[AUDIO_CODEC_OUT_MAX];
+static const char *const Fixture_Names[] = {
+    "one_phrase.wav", "short_pause.wav", "long_pause.wav",
+    "fricative_first.wav", "room_noise.wav"};
+
+// keeps the compiler from dropping the encode
+static volatile uintptr_t Bench_Sink;
+
+// PROTOTYPING HELPERS
+static size_t helper_Load_Wav(const char *Name);
+static uint64_t helper_Now_ns(void);
+static void helper_Bench_Codec(const char *Label, const AudioCodec *Codec,
+                               uint8_t Drop_Bits);
+
+// PROTOTYPING TESTS
+void bench_Wav();
+void bench_Ima_Adpcm();
+void bench_Flac();
+void bench_Flac_Drop_Bits();
+
+//================================CODE
+// START=============================================
+void setUp(void) {}
+void tearDown(void) {}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(bench_Wav);
+  RUN_TEST(bench_Ima_Adpcm);
+  RUN_TEST(bench_Flac);
+  RUN_TEST(bench_Flac_Drop_Bits);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+void bench_Wav() { helper_Bench_Codec("wav", &Audio_Codec_Wav, 0); }
+
+void bench_Ima_Adpcm() {
+  helper_Bench_Codec("ima-adpcm", &Audio_Codec_Ima_Adpcm, 0);
+}
+
+void bench_Flac() { helper_Bench_Codec("flac", &Audio_Codec_Flac, 0); }
+
+void bench_Flac_Drop_Bits() {
+  helper_Bench_Codec("flac -4", &Audio_Codec_Flac, 4);
+  helper_Bench_Codec("flac -6", &Audio_Codec_Flac, 6);
+  helper_Bench_Codec("flac -8", &Audio_Codec_Flac, 8);
+}
+
+// HELPER FUNCTIONS
+// 16 kHz 16-bit mono only, the chunks are walked to find fmt and data
+static size_t helper_Load_Wav(const char *Name) {
+  char Path[256];
+  snprintf(Path, sizeof(Path), "%s/%s", CODEC_FIXTURE_DIR, Name);
+  FILE *File = fopen(Path, "rb");
+  if (File == NULL) {
+    return 0;
+  }
+  uint8_t Header[12];
+  size_t Samples = 0;
+  bool Format_Ok = false;
+  if (fread(Header, 1, 12, File) == 12 && !memcmp(Header, "RIFF", 4) &&
+      !memcmp(Header + 8, "WAVE", 4)) {
+    uint8_t Chunk[8];
+    while (fread(Chunk, 1, 8, File) == 8) {
+      uint32_t Size = (uint32_t)Chunk[4] | (uint32_t)Chunk[5] << 8 |
+                      (uint32_t)Chunk[6] << 16 | (uint32_t)Chunk[7] << 24;
+      if (!memcmp(Chunk, "fmt ", 4) && Size >= 16) {
+        uint8_t Fmt[16];
+        if (fread(Fmt, 1, 16, File) != 16) {
+          break;
+        }
+        uint32_t Rate = (uint32_t)Fmt[4] | (uint32_t)Fmt[5] << 8 |
+                        (uint32_t)Fmt[6] << 16 | (uint32_t)Fmt[7] << 24;
+        Format_Ok = Fmt[0] == 1 && Fmt[2] == 1 && Rate == SAMPLE_RATE &&
+                    Fmt[14] == 16;
+        fseek(File, (long)(Size - 16 + (Size & 1)), SEEK_CUR);
+      } else if (!memcmp(Chunk, "data", 4) && Format_Ok) {
+        size_t Want = Size / 2 < MAX_CLIP_SAMPLES ? Size / 2 : MAX_CLIP_SAMPLES;
+        Samples = fread(Clip, 2, Want, File); // the host is little endian
+        break;
+      } else {
+        fseek(File, (long)(Size + (Size & 1)), SEEK_CUR);
+      }
+    }
+  }
+  fclose(File);
+  return Samples;
+}
+
+static uint64_t helper_Now_ns(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+// every clip, every pass, the time is the push and finish calls only
+static void helper_Bench_Codec(const char *Label, const AudioCodec *Codec,
+                               uint8_t Drop_Bits) {
+  const AudioEncoderConfig Config = {Codec, SAMPLE_RATE, 0, 0, Drop_Bits};
+  uint64_t Elapsed_ns = 0;
+  uint64_t Frames = 0;
+  uint64_t Wav_Bytes = 0;
+  uint64_t Coded_Bytes = 0;
+  for (size_t c = 0; c < sizeof(Fixture_Names) / sizeof(Fixture_Names[0]);
+       c++) {
+    Clip_Samples = helper_Load_Wav(Fixture_Names[c]);
+    TEST_ASSERT_TRUE_MESSAGE(Clip_Samples > 0, Fixture_Names[c]);
+    for (size_t p = 0; p < Bench_Passes; p++) {
+      TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encoder, &Config));
+      uint64_t Start = helper_Now_ns();
+      for (size_t Pos = 0; Pos < Clip_Samples; Pos += FRAME_SAMPLES) {
+        size_t Take = Clip_Samples - Pos < FRAME_SAMPLES ? Clip_Samples - Pos
+                                                         : FRAME_SAMPLES;
+        Bench_Sink ^= Audio_Encoder_Push(&Encoder, Clip + Pos, Take, Out);
+        Frames++;
+      }
+      Bench_Sink ^= Audio_Encoder_Finish(&Encoder, Out);
+      Elapsed_ns += helper_Now_ns() - Start;
+    }
+    Wav_Bytes += 44 + 2 * (uint64_t)Clip_Samples;
+    Coded_Bytes += Encoder.Bytes_Out;
+  }
+  char Line[128];
+  snprintf(Line, sizeof(Line),
+           "%-9s %7.2f us per frame, %6.1f Msamples/s, %5.2f:1 against wav",
+           Label, (double)Elapsed_ns / 1000.0 / (double)Frames,
+           (double)Frames * FRAME_SAMPLES * 1000.0 / (double)Elapsed_ns,
+           (double)Wav_Bytes / (double)Coded_Bytes);
+  TEST_MESSAGE(Line);
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*Audio conversion benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: reports samples/s for each kernel over 20 ms frames of
+    random slots, out of place and in place the way the capture task runs
+    it, so the kernels can be compared before and after a change
+    run with: pio test -e native_audio_convert_bench
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_AUDIO_CONVERT)
+
+#include "AudioConvert.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#define FRAME_SAMPLES 320 // 20 ms at 16 kHz
+#define CLIP_FRAMES 500   // 10 s
+const size_t Bench_Passes = 20;
+static int32_t Clip[CLIP_FRAMES][FRAME_SAMPLES];
+static int32_t Work[CLIP_FRAMES][FRAME_SAMPLES];
+static int16_t Pcm[FRAME_SAMPLES];
+static const AudioConvertParams Params = AUDIO_CONVERT_SPH0645;
+
+// keeps the compiler from dropping the conversions
+static volatile uintptr_t Bench_Sink;
+
+// PROTOTYPING HELPERS
+static uint64_t helper_Now_ns(void);
+static void helper_Report(const char *Name, uint64_t Elapsed_ns);
+static void helper_Bench_Kernel(const char *Name, AudioConvertKernel Kernel);
+
+// PROTOTYPING TESTS
+void bench_Scalar_Kernel();
+void bench_Block_Kernel();
+void bench_Default_Kernel();
+void bench_In_Place();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  srand(17);
+  for (size_t f = 0; f < CLIP_FRAMES; f++) {
+    for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+      Clip[f][i] = (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+    }
+  }
+}
+void tearDown(void) {}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(bench_Scalar_Kernel);
+  RUN_TEST(bench_Block_Kernel);
+  RUN_TEST(bench_Default_Kernel);
+  RUN_TEST(bench_In_Place);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+void bench_Scalar_Kernel() {
+  helper_Bench_Kernel("scalar", Audio_Convert_Scalar);
+}
+
+void bench_Block_Kernel() { helper_Bench_Kernel("block", Audio_Convert_Block); }
+
+// the block kernel, or pie for the bulk when built with AUDIO_CONVERT_PIE
+void bench_Default_Kernel() { helper_Bench_Kernel("default", Audio_Convert); }
+
+// each frame over its own slots, the copy back in is left out of the time
+void bench_In_Place() {
+  uint64_t Elapsed_ns = 0;
+  for (size_t p = 0; p < Bench_Passes; p++) {
+    memcpy(Work, Clip, sizeof(Clip));
+    uint64_t Start = helper_Now_ns();
+    for (size_t f = 0; f < CLIP_FRAMES; f++) {
+      Audio_Convert(Work[f], (int16_t *)Work[f], FRAME_SAMPLES, &Params);
+    }
+    Elapsed_ns += helper_Now_ns() - Start;
+    Bench_Sink ^= (uintptr_t)Work[p][p];
+  }
+  helper_Report("in place", Elapsed_ns);
+}
+
+// HELPER FUNCTIONS
+static uint64_t helper_Now_ns(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+static void helper_Report(const char *Name, uint64_t Elapsed_ns) {
+  double Samples = (double)Bench_Passes * CLIP_FRAMES * FRAME_SAMPLES;
+  char Line[128];
+  snprintf(Line, sizeof(Line), "%-9s %8.1f Msamples/s, %6.2f us per frame",
+           Name, Samples * 1000.0 / (double)Elapsed_ns,
+           (double)Elapsed_ns / 1000.0 / (Bench_Passes * CLIP_FRAMES));
+  TEST_MESSAGE(Line);
+}
+
+static void helper_Bench_Kernel(const char *Name, AudioConvertKernel Kernel) {
+  uint64_t Start = helper_Now_ns();
+  for (size_t p = 0; p < Bench_Passes; p++) {
+    for (size_t f = 0; f < CLIP_FRAMES; f++) {
+      Kernel(Clip[f], Pcm, FRAME_SAMPLES, &Params);
+      Bench_Sink ^= (uintptr_t)Pcm[f % FRAME_SAMPLES];
+    }
+  }
+  helper_Report(Name, helper_Now_ns() - Start);
+}
+
+#endif
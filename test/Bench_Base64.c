@@ -0,0 +1,112 @@
+/*Base64 encoder benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: reports MB/s of raw input for each kernel on a 10 s, 16 kHz,
+    16-bit clip, whole and streamed in the pieces the request body reads
+    pull, so the kernels can be compared before and after a change
+    run with: pio test -e native_base64_bench
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_BASE64)
+
+#include "Base64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#define BENCH_CLIP_BYTES (10 * 16000 * 2) // 10 s of 16 kHz 16-bit mono
+const size_t Bench_Iterations = 200;
+const size_t Bench_Stream_Chunk = 192; // what one request body read encodes
+static uint8_t Clip[BENCH_CLIP_BYTES];
+static char Encoded[BASE64_ENCODED_LEN(BENCH_CLIP_BYTES)];
+
+// keeps the compiler from dropping the encodes
+static volatile uintptr_t Bench_Sink;
+
+// PROTOTYPING HELPERS
+static uint64_t helper_Now_ns(void);
+static void helper_Report(const char *Name, uint64_t Elapsed_ns);
+static void helper_Bench_Kernel(const char *Name, base64_kernel_t Kernel);
+
+// PROTOTYPING TESTS
+void bench_Scalar_Kernel();
+void bench_Word_Kernel();
+void bench_Default_Kernel();
+void bench_Streamed_In_Request_Reads();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+    srand(10);
+    for (size_t i = 0; i < sizeof(Clip); i++) {
+        Clip[i] = (uint8_t)rand();
+    }
+}
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(bench_Scalar_Kernel);
+    RUN_TEST(bench_Word_Kernel);
+    RUN_TEST(bench_Default_Kernel);
+    RUN_TEST(bench_Streamed_In_Request_Reads);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+void bench_Scalar_Kernel() { helper_Bench_Kernel("scalar", base64_encode_groups_scalar); }
+
+void bench_Word_Kernel() { helper_Bench_Kernel("word", base64_encode_groups_word); }
+
+// the word kernel, or pie for the bulk when built with BASE64_PIE
+void bench_Default_Kernel() { helper_Bench_Kernel("default", base64_encode_groups); }
+
+// the way GeminiPayload uses it, a read's worth at a time with the
+// remainder carried across
+void bench_Streamed_In_Request_Reads() {
+    uint64_t Start = helper_Now_ns();
+    for (size_t i = 0; i < Bench_Iterations; i++) {
+        base64_stream_t Stream;
+        base64_stream_init(&Stream);
+        size_t Written = 0;
+        for (size_t Pos = 0; Pos < sizeof(Clip); Pos += Bench_Stream_Chunk - 1) { // off the group size
+            size_t Len = sizeof(Clip) - Pos < Bench_Stream_Chunk - 1 ? sizeof(Clip) - Pos : Bench_Stream_Chunk - 1;
+            Written += base64_stream_update(&Stream, Clip + Pos, Len, Encoded + Written);
+        }
+        Written += base64_stream_final(&Stream, Encoded + Written);
+        TEST_ASSERT_EQUAL_size_t(sizeof(Encoded), Written);
+        Bench_Sink ^= (uintptr_t)Encoded[Written / 2];
+    }
+    helper_Report("streamed", helper_Now_ns() - Start);
+}
+
+// HELPER FUNCTIONS
+static uint64_t helper_Now_ns(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+static void helper_Report(const char *Name, uint64_t Elapsed_ns) {
+    double Per_Clip_us = (double)Elapsed_ns / (double)Bench_Iterations / 1000.0;
+    char Line[128];
+    snprintf(Line, sizeof(Line), "%-9s %8.1f MB/s, %8.1f us per 10 s clip", Name,
+             (double)sizeof(Clip) / Per_Clip_us, Per_Clip_us);
+    TEST_MESSAGE(Line);
+}
+
+static void helper_Bench_Kernel(const char *Name, base64_kernel_t Kernel) {
+    uint64_t Start = helper_Now_ns();
+    for (size_t i = 0; i < Bench_Iterations; i++) {
+        Kernel(Clip, sizeof(Clip) / 3, Encoded);
+        Bench_Sink ^= (uintptr_t)Encoded[i % sizeof(Encoded)];
+    }
+    helper_Report(Name, helper_Now_ns() - Start);
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*Gemini reply parsing benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: compares the incremental extractor against the old cJSON path
+    (whole body in memory, cJSON_Parse, copy the text out) on the recorded
+    replies in test/standin/responses. reports time per reply and the most
+    heap each path had live at once
+    run with: pio test -e native_json_bench from the project root. the
+    cJSON side uses the parser vendored in test/cJSON.c
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_GEMINI_JSON)
+
+#include "GeminiJson.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+const size_t Bench_Iterations = 2000;
+const size_t Bench_Chunk_Size = 1436; // one tcp segment through tls
+static const char *Bench_Replies[] = {
+    "test/standin/responses/plain.json",
+    "test/standin/responses/cached.json",
+    "test/standin/responses/grounded.json",
+};
+#define BENCH_REPLY_COUNT (sizeof(Bench_Replies) / sizeof(Bench_Replies[0]))
+
+// heap the cJSON path has live, every block carries its size in front
+static size_t Heap_Live;
+static size_t Heap_Peak;
+static size_t Heap_Allocs;
+
+// keeps the compiler from dropping the parses
+static volatile uintptr_t Bench_Sink;
+
+// PROTOTYPING HELPERS
+static uint64_t helper_Now_ns(void);
+static char *helper_Read_File(const char *Path, size_t *Len);
+static void helper_Report(const char *Name, const char *Reply, uint64_t Elapsed_ns, size_t Peak_Heap,
+                          size_t Allocs);
+static void *helper_Count_Malloc(size_t Size);
+static void helper_Count_Free(void *Block);
+static char *helper_Cjson_Text(const char *Body);
+
+// PROTOTYPING TESTS
+void bench_Extractor_Chunked();
+void bench_Cjson_Whole_Body();
+
+//================================CODE
+// START=============================================
+void setUp(void) {}
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(bench_Extractor_Chunked);
+    RUN_TEST(bench_Cjson_Whole_Body);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+// fed a segment at a time the way the session hands the body over, the
+// state and the text buffer are all the memory it needs
+void bench_Extractor_Chunked() {
+    char Text[2048];
+    gemini_json_t Json;
+    for (size_t r = 0; r < BENCH_REPLY_COUNT; r++) {
+        size_t Len;
+        char *Reply = helper_Read_File(Bench_Replies[r], &Len);
+        uint64_t Start = helper_Now_ns();
+        for (size_t i = 0; i < Bench_Iterations; i++) {
+            gemini_json_init(&Json, Text, sizeof(Text), NULL, NULL);
+            for (size_t Offset = 0; Offset < Len; Offset += Bench_Chunk_Size) {
+                size_t Left = Len - Offset;
+                gemini_json_feed(&Json, Reply + Offset, Left < Bench_Chunk_Size ? Left : Bench_Chunk_Size);
+            }
+            TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, Json.status);
+            Bench_Sink ^= Json.text_len;
+        }
+        helper_Report("extractor", Bench_Replies[r], helper_Now_ns() - Start, 0, 0);
+        free(Reply);
+    }
+    char Line[96];
+    snprintf(Line, sizeof(Line), "extractor state %zu bytes on the stack, no heap", sizeof(gemini_json_t));
+    TEST_MESSAGE(Line);
+}
+
+// what parse_gemini_response used to do: the body is buffered whole, parsed
+// into a tree and the text copied out
+void bench_Cjson_Whole_Body() {
+    cJSON_Hooks Hooks = {.malloc_fn = helper_Count_Malloc, .free_fn = helper_Count_Free};
+    cJSON_InitHooks(&Hooks);
+    for (size_t r = 0; r < BENCH_REPLY_COUNT; r++) {
+        size_t Len;
+        char *Reply = helper_Read_File(Bench_Replies[r], &Len);
+        Heap_Peak = 0;
+        Heap_Allocs = 0;
+        uint64_t Start = helper_Now_ns();
+        for (size_t i = 0; i < Bench_Iterations; i++) {
+            char *Text = helper_Cjson_Text(Reply);
+            TEST_ASSERT_NOT_NULL(Text);
+            Bench_Sink ^= (uintptr_t)Text;
+            helper_Count_Free(Text);
+        }
+        uint64_t Elapsed = helper_Now_ns() - Start;
+        TEST_ASSERT_EQUAL_size_t(0, Heap_Live);
+        // the body buffer has to exist whole as well
+        helper_Report("cJSON", Bench_Replies[r], Elapsed, Heap_Peak + Len + 1, Heap_Allocs / Bench_Iterations);
+        free(Reply);
+    }
+    cJSON_InitHooks(NULL);
+}
+
+// HELPER FUNCTIONS
+static uint64_t helper_Now_ns(void) {
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+static char *helper_Read_File(const char *Path, size_t *Len) {
+    FILE *File = fopen(Path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(File, Path);
+    fseek(File, 0, SEEK_END);
+    *Len = (size_t)ftell(File);
+    fseek(File, 0, SEEK_SET);
+    char *Data = malloc(*Len + 1);
+    TEST_ASSERT_NOT_NULL(Data);
+    TEST_ASSERT_EQUAL_size_t(*Len, fread(Data, 1, *Len, File));
+    Data[*Len] = '\0';
+    fclose(File);
+    return Data;
+}
+
+static void helper_Report(const char *Name, const char *Reply, uint64_t Elapsed_ns, size_t Peak_Heap,
+                          size_t Allocs) {
+    const char *File = strrchr(Reply, '/') ? strrchr(Reply, '/') + 1 : Reply;
+    char Line[128];
+    snprintf(Line, sizeof(Line), "%-10s %-14s %9.2f us/reply, peak heap %6zu bytes, %4zu allocs", Name, File,
+             (double)Elapsed_ns / (double)Bench_Iterations / 1000.0, Peak_Heap, Allocs);
+    TEST_MESSAGE(Line);
+}
+
+static void *helper_Count_Malloc(size_t Size) {
+    size_t *Block = malloc(sizeof(size_t) + Size);
+    if (!Block) {
+        return NULL;
+    }
+    *Block = Size;
+    Heap_Live += Size;
+    Heap_Allocs++;
+    Heap_Peak = Heap_Live > Heap_Peak ? Heap_Live : Heap_Peak;
+    return Block + 1;
+}
+
+static void helper_Count_Free(void *Block) {
+    if (!Block) {
+        return;
+    }
+    size_t *Start = (size_t *)Block - 1;
+    Heap_Live -= *Start;
+    free(Start);
+}
+
+static char *helper_Cjson_Text(const char *Body) {
+    cJSON *Root = cJSON_Parse(Body);
+    const cJSON *Candidate = cJSON_GetArrayItem(cJSON_GetObjectItem(Root, "candidates"), 0);
+    const cJSON *Parts = cJSON_GetObjectItem(cJSON_GetObjectItem(Candidate, "content"), "parts");
+    const cJSON *Text = cJSON_GetObjectItem(cJSON_GetArrayItem(Parts, 0), "text");
+    char *Copy = NULL;
+    if (cJSON_IsString(Text)) {
+        size_t Len = strlen(Text->valuestring);
+        Copy = helper_Count_Malloc(Len + 1);
+        memcpy(Copy, Text->valuestring, Len + 1);
+    }
+    cJSON_Delete(Root);
+    return Copy;
+}
+
+#endif
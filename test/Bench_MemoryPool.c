@@ -0,0 +1,163 @@
+/*MemoryPool benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: reports ns per operation for alloc/free mixes so changes to the
+    pool hot path can be compared before and after
+    run with: pio test -e native_bench, add -D POOL_THREAD_SAFE to the env
+    build_flags to see what the lock costs
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_MEMORY_POOL)
+
+#include "MemoryPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+static PoolMemoryInfo *Memory_Handler;
+const size_t Bench_Pool_Blocks = 64; // blocks per size class
+const size_t Bench_Iterations = 200000;
+const size_t Bench_Small_Size = 48;
+#define BENCH_BATCH 32
+
+// request sizes spread over every class, including sizes that round up
+static const size_t Bench_Mixed_Sizes[] = {24,   600,  64, 1500,
+                                           300, 2048, 8,  513};
+#define BENCH_MIXED_COUNT                                                      \
+  (sizeof(Bench_Mixed_Sizes) / sizeof(Bench_Mixed_Sizes[0]))
+
+// keeps the compiler from dropping the alloc/free pairs
+static volatile uintptr_t Bench_Sink;
+
+// PROTOTYPING HELPERS
+static uint64_t helper_Now_ns(void);
+static void helper_Report(const char *Name, uint64_t Elapsed_ns,
+                          size_t Operations);
+
+// PROTOTYPING TESTS
+void bench_Single_Size_Churn();
+void bench_Mixed_Size_Churn();
+void bench_Mixed_Batch_Lifo();
+void bench_Mixed_Batch_Fifo();
+void bench_Task_Cache_Mixed_Churn();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler =
+      Pool_Ini(Bench_Pool_Blocks, Bench_Pool_Blocks, Bench_Pool_Blocks);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(bench_Single_Size_Churn);
+  RUN_TEST(bench_Mixed_Size_Churn);
+  RUN_TEST(bench_Mixed_Batch_Lifo);
+  RUN_TEST(bench_Mixed_Batch_Fifo);
+  RUN_TEST(bench_Task_Cache_Mixed_Churn);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+// alloc then free the same small block over and over
+void bench_Single_Size_Churn() {
+  uint64_t Start = helper_Now_ns();
+  for (size_t i = 0; i < Bench_Iterations; i++) {
+    void *Block = Pool_Alloc(Bench_Small_Size, Memory_Handler);
+    Bench_Sink ^= (uintptr_t)Block;
+    Pool_Free(Block, Memory_Handler);
+  }
+  helper_Report("single size alloc+free", helper_Now_ns() - Start,
+                Bench_Iterations * 2);
+}
+
+// alloc then free straight away, cycling through every class
+void bench_Mixed_Size_Churn() {
+  uint64_t Start = helper_Now_ns();
+  for (size_t i = 0; i < Bench_Iterations; i++) {
+    void *Block =
+        Pool_Alloc(Bench_Mixed_Sizes[i % BENCH_MIXED_COUNT], Memory_Handler);
+    Bench_Sink ^= (uintptr_t)Block;
+    Pool_Free(Block, Memory_Handler);
+  }
+  helper_Report("mixed size alloc+free", helper_Now_ns() - Start,
+                Bench_Iterations * 2);
+}
+
+// hold a batch of mixed blocks and hand them back newest first
+void bench_Mixed_Batch_Lifo() {
+  void *Batch[BENCH_BATCH];
+  size_t Rounds = Bench_Iterations / BENCH_BATCH;
+  uint64_t Start = helper_Now_ns();
+  for (size_t r = 0; r < Rounds; r++) {
+    for (size_t i = 0; i < BENCH_BATCH; i++) {
+      Batch[i] = Pool_Alloc(Bench_Mixed_Sizes[(r + i) % BENCH_MIXED_COUNT],
+                            Memory_Handler);
+    }
+    for (size_t i = BENCH_BATCH; i > 0; i--) {
+      Bench_Sink ^= (uintptr_t)Batch[i - 1];
+      Pool_Free(Batch[i - 1], Memory_Handler);
+    }
+  }
+  helper_Report("mixed batch lifo free", helper_Now_ns() - Start,
+                Rounds * BENCH_BATCH * 2);
+}
+
+// hold a batch of mixed blocks and hand them back oldest first
+void bench_Mixed_Batch_Fifo() {
+  void *Batch[BENCH_BATCH];
+  size_t Rounds = Bench_Iterations / BENCH_BATCH;
+  uint64_t Start = helper_Now_ns();
+  for (size_t r = 0; r < Rounds; r++) {
+    for (size_t i = 0; i < BENCH_BATCH; i++) {
+      Batch[i] = Pool_Alloc(Bench_Mixed_Sizes[(r + i) % BENCH_MIXED_COUNT],
+                            Memory_Handler);
+    }
+    for (size_t i = 0; i < BENCH_BATCH; i++) {
+      Bench_Sink ^= (uintptr_t)Batch[i];
+      Pool_Free(Batch[i], Memory_Handler);
+    }
+  }
+  helper_Report("mixed batch fifo free", helper_Now_ns() - Start,
+                Rounds * BENCH_BATCH * 2);
+}
+
+// same as the mixed churn but through a task cache, the path the capture
+// and http tasks use in thread safe builds
+void bench_Task_Cache_Mixed_Churn() {
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Memory_Handler);
+  uint64_t Start = helper_Now_ns();
+  for (size_t i = 0; i < Bench_Iterations; i++) {
+    void *Block =
+        Pool_Cache_Alloc(Bench_Mixed_Sizes[i % BENCH_MIXED_COUNT], &Cache);
+    Bench_Sink ^= (uintptr_t)Block;
+    Pool_Cache_Free(Block, &Cache);
+  }
+  helper_Report("task cache alloc+free", helper_Now_ns() - Start,
+                Bench_Iterations * 2);
+  Pool_Cache_Flush(&Cache);
+}
+
+// HELPER FUNCTIONS
+static uint64_t helper_Now_ns(void) {
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+static void helper_Report(const char *Name, uint64_t Elapsed_ns,
+                          size_t Operations) {
+  char Line[96];
+  snprintf(Line, sizeof(Line), "%-24s %8.2f ns/op (%zu ops)", Name,
+           (double)Elapsed_ns / (double)Operations, Operations);
+  TEST_MESSAGE(Line);
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*Voice pipeline benchmark for the native environment
+    Written by Matthew Ayestaran
+    purpose: plays the wav clips in test/fixtures/vad into the voice stages
+    as i2s frames at BENCH_SPEED times real time, through the real convert,
+    voice detector and flac encode, a fake upload with a slow link and a
+    server that streams its reply, and a fake speech engine. reports what
+    each stage spent working, waiting for input and waiting on the stage
+    after it, and how long after the speaker stopped the first sentence
+    was spoken, held against the same work done one step after another
+    run with: pio test -e native_pipeline_bench
+*/
+
+#if defined(UNIT_TEST) && defined(BENCH_PIPELINE)
+
+#ifndef POOL_THREAD_SAFE
+#error "blocks are freed on other threads, build with POOL_THREAD_SAFE"
+#endif
+
+#include "VoiceStages.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#ifndef PIPE_FIXTURE_DIR
+#define PIPE_FIXTURE_DIR "test/fixtures/vad"
+#endif
+#ifndef BENCH_SPEED
+#define BENCH_SPEED 4 // every wait below is this many times shorter
+#endif
+#define SAMPLE_RATE 16000
+#define FRAME_SAMPLES 320 // 20 ms
+#define FRAME_BYTES (sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t))
+#define MAX_CLIP_SAMPLES (4 * SAMPLE_RATE)
+#define TAIL_FRAMES 50     // quiet after the clip so the vad can end
+#define LINK_BYTES_PER_S 16000 // a weak wifi uplink under tls
+#define SERVER_RTT_us 150000
+#define SERVER_THINK_us 400000 // after the last byte, before the first text
+#define TOKEN_us 30000         // between reply pieces
+#define TOKEN_BYTES 12
+#define SPEAK_WORD_us 250000
+static PoolMemoryInfo *Memory_Handler;
+static Pipeline Pipe;
+static const PoolClassConfig Pipe_Classes[] = {
+    {64, 32, 0},
+    {VOICE_SENTENCE_MAX, 16, 0},
+    {FRAME_BYTES, 40, 0},
+    {AUDIO_CODEC_OUT_MAX, 24, 0}};
+static const char *const Fixture_Names[] = {
+    "one_phrase.wav", "short_pause.wav", "fricative_first.wav"};
+static const char Reply[] =
+    "The tallest mountain in the world is Mount Everest. It stands about "
+    "8,849 meters above sea level, on the border of Nepal and China. "
+    "Climbers usually start from base camp in spring.";
+static const char *const Stage_Names[] = {"capture", "convert", "encode",
+                                          "upload",  "sentence", "speech"};
+static int16_t Clip[MAX_CLIP_SAMPLES];
+static size_t Clip_Samples;
+
+typedef struct {
+  uint32_t Sent;
+  uint32_t Frames;
+  int64_t Next_us;
+} BenchCapture;
+
+typedef struct {
+  size_t Bytes;
+  int64_t Last_Byte_us;
+} BenchUpload;
+
+typedef struct {
+  uint32_t Sentences;
+  int64_t First_us;
+} BenchSpeech;
+
+static BenchCapture Capture_Ctx;
+static VoiceConvertCtx Convert_Ctx;
+static VoiceEncodeCtx Encode_Ctx;
+static BenchUpload Upload_Ctx;
+static VoiceSentenceCtx Sentence_Ctx;
+static BenchSpeech Speech_Ctx;
+
+// PROTOTYPING HELPERS
+static size_t helper_Load_Wav(const char *Name);
+static PipeResult helper_Capture(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Upload(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Speech(PipeStage *Stage, PipeMsg *In);
+static void helper_Sleep_Until(int64_t Time_us);
+static void helper_Wait(int64_t Duration_us);
+static void helper_Report(const char *Clip_Name);
+
+// PROTOTYPING TESTS
+void bench_Voice_Pipeline();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Pipe_Classes, 4);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(bench_Voice_Pipeline);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// BENCHMARKS
+void bench_Voice_Pipeline() {
+  const AudioVadConfig Vad = AUDIO_VAD_CONFIG_DEFAULT;
+  const AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 6};
+  for (size_t c = 0; c < sizeof(Fixture_Names) / sizeof(Fixture_Names[0]);
+       c++) {
+    Clip_Samples = helper_Load_Wav(Fixture_Names[c]);
+    if (Clip_Samples == 0) {
+      TEST_IGNORE_MESSAGE("fixtures missing, run make_vad_fixtures.py");
+    }
+    Capture_Ctx = (BenchCapture){
+        .Frames = (uint32_t)(Clip_Samples / FRAME_SAMPLES) + TAIL_FRAMES};
+    Convert_Ctx = (VoiceConvertCtx){.Convert = AUDIO_CONVERT_SPH0645,
+                                    .Use_Vad = true};
+    memset(&Upload_Ctx, 0, sizeof(Upload_Ctx));
+    memset(&Sentence_Ctx, 0, sizeof(Sentence_Ctx));
+    memset(&Speech_Ctx, 0, sizeof(Speech_Ctx));
+    TEST_ASSERT_EQUAL_INT(0, Audio_Vad_Ini(&Convert_Ctx.Vad, &Vad,
+                                           Memory_Handler, SAMPLE_RATE,
+                                           FRAME_SAMPLES));
+    TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encode_Ctx.Encoder, &Config));
+    const PipeStageConfig Stages[] = {
+        {.Name = "capture", .Process = helper_Capture, .Ctx = &Capture_Ctx,
+         .Queue_Depth = 8, .Core = -1},
+        {.Name = "convert", .Process = Voice_Convert_Stage,
+         .Ctx = &Convert_Ctx, .Queue_Depth = 8, .Core = -1},
+        {.Name = "encode", .Process = Voice_Encode_Stage, .Ctx = &Encode_Ctx,
+         .Queue_Depth = 8, .Core = -1},
+        {.Name = "upload", .Process = helper_Upload, .Ctx = &Upload_Ctx,
+         .Pull = true, .Queue_Depth = 16, .Core = -1},
+        {.Name = "sentence", .Process = Voice_Sentence_Stage,
+         .Ctx = &Sentence_Ctx, .Queue_Depth = 4, .Core = -1},
+        {.Name = "speech", .Process = helper_Speech, .Ctx = &Speech_Ctx,
+         .Core = -1}};
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 6));
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Start(&Pipe));
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Wait(&Pipe));
+    helper_Report(Fixture_Names[c]);
+    Pipeline_Deinit(&Pipe);
+  }
+}
+
+// HELPER FUNCTIONS
+// 16 kHz 16-bit mono only, the chunks are walked to find fmt and data
+static size_t helper_Load_Wav(const char *Name) {
+  char Path[256];
+  snprintf(Path, sizeof(Path), "%s/%s", PIPE_FIXTURE_DIR, Name);
+  FILE *File = fopen(Path, "rb");
+  if (File == NULL) {
+    return 0;
+  }
+  uint8_t Header[12];
+  size_t Samples = 0;
+  bool Format_Ok = false;
+  if (fread(Header, 1, 12, File) == 12 && !memcmp(Header, "RIFF", 4) &&
+      !memcmp(Header + 8, "WAVE", 4)) {
+    uint8_t Chunk[8];
+    while (fread(Chunk, 1, 8, File) == 8) {
+      uint32_t Size = (uint32_t)Chunk[4] | (uint32_t)Chunk[5] << 8 |
+                      (uint32_t)Chunk[6] << 16 | (uint32_t)Chunk[7] << 24;
+      if (!memcmp(Chunk, "fmt ", 4) && Size >= 16) {
+        uint8_t Fmt[16];
+        if (fread(Fmt, 1, 16, File) != 16) {
+          break;
+        }
+        uint32_t Rate = (uint32_t)Fmt[4] | (uint32_t)Fmt[5] << 8 |
+                        (uint32_t)Fmt[6] << 16 | (uint32_t)Fmt[7] << 24;
+        Format_Ok = Fmt[0] == 1 && Fmt[2] == 1 && Rate == SAMPLE_RATE &&
+                    Fmt[14] == 16;
+        fseek(File, (long)(Size - 16 + (Size & 1)), SEEK_CUR);
+      } else if (!memcmp(Chunk, "data", 4) && Format_Ok) {
+        size_t Want = Size / 2 < MAX_CLIP_SAMPLES ? Size / 2 : MAX_CLIP_SAMPLES;
+        Samples = fread(Clip, 2, Want, File); // the host is little endian
+        break;
+      } else {
+        fseek(File, (long)(Size + (Size & 1)), SEEK_CUR);
+      }
+    }
+  }
+  fclose(File);
+  return Samples;
+}
+
+// a frame every 20 ms, as slots the way the mic sends them
+static PipeResult helper_Capture(PipeStage *Stage, PipeMsg *In) {
+  BenchCapture *Ctx = (BenchCapture *)Stage->Config.Ctx;
+  if (Ctx->Sent == Ctx->Frames) {
+    return PIPE_END;
+  }
+  if (Ctx->Next_us == 0) {
+    Ctx->Next_us = Pipe_Now_us();
+  }
+  Ctx->Next_us += 20000 / BENCH_SPEED;
+  helper_Sleep_Until(Ctx->Next_us);
+  AudioFrame *Frame = Pipe_Alloc(Stage, FRAME_BYTES);
+  if (Frame == NULL) {
+    return PIPE_END;
+  }
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    const size_t Index = Ctx->Sent * FRAME_SAMPLES + i;
+    const int16_t Sample = Index < Clip_Samples ? Clip[Index] : 0;
+    Frame->Data[i] = (int32_t)((uint32_t)(int32_t)Sample << 14);
+  }
+  Frame->Sequence = Ctx->Sent++;
+  Frame->Sample_Count = FRAME_SAMPLES;
+  Frame->Format = AUDIO_FORMAT_I2S32;
+  Frame->Timestamp_us = Pipe_Now_us();
+  return Pipe_Send_At(Stage, Frame, FRAME_BYTES, Frame->Timestamp_us)
+             ? PIPE_MORE
+             : PIPE_END;
+}
+
+// sends each block at the link's speed, then the server answers a piece
+// at a time
+static PipeResult helper_Upload(PipeStage *Stage, PipeMsg *In) {
+  BenchUpload *Ctx = (BenchUpload *)Stage->Config.Ctx;
+  PipeMsg Msg;
+  helper_Wait(SERVER_RTT_us / 2); // the request line and headers
+  while (Pipe_Receive(Stage, &Msg)) {
+    helper_Wait((int64_t)Msg.Length * 1000000 / LINK_BYTES_PER_S);
+    Ctx->Bytes += Msg.Length;
+    Pipe_Free(Stage, Msg.Block);
+  }
+  Ctx->Last_Byte_us = Pipe_Now_us();
+  helper_Wait(SERVER_RTT_us / 2 + SERVER_THINK_us);
+  for (size_t Done = 0; Done < sizeof(Reply) - 1; Done += TOKEN_BYTES) {
+    const size_t Take = sizeof(Reply) - 1 - Done < TOKEN_BYTES
+                            ? sizeof(Reply) - 1 - Done
+                            : TOKEN_BYTES;
+    char *Block = Pipe_Alloc(Stage, Take);
+    if (Block == NULL) {
+      return PIPE_END;
+    }
+    memcpy(Block, Reply + Done, Take);
+    if (!Pipe_Send(Stage, Block, (uint32_t)Take)) {
+      return PIPE_END;
+    }
+    helper_Wait(TOKEN_us);
+  }
+  return PIPE_END;
+}
+
+static PipeResult helper_Speech(PipeStage *Stage, PipeMsg *In) {
+  BenchSpeech *Ctx = (BenchSpeech *)Stage->Config.Ctx;
+  if (In == NULL) {
+    return PIPE_END;
+  }
+  if (Ctx->Sentences++ == 0) {
+    Ctx->First_us = Pipe_Now_us();
+  }
+  int64_t Words = 1;
+  for (uint32_t i = 0; i < In->Length; i++) {
+    Words += ((const char *)In->Block)[i] == ' ';
+  }
+  helper_Wait(Words * SPEAK_WORD_us);
+  return PIPE_MORE;
+}
+
+static void helper_Sleep_Until(int64_t Time_us) {
+  const int64_t Left_us = Time_us - Pipe_Now_us();
+  if (Left_us > 0) {
+    const struct timespec Sleep = {(time_t)(Left_us / 1000000),
+                                   (long)(Left_us % 1000000) * 1000};
+    nanosleep(&Sleep, NULL);
+  }
+}
+
+static void helper_Wait(int64_t Duration_us) {
+  helper_Sleep_Until(Pipe_Now_us() + Duration_us / BENCH_SPEED);
+}
+
+// times are put back in real time. one after another is the same work
+// with nothing overlapped: the upload of the whole file only starts once
+// the speaker stopped, and the answer is only spoken once it has all come
+static void helper_Report(const char *Clip_Name) {
+  PipeStageStats Stats[6];
+  for (size_t i = 0; i < 6; i++) {
+    Pipeline_Get_Stats(&Pipe, i, &Stats[i]);
+  }
+  char Line[200];
+  snprintf(Line, sizeof(Line), "%s, %u frames passed the vad, %zu bytes up",
+           Clip_Name, (unsigned)Stats[2].In, Upload_Ctx.Bytes);
+  TEST_MESSAGE(Line);
+  TEST_MESSAGE("stage      in   out  busy ms starved ms blocked ms latency "
+               "ms (max)");
+  for (size_t i = 0; i < 6; i++) {
+    snprintf(Line, sizeof(Line), "%-8s %4u  %4u  %7.1f  %9.1f  %9.1f  %7.1f "
+                                 "(%.1f)",
+             Stage_Names[i], (unsigned)Stats[i].In, (unsigned)Stats[i].Out,
+             Stats[i].Busy_us * BENCH_SPEED / 1000.0,
+             Stats[i].Starved_us * BENCH_SPEED / 1000.0,
+             Stats[i].Blocked_us * BENCH_SPEED / 1000.0,
+             Stats[i].Out ? Stats[i].Latency_us * BENCH_SPEED / 1000.0 /
+                                Stats[i].Out
+                          : 0.0,
+             Stats[i].Max_Latency_us * BENCH_SPEED / 1000.0);
+    TEST_MESSAGE(Line);
+  }
+  // the vad's end is when convert stopped
+  const int64_t Spoke_us = Speech_Ctx.First_us - Pipe.Start_us -
+                           Stats[1].Ended_us;
+  const double Upload_ms = (double)Upload_Ctx.Bytes * 1000.0 /
+                           LINK_BYTES_PER_S;
+  const double Reply_ms = (double)((sizeof(Reply) - 1 + TOKEN_BYTES - 1) /
+                                   TOKEN_BYTES) *
+                          TOKEN_us / 1000.0;
+  const double Serial_ms = (Stats[2].Busy_us * BENCH_SPEED) / 1000.0 +
+                           Upload_ms +
+                           (SERVER_RTT_us + SERVER_THINK_us) / 1000.0 +
+                           Reply_ms;
+  snprintf(Line, sizeof(Line),
+           "first sentence %.0f ms after the speaker stopped, one after "
+           "another %.0f ms",
+           (double)Spoke_us * BENCH_SPEED / 1000.0, Serial_ms);
+  TEST_MESSAGE(Line);
+}
+
+#endif
@@ -0,0 +1,158 @@
+/*Arena allocator unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the request arena hands out aligned, non overlapping
+    blocks, grows into new chunks, and that a reset reuses what it has
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_ARENA)
+
+#include "Arena.h"
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+static Arena *Request_Arena;
+const size_t Test_Chunk_Size = 256;
+
+// PROTOTYPING HELPERS
+size_t helper_Chunk_Count(const Arena *handle);
+
+// PROTOTYPING TESTS
+void test_Alloc_Is_Aligned_And_Disjoint();
+void test_Alloc_Grows_Into_New_Chunk();
+void test_Oversize_Alloc_Gets_Own_Chunk();
+void test_Reset_Reuses_Chunks();
+void test_Realloc_Grows_Newest_In_Place();
+void test_Realloc_Copies_Older_Block();
+void test_Owns_Only_Arena_Memory();
+void test_Strdup_Copies_String();
+void test_Null_And_Zero_Requests();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Request_Arena = Arena_Ini(Test_Chunk_Size);
+  TEST_ASSERT_NOT_NULL(Request_Arena);
+}
+void tearDown(void) { Arena_Destroy(Request_Arena); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Alloc_Is_Aligned_And_Disjoint);
+  RUN_TEST(test_Alloc_Grows_Into_New_Chunk);
+  RUN_TEST(test_Oversize_Alloc_Gets_Own_Chunk);
+  RUN_TEST(test_Reset_Reuses_Chunks);
+  RUN_TEST(test_Realloc_Grows_Newest_In_Place);
+  RUN_TEST(test_Realloc_Copies_Older_Block);
+  RUN_TEST(test_Owns_Only_Arena_Memory);
+  RUN_TEST(test_Strdup_Copies_String);
+  RUN_TEST(test_Null_And_Zero_Requests);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Alloc_Is_Aligned_And_Disjoint() {
+  uint8_t *First = Arena_Alloc(Request_Arena, 3);
+  uint8_t *Second = Arena_Alloc(Request_Arena, 5);
+  TEST_ASSERT_NOT_NULL(First);
+  TEST_ASSERT_NOT_NULL(Second);
+  TEST_ASSERT_EQUAL_size_t(0, (uintptr_t)First % _Alignof(max_align_t));
+  TEST_ASSERT_EQUAL_size_t(0, (uintptr_t)Second % _Alignof(max_align_t));
+  TEST_ASSERT_TRUE(Second >= First + 3);
+  TEST_ASSERT_EQUAL_size_t(8, Request_Arena->Total_Used);
+}
+
+void test_Alloc_Grows_Into_New_Chunk() {
+  for (size_t i = 0; i < 8; i++) {
+    uint8_t *Block = Arena_Alloc(Request_Arena, 64);
+    TEST_ASSERT_NOT_NULL(Block);
+    memset(Block, (int)i, 64);
+  }
+  TEST_ASSERT_EQUAL_size_t(2, helper_Chunk_Count(Request_Arena));
+  TEST_ASSERT_EQUAL_size_t(8 * 64, Request_Arena->Total_Used);
+}
+
+void test_Oversize_Alloc_Gets_Own_Chunk() {
+  uint8_t *Block = Arena_Alloc(Request_Arena, Test_Chunk_Size * 4);
+  TEST_ASSERT_NOT_NULL(Block);
+  memset(Block, 0xAA, Test_Chunk_Size * 4);
+  TEST_ASSERT_EQUAL_size_t(Test_Chunk_Size * 4, Request_Arena->Current->Size);
+}
+
+void test_Reset_Reuses_Chunks() {
+  void *First = Arena_Alloc(Request_Arena, 200);
+  Arena_Alloc(Request_Arena, 200); // spills into a second chunk
+  TEST_ASSERT_EQUAL_size_t(2, helper_Chunk_Count(Request_Arena));
+
+  Arena_Reset(Request_Arena);
+  TEST_ASSERT_EQUAL_size_t(0, Request_Arena->Total_Used);
+  TEST_ASSERT_EQUAL_size_t(400, Request_Arena->High_Water);
+  // same pattern again lands on the same memory with no new chunks
+  TEST_ASSERT_EQUAL_PTR(First, Arena_Alloc(Request_Arena, 200));
+  Arena_Alloc(Request_Arena, 200);
+  TEST_ASSERT_EQUAL_size_t(2, helper_Chunk_Count(Request_Arena));
+}
+
+void test_Realloc_Grows_Newest_In_Place() {
+  char *Buffer = Arena_Alloc(Request_Arena, 16);
+  strcpy(Buffer, "response");
+  char *Grown = Arena_Realloc(Request_Arena, Buffer, 16, 128);
+  TEST_ASSERT_EQUAL_PTR(Buffer, Grown);
+  TEST_ASSERT_EQUAL_size_t(128, Request_Arena->Total_Used);
+
+  // past the end of the chunk it has to move, contents come along
+  char *Moved = Arena_Realloc(Request_Arena, Grown, 128, 1024);
+  TEST_ASSERT_NOT_NULL(Moved);
+  TEST_ASSERT_TRUE(Moved != Grown);
+  TEST_ASSERT_EQUAL_STRING("response", Moved);
+}
+
+void test_Realloc_Copies_Older_Block() {
+  char *Older = Arena_Strdup(Request_Arena, "older");
+  Arena_Alloc(Request_Arena, 8);
+  char *Grown = Arena_Realloc(Request_Arena, Older, 6, 32);
+  TEST_ASSERT_TRUE(Grown != Older);
+  TEST_ASSERT_EQUAL_STRING("older", Grown);
+}
+
+void test_Owns_Only_Arena_Memory() {
+  int stack_variable = 100;
+  void *First = Arena_Alloc(Request_Arena, 200);
+  void *Second = Arena_Alloc(Request_Arena, 200);
+  TEST_ASSERT_TRUE(Arena_Owns(Request_Arena, First));
+  TEST_ASSERT_TRUE(Arena_Owns(Request_Arena, Second));
+  TEST_ASSERT_FALSE(Arena_Owns(Request_Arena, &stack_variable));
+  TEST_ASSERT_FALSE(Arena_Owns(Request_Arena, NULL));
+}
+
+void test_Strdup_Copies_String() {
+  const char *Original = "cachedContents/abc123";
+  char *Copy = Arena_Strdup(Request_Arena, Original);
+  TEST_ASSERT_TRUE(Copy != Original);
+  TEST_ASSERT_EQUAL_STRING(Original, Copy);
+  TEST_ASSERT_NULL(Arena_Strdup(Request_Arena, NULL));
+}
+
+void test_Null_And_Zero_Requests() {
+  TEST_ASSERT_NULL(Arena_Ini(0));
+  TEST_ASSERT_NULL(Arena_Alloc(NULL, 16));
+  TEST_ASSERT_NULL(Arena_Alloc(Request_Arena, 0));
+  Arena_Reset(NULL);
+  Arena_Destroy(NULL);
+}
+
+// HELPER FUNCTIONS
+size_t helper_Chunk_Count(const Arena *handle) {
+  size_t Count = 0;
+  for (const ArenaChunk *Chunk = handle->First; Chunk != NULL;
+       Chunk = Chunk->Next) {
+    Count++;
+  }
+  return Count;
+}
+
+#endif
@@ -0,0 +1,349 @@
+/*Audio capture ring unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the frame ring hands frames over in order and refuses
+    them when full, that the capture side numbers frames, counts what it
+    drops and gives every block back to the pool, then runs a simulated
+    i2s producer on one pthread against a consumer on another and checks
+    every sample arrives untouched
+    run with: pio test -e native_audio_capture
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_CAPTURE)
+
+#ifndef POOL_THREAD_SAFE
+#error "frames are freed on the consumer thread, build with POOL_THREAD_SAFE"
+#endif
+
+#include "AudioCapture.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#define FRAME_SAMPLES 320 // 20 ms at 16 kHz
+#define RING_FRAMES 8
+#define POOL_FRAMES 12
+static PoolMemoryInfo *Memory_Handler;
+static AudioCapture Capture;
+static const PoolClassConfig Audio_Classes[] = {
+    {sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t), POOL_FRAMES, 0}};
+const uint32_t Threaded_Frames = 20000;
+
+typedef struct { // what the consumer thread saw
+  uint32_t Received;
+  uint32_t Out_Of_Order;
+  uint32_t Corrupted;
+  uint32_t Gaps; // frames the sequence skipped
+} ConsumerResult;
+
+static atomic_bool Producer_Done;
+
+// PROTOTYPING HELPERS
+static int32_t helper_Slot(uint32_t Sequence, size_t Index);
+static void helper_Fill(AudioFrame *Frame, uint32_t Sequence);
+static bool helper_Frame_Intact(const AudioFrame *Frame);
+static void *helper_Producer_Thread(void *Argument);
+static void *helper_Consumer_Thread(void *Argument);
+static void helper_Confirm_Every_Block_Returned(void);
+
+// PROTOTYPING TESTS
+void test_Ring_Rejects_Bad_Sizes();
+void test_Ring_Is_First_In_First_Out_Across_Wrap();
+void test_Ring_Full_Refuses_The_Frame();
+void test_Capture_Numbers_Frames();
+void test_Capture_Counts_Ring_Full_And_Frees();
+void test_Capture_Counts_Pool_Empty_As_A_Gap();
+void test_Capture_Abort_Counts_Read_Error();
+void test_Capture_Refuses_A_Pool_Too_Small();
+void test_Capture_Flush_Returns_Everything();
+void test_Threaded_Producer_And_Consumer();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Audio_Classes, 1);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+  TEST_ASSERT_EQUAL_INT(
+      0, Audio_Capture_Ini(&Capture, Memory_Handler, FRAME_SAMPLES,
+                           RING_FRAMES));
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Ring_Rejects_Bad_Sizes);
+  RUN_TEST(test_Ring_Is_First_In_First_Out_Across_Wrap);
+  RUN_TEST(test_Ring_Full_Refuses_The_Frame);
+  RUN_TEST(test_Capture_Numbers_Frames);
+  RUN_TEST(test_Capture_Counts_Ring_Full_And_Frees);
+  RUN_TEST(test_Capture_Counts_Pool_Empty_As_A_Gap);
+  RUN_TEST(test_Capture_Abort_Counts_Read_Error);
+  RUN_TEST(test_Capture_Refuses_A_Pool_Too_Small);
+  RUN_TEST(test_Capture_Flush_Returns_Everything);
+  RUN_TEST(test_Threaded_Producer_And_Consumer);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Ring_Rejects_Bad_Sizes() {
+  AudioRing Ring;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Ring_Ini(&Ring, 0));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Ring_Ini(&Ring, 6));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Ring_Ini(&Ring, AUDIO_RING_MAX_FRAMES * 2));
+  TEST_ASSERT_EQUAL_INT(0, Audio_Ring_Ini(&Ring, 1));
+  TEST_ASSERT_EQUAL_INT(0, Audio_Ring_Ini(&Ring, AUDIO_RING_MAX_FRAMES));
+}
+
+void test_Ring_Is_First_In_First_Out_Across_Wrap() {
+  AudioRing Ring;
+  AudioFrame Frames[4];
+  TEST_ASSERT_EQUAL_INT(0, Audio_Ring_Ini(&Ring, 4));
+  TEST_ASSERT_NULL(Audio_Ring_Pop(&Ring));
+  // push and pop around the ring a few times, 3 in flight at once
+  size_t Next_In = 0, Next_Out = 0;
+  for (int Round = 0; Round < 10; Round++) {
+    while (Audio_Ring_Count(&Ring) < 3) {
+      TEST_ASSERT_TRUE(Audio_Ring_Push(&Ring, &Frames[Next_In++ % 4]));
+    }
+    TEST_ASSERT_EQUAL_PTR(&Frames[Next_Out++ % 4], Audio_Ring_Pop(&Ring));
+    TEST_ASSERT_EQUAL_PTR(&Frames[Next_Out++ % 4], Audio_Ring_Pop(&Ring));
+  }
+  TEST_ASSERT_EQUAL_size_t(Next_In - Next_Out, Audio_Ring_Count(&Ring));
+}
+
+void test_Ring_Full_Refuses_The_Frame() {
+  AudioRing Ring;
+  AudioFrame Frames[3];
+  TEST_ASSERT_EQUAL_INT(0, Audio_Ring_Ini(&Ring, 2));
+  TEST_ASSERT_TRUE(Audio_Ring_Push(&Ring, &Frames[0]));
+  TEST_ASSERT_TRUE(Audio_Ring_Push(&Ring, &Frames[1]));
+  TEST_ASSERT_FALSE(Audio_Ring_Push(&Ring, &Frames[2]));
+  TEST_ASSERT_EQUAL_PTR(&Frames[0], Audio_Ring_Pop(&Ring));
+  TEST_ASSERT_TRUE(Audio_Ring_Push(&Ring, &Frames[2]));
+  TEST_ASSERT_EQUAL_PTR(&Frames[1], Audio_Ring_Pop(&Ring));
+  TEST_ASSERT_EQUAL_PTR(&Frames[2], Audio_Ring_Pop(&Ring));
+}
+
+// the consumer gets the very block the producer filled
+void test_Capture_Numbers_Frames() {
+  for (uint32_t i = 0; i < 3; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+    TEST_ASSERT_NOT_NULL(Frame);
+    TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_I2S32, Frame->Format);
+    helper_Fill(Frame, i);
+    TEST_ASSERT_TRUE(
+        Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, 1000 * i));
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+    TEST_ASSERT_NOT_NULL(Frame);
+    TEST_ASSERT_EQUAL_UINT32(i, Frame->Sequence);
+    TEST_ASSERT_EQUAL_UINT32(FRAME_SAMPLES, Frame->Sample_Count);
+    TEST_ASSERT_EQUAL_INT64(1000 * i, Frame->Timestamp_us);
+    TEST_ASSERT_TRUE(helper_Frame_Intact(Frame));
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  TEST_ASSERT_NULL(Audio_Capture_Frame_Take(&Capture));
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(3, Counters.Frames);
+  TEST_ASSERT_EQUAL_UINT32(3, Counters.Ring_High_Water);
+  helper_Confirm_Every_Block_Returned();
+}
+
+// a stalled consumer costs the newest frames, never a block
+void test_Capture_Counts_Ring_Full_And_Frees() {
+  for (uint32_t i = 0; i < RING_FRAMES + 3; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+    TEST_ASSERT_NOT_NULL(Frame);
+    helper_Fill(Frame, i);
+    TEST_ASSERT_EQUAL(i < RING_FRAMES, Audio_Capture_Frame_Commit(
+                                           &Capture, Frame, FRAME_SAMPLES, 0));
+  }
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(RING_FRAMES, Counters.Frames);
+  TEST_ASSERT_EQUAL_UINT32(3, Counters.Ring_Full);
+  TEST_ASSERT_EQUAL_UINT32(RING_FRAMES, Counters.Ring_High_Water);
+  // the consumer catches up and sees the gap in the sequence
+  Audio_Capture_Frame_Release(&Capture, Audio_Capture_Frame_Take(&Capture));
+  AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+  Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, 0);
+  uint32_t Last = 0;
+  while ((Frame = Audio_Capture_Frame_Take(&Capture)) != NULL) {
+    Last = Frame->Sequence;
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  TEST_ASSERT_EQUAL_UINT32(RING_FRAMES + 3, Last);
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Capture_Counts_Pool_Empty_As_A_Gap() {
+  AudioFrame *Held[POOL_FRAMES];
+  for (size_t i = 0; i < POOL_FRAMES; i++) {
+    Held[i] = Audio_Capture_Frame_Get(&Capture);
+    TEST_ASSERT_NOT_NULL(Held[i]);
+  }
+  TEST_ASSERT_NULL(Audio_Capture_Frame_Get(&Capture));
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Pool_Empty);
+  Audio_Capture_Frame_Commit(&Capture, Held[0], FRAME_SAMPLES, 0);
+  AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+  TEST_ASSERT_EQUAL_UINT32(1, Frame->Sequence); // 0 was the lost one
+  Audio_Capture_Frame_Release(&Capture, Frame);
+  for (size_t i = 1; i < POOL_FRAMES; i++) {
+    Audio_Capture_Frame_Release(&Capture, Held[i]);
+  }
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Capture_Abort_Counts_Read_Error() {
+  Audio_Capture_Frame_Abort(&Capture, Audio_Capture_Frame_Get(&Capture));
+  AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+  Audio_Capture_Frame_Commit(&Capture, Frame, 100, 0);
+  Frame = Audio_Capture_Frame_Take(&Capture);
+  TEST_ASSERT_EQUAL_UINT32(1, Frame->Sequence);
+  TEST_ASSERT_EQUAL_UINT32(100, Frame->Sample_Count); // a short read is kept
+  Audio_Capture_Frame_Release(&Capture, Frame);
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Read_Errors);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Frames);
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Capture_Refuses_A_Pool_Too_Small() {
+  AudioCapture Other;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Capture_Ini(&Other, Memory_Handler,
+                                              FRAME_SAMPLES * 2, RING_FRAMES));
+  TEST_ASSERT_EQUAL_INT(
+      -1, Audio_Capture_Ini(&Other, Memory_Handler, FRAME_SAMPLES, 3));
+  TEST_ASSERT_EQUAL_INT(-1,
+                        Audio_Capture_Ini(&Other, NULL, FRAME_SAMPLES, 4));
+}
+
+void test_Capture_Flush_Returns_Everything() {
+  for (int i = 0; i < 5; i++) {
+    Audio_Capture_Frame_Commit(&Capture, Audio_Capture_Frame_Get(&Capture),
+                               FRAME_SAMPLES, 0);
+  }
+  Audio_Capture_Flush(&Capture);
+  TEST_ASSERT_NULL(Audio_Capture_Frame_Take(&Capture));
+  helper_Confirm_Every_Block_Returned();
+}
+
+// the i2s task and the uploader on different cores. the consumer yields
+// now and then so the ring does fill up, whatever gets through has to be
+// whole and in order and every dropped frame has to show as a gap
+void test_Threaded_Producer_And_Consumer() {
+  pthread_t Producer, Consumer;
+  ConsumerResult Result = {0};
+  atomic_store(&Producer_Done, false);
+  pthread_create(&Consumer, NULL, helper_Consumer_Thread, &Result);
+  pthread_create(&Producer, NULL, helper_Producer_Thread, NULL);
+  pthread_join(Producer, NULL);
+  pthread_join(Consumer, NULL);
+
+  AudioCaptureCounters Counters;
+  Audio_Capture_Get_Counters(&Capture, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(0, Result.Out_Of_Order);
+  TEST_ASSERT_EQUAL_UINT32(0, Result.Corrupted);
+  TEST_ASSERT_EQUAL_UINT32(Counters.Frames, Result.Received);
+  TEST_ASSERT_EQUAL_UINT32(Threaded_Frames, Counters.Frames +
+                                                Counters.Ring_Full +
+                                                Counters.Pool_Empty);
+  TEST_ASSERT_EQUAL_UINT32(Counters.Ring_Full + Counters.Pool_Empty,
+                           Result.Gaps);
+  helper_Confirm_Every_Block_Returned();
+  char Line[128];
+  snprintf(Line, sizeof(Line),
+           "%u frames, %u through, %u ring full, %u pool empty, high water %u",
+           (unsigned)Threaded_Frames, (unsigned)Counters.Frames,
+           (unsigned)Counters.Ring_Full, (unsigned)Counters.Pool_Empty,
+           (unsigned)Counters.Ring_High_Water);
+  TEST_MESSAGE(Line);
+}
+
+// HELPER FUNCTIONS
+static int32_t helper_Slot(uint32_t Sequence, size_t Index) {
+  return (int32_t)(Sequence * 2654435761u + (uint32_t)Index * 40503u);
+}
+
+static void helper_Fill(AudioFrame *Frame, uint32_t Sequence) {
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Frame->Data[i] = helper_Slot(Sequence, i);
+  }
+}
+
+static bool helper_Frame_Intact(const AudioFrame *Frame) {
+  for (size_t i = 0; i < Frame->Sample_Count; i++) {
+    if (Frame->Data[i] != helper_Slot(Frame->Sequence, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// fills a frame the way the dma would, the sequence it will be given is
+// the producer's own counter
+static void *helper_Producer_Thread(void *Argument) {
+  for (uint32_t i = 0; i < Threaded_Frames; i++) {
+    uint32_t Sequence = Capture.Sequence;
+    AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+    if (Frame == NULL) {
+      continue;
+    }
+    helper_Fill(Frame, Sequence);
+    Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, i);
+    if (i % 64 == 0) {
+      sched_yield();
+    }
+  }
+  atomic_store(&Producer_Done, true);
+  return NULL;
+}
+
+static void *helper_Consumer_Thread(void *Argument) {
+  ConsumerResult *Result = (ConsumerResult *)Argument;
+  int64_t Expected = 0;
+  for (;;) {
+    bool Done = atomic_load(&Producer_Done);
+    AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+    if (Frame == NULL) {
+      if (Done) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    if ((int64_t)Frame->Sequence < Expected) {
+      Result->Out_Of_Order++;
+    }
+    Result->Gaps += (uint32_t)((int64_t)Frame->Sequence - Expected);
+    Expected = (int64_t)Frame->Sequence + 1;
+    if (!helper_Frame_Intact(Frame)) {
+      Result->Corrupted++;
+    }
+    Result->Received++;
+    Audio_Capture_Frame_Release(&Capture, Frame);
+    if (Result->Received % 97 == 0) {
+      sched_yield(); // lets the ring back up now and then
+    }
+  }
+  // drops after the last frame that got through don't show as a gap
+  Result->Gaps += (uint32_t)((int64_t)Capture.Sequence - Expected);
+  return NULL;
+}
+
+static void helper_Confirm_Every_Block_Returned(void) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  TEST_ASSERT_EQUAL_size_t(0, Stats.Class[0].Counters.In_Use);
+}
+
+#endif
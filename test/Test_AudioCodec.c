@@ -0,0 +1,710 @@
+/*Audio codec unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the wav codec byte for byte, decodes the ima adpcm
+    and flac output with small decoders written here from the format
+    specs (crcs, frame numbers and all) and compares against what went
+    in. flac has to come back exact on the wav clips in test/fixtures/vad
+    and on the signals that pick each subframe type, adpcm has to stay
+    close to the speech. pushing a frame at a time, a sample at a time or
+    through the pull adapter must give the very same file
+    run with: pio test -e native_audio_codec
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_CODEC)
+
+#include "AudioCodec.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#ifndef CODEC_FIXTURE_DIR
+#define CODEC_FIXTURE_DIR "test/fixtures/vad"
+#endif
+#define SAMPLE_RATE 16000
+#define FRAME_SAMPLES 320 // 20 ms
+#define MAX_CLIP_SAMPLES (4 * SAMPLE_RATE)
+#define MAX_FILE_BYTES (2 * MAX_CLIP_SAMPLES + 64 * 1024)
+static int16_t Clip[MAX_CLIP_SAMPLES];
+static int16_t Decoded[MAX_CLIP_SAMPLES + AUDIO_CODEC_MAX_BLOCK];
+static uint8_t File_Bytes[MAX_FILE_BYTES];
+static uint8_t Other_Bytes[MAX_FILE_BYTES];
+static const char *const Fixture_Names[] = {
+    "room_noise.wav", "click.wav",       "one_phrase.wav",
+    "short_pause.wav", "long_pause.wav", "fricative_first.wav"};
+
+typedef struct { // pcm source for the pull adapter, odd sized reads
+  const int16_t *Pcm;
+  size_t Count;
+  size_t Pos;
+  size_t Step;
+  bool Fail_At_End;
+} PcmSource;
+
+typedef struct { // msb first
+  const uint8_t *Data;
+  size_t Len;
+  size_t Bit;
+} BitReader;
+
+// PROTOTYPING HELPERS
+static size_t helper_Load_Wav(const char *Name);
+static size_t helper_Encode(const AudioEncoderConfig *Config,
+                            const int16_t *Pcm, size_t Count, size_t Chunk,
+                            uint8_t *Out);
+static int helper_Pcm_Read(void *Ctx, int16_t *Samples, size_t Max_Samples);
+static long helper_Flac_Decode(const uint8_t *Data, size_t Len, int16_t *Out,
+                               size_t Max);
+static long helper_Adpcm_Decode(const uint8_t *Data, size_t Len, int16_t *Out,
+                                 size_t Max);
+static uint32_t helper_Bits(BitReader *Reader, unsigned Count);
+static int32_t helper_Signed_Bits(BitReader *Reader, unsigned Count);
+static uint32_t helper_Unary(BitReader *Reader);
+static uint32_t helper_Le32(const uint8_t *Data);
+static double helper_Snr_Db(const int16_t *Want, const int16_t *Got,
+                            size_t Count);
+static void helper_Confirm_Flac_Exact(const int16_t *Pcm, size_t Count,
+                                      size_t Block, const char *Label);
+
+// PROTOTYPING TESTS
+void test_Ini_Checks_Config();
+void test_Wav_Is_Header_And_Pcm();
+void test_Adpcm_Decodes_Close_To_Speech();
+void test_Flac_Lossless_On_Fixtures();
+void test_Flac_Subframe_Types_And_Edges();
+void test_Flac_Frame_Numbers_Past_One_Byte();
+void test_Flac_Drop_Bits_Rounds_And_Shrinks();
+void test_Chunk_Size_Does_Not_Change_The_File();
+void test_Stream_Adapter_Matches_Push();
+
+//================================CODE
+// START=============================================
+void setUp(void) { srand(19); }
+void tearDown(void) {}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Ini_Checks_Config);
+  RUN_TEST(test_Wav_Is_Header_And_Pcm);
+  RUN_TEST(test_Adpcm_Decodes_Close_To_Speech);
+  RUN_TEST(test_Flac_Lossless_On_Fixtures);
+  RUN_TEST(test_Flac_Subframe_Types_And_Edges);
+  RUN_TEST(test_Flac_Frame_Numbers_Past_One_Byte);
+  RUN_TEST(test_Flac_Drop_Bits_Rounds_And_Shrinks);
+  RUN_TEST(test_Chunk_Size_Does_Not_Change_The_File);
+  RUN_TEST(test_Stream_Adapter_Matches_Push);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Ini_Checks_Config() {
+  AudioEncoder Encoder;
+  AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 0};
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encoder, &Config));
+  TEST_ASSERT_EQUAL_size_t(320, Encoder.Block_Samples);
+  Config.Block_Samples = 15; // under the flac minimum
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Block_Samples = AUDIO_CODEC_MAX_BLOCK + 1;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Block_Samples = 0;
+  Config.Drop_Bits = 9;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Drop_Bits = 0;
+  Config.Sample_Rate = 0;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Sample_Rate = SAMPLE_RATE;
+  Config.Codec = NULL;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+
+  // adpcm blocks are a header sample and whole bytes of two
+  Config.Codec = &Audio_Codec_Ima_Adpcm;
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encoder, &Config));
+  TEST_ASSERT_EQUAL_size_t(505, Encoder.Block_Samples);
+  TEST_ASSERT_EQUAL_size_t(256, Encoder.State.Adpcm.Block_Align);
+  Config.Block_Samples = 320;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Block_Samples = 1;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Block_Samples = 0;
+  Config.Drop_Bits = 2; // flac only
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+  Config.Codec = &Audio_Codec_Wav;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Encoder_Ini(&Encoder, &Config));
+}
+
+void test_Wav_Is_Header_And_Pcm() {
+  static const uint8_t Want_Header[44] = {
+      'R', 'I',  'F',  'F', 0x2c, 0,    0,    0,    'W', 'A',  'V',
+      'E', 'f',  'm',  't', ' ',  16,   0,    0,    0,   1,    0,
+      1,   0,    0x80, 0x3e, 0,   0,    0,    0x7d, 0,   0,    2,
+      0,   16,   0,    'd', 'a',  't',  'a',  8,    0,   0,    0};
+  const int16_t Pcm[4] = {1, -2, 0x1234, INT16_MIN};
+  AudioEncoderConfig Config = {&Audio_Codec_Wav, SAMPLE_RATE, 4, 0, 0};
+  size_t Len = helper_Encode(&Config, Pcm, 4, 3, File_Bytes);
+  TEST_ASSERT_EQUAL_size_t(52, Len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(Want_Header, File_Bytes, 44);
+  const uint8_t Want_Data[8] = {1, 0, 0xfe, 0xff, 0x34, 0x12, 0, 0x80};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(Want_Data, File_Bytes + 44, 8);
+  // unknown length runs to the end of the stream
+  Config.Total_Samples = 0;
+  helper_Encode(&Config, Pcm, 4, 4, File_Bytes);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, helper_Le32(File_Bytes + 4));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, helper_Le32(File_Bytes + 40));
+}
+
+void test_Adpcm_Decodes_Close_To_Speech() {
+  size_t Samples = helper_Load_Wav("one_phrase.wav");
+  TEST_ASSERT_TRUE(Samples > 0);
+  AudioEncoderConfig Config = {&Audio_Codec_Ima_Adpcm, SAMPLE_RATE,
+                               (uint32_t)Samples, 0, 0};
+  size_t Len = helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+  // whole blocks of 256, the last one padded out
+  size_t Blocks = (Samples + 504) / 505;
+  TEST_ASSERT_EQUAL_size_t(60 + Blocks * 256, Len);
+  TEST_ASSERT_EQUAL_UINT32(Blocks * 256, helper_Le32(File_Bytes + 56));
+  TEST_ASSERT_EQUAL_UINT32(Samples, helper_Le32(File_Bytes + 48));
+  long Got = helper_Adpcm_Decode(File_Bytes, Len, Decoded,
+                                 sizeof(Decoded) / sizeof(Decoded[0]));
+  TEST_ASSERT_EQUAL_INT32((long)(Blocks * 505), Got);
+  // each block starts on its sample exactly
+  for (size_t b = 0; b < Blocks; b++) {
+    TEST_ASSERT_EQUAL_INT16(Clip[b * 505], Decoded[b * 505]);
+  }
+  // the phrase itself, 0.6 s to 1.4 s
+  double Snr = helper_Snr_Db(Clip + 9600, Decoded + 9600, 12800);
+  char Line[96];
+  snprintf(Line, sizeof(Line), "adpcm speech snr %.1f dB, %.2f:1", Snr,
+           (double)(Samples * 2 + 44) / (double)Len);
+  TEST_MESSAGE(Line);
+  TEST_ASSERT_TRUE(Snr > 20.0);
+}
+
+void test_Flac_Lossless_On_Fixtures() {
+  for (size_t f = 0; f < sizeof(Fixture_Names) / sizeof(Fixture_Names[0]);
+       f++) {
+    size_t Samples = helper_Load_Wav(Fixture_Names[f]);
+    TEST_ASSERT_TRUE_MESSAGE(Samples > 0, Fixture_Names[f]);
+    helper_Confirm_Flac_Exact(Clip, Samples, 0, Fixture_Names[f]);
+    AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 0};
+    size_t Len =
+        helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+    char Line[96];
+    snprintf(Line, sizeof(Line), "flac %-20s %.2f:1", Fixture_Names[f],
+             (double)(Samples * 2 + 44) / (double)Len);
+    TEST_MESSAGE(Line);
+  }
+}
+
+void test_Flac_Subframe_Types_And_Edges() {
+  int16_t *Pcm = Clip;
+  // silence is a constant subframe, a few bytes a frame
+  memset(Pcm, 0, 4 * FRAME_SAMPLES * sizeof(int16_t));
+  helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, 0, "silence");
+  AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 0};
+  size_t Len = helper_Encode(&Config, Pcm, 4 * FRAME_SAMPLES, FRAME_SAMPLES,
+                             File_Bytes);
+  TEST_ASSERT_TRUE(Len < 42 + 4 * 16);
+  // full scale noise can't be predicted, verbatim keeps it at 16 bits
+  for (size_t i = 0; i < 4 * FRAME_SAMPLES; i++) {
+    Pcm[i] = (int16_t)(rand() & 0xffff);
+  }
+  helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, 0, "noise");
+  Len = helper_Encode(&Config, Pcm, 4 * FRAME_SAMPLES, FRAME_SAMPLES,
+                      File_Bytes);
+  TEST_ASSERT_TRUE(Len <= 42 + 4 * (2 * FRAME_SAMPLES + 16));
+  // the largest steps a residual can take
+  for (size_t i = 0; i < 4 * FRAME_SAMPLES; i++) {
+    Pcm[i] = (i / 2) % 2 ? INT16_MIN : INT16_MAX;
+  }
+  helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, 0, "extremes");
+  // a ramp is all fixed order 2 zeros, one shifted up leaves wasted bits
+  for (size_t i = 0; i < 4 * FRAME_SAMPLES; i++) {
+    Pcm[i] = (int16_t)((int)i * 7 - 4000);
+  }
+  helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, 0, "ramp");
+  for (size_t i = 0; i < 4 * FRAME_SAMPLES; i++) {
+    Pcm[i] = (int16_t)(((int)(rand() % 512) - 256) * 32);
+  }
+  helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, 0, "wasted bits");
+  // short last frames, down to one sample, and a clip with none at all
+  for (size_t i = 0; i < 4 * FRAME_SAMPLES; i++) {
+    Pcm[i] = (int16_t)(1000 * sin((double)i * 0.05) + (rand() % 64));
+  }
+  for (size_t Count = 0; Count < 6; Count++) {
+    helper_Confirm_Flac_Exact(Pcm, Count, 16, "tiny");
+  }
+  helper_Confirm_Flac_Exact(Pcm, 3 * FRAME_SAMPLES + 1, 0, "one over");
+  helper_Confirm_Flac_Exact(Pcm, 3 * FRAME_SAMPLES + 17, 0, "odd tail");
+  // block sizes with their own codes in the frame header
+  const size_t Blocks[] = {16, 192, 256, 576, 1024, 1152, 1000, 100};
+  for (size_t b = 0; b < sizeof(Blocks) / sizeof(Blocks[0]); b++) {
+    helper_Confirm_Flac_Exact(Pcm, 4 * FRAME_SAMPLES, Blocks[b], "blocks");
+  }
+}
+
+// frame numbers are utf-8 coded, 16 sample blocks go past 2 and 3 bytes
+void test_Flac_Frame_Numbers_Past_One_Byte() {
+  for (size_t i = 0; i < MAX_CLIP_SAMPLES; i++) {
+    Clip[i] = (int16_t)(rand() % 200 - 100);
+  }
+  helper_Confirm_Flac_Exact(Clip, MAX_CLIP_SAMPLES, 16, "4000 frames");
+}
+
+void test_Flac_Drop_Bits_Rounds_And_Shrinks() {
+  size_t Samples = helper_Load_Wav("one_phrase.wav");
+  TEST_ASSERT_TRUE(Samples > 0);
+  Clip[0] = INT16_MAX; // the top can't round up
+  Clip[1] = INT16_MIN;
+  AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 0};
+  size_t Lossless =
+      helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+  size_t Previous = Lossless;
+  for (uint8_t Drop = 2; Drop <= 8; Drop += 2) {
+    Config.Drop_Bits = Drop;
+    size_t Len =
+        helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+    TEST_ASSERT_TRUE(Len < Previous);
+    Previous = Len;
+    long Got = helper_Flac_Decode(File_Bytes, Len, Decoded,
+                                  sizeof(Decoded) / sizeof(Decoded[0]));
+    TEST_ASSERT_EQUAL_INT32((long)Samples, Got);
+    const int32_t Step = 1 << Drop;
+    for (size_t i = 0; i < Samples; i++) {
+      int32_t Error = Decoded[i] - Clip[i];
+      TEST_ASSERT_EQUAL_INT32(0, Decoded[i] % Step);
+      // to the nearest step, or the step below at the very top
+      TEST_ASSERT_TRUE(Error > -Step && Error <= Step / 2);
+    }
+    double Snr = helper_Snr_Db(Clip + 9600, Decoded + 9600, 12800);
+    char Line[96];
+    snprintf(Line, sizeof(Line), "flac drop %u, snr %.1f dB, %.2f:1",
+             (unsigned)Drop, Snr, (double)(Samples * 2 + 44) / (double)Len);
+    TEST_MESSAGE(Line);
+  }
+}
+
+void test_Chunk_Size_Does_Not_Change_The_File() {
+  size_t Samples = helper_Load_Wav("short_pause.wav");
+  TEST_ASSERT_TRUE(Samples > 0);
+  const AudioCodec *Codecs[] = {&Audio_Codec_Wav, &Audio_Codec_Ima_Adpcm,
+                                &Audio_Codec_Flac};
+  const size_t Chunks[] = {1, 7, 160, 319};
+  for (size_t c = 0; c < 3; c++) {
+    AudioEncoderConfig Config = {Codecs[c], SAMPLE_RATE, 0, 0, 0};
+    size_t Want =
+        helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+    for (size_t k = 0; k < sizeof(Chunks) / sizeof(Chunks[0]); k++) {
+      size_t Len = helper_Encode(&Config, Clip, Samples, Chunks[k],
+                                 Other_Bytes);
+      TEST_ASSERT_EQUAL_size_t_MESSAGE(Want, Len, Codecs[c]->Name);
+      TEST_ASSERT_EQUAL_MEMORY_MESSAGE(File_Bytes, Other_Bytes, Want,
+                                       Codecs[c]->Name);
+    }
+  }
+}
+
+// odd source reads and a byte at a time out, as the payload might ask
+void test_Stream_Adapter_Matches_Push() {
+  size_t Samples = helper_Load_Wav("one_phrase.wav");
+  TEST_ASSERT_TRUE(Samples > 0);
+  static AudioEncodeStream Stream;
+  const AudioCodec *Codecs[] = {&Audio_Codec_Wav, &Audio_Codec_Ima_Adpcm,
+                                &Audio_Codec_Flac};
+  for (size_t c = 0; c < 3; c++) {
+    AudioEncoderConfig Config = {Codecs[c], SAMPLE_RATE, 0, 0, 0};
+    size_t Want =
+        helper_Encode(&Config, Clip, Samples, FRAME_SAMPLES, File_Bytes);
+    PcmSource Source = {Clip, Samples, 0, 77, false};
+    TEST_ASSERT_EQUAL_INT(0, Audio_Encode_Stream_Ini(&Stream, &Config,
+                                                     helper_Pcm_Read, &Source));
+    size_t Len = 0;
+    int Got;
+    size_t Size = 1;
+    while ((Got = Audio_Encode_Stream_Read(&Stream, Other_Bytes + Len,
+                                           Size)) > 0) {
+      TEST_ASSERT_TRUE((size_t)Got <= Size);
+      Len += (size_t)Got;
+      Size = Size % 300 + 1;
+    }
+    TEST_ASSERT_EQUAL_INT(0, Got);
+    TEST_ASSERT_EQUAL_INT(0, Audio_Encode_Stream_Read(&Stream, Other_Bytes, 1));
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(Want, Len, Codecs[c]->Name);
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(File_Bytes, Other_Bytes, Want,
+                                     Codecs[c]->Name);
+  }
+  // a source that gives up is passed on
+  AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE, 0, 0, 0};
+  PcmSource Source = {Clip, 1000, 0, 320, true};
+  TEST_ASSERT_EQUAL_INT(
+      0, Audio_Encode_Stream_Ini(&Stream, &Config, helper_Pcm_Read, &Source));
+  int Got;
+  while ((Got = Audio_Encode_Stream_Read(&Stream, Other_Bytes, 4096)) > 0) {
+  }
+  TEST_ASSERT_EQUAL_INT(-1, Got);
+  TEST_ASSERT_EQUAL_INT(
+      -1, Audio_Encode_Stream_Ini(&Stream, &Config, NULL, &Source));
+}
+
+// HELPER FUNCTIONS
+// 16 kHz 16-bit mono only, the chunks are walked to find fmt and data
+static size_t helper_Load_Wav(const char *Name) {
+  char Path[256];
+  snprintf(Path, sizeof(Path), "%s/%s", CODEC_FIXTURE_DIR, Name);
+  FILE *File = fopen(Path, "rb");
+  if (File == NULL) {
+    return 0;
+  }
+  uint8_t Header[12];
+  size_t Samples = 0;
+  bool Format_Ok = false;
+  if (fread(Header, 1, 12, File) == 12 && !memcmp(Header, "RIFF", 4) &&
+      !memcmp(Header + 8, "WAVE", 4)) {
+    uint8_t Chunk[8];
+    while (fread(Chunk, 1, 8, File) == 8) {
+      uint32_t Size = helper_Le32(Chunk + 4);
+      if (!memcmp(Chunk, "fmt ", 4) && Size >= 16) {
+        uint8_t Fmt[16];
+        if (fread(Fmt, 1, 16, File) != 16) {
+          break;
+        }
+        Format_Ok = Fmt[0] == 1 && Fmt[2] == 1 &&
+                    helper_Le32(Fmt + 4) == SAMPLE_RATE && Fmt[14] == 16;
+        fseek(File, (long)(Size - 16 + (Size & 1)), SEEK_CUR);
+      } else if (!memcmp(Chunk, "data", 4) && Format_Ok) {
+        size_t Want = Size / 2 < MAX_CLIP_SAMPLES ? Size / 2 : MAX_CLIP_SAMPLES;
+        Samples = fread(Clip, 2, Want, File); // the host is little endian
+        break;
+      } else {
+        fseek(File, (long)(Size + (Size & 1)), SEEK_CUR);
+      }
+    }
+  }
+  fclose(File);
+  return Samples;
+}
+
+// the whole clip pushed Chunk samples at a time, then finished
+static size_t helper_Encode(const AudioEncoderConfig *Config,
+                            const int16_t *Pcm, size_t Count, size_t Chunk,
+                            uint8_t *Out) {
+  static AudioEncoder Encoder;
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encoder, Config));
+  size_t Len = 0;
+  for (size_t Pos = 0; Pos < Count; Pos += Chunk) {
+    size_t Take = Count - Pos < Chunk ? Count - Pos : Chunk;
+    TEST_ASSERT_TRUE(Len + AUDIO_CODEC_OUT_MAX <= MAX_FILE_BYTES);
+    Len += Audio_Encoder_Push(&Encoder, Pcm + Pos, Take, Out + Len);
+  }
+  Len += Audio_Encoder_Finish(&Encoder, Out + Len);
+  TEST_ASSERT_EQUAL_UINT64(Len, Encoder.Bytes_Out);
+  TEST_ASSERT_EQUAL_UINT64(Count, Encoder.Samples_In);
+  return Len;
+}
+
+static int helper_Pcm_Read(void *Ctx, int16_t *Samples, size_t Max_Samples) {
+  PcmSource *Source = (PcmSource *)Ctx;
+  size_t Left = Source->Count - Source->Pos;
+  if (Left == 0) {
+    return Source->Fail_At_End ? -1 : 0;
+  }
+  size_t Give = Left < Source->Step ? Left : Source->Step;
+  Give = Give < Max_Samples ? Give : Max_Samples;
+  memcpy(Samples, Source->Pcm + Source->Pos, Give * sizeof(int16_t));
+  Source->Pos += Give;
+  return (int)Give;
+}
+
+// the parts of flac the encoder can write: stream info, fixed block size
+// frames of one channel, constant, verbatim and fixed subframes with rice
+// partitions and wasted bits. every crc, sync and frame number is checked,
+// -1 for anything wrong, otherwise the samples decoded
+static long helper_Flac_Decode(const uint8_t *Data, size_t Len, int16_t *Out,
+                               size_t Max) {
+  if (Len < 42 || memcmp(Data, "fLaC", 4) || Data[4] != 0x80 ||
+      Data[5] != 0 || Data[6] != 0 || Data[7] != 34) {
+    return -1;
+  }
+  BitReader Info = {Data + 8, 34, 0};
+  uint32_t Min_Block = helper_Bits(&Info, 16);
+  uint32_t Max_Block = helper_Bits(&Info, 16);
+  helper_Bits(&Info, 24);
+  helper_Bits(&Info, 24);
+  uint32_t Rate = helper_Bits(&Info, 20);
+  if (Min_Block != Max_Block || Min_Block < 16 || Rate != SAMPLE_RATE ||
+      helper_Bits(&Info, 3) != 0 || helper_Bits(&Info, 5) != 15) {
+    return -1;
+  }
+  size_t Pos = 42;
+  size_t Count = 0;
+  uint32_t Frame_Number = 0;
+  while (Pos < Len) {
+    BitReader Reader = {Data + Pos, Len - Pos, 0};
+    if (helper_Bits(&Reader, 16) != 0xfff8) {
+      return -1;
+    }
+    uint32_t Size_Code = helper_Bits(&Reader, 4);
+    uint32_t Rate_Code = helper_Bits(&Reader, 4);
+    if (helper_Bits(&Reader, 8) != 0x08) { // mono, 16 bits
+      return -1;
+    }
+    uint32_t Lead = helper_Bits(&Reader, 8);
+    unsigned Extra = 0;
+    while ((Lead & 0x80) && Extra < 6 && (Lead & (0x40u >> Extra))) {
+      Extra++;
+    }
+    if ((Lead & 0x80) && Extra == 0) {
+      return -1;
+    }
+    uint32_t Number = Extra ? Lead & (0x3fu >> Extra) : Lead;
+    for (unsigned i = 0; i < Extra; i++) {
+      uint32_t Next = helper_Bits(&Reader, 8);
+      if ((Next & 0xc0) != 0x80) {
+        return -1;
+      }
+      Number = Number << 6 | (Next & 0x3f);
+    }
+    if (Number != Frame_Number++) {
+      return -1;
+    }
+    size_t Block;
+    if (Size_Code == 1) {
+      Block = 192;
+    } else if (Size_Code >= 2 && Size_Code <= 5) {
+      Block = 576u << (Size_Code - 2);
+    } else if (Size_Code == 6) {
+      Block = helper_Bits(&Reader, 8) + 1;
+    } else if (Size_Code == 7) {
+      Block = helper_Bits(&Reader, 16) + 1;
+    } else if (Size_Code >= 8) {
+      Block = 256u << (Size_Code - 8);
+    } else {
+      return -1;
+    }
+    if (Rate_Code != 5) { // 16 kHz
+      return -1;
+    }
+    size_t Header_Bytes = Reader.Bit / 8;
+    uint8_t Crc8 = 0;
+    for (size_t i = 0; i < Header_Bytes; i++) {
+      Crc8 ^= Data[Pos + i];
+      for (int b = 0; b < 8; b++) {
+        Crc8 = Crc8 & 0x80 ? (uint8_t)(Crc8 << 1 ^ 0x07) : (uint8_t)(Crc8 << 1);
+      }
+    }
+    if (helper_Bits(&Reader, 8) != Crc8 || Block > Max_Block ||
+        Count + Block > Max) {
+      return -1;
+    }
+
+    if (helper_Bits(&Reader, 1) != 0) {
+      return -1;
+    }
+    uint32_t Type = helper_Bits(&Reader, 6);
+    unsigned Wasted = 0;
+    if (helper_Bits(&Reader, 1)) {
+      Wasted = helper_Unary(&Reader) + 1;
+    }
+    const unsigned Bps = 16 - Wasted;
+    int32_t *X = malloc(Block * sizeof(int32_t));
+    TEST_ASSERT_NOT_NULL(X);
+    if (Type == 0) {
+      int32_t Value = helper_Signed_Bits(&Reader, Bps);
+      for (size_t i = 0; i < Block; i++) {
+        X[i] = Value;
+      }
+    } else if (Type == 1) {
+      for (size_t i = 0; i < Block; i++) {
+        X[i] = helper_Signed_Bits(&Reader, Bps);
+      }
+    } else if (Type >= 8 && Type <= 12) {
+      unsigned Order = Type - 8;
+      for (unsigned i = 0; i < Order; i++) {
+        X[i] = helper_Signed_Bits(&Reader, Bps);
+      }
+      if (helper_Bits(&Reader, 2) != 0) {
+        free(X);
+        return -1;
+      }
+      unsigned Partition_Order = helper_Bits(&Reader, 4);
+      size_t i = Order;
+      for (unsigned p = 0; p < (1u << Partition_Order); p++) {
+        unsigned Rice = helper_Bits(&Reader, 4);
+        size_t End = (Block >> Partition_Order) * (p + 1);
+        for (; i < End; i++) {
+          uint32_t U = helper_Unary(&Reader) << Rice | helper_Bits(&Reader, Rice);
+          int32_t E = (int32_t)(U >> 1) ^ -(int32_t)(U & 1);
+          switch (Order) {
+          case 0:
+            X[i] = E;
+            break;
+          case 1:
+            X[i] = E + X[i - 1];
+            break;
+          case 2:
+            X[i] = E + 2 * X[i - 1] - X[i - 2];
+            break;
+          case 3:
+            X[i] = E + 3 * X[i - 1] - 3 * X[i - 2] + X[i - 3];
+            break;
+          default:
+            X[i] = E + 4 * X[i - 1] - 6 * X[i - 2] + 4 * X[i - 3] - X[i - 4];
+            break;
+          }
+        }
+      }
+    } else {
+      free(X);
+      return -1;
+    }
+    for (size_t i = 0; i < Block; i++) {
+      int32_t Sample = X[i] * (1 << Wasted);
+      if (Sample > INT16_MAX || Sample < INT16_MIN) {
+        free(X);
+        return -1;
+      }
+      Out[Count++] = (int16_t)Sample;
+    }
+    free(X);
+
+    // zero padding to the byte, then the crc-16 of the whole frame
+    while (Reader.Bit % 8) {
+      if (helper_Bits(&Reader, 1) != 0) {
+        return -1;
+      }
+    }
+    size_t Frame_Bytes = Reader.Bit / 8;
+    uint16_t Crc16 = 0;
+    for (size_t i = 0; i < Frame_Bytes; i++) {
+      Crc16 ^= (uint16_t)(Data[Pos + i] << 8);
+      for (int b = 0; b < 8; b++) {
+        Crc16 = Crc16 & 0x8000 ? (uint16_t)(Crc16 << 1 ^ 0x8005)
+                               : (uint16_t)(Crc16 << 1);
+      }
+    }
+    if (Reader.Bit / 8 + 2 > Reader.Len || helper_Bits(&Reader, 16) != Crc16) {
+      return -1;
+    }
+    Pos += Reader.Bit / 8;
+  }
+  return (long)Count;
+}
+
+// the ima adpcm decoder from the wav spec, fmt checked on the way
+static long helper_Adpcm_Decode(const uint8_t *Data, size_t Len, int16_t *Out,
+                                size_t Max) {
+  static const int Steps[89] = {
+      7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+      19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+      50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+      2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+      5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+      15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+  static const int Index_Step[16] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                     -1, -1, -1, -1, 2, 4, 6, 8};
+  if (Len < 60 || memcmp(Data, "RIFF", 4) || memcmp(Data + 8, "WAVEfmt ", 8) ||
+      Data[20] != 0x11 || Data[34] != 4 || memcmp(Data + 52, "data", 4)) {
+    return -1;
+  }
+  const size_t Align = (size_t)Data[32] | (size_t)Data[33] << 8;
+  const size_t Per_Block = (size_t)Data[38] | (size_t)Data[39] << 8;
+  if (Per_Block != 2 * (Align - 4) + 1 || (Len - 60) % Align != 0) {
+    return -1;
+  }
+  size_t Count = 0;
+  for (size_t Pos = 60; Pos < Len; Pos += Align) {
+    if (Count + Per_Block > Max || Data[Pos + 2] > 88 || Data[Pos + 3] != 0) {
+      return -1;
+    }
+    int Predictor = (int16_t)(Data[Pos] | Data[Pos + 1] << 8);
+    int Index = Data[Pos + 2];
+    Out[Count++] = (int16_t)Predictor;
+    for (size_t i = 0; i < 2 * (Align - 4); i++) {
+      uint8_t Byte = Data[Pos + 4 + i / 2];
+      int Code = i % 2 ? Byte >> 4 : Byte & 0xf;
+      int Step = Steps[Index];
+      int Diff = Step >> 3;
+      if (Code & 4) {
+        Diff += Step;
+      }
+      if (Code & 2) {
+        Diff += Step >> 1;
+      }
+      if (Code & 1) {
+        Diff += Step >> 2;
+      }
+      Predictor += Code & 8 ? -Diff : Diff;
+      Predictor = Predictor > 32767 ? 32767 : Predictor < -32768 ? -32768 : Predictor;
+      Index += Index_Step[Code];
+      Index = Index < 0 ? 0 : Index > 88 ? 88 : Index;
+      Out[Count++] = (int16_t)Predictor;
+    }
+  }
+  return (long)Count;
+}
+
+static uint32_t helper_Bits(BitReader *Reader, unsigned Count) {
+  uint32_t Value = 0;
+  for (unsigned i = 0; i < Count; i++) {
+    size_t Byte = Reader->Bit / 8;
+    TEST_ASSERT_TRUE_MESSAGE(Byte < Reader->Len, "read past the end");
+    Value = Value << 1 | ((Reader->Data[Byte] >> (7 - Reader->Bit % 8)) & 1);
+    Reader->Bit++;
+  }
+  return Value;
+}
+
+static int32_t helper_Signed_Bits(BitReader *Reader, unsigned Count) {
+  uint32_t Value = helper_Bits(Reader, Count);
+  uint32_t Sign = 1u << (Count - 1);
+  return (int32_t)(Value ^ Sign) - (int32_t)Sign;
+}
+
+static uint32_t helper_Unary(BitReader *Reader) {
+  uint32_t Zeros = 0;
+  while (helper_Bits(Reader, 1) == 0) {
+    Zeros++;
+  }
+  return Zeros;
+}
+
+static uint32_t helper_Le32(const uint8_t *Data) {
+  return (uint32_t)Data[0] | (uint32_t)Data[1] << 8 |
+         (uint32_t)Data[2] << 16 | (uint32_t)Data[3] << 24;
+}
+
+static double helper_Snr_Db(const int16_t *Want, const int16_t *Got,
+                            size_t Count) {
+  double Signal = 0;
+  double Noise = 0;
+  for (size_t i = 0; i < Count; i++) {
+    double Error = (double)Got[i] - Want[i];
+    Signal += (double)Want[i] * Want[i];
+    Noise += Error * Error;
+  }
+  return Noise == 0 ? INFINITY : 10 * log10(Signal / Noise);
+}
+
+// encoded with the block given (0 for the default), decoded and compared
+static void helper_Confirm_Flac_Exact(const int16_t *Pcm, size_t Count,
+                                      size_t Block, const char *Label) {
+  AudioEncoderConfig Config = {&Audio_Codec_Flac, SAMPLE_RATE,
+                               (uint32_t)Count, Block, 0};
+  size_t Chunk = Block ? Block : FRAME_SAMPLES;
+  size_t Len = helper_Encode(&Config, Pcm, Count, Chunk, File_Bytes);
+  long Got = helper_Flac_Decode(File_Bytes, Len, Decoded,
+                                sizeof(Decoded) / sizeof(Decoded[0]));
+  TEST_ASSERT_EQUAL_INT32_MESSAGE((long)Count, Got, Label);
+  if (Count > 0) {
+    TEST_ASSERT_EQUAL_INT16_ARRAY_MESSAGE(Pcm, Decoded, Count, Label);
+  }
+}
+
+#endif
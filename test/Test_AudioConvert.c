@@ -0,0 +1,203 @@
+/*Audio conversion unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the scalar reference against worked samples, then that
+    the block kernel and the default kernel give the very same bits for
+    every 18-bit sample, for random slots at every length around the block
+    size and for each shift in use, out of place and in place in a pool
+    frame
+    run with: pio test -e native_audio_convert
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_CONVERT)
+
+#include "AudioConvert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#define MAX_SAMPLES 400 // a 20 ms frame and some
+#define SPH0645_BITS 18
+static PoolMemoryInfo *Memory_Handler;
+static const PoolClassConfig Frame_Classes[] = {
+    {sizeof(AudioFrame) + MAX_SAMPLES * sizeof(int32_t), 2, 0}};
+static int32_t Slots[MAX_SAMPLES];
+static int16_t Expected[MAX_SAMPLES];
+static int16_t Got[MAX_SAMPLES];
+static const AudioConvertParams Param_Cases[] = {
+    {14, 0}, {14, -1200}, {14, 40000}, {16, 0}, {16, 300}, {8, -5}, {31, 0}};
+
+// PROTOTYPING HELPERS
+static int32_t helper_Random_Slot(void);
+static void helper_Fill_Random(size_t Count);
+static void helper_Confirm_Kernel(AudioConvertKernel Kernel, size_t Count,
+                                  const AudioConvertParams *Params);
+
+// PROTOTYPING TESTS
+void test_Scalar_Worked_Samples();
+void test_Every_18_Bit_Sample_Bit_Exact();
+void test_Random_Slots_Every_Length();
+void test_In_Place_Matches_Out_Of_Place();
+void test_Frame_Converts_Once_In_Its_Block();
+void test_Dc_Estimate_Rounds_To_Nearest();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  srand(17);
+  Memory_Handler = Pool_Ini_Config(Frame_Classes, 1);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Scalar_Worked_Samples);
+  RUN_TEST(test_Every_18_Bit_Sample_Bit_Exact);
+  RUN_TEST(test_Random_Slots_Every_Length);
+  RUN_TEST(test_In_Place_Matches_Out_Of_Place);
+  RUN_TEST(test_Frame_Converts_Once_In_Its_Block);
+  RUN_TEST(test_Dc_Estimate_Rounds_To_Nearest);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+// slots as the mic sends them, 18 bits at the top and noise below
+void test_Scalar_Worked_Samples() {
+  const AudioConvertParams Params = {14, -100};
+  const int32_t In[] = {
+      0,
+      1 << 14,             // 1, then +100 of offset
+      0x3fff,              // below the 18 bits, shifted out
+      -(1 << 14),          // -1
+      -(3 << 13),          // -1.5 rounds down like any arithmetic shift
+      32667 << 14,         // exactly full scale once the offset is back
+      32668 << 14,         // one over, clipped
+      (int32_t)0x7fffc000, // the mic's largest, clipped
+      (int32_t)0x80000000, // the mic's smallest, clipped
+      -(32868 << 14),      // exactly the most negative
+  };
+  const int16_t Want[] = {100,   101,   100,   99,     98,
+                          32767, 32767, 32767, -32768, -32768};
+  int16_t Out[sizeof(Want) / sizeof(Want[0])];
+  Audio_Convert_Scalar(In, Out, sizeof(Want) / sizeof(Want[0]), &Params);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(Want, Out, sizeof(Want) / sizeof(Want[0]));
+}
+
+// every value the mic can send, with the offsets either side of zero
+void test_Every_18_Bit_Sample_Bit_Exact() {
+  for (size_t p = 0; p < 3; p++) {
+    const AudioConvertParams *Params = &Param_Cases[p];
+    for (int32_t Base = -(1 << (SPH0645_BITS - 1));
+         Base < (1 << (SPH0645_BITS - 1)); Base += MAX_SAMPLES) {
+      size_t Count = 0;
+      for (; Count < MAX_SAMPLES &&
+             Base + (int32_t)Count < (1 << (SPH0645_BITS - 1));
+           Count++) {
+        // a low bit or two of noise under the sample, like the real part
+        Slots[Count] = (int32_t)((uint32_t)(Base + (int32_t)Count)
+                                 << (32 - SPH0645_BITS)) |
+                       (int32_t)(Count & 3);
+      }
+      helper_Confirm_Kernel(Audio_Convert_Block, Count, Params);
+      helper_Confirm_Kernel(Audio_Convert, Count, Params);
+    }
+  }
+}
+
+void test_Random_Slots_Every_Length() {
+  for (size_t p = 0; p < sizeof(Param_Cases) / sizeof(Param_Cases[0]); p++) {
+    for (size_t Count = 0; Count <= 3 * AUDIO_CONVERT_BLOCK + 1; Count++) {
+      helper_Fill_Random(Count);
+      helper_Confirm_Kernel(Audio_Convert_Block, Count, &Param_Cases[p]);
+      helper_Confirm_Kernel(Audio_Convert, Count, &Param_Cases[p]);
+    }
+  }
+}
+
+// the output lands over the input it was made from
+void test_In_Place_Matches_Out_Of_Place() {
+  static int32_t Buffer[MAX_SAMPLES];
+  const size_t Counts[] = {1, 31, 32, 33, 320, MAX_SAMPLES};
+  for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); c++) {
+    for (size_t p = 0; p < sizeof(Param_Cases) / sizeof(Param_Cases[0]);
+         p++) {
+      helper_Fill_Random(Counts[c]);
+      Audio_Convert_Scalar(Slots, Expected, Counts[c], &Param_Cases[p]);
+      memcpy(Buffer, Slots, Counts[c] * sizeof(int32_t));
+      Audio_Convert(Buffer, (int16_t *)Buffer, Counts[c], &Param_Cases[p]);
+      TEST_ASSERT_EQUAL_MEMORY(Expected, Buffer, Counts[c] * sizeof(int16_t));
+    }
+  }
+}
+
+void test_Frame_Converts_Once_In_Its_Block() {
+  const AudioConvertParams Params = AUDIO_CONVERT_SPH0645;
+  AudioFrame *Frame = Pool_Alloc(Frame_Classes[0].Block_Size, Memory_Handler);
+  TEST_ASSERT_NOT_NULL(Frame);
+  helper_Fill_Random(320);
+  memcpy(Frame->Data, Slots, 320 * sizeof(int32_t));
+  Frame->Format = AUDIO_FORMAT_I2S32;
+  Frame->Sample_Count = 320;
+  Audio_Convert_Scalar(Slots, Expected, 320, &Params);
+
+  TEST_ASSERT_EQUAL_INT(0, Audio_Frame_To_Pcm16(Frame, &Params));
+  TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_PCM16, Frame->Format);
+  TEST_ASSERT_EQUAL_UINT32(320, Frame->Sample_Count);
+  TEST_ASSERT_EQUAL_INT16_ARRAY(Expected, Audio_Frame_Pcm16(Frame), 320);
+  // a second pass would read pcm as slots
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Frame_To_Pcm16(Frame, &Params));
+  TEST_ASSERT_EQUAL_INT16_ARRAY(Expected, Audio_Frame_Pcm16(Frame), 320);
+  Pool_Free(Frame, Memory_Handler);
+}
+
+void test_Dc_Estimate_Rounds_To_Nearest() {
+  const int32_t Quiet[] = {-(40 << 14), -(41 << 14), -(40 << 14),
+                           -(41 << 14)};
+  TEST_ASSERT_EQUAL_INT32(-41, Audio_Convert_Dc_Estimate(Quiet, 4, 14));
+  const int32_t Level[] = {7 << 14, 7 << 14, 8 << 14};
+  TEST_ASSERT_EQUAL_INT32(7, Audio_Convert_Dc_Estimate(Level, 3, 14));
+  TEST_ASSERT_EQUAL_INT32(0, Audio_Convert_Dc_Estimate(Level, 0, 14));
+  // taking the estimate off a quiet frame centres it
+  const AudioConvertParams Params = {14,
+                                     Audio_Convert_Dc_Estimate(Level, 3, 14)};
+  int16_t Out[3];
+  Audio_Convert(Level, Out, 3, &Params);
+  TEST_ASSERT_EQUAL_INT16(0, Out[0]);
+  TEST_ASSERT_EQUAL_INT16(1, Out[2]);
+}
+
+// HELPER FUNCTIONS
+static int32_t helper_Random_Slot(void) {
+  return (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+}
+
+static void helper_Fill_Random(size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    Slots[i] = helper_Random_Slot();
+  }
+  // the extremes turn up wherever the block boundaries fall
+  if (Count > 2) {
+    Slots[Count / 2] = INT32_MAX;
+    Slots[Count - 1] = INT32_MIN;
+  }
+}
+
+static void helper_Confirm_Kernel(AudioConvertKernel Kernel, size_t Count,
+                                  const AudioConvertParams *Params) {
+  Audio_Convert_Scalar(Slots, Expected, Count, Params);
+  memset(Got, 0x5a, sizeof(Got));
+  Kernel(Slots, Got, Count, Params);
+  if (Count > 0) {
+    TEST_ASSERT_EQUAL_INT16_ARRAY(Expected, Got, Count);
+  }
+  // nothing past the end is touched
+  if (Count < MAX_SAMPLES) {
+    TEST_ASSERT_EQUAL_INT16((int16_t)0x5a5a, Got[Count]);
+  }
+}
+
+#endif
@@ -0,0 +1,309 @@
+/*Audio playback ring unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the playback ring stays silent until enough is buffered
+    or an end is marked, plays a short sentence out at once, counts an
+    underrun only when it runs dry before the end mark, keeps samples whole
+    across the wrap and when full, then runs a writer on one pthread against
+    a reader on another and checks every sample comes out once and in order
+    run with: pio test -e native_audio_playback
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_PLAYBACK)
+
+#include "AudioPlayback.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#define RING_SAMPLES 1024
+#define START_SAMPLES 256
+#define FRAME_SAMPLES 64 // what the reader takes per call, a dma buffer
+static int16_t Ring[RING_SAMPLES];
+static AudioPlayback Playback;
+static int16_t Out[RING_SAMPLES];
+const uint32_t Threaded_Samples = 2000000;
+
+typedef struct { // what the reader thread saw
+  uint32_t Received;
+  uint32_t Out_Of_Order;
+} ReaderResult;
+
+static atomic_bool Writer_Done;
+
+// PROTOTYPING HELPERS
+static int16_t helper_Sample(uint32_t Index);
+static void helper_Write(uint32_t From, size_t Count);
+static void helper_Expect_Silence(const int16_t *Samples, size_t Count);
+static void helper_Expect_Samples(const int16_t *Samples, uint32_t From,
+                                  size_t Count);
+static void *helper_Writer_Thread(void *Argument);
+static void *helper_Reader_Thread(void *Argument);
+
+// PROTOTYPING TESTS
+void test_Ini_Rejects_Bad_Sizes();
+void test_Silent_Until_Start_Samples();
+void test_End_Mark_Plays_A_Short_Sentence_At_Once();
+void test_Dry_Before_The_End_Is_An_Underrun();
+void test_Playback_Buffers_Again_After_An_Underrun();
+void test_Samples_Stay_Whole_Across_The_Wrap();
+void test_Write_Takes_Only_What_Fits();
+void test_Drop_Empties_The_Ring();
+void test_Threaded_Writer_And_Reader();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  TEST_ASSERT_EQUAL_INT(0, Audio_Playback_Ini(&Playback, Ring, RING_SAMPLES,
+                                              START_SAMPLES));
+}
+void tearDown(void) {}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Ini_Rejects_Bad_Sizes);
+  RUN_TEST(test_Silent_Until_Start_Samples);
+  RUN_TEST(test_End_Mark_Plays_A_Short_Sentence_At_Once);
+  RUN_TEST(test_Dry_Before_The_End_Is_An_Underrun);
+  RUN_TEST(test_Playback_Buffers_Again_After_An_Underrun);
+  RUN_TEST(test_Samples_Stay_Whole_Across_The_Wrap);
+  RUN_TEST(test_Write_Takes_Only_What_Fits);
+  RUN_TEST(test_Drop_Empties_The_Ring);
+  RUN_TEST(test_Threaded_Writer_And_Reader);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Ini_Rejects_Bad_Sizes() {
+  AudioPlayback Other;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Playback_Ini(&Other, Ring, 0, 0));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Playback_Ini(&Other, Ring, 1000, 0));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Playback_Ini(&Other, NULL, 1024, 0));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Playback_Ini(&Other, Ring, 1024, 1025));
+  TEST_ASSERT_EQUAL_INT(0, Audio_Playback_Ini(&Other, Ring, 1024, 1024));
+}
+
+void test_Silent_Until_Start_Samples() {
+  memset(Out, 0x55, sizeof(Out));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+  helper_Expect_Silence(Out, FRAME_SAMPLES);
+  helper_Write(0, START_SAMPLES - 1);
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+  TEST_ASSERT_TRUE(Audio_Playback_Idle(&Playback) == false);
+  helper_Write(START_SAMPLES - 1, 1);
+  TEST_ASSERT_EQUAL_size_t(FRAME_SAMPLES, Audio_Playback_Read(
+                                              &Playback, Out, FRAME_SAMPLES));
+  helper_Expect_Samples(Out, 0, FRAME_SAMPLES);
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Starts);
+  TEST_ASSERT_EQUAL_UINT32(START_SAMPLES, Counters.Written);
+  TEST_ASSERT_EQUAL_UINT32(FRAME_SAMPLES, Counters.Played);
+}
+
+// a one word sentence is shorter than the start threshold, it must not
+// wait for the next sentence to push it over
+void test_End_Mark_Plays_A_Short_Sentence_At_Once() {
+  helper_Write(0, 100);
+  Audio_Playback_Mark_End(&Playback);
+  TEST_ASSERT_EQUAL_size_t(FRAME_SAMPLES, Audio_Playback_Read(
+                                              &Playback, Out, FRAME_SAMPLES));
+  helper_Expect_Samples(Out, 0, FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_size_t(100 - FRAME_SAMPLES,
+                           Audio_Playback_Read(&Playback, Out, FRAME_SAMPLES));
+  helper_Expect_Samples(Out, FRAME_SAMPLES, 100 - FRAME_SAMPLES);
+  helper_Expect_Silence(Out + 100 - FRAME_SAMPLES, 2 * FRAME_SAMPLES - 100);
+  TEST_ASSERT_TRUE(Audio_Playback_Idle(&Playback));
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Underruns);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Starts);
+  // the next sentence waits for the threshold again
+  helper_Write(100, 10);
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+}
+
+void test_Dry_Before_The_End_Is_An_Underrun() {
+  helper_Write(0, START_SAMPLES);
+  for (size_t i = 0; i < START_SAMPLES / FRAME_SAMPLES; i++) {
+    TEST_ASSERT_EQUAL_size_t(FRAME_SAMPLES, Audio_Playback_Read(
+                                                &Playback, Out, FRAME_SAMPLES));
+  }
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Underruns);
+  // empty exactly on a frame boundary, the next read finds it dry
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Underruns);
+  TEST_ASSERT_TRUE(Audio_Playback_Idle(&Playback));
+}
+
+void test_Playback_Buffers_Again_After_An_Underrun() {
+  helper_Write(0, START_SAMPLES + 10);
+  for (size_t i = 0; i < START_SAMPLES / FRAME_SAMPLES; i++) {
+    Audio_Playback_Read(&Playback, Out, FRAME_SAMPLES);
+  }
+  TEST_ASSERT_EQUAL_size_t(10, Audio_Playback_Read(&Playback, Out,
+                                                   FRAME_SAMPLES));
+  helper_Write(START_SAMPLES + 10, FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+  helper_Write(START_SAMPLES + 10 + FRAME_SAMPLES, START_SAMPLES);
+  TEST_ASSERT_EQUAL_size_t(FRAME_SAMPLES, Audio_Playback_Read(
+                                              &Playback, Out, FRAME_SAMPLES));
+  helper_Expect_Samples(Out, START_SAMPLES + 10, FRAME_SAMPLES);
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Underruns);
+  TEST_ASSERT_EQUAL_UINT32(2, Counters.Starts);
+}
+
+// odd sized writes and reads walk the ring round several times
+void test_Samples_Stay_Whole_Across_The_Wrap() {
+  uint32_t Written = 0, Read = 0;
+  while (Read < 10 * RING_SAMPLES) {
+    while (Audio_Playback_Space(&Playback) >= 97) {
+      helper_Write(Written, 97);
+      Written += 97;
+    }
+    const size_t Got = Audio_Playback_Read(&Playback, Out, 61);
+    TEST_ASSERT_EQUAL_size_t(61, Got);
+    helper_Expect_Samples(Out, Read, Got);
+    Read += (uint32_t)Got;
+  }
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Underruns);
+  TEST_ASSERT_EQUAL_UINT32(RING_SAMPLES, Counters.High_Water);
+}
+
+void test_Write_Takes_Only_What_Fits() {
+  static int16_t Big[RING_SAMPLES + 100];
+  for (uint32_t i = 0; i < RING_SAMPLES + 100; i++) {
+    Big[i] = helper_Sample(i);
+  }
+  TEST_ASSERT_EQUAL_size_t(RING_SAMPLES, Audio_Playback_Write(
+                                             &Playback, Big, RING_SAMPLES + 100));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Space(&Playback));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Write(&Playback, Big, 1));
+  Audio_Playback_Read(&Playback, Out, FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_size_t(FRAME_SAMPLES, Audio_Playback_Space(&Playback));
+  TEST_ASSERT_EQUAL_size_t(RING_SAMPLES - FRAME_SAMPLES,
+                           Audio_Playback_Level(&Playback));
+}
+
+void test_Drop_Empties_The_Ring() {
+  helper_Write(0, START_SAMPLES * 2);
+  Audio_Playback_Read(&Playback, Out, FRAME_SAMPLES);
+  Audio_Playback_Drop(&Playback);
+  TEST_ASSERT_TRUE(Audio_Playback_Idle(&Playback));
+  TEST_ASSERT_EQUAL_size_t(RING_SAMPLES, Audio_Playback_Space(&Playback));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Playback_Read(&Playback, Out,
+                                                  FRAME_SAMPLES));
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Underruns);
+}
+
+// the reader never waits, like the i2s task it takes what there is and
+// plays silence for the rest
+void test_Threaded_Writer_And_Reader() {
+  pthread_t Writer, Reader;
+  ReaderResult Result = {0};
+  atomic_store(&Writer_Done, false);
+  pthread_create(&Reader, NULL, helper_Reader_Thread, &Result);
+  pthread_create(&Writer, NULL, helper_Writer_Thread, NULL);
+  pthread_join(Writer, NULL);
+  pthread_join(Reader, NULL);
+  TEST_ASSERT_EQUAL_UINT32(Threaded_Samples, Result.Received);
+  TEST_ASSERT_EQUAL_UINT32(0, Result.Out_Of_Order);
+  AudioPlaybackCounters Counters;
+  Audio_Playback_Get_Counters(&Playback, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(Threaded_Samples, Counters.Played);
+}
+
+// HELPER FUNCTIONS
+static int16_t helper_Sample(uint32_t Index) {
+  return (int16_t)((Index * 7919u) & 0xffff);
+}
+
+static void helper_Write(uint32_t From, size_t Count) {
+  int16_t Samples[RING_SAMPLES];
+  TEST_ASSERT_LESS_OR_EQUAL_size_t(RING_SAMPLES, Count);
+  for (size_t i = 0; i < Count; i++) {
+    Samples[i] = helper_Sample(From + (uint32_t)i);
+  }
+  TEST_ASSERT_EQUAL_size_t(Count,
+                           Audio_Playback_Write(&Playback, Samples, Count));
+}
+
+static void helper_Expect_Silence(const int16_t *Samples, size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    TEST_ASSERT_EQUAL_INT16(0, Samples[i]);
+  }
+}
+
+static void helper_Expect_Samples(const int16_t *Samples, uint32_t From,
+                                  size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    TEST_ASSERT_EQUAL_INT16(helper_Sample(From + (uint32_t)i), Samples[i]);
+  }
+}
+
+// odd sized writes, a mark at the end so the last few play out
+static void *helper_Writer_Thread(void *Argument) {
+  int16_t Samples[37];
+  uint32_t Sent = 0;
+  while (Sent < Threaded_Samples) {
+    size_t Count = Threaded_Samples - Sent < 37 ? Threaded_Samples - Sent : 37;
+    for (size_t i = 0; i < Count; i++) {
+      Samples[i] = helper_Sample(Sent + (uint32_t)i);
+    }
+    size_t Done = 0;
+    while (Done < Count) {
+      size_t Took =
+          Audio_Playback_Write(&Playback, Samples + Done, Count - Done);
+      if (Took == 0) {
+        sched_yield();
+      }
+      Done += Took;
+    }
+    Sent += (uint32_t)Count;
+  }
+  Audio_Playback_Mark_End(&Playback);
+  atomic_store(&Writer_Done, true);
+  return NULL;
+}
+
+static void *helper_Reader_Thread(void *Argument) {
+  ReaderResult *Result = (ReaderResult *)Argument;
+  int16_t Frame[FRAME_SAMPLES];
+  for (;;) {
+    bool Done = atomic_load(&Writer_Done);
+    size_t Got = Audio_Playback_Read(&Playback, Frame, FRAME_SAMPLES);
+    for (size_t i = 0; i < Got; i++) {
+      if (Frame[i] != helper_Sample(Result->Received)) {
+        Result->Out_Of_Order++;
+      }
+      Result->Received++;
+    }
+    if (Got == 0) {
+      if (Done && Audio_Playback_Level(&Playback) == 0) {
+        break;
+      }
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*Audio pre-roll unit tests
+    Written by Matthew Ayestaran
+    purpose: drives the pre-roll with a simulated mic whose slots count
+    the samples, and checks it keeps only the last frames without touching
+    the pool or converting anything, that a press hands them to the capture
+    ring oldest first from sequence 0 and the live frames carry on from
+    there without a missing sample, and that its blocks are counted in the
+    pool and all come back
+    run with: pio test -e native_audio_preroll
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_PREROLL)
+
+#include "AudioPreroll.h"
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#define FRAME_SAMPLES 320 // 20 ms at 16 kHz
+#define RING_FRAMES 8
+#define PREROLL_FRAMES 5
+#define POOL_FRAMES 16
+static PoolMemoryInfo *Memory_Handler;
+static AudioCapture Capture;
+static AudioPreroll Preroll;
+static const PoolClassConfig Audio_Classes[] = {
+    {sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t), POOL_FRAMES, 0}};
+static const AudioConvertParams Convert = AUDIO_CONVERT_SPH0645;
+static uint32_t Next_Sample; // what the simulated mic sends next
+
+// PROTOTYPING HELPERS
+static int32_t helper_Slot(uint32_t Sample);
+static void helper_Read(AudioFrame *Frame);
+static void helper_Hold_Frames(size_t Count);
+static AudioFrame *helper_Live_Frame(void);
+static void helper_Check_Pcm(const AudioFrame *Frame, uint32_t First_Sample);
+static size_t helper_In_Use(void);
+static uint64_t helper_Total_Allocs(void);
+
+// PROTOTYPING TESTS
+void test_Frames_For_Rounds_Up();
+void test_Ini_Takes_Its_Blocks_Up_Front();
+void test_Ini_Refuses_Bad_Sizes();
+void test_Idle_Keeps_The_Last_Frames_Raw_Without_The_Pool();
+void test_Release_Numbers_From_Zero_And_Converts();
+void test_Live_Frames_Follow_Without_A_Gap();
+void test_Release_Without_Convert_Keeps_Slots();
+void test_Rearm_Tops_Up_From_The_Pool();
+void test_Empty_Pool_Recycles_The_Oldest();
+void test_Abort_Keeps_The_Block();
+void test_Discard_Drops_Stale_Frames();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Audio_Classes, 1);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+  TEST_ASSERT_EQUAL_INT(
+      0, Audio_Capture_Ini(&Capture, Memory_Handler, FRAME_SAMPLES,
+                           RING_FRAMES));
+  TEST_ASSERT_EQUAL_INT(0,
+                        Audio_Preroll_Ini(&Preroll, &Capture, PREROLL_FRAMES));
+  Next_Sample = 0;
+}
+void tearDown(void) {
+  Audio_Preroll_Flush(&Preroll);
+  Audio_Capture_Flush(&Capture);
+  TEST_ASSERT_EQUAL_size_t(0, helper_In_Use());
+  Pool_Destroy(Memory_Handler);
+}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Frames_For_Rounds_Up);
+  RUN_TEST(test_Ini_Takes_Its_Blocks_Up_Front);
+  RUN_TEST(test_Ini_Refuses_Bad_Sizes);
+  RUN_TEST(test_Idle_Keeps_The_Last_Frames_Raw_Without_The_Pool);
+  RUN_TEST(test_Release_Numbers_From_Zero_And_Converts);
+  RUN_TEST(test_Live_Frames_Follow_Without_A_Gap);
+  RUN_TEST(test_Release_Without_Convert_Keeps_Slots);
+  RUN_TEST(test_Rearm_Tops_Up_From_The_Pool);
+  RUN_TEST(test_Empty_Pool_Recycles_The_Oldest);
+  RUN_TEST(test_Abort_Keeps_The_Block);
+  RUN_TEST(test_Discard_Drops_Stale_Frames);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Frames_For_Rounds_Up() {
+  TEST_ASSERT_EQUAL_size_t(15, Audio_Preroll_Frames_For(16000, 320, 300));
+  TEST_ASSERT_EQUAL_size_t(16, Audio_Preroll_Frames_For(16000, 320, 301));
+  TEST_ASSERT_EQUAL_size_t(1, Audio_Preroll_Frames_For(16000, 320, 1));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Preroll_Frames_For(16000, 320, 0));
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Preroll_Frames_For(16000, 0, 300));
+}
+
+// the frames plus the one being filled, shown in the pool from the start
+void test_Ini_Takes_Its_Blocks_Up_Front() {
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, helper_In_Use());
+  Audio_Preroll_Flush(&Preroll);
+  TEST_ASSERT_EQUAL_size_t(0, helper_In_Use());
+}
+
+void test_Ini_Refuses_Bad_Sizes() {
+  Audio_Preroll_Flush(&Preroll);
+  AudioPreroll Other;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Preroll_Ini(&Other, &Capture, 0));
+  TEST_ASSERT_EQUAL_INT(
+      -1, Audio_Preroll_Ini(&Other, &Capture, AUDIO_PREROLL_MAX_FRAMES + 1));
+  // no room left in the ring for a live frame after the press
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Preroll_Ini(&Other, &Capture, RING_FRAMES));
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Preroll_Ini(&Other, NULL, PREROLL_FRAMES));
+  // the pool can't give the blocks, the ones it did give go back
+  AudioFrame *Taken[POOL_FRAMES - PREROLL_FRAMES];
+  for (size_t i = 0; i < POOL_FRAMES - PREROLL_FRAMES; i++) {
+    Taken[i] = Audio_Capture_Frame_Get(&Capture);
+    TEST_ASSERT_NOT_NULL(Taken[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(-1,
+                        Audio_Preroll_Ini(&Other, &Capture, PREROLL_FRAMES));
+  TEST_ASSERT_EQUAL_size_t(POOL_FRAMES - PREROLL_FRAMES, helper_In_Use());
+  for (size_t i = 0; i < POOL_FRAMES - PREROLL_FRAMES; i++) {
+    Audio_Capture_Frame_Release(&Capture, Taken[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(0,
+                        Audio_Preroll_Ini(&Other, &Capture, RING_FRAMES - 1));
+  Audio_Preroll_Flush(&Other);
+}
+
+// minutes of waiting cost no allocation and no conversion, only the last
+// PREROLL_FRAMES are there when the button goes down
+void test_Idle_Keeps_The_Last_Frames_Raw_Without_The_Pool() {
+  const uint64_t Allocs = helper_Total_Allocs();
+  helper_Hold_Frames(4 * PREROLL_FRAMES + 2);
+  TEST_ASSERT_EQUAL_UINT64(Allocs, helper_Total_Allocs());
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, helper_In_Use());
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES, Preroll.Count);
+  uint32_t First = (4 * PREROLL_FRAMES + 2 - PREROLL_FRAMES) * FRAME_SAMPLES;
+  for (size_t f = 0; f < Preroll.Count; f++) {
+    const AudioFrame *Frame =
+        Preroll.Held[(Preroll.Oldest + f) % AUDIO_PREROLL_MAX_FRAMES];
+    TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_I2S32, Frame->Format);
+    TEST_ASSERT_EQUAL_INT32(helper_Slot(First + f * FRAME_SAMPLES),
+                            Frame->Data[0]);
+  }
+  AudioPrerollCounters Counters;
+  Audio_Preroll_Get_Counters(&Preroll, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(4 * PREROLL_FRAMES + 2, Counters.Frames_Held);
+  TEST_ASSERT_EQUAL_UINT32(3 * PREROLL_FRAMES + 2, Counters.Recycled);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Released);
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Ring_Count(&Capture.Ring));
+}
+
+void test_Release_Numbers_From_Zero_And_Converts() {
+  helper_Hold_Frames(PREROLL_FRAMES + 3);
+  Capture.Sequence = 77; // left over from an earlier recording
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES,
+                           Audio_Preroll_Release(&Preroll, &Convert));
+  TEST_ASSERT_EQUAL_size_t(0, Preroll.Count);
+  for (uint32_t i = 0; i < PREROLL_FRAMES; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+    TEST_ASSERT_NOT_NULL(Frame);
+    TEST_ASSERT_EQUAL_UINT32(i, Frame->Sequence);
+    TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_PCM16, Frame->Format);
+    // the time each was read, not the time of the press
+    TEST_ASSERT_EQUAL_INT64(3 + i, Frame->Timestamp_us);
+    helper_Check_Pcm(Frame, (3 + i) * FRAME_SAMPLES);
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  AudioPrerollCounters Counters;
+  Audio_Preroll_Get_Counters(&Preroll, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(PREROLL_FRAMES, Counters.Released);
+  // the blocks went with the frames
+  TEST_ASSERT_EQUAL_size_t(1, helper_In_Use());
+}
+
+// the sample said as the button went down is in the recording once
+void test_Live_Frames_Follow_Without_A_Gap() {
+  helper_Hold_Frames(PREROLL_FRAMES);
+  Audio_Preroll_Release(&Preroll, &Convert);
+  for (int i = 0; i < 3; i++) {
+    AudioFrame *Frame = helper_Live_Frame();
+    Audio_Convert(Frame->Data, Audio_Frame_Pcm16(Frame), FRAME_SAMPLES,
+                  &Convert);
+    Frame->Format = AUDIO_FORMAT_PCM16;
+    TEST_ASSERT_TRUE(
+        Audio_Capture_Frame_Commit(&Capture, Frame, FRAME_SAMPLES, 0));
+  }
+  uint32_t Sequence = 0;
+  AudioFrame *Frame;
+  while ((Frame = Audio_Capture_Frame_Take(&Capture)) != NULL) {
+    TEST_ASSERT_EQUAL_UINT32(Sequence, Frame->Sequence);
+    helper_Check_Pcm(Frame, Sequence * FRAME_SAMPLES);
+    Sequence++;
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+  TEST_ASSERT_EQUAL_UINT32(PREROLL_FRAMES + 3, Sequence);
+}
+
+void test_Release_Without_Convert_Keeps_Slots() {
+  helper_Hold_Frames(2);
+  TEST_ASSERT_EQUAL_size_t(2, Audio_Preroll_Release(&Preroll, NULL));
+  for (uint32_t i = 0; i < 2; i++) {
+    AudioFrame *Frame = Audio_Capture_Frame_Take(&Capture);
+    TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_I2S32, Frame->Format);
+    for (size_t s = 0; s < FRAME_SAMPLES; s++) {
+      TEST_ASSERT_EQUAL_INT32(helper_Slot(i * FRAME_SAMPLES + (uint32_t)s),
+                              Frame->Data[s]);
+    }
+    Audio_Capture_Frame_Release(&Capture, Frame);
+  }
+}
+
+// after a recording the blocks handed over come back from the pool one frame
+// at a time, never more than the pre-roll started with
+void test_Rearm_Tops_Up_From_The_Pool() {
+  helper_Hold_Frames(PREROLL_FRAMES);
+  Audio_Preroll_Release(&Preroll, &Convert);
+  Audio_Capture_Flush(&Capture);
+  TEST_ASSERT_EQUAL_size_t(1, helper_In_Use());
+  const uint64_t Allocs = helper_Total_Allocs();
+  helper_Hold_Frames(3 * PREROLL_FRAMES);
+  TEST_ASSERT_EQUAL_UINT64(Allocs + PREROLL_FRAMES, helper_Total_Allocs());
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, helper_In_Use());
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES, Preroll.Count);
+}
+
+// the consumer still holds everything, the pre-roll goes on with what it
+// has left and counts the blocks it couldn't get
+void test_Empty_Pool_Recycles_The_Oldest() {
+  helper_Hold_Frames(PREROLL_FRAMES);
+  Audio_Preroll_Release(&Preroll, &Convert);
+  AudioFrame *Taken[POOL_FRAMES];
+  size_t Taken_Count = 0;
+  while ((Taken[Taken_Count] = Audio_Capture_Frame_Get(&Capture)) != NULL) {
+    Taken_Count++;
+  }
+  helper_Hold_Frames(3);
+  TEST_ASSERT_EQUAL_size_t(1, Preroll.Count);
+  AudioPrerollCounters Counters;
+  Audio_Preroll_Get_Counters(&Preroll, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(2, Counters.Blocks_Short); // the spare did one
+  TEST_ASSERT_EQUAL_INT32(helper_Slot((PREROLL_FRAMES + 2) * FRAME_SAMPLES),
+                          Preroll.Held[Preroll.Oldest]->Data[0]);
+  // and with nothing held at all there is no frame to give
+  AudioPreroll Empty = {.Capture = &Capture, .Frames = PREROLL_FRAMES};
+  TEST_ASSERT_NULL(Audio_Preroll_Frame_Get(&Empty));
+  for (size_t i = 0; i < Taken_Count; i++) {
+    Audio_Capture_Frame_Release(&Capture, Taken[i]);
+  }
+}
+
+void test_Abort_Keeps_The_Block() {
+  helper_Hold_Frames(2);
+  Audio_Preroll_Frame_Abort(&Preroll, Audio_Preroll_Frame_Get(&Preroll));
+  TEST_ASSERT_EQUAL_size_t(2, Preroll.Count);
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, helper_In_Use());
+  AudioPrerollCounters Counters;
+  Audio_Preroll_Get_Counters(&Preroll, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Read_Errors);
+  TEST_ASSERT_EQUAL_UINT32(2, Counters.Frames_Held);
+}
+
+void test_Discard_Drops_Stale_Frames() {
+  helper_Hold_Frames(PREROLL_FRAMES);
+  Audio_Preroll_Discard(&Preroll);
+  TEST_ASSERT_EQUAL_size_t(0, Preroll.Count);
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, Preroll.Spare_Count);
+  TEST_ASSERT_EQUAL_size_t(0, Audio_Preroll_Release(&Preroll, &Convert));
+  TEST_ASSERT_EQUAL_size_t(PREROLL_FRAMES + 1, helper_In_Use());
+}
+
+// HELPER FUNCTIONS
+// the count lands in the bits the SPH0645 conversion keeps
+static int32_t helper_Slot(uint32_t Sample) {
+  return (int32_t)(Sample << Convert.Shift);
+}
+
+static void helper_Read(AudioFrame *Frame) {
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Frame->Data[i] = helper_Slot(Next_Sample++);
+  }
+}
+
+// the capture task while nobody is recording, the timestamp is the frame
+// number so the tests can tell which frame is which
+static void helper_Hold_Frames(size_t Count) {
+  for (size_t i = 0; i < Count; i++) {
+    AudioFrame *Frame = Audio_Preroll_Frame_Get(&Preroll);
+    if (Frame == NULL) {
+      Next_Sample += FRAME_SAMPLES; // that audio is lost
+      continue;
+    }
+    TEST_ASSERT_EQUAL_INT(AUDIO_FORMAT_I2S32, Frame->Format);
+    int64_t Number = Next_Sample / FRAME_SAMPLES;
+    helper_Read(Frame);
+    Audio_Preroll_Frame_Commit(&Preroll, Frame, FRAME_SAMPLES, Number);
+  }
+}
+
+static AudioFrame *helper_Live_Frame(void) {
+  AudioFrame *Frame = Audio_Capture_Frame_Get(&Capture);
+  TEST_ASSERT_NOT_NULL(Frame);
+  helper_Read(Frame);
+  return Frame;
+}
+
+static void helper_Check_Pcm(const AudioFrame *Frame, uint32_t First_Sample) {
+  const int16_t *Pcm = Audio_Frame_Pcm16((AudioFrame *)Frame);
+  for (size_t i = 0; i < Frame->Sample_Count; i++) {
+    TEST_ASSERT_EQUAL_INT16(First_Sample + i, Pcm[i]);
+  }
+}
+
+static size_t helper_In_Use(void) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  return Stats.Class[0].Counters.In_Use;
+}
+
+static uint64_t helper_Total_Allocs(void) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  return Stats.Class[0].Counters.Total_Allocs;
+}
+
+#endif
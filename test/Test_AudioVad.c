@@ -0,0 +1,380 @@
+/*Voice activity detection unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the frame measurements, the start, hangover and end
+    of speech on made up frames, then runs the wav clips in
+    test/fixtures/vad through the detector 20 ms at a time and checks the
+    frames passed on cover each phrase from its first frame to the end of
+    the hangover, that silence, room noise and a click are dropped, and
+    that every block goes back to the pool
+    run with: pio test -e native_audio_vad
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_AUDIO_VAD)
+
+#include "AudioConvert.h"
+#include "AudioVad.h"
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#ifndef VAD_FIXTURE_DIR
+#define VAD_FIXTURE_DIR "test/fixtures/vad"
+#endif
+#define SAMPLE_RATE 16000
+#define FRAME_SAMPLES 320 // 20 ms
+#define FRAME_MS 20
+#define MAX_CLIP_SAMPLES (4 * SAMPLE_RATE)
+#define MAX_SEGMENTS 4
+static PoolMemoryInfo *Memory_Handler;
+static const PoolClassConfig Frame_Classes[] = {
+    {sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t), 16, 0}};
+static const AudioVadConfig Config = AUDIO_VAD_CONFIG_DEFAULT;
+static AudioVad Vad;
+static int16_t Clip[MAX_CLIP_SAMPLES];
+
+typedef struct { // a phrase as the frames passed on show it
+  uint32_t First_ms;
+  uint32_t Last_ms; // end of the last frame passed on
+} Segment;
+
+typedef struct { // what the detector made of a clip
+  uint32_t Frames;
+  uint32_t Passed;
+  size_t Segments;
+  Segment Segment[MAX_SEGMENTS];
+  uint32_t Ends; // AUDIO_VAD_EVENT_END seen
+  bool Speech_At_Finish;
+} ClipResult;
+
+typedef struct { // where the speech in a fixture is
+  const char *Name;
+  size_t Segments;
+  Segment Speech[MAX_SEGMENTS];
+} Fixture;
+
+static const Fixture Fixtures[] = {
+    {"room_noise.wav", 0, {{0, 0}}},
+    {"click.wav", 0, {{0, 0}}},
+    {"one_phrase.wav", 1, {{600, 1400}}},
+    {"short_pause.wav", 1, {{400, 1840}}}, // 240 ms gap, under the hangover
+    {"long_pause.wav", 2, {{400, 900}, {1900, 2400}}},
+    {"fricative_first.wav", 1, {{400, 1200}}},
+};
+
+// PROTOTYPING HELPERS
+static size_t helper_Load_Wav(const char *Name);
+static AudioFrame *helper_Frame(const int16_t *Pcm, uint32_t Sequence);
+static AudioFrame *helper_Level_Frame(int16_t Level, uint32_t Sequence);
+static size_t helper_Push(AudioFrame *Frame, uint32_t *Events);
+static void helper_Run_Clip(size_t Samples, ClipResult *Result);
+static void helper_Confirm_Every_Block_Returned(void);
+
+// PROTOTYPING TESTS
+void test_Measure_Level_And_Crossings();
+void test_Ini_Checks_Config();
+void test_Onset_Too_Short_Is_Dropped();
+void test_Speech_Starts_With_Its_Onset();
+void test_Stop_Rms_Carries_Speech_And_Hangover_Ends_It();
+void test_Finish_Drops_Held_Onset();
+void test_Wav_Fixtures();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Frame_Classes, 1);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+  TEST_ASSERT_EQUAL_INT(0, Audio_Vad_Ini(&Vad, &Config, Memory_Handler,
+                                         SAMPLE_RATE, FRAME_SAMPLES));
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Measure_Level_And_Crossings);
+  RUN_TEST(test_Ini_Checks_Config);
+  RUN_TEST(test_Onset_Too_Short_Is_Dropped);
+  RUN_TEST(test_Speech_Starts_With_Its_Onset);
+  RUN_TEST(test_Stop_Rms_Carries_Speech_And_Hangover_Ends_It);
+  RUN_TEST(test_Finish_Drops_Held_Onset);
+  RUN_TEST(test_Wav_Fixtures);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Measure_Level_And_Crossings() {
+  int16_t Pcm[FRAME_SAMPLES];
+  AudioVadMeasure Measure;
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Pcm[i] = 100;
+  }
+  Audio_Vad_Measure(Pcm, FRAME_SAMPLES, &Measure);
+  TEST_ASSERT_EQUAL_UINT32(10000, Measure.Mean_Square);
+  TEST_ASSERT_EQUAL_UINT32(0, Measure.Crossings);
+  // every sample flips
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Pcm[i] = i % 2 ? -32768 : 32767;
+  }
+  Audio_Vad_Measure(Pcm, FRAME_SAMPLES, &Measure);
+  TEST_ASSERT_EQUAL_UINT32(1073709056, Measure.Mean_Square);
+  TEST_ASSERT_EQUAL_UINT32(319 * 1000 / FRAME_SAMPLES, Measure.Crossings);
+  // 1 kHz crosses twice a millisecond, 125 per 1000 samples at 16 kHz
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Pcm[i] = (int16_t)(8 * ((i + 4) % 16 < 8 ? 1 : -1));
+  }
+  Audio_Vad_Measure(Pcm, FRAME_SAMPLES, &Measure);
+  TEST_ASSERT_EQUAL_UINT32(64, Measure.Mean_Square);
+  TEST_ASSERT_EQUAL_UINT32(40 * 1000 / FRAME_SAMPLES, Measure.Crossings);
+  Audio_Vad_Measure(Pcm, 0, &Measure);
+  TEST_ASSERT_EQUAL_UINT32(0, Measure.Mean_Square);
+}
+
+void test_Ini_Checks_Config() {
+  AudioVad Other;
+  AudioVadConfig Bad = Config;
+  Bad.Stop_Rms = Bad.Start_Rms + 1;
+  TEST_ASSERT_EQUAL_INT(-1, Audio_Vad_Ini(&Other, &Bad, Memory_Handler,
+                                          SAMPLE_RATE, FRAME_SAMPLES));
+  TEST_ASSERT_EQUAL_INT(
+      -1, Audio_Vad_Ini(&Other, &Config, NULL, SAMPLE_RATE, FRAME_SAMPLES));
+  TEST_ASSERT_EQUAL_INT(
+      -1, Audio_Vad_Ini(&Other, &Config, Memory_Handler, SAMPLE_RATE, 0));
+  // 60 ms and 400 ms in 20 ms frames
+  TEST_ASSERT_EQUAL_UINT32(3, Vad.Start_Frames);
+  TEST_ASSERT_EQUAL_UINT32(20, Vad.Hangover_Frames);
+  AudioVadConfig Edges = Config;
+  Edges.Start_ms = 0;
+  Edges.Hangover_ms = 1;
+  Audio_Vad_Ini(&Other, &Edges, Memory_Handler, SAMPLE_RATE, FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_UINT32(1, Other.Start_Frames);
+  TEST_ASSERT_EQUAL_UINT32(1, Other.Hangover_Frames);
+  Edges.Start_ms = 1000;
+  Audio_Vad_Ini(&Other, &Edges, Memory_Handler, SAMPLE_RATE, FRAME_SAMPLES);
+  TEST_ASSERT_EQUAL_UINT32(AUDIO_VAD_MAX_ONSET_FRAMES, Other.Start_Frames);
+}
+
+void test_Onset_Too_Short_Is_Dropped() {
+  uint32_t Events;
+  TEST_ASSERT_EQUAL_size_t(0, helper_Push(helper_Level_Frame(2000, 0),
+                                          &Events));
+  TEST_ASSERT_EQUAL_size_t(0, helper_Push(helper_Level_Frame(2000, 1),
+                                          &Events));
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_ONSET, Vad.State);
+  TEST_ASSERT_EQUAL_size_t(0, helper_Push(helper_Level_Frame(0, 2), &Events));
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_SILENCE, Vad.State);
+  TEST_ASSERT_EQUAL_UINT32(0, Events);
+  AudioVadCounters Counters;
+  Audio_Vad_Get_Counters(&Vad, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(3, Counters.Frames_Dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, Counters.Segments);
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Speech_Starts_With_Its_Onset() {
+  uint32_t Events;
+  helper_Push(helper_Level_Frame(0, 0), &Events);
+  helper_Push(helper_Level_Frame(2000, 1), &Events);
+  helper_Push(helper_Level_Frame(2000, 2), &Events);
+  AudioFrame *Out[AUDIO_VAD_MAX_OUT];
+  TEST_ASSERT_EQUAL_size_t(
+      3, Audio_Vad_Push(&Vad, helper_Level_Frame(2000, 3), Out, &Events));
+  TEST_ASSERT_EQUAL_UINT32(AUDIO_VAD_EVENT_START, Events);
+  for (size_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i + 1, Out[i]->Sequence);
+    Pool_Free(Out[i], Memory_Handler);
+  }
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_SPEECH, Vad.State);
+  TEST_ASSERT_TRUE(Audio_Vad_Finish(&Vad));
+  helper_Confirm_Every_Block_Returned();
+}
+
+// between Stop_Rms and Start_Rms speech goes on but can't start
+void test_Stop_Rms_Carries_Speech_And_Hangover_Ends_It() {
+  uint32_t Events;
+  uint32_t Sequence = 0;
+  for (int i = 0; i < 3; i++) {
+    helper_Push(helper_Level_Frame(400, Sequence++), &Events);
+  }
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_SILENCE, Vad.State);
+  for (int i = 0; i < 3; i++) {
+    helper_Push(helper_Level_Frame(2000, Sequence++), &Events);
+  }
+  TEST_ASSERT_EQUAL_UINT32(AUDIO_VAD_EVENT_START, Events);
+  for (int i = 0; i < 50; i++) {
+    TEST_ASSERT_EQUAL_size_t(
+        1, helper_Push(helper_Level_Frame(400, Sequence++), &Events));
+  }
+  // quiet for exactly the hangover is still passed on, one more ends it
+  for (uint32_t i = 0; i < Vad.Hangover_Frames; i++) {
+    TEST_ASSERT_EQUAL_size_t(
+        1, helper_Push(helper_Level_Frame(50, Sequence++), &Events));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, Events);
+  TEST_ASSERT_EQUAL_size_t(
+      0, helper_Push(helper_Level_Frame(50, Sequence++), &Events));
+  TEST_ASSERT_EQUAL_UINT32(AUDIO_VAD_EVENT_END, Events);
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_SILENCE, Vad.State);
+  TEST_ASSERT_FALSE(Audio_Vad_Finish(&Vad));
+  AudioVadCounters Counters;
+  Audio_Vad_Get_Counters(&Vad, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(Sequence, Counters.Frames_In);
+  TEST_ASSERT_EQUAL_UINT32(3 + 50 + Vad.Hangover_Frames, Counters.Frames_Passed);
+  TEST_ASSERT_EQUAL_UINT32(4, Counters.Frames_Dropped);
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Finish_Drops_Held_Onset() {
+  uint32_t Events;
+  helper_Push(helper_Level_Frame(2000, 0), &Events);
+  helper_Push(helper_Level_Frame(2000, 1), &Events);
+  TEST_ASSERT_FALSE(Audio_Vad_Finish(&Vad));
+  TEST_ASSERT_EQUAL_INT(AUDIO_VAD_SILENCE, Vad.State);
+  helper_Confirm_Every_Block_Returned();
+}
+
+void test_Wav_Fixtures() {
+  for (size_t f = 0; f < sizeof(Fixtures) / sizeof(Fixtures[0]); f++) {
+    const Fixture *Want = &Fixtures[f];
+    size_t Samples = helper_Load_Wav(Want->Name);
+    TEST_ASSERT_TRUE_MESSAGE(Samples > 0, Want->Name);
+    TEST_ASSERT_EQUAL_INT(0, Audio_Vad_Ini(&Vad, &Config, Memory_Handler,
+                                           SAMPLE_RATE, FRAME_SAMPLES));
+    ClipResult Got;
+    helper_Run_Clip(Samples, &Got);
+
+    uint32_t Clip_ms = (uint32_t)(Samples * 1000 / SAMPLE_RATE);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(Want->Segments, Got.Segments, Want->Name);
+    for (size_t s = 0; s < Want->Segments; s++) {
+      // the onset frames come through, the phrase starts on its first frame
+      TEST_ASSERT_EQUAL_UINT32_MESSAGE(Want->Speech[s].First_ms,
+                                       Got.Segment[s].First_ms, Want->Name);
+      // the hangover after the last word, or what is left of the clip
+      uint32_t Until = Want->Speech[s].Last_ms + Config.Hangover_ms;
+      Until = Until < Clip_ms ? Until : Clip_ms;
+      TEST_ASSERT_UINT32_WITHIN_MESSAGE(FRAME_MS, Until,
+                                        Got.Segment[s].Last_ms, Want->Name);
+    }
+    // an end for every segment that stopped before the clip did
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(Got.Segments - Got.Speech_At_Finish,
+                                     Got.Ends, Want->Name);
+    helper_Confirm_Every_Block_Returned();
+    char Line[128];
+    snprintf(Line, sizeof(Line), "%-20s %3u of %3u frames passed on",
+             Want->Name, (unsigned)Got.Passed, (unsigned)Got.Frames);
+    TEST_MESSAGE(Line);
+  }
+}
+
+// HELPER FUNCTIONS
+// 16 kHz 16-bit mono only, the chunks are walked to find fmt and data
+static size_t helper_Load_Wav(const char *Name) {
+  char Path[256];
+  snprintf(Path, sizeof(Path), "%s/%s", VAD_FIXTURE_DIR, Name);
+  FILE *File = fopen(Path, "rb");
+  if (File == NULL) {
+    return 0;
+  }
+  uint8_t Header[12];
+  size_t Samples = 0;
+  bool Format_Ok = false;
+  if (fread(Header, 1, 12, File) == 12 && !memcmp(Header, "RIFF", 4) &&
+      !memcmp(Header + 8, "WAVE", 4)) {
+    uint8_t Chunk[8];
+    while (fread(Chunk, 1, 8, File) == 8) {
+      uint32_t Size = (uint32_t)Chunk[4] | (uint32_t)Chunk[5] << 8 |
+                      (uint32_t)Chunk[6] << 16 | (uint32_t)Chunk[7] << 24;
+      if (!memcmp(Chunk, "fmt ", 4) && Size >= 16) {
+        uint8_t Fmt[16];
+        if (fread(Fmt, 1, 16, File) != 16) {
+          break;
+        }
+        uint32_t Rate = (uint32_t)Fmt[4] | (uint32_t)Fmt[5] << 8 |
+                        (uint32_t)Fmt[6] << 16 | (uint32_t)Fmt[7] << 24;
+        Format_Ok = Fmt[0] == 1 && Fmt[2] == 1 && Rate == SAMPLE_RATE &&
+                    Fmt[14] == 16;
+        fseek(File, (long)(Size - 16 + (Size & 1)), SEEK_CUR);
+      } else if (!memcmp(Chunk, "data", 4) && Format_Ok) {
+        size_t Want = Size / 2 < MAX_CLIP_SAMPLES ? Size / 2 : MAX_CLIP_SAMPLES;
+        Samples = fread(Clip, 2, Want, File); // the host is little endian
+        break;
+      } else {
+        fseek(File, (long)(Size + (Size & 1)), SEEK_CUR);
+      }
+    }
+  }
+  fclose(File);
+  return Samples;
+}
+
+// a pcm frame the way the capture task hands them over
+static AudioFrame *helper_Frame(const int16_t *Pcm, uint32_t Sequence) {
+  AudioFrame *Frame = Pool_Alloc(Frame_Classes[0].Block_Size, Memory_Handler);
+  TEST_ASSERT_NOT_NULL(Frame);
+  memcpy(Audio_Frame_Pcm16(Frame), Pcm, FRAME_SAMPLES * sizeof(int16_t));
+  Frame->Sequence = Sequence;
+  Frame->Sample_Count = FRAME_SAMPLES;
+  Frame->Timestamp_us = (int64_t)(Sequence + 1) * FRAME_MS * 1000;
+  Frame->Format = AUDIO_FORMAT_PCM16;
+  return Frame;
+}
+
+// a 500 Hz square wave, few crossings and an rms of Level
+static AudioFrame *helper_Level_Frame(int16_t Level, uint32_t Sequence) {
+  int16_t Pcm[FRAME_SAMPLES];
+  for (size_t i = 0; i < FRAME_SAMPLES; i++) {
+    Pcm[i] = (i / 16) % 2 ? (int16_t)-Level : Level;
+  }
+  return helper_Frame(Pcm, Sequence);
+}
+
+// pushes a frame and hands whatever comes out straight back to the pool
+static size_t helper_Push(AudioFrame *Frame, uint32_t *Events) {
+  AudioFrame *Out[AUDIO_VAD_MAX_OUT];
+  size_t Passed = Audio_Vad_Push(&Vad, Frame, Out, Events);
+  for (size_t i = 0; i < Passed; i++) {
+    Pool_Free(Out[i], Memory_Handler);
+  }
+  return Passed;
+}
+
+// frames passed on should follow each other within a segment
+static void helper_Run_Clip(size_t Samples, ClipResult *Result) {
+  memset(Result, 0, sizeof(*Result));
+  int64_t Expected = -1;
+  for (size_t Start = 0; Start + FRAME_SAMPLES <= Samples;
+       Start += FRAME_SAMPLES) {
+    AudioFrame *Out[AUDIO_VAD_MAX_OUT];
+    uint32_t Events;
+    size_t Passed = Audio_Vad_Push(
+        &Vad, helper_Frame(Clip + Start, Result->Frames), Out, &Events);
+    Result->Frames++;
+    if (Events & AUDIO_VAD_EVENT_START) {
+      TEST_ASSERT_TRUE(Result->Segments < MAX_SEGMENTS);
+      Result->Segment[Result->Segments++].First_ms =
+          Out[0]->Sequence * FRAME_MS;
+      Expected = Out[0]->Sequence;
+    }
+    if (Events & AUDIO_VAD_EVENT_END) {
+      Result->Ends++;
+    }
+    for (size_t i = 0; i < Passed; i++) {
+      TEST_ASSERT_EQUAL_UINT32(Expected++, Out[i]->Sequence);
+      Result->Segment[Result->Segments - 1].Last_ms =
+          (Out[i]->Sequence + 1) * FRAME_MS;
+      Pool_Free(Out[i], Memory_Handler);
+    }
+    Result->Passed += (uint32_t)Passed;
+  }
+  Result->Speech_At_Finish = Audio_Vad_Finish(&Vad);
+}
+
+static void helper_Confirm_Every_Block_Returned(void) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  TEST_ASSERT_EQUAL_size_t(0, Stats.Class[0].Counters.In_Use);
+}
+
+#endif
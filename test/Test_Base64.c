@@ -0,0 +1,200 @@
+/*Base64 encoder unit tests
+    Written by Matthew Ayestaran
+    purpose: checks every kernel against a plain bit at a time reference
+    encoder, on the rfc 4648 vectors, every possible 3 byte group and random
+    data at odd alignments, and that the streaming calls give the same text
+    however the input is split
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_BASE64)
+
+#include "Base64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+static uint8_t Input[4096 + 3];
+static char Expected[BASE64_ENCODED_LEN(sizeof(Input)) + 1];
+static char Output[BASE64_ENCODED_LEN(sizeof(Input)) + 16];
+static const base64_kernel_t Kernels[] = {
+    base64_encode_groups_scalar,
+    base64_encode_groups_word,
+    base64_encode_groups,
+};
+static const char *Kernel_Names[] = {"scalar", "word", "default"};
+#define KERNEL_COUNT (sizeof(Kernels) / sizeof(Kernels[0]))
+
+// PROTOTYPING HELPERS
+static size_t helper_Reference(const uint8_t *In, size_t Len, char *Out);
+static void helper_Random_Input(size_t Len);
+
+// PROTOTYPING TESTS
+void test_Rfc4648_Vectors();
+void test_Every_Group_Matches_Reference();
+void test_Kernels_Match_Reference_At_Any_Alignment();
+void test_Kernels_Write_Nothing_Past_The_End();
+void test_Stream_Any_Split_Gives_The_Same_Text();
+void test_Stream_Carries_Up_To_Two_Bytes();
+
+//================================CODE
+// START=============================================
+void setUp(void) { memset(Output, 0, sizeof(Output)); }
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Rfc4648_Vectors);
+    RUN_TEST(test_Every_Group_Matches_Reference);
+    RUN_TEST(test_Kernels_Match_Reference_At_Any_Alignment);
+    RUN_TEST(test_Kernels_Write_Nothing_Past_The_End);
+    RUN_TEST(test_Stream_Any_Split_Gives_The_Same_Text);
+    RUN_TEST(test_Stream_Carries_Up_To_Two_Bytes);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Rfc4648_Vectors() {
+    static const char *Plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    static const char *Encoded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    for (size_t i = 0; i < sizeof(Plain) / sizeof(Plain[0]); i++) {
+        memset(Output, 0, sizeof(Output));
+        size_t Len = base64_encode((const uint8_t *)Plain[i], strlen(Plain[i]), Output);
+        TEST_ASSERT_EQUAL_size_t(strlen(Encoded[i]), Len);
+        TEST_ASSERT_EQUAL_STRING(Encoded[i], Output);
+    }
+}
+
+// all 2^24 groups through each kernel, a block of them at a time
+void test_Every_Group_Matches_Reference() {
+    const size_t Groups = 1024;
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        for (uint32_t First = 0; First < (1u << 24); First += Groups) {
+            for (size_t g = 0; g < Groups; g++) {
+                uint32_t Value = First + (uint32_t)g;
+                Input[g * 3] = (uint8_t)(Value >> 16);
+                Input[g * 3 + 1] = (uint8_t)(Value >> 8);
+                Input[g * 3 + 2] = (uint8_t)Value;
+            }
+            helper_Reference(Input, Groups * 3, Expected);
+            Kernels[k](Input, Groups, Output);
+            if (memcmp(Expected, Output, Groups * 4) != 0) {
+                TEST_FAIL_MESSAGE(Kernel_Names[k]);
+            }
+        }
+    }
+}
+
+void test_Kernels_Match_Reference_At_Any_Alignment() {
+    srand(4648);
+    for (int Round = 0; Round < 500; Round++) {
+        size_t Groups = (size_t)(rand() % 1300);
+        size_t Shift = (size_t)(rand() % 4);
+        helper_Random_Input(sizeof(Input));
+        helper_Reference(Input + Shift, Groups * 3, Expected);
+        for (size_t k = 0; k < KERNEL_COUNT; k++) {
+            Kernels[k](Input + Shift, Groups, Output + Shift);
+            TEST_ASSERT_EQUAL_MEMORY_MESSAGE(Expected, Output + Shift, Groups * 4, Kernel_Names[k]);
+        }
+        size_t Len = Groups * 3 + (size_t)(rand() % 3);
+        size_t Chars = helper_Reference(Input + Shift, Len, Expected);
+        TEST_ASSERT_EQUAL_size_t(Chars, base64_encode(Input + Shift, Len, Output));
+        TEST_ASSERT_EQUAL_MEMORY(Expected, Output, Chars);
+    }
+}
+
+void test_Kernels_Write_Nothing_Past_The_End() {
+    helper_Random_Input(64);
+    for (size_t Groups = 0; Groups <= 9; Groups++) {
+        for (size_t k = 0; k < KERNEL_COUNT; k++) {
+            memset(Output, '#', sizeof(Output));
+            Kernels[k](Input, Groups, Output);
+            TEST_ASSERT_EQUAL_CHAR('#', Output[Groups * 4]);
+        }
+        for (size_t Extra = 0; Extra < 3; Extra++) {
+            memset(Output, '#', sizeof(Output));
+            size_t Len = base64_encode(Input, Groups * 3 + Extra, Output);
+            TEST_ASSERT_EQUAL_size_t(BASE64_ENCODED_LEN(Groups * 3 + Extra), Len);
+            TEST_ASSERT_EQUAL_CHAR('#', Output[Len]);
+        }
+    }
+}
+
+// the pcm comes over in whatever sizes the recording hands out
+void test_Stream_Any_Split_Gives_The_Same_Text() {
+    srand(16000);
+    for (int Round = 0; Round < 300; Round++) {
+        size_t Len = (size_t)(rand() % 4000);
+        helper_Random_Input(Len);
+        size_t Chars = helper_Reference(Input, Len, Expected);
+        base64_stream_t Stream;
+        base64_stream_init(&Stream);
+        size_t Pos = 0;
+        size_t Written = 0;
+        while (Pos < Len) {
+            size_t Step = (size_t)(rand() % (Round % 2 ? 8 : 700)); // 0 works too
+            Step = Step < Len - Pos ? Step : Len - Pos;
+            size_t Got = base64_stream_update(&Stream, Input + Pos, Step, Output + Written);
+            TEST_ASSERT_EQUAL_size_t(0, Got % 4);
+            TEST_ASSERT_LESS_OR_EQUAL_size_t((Stream.carry_len + Step) / 3 * 4 + 4, Got);
+            TEST_ASSERT_TRUE(Stream.carry_len < 3);
+            Pos += Step;
+            Written += Got;
+        }
+        Written += base64_stream_final(&Stream, Output + Written);
+        TEST_ASSERT_EQUAL_size_t(Chars, Written);
+        TEST_ASSERT_EQUAL_MEMORY(Expected, Output, Chars);
+    }
+}
+
+void test_Stream_Carries_Up_To_Two_Bytes() {
+    const uint8_t Bytes[] = {'f', 'o', 'o', 'b', 'a', 'r'};
+    base64_stream_t Stream;
+    base64_stream_init(&Stream);
+    TEST_ASSERT_EQUAL_size_t(0, base64_stream_update(&Stream, Bytes, 1, Output));
+    TEST_ASSERT_EQUAL_size_t(0, base64_stream_update(&Stream, Bytes + 1, 1, Output));
+    TEST_ASSERT_EQUAL_UINT8(2, Stream.carry_len);
+    TEST_ASSERT_EQUAL_size_t(4, base64_stream_update(&Stream, Bytes + 2, 2, Output));
+    TEST_ASSERT_EQUAL_MEMORY("Zm9v", Output, 4);
+    TEST_ASSERT_EQUAL_UINT8(1, Stream.carry_len);
+    TEST_ASSERT_EQUAL_size_t(4, base64_stream_final(&Stream, Output));
+    TEST_ASSERT_EQUAL_MEMORY("Yg==", Output, 4);
+    // nothing carried, nothing to pad
+    TEST_ASSERT_EQUAL_size_t(0, base64_stream_final(&Stream, Output));
+}
+
+// HELPER FUNCTIONS
+// a bit at a time, nothing shared with the encoder under test
+static size_t helper_Reference(const uint8_t *In, size_t Len, char *Out) {
+    static const char Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t Chars = 0;
+    unsigned Value = 0;
+    int Bits = 0;
+    for (size_t Bit = 0; Bit < Len * 8; Bit++) {
+        Value = Value << 1 | ((In[Bit / 8] >> (7 - Bit % 8)) & 1);
+        if (++Bits == 6) {
+            Out[Chars++] = Digits[Value];
+            Value = 0;
+            Bits = 0;
+        }
+    }
+    if (Bits > 0) {
+        Out[Chars++] = Digits[Value << (6 - Bits)];
+    }
+    while (Chars % 4 != 0) {
+        Out[Chars++] = '=';
+    }
+    return Chars;
+}
+
+static void helper_Random_Input(size_t Len) {
+    for (size_t i = 0; i < Len; i++) {
+        Input[i] = (uint8_t)rand();
+    }
+}
+
+#endif
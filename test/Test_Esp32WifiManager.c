@@ -1,20 +1,390 @@
-/*
- * description: number of tests for the esp32wifimanager header file to confirm
- * functionality created by: matthew ayestaran date: 19-10-2025
- * */
-/*
-#ifndef Test_Esp32WifiManager_c
-
-#include <fff.h>
+/*Wifi manager reconnect unit tests
+    Written by Matthew Ayestaran
+    purpose: runs the reconnect state machine the wifi manager drives
+    against a fake radio, timer and clock. checks the backoff doubles up to
+    its cap with jitter that never reaches zero, that it never gives up,
+    that an attempt which hangs is dropped, that a stable link is retried
+    at once and a flapping one backs off, that the subscribers see every
+    change and the warm deadline check gives up early, then leaves an
+    access point down for ten simulated minutes and counts the attempts
+    run with: pio test -e native_wifi_manager
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_ESP32_WIFI_MANAGER)
+
+#include "WifiLink.h"
+#include <string.h>
 #include <unity.h>
 
-FAKE_VALUE_FUNC(esp_err_t, esp_wifi_connect);
-FAKE_VALUE_FUNC(EventBits_t, xEventGroupSetBits, EventGroupHandle_t,
-                const EventBits_t);
-FAKE_VALUE_FUNC(EventBits_t, xEventGroupClearBits, EventGroupHandle_t,
-                const EventBits_t);
+// fake radio, timer and clock for the ops. the access point answers an
+// attempt by the next call to helper_Run_Radio
+typedef struct {
+    int Connects;
+    int Disconnects;
+    bool Timer_Armed;
+    int64_t Timer_Due_us;
+    int64_t Now_us;
+    uint32_t Seed;
+    uint32_t Fixed_Random; // returned instead when Use_Fixed, 0 is the bottom of the jitter
+    bool Use_Fixed;
+    bool Attempt_Pending;
+} FakeRadio;
 
-#include "esp32wifimanager.h"
+// what a subscriber was told, the first 64 changes
+typedef struct {
+    wifi_link_state_t From[64];
+    wifi_link_state_t To[64];
+    int Count;
+} StateLog;
 
-#endif  //fndef Test_Esp32WifiManager.c"
-*/
+// standard values
+static FakeRadio Radio;
+static wifi_link_t Link;
+static StateLog Log;
+static const wifi_backoff_policy_t Policy = {
+    .base_ms = 500, .max_ms = 60000, .attempt_timeout_ms = 15000, .stable_ms = 30000};
+
+// PROTOTYPING HELPERS
+static void helper_Fake_Connect(void *ctx);
+static void helper_Fake_Disconnect(void *ctx);
+static void helper_Fake_Arm_Timer(void *ctx, uint32_t ms);
+static void helper_Fake_Cancel_Timer(void *ctx);
+static uint32_t helper_Fake_Random(void *ctx);
+static int64_t helper_Fake_Now(void *ctx);
+static void helper_Log_State(void *ctx, wifi_link_state_t from, wifi_link_state_t to);
+static void helper_Fire_Timer(void);
+static void helper_Advance_ms(uint32_t ms);
+static void helper_Bring_Up(void);
+static void helper_Run_Radio(bool ap_up, int64_t until_us);
+
+// PROTOTYPING TESTS
+void test_Backoff_Doubles_Up_To_The_Cap();
+void test_Jitter_Stays_Within_Half_And_Never_Zero();
+void test_Start_Connects_And_Comes_Up();
+void test_Static_Address_Before_Associated();
+void test_Failed_Attempts_Back_Off_And_Never_Give_Up();
+void test_Hung_Attempt_Is_Dropped();
+void test_Stable_Link_Reconnects_At_Once();
+void test_Flapping_Link_Backs_Off();
+void test_Stop_Cancels_And_Ignores_Late_Events();
+void test_Subscribers_See_Every_Change();
+void test_Warm_Deadline_Gives_Up_Early();
+void test_Access_Point_Down_Ten_Minutes_Is_No_Storm();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+    memset(&Radio, 0, sizeof(Radio));
+    memset(&Log, 0, sizeof(Log));
+    Radio.Now_us = 5000000;
+    Radio.Seed = 12345;
+    const wifi_link_ops_t Ops = {helper_Fake_Connect, helper_Fake_Disconnect, helper_Fake_Arm_Timer,
+                                 helper_Fake_Cancel_Timer, helper_Fake_Random, helper_Fake_Now, &Radio};
+    wifi_link_init(&Link, &Ops, &Policy);
+    TEST_ASSERT_TRUE(wifi_link_subscribe(&Link, helper_Log_State, &Log));
+}
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Backoff_Doubles_Up_To_The_Cap);
+    RUN_TEST(test_Jitter_Stays_Within_Half_And_Never_Zero);
+    RUN_TEST(test_Start_Connects_And_Comes_Up);
+    RUN_TEST(test_Static_Address_Before_Associated);
+    RUN_TEST(test_Failed_Attempts_Back_Off_And_Never_Give_Up);
+    RUN_TEST(test_Hung_Attempt_Is_Dropped);
+    RUN_TEST(test_Stable_Link_Reconnects_At_Once);
+    RUN_TEST(test_Flapping_Link_Backs_Off);
+    RUN_TEST(test_Stop_Cancels_And_Ignores_Late_Events);
+    RUN_TEST(test_Subscribers_See_Every_Change);
+    RUN_TEST(test_Warm_Deadline_Gives_Up_Early);
+    RUN_TEST(test_Access_Point_Down_Ten_Minutes_Is_No_Storm);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+// with the top of the jitter the delay is the doubled one exactly, with the
+// bottom it is half of it
+void test_Backoff_Doubles_Up_To_The_Cap() {
+    const uint32_t Expected[] = {500, 1000, 2000, 4000, 8000, 16000, 32000, 60000, 60000};
+    for (uint32_t i = 0; i < sizeof(Expected) / sizeof(Expected[0]); i++) {
+        TEST_ASSERT_EQUAL_UINT32(Expected[i], wifi_backoff_delay_ms(&Policy, i + 1, Expected[i] / 2));
+    }
+    TEST_ASSERT_EQUAL_UINT32(60000, wifi_backoff_delay_ms(&Policy, 1000000, 30000)); // no overflow
+    TEST_ASSERT_EQUAL_UINT32(250, wifi_backoff_delay_ms(&Policy, 1, 0));
+    TEST_ASSERT_EQUAL_UINT32(30000, wifi_backoff_delay_ms(&Policy, 1000000, 0));
+}
+
+void test_Jitter_Stays_Within_Half_And_Never_Zero() {
+    const wifi_backoff_policy_t Tiny = {.base_ms = 1, .max_ms = 1};
+    TEST_ASSERT_EQUAL_UINT32(1, wifi_backoff_delay_ms(&Tiny, 1, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, wifi_backoff_delay_ms(&Tiny, 1, 0xffffffff));
+    uint32_t Seen_Low = 0xffffffff, Seen_High = 0;
+    for (uint32_t i = 0; i < 10000; i++) {
+        uint32_t Delay = wifi_backoff_delay_ms(&Policy, 4, helper_Fake_Random(&Radio));
+        TEST_ASSERT_TRUE(Delay >= 2000 && Delay <= 4000);
+        Seen_Low = Delay < Seen_Low ? Delay : Seen_Low;
+        Seen_High = Delay > Seen_High ? Delay : Seen_High;
+    }
+    TEST_ASSERT_TRUE(Seen_Low < 2100 && Seen_High > 3900); // spread over the whole range
+}
+
+void test_Start_Connects_And_Comes_Up() {
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_STOPPED, Link.state);
+    wifi_link_start(&Link);
+    TEST_ASSERT_EQUAL_INT(1, Radio.Connects);
+    TEST_ASSERT_TRUE(Radio.Timer_Armed); // the attempt timeout
+    TEST_ASSERT_EQUAL_INT64(Radio.Now_us + 15000000, Radio.Timer_Due_us);
+    wifi_link_associated(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_GETTING_IP, Link.state);
+    wifi_link_got_ip(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_UP, Link.state);
+    TEST_ASSERT_FALSE(Radio.Timer_Armed);
+    wifi_link_start(&Link); // already going
+    TEST_ASSERT_EQUAL_INT(1, Radio.Connects);
+}
+
+void test_Static_Address_Before_Associated() {
+    wifi_link_start(&Link);
+    wifi_link_got_ip(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_UP, Link.state);
+    wifi_link_associated(&Link); // late, changes nothing
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_UP, Link.state);
+}
+
+// the old manager stopped after five, this one keeps going at the cap
+void test_Failed_Attempts_Back_Off_And_Never_Give_Up() {
+    Radio.Use_Fixed = true;
+    Radio.Fixed_Random = 0;
+    wifi_link_start(&Link);
+    uint32_t Last_Delay = 0;
+    for (int i = 0; i < 100; i++) {
+        wifi_link_lost(&Link);
+        TEST_ASSERT_EQUAL_INT(WIFI_LINK_BACKOFF, Link.state);
+        TEST_ASSERT_TRUE(Radio.Timer_Armed);
+        uint32_t Delay = (uint32_t)((Radio.Timer_Due_us - Radio.Now_us) / 1000);
+        TEST_ASSERT_TRUE(Delay >= Last_Delay);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(60000, Delay);
+        Last_Delay = Delay;
+        helper_Fire_Timer();
+        TEST_ASSERT_EQUAL_INT(WIFI_LINK_CONNECTING, Link.state);
+    }
+    TEST_ASSERT_EQUAL_INT(101, Radio.Connects);
+    TEST_ASSERT_EQUAL_UINT32(101, Link.attempts);
+    TEST_ASSERT_EQUAL_UINT32(30000, Last_Delay);
+}
+
+// dhcp that never answers mustn't leave it waiting forever
+void test_Hung_Attempt_Is_Dropped() {
+    wifi_link_start(&Link);
+    wifi_link_associated(&Link);
+    helper_Fire_Timer();
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_BACKOFF, Link.state);
+    TEST_ASSERT_EQUAL_INT(1, Radio.Disconnects);
+    TEST_ASSERT_EQUAL_UINT32(1, Link.failures);
+    wifi_link_lost(&Link); // the disconnect echoing back
+    TEST_ASSERT_EQUAL_UINT32(1, Link.failures);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_BACKOFF, Link.state);
+}
+
+void test_Stable_Link_Reconnects_At_Once() {
+    helper_Bring_Up();
+    helper_Advance_ms(Policy.stable_ms);
+    wifi_link_lost(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_CONNECTING, Link.state);
+    TEST_ASSERT_EQUAL_INT(2, Radio.Connects);
+    TEST_ASSERT_EQUAL_UINT32(1, Link.drops);
+    TEST_ASSERT_EQUAL_UINT32(0, Link.failures);
+}
+
+// an access point that lets it on and throws it off again every second
+void test_Flapping_Link_Backs_Off() {
+    Radio.Use_Fixed = true;
+    Radio.Fixed_Random = 0;
+    helper_Bring_Up();
+    for (uint32_t i = 1; i <= 6; i++) {
+        helper_Advance_ms(1000);
+        wifi_link_lost(&Link);
+        TEST_ASSERT_EQUAL_INT(WIFI_LINK_BACKOFF, Link.state);
+        TEST_ASSERT_EQUAL_UINT32(i, Link.failures);
+        helper_Fire_Timer();
+        wifi_link_got_ip(&Link);
+    }
+    TEST_ASSERT_EQUAL_UINT32(8000, wifi_backoff_delay_ms(&Policy, Link.failures, 0));
+    // staying up long enough forgives it
+    helper_Advance_ms(Policy.stable_ms);
+    wifi_link_lost(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_CONNECTING, Link.state);
+    TEST_ASSERT_EQUAL_UINT32(0, Link.failures);
+}
+
+void test_Stop_Cancels_And_Ignores_Late_Events() {
+    wifi_link_start(&Link);
+    wifi_link_lost(&Link);
+    wifi_link_stop(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_STOPPED, Link.state);
+    TEST_ASSERT_FALSE(Radio.Timer_Armed);
+    TEST_ASSERT_EQUAL_INT(0, Radio.Disconnects); // nothing to drop while backing off
+    wifi_link_timer(&Link);
+    wifi_link_got_ip(&Link);
+    wifi_link_lost(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_STOPPED, Link.state);
+    TEST_ASSERT_EQUAL_INT(1, Radio.Connects);
+    helper_Bring_Up(); // starts again from no failures
+    TEST_ASSERT_EQUAL_UINT32(0, Link.failures);
+    wifi_link_stop(&Link);
+    TEST_ASSERT_EQUAL_INT(1, Radio.Disconnects);
+}
+
+void test_Subscribers_See_Every_Change() {
+    StateLog Others[WIFI_LINK_MAX_SUBSCRIBERS - 1];
+    memset(Others, 0, sizeof(Others));
+    for (int i = 0; i < WIFI_LINK_MAX_SUBSCRIBERS - 1; i++) {
+        TEST_ASSERT_TRUE(wifi_link_subscribe(&Link, helper_Log_State, &Others[i]));
+    }
+    TEST_ASSERT_FALSE(wifi_link_subscribe(&Link, helper_Log_State, &Log));
+    helper_Bring_Up();
+    wifi_link_lost(&Link);
+    const wifi_link_state_t To[] = {WIFI_LINK_CONNECTING, WIFI_LINK_GETTING_IP, WIFI_LINK_UP, WIFI_LINK_BACKOFF};
+    TEST_ASSERT_EQUAL_INT(4, Log.Count);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(To[i], Log.To[i]);
+        TEST_ASSERT_EQUAL_INT(i == 0 ? WIFI_LINK_STOPPED : To[i - 1], Log.From[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(4, Others[WIFI_LINK_MAX_SUBSCRIBERS - 2].Count);
+    TEST_ASSERT_EQUAL_STRING("backoff", wifi_link_state_name(Link.state));
+}
+
+void test_Warm_Deadline_Gives_Up_Early() {
+    TEST_ASSERT_FALSE(wifi_link_may_be_up_by(&Link, Radio.Now_us + 60000000)); // stopped
+    wifi_link_start(&Link);
+    TEST_ASSERT_TRUE(wifi_link_may_be_up_by(&Link, Radio.Now_us + 1000));
+    TEST_ASSERT_FALSE(wifi_link_may_be_up_by(&Link, Radio.Now_us)); // already past
+    Radio.Use_Fixed = true;
+    Radio.Fixed_Random = 0;
+    for (int i = 0; i < 5; i++) { // next wait is 4 s
+        wifi_link_lost(&Link);
+        if (i < 4) {
+            helper_Fire_Timer();
+        }
+    }
+    TEST_ASSERT_FALSE(wifi_link_may_be_up_by(&Link, Radio.Now_us + 3000000));
+    TEST_ASSERT_TRUE(wifi_link_may_be_up_by(&Link, Radio.Now_us + 5000000));
+    helper_Fire_Timer();
+    wifi_link_got_ip(&Link);
+    TEST_ASSERT_TRUE(wifi_link_may_be_up_by(&Link, 0)); // up already
+}
+
+// the access point is off for ten minutes then back. a storm would be an
+// attempt a second or so, this should settle at one a minute at most
+void test_Access_Point_Down_Ten_Minutes_Is_No_Storm() {
+    helper_Bring_Up();
+    helper_Advance_ms(Policy.stable_ms);
+    const int64_t Down_us = Radio.Now_us;
+    const int64_t Back_us = Down_us + 600000000LL;
+    wifi_link_lost(&Link);
+    helper_Run_Radio(false, Back_us);
+    const int Attempts_Down = Radio.Connects - 1;
+    helper_Run_Radio(true, Back_us + 120000000LL);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_UP, Link.state);
+    TEST_ASSERT_TRUE(Attempts_Down >= 10);
+    TEST_ASSERT_TRUE(Attempts_Down <= 30);
+    const int64_t Up_After_us = Link.up_since_us - Back_us;
+    TEST_ASSERT_TRUE(Up_After_us <= (int64_t)(Policy.max_ms + Policy.attempt_timeout_ms) * 1000);
+
+    char Line[128];
+    snprintf(Line, sizeof(Line), "ap down 10 min: %d attempts, up %lld ms after it came back", Attempts_Down,
+             (long long)Up_After_us / 1000);
+    TEST_MESSAGE(Line);
+}
+
+// HELPER FUNCTIONS
+static void helper_Fake_Connect(void *ctx) {
+    FakeRadio *Fake = (FakeRadio *)ctx;
+    Fake->Connects++;
+    Fake->Attempt_Pending = true;
+}
+
+static void helper_Fake_Disconnect(void *ctx) {
+    FakeRadio *Fake = (FakeRadio *)ctx;
+    Fake->Disconnects++;
+    Fake->Attempt_Pending = false;
+}
+
+static void helper_Fake_Arm_Timer(void *ctx, uint32_t ms) {
+    FakeRadio *Fake = (FakeRadio *)ctx;
+    Fake->Timer_Armed = true;
+    Fake->Timer_Due_us = Fake->Now_us + (int64_t)ms * 1000;
+}
+
+static void helper_Fake_Cancel_Timer(void *ctx) { ((FakeRadio *)ctx)->Timer_Armed = false; }
+
+// xorshift, the same sequence every run
+static uint32_t helper_Fake_Random(void *ctx) {
+    FakeRadio *Fake = (FakeRadio *)ctx;
+    if (Fake->Use_Fixed) {
+        return Fake->Fixed_Random;
+    }
+    Fake->Seed ^= Fake->Seed << 13;
+    Fake->Seed ^= Fake->Seed >> 17;
+    Fake->Seed ^= Fake->Seed << 5;
+    return Fake->Seed;
+}
+
+static int64_t helper_Fake_Now(void *ctx) { return ((FakeRadio *)ctx)->Now_us; }
+
+static void helper_Log_State(void *ctx, wifi_link_state_t from, wifi_link_state_t to) {
+    StateLog *State_Log = (StateLog *)ctx;
+    TEST_ASSERT_NOT_EQUAL(from, to);
+    if (State_Log->Count < 64) {
+        State_Log->From[State_Log->Count] = from;
+        State_Log->To[State_Log->Count] = to;
+    }
+    State_Log->Count++;
+}
+
+// moves the clock to when the timer is due and fires it
+static void helper_Fire_Timer(void) {
+    TEST_ASSERT_TRUE(Radio.Timer_Armed);
+    Radio.Now_us = Radio.Timer_Due_us;
+    Radio.Timer_Armed = false;
+    wifi_link_timer(&Link);
+}
+
+static void helper_Advance_ms(uint32_t ms) { Radio.Now_us += (int64_t)ms * 1000; }
+
+static void helper_Bring_Up(void) {
+    wifi_link_start(&Link);
+    wifi_link_associated(&Link);
+    wifi_link_got_ip(&Link);
+    TEST_ASSERT_EQUAL_INT(WIFI_LINK_UP, Link.state);
+}
+
+// a down access point fails an attempt after a 3 s scan, an up one lets
+// it on in 2 s. stops once up or at until_us
+static void helper_Run_Radio(bool ap_up, int64_t until_us) {
+    while (Radio.Now_us < until_us && Link.state != WIFI_LINK_UP) {
+        if (Radio.Attempt_Pending) {
+            Radio.Attempt_Pending = false;
+            if (ap_up) {
+                helper_Advance_ms(2000);
+                wifi_link_associated(&Link);
+                wifi_link_got_ip(&Link);
+            } else {
+                helper_Advance_ms(3000);
+                wifi_link_lost(&Link);
+            }
+        } else {
+            if (Radio.Timer_Due_us > until_us) {
+                Radio.Now_us = until_us;
+                return;
+            }
+            helper_Fire_Timer();
+        }
+    }
+}
+
+#endif
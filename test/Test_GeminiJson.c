@@ -0,0 +1,233 @@
+/*Gemini json extractor unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the answer text and cache name come out of recorded
+    replies the same whichever way the bytes are split, that escapes decode
+    to utf-8 and that broken json is caught
+    the recorded replies are in test/standin/responses, run from the project root
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_GEMINI_JSON)
+
+#include "GeminiJson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// text the callback saw
+typedef struct {
+    char Data[1024];
+    size_t Len;
+    int Calls;
+    size_t Stop_After; // 0 never stops
+} TextSink;
+
+// standard values
+static gemini_json_t Json;
+static char Text[1024];
+static const char *Grounded_Path = "test/standin/responses/grounded.json";
+static const char *Cached_Path = "test/standin/responses/cached.json";
+static const size_t Grounded_Text_Len = 508; // utf-8 bytes in parts[0].text
+
+// PROTOTYPING HELPERS
+static char *helper_Read_File(const char *Path, size_t *Len);
+static gemini_json_status_t helper_Feed_String(const char *Document);
+static bool helper_Sink_Text(void *ctx, const char *text, size_t len);
+
+// PROTOTYPING TESTS
+void test_Extracts_Text_And_Cache_Name();
+void test_Every_Split_Gives_Same_Text();
+void test_Byte_At_A_Time();
+void test_Only_The_Answer_Is_Kept();
+void test_Escapes_Decode_To_Utf8();
+void test_Lone_Surrogate_Becomes_Replacement();
+void test_Truncated_Text_Is_Flagged();
+void test_Malformed_Json_Is_An_Error();
+void test_Too_Deep_Is_An_Error();
+void test_Callback_Sees_Text_And_Can_Stop();
+void test_Reset_Reads_The_Next_Document();
+
+//================================CODE
+// START=============================================
+void setUp(void) { gemini_json_init(&Json, Text, sizeof(Text), NULL, NULL); }
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Extracts_Text_And_Cache_Name);
+    RUN_TEST(test_Every_Split_Gives_Same_Text);
+    RUN_TEST(test_Byte_At_A_Time);
+    RUN_TEST(test_Only_The_Answer_Is_Kept);
+    RUN_TEST(test_Escapes_Decode_To_Utf8);
+    RUN_TEST(test_Lone_Surrogate_Becomes_Replacement);
+    RUN_TEST(test_Truncated_Text_Is_Flagged);
+    RUN_TEST(test_Malformed_Json_Is_An_Error);
+    RUN_TEST(test_Too_Deep_Is_An_Error);
+    RUN_TEST(test_Callback_Sees_Text_And_Can_Stop);
+    RUN_TEST(test_Reset_Reads_The_Next_Document);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Extracts_Text_And_Cache_Name() {
+    size_t Len;
+    char *Reply = helper_Read_File(Cached_Path, &Len);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, gemini_json_feed(&Json, Reply, Len));
+    // two parts run together, \u00d7 decoded
+    TEST_ASSERT_EQUAL_STRING("Still on it: the pool was 64 blocks \xc3\x97 8 classes.", Text);
+    TEST_ASSERT_EQUAL_STRING("cachedContents/5g2lr0xqh7bm", Json.cache_name);
+    TEST_ASSERT_FALSE(Json.text_truncated);
+    free(Reply);
+}
+
+void test_Every_Split_Gives_Same_Text() {
+    size_t Len;
+    char *Reply = helper_Read_File(Grounded_Path, &Len);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, gemini_json_feed(&Json, Reply, Len));
+    char Whole[1024];
+    strcpy(Whole, Text);
+    TEST_ASSERT_EQUAL_size_t(Grounded_Text_Len, Json.text_len);
+
+    for (size_t Split = 1; Split < Len - 1; Split++) { // the last byte is the newline after }
+        gemini_json_init(&Json, Text, sizeof(Text), NULL, NULL);
+        TEST_ASSERT_EQUAL_INT(GEMINI_JSON_MORE, gemini_json_feed(&Json, Reply, Split));
+        TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, gemini_json_feed(&Json, Reply + Split, Len - Split));
+        TEST_ASSERT_EQUAL_STRING(Whole, Text);
+    }
+    free(Reply);
+}
+
+void test_Byte_At_A_Time() {
+    size_t Len;
+    char *Reply = helper_Read_File(Grounded_Path, &Len);
+    gemini_json_status_t Status = GEMINI_JSON_MORE;
+    for (size_t i = 0; i < Len; i++) {
+        Status = gemini_json_feed(&Json, Reply + i, 1);
+        TEST_ASSERT_TRUE(Status == GEMINI_JSON_MORE || Status == GEMINI_JSON_DONE);
+    }
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, Status);
+    TEST_ASSERT_EQUAL_size_t(Grounded_Text_Len, Json.text_len);
+    free(Reply);
+}
+
+// text keys under grounding, other candidates and nested cachedContent keys
+// must all be left alone
+void test_Only_The_Answer_Is_Kept() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"text\":\"no\",\"candidates\":[{\"content\":{\"parts\":["
+                                             "{\"text\":\"a\",\"thought\":false},{\"inlineData\":{\"text\":\"no\"}},"
+                                             "{\"text\":\"b\"}],\"text\":\"no\"},\"cachedContent\":\"no\","
+                                             "\"groundingMetadata\":{\"groundingSupports\":[{\"segment\":{\"text\":"
+                                             "\"no\"}}]}},{\"content\":{\"parts\":[{\"text\":\"no\"}]}}],"
+                                             "\"cachedContent\":\"cachedContents/x\",\"usage\":[1,-2.5e3,true,null]}"));
+    TEST_ASSERT_EQUAL_STRING("ab", Text);
+    TEST_ASSERT_EQUAL_STRING("cachedContents/x", Json.cache_name);
+}
+
+void test_Escapes_Decode_To_Utf8() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"candidates\":[{\"content\":{\"parts\":[{\"text\":"
+                                             "\"\\\"q\\\"\\\\\\/\\n\\t\\u00e9\\u20AC\\ud83d\\ude00\"}]}}]}"));
+    TEST_ASSERT_EQUAL_STRING("\"q\"\\/\n\t\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", Text);
+}
+
+void test_Lone_Surrogate_Becomes_Replacement() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"candidates\":[{\"content\":{\"parts\":[{\"text\":"
+                                             "\"a\\ud83db\\ude00\\ud83d\"}]}}]}"));
+    TEST_ASSERT_EQUAL_STRING("a\xef\xbf\xbd" "b\xef\xbf\xbd\xef\xbf\xbd", Text);
+}
+
+void test_Truncated_Text_Is_Flagged() {
+    char Small[8];
+    gemini_json_init(&Json, Small, sizeof(Small), NULL, NULL);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"0123456789\"}]}}]}"));
+    TEST_ASSERT_EQUAL_STRING("0123456", Small);
+    TEST_ASSERT_TRUE(Json.text_truncated);
+}
+
+void test_Malformed_Json_Is_An_Error() {
+    const char *Broken[] = {"{\"a\" 1}", "{\"a\":}", "[1,]", "{\"a\":1}}", "{\"a\":\"x\ny\"}",
+                            "{\"a\":\"\\q\"}", "{\"a\":\"\\u12g4\"}", "{,}", "]"};
+    for (size_t i = 0; i < sizeof(Broken) / sizeof(Broken[0]); i++) {
+        gemini_json_init(&Json, Text, sizeof(Text), NULL, NULL);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(GEMINI_JSON_ERROR, helper_Feed_String(Broken[i]), Broken[i]);
+    }
+    // stays failed
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_ERROR, helper_Feed_String("{}"));
+}
+
+void test_Too_Deep_Is_An_Error() {
+    char Deep[GEMINI_JSON_DEPTH_MAX * 2 + 4];
+    memset(Deep, '[', GEMINI_JSON_DEPTH_MAX);
+    memset(Deep + GEMINI_JSON_DEPTH_MAX, ']', GEMINI_JSON_DEPTH_MAX);
+    Deep[GEMINI_JSON_DEPTH_MAX * 2] = '\0';
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, helper_Feed_String(Deep));
+
+    gemini_json_init(&Json, Text, sizeof(Text), NULL, NULL);
+    memset(Deep, '[', GEMINI_JSON_DEPTH_MAX + 1);
+    Deep[GEMINI_JSON_DEPTH_MAX + 1] = '\0';
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_ERROR, helper_Feed_String(Deep));
+}
+
+void test_Callback_Sees_Text_And_Can_Stop() {
+    TextSink Sink = {0};
+    gemini_json_init(&Json, NULL, 0, helper_Sink_Text, &Sink);
+    size_t Len;
+    char *Reply = helper_Read_File(Grounded_Path, &Len);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE, gemini_json_feed(&Json, Reply, Len));
+    TEST_ASSERT_EQUAL_size_t(Grounded_Text_Len, Sink.Len);
+    TEST_ASSERT_EQUAL_size_t(0, Json.text_len); // no buffer given
+
+    memset(&Sink, 0, sizeof(Sink));
+    Sink.Stop_After = 10;
+    gemini_json_init(&Json, NULL, 0, helper_Sink_Text, &Sink);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_ABORTED, gemini_json_feed(&Json, Reply, Len));
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_ABORTED, gemini_json_feed(&Json, "{}", 2));
+    TEST_ASSERT_TRUE(Sink.Len >= 10 && Sink.Len < Grounded_Text_Len);
+    free(Reply);
+}
+
+// one document per streamed event, the text keeps adding up
+void test_Reset_Reads_The_Next_Document() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"Hel\"}]}}]}\r\n"));
+    gemini_json_reset(&Json);
+    TEST_ASSERT_EQUAL_INT(GEMINI_JSON_DONE,
+                          helper_Feed_String("{\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"lo\"}]}}]}"));
+    TEST_ASSERT_EQUAL_STRING("Hello", Text);
+}
+
+// HELPER FUNCTIONS
+static char *helper_Read_File(const char *Path, size_t *Len) {
+    FILE *File = fopen(Path, "rb");
+    TEST_ASSERT_NOT_NULL_MESSAGE(File, Path);
+    fseek(File, 0, SEEK_END);
+    *Len = (size_t)ftell(File);
+    fseek(File, 0, SEEK_SET);
+    char *Data = malloc(*Len + 1);
+    TEST_ASSERT_NOT_NULL(Data);
+    TEST_ASSERT_EQUAL_size_t(*Len, fread(Data, 1, *Len, File));
+    Data[*Len] = '\0';
+    fclose(File);
+    return Data;
+}
+
+static gemini_json_status_t helper_Feed_String(const char *Document) {
+    return gemini_json_feed(&Json, Document, strlen(Document));
+}
+
+static bool helper_Sink_Text(void *ctx, const char *text, size_t len) {
+    TextSink *Sink = (TextSink *)ctx;
+    TEST_ASSERT_TRUE(Sink->Len + len < sizeof(Sink->Data));
+    memcpy(Sink->Data + Sink->Len, text, len);
+    Sink->Len += len;
+    Sink->Calls++;
+    return Sink->Stop_After == 0 || Sink->Len < Sink->Stop_After;
+}
+
+#endif
@@ -0,0 +1,676 @@
+/*Gemini request body writer unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the body is valid json whatever the question holds
+    (quotes, control characters, broken utf-8), that the question comes back
+    out unchanged when it was valid utf-8 and that reading it out in small
+    pieces gives the same bytes as writing it whole
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_GEMINI_PAYLOAD)
+
+#include "GeminiPayload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+static char Body[8192];
+static char Decoded[2048];
+static const char *Question_Key = "{\"contents\":[{\"parts\":[{\"text\":\"";
+static const char *Expected_Body =
+    "{\"contents\":[{\"parts\":[{\"text\":\"Why is the sky blue?\"}]}]"
+    ",\"cachedContent\":\"cachedContents/5g2lr0xqh7bm\""
+    ",\"tools\":[{\"googleSearchRetrieval\":{}}]"
+    ",\"safetySettings\":["
+    "{\"category\":\"HARM_CATEGORY_DANGEROUS_CONTENT\",\"threshold\":\"BLOCK_NONE\"},"
+    "{\"category\":\"HARM_CATEGORY_HATE_SPEECH\",\"threshold\":\"BLOCK_NONE\"},"
+    "{\"category\":\"HARM_CATEGORY_HARASSMENT\",\"threshold\":\"BLOCK_NONE\"},"
+    "{\"category\":\"HARM_CATEGORY_SEXUALLY_EXPLICIT\",\"threshold\":\"BLOCK_NONE\"}]"
+    ",\"generationConfig\":{\"temperature\":0.9}}";
+// valid utf-8 that still has to be escaped or passed through untouched
+static const char *Tricky_Questions[] = {
+    "",
+    "\"quoted\" and \\backslashed\\",
+    "\"}]}],\"tools\":[]}",
+    "tab\tnewline\ncarriage\rbackspace\bformfeed\f",
+    "\x01\x02\x1e\x1f\x7f",
+    "literal \\u0000 and \\ud800 in the text",
+    "</script><!-- -->",
+    "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xef\xbf\xbf \xf4\x8f\xbf\xbf",
+    "\xe2\x80\xa8 line and paragraph \xe2\x80\xa9 separators",
+};
+// not utf-8, each bad byte has to become U+FFFD
+static const char *Broken_Questions[] = {
+    "\x80",                 // lone continuation byte
+    "\xc0\xaf",             // overlong slash
+    "\xe0\x80\xaf",         // overlong slash again
+    "\xed\xa0\x80",         // utf-16 surrogate
+    "\xf4\x90\x80\x80",     // past U+10FFFF
+    "\xf5\x80\x80\x80",
+    "\xfe\xff",
+    "cut short \xe2\x82",   // sequence runs into the end
+    "\xf0\x9f\x98",
+    "a\xc3" "b",            // sequence runs into ascii
+};
+
+// synthetic recording, hands over a few samples at a time
+typedef struct {
+    size_t Total;
+    size_t Pos;
+    size_t Fail_At; // 0 to never fail
+    size_t Calls;
+} PcmSource;
+
+static char Audio_Body[16384];
+static uint8_t Audio_Raw[12288];
+static const char *Audio_Key = "\"data\":\"";
+static const char *Base64_Digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// PROTOTYPING HELPERS
+static bool helper_Valid_Json(const char *Json);
+static bool helper_Value(const char **p, int Depth);
+static bool helper_String(const char **p, char *Out, size_t *Out_Len);
+static void helper_Skip_Space(const char **p);
+static size_t helper_Utf8_Len(const unsigned char *s);
+static void helper_Put_Utf8(char *Out, size_t *Out_Len, unsigned long Code_Point);
+static const char *helper_Decode_Question(const char *Json);
+static int16_t helper_Sample(size_t Index);
+static int helper_Pcm_Read(void *Ctx, int16_t *Samples, size_t Max_Samples);
+static int helper_Encoded_Read(void *Ctx, uint8_t *Buf, size_t Size);
+static size_t helper_Read_Audio(gemini_payload_t *Payload, size_t Size);
+static size_t helper_Decode_Audio(const char *Json);
+
+// PROTOTYPING TESTS
+void test_Body_Matches_The_Old_Layout();
+void test_Cache_Name_Is_Left_Out_When_Null();
+void test_Len_Matches_What_Is_Written();
+void test_Tricky_Questions_Round_Trip();
+void test_Broken_Utf8_Becomes_Replacement();
+void test_Random_Bytes_Give_Valid_Json();
+void test_Small_Reads_Give_The_Same_Body();
+void test_Short_Buffer_Is_Refused();
+void test_Rewind_Reads_It_Again();
+void test_Escape_Alone_Matches_The_Body();
+void test_Wav_Header_Fields();
+void test_Audio_Body_Decodes_To_The_Clip();
+void test_Audio_Small_Reads_Give_The_Same_Body();
+void test_Audio_Len_Only_When_Total_Is_Known();
+void test_Audio_Failing_Source_Cuts_It_Short();
+void test_Encoded_Audio_Goes_Out_Unchanged();
+
+//================================CODE
+// START=============================================
+void setUp(void) { memset(Body, 0, sizeof(Body)); }
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Body_Matches_The_Old_Layout);
+    RUN_TEST(test_Cache_Name_Is_Left_Out_When_Null);
+    RUN_TEST(test_Len_Matches_What_Is_Written);
+    RUN_TEST(test_Tricky_Questions_Round_Trip);
+    RUN_TEST(test_Broken_Utf8_Becomes_Replacement);
+    RUN_TEST(test_Random_Bytes_Give_Valid_Json);
+    RUN_TEST(test_Small_Reads_Give_The_Same_Body);
+    RUN_TEST(test_Short_Buffer_Is_Refused);
+    RUN_TEST(test_Rewind_Reads_It_Again);
+    RUN_TEST(test_Escape_Alone_Matches_The_Body);
+    RUN_TEST(test_Wav_Header_Fields);
+    RUN_TEST(test_Audio_Body_Decodes_To_The_Clip);
+    RUN_TEST(test_Audio_Small_Reads_Give_The_Same_Body);
+    RUN_TEST(test_Audio_Len_Only_When_Total_Is_Known);
+    RUN_TEST(test_Audio_Failing_Source_Cuts_It_Short);
+    RUN_TEST(test_Encoded_Audio_Goes_Out_Unchanged);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+// same keys in the same order as the cJSON version, minus the whitespace
+void test_Body_Matches_The_Old_Layout() {
+    size_t Len = gemini_payload_write("Why is the sky blue?", "cachedContents/5g2lr0xqh7bm", Body, sizeof(Body));
+    TEST_ASSERT_EQUAL_STRING(Expected_Body, Body);
+    TEST_ASSERT_EQUAL_size_t(strlen(Expected_Body), Len);
+    TEST_ASSERT_TRUE(helper_Valid_Json(Body));
+}
+
+void test_Cache_Name_Is_Left_Out_When_Null() {
+    TEST_ASSERT_NOT_EQUAL(0, gemini_payload_write("hi", NULL, Body, sizeof(Body)));
+    TEST_ASSERT_NULL(strstr(Body, "cachedContent"));
+    TEST_ASSERT_TRUE(helper_Valid_Json(Body));
+    TEST_ASSERT_NOT_EQUAL(0, gemini_payload_write(NULL, NULL, Body, sizeof(Body)));
+    TEST_ASSERT_EQUAL_STRING("", helper_Decode_Question(Body));
+}
+
+void test_Len_Matches_What_Is_Written() {
+    gemini_payload_t Payload;
+    for (size_t i = 0; i < sizeof(Tricky_Questions) / sizeof(Tricky_Questions[0]); i++) {
+        gemini_payload_init(&Payload, Tricky_Questions[i], "cachedContents/\"x\"");
+        size_t Len = gemini_payload_len(&Payload);
+        TEST_ASSERT_EQUAL_size_t(Len, gemini_payload_write(Tricky_Questions[i], "cachedContents/\"x\"", Body,
+                                                           sizeof(Body)));
+        TEST_ASSERT_EQUAL_size_t(Len, strlen(Body));
+    }
+}
+
+void test_Tricky_Questions_Round_Trip() {
+    for (size_t i = 0; i < sizeof(Tricky_Questions) / sizeof(Tricky_Questions[0]); i++) {
+        TEST_ASSERT_NOT_EQUAL(0, gemini_payload_write(Tricky_Questions[i], NULL, Body, sizeof(Body)));
+        TEST_ASSERT_TRUE_MESSAGE(helper_Valid_Json(Body), Body);
+        TEST_ASSERT_EQUAL_STRING(Tricky_Questions[i], helper_Decode_Question(Body));
+    }
+    // control characters never go out raw
+    gemini_payload_write("\x01\n", NULL, Body, sizeof(Body));
+    TEST_ASSERT_NOT_NULL(strstr(Body, "\"\\u0001\\n\""));
+}
+
+void test_Broken_Utf8_Becomes_Replacement() {
+    for (size_t i = 0; i < sizeof(Broken_Questions) / sizeof(Broken_Questions[0]); i++) {
+        TEST_ASSERT_NOT_EQUAL(0, gemini_payload_write(Broken_Questions[i], NULL, Body, sizeof(Body)));
+        TEST_ASSERT_TRUE_MESSAGE(helper_Valid_Json(Body), Broken_Questions[i]);
+        TEST_ASSERT_NOT_NULL(strstr(helper_Decode_Question(Body), "\xef\xbf\xbd"));
+    }
+    gemini_payload_write("a\xc3" "b", NULL, Body, sizeof(Body));
+    TEST_ASSERT_EQUAL_STRING("a\xef\xbf\xbd" "b", helper_Decode_Question(Body));
+}
+
+void test_Random_Bytes_Give_Valid_Json() {
+    char Question[257];
+    srand(1234);
+    for (int Round = 0; Round < 2000; Round++) {
+        size_t Len = (size_t)(rand() % 256);
+        for (size_t i = 0; i < Len; i++) {
+            Question[i] = (char)(rand() % 255 + 1); // anything but the nul
+        }
+        Question[Len] = '\0';
+        TEST_ASSERT_NOT_EQUAL(0, gemini_payload_write(Question, Question, Body, sizeof(Body)));
+        TEST_ASSERT_TRUE(helper_Valid_Json(Body));
+    }
+}
+
+void test_Small_Reads_Give_The_Same_Body() {
+    const char *Question = "\"\\\x01 caf\xc3\xa9 \xf0\x9f\x98\x80\xff tail";
+    size_t Whole = gemini_payload_write(Question, "cachedContents/abc", Body, sizeof(Body));
+    char Pieces[sizeof(Body)];
+    gemini_payload_t Payload;
+    for (size_t Size = 1; Size <= 64; Size++) {
+        gemini_payload_init(&Payload, Question, "cachedContents/abc");
+        size_t Total = 0;
+        size_t Got;
+        while ((Got = gemini_payload_read(&Payload, Pieces + Total, Size)) > 0) {
+            TEST_ASSERT_LESS_OR_EQUAL_size_t(Size, Got);
+            Total += Got;
+        }
+        TEST_ASSERT_EQUAL_size_t(Whole, Total);
+        TEST_ASSERT_EQUAL_MEMORY(Body, Pieces, Whole);
+    }
+}
+
+void test_Short_Buffer_Is_Refused() {
+    size_t Len = gemini_payload_write("hi", NULL, Body, sizeof(Body));
+    TEST_ASSERT_EQUAL_size_t(0, gemini_payload_write("hi", NULL, Body, Len)); // no room for the nul
+    TEST_ASSERT_EQUAL_size_t(Len, gemini_payload_write("hi", NULL, Body, Len + 1));
+}
+
+// a retry on a new connection sends the same body again
+void test_Rewind_Reads_It_Again() {
+    const char *Question = "split \x01 here";
+    size_t Whole = gemini_payload_write(Question, NULL, Body, sizeof(Body));
+    char Again[sizeof(Body)];
+    gemini_payload_t Payload;
+    gemini_payload_init(&Payload, Question, NULL);
+    char Scratch[40];
+    TEST_ASSERT_EQUAL_size_t(40, gemini_payload_read(&Payload, Scratch, 40)); // stops inside the \u0001
+    TEST_ASSERT_EQUAL_MEMORY("\\u", Scratch + 38, 2);
+    gemini_payload_rewind(&Payload);
+    TEST_ASSERT_EQUAL_size_t(Whole, gemini_payload_read(&Payload, Again, sizeof(Again)));
+    TEST_ASSERT_EQUAL_MEMORY(Body, Again, Whole);
+}
+
+// the speech request escapes its text on its own, the same way
+void test_Escape_Alone_Matches_The_Body() {
+    const char *Text = "\"\\\x01 caf\xc3\xa9 \xff";
+    char Escaped[64];
+    size_t Len = gemini_payload_escape(Text, Escaped, sizeof(Escaped));
+    TEST_ASSERT_EQUAL_size_t(strlen(Escaped), Len);
+    gemini_payload_write(Text, NULL, Body, sizeof(Body));
+    TEST_ASSERT_NOT_NULL(strstr(Body, Escaped));
+    TEST_ASSERT_EQUAL_size_t(0, gemini_payload_escape(Text, Escaped, Len)); // no room for the nul
+    TEST_ASSERT_EQUAL_STRING("", Escaped);
+    TEST_ASSERT_EQUAL_size_t(Len, gemini_payload_escape(Text, Escaped, Len + 1));
+}
+
+void test_Wav_Header_Fields() {
+    static const uint8_t Known[GEMINI_PAYLOAD_WAV_HEADER_SIZE] = {
+        'R', 'I', 'F', 'F', 0x44, 0x7d, 0x00, 0x00, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+        0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x80, 0x3e, 0x00, 0x00, 0x00, 0x7d, 0x00, 0x00,
+        0x02, 0x00, 0x10, 0x00, 'd', 'a', 't', 'a', 0x20, 0x7d, 0x00, 0x00,
+    };
+    uint8_t Header[GEMINI_PAYLOAD_WAV_HEADER_SIZE];
+    gemini_payload_wav_header(Header, 16000, 16016); // a second and a bit
+    TEST_ASSERT_EQUAL_MEMORY(Known, Header, sizeof(Header));
+    // still recording, both sizes run to the end of the stream
+    gemini_payload_wav_header(Header, 16000, 0);
+    TEST_ASSERT_EQUAL_MEMORY("\xff\xff\xff\xff", Header + 4, 4);
+    TEST_ASSERT_EQUAL_MEMORY("\xff\xff\xff\xff", Header + 40, 4);
+    TEST_ASSERT_EQUAL_MEMORY(Known + 8, Header + 8, 32);
+}
+
+void test_Audio_Body_Decodes_To_The_Clip() {
+    static const size_t Totals[] = {0, 1, 2, 3, 1000, 1001, 4097};
+    for (size_t t = 0; t < sizeof(Totals) / sizeof(Totals[0]); t++) {
+        PcmSource Source = {.Total = Totals[t]};
+        gemini_payload_audio_t Audio = {.sample_rate = 16000, .read = helper_Pcm_Read, .ctx = &Source};
+        gemini_payload_t Payload;
+        gemini_payload_init_audio(&Payload, "What did I say?", &Audio, "cachedContents/abc");
+        size_t Len = helper_Read_Audio(&Payload, sizeof(Audio_Body));
+        Audio_Body[Len] = '\0';
+        TEST_ASSERT_TRUE_MESSAGE(helper_Valid_Json(Audio_Body), Audio_Body);
+        TEST_ASSERT_EQUAL_STRING("What did I say?", helper_Decode_Question(Audio_Body));
+        TEST_ASSERT_NOT_NULL(strstr(Audio_Body, "\"mime_type\":\"audio/wav\""));
+        TEST_ASSERT_NOT_NULL(strstr(Audio_Body, "\"cachedContent\":\"cachedContents/abc\""));
+        size_t Raw_Len = helper_Decode_Audio(Audio_Body);
+        TEST_ASSERT_EQUAL_size_t(GEMINI_PAYLOAD_WAV_HEADER_SIZE + 2 * Totals[t], Raw_Len);
+        TEST_ASSERT_EQUAL_MEMORY("RIFF", Audio_Raw, 4);
+        for (size_t i = 0; i < Totals[t]; i++) {
+            const uint8_t *Sample = Audio_Raw + GEMINI_PAYLOAD_WAV_HEADER_SIZE + 2 * i;
+            TEST_ASSERT_EQUAL_INT16(helper_Sample(i), (int16_t)(Sample[0] | (Sample[1] << 8)));
+        }
+    }
+    // without a prompt the clip is the only part
+    PcmSource Source = {.Total = 10};
+    gemini_payload_audio_t Audio = {.sample_rate = 16000, .read = helper_Pcm_Read, .ctx = &Source};
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, NULL, &Audio, NULL);
+    Audio_Body[helper_Read_Audio(&Payload, sizeof(Audio_Body))] = '\0';
+    TEST_ASSERT_TRUE(helper_Valid_Json(Audio_Body));
+    TEST_ASSERT_EQUAL_INT(0, strncmp(Audio_Body, "{\"contents\":[{\"parts\":[{\"inline_data\":", 38));
+    TEST_ASSERT_NULL(strstr(Audio_Body, "cachedContent"));
+}
+
+// the session reads what fits its buffer and the recording hands over what
+// it has, neither lines up with the base64 groups
+void test_Audio_Small_Reads_Give_The_Same_Body() {
+    PcmSource Source = {.Total = 1001};
+    gemini_payload_audio_t Audio = {.sample_rate = 16000, .read = helper_Pcm_Read, .ctx = &Source};
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, "\"quoted\" \x01", &Audio, NULL);
+    size_t Whole = helper_Read_Audio(&Payload, sizeof(Audio_Body));
+    char Pieces[sizeof(Audio_Body)];
+    for (size_t Size = 1; Size <= 64; Size++) {
+        Source = (PcmSource){.Total = 1001};
+        gemini_payload_init_audio(&Payload, "\"quoted\" \x01", &Audio, NULL);
+        size_t Total = 0;
+        size_t Got;
+        while ((Got = gemini_payload_read(&Payload, Pieces + Total, Size)) > 0) {
+            TEST_ASSERT_LESS_OR_EQUAL_size_t(Size, Got);
+            Total += Got;
+        }
+        TEST_ASSERT_EQUAL_size_t(Whole, Total);
+        TEST_ASSERT_EQUAL_MEMORY(Audio_Body, Pieces, Whole);
+    }
+}
+
+void test_Audio_Len_Only_When_Total_Is_Known() {
+    PcmSource Source = {.Total = 1001};
+    gemini_payload_audio_t Audio = {.sample_rate = 16000, .read = helper_Pcm_Read, .ctx = &Source};
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, "hi", &Audio, "cachedContents/abc");
+    TEST_ASSERT_EQUAL_size_t(GEMINI_PAYLOAD_LEN_UNKNOWN, gemini_payload_len(&Payload));
+    Audio.total_samples = 1001;
+    gemini_payload_init_audio(&Payload, "hi", &Audio, "cachedContents/abc");
+    size_t Len = gemini_payload_len(&Payload);
+    TEST_ASSERT_EQUAL_size_t(Len, helper_Read_Audio(&Payload, sizeof(Audio_Body)));
+    helper_Decode_Audio(Audio_Body);
+    TEST_ASSERT_EQUAL_MEMORY("\xd2\x07\x00\x00", Audio_Raw + 40, 4); // 2002 bytes of pcm
+    // a clip can't be recorded again
+    TEST_ASSERT_FALSE(gemini_payload_rewind(&Payload));
+}
+
+void test_Audio_Failing_Source_Cuts_It_Short() {
+    PcmSource Source = {.Total = 4000, .Fail_At = 500};
+    gemini_payload_audio_t Audio = {.sample_rate = 16000, .read = helper_Pcm_Read, .ctx = &Source};
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, NULL, &Audio, NULL);
+    size_t Total = 0;
+    size_t Got;
+    while ((Got = gemini_payload_read(&Payload, Audio_Body + Total, 100)) > 0) {
+        Total += Got;
+    }
+    TEST_ASSERT_TRUE(Payload.failed);
+    TEST_ASSERT_LESS_THAN_size_t(4 * (2 * 500 + GEMINI_PAYLOAD_WAV_HEADER_SIZE) / 3 + 200, Total);
+    TEST_ASSERT_EQUAL_size_t(0, gemini_payload_read(&Payload, Audio_Body, sizeof(Audio_Body)));
+}
+
+// a file from AudioCodec goes in as it is, no wav header of our own and
+// no length up front
+void test_Encoded_Audio_Goes_Out_Unchanged() {
+    static const size_t Totals[] = {0, 1, 2, 3, 4, 1000, 8191};
+    for (size_t t = 0; t < sizeof(Totals) / sizeof(Totals[0]); t++) {
+        PcmSource Source = {.Total = Totals[t]};
+        gemini_payload_audio_t Audio = {.sample_rate = 16000, .ctx = &Source,
+                                        .read_encoded = helper_Encoded_Read, .mime_type = "audio/flac"};
+        gemini_payload_t Payload;
+        gemini_payload_init_audio(&Payload, "What did I say?", &Audio, NULL);
+        TEST_ASSERT_EQUAL_size_t(GEMINI_PAYLOAD_LEN_UNKNOWN, gemini_payload_len(&Payload));
+        size_t Len = helper_Read_Audio(&Payload, sizeof(Audio_Body));
+        Audio_Body[Len] = '\0';
+        TEST_ASSERT_TRUE_MESSAGE(helper_Valid_Json(Audio_Body), Audio_Body);
+        TEST_ASSERT_NOT_NULL(strstr(Audio_Body, "{\"inline_data\":{\"mime_type\":\"audio/flac\",\"data\":\""));
+        TEST_ASSERT_EQUAL_size_t(Totals[t], helper_Decode_Audio(Audio_Body));
+        for (size_t i = 0; i < Totals[t]; i++) {
+            TEST_ASSERT_EQUAL_UINT8((uint8_t)helper_Sample(i), Audio_Raw[i]);
+        }
+    }
+    // small reads, and a source that gives up part way
+    PcmSource Source = {.Total = 1000};
+    gemini_payload_audio_t Audio = {.sample_rate = 16000, .ctx = &Source,
+                                    .read_encoded = helper_Encoded_Read, .mime_type = "audio/flac"};
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, NULL, &Audio, NULL);
+    size_t Whole = helper_Read_Audio(&Payload, sizeof(Audio_Body));
+    char Pieces[sizeof(Audio_Body)];
+    for (size_t Size = 1; Size <= 9; Size++) {
+        Source = (PcmSource){.Total = 1000};
+        gemini_payload_init_audio(&Payload, NULL, &Audio, NULL);
+        size_t Total = 0;
+        size_t Got;
+        while ((Got = gemini_payload_read(&Payload, Pieces + Total, Size)) > 0) {
+            Total += Got;
+        }
+        TEST_ASSERT_EQUAL_size_t(Whole, Total);
+        TEST_ASSERT_EQUAL_MEMORY(Audio_Body, Pieces, Whole);
+    }
+    Source = (PcmSource){.Total = 1000, .Fail_At = 300};
+    gemini_payload_init_audio(&Payload, NULL, &Audio, NULL);
+    while (gemini_payload_read(&Payload, Pieces, 64) > 0) {
+    }
+    TEST_ASSERT_TRUE(Payload.failed);
+}
+
+// HELPER FUNCTIONS
+// strict rfc 8259 check, strings must be valid utf-8 as well
+static bool helper_Valid_Json(const char *Json) {
+    const char *p = Json;
+    if (!helper_Value(&p, 0)) {
+        return false;
+    }
+    helper_Skip_Space(&p);
+    return *p == '\0';
+}
+
+static bool helper_Value(const char **p, int Depth) {
+    if (Depth > 64) {
+        return false;
+    }
+    helper_Skip_Space(p);
+    const char *s = *p;
+    if (*s == '"') {
+        size_t Len = 0;
+        return helper_String(p, NULL, &Len);
+    }
+    if (*s == '{' || *s == '[') {
+        char Close = *s == '{' ? '}' : ']';
+        *p = s + 1;
+        helper_Skip_Space(p);
+        if (**p == Close) {
+            (*p)++;
+            return true;
+        }
+        for (;;) {
+            if (Close == '}') {
+                size_t Len = 0;
+                helper_Skip_Space(p);
+                if (**p != '"' || !helper_String(p, NULL, &Len)) {
+                    return false;
+                }
+                helper_Skip_Space(p);
+                if (**p != ':') {
+                    return false;
+                }
+                (*p)++;
+            }
+            if (!helper_Value(p, Depth + 1)) {
+                return false;
+            }
+            helper_Skip_Space(p);
+            if (**p == Close) {
+                (*p)++;
+                return true;
+            }
+            if (**p != ',') {
+                return false;
+            }
+            (*p)++;
+        }
+    }
+    static const char *Literals[] = {"true", "false", "null"};
+    for (size_t i = 0; i < 3; i++) {
+        if (strncmp(s, Literals[i], strlen(Literals[i])) == 0) {
+            *p = s + strlen(Literals[i]);
+            return true;
+        }
+    }
+    // number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (*s == '-') {
+        s++;
+    }
+    if (*s == '0') {
+        s++;
+    } else if (*s >= '1' && *s <= '9') {
+        while (*s >= '0' && *s <= '9') {
+            s++;
+        }
+    } else {
+        return false;
+    }
+    if (*s == '.') {
+        s++;
+        if (!(*s >= '0' && *s <= '9')) {
+            return false;
+        }
+        while (*s >= '0' && *s <= '9') {
+            s++;
+        }
+    }
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        if (*s == '+' || *s == '-') {
+            s++;
+        }
+        if (!(*s >= '0' && *s <= '9')) {
+            return false;
+        }
+        while (*s >= '0' && *s <= '9') {
+            s++;
+        }
+    }
+    *p = s;
+    return true;
+}
+
+// reads the string at *p, decoded into Out when it isn't NULL
+static bool helper_String(const char **p, char *Out, size_t *Out_Len) {
+    const unsigned char *s = (const unsigned char *)*p + 1;
+    for (;;) {
+        if (*s == '"') {
+            *p = (const char *)s + 1;
+            if (Out) {
+                Out[*Out_Len] = '\0';
+            }
+            return true;
+        }
+        if (*s < 0x20) {
+            return false; // raw control character, or the end of the text
+        }
+        if (*s == '\\') {
+            s++;
+            unsigned long Code_Point = 0;
+            switch (*s) {
+                case '"': Code_Point = '"'; break;
+                case '\\': Code_Point = '\\'; break;
+                case '/': Code_Point = '/'; break;
+                case 'b': Code_Point = '\b'; break;
+                case 'f': Code_Point = '\f'; break;
+                case 'n': Code_Point = '\n'; break;
+                case 'r': Code_Point = '\r'; break;
+                case 't': Code_Point = '\t'; break;
+                case 'u':
+                    for (int i = 1; i <= 4; i++) {
+                        char Hex[2] = {(char)s[i], '\0'};
+                        if (!strchr("0123456789abcdefABCDEF", Hex[0]) || Hex[0] == '\0') {
+                            return false;
+                        }
+                        Code_Point = Code_Point * 16 + strtoul(Hex, NULL, 16);
+                    }
+                    s += 4;
+                    break;
+                default: return false;
+            }
+            s++;
+            if (Out) {
+                helper_Put_Utf8(Out, Out_Len, Code_Point);
+            }
+            continue;
+        }
+        size_t Len = *s < 0x80 ? 1 : helper_Utf8_Len(s);
+        if (Len == 0) {
+            return false;
+        }
+        if (Out) {
+            memcpy(Out + *Out_Len, s, Len);
+        }
+        *Out_Len += Len;
+        s += Len;
+    }
+}
+
+static void helper_Skip_Space(const char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') {
+        (*p)++;
+    }
+}
+
+// written from the unicode table 3-7 rather than shared with the writer
+static size_t helper_Utf8_Len(const unsigned char *s) {
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        return (s[1] & 0xc0) == 0x80 ? 2 : 0;
+    }
+    if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        unsigned long Code_Point = ((s[0] & 0x0ful) << 12) | ((s[1] & 0x3ful) << 6) | (s[2] & 0x3ful);
+        bool Shape = (s[1] & 0xc0) == 0x80 && (s[2] & 0xc0) == 0x80;
+        return Shape && Code_Point >= 0x800 && (Code_Point < 0xd800 || Code_Point > 0xdfff) ? 3 : 0;
+    }
+    if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        if ((s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80 || (s[3] & 0xc0) != 0x80) {
+            return 0;
+        }
+        unsigned long Code_Point = ((s[0] & 0x07ul) << 18) | ((s[1] & 0x3ful) << 12) | ((s[2] & 0x3ful) << 6) |
+                                   (s[3] & 0x3ful);
+        return Code_Point >= 0x10000 && Code_Point <= 0x10ffff ? 4 : 0;
+    }
+    return 0;
+}
+
+// the writer never emits surrogate escapes, so these are all below U+10000
+static void helper_Put_Utf8(char *Out, size_t *Out_Len, unsigned long Code_Point) {
+    if (Code_Point < 0x80) {
+        Out[(*Out_Len)++] = (char)Code_Point;
+    } else if (Code_Point < 0x800) {
+        Out[(*Out_Len)++] = (char)(0xc0 | (Code_Point >> 6));
+        Out[(*Out_Len)++] = (char)(0x80 | (Code_Point & 0x3f));
+    } else {
+        Out[(*Out_Len)++] = (char)(0xe0 | (Code_Point >> 12));
+        Out[(*Out_Len)++] = (char)(0x80 | ((Code_Point >> 6) & 0x3f));
+        Out[(*Out_Len)++] = (char)(0x80 | (Code_Point & 0x3f));
+    }
+}
+
+// contents[0].parts[0].text decoded back to bytes
+static const char *helper_Decode_Question(const char *Json) {
+    TEST_ASSERT_EQUAL_INT(0, strncmp(Json, Question_Key, strlen(Question_Key)));
+    const char *p = Json + strlen(Question_Key) - 1; // back on the opening quote
+    size_t Len = 0;
+    TEST_ASSERT_TRUE(helper_String(&p, Decoded, &Len));
+    return Decoded;
+}
+
+// a sawtooth that covers the whole range, so both bytes of every sample matter
+static int16_t helper_Sample(size_t Index) { return (int16_t)(Index * 2731u + 17u); }
+
+static int helper_Pcm_Read(void *Ctx, int16_t *Samples, size_t Max_Samples) {
+    PcmSource *Source = Ctx;
+    if (Source->Fail_At && Source->Pos >= Source->Fail_At) {
+        return -1;
+    }
+    // 1 to 7 samples a call, never what was asked for
+    size_t Count = Source->Calls++ % 7 + 1;
+    Count = Count < Max_Samples ? Count : Max_Samples;
+    Count = Count < Source->Total - Source->Pos ? Count : Source->Total - Source->Pos;
+    for (size_t i = 0; i < Count; i++) {
+        Samples[i] = helper_Sample(Source->Pos++);
+    }
+    return (int)Count;
+}
+
+// the low byte of the same sawtooth, 1 to 7 bytes a call
+static int helper_Encoded_Read(void *Ctx, uint8_t *Buf, size_t Size) {
+    PcmSource *Source = Ctx;
+    if (Source->Fail_At && Source->Pos >= Source->Fail_At) {
+        return -1;
+    }
+    size_t Count = Source->Calls++ % 7 + 1;
+    Count = Count < Size ? Count : Size;
+    Count = Count < Source->Total - Source->Pos ? Count : Source->Total - Source->Pos;
+    for (size_t i = 0; i < Count; i++) {
+        Buf[i] = (uint8_t)helper_Sample(Source->Pos++);
+    }
+    return (int)Count;
+}
+
+static size_t helper_Read_Audio(gemini_payload_t *Payload, size_t Size) {
+    size_t Total = 0;
+    size_t Got;
+    while ((Got = gemini_payload_read(Payload, Audio_Body + Total, Size - 1 - Total)) > 0) {
+        Total += Got;
+    }
+    TEST_ASSERT_FALSE(Payload->failed);
+    return Total;
+}
+
+// inline_data.data base64 decoded into Audio_Raw
+static size_t helper_Decode_Audio(const char *Json) {
+    const char *p = strstr(Json, Audio_Key);
+    TEST_ASSERT_NOT_NULL(p);
+    p += strlen(Audio_Key);
+    size_t Len = 0;
+    unsigned long Bits = 0;
+    int Count = 0;
+    for (; *p != '"'; p++) {
+        if (*p == '=') {
+            continue;
+        }
+        const char *Digit = strchr(Base64_Digits, *p);
+        TEST_ASSERT_NOT_NULL(Digit);
+        Bits = (Bits << 6) | (unsigned long)(Digit - Base64_Digits);
+        if (++Count == 4) {
+            Audio_Raw[Len++] = (uint8_t)(Bits >> 16);
+            Audio_Raw[Len++] = (uint8_t)(Bits >> 8);
+            Audio_Raw[Len++] = (uint8_t)Bits;
+            Bits = 0;
+            Count = 0;
+        }
+    }
+    if (Count == 3) {
+        Audio_Raw[Len++] = (uint8_t)(Bits >> 10);
+        Audio_Raw[Len++] = (uint8_t)(Bits >> 2);
+    } else if (Count == 2) {
+        Audio_Raw[Len++] = (uint8_t)(Bits >> 4);
+    }
+    return Len;
+}
+
+#endif
@@ -0,0 +1,609 @@
+/*Gemini prewarm unit tests
+    Written by Matthew Ayestaran
+    purpose: runs the button press prewarm against a fake radio, resolver
+    and server. checks it wakes, resolves and connects in that order and
+    the upload's request goes out on that connection, that a failed
+    resolve or connect leaves the upload to connect itself, that a cancel
+    while warming closes what the handshake opened and one before the
+    connect skips it, that the claim waits for a prewarm in flight and a
+    second press doesn't start another. then measures press to first byte
+    against the local https stand-in, connecting when the button is let go
+    against prewarming from the press, for a long and a short recording
+    run the stand-in with: python3 test/standin/https_standin.py --port 8443 --handshake-delay-ms 150
+    run with: pio test -e native_gemini_prewarm
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_GEMINI_PREWARM)
+
+#include "GeminiPrewarm.h"
+#include "GeminiSession.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+typedef enum { BLOCK_NONE = 0, BLOCK_RESOLVE, BLOCK_CONNECT } BlockAt;
+
+// fake radio, resolver and server. the resolve and the connect take time
+// on the fake clock, either can be held until the test lets it go
+typedef struct {
+    int Wakes;
+    int Sleeps;
+    int Resolves;
+    int Connects;
+    int Closes;
+    bool Resolve_Fails;
+    bool Connect_Fails;
+    char Order[64]; // w wake, r resolve, c connect, s sleep
+    BlockAt Block;
+    bool Entered;
+    bool Released;
+    pthread_mutex_t Gate_Lock;
+    pthread_cond_t Gate_Changed;
+    size_t Reply_Pos;
+} FakeNet;
+
+// body collected by the on_body callback
+typedef struct {
+    size_t Len;
+    gemini_session_t *Session;
+    int64_t First_Byte_us;
+} BodySink;
+
+// a thread calling claim, for the test that it waits
+typedef struct {
+    gemini_prewarm_t *Prewarm;
+    gemini_prewarm_state_t State;
+    volatile bool Returned;
+} Claimer;
+
+// openssl client for the stand-in, a fresh full handshake every connect
+typedef struct {
+    SSL *Tls;
+} TlsClient;
+
+// standard values
+static FakeNet Net;
+static gemini_session_t Session;
+static gemini_prewarm_t Prewarm;
+static int64_t Fake_Now_us;
+static const int64_t Resolve_Takes_us = 40000;
+static const int64_t Connect_Takes_us = 300000;
+static const char *Reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+// PROTOTYPING HELPERS
+static void helper_Radio_Wake(void *ctx);
+static void helper_Radio_Sleep(void *ctx);
+static int helper_Resolve(void *ctx, const char *host);
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Fake_Close(void *ctx);
+static int64_t helper_Fake_Clock(void);
+static void helper_Gate(BlockAt at);
+static void helper_Wait_Entered(void);
+static void helper_Let_Go(void);
+static void *helper_Run_Thread(void *arg);
+static void *helper_Standin_Run_Thread(void *arg);
+static void *helper_Claim_Thread(void *arg);
+static bool helper_Sink_Body(void *ctx, const char *data, size_t len);
+static gemini_session_err_t helper_Post(gemini_session_t *session, BodySink *sink);
+static void helper_Sleep_ms(int ms);
+static int64_t helper_Press_To_First_Byte(gemini_prewarm_t *prewarm, gemini_session_t *session, bool prewarm_on_press,
+                                          int recording_ms);
+static int64_t helper_Median(int64_t *values, int count);
+static int helper_Standin_Resolve(void *ctx, const char *host);
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Tls_Close(void *ctx);
+
+// PROTOTYPING TESTS
+void test_Run_Wakes_Resolves_And_Connects();
+void test_Upload_Reuses_The_Prewarmed_Connection();
+void test_Connected_Session_Is_Not_Reconnected();
+void test_Failed_Resolve_Skips_The_Connect();
+void test_Failed_Connect_Leaves_Upload_To_Connect();
+void test_Cancel_During_Handshake_Closes_After();
+void test_Cancel_Before_Connect_Skips_It();
+void test_Cancel_When_Warm_Closes_Now();
+void test_Cancel_After_Claim_Leaves_Upload_Alone();
+void test_Claim_Waits_For_Run_In_Flight();
+void test_Second_Press_Does_Not_Start_Another();
+void test_Standin_Press_To_First_Byte_Cold_And_Prewarmed();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+    memset(&Net, 0, sizeof(Net));
+    pthread_mutex_init(&Net.Gate_Lock, NULL);
+    pthread_cond_init(&Net.Gate_Changed, NULL);
+    Fake_Now_us = 1000000;
+    const gemini_transport_t Transport = {helper_Fake_Connect, helper_Fake_Write, helper_Fake_Read,
+                                          helper_Fake_Close, &Net, NULL};
+    gemini_session_init(&Session, &Transport, "generativelanguage.googleapis.com", 443, NULL);
+    Session.now_us = helper_Fake_Clock;
+    const gemini_prewarm_ops_t Ops = {helper_Radio_Wake, helper_Radio_Sleep, helper_Resolve, &Net};
+    TEST_ASSERT_TRUE(gemini_prewarm_init(&Prewarm, &Session, &Ops));
+}
+void tearDown(void) {
+    gemini_prewarm_deinit(&Prewarm);
+    pthread_cond_destroy(&Net.Gate_Changed);
+    pthread_mutex_destroy(&Net.Gate_Lock);
+}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Run_Wakes_Resolves_And_Connects);
+    RUN_TEST(test_Upload_Reuses_The_Prewarmed_Connection);
+    RUN_TEST(test_Connected_Session_Is_Not_Reconnected);
+    RUN_TEST(test_Failed_Resolve_Skips_The_Connect);
+    RUN_TEST(test_Failed_Connect_Leaves_Upload_To_Connect);
+    RUN_TEST(test_Cancel_During_Handshake_Closes_After);
+    RUN_TEST(test_Cancel_Before_Connect_Skips_It);
+    RUN_TEST(test_Cancel_When_Warm_Closes_Now);
+    RUN_TEST(test_Cancel_After_Claim_Leaves_Upload_Alone);
+    RUN_TEST(test_Claim_Waits_For_Run_In_Flight);
+    RUN_TEST(test_Second_Press_Does_Not_Start_Another);
+    RUN_TEST(test_Standin_Press_To_First_Byte_Cold_And_Prewarmed);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Run_Wakes_Resolves_And_Connects() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_IDLE, Prewarm.state);
+    TEST_ASSERT_TRUE(gemini_prewarm_run(&Prewarm));
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_WARM, Prewarm.state);
+    TEST_ASSERT_EQUAL_STRING("wrc", Net.Order);
+    TEST_ASSERT_TRUE(Session.connected);
+    TEST_ASSERT_EQUAL_INT64(Resolve_Takes_us, Prewarm.timing.dns_us);
+    TEST_ASSERT_EQUAL_INT64(Connect_Takes_us, Prewarm.timing.connect_us);
+    TEST_ASSERT_EQUAL_INT64(Resolve_Takes_us + Connect_Takes_us, Prewarm.timing.total_us);
+    TEST_ASSERT_EQUAL_UINT32(1, Prewarm.runs);
+}
+
+// the point of it, the handshake is already paid for when the upload starts
+void test_Upload_Reuses_The_Prewarmed_Connection() {
+    gemini_prewarm_run(&Prewarm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_WARM, gemini_prewarm_claim(&Prewarm));
+    BodySink Sink = {0};
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink));
+    TEST_ASSERT_TRUE(Session.timing.reused);
+    TEST_ASSERT_EQUAL_INT64(0, Session.timing.connect_us);
+    TEST_ASSERT_EQUAL_INT(1, Net.Connects);
+    TEST_ASSERT_EQUAL_size_t(2, Sink.Len);
+    gemini_prewarm_release(&Prewarm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_IDLE, Prewarm.state);
+    TEST_ASSERT_EQUAL_INT(0, Net.Sleeps); // the answer may still be downloading
+    gemini_prewarm_done(&Prewarm);
+    TEST_ASSERT_EQUAL_STRING("wrcs", Net.Order);
+    gemini_prewarm_done(&Prewarm);
+    TEST_ASSERT_EQUAL_INT(1, Net.Sleeps);
+}
+
+// a press soon after the last question finds its connection still open
+void test_Connected_Session_Is_Not_Reconnected() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_connect(&Session));
+    TEST_ASSERT_TRUE(gemini_prewarm_run(&Prewarm));
+    TEST_ASSERT_EQUAL_INT(1, Net.Connects);
+    TEST_ASSERT_EQUAL_INT64(0, Prewarm.timing.connect_us);
+}
+
+void test_Failed_Resolve_Skips_The_Connect() {
+    Net.Resolve_Fails = true;
+    TEST_ASSERT_FALSE(gemini_prewarm_run(&Prewarm));
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_FAILED, Prewarm.state);
+    TEST_ASSERT_EQUAL_INT(0, Net.Connects);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_FAILED, gemini_prewarm_claim(&Prewarm));
+}
+
+void test_Failed_Connect_Leaves_Upload_To_Connect() {
+    Net.Connect_Fails = true;
+    TEST_ASSERT_FALSE(gemini_prewarm_run(&Prewarm));
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_FAILED, gemini_prewarm_claim(&Prewarm));
+    Net.Connect_Fails = false; // the radio was still waking up, say
+    BodySink Sink = {0};
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink));
+    TEST_ASSERT_FALSE(Session.timing.reused);
+    TEST_ASSERT_EQUAL_STRING("wrcc", Net.Order);
+    TEST_ASSERT_EQUAL_INT(1, Net.Connects);
+    gemini_prewarm_release(&Prewarm);
+}
+
+// the recording is dropped part way through the tls handshake
+void test_Cancel_During_Handshake_Closes_After() {
+    Net.Block = BLOCK_CONNECT;
+    pthread_t Worker;
+    bool Warm = true;
+    pthread_create(&Worker, NULL, helper_Run_Thread, &Warm);
+    helper_Wait_Entered();
+    gemini_prewarm_cancel(&Prewarm);
+    TEST_ASSERT_EQUAL_INT(0, Net.Closes); // nothing to close until the connect comes back
+    helper_Let_Go();
+    pthread_join(Worker, NULL);
+    TEST_ASSERT_FALSE(Warm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_CANCELLED, Prewarm.state);
+    TEST_ASSERT_FALSE(Session.connected);
+    TEST_ASSERT_EQUAL_INT(1, Net.Closes);
+    TEST_ASSERT_EQUAL_STRING("wrcs", Net.Order);
+}
+
+void test_Cancel_Before_Connect_Skips_It() {
+    Net.Block = BLOCK_RESOLVE;
+    pthread_t Worker;
+    bool Warm = true;
+    pthread_create(&Worker, NULL, helper_Run_Thread, &Warm);
+    helper_Wait_Entered();
+    gemini_prewarm_cancel(&Prewarm);
+    helper_Let_Go();
+    pthread_join(Worker, NULL);
+    TEST_ASSERT_FALSE(Warm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_CANCELLED, Prewarm.state);
+    TEST_ASSERT_EQUAL_STRING("wrs", Net.Order);
+}
+
+void test_Cancel_When_Warm_Closes_Now() {
+    gemini_prewarm_run(&Prewarm);
+    gemini_prewarm_cancel(&Prewarm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_CANCELLED, Prewarm.state);
+    TEST_ASSERT_FALSE(Session.connected);
+    TEST_ASSERT_EQUAL_STRING("wrcs", Net.Order);
+    TEST_ASSERT_TRUE(gemini_prewarm_run(&Prewarm)); // the next press starts over
+    TEST_ASSERT_EQUAL_INT(2, Net.Connects);
+}
+
+// the upload owns the session, the pipeline's abort stops it its own way
+void test_Cancel_After_Claim_Leaves_Upload_Alone() {
+    gemini_prewarm_run(&Prewarm);
+    gemini_prewarm_claim(&Prewarm);
+    gemini_prewarm_cancel(&Prewarm);
+    TEST_ASSERT_TRUE(Session.connected);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_WARM, Prewarm.state);
+    TEST_ASSERT_EQUAL_INT(0, Net.Sleeps);
+    gemini_prewarm_release(&Prewarm);
+}
+
+// a press and release quicker than the handshake, the upload waits for
+// it instead of starting a second connection on the same session
+void test_Claim_Waits_For_Run_In_Flight() {
+    Net.Block = BLOCK_CONNECT;
+    pthread_t Worker, Claiming;
+    bool Warm = false;
+    Claimer Claim = {.Prewarm = &Prewarm};
+    pthread_create(&Worker, NULL, helper_Run_Thread, &Warm);
+    helper_Wait_Entered();
+    pthread_create(&Claiming, NULL, helper_Claim_Thread, &Claim);
+    helper_Sleep_ms(50);
+    TEST_ASSERT_FALSE(Claim.Returned);
+    helper_Let_Go();
+    pthread_join(Worker, NULL);
+    pthread_join(Claiming, NULL);
+    TEST_ASSERT_TRUE(Warm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_PREWARM_WARM, Claim.State);
+    TEST_ASSERT_EQUAL_INT(1, Net.Connects);
+    gemini_prewarm_release(&Prewarm);
+}
+
+void test_Second_Press_Does_Not_Start_Another() {
+    Net.Block = BLOCK_CONNECT;
+    pthread_t Worker;
+    bool Warm = false;
+    pthread_create(&Worker, NULL, helper_Run_Thread, &Warm);
+    helper_Wait_Entered();
+    TEST_ASSERT_FALSE(gemini_prewarm_run(&Prewarm)); // bounced, or pressed twice
+    helper_Let_Go();
+    pthread_join(Worker, NULL);
+    TEST_ASSERT_TRUE(Warm);
+    TEST_ASSERT_EQUAL_UINT32(1, Prewarm.runs);
+    gemini_prewarm_claim(&Prewarm);
+    TEST_ASSERT_FALSE(gemini_prewarm_run(&Prewarm)); // pressed while the answer comes in
+    TEST_ASSERT_EQUAL_UINT32(1, Prewarm.runs);
+    gemini_prewarm_release(&Prewarm);
+    TEST_ASSERT_TRUE(gemini_prewarm_run(&Prewarm));
+    TEST_ASSERT_EQUAL_INT(1, Net.Connects);
+    TEST_ASSERT_EQUAL_INT(1, Net.Wakes); // still awake from the first
+}
+
+// each question is asked on a fresh full handshake, the cold one connects
+// once the button is let go and the other from the press. with the
+// stand-in's --handshake-delay-ms the connection costs what it would over
+// wifi, the short recording ends before the prewarm has finished
+void test_Standin_Press_To_First_Byte_Cold_And_Prewarmed() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    gemini_prewarm_t Standin_Prewarm;
+    const char *Port = getenv("GEMINI_STANDIN_PORT");
+    const gemini_transport_t Transport = {helper_Tls_Connect, helper_Tls_Write, helper_Tls_Read, helper_Tls_Close,
+                                          &Client, NULL};
+    gemini_session_init(&Standin, &Transport, "127.0.0.1", Port ? atoi(Port) : 8443, NULL);
+    if (gemini_session_connect(&Standin) != GEMINI_SESSION_OK) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    gemini_session_close(&Standin);
+    const gemini_prewarm_ops_t Ops = {.resolve = helper_Standin_Resolve};
+    TEST_ASSERT_TRUE(gemini_prewarm_init(&Standin_Prewarm, &Standin, &Ops));
+
+    const int Recording_ms[] = {400, 60};
+    for (int r = 0; r < 2; r++) {
+        int64_t Cold[5], Warm[5];
+        for (int i = 0; i < 5; i++) {
+            Cold[i] = helper_Press_To_First_Byte(&Standin_Prewarm, &Standin, false, Recording_ms[r]);
+            TEST_ASSERT_FALSE(Standin.timing.reused);
+            Warm[i] = helper_Press_To_First_Byte(&Standin_Prewarm, &Standin, true, Recording_ms[r]);
+            TEST_ASSERT_TRUE(Standin.timing.reused);
+            TEST_ASSERT_EQUAL_INT64(0, Standin.timing.connect_us);
+        }
+        const int64_t Cold_us = helper_Median(Cold, 5);
+        const int64_t Warm_us = helper_Median(Warm, 5);
+        char Line[160];
+        snprintf(Line, sizeof(Line),
+                 "%d ms recording, press to first byte: %lld us cold, %lld us prewarmed (handshake %lld us)",
+                 Recording_ms[r], (long long)Cold_us, (long long)Warm_us,
+                 (long long)Standin_Prewarm.timing.connect_us);
+        TEST_MESSAGE(Line);
+        TEST_ASSERT_TRUE(Warm_us < Cold_us);
+    }
+    gemini_prewarm_deinit(&Standin_Prewarm);
+}
+
+// HELPER FUNCTIONS
+static void helper_Radio_Wake(void *ctx) {
+    FakeNet *Fake = (FakeNet *)ctx;
+    Fake->Wakes++;
+    strcat(Fake->Order, "w");
+}
+
+static void helper_Radio_Sleep(void *ctx) {
+    FakeNet *Fake = (FakeNet *)ctx;
+    Fake->Sleeps++;
+    strcat(Fake->Order, "s");
+}
+
+static int helper_Resolve(void *ctx, const char *host) {
+    FakeNet *Fake = (FakeNet *)ctx;
+    TEST_ASSERT_EQUAL_STRING("generativelanguage.googleapis.com", host);
+    Fake->Resolves++;
+    strcat(Fake->Order, "r");
+    helper_Gate(BLOCK_RESOLVE);
+    Fake_Now_us += Resolve_Takes_us;
+    return Fake->Resolve_Fails ? -1 : 0;
+}
+
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    FakeNet *Fake = (FakeNet *)ctx;
+    strcat(Fake->Order, "c");
+    helper_Gate(BLOCK_CONNECT);
+    Fake_Now_us += Connect_Takes_us;
+    if (Fake->Connect_Fails) {
+        return -1;
+    }
+    Fake->Connects++;
+    return 0;
+}
+
+// the request goes out whole before anything is read, so each write
+// starts the reply over
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len) {
+    ((FakeNet *)ctx)->Reply_Pos = 0;
+    return (int)len;
+}
+
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    FakeNet *Fake = (FakeNet *)ctx;
+    size_t Left = strlen(Reply) - Fake->Reply_Pos;
+    size_t Take = Left < len ? Left : len;
+    memcpy(buf, Reply + Fake->Reply_Pos, Take);
+    Fake->Reply_Pos += Take;
+    return Take > 0 ? (int)Take : GEMINI_TRANSPORT_TIMEOUT;
+}
+
+static void helper_Fake_Close(void *ctx) { ((FakeNet *)ctx)->Closes++; }
+
+static int64_t helper_Fake_Clock(void) { return Fake_Now_us; }
+
+// holds the op at until helper_Let_Go when it is the one being blocked
+static void helper_Gate(BlockAt at) {
+    pthread_mutex_lock(&Net.Gate_Lock);
+    if (Net.Block == at) {
+        Net.Entered = true;
+        pthread_cond_broadcast(&Net.Gate_Changed);
+        while (!Net.Released) {
+            pthread_cond_wait(&Net.Gate_Changed, &Net.Gate_Lock);
+        }
+    }
+    pthread_mutex_unlock(&Net.Gate_Lock);
+}
+
+static void helper_Wait_Entered(void) {
+    pthread_mutex_lock(&Net.Gate_Lock);
+    while (!Net.Entered) {
+        pthread_cond_wait(&Net.Gate_Changed, &Net.Gate_Lock);
+    }
+    pthread_mutex_unlock(&Net.Gate_Lock);
+}
+
+static void helper_Let_Go(void) {
+    pthread_mutex_lock(&Net.Gate_Lock);
+    Net.Released = true;
+    pthread_cond_broadcast(&Net.Gate_Changed);
+    pthread_mutex_unlock(&Net.Gate_Lock);
+}
+
+// the prewarm task the button press wakes
+static void *helper_Run_Thread(void *arg) {
+    *(bool *)arg = gemini_prewarm_run(&Prewarm);
+    return NULL;
+}
+
+static void *helper_Standin_Run_Thread(void *arg) {
+    gemini_prewarm_run((gemini_prewarm_t *)arg);
+    return NULL;
+}
+
+static void *helper_Claim_Thread(void *arg) {
+    Claimer *Claim = (Claimer *)arg;
+    Claim->State = gemini_prewarm_claim(Claim->Prewarm);
+    Claim->Returned = true;
+    return NULL;
+}
+
+static bool helper_Sink_Body(void *ctx, const char *data, size_t len) {
+    BodySink *Sink = (BodySink *)ctx;
+    if (Sink->Len == 0 && Sink->Session) {
+        Sink->First_Byte_us = Sink->Session->now_us();
+    }
+    Sink->Len += len;
+    return true;
+}
+
+static gemini_session_err_t helper_Post(gemini_session_t *session, BodySink *sink) {
+    static const gemini_header_t Headers[] = {{"Content-Type", "application/octet-stream"}};
+    const char *Body = "question";
+    const gemini_request_t Request = {
+        .method = "POST",
+        .path = "/upload",
+        .headers = Headers,
+        .header_count = 1,
+        .body = Body,
+        .body_len = strlen(Body),
+        .on_body = helper_Sink_Body,
+        .ctx = sink,
+    };
+    int Status = 0;
+    gemini_session_err_t Err = gemini_session_request(session, &Request, &Status);
+    if (Err == GEMINI_SESSION_OK) {
+        TEST_ASSERT_EQUAL_INT(200, Status);
+    }
+    return Err;
+}
+
+static void helper_Sleep_ms(int ms) {
+    struct timespec Wait = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&Wait, NULL);
+}
+
+// one question, the press to the first byte of the answer. the prewarm
+// runs on its own thread like the task the button's interrupt wakes
+static int64_t helper_Press_To_First_Byte(gemini_prewarm_t *prewarm, gemini_session_t *session, bool prewarm_on_press,
+                                          int recording_ms) {
+    BodySink Sink = {.Session = session};
+    pthread_t Worker;
+    const int64_t Press_us = session->now_us();
+    if (prewarm_on_press) {
+        pthread_create(&Worker, NULL, helper_Standin_Run_Thread, prewarm);
+    }
+    helper_Sleep_ms(recording_ms);
+    gemini_prewarm_claim(prewarm);
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(session, &Sink));
+    gemini_prewarm_release(prewarm);
+    if (prewarm_on_press) {
+        pthread_join(Worker, NULL);
+    }
+    gemini_session_close(session); // the next question starts cold
+    TEST_ASSERT_TRUE(Sink.Len > 0);
+    return Sink.First_Byte_us - Press_us;
+}
+
+static int64_t helper_Median(int64_t *values, int count) {
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && values[j] < values[j - 1]; j--) {
+            int64_t Swap = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = Swap;
+        }
+    }
+    return values[count / 2];
+}
+
+static int helper_Standin_Resolve(void *ctx, const char *host) {
+    struct addrinfo Hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *Address;
+    if (getaddrinfo(host, NULL, &Hints, &Address) != 0) {
+        return -1;
+    }
+    freeaddrinfo(Address);
+    return 0;
+}
+
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    TlsClient *Client = (TlsClient *)ctx;
+    static SSL_CTX *Tls_Context;
+    if (!Tls_Context) {
+        Tls_Context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_max_proto_version(Tls_Context, TLS1_2_VERSION);
+    }
+    char Port[8];
+    snprintf(Port, sizeof(Port), "%d", port);
+    struct addrinfo Hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *Address;
+    if (getaddrinfo(host, Port, &Hints, &Address) != 0) {
+        return -1;
+    }
+    int Socket = socket(Address->ai_family, Address->ai_socktype, 0);
+    int Connected = Socket >= 0 ? connect(Socket, Address->ai_addr, Address->ai_addrlen) : -1;
+    freeaddrinfo(Address);
+    if (Connected != 0) {
+        if (Socket >= 0) {
+            close(Socket);
+        }
+        return -1;
+    }
+    int No_Delay = 1; // same as the esp_tls transport
+    setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, &No_Delay, sizeof(No_Delay));
+    Client->Tls = SSL_new(Tls_Context);
+    SSL_set_fd(Client->Tls, Socket);
+    if (SSL_connect(Client->Tls) != 1) {
+        helper_Tls_Close(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len) {
+    int Sent = SSL_write(((TlsClient *)ctx)->Tls, data, (int)len);
+    return Sent > 0 ? Sent : -1;
+}
+
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    SSL *Tls = ((TlsClient *)ctx)->Tls;
+    if (SSL_pending(Tls) == 0) {
+        struct pollfd Wait = {.fd = SSL_get_fd(Tls), .events = POLLIN};
+        int Ready = poll(&Wait, 1, timeout_ms);
+        if (Ready == 0) {
+            return GEMINI_TRANSPORT_TIMEOUT;
+        }
+        if (Ready < 0) {
+            return -1;
+        }
+    }
+    int Got = SSL_read(Tls, buf, (int)len);
+    if (Got > 0) {
+        return Got;
+    }
+    return SSL_get_error(Tls, Got) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+}
+
+static void helper_Tls_Close(void *ctx) {
+    TlsClient *Client = (TlsClient *)ctx;
+    if (Client->Tls) {
+        int Socket = SSL_get_fd(Client->Tls);
+        SSL_shutdown(Client->Tls);
+        SSL_free(Client->Tls);
+        close(Socket);
+        Client->Tls = NULL;
+    }
+}
+
+#endif
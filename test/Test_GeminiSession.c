@@ -0,0 +1,1124 @@
+/*Gemini keep-alive session unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the http framing, connection reuse and reconnect policy
+    against an in-memory fake server, including request bodies pulled from a
+    callback, then measures cold and warm time to first byte, full against
+    resumed tls handshakes and the first streamed event against the last,
+    checks big uploads arrive whole and that an audio question goes out
+    while it is still being recorded, against the local https stand-in when
+    it is running
+    run the stand-in with: python3 test/standin/https_standin.py --port 8443
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_GEMINI_SESSION)
+
+#include "GeminiPayload.h"
+#include "GeminiSession.h"
+#include "GeminiSse.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+// fake server, every request gets Reply back
+typedef struct {
+    const char *Reply;
+    size_t Reply_Pos;
+    bool Reply_Pending;
+    size_t Read_Step;             // most bytes handed out per read, 0 for all
+    int Replies_Per_Connection;   // closes after this many, 0 never
+    int Replies_On_Connection;
+    int Connects;
+    int Closes;
+    bool Resumes; // every connect after the first resumes the tls session
+    char Written[8192];
+    size_t Written_Len;
+} FakeServer;
+
+// body collected by the on_body callback
+typedef struct {
+    char Data[512];
+    size_t Len;
+    size_t Abort_After; // 0 never aborts
+    gemini_session_t *Session; // clock for First_Byte_us, may be NULL
+    int64_t First_Byte_us;
+} BodySink;
+
+// request body made up a piece at a time, byte i is helper_Source_Byte(i)
+typedef struct {
+    size_t Len;
+    size_t Pos;
+    size_t Step;   // most bytes handed out per read, 0 for all that fit
+    int Rewinds;
+    bool Fail;     // body_read reports an error
+} BodySource;
+
+// synthetic recording, a 440 Hz tone handed over 20 ms at a time. paced
+// ones only have a frame once it would have been recorded
+typedef struct {
+    size_t Total;
+    size_t Pos;
+    bool Paced;
+    int64_t Start_us;
+    int64_t Stop_us;   // when the last sample was handed over
+    double Last[2];    // oscillator state
+    EVP_MD_CTX *Hash;  // of every sample handed over
+    gemini_session_t *Session;
+} PcmClip;
+
+// events the sse parser handed out
+typedef struct {
+    gemini_sse_parser_t Parser;
+    char Buffer[1024];
+    char Names[8][GEMINI_SSE_EVENT_MAX];
+    char Events[8][1024];
+    size_t Lens[8];
+    int Count;
+    int Stop_After; // 0 never stops
+    char Data[4096]; // streamed data of every event run together
+    size_t Data_Len;
+    int Data_Calls;
+    int Stop_Data_After; // 0 never stops
+    gemini_session_t *Session; // clock for First_Event_us, may be NULL
+    int64_t First_Event_us;
+} EventSink;
+
+// openssl client for the stand-in. the ticket is kept across connects the
+// way the esp_tls transport keeps it, capped at tls 1.2 to match mbedtls
+typedef struct {
+    SSL *Tls;
+    SSL_SESSION *Ticket;
+    bool Resumed;
+} TlsClient;
+
+// standard values
+static FakeServer Server;
+static gemini_session_t Session;
+static int64_t Fake_Now_us;
+static const char *Content_Length_Reply =
+    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"text\":\"hi\"}";
+static const char *Chunked_Reply =
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "5\r\n{\"tex\r\n8;ext=1\r\nt\":\"hi\"}\r\n0\r\nX-Trailer: 1\r\n\r\n";
+static const char *Close_Reply =
+    "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok";
+static const char *Sse_Reply =
+    "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "18\r\ndata: {\"text\":\"Hel\"}\r\n\r\n\r\n"
+    "17\r\ndata: {\"text\":\"lo\"}\r\n\r\n\r\n0\r\n\r\n";
+
+// PROTOTYPING HELPERS
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Fake_Close(void *ctx);
+static bool helper_Fake_Resumed(void *ctx);
+static int64_t helper_Fake_Clock(void);
+static bool helper_Sink_Body(void *ctx, const char *data, size_t len);
+static gemini_session_err_t helper_Post(gemini_session_t *session, BodySink *sink, int *status);
+static uint8_t helper_Source_Byte(size_t i);
+static int helper_Source_Read(void *ctx, uint8_t *buf, size_t size);
+static bool helper_Source_Rewind(void *ctx);
+static gemini_session_err_t helper_Post_Pulled(gemini_session_t *session, const char *path, BodySource *source,
+                                               size_t body_len, bool rewind, BodySink *sink, int *status);
+static int helper_Pcm_Read(void *ctx, int16_t *samples, size_t max_samples);
+static int helper_Payload_Pull(void *ctx, uint8_t *buf, size_t size);
+static int64_t helper_Standin_Audio(gemini_session_t *session, size_t samples, bool paced, BodySink *sink);
+static const char *helper_Written_Body(void);
+static void helper_Event_Sink(EventSink *sink);
+static void helper_Streamed_Sink(EventSink *sink);
+static bool helper_Sink_Event(void *ctx, const char *event, const char *data, size_t len);
+static bool helper_Sink_Data(void *ctx, const char *bytes, size_t len);
+static bool helper_Sse_Body(void *ctx, const char *data, size_t len);
+static gemini_session_err_t helper_Stream(gemini_session_t *session, EventSink *sink, int *status);
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Tls_Close(void *ctx);
+static bool helper_Tls_Resumed(void *ctx);
+static bool helper_Standin_Session(gemini_session_t *session, TlsClient *client);
+static int64_t helper_Standin_Handshake(gemini_session_t *session, bool *resumed);
+
+// PROTOTYPING TESTS
+void test_Request_Is_Framed();
+void test_Content_Length_Body_In_Small_Reads();
+void test_Chunked_Body_Is_Reassembled();
+void test_Connection_Is_Reused();
+void test_Reconnects_When_Server_Dropped_Connection();
+void test_Idle_Timeout_Starts_Fresh_Connection();
+void test_Max_Requests_Policy();
+void test_Connection_Close_Reply_Closes();
+void test_Aborted_Body_Is_Not_Retried();
+void test_Connect_Prewarms_Without_Reconnecting();
+void test_Resumed_Handshake_Is_Reported();
+void test_Standin_Cold_And_Warm_Time_To_First_Byte();
+void test_Standin_Full_And_Resumed_Handshake();
+void test_Sse_Events_Split_Anywhere();
+void test_Sse_Line_Endings_Comments_And_Fields();
+void test_Sse_Oversize_Event_Is_Dropped();
+void test_Sse_Callback_Stops_Stream();
+void test_Sse_Streamed_Event_Has_No_Size_Limit();
+void test_Sse_Streamed_Data_Callback_Stops_Stream();
+void test_Sse_Over_Chunked_Session_Reply();
+void test_Standin_Stream_First_Event_Before_Last();
+void test_Pulled_Body_With_Content_Length();
+void test_Pulled_Body_Goes_Chunked();
+void test_Pulled_Body_Wrong_Length_Fails();
+void test_Pulled_Body_Is_Rewound_For_Retry();
+void test_Pulled_Body_Error_Aborts();
+void test_Standin_Upload_Is_Reassembled();
+void test_Standin_Audio_Question_While_Recording();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+    memset(&Server, 0, sizeof(Server));
+    Server.Reply = Content_Length_Reply;
+    Fake_Now_us = 1000000;
+    const gemini_transport_t Transport = {helper_Fake_Connect, helper_Fake_Write, helper_Fake_Read,
+                                          helper_Fake_Close, &Server, helper_Fake_Resumed};
+    gemini_session_init(&Session, &Transport, "example.com", 443, NULL);
+    Session.now_us = helper_Fake_Clock;
+}
+void tearDown(void) { gemini_session_close(&Session); }
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Request_Is_Framed);
+    RUN_TEST(test_Content_Length_Body_In_Small_Reads);
+    RUN_TEST(test_Chunked_Body_Is_Reassembled);
+    RUN_TEST(test_Connection_Is_Reused);
+    RUN_TEST(test_Reconnects_When_Server_Dropped_Connection);
+    RUN_TEST(test_Idle_Timeout_Starts_Fresh_Connection);
+    RUN_TEST(test_Max_Requests_Policy);
+    RUN_TEST(test_Connection_Close_Reply_Closes);
+    RUN_TEST(test_Aborted_Body_Is_Not_Retried);
+    RUN_TEST(test_Connect_Prewarms_Without_Reconnecting);
+    RUN_TEST(test_Resumed_Handshake_Is_Reported);
+    RUN_TEST(test_Standin_Cold_And_Warm_Time_To_First_Byte);
+    RUN_TEST(test_Standin_Full_And_Resumed_Handshake);
+    RUN_TEST(test_Sse_Events_Split_Anywhere);
+    RUN_TEST(test_Sse_Line_Endings_Comments_And_Fields);
+    RUN_TEST(test_Sse_Oversize_Event_Is_Dropped);
+    RUN_TEST(test_Sse_Callback_Stops_Stream);
+    RUN_TEST(test_Sse_Streamed_Event_Has_No_Size_Limit);
+    RUN_TEST(test_Sse_Streamed_Data_Callback_Stops_Stream);
+    RUN_TEST(test_Sse_Over_Chunked_Session_Reply);
+    RUN_TEST(test_Standin_Stream_First_Event_Before_Last);
+    RUN_TEST(test_Pulled_Body_With_Content_Length);
+    RUN_TEST(test_Pulled_Body_Goes_Chunked);
+    RUN_TEST(test_Pulled_Body_Wrong_Length_Fails);
+    RUN_TEST(test_Pulled_Body_Is_Rewound_For_Retry);
+    RUN_TEST(test_Pulled_Body_Error_Aborts);
+    RUN_TEST(test_Standin_Upload_Is_Reassembled);
+    RUN_TEST(test_Standin_Audio_Question_While_Recording);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Request_Is_Framed() {
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    Server.Written[Server.Written_Len] = '\0';
+    TEST_ASSERT_EQUAL_STRING("POST /v1beta/models/test:generateContent HTTP/1.1\r\n"
+                             "Host: example.com\r\n"
+                             "Connection: keep-alive\r\n"
+                             "Content-Length: 9\r\n"
+                             "Content-Type: application/json\r\n"
+                             "\r\n"
+                             "{\"q\":\"a\"}",
+                             Server.Written);
+}
+
+void test_Content_Length_Body_In_Small_Reads() {
+    Server.Read_Step = 5; // splits the status line, headers and body
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"hi\"}", Sink.Data);
+}
+
+void test_Chunked_Body_Is_Reassembled() {
+    Server.Reply = Chunked_Reply;
+    Server.Read_Step = 3;
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"hi\"}", Sink.Data);
+    TEST_ASSERT_TRUE(Session.connected); // chunked replies keep the connection
+}
+
+void test_Connection_Is_Reused() {
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post(&Session, &Sink, &Status);
+    TEST_ASSERT_FALSE(Session.timing.reused);
+    Fake_Now_us += 1000;
+    Sink.Len = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_TRUE(Session.timing.reused);
+    TEST_ASSERT_EQUAL_INT(0, Session.timing.connect_us);
+    TEST_ASSERT_EQUAL_INT(1, Server.Connects);
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"hi\"}", Sink.Data);
+}
+
+void test_Reconnects_When_Server_Dropped_Connection() {
+    Server.Replies_Per_Connection = 1;
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post(&Session, &Sink, &Status);
+    Sink.Len = 0;
+    // the server quietly closed after the first reply, the retry goes out
+    // on a new connection and the caller never sees the failure
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    TEST_ASSERT_EQUAL_INT(2, Server.Connects);
+    TEST_ASSERT_FALSE(Session.timing.reused);
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"hi\"}", Sink.Data);
+}
+
+void test_Idle_Timeout_Starts_Fresh_Connection() {
+    gemini_session_policy_t Policy = GEMINI_SESSION_POLICY_DEFAULT;
+    Policy.idle_timeout_ms = 5000;
+    gemini_session_set_policy(&Session, &Policy);
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post(&Session, &Sink, &Status);
+    Fake_Now_us += 4000 * 1000;
+    helper_Post(&Session, &Sink, &Status);
+    TEST_ASSERT_EQUAL_INT(1, Server.Connects);
+
+    Fake_Now_us += 5000 * 1000;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(2, Server.Connects);
+    TEST_ASSERT_EQUAL_INT(1, Server.Closes);
+    TEST_ASSERT_FALSE(Session.timing.reused);
+}
+
+void test_Max_Requests_Policy() {
+    gemini_session_policy_t Policy = GEMINI_SESSION_POLICY_DEFAULT;
+    Policy.max_requests = 2;
+    gemini_session_set_policy(&Session, &Policy);
+    BodySink Sink = {0};
+    int Status = 0;
+    for (int i = 0; i < 5; i++) {
+        Sink.Len = 0;
+        TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    }
+    TEST_ASSERT_EQUAL_INT(3, Server.Connects);
+}
+
+void test_Connection_Close_Reply_Closes() {
+    Server.Reply = Close_Reply;
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_STRING("ok", Sink.Data);
+    TEST_ASSERT_FALSE(Session.connected);
+    TEST_ASSERT_EQUAL_INT(1, Server.Closes);
+}
+
+void test_Aborted_Body_Is_Not_Retried() {
+    Server.Read_Step = 4;
+    BodySink Sink = {.Abort_After = 1};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_ERR_ABORTED, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(1, Server.Connects);
+    TEST_ASSERT_FALSE(Session.connected); // rest of the body is still on the wire
+}
+
+void test_Connect_Prewarms_Without_Reconnecting() {
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_connect(&Session));
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_connect(&Session));
+    TEST_ASSERT_EQUAL_INT(1, Server.Connects);
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post(&Session, &Sink, &Status);
+    TEST_ASSERT_TRUE(Session.timing.reused);
+}
+
+void test_Resumed_Handshake_Is_Reported() {
+    Server.Resumes = true;
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post(&Session, &Sink, &Status);
+    TEST_ASSERT_FALSE(Session.timing.resumed);
+    gemini_session_close(&Session);
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Session, &Sink, &Status));
+    TEST_ASSERT_FALSE(Session.timing.reused);
+    TEST_ASSERT_TRUE(Session.timing.resumed);
+    helper_Post(&Session, &Sink, &Status);
+    TEST_ASSERT_TRUE(Session.timing.reused);
+    TEST_ASSERT_FALSE(Session.timing.resumed); // no handshake at all
+}
+
+// real tls against the stand-in, cold is dns + tcp + tls + request, warm
+// is only the request. skipped when the stand-in isn't running
+void test_Standin_Cold_And_Warm_Time_To_First_Byte() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Client)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    SSL_SESSION_free(Client.Ticket); // cold means a full handshake
+    Client.Ticket = NULL;
+
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Standin, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    gemini_session_timing_t Cold = Standin.timing;
+    Sink.Len = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post(&Standin, &Sink, &Status));
+    gemini_session_timing_t Warm = Standin.timing;
+    TEST_ASSERT_TRUE(Warm.reused);
+    TEST_ASSERT_EQUAL_INT(2, Standin.connects);
+    TEST_ASSERT_NOT_NULL(strstr(Sink.Data, "Hello from the stand-in."));
+
+    char Line[128];
+    snprintf(Line, sizeof(Line), "cold: connect %lld us, first byte %lld us", (long long)Cold.connect_us,
+             (long long)Cold.ttfb_us);
+    TEST_MESSAGE(Line);
+    snprintf(Line, sizeof(Line), "warm: connect %lld us, first byte %lld us", (long long)Warm.connect_us,
+             (long long)Warm.ttfb_us);
+    TEST_MESSAGE(Line);
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Client.Ticket);
+}
+
+// best of a few handshakes each way so scheduling noise doesn't decide it.
+// the ticket is then pushed through der and back, the way it goes through
+// nvs over a reboot, and must still resume
+void test_Standin_Full_And_Resumed_Handshake() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Client)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    int64_t Full_us = INT64_MAX;
+    int64_t Resumed_us = INT64_MAX;
+    bool Resumed;
+    for (int i = 0; i < 5; i++) {
+        SSL_SESSION_free(Client.Ticket);
+        Client.Ticket = NULL;
+        int64_t Took = helper_Standin_Handshake(&Standin, &Resumed);
+        TEST_ASSERT_FALSE(Resumed);
+        Full_us = Took < Full_us ? Took : Full_us;
+        Took = helper_Standin_Handshake(&Standin, &Resumed);
+        TEST_ASSERT_TRUE(Resumed);
+        Resumed_us = Took < Resumed_us ? Took : Resumed_us;
+    }
+
+    unsigned char Saved[4096];
+    unsigned char *Write = Saved;
+    TEST_ASSERT_TRUE(i2d_SSL_SESSION(Client.Ticket, NULL) <= (int)sizeof(Saved));
+    int Saved_Len = i2d_SSL_SESSION(Client.Ticket, &Write);
+    SSL_SESSION_free(Client.Ticket);
+    const unsigned char *Read = Saved;
+    Client.Ticket = d2i_SSL_SESSION(NULL, &Read, Saved_Len);
+    TEST_ASSERT_NOT_NULL(Client.Ticket);
+    int64_t Reboot_us = helper_Standin_Handshake(&Standin, &Resumed);
+    TEST_ASSERT_TRUE(Resumed);
+
+    char Line[128];
+    snprintf(Line, sizeof(Line), "full handshake %lld us, resumed %lld us, resumed after reload %lld us",
+             (long long)Full_us, (long long)Resumed_us, (long long)Reboot_us);
+    TEST_MESSAGE(Line);
+    TEST_ASSERT_TRUE(Resumed_us < Full_us);
+    SSL_SESSION_free(Client.Ticket);
+}
+
+void test_Sse_Events_Split_Anywhere() {
+    const char *Stream = "data: {\"a\":1}\r\n\r\ndata: {\"b\":2}\r\n\r\n";
+    for (size_t Step = 1; Step <= strlen(Stream); Step++) {
+        EventSink Sink;
+        helper_Event_Sink(&Sink);
+        for (size_t i = 0; i < strlen(Stream); i += Step) {
+            size_t Left = strlen(Stream) - i;
+            TEST_ASSERT_TRUE(gemini_sse_feed(&Sink.Parser, Stream + i, Left < Step ? Left : Step));
+        }
+        TEST_ASSERT_EQUAL_INT(2, Sink.Count);
+        TEST_ASSERT_EQUAL_STRING("message", Sink.Names[0]);
+        TEST_ASSERT_EQUAL_STRING("{\"a\":1}", Sink.Events[0]);
+        TEST_ASSERT_EQUAL_STRING("{\"b\":2}", Sink.Events[1]);
+    }
+}
+
+void test_Sse_Line_Endings_Comments_And_Fields() {
+    const char *Stream = ": keep-alive\n\n"  // comment only, no event
+                         "event: delta\rid: 7\rdata:one\r\ndata\ndata:  two\n\n"
+                         "retry: 10\n\n"     // no data, no event
+                         "data: last\n";      // never finished, never delivered
+    EventSink Sink;
+    helper_Event_Sink(&Sink);
+    TEST_ASSERT_TRUE(gemini_sse_feed(&Sink.Parser, Stream, strlen(Stream)));
+    TEST_ASSERT_EQUAL_INT(1, Sink.Count);
+    TEST_ASSERT_EQUAL_STRING("delta", Sink.Names[0]);
+    TEST_ASSERT_EQUAL_STRING("one\n\n two", Sink.Events[0]);
+}
+
+void test_Sse_Oversize_Event_Is_Dropped() {
+    EventSink Sink;
+    helper_Event_Sink(&Sink);
+    char Big[sizeof(Sink.Buffer) + 16];
+    memset(Big, 'x', sizeof(Big));
+    gemini_sse_feed(&Sink.Parser, "data: ", 6);
+    gemini_sse_feed(&Sink.Parser, Big, sizeof(Big));
+    const char *Next = "\n\ndata: ok\n\n";
+    gemini_sse_feed(&Sink.Parser, Next, strlen(Next));
+    TEST_ASSERT_EQUAL_INT(1, Sink.Count);
+    TEST_ASSERT_EQUAL_STRING("ok", Sink.Events[0]);
+    TEST_ASSERT_EQUAL_INT(1, Sink.Parser.dropped);
+}
+
+void test_Sse_Callback_Stops_Stream() {
+    EventSink Sink;
+    helper_Event_Sink(&Sink);
+    Sink.Stop_After = 1;
+    const char *Stream = "data: 1\n\ndata: 2\n\n";
+    TEST_ASSERT_FALSE(gemini_sse_feed(&Sink.Parser, Stream, strlen(Stream)));
+    TEST_ASSERT_FALSE(gemini_sse_feed(&Sink.Parser, Stream, strlen(Stream)));
+    TEST_ASSERT_EQUAL_INT(1, Sink.Count);
+}
+
+// the last event of a grounded reply is several KB, streamed it gets
+// through whole however it is split
+void test_Sse_Streamed_Event_Has_No_Size_Limit() {
+    char Stream[4096];
+    size_t Len = (size_t)snprintf(Stream, sizeof(Stream), "event: big\r\ndata: ");
+    memset(Stream + Len, 'x', 3000);
+    Len += 3000;
+    Len += (size_t)snprintf(Stream + Len, sizeof(Stream) - Len, "\r\ndata: y\r\n\r\ndata: ok\r\n\r\n");
+    const size_t Steps[] = {1, 7, 1000, sizeof(Stream)};
+    for (size_t s = 0; s < sizeof(Steps) / sizeof(Steps[0]); s++) {
+        EventSink Sink;
+        helper_Streamed_Sink(&Sink);
+        for (size_t i = 0; i < Len; i += Steps[s]) {
+            size_t Left = Len - i;
+            TEST_ASSERT_TRUE(gemini_sse_feed(&Sink.Parser, Stream + i, Left < Steps[s] ? Left : Steps[s]));
+        }
+        TEST_ASSERT_EQUAL_INT(2, Sink.Count);
+        TEST_ASSERT_EQUAL_STRING("big", Sink.Names[0]);
+        TEST_ASSERT_EQUAL_size_t(3002, Sink.Lens[0]);
+        TEST_ASSERT_EQUAL_STRING("message", Sink.Names[1]);
+        TEST_ASSERT_EQUAL_size_t(2, Sink.Lens[1]);
+        TEST_ASSERT_EQUAL_size_t(3004, Sink.Data_Len);
+        TEST_ASSERT_EQUAL_CHAR('x', Sink.Data[2999]);
+        TEST_ASSERT_EQUAL_STRING("\nyok", Sink.Data + 3000);
+        TEST_ASSERT_EQUAL_INT(0, Sink.Parser.dropped);
+    }
+}
+
+void test_Sse_Streamed_Data_Callback_Stops_Stream() {
+    EventSink Sink;
+    helper_Streamed_Sink(&Sink);
+    Sink.Stop_Data_After = 1;
+    const char *Stream = "data: 1\n\ndata: 2\n\n";
+    TEST_ASSERT_FALSE(gemini_sse_feed(&Sink.Parser, Stream, strlen(Stream)));
+    TEST_ASSERT_EQUAL_INT(1, Sink.Data_Calls);
+    TEST_ASSERT_EQUAL_INT(0, Sink.Count);
+    TEST_ASSERT_EQUAL_STRING("1", Sink.Data);
+}
+
+void test_Sse_Over_Chunked_Session_Reply() {
+    Server.Reply = Sse_Reply;
+    Server.Read_Step = 7;
+    EventSink Sink;
+    helper_Event_Sink(&Sink);
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Stream(&Session, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    TEST_ASSERT_EQUAL_INT(2, Sink.Count);
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"Hel\"}", Sink.Events[0]);
+    TEST_ASSERT_EQUAL_STRING("{\"text\":\"lo\"}", Sink.Events[1]);
+    TEST_ASSERT_TRUE(Session.connected);
+}
+
+// the stand-in leaves a gap between events like the model does between
+// words, the first one should land long before the stream ends
+void test_Standin_Stream_First_Event_Before_Last() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Client)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    EventSink Sink;
+    helper_Event_Sink(&Sink);
+    Sink.Session = &Standin;
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Stream(&Standin, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    TEST_ASSERT_EQUAL_INT(5, Sink.Count);
+    TEST_ASSERT_NOT_NULL(strstr(Sink.Events[0], "\"text\": \"Hello \""));
+    TEST_ASSERT_NOT_NULL(strstr(Sink.Events[4], "finishReason"));
+    int64_t First_us = Sink.First_Event_us - Standin.request_start_us;
+
+    char Line[128];
+    snprintf(Line, sizeof(Line), "stream: first event %lld us, last event %lld us", (long long)First_us,
+             (long long)Standin.timing.total_us);
+    TEST_MESSAGE(Line);
+    TEST_ASSERT_TRUE(First_us * 2 < Standin.timing.total_us);
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Client.Ticket);
+}
+
+void test_Pulled_Body_With_Content_Length() {
+    BodySource Source = {.Len = 3000, .Step = 7};
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK,
+                          helper_Post_Pulled(&Session, "/upload", &Source, Source.Len, false, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(200, Status);
+    Server.Written[Server.Written_Len] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(Server.Written, "Content-Length: 3000\r\n"));
+    TEST_ASSERT_NULL(strstr(Server.Written, "Transfer-Encoding"));
+    const char *Body = helper_Written_Body();
+    TEST_ASSERT_EQUAL_size_t(3000, Server.Written_Len - (Body - Server.Written));
+    for (size_t i = 0; i < 3000; i++) {
+        TEST_ASSERT_EQUAL_HEX8(helper_Source_Byte(i), (uint8_t)Body[i]);
+    }
+}
+
+void test_Pulled_Body_Goes_Chunked() {
+    BodySource Source = {.Len = 3000, .Step = 100};
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post_Pulled(&Session, "/upload", &Source,
+                                                                GEMINI_BODY_LEN_CHUNKED, false, &Sink, &Status));
+    Server.Written[Server.Written_Len] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(Server.Written, "Transfer-Encoding: chunked\r\n"));
+    TEST_ASSERT_NULL(strstr(Server.Written, "Content-Length"));
+    // take the chunks apart again
+    const char *p = helper_Written_Body();
+    size_t Total = 0;
+    int Chunks = 0;
+    for (;;) {
+        char *Data;
+        size_t Size = strtoul(p, &Data, 16);
+        TEST_ASSERT_EQUAL_MEMORY("\r\n", Data, 2);
+        Data += 2;
+        if (Size == 0) {
+            TEST_ASSERT_EQUAL_STRING("\r\n", Data);
+            break;
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(GEMINI_SESSION_RX_BUFFER_SIZE, Size);
+        for (size_t i = 0; i < Size; i++) {
+            TEST_ASSERT_EQUAL_HEX8(helper_Source_Byte(Total + i), (uint8_t)Data[i]);
+        }
+        TEST_ASSERT_EQUAL_MEMORY("\r\n", Data + Size, 2);
+        Total += Size;
+        Chunks++;
+        p = Data + Size + 2;
+    }
+    TEST_ASSERT_EQUAL_size_t(3000, Total);
+    TEST_ASSERT_TRUE(Chunks >= 3); // 3000 bytes can't go through the buffer in fewer
+}
+
+void test_Pulled_Body_Wrong_Length_Fails() {
+    BodySource Source = {.Len = 100};
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_ERR_ARG,
+                          helper_Post_Pulled(&Session, "/upload", &Source, 50, false, &Sink, &Status));
+    TEST_ASSERT_FALSE(Session.connected); // the server is still waiting on the rest
+    Source.Pos = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_ERR_ARG,
+                          helper_Post_Pulled(&Session, "/upload", &Source, 200, false, &Sink, &Status));
+    TEST_ASSERT_FALSE(Session.connected);
+}
+
+// the body was already pulled onto the dead connection, it can only go
+// again if it can be started over
+void test_Pulled_Body_Is_Rewound_For_Retry() {
+    Server.Replies_Per_Connection = 1;
+    BodySource Source = {.Len = 2000};
+    BodySink Sink = {0};
+    int Status = 0;
+    helper_Post_Pulled(&Session, "/upload", &Source, Source.Len, true, &Sink, &Status);
+    Source.Pos = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK,
+                          helper_Post_Pulled(&Session, "/upload", &Source, Source.Len, true, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(1, Source.Rewinds);
+    TEST_ASSERT_EQUAL_INT(2, Server.Connects);
+
+    Source.Pos = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_ERR_IO,
+                          helper_Post_Pulled(&Session, "/upload", &Source, Source.Len, false, &Sink, &Status));
+    TEST_ASSERT_EQUAL_INT(2, Server.Connects);
+}
+
+void test_Pulled_Body_Error_Aborts() {
+    BodySource Source = {.Len = 100, .Fail = true};
+    BodySink Sink = {0};
+    int Status = 0;
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_ERR_ABORTED,
+                          helper_Post_Pulled(&Session, "/upload", &Source, GEMINI_BODY_LEN_CHUNKED, true, &Sink,
+                                             &Status));
+    TEST_ASSERT_FALSE(Session.connected);
+}
+
+// far more body than the staging buffer, both ways of framing it, and the
+// stand-in hashes what arrived
+void test_Standin_Upload_Is_Reassembled() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Client)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    const size_t Lengths[] = {4 * 1024 * 1024, 300 * 1024 + 17};
+    const size_t Body_Lens[] = {GEMINI_BODY_LEN_CHUNKED, 300 * 1024 + 17};
+    for (int i = 0; i < 2; i++) {
+        BodySource Source = {.Len = Lengths[i], .Step = 333};
+        BodySink Sink = {0};
+        int Status = 0;
+        TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, helper_Post_Pulled(&Standin, "/upload", &Source, Body_Lens[i],
+                                                                    true, &Sink, &Status));
+        TEST_ASSERT_EQUAL_INT(200, Status);
+
+        EVP_MD_CTX *Hash = EVP_MD_CTX_new();
+        EVP_DigestInit_ex(Hash, EVP_sha256(), NULL);
+        uint8_t Block[4096];
+        for (size_t Pos = 0; Pos < Source.Len; Pos += sizeof(Block)) {
+            size_t Len = Source.Len - Pos < sizeof(Block) ? Source.Len - Pos : sizeof(Block);
+            for (size_t b = 0; b < Len; b++) {
+                Block[b] = helper_Source_Byte(Pos + b);
+            }
+            EVP_DigestUpdate(Hash, Block, Len);
+        }
+        unsigned char Digest[32];
+        EVP_DigestFinal_ex(Hash, Digest, NULL);
+        EVP_MD_CTX_free(Hash);
+        char Expected[128];
+        int Len = snprintf(Expected, sizeof(Expected), "{\"length\": %zu, \"sha256\": \"", Source.Len);
+        for (int b = 0; b < 32; b++) {
+            Len += snprintf(Expected + Len, sizeof(Expected) - Len, "%02x", Digest[b]);
+        }
+        snprintf(Expected + Len, sizeof(Expected) - Len, "\"}");
+        TEST_ASSERT_EQUAL_STRING(Expected, Sink.Data);
+
+        char Line[128];
+        snprintf(Line, sizeof(Line), "%s upload of %zu bytes: %lld us", i == 0 ? "chunked" : "sized",
+                 Source.Len, (long long)Standin.timing.total_us);
+        TEST_MESSAGE(Line);
+    }
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Client.Ticket);
+}
+
+// a second of speech uploaded as it is recorded against the same clip sent
+// after the recording stopped. what counts is the time from letting go of
+// the button to the first byte of the reply
+void test_Standin_Audio_Question_While_Recording() {
+    TlsClient Client = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Client)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    const size_t Samples = 16000;
+    BodySink Live = {.Session = &Standin};
+    int64_t Live_us = helper_Standin_Audio(&Standin, Samples, true, &Live);
+    BodySink After = {.Session = &Standin};
+    int64_t After_us = helper_Standin_Audio(&Standin, Samples, false, &After);
+
+    char Line[160];
+    snprintf(Line, sizeof(Line), "release to first byte: %lld us uploading while recording, %lld us uploading after",
+             (long long)Live_us, (long long)After_us);
+    TEST_MESSAGE(Line);
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Client.Ticket);
+}
+
+// HELPER FUNCTIONS
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    Fake->Connects++;
+    Fake->Replies_On_Connection = 0;
+    Fake->Reply_Pending = false;
+    Fake_Now_us += 100000; // handshakes aren't free
+    return 0;
+}
+
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    size_t Room = sizeof(Fake->Written) - 1 - Fake->Written_Len;
+    size_t Copy = len < Room ? len : Room;
+    memcpy(Fake->Written + Fake->Written_Len, data, Copy);
+    Fake->Written_Len += Copy;
+    return (int)len;
+}
+
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    if (!Fake->Reply_Pending) {
+        if (Fake->Replies_Per_Connection != 0 &&
+            Fake->Replies_On_Connection >= Fake->Replies_Per_Connection) {
+            return 0; // server side closed
+        }
+        Fake->Reply_Pending = true;
+        Fake->Reply_Pos = 0;
+        Fake->Replies_On_Connection++;
+    }
+    size_t Left = strlen(Fake->Reply) - Fake->Reply_Pos;
+    if (Left == 0) {
+        return GEMINI_TRANSPORT_TIMEOUT;
+    }
+    size_t Step = Fake->Read_Step ? Fake->Read_Step : Left;
+    size_t Copy = Left < Step ? Left : Step;
+    Copy = Copy < len ? Copy : len;
+    memcpy(buf, Fake->Reply + Fake->Reply_Pos, Copy);
+    Fake->Reply_Pos += Copy;
+    if (Fake->Reply_Pos == strlen(Fake->Reply)) {
+        Fake->Reply_Pending = false;
+    }
+    return (int)Copy;
+}
+
+static void helper_Fake_Close(void *ctx) { ((FakeServer *)ctx)->Closes++; }
+
+static bool helper_Fake_Resumed(void *ctx) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    return Fake->Resumes && Fake->Connects > 1;
+}
+
+static int64_t helper_Fake_Clock(void) { return Fake_Now_us; }
+
+static bool helper_Sink_Body(void *ctx, const char *data, size_t len) {
+    BodySink *Sink = (BodySink *)ctx;
+    if (Sink->Abort_After != 0 && Sink->Len >= Sink->Abort_After) {
+        return false;
+    }
+    if (Sink->Len == 0 && Sink->Session) {
+        Sink->First_Byte_us = Sink->Session->now_us();
+    }
+    TEST_ASSERT_TRUE(Sink->Len + len < sizeof(Sink->Data));
+    memcpy(Sink->Data + Sink->Len, data, len);
+    Sink->Len += len;
+    Sink->Data[Sink->Len] = '\0';
+    return true;
+}
+
+static gemini_session_err_t helper_Post(gemini_session_t *session, BodySink *sink, int *status) {
+    static const gemini_header_t Headers[] = {{"Content-Type", "application/json"}};
+    const char *Body = "{\"q\":\"a\"}";
+    const gemini_request_t Request = {
+        .method = "POST",
+        .path = "/v1beta/models/test:generateContent",
+        .headers = Headers,
+        .header_count = 1,
+        .body = Body,
+        .body_len = strlen(Body),
+        .on_body = helper_Sink_Body,
+        .ctx = sink,
+    };
+    return gemini_session_request(session, &Request, status);
+}
+
+static uint8_t helper_Source_Byte(size_t i) { return (uint8_t)(i * 131 + (i >> 9)); }
+
+static int helper_Source_Read(void *ctx, uint8_t *buf, size_t size) {
+    BodySource *Source = (BodySource *)ctx;
+    if (Source->Fail) {
+        return -1;
+    }
+    size_t Len = Source->Len - Source->Pos;
+    Len = Len < size ? Len : size;
+    if (Source->Step != 0 && Len > Source->Step) {
+        Len = Source->Step;
+    }
+    for (size_t i = 0; i < Len; i++) {
+        buf[i] = helper_Source_Byte(Source->Pos + i);
+    }
+    Source->Pos += Len;
+    return (int)Len;
+}
+
+static bool helper_Source_Rewind(void *ctx) {
+    BodySource *Source = (BodySource *)ctx;
+    Source->Pos = 0;
+    Source->Rewinds++;
+    return true;
+}
+
+static gemini_session_err_t helper_Post_Pulled(gemini_session_t *session, const char *path, BodySource *source,
+                                               size_t body_len, bool rewind, BodySink *sink, int *status) {
+    static const gemini_header_t Headers[] = {{"Content-Type", "application/octet-stream"}};
+    Server.Written_Len = 0;
+    const gemini_request_t Request = {
+        .method = "POST",
+        .path = path,
+        .headers = Headers,
+        .header_count = 1,
+        .body_len = body_len,
+        .on_body = helper_Sink_Body,
+        .ctx = sink,
+        .body_read = helper_Source_Read,
+        .body_ctx = source,
+        .body_rewind = rewind ? helper_Source_Rewind : NULL,
+    };
+    return gemini_session_request(session, &Request, status);
+}
+
+static int helper_Pcm_Read(void *ctx, int16_t *samples, size_t max_samples) {
+    PcmClip *Clip = (PcmClip *)ctx;
+    const size_t Frame = 320; // 20 ms at 16 kHz
+    if (Clip->Pos == Clip->Total) {
+        if (Clip->Stop_us == 0) {
+            Clip->Stop_us = Clip->Session->now_us();
+        }
+        return 0;
+    }
+    if (Clip->Paced) {
+        // the frame ending at Pos + Frame isn't recorded until then
+        int64_t Ready_us = Clip->Start_us + (int64_t)((Clip->Pos / Frame + 1) * Frame) * 1000000 / 16000;
+        int64_t Now_us = Clip->Session->now_us();
+        if (Ready_us > Now_us) {
+            usleep((useconds_t)(Ready_us - Now_us));
+        }
+    }
+    size_t Count = Frame - Clip->Pos % Frame;
+    Count = Count < max_samples ? Count : max_samples;
+    Count = Count < Clip->Total - Clip->Pos ? Count : Clip->Total - Clip->Pos;
+    for (size_t i = 0; i < Count; i++) {
+        double Next = 1.9244 * Clip->Last[0] - Clip->Last[1]; // 2 cos(2 pi 440 / 16000)
+        Clip->Last[1] = Clip->Last[0];
+        Clip->Last[0] = Next;
+        samples[i] = (int16_t)Next;
+        uint8_t Le[2] = {(uint8_t)samples[i], (uint8_t)((uint16_t)samples[i] >> 8)};
+        EVP_DigestUpdate(Clip->Hash, Le, 2);
+    }
+    Clip->Pos += Count;
+    return (int)Count;
+}
+
+static int helper_Payload_Pull(void *ctx, uint8_t *buf, size_t size) {
+    gemini_payload_t *Payload = (gemini_payload_t *)ctx;
+    size_t Len = gemini_payload_read(Payload, (char *)buf, size);
+    return Payload->failed ? -1 : (int)Len;
+}
+
+// one audio question to the stand-in, checks it heard the whole clip and
+// returns the time from the end of the recording to the first reply byte.
+// a paced clip goes chunked as it is recorded, otherwise it is all there
+// at once and goes with its length the way it would after recording
+static int64_t helper_Standin_Audio(gemini_session_t *session, size_t samples, bool paced, BodySink *sink) {
+    static const gemini_header_t Headers[] = {{"Content-Type", "application/json"}};
+    PcmClip Clip = {.Total = samples, .Paced = paced, .Last = {0, -8000 * 0.1719}, .Session = session};
+    Clip.Hash = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(Clip.Hash, EVP_sha256(), NULL);
+    const gemini_payload_audio_t Audio = {
+        .sample_rate = 16000,
+        .total_samples = paced ? 0 : (uint32_t)samples,
+        .read = helper_Pcm_Read,
+        .ctx = &Clip,
+    };
+    gemini_payload_t Payload;
+    gemini_payload_init_audio(&Payload, "What did I say?", &Audio, NULL);
+    size_t Len = gemini_payload_len(&Payload);
+    const gemini_request_t Request = {
+        .method = "POST",
+        .path = "/v1beta/models/test:generateContent",
+        .headers = Headers,
+        .header_count = 1,
+        .body_len = Len == GEMINI_PAYLOAD_LEN_UNKNOWN ? GEMINI_BODY_LEN_CHUNKED : Len,
+        .on_body = helper_Sink_Body,
+        .ctx = sink,
+        .body_read = helper_Payload_Pull,
+        .body_ctx = &Payload,
+    };
+    int Status = 0;
+    Clip.Start_us = session->now_us();
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_request(session, &Request, &Status));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(200, Status, sink->Data);
+
+    unsigned char Digest[32];
+    EVP_DigestFinal_ex(Clip.Hash, Digest, NULL);
+    EVP_MD_CTX_free(Clip.Hash);
+    char Expected[128];
+    int Pos = snprintf(Expected, sizeof(Expected), "heard %zu samples at 16000 Hz, sha256 ", samples);
+    for (int b = 0; b < 32; b++) {
+        Pos += snprintf(Expected + Pos, sizeof(Expected) - Pos, "%02x", Digest[b]);
+    }
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(sink->Data, Expected), sink->Data);
+    // unpaced the clip was whole before the request started
+    int64_t Released_us = paced ? Clip.Stop_us : Clip.Start_us;
+    return sink->First_Byte_us - Released_us;
+}
+
+// what the fake server got after the request headers
+static const char *helper_Written_Body(void) {
+    Server.Written[Server.Written_Len] = '\0';
+    const char *End = strstr(Server.Written, "\r\n\r\n");
+    TEST_ASSERT_NOT_NULL(End);
+    return End + 4;
+}
+
+static void helper_Event_Sink(EventSink *sink) {
+    memset(sink, 0, sizeof(*sink));
+    gemini_sse_init(&sink->Parser, sink->Buffer, sizeof(sink->Buffer), helper_Sink_Event, sink);
+}
+
+static void helper_Streamed_Sink(EventSink *sink) {
+    memset(sink, 0, sizeof(*sink));
+    gemini_sse_init_streamed(&sink->Parser, helper_Sink_Data, helper_Sink_Event, sink);
+}
+
+static bool helper_Sink_Event(void *ctx, const char *event, const char *data, size_t len) {
+    EventSink *Sink = (EventSink *)ctx;
+    TEST_ASSERT_TRUE(Sink->Count < 8);
+    if (data != NULL) {
+        TEST_ASSERT_EQUAL_size_t(strlen(data), len);
+    }
+    if (Sink->Count == 0 && Sink->Session) {
+        Sink->First_Event_us = Sink->Session->now_us();
+    }
+    snprintf(Sink->Names[Sink->Count], sizeof(Sink->Names[0]), "%s", event);
+    snprintf(Sink->Events[Sink->Count], sizeof(Sink->Events[0]), "%s", data ? data : "");
+    Sink->Lens[Sink->Count] = len;
+    Sink->Count++;
+    return Sink->Stop_After == 0 || Sink->Count < Sink->Stop_After;
+}
+
+static bool helper_Sink_Data(void *ctx, const char *bytes, size_t len) {
+    EventSink *Sink = (EventSink *)ctx;
+    TEST_ASSERT_TRUE(len > 0 && Sink->Data_Len + len < sizeof(Sink->Data));
+    memcpy(Sink->Data + Sink->Data_Len, bytes, len);
+    Sink->Data_Len += len;
+    Sink->Data_Calls++;
+    return Sink->Stop_Data_After == 0 || Sink->Data_Calls < Sink->Stop_Data_After;
+}
+
+static bool helper_Sse_Body(void *ctx, const char *data, size_t len) {
+    return gemini_sse_feed(&((EventSink *)ctx)->Parser, data, len);
+}
+
+static gemini_session_err_t helper_Stream(gemini_session_t *session, EventSink *sink, int *status) {
+    static const gemini_header_t Headers[] = {{"Content-Type", "application/json"}};
+    const char *Body = "{\"q\":\"a\"}";
+    const gemini_request_t Request = {
+        .method = "POST",
+        .path = "/v1beta/models/test:streamGenerateContent?alt=sse",
+        .headers = Headers,
+        .header_count = 1,
+        .body = Body,
+        .body_len = strlen(Body),
+        .on_body = helper_Sse_Body,
+        .ctx = sink,
+    };
+    return gemini_session_request(session, &Request, status);
+}
+
+// session on the stand-in, false when it isn't running
+static bool helper_Standin_Session(gemini_session_t *session, TlsClient *client) {
+    const char *Port = getenv("GEMINI_STANDIN_PORT");
+    const gemini_transport_t Transport = {helper_Tls_Connect, helper_Tls_Write, helper_Tls_Read,
+                                          helper_Tls_Close, client, helper_Tls_Resumed};
+    gemini_session_init(session, &Transport, "127.0.0.1", Port ? atoi(Port) : 8443, NULL);
+    if (gemini_session_connect(session) != GEMINI_SESSION_OK) {
+        return false;
+    }
+    gemini_session_close(session);
+    return true;
+}
+
+// dns + tcp + tls only, on a fresh connection
+static int64_t helper_Standin_Handshake(gemini_session_t *session, bool *resumed) {
+    gemini_session_close(session);
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_connect(session));
+    *resumed = session->transport.resumed(session->transport.ctx);
+    return session->timing.connect_us;
+}
+
+// openssl transport for the stand-in, its certificate is self signed so it
+// isn't verified
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    TlsClient *Client = (TlsClient *)ctx;
+    static SSL_CTX *Tls_Context;
+    if (!Tls_Context) {
+        Tls_Context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_max_proto_version(Tls_Context, TLS1_2_VERSION);
+    }
+    char Port[8];
+    snprintf(Port, sizeof(Port), "%d", port);
+    struct addrinfo Hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *Address;
+    if (getaddrinfo(host, Port, &Hints, &Address) != 0) {
+        return -1;
+    }
+    int Socket = socket(Address->ai_family, Address->ai_socktype, 0);
+    int Connected = Socket >= 0 ? connect(Socket, Address->ai_addr, Address->ai_addrlen) : -1;
+    freeaddrinfo(Address);
+    if (Connected != 0) {
+        if (Socket >= 0) {
+            close(Socket);
+        }
+        return -1;
+    }
+    int No_Delay = 1; // same as the esp_tls transport
+    setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, &No_Delay, sizeof(No_Delay));
+    Client->Tls = SSL_new(Tls_Context);
+    SSL_set_fd(Client->Tls, Socket);
+    if (Client->Ticket) {
+        SSL_set_session(Client->Tls, Client->Ticket);
+    }
+    if (SSL_connect(Client->Tls) != 1) {
+        helper_Tls_Close(ctx);
+        return -1;
+    }
+    Client->Resumed = SSL_session_reused(Client->Tls);
+    SSL_SESSION_free(Client->Ticket);
+    Client->Ticket = SSL_get1_session(Client->Tls);
+    return 0;
+}
+
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len) {
+    int Sent = SSL_write(((TlsClient *)ctx)->Tls, data, (int)len);
+    return Sent > 0 ? Sent : -1;
+}
+
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    SSL *Tls = ((TlsClient *)ctx)->Tls;
+    if (SSL_pending(Tls) == 0) {
+        struct pollfd Wait = {.fd = SSL_get_fd(Tls), .events = POLLIN};
+        int Ready = poll(&Wait, 1, timeout_ms);
+        if (Ready == 0) {
+            return GEMINI_TRANSPORT_TIMEOUT;
+        }
+        if (Ready < 0) {
+            return -1;
+        }
+    }
+    int Got = SSL_read(Tls, buf, (int)len);
+    if (Got > 0) {
+        return Got;
+    }
+    return SSL_get_error(Tls, Got) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+}
+
+static void helper_Tls_Close(void *ctx) {
+    TlsClient *Client = (TlsClient *)ctx;
+    if (Client->Tls) {
+        int Socket = SSL_get_fd(Client->Tls);
+        SSL_shutdown(Client->Tls); // openssl won't resume a session that wasn't shut down
+        SSL_free(Client->Tls);
+        close(Socket);
+        Client->Tls = NULL;
+    }
+}
+
+static bool helper_Tls_Resumed(void *ctx) { return ((TlsClient *)ctx)->Resumed; }
+
+#endif
@@ -4,17 +4,25 @@
     purpose: this contains the unit tests for the memory control header
 */
 
-#ifdef UNIT_TEST
+#if defined(UNIT_TEST) && defined(TEST_MEMORY_POOL)
 
 #include "MemoryPool.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unity.h>
 
-// THESE NEED TO MATCH THE .C FILE DEFINITIONS
-#define SMALL_BLOCK_SIZE 64
-#define MEDIUM_BLOCK_SIZE 512
-#define LARGE_BLOCK_SIZE 2048
+// default classes used by Pool_Ini
+#define SMALL_BLOCK_SIZE POOL_DEFAULT_SMALL_BLOCK_SIZE
+#define MEDIUM_BLOCK_SIZE POOL_DEFAULT_MEDIUM_BLOCK_SIZE
+#define LARGE_BLOCK_SIZE POOL_DEFAULT_LARGE_BLOCK_SIZE
+
+// fake backing allocator that records what it was asked for
+typedef struct {
+  size_t Claims[POOL_CAPABILITY_COUNT];
+  size_t Outstanding;
+  int Fail_Capability; // -1 never fails
+} TestBacking;
 
 // standard values
 static PoolMemoryInfo *Memory_Handler;
@@ -30,6 +38,16 @@ void helper_Confirm_valid_Pool_Creation(size_t Memory_Size, size_t Block_Size);
 void helper_freeblock_system(size_t Memory_Size);
 void helper_double_free(size_t Memory_Size);
 void helper_Interleaved_Allocation_And_Free(size_t Memory_Size);
+int helper_Block_In_Class(PoolMemoryInfo *handle, size_t Class_Index,
+                          void *Block);
+void *helper_Backing_Alloc(size_t Size, PoolCapability Capability,
+                           void *Context);
+void helper_Backing_Free(void *Memory, PoolCapability Capability,
+                         void *Context);
+#ifdef POOL_HARDENED
+uint64_t helper_Rejected_Frees(PoolMemoryInfo *handle);
+uint64_t helper_Corrupt_Blocks(PoolMemoryInfo *handle, size_t Class_Index);
+#endif
 
 // PROTOTYPING TESTS
 void test_Small_Block_Group_Allocation();
@@ -56,6 +74,27 @@ void test_free_invalid_pointer_does_not_corrupt_list();
 
 void test_Freeing_Null_Pointer();
 
+void test_Config_Request_Picks_Smallest_Fit();
+void test_Config_Unsorted_Classes_Are_Sorted();
+void test_Config_Alignment_Is_Honoured();
+void test_Config_Rejects_Bad_Classes();
+void test_Config_Free_Returns_To_Owning_Class();
+
+void test_Backing_Classes_Claim_From_Their_Capability();
+void test_Backing_Failure_Releases_Every_Claim();
+
+void test_Stats_Track_In_Use_And_High_Water();
+void test_Stats_Count_Failed_And_Oversize();
+void test_Stats_Cache_Hits_Fold_On_Flush();
+void test_Stats_Reject_Null();
+
+#ifdef POOL_HARDENED
+void test_Hardened_Rejects_Interior_Pointer();
+void test_Hardened_Detects_Write_After_Free();
+void test_Hardened_Cuts_Overwritten_Link();
+void test_Hardened_Cache_Rejects_Double_Free();
+#endif
+
 //================================CODE
 // START=============================================
 void setUp(void) {
@@ -96,6 +135,27 @@ int main(void) {
 
   RUN_TEST(test_Freeing_Null_Pointer);
 
+  RUN_TEST(test_Config_Request_Picks_Smallest_Fit);
+  RUN_TEST(test_Config_Unsorted_Classes_Are_Sorted);
+  RUN_TEST(test_Config_Alignment_Is_Honoured);
+  RUN_TEST(test_Config_Rejects_Bad_Classes);
+  RUN_TEST(test_Config_Free_Returns_To_Owning_Class);
+
+  RUN_TEST(test_Backing_Classes_Claim_From_Their_Capability);
+  RUN_TEST(test_Backing_Failure_Releases_Every_Claim);
+
+  RUN_TEST(test_Stats_Track_In_Use_And_High_Water);
+  RUN_TEST(test_Stats_Count_Failed_And_Oversize);
+  RUN_TEST(test_Stats_Cache_Hits_Fold_On_Flush);
+  RUN_TEST(test_Stats_Reject_Null);
+
+#ifdef POOL_HARDENED
+  RUN_TEST(test_Hardened_Rejects_Interior_Pointer);
+  RUN_TEST(test_Hardened_Detects_Write_After_Free);
+  RUN_TEST(test_Hardened_Cuts_Overwritten_Link);
+  RUN_TEST(test_Hardened_Cache_Rejects_Double_Free);
+#endif
+
   return UNITY_END(); // Ends the test runner and prints a summary
 }
 
@@ -147,6 +207,9 @@ void test_free_invalid_pointer_does_not_corrupt_list() {
   void *invalid_pointer = (void *)&stack_variable;
 
   Pool_Free(invalid_pointer, Memory_Handler); // Passes if this does nothing
+#ifdef POOL_HARDENED
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Memory_Handler));
+#endif
 
   void *pointer = Pool_Alloc(10, Memory_Handler);
   TEST_ASSERT_NOT_NULL(pointer);
@@ -154,6 +217,275 @@ void test_free_invalid_pointer_does_not_corrupt_list() {
 }
 // Freeing NULL Pointer
 void test_Freeing_Null_Pointer() { Pool_Free(NULL, Memory_Handler); }
+// Configured pool group
+// 600 bytes should land in a 1KB block instead of the next class up
+void test_Config_Request_Picks_Smallest_Fit() {
+  const PoolClassConfig Classes[] = {
+      {1024, 2, 0}, {4096, 2, 0}, {16384, 1, 0}};
+  PoolMemoryInfo *Config_Handler = Pool_Ini_Config(Classes, 3);
+  TEST_ASSERT_NOT_NULL(Config_Handler);
+
+  void *Frame = Pool_Alloc(600, Config_Handler);
+  void *Record = Pool_Alloc(4000, Config_Handler);
+  void *Chunk = Pool_Alloc(16384, Config_Handler);
+  TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, 0, Frame));
+  TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, 1, Record));
+  TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, 2, Chunk));
+  TEST_ASSERT_NULL(Pool_Alloc(16385, Config_Handler));
+
+  Pool_Free(Frame, Config_Handler);
+  Pool_Free(Record, Config_Handler);
+  Pool_Free(Chunk, Config_Handler);
+  Pool_Destroy(Config_Handler);
+}
+// classes can be handed over in any order
+void test_Config_Unsorted_Classes_Are_Sorted() {
+  const PoolClassConfig Classes[] = {{2048, 1, 0}, {32, 1, 0}, {256, 1, 0}};
+  PoolMemoryInfo *Config_Handler = Pool_Ini_Config(Classes, 3);
+  TEST_ASSERT_NOT_NULL(Config_Handler);
+  TEST_ASSERT_EQUAL_size_t(32, Config_Handler->Pool_Storage[0].Request_Size);
+  TEST_ASSERT_EQUAL_size_t(256, Config_Handler->Pool_Storage[1].Request_Size);
+  TEST_ASSERT_EQUAL_size_t(2048, Config_Handler->Pool_Storage[2].Request_Size);
+  void *Block = Pool_Alloc(100, Config_Handler);
+  TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, 1, Block));
+  Pool_Destroy(Config_Handler);
+}
+// every block in an aligned class starts on the boundary, even when the
+// block size is not a multiple of it
+void test_Config_Alignment_Is_Honoured() {
+  const PoolClassConfig Classes[] = {{24, 3, 0}, {100, 4, 64}};
+  PoolMemoryInfo *Config_Handler = Pool_Ini_Config(Classes, 2);
+  TEST_ASSERT_NOT_NULL(Config_Handler);
+  for (size_t i = 0; i < 4; i++) {
+    void *Block = Pool_Alloc(100, Config_Handler);
+    TEST_ASSERT_NOT_NULL(Block);
+    TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)Block % 64);
+    TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, 1, Block));
+  }
+  TEST_ASSERT_NULL(Pool_Alloc(100, Config_Handler));
+  Pool_Destroy(Config_Handler);
+}
+void test_Config_Rejects_Bad_Classes() {
+  const PoolClassConfig Zero_Size[] = {{0, 1, 0}};
+  const PoolClassConfig Odd_Alignment[] = {{64, 1, 24}};
+  const PoolClassConfig Repeated[] = {{64, 1, 0}, {64, 2, 0}};
+  const PoolClassConfig Bad_Capability[] = {
+      {64, 1, 0, POOL_CAPABILITY_COUNT}};
+  const PoolClassConfig Huge_Size[] = {{SIZE_MAX - 4, 1, 0}};
+  const PoolClassConfig Huge_Alignment[] = {{64, 1, (SIZE_MAX >> 1) + 1}};
+  PoolClassConfig Too_Many[POOL_MAX_CLASSES + 1];
+  for (size_t i = 0; i < POOL_MAX_CLASSES + 1; i++) {
+    Too_Many[i] = (PoolClassConfig){(i + 1) * 16, 1, 0};
+  }
+  TEST_ASSERT_NULL(Pool_Ini_Config(NULL, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Zero_Size, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Odd_Alignment, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Repeated, 2));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Bad_Capability, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Huge_Size, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Huge_Alignment, 1));
+  TEST_ASSERT_NULL(Pool_Ini_Config(Too_Many, POOL_MAX_CLASSES + 1));
+}
+// freed blocks go back on the list of the class they came from
+void test_Config_Free_Returns_To_Owning_Class() {
+  const PoolClassConfig Classes[] = {
+      {16, 2, 0}, {1024, 1, 32}, {4096, 1, 0}, {16384, 1, 128}};
+  PoolMemoryInfo *Config_Handler = Pool_Ini_Config(Classes, 4);
+  TEST_ASSERT_NOT_NULL(Config_Handler);
+  const size_t Sizes[] = {16, 1024, 4096, 16384};
+  for (size_t i = 0; i < 4; i++) {
+    void *Block = Pool_Alloc(Sizes[i], Config_Handler);
+    TEST_ASSERT_NOT_NULL(Block);
+    Pool_Free(Block, Config_Handler);
+    TEST_ASSERT_EQUAL_PTR(Block, Pool_Alloc(Sizes[i], Config_Handler));
+    TEST_ASSERT_TRUE(helper_Block_In_Class(Config_Handler, i, Block));
+  }
+  Pool_Destroy(Config_Handler);
+}
+// Backing memory group
+// small blocks in internal ram, dma frames and psram chunks each get their
+// own claim and frees still find the right class across claims
+void test_Backing_Classes_Claim_From_Their_Capability() {
+  TestBacking Backing_State = {.Fail_Capability = -1};
+  const PoolBackingAllocator Backing = {helper_Backing_Alloc,
+                                        helper_Backing_Free, &Backing_State};
+  const PoolClassConfig Classes[] = {
+      {64, 4, 0, POOL_CAP_INTERNAL},
+      {512, 4, 0, POOL_CAP_INTERNAL},
+      {1024, 2, 32, POOL_CAP_DMA},
+      {16384, 2, 0, POOL_CAP_PSRAM},
+  };
+  PoolMemoryInfo *Backed_Handler =
+      Pool_Ini_Config_Backing(Classes, 4, &Backing);
+  TEST_ASSERT_NOT_NULL(Backed_Handler);
+  TEST_ASSERT_EQUAL_size_t(3, Backed_Handler->Region_Count);
+  // the handle plus the two internal classes sharing one claim
+  TEST_ASSERT_EQUAL_size_t(2, Backing_State.Claims[POOL_CAP_INTERNAL]);
+  TEST_ASSERT_EQUAL_size_t(1, Backing_State.Claims[POOL_CAP_DMA]);
+  TEST_ASSERT_EQUAL_size_t(1, Backing_State.Claims[POOL_CAP_PSRAM]);
+  TEST_ASSERT_EQUAL_size_t(0, Backing_State.Claims[POOL_CAP_ANY]);
+
+  const size_t Sizes[] = {64, 512, 1024, 16384};
+  for (size_t i = 0; i < 4; i++) {
+    void *Block = Pool_Alloc(Sizes[i], Backed_Handler);
+    TEST_ASSERT_TRUE(helper_Block_In_Class(Backed_Handler, i, Block));
+    Pool_Free(Block, Backed_Handler);
+    TEST_ASSERT_EQUAL_PTR(Block, Pool_Alloc(Sizes[i], Backed_Handler));
+  }
+  Pool_Destroy(Backed_Handler);
+  TEST_ASSERT_EQUAL_size_t(0, Backing_State.Outstanding);
+}
+// running out of psram part way through must not leak the earlier claims
+void test_Backing_Failure_Releases_Every_Claim() {
+  TestBacking Backing_State = {.Fail_Capability = POOL_CAP_PSRAM};
+  const PoolBackingAllocator Backing = {helper_Backing_Alloc,
+                                        helper_Backing_Free, &Backing_State};
+  const PoolClassConfig Classes[] = {
+      {64, 4, 0, POOL_CAP_INTERNAL},
+      {1024, 2, 0, POOL_CAP_DMA},
+      {16384, 2, 0, POOL_CAP_PSRAM},
+  };
+  TEST_ASSERT_NULL(Pool_Ini_Config_Backing(Classes, 3, &Backing));
+  TEST_ASSERT_EQUAL_size_t(0, Backing_State.Outstanding);
+}
+// Statistics group
+void test_Stats_Track_In_Use_And_High_Water() {
+  const size_t Request = 40;
+  void *Block[3];
+  for (size_t i = 0; i < 3; i++) {
+    Block[i] = Pool_Alloc(Request, Memory_Handler);
+  }
+  Pool_Free(Block[1], Memory_Handler);
+
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  TEST_ASSERT_EQUAL_size_t(3, Stats.Class_Count);
+  PoolClassStats *Small = &Stats.Class[0];
+  TEST_ASSERT_EQUAL_size_t(SMALL_BLOCK_SIZE, Small->Request_Size);
+  TEST_ASSERT_EQUAL_size_t(Small_Pool_Size, Small->Total_Blocks);
+  TEST_ASSERT_EQUAL_size_t(2, Small->Counters.In_Use);
+  TEST_ASSERT_EQUAL_size_t(3, Small->Counters.High_Water);
+  TEST_ASSERT_EQUAL_UINT64(3, Small->Counters.Total_Allocs);
+  TEST_ASSERT_EQUAL_UINT64(3 * (Small->Block_Size - Request),
+                           Small->Counters.Bytes_Wasted);
+  // the other classes were never touched
+  TEST_ASSERT_EQUAL_UINT64(0, Stats.Class[1].Counters.Total_Allocs);
+  TEST_ASSERT_EQUAL_UINT64(0, Stats.Class[2].Counters.Total_Allocs);
+
+  Pool_Free(Block[0], Memory_Handler);
+  Pool_Free(Block[2], Memory_Handler);
+  Pool_Get_Stats(Memory_Handler, &Stats);
+  TEST_ASSERT_EQUAL_size_t(0, Stats.Class[0].Counters.In_Use);
+  TEST_ASSERT_EQUAL_size_t(3, Stats.Class[0].Counters.High_Water);
+}
+
+void test_Stats_Count_Failed_And_Oversize() {
+  helper_Small_Pool_Exhaustion(SMALL_BLOCK_SIZE, Small_Pool_Size);
+  TEST_ASSERT_NULL(Pool_Alloc(LARGE_BLOCK_SIZE + 1, Memory_Handler));
+
+  PoolStats Stats;
+  Pool_Get_Stats(Memory_Handler, &Stats);
+  TEST_ASSERT_EQUAL_UINT64(1, Stats.Class[0].Counters.Failed_Allocs);
+  TEST_ASSERT_EQUAL_UINT64(Small_Pool_Size,
+                           Stats.Class[0].Counters.Total_Allocs);
+  TEST_ASSERT_EQUAL_size_t(Small_Pool_Size,
+                           Stats.Class[0].Counters.High_Water);
+  TEST_ASSERT_EQUAL_UINT64(1, Stats.Oversize_Allocs);
+  TEST_ASSERT_EQUAL_UINT64(0, Stats.Class[2].Counters.Failed_Allocs);
+}
+
+void test_Stats_Cache_Hits_Fold_On_Flush() {
+  const PoolClassConfig Classes[] = {{64, 64, 0}};
+  PoolMemoryInfo *Cached_Pool = Pool_Ini_Config(Classes, 1);
+  TEST_ASSERT_NOT_NULL(Cached_Pool);
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Cached_Pool);
+  for (size_t i = 0; i < 10; i++) {
+    Pool_Cache_Free(Pool_Cache_Alloc(60, &Cache), &Cache);
+  }
+
+  // blocks parked in the cache still count as in use
+  PoolStats Stats;
+  Pool_Get_Stats(Cached_Pool, &Stats);
+  TEST_ASSERT_NOT_EQUAL(0, Stats.Class[0].Counters.In_Use);
+
+  Pool_Cache_Flush(&Cache);
+  Pool_Get_Stats(Cached_Pool, &Stats);
+  TEST_ASSERT_EQUAL_size_t(0, Stats.Class[0].Counters.In_Use);
+  TEST_ASSERT_EQUAL_UINT64(10, Stats.Class[0].Counters.Total_Allocs);
+  TEST_ASSERT_EQUAL_UINT64(10 * (Stats.Class[0].Block_Size - 60),
+                           Stats.Class[0].Counters.Bytes_Wasted);
+  Pool_Destroy(Cached_Pool);
+}
+
+void test_Stats_Reject_Null() {
+  PoolStats Stats;
+  TEST_ASSERT_FALSE(Pool_Get_Stats(NULL, &Stats));
+  TEST_ASSERT_FALSE(Pool_Get_Stats(Memory_Handler, NULL));
+  Pool_Log_Stats(NULL, "pool");
+}
+// Hardened build group
+#ifdef POOL_HARDENED
+void test_Hardened_Rejects_Interior_Pointer() {
+  uint8_t *Block = Pool_Alloc(SMALL_BLOCK_SIZE, Memory_Handler);
+  Pool_Free(Block + 8, Memory_Handler);
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Memory_Handler));
+  // the block is still held, so the real free goes through
+  Pool_Free(Block, Memory_Handler);
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Memory_Handler));
+  PoolStats Stats;
+  Pool_Get_Stats(Memory_Handler, &Stats);
+  TEST_ASSERT_EQUAL_size_t(0, Stats.Class[0].Counters.In_Use);
+}
+
+void test_Hardened_Detects_Write_After_Free() {
+  uint8_t *Block = Pool_Alloc(MEDIUM_BLOCK_SIZE, Memory_Handler);
+  TEST_ASSERT_EQUAL_UINT64(0, helper_Corrupt_Blocks(Memory_Handler, 1));
+  Pool_Free(Block, Memory_Handler);
+  TEST_ASSERT_EQUAL_HEX8(POOL_POISON_BYTE, Block[100]);
+  Block[100] = TEST_PATTERN; // late write through a stale pointer
+
+  TEST_ASSERT_EQUAL_PTR(Block, Pool_Alloc(MEDIUM_BLOCK_SIZE, Memory_Handler));
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Corrupt_Blocks(Memory_Handler, 1));
+  Pool_Free(Block, Memory_Handler);
+}
+
+void test_Hardened_Cuts_Overwritten_Link() {
+  int stack_variable = 100;
+  uint8_t *Block = Pool_Alloc(LARGE_BLOCK_SIZE, Memory_Handler);
+  Pool_Free(Block, Memory_Handler);
+  // stale pointer overwrites the free list link with something foreign
+  ((FreeBlock *)Block)->next = (FreeBlock *)&stack_variable;
+
+  TEST_ASSERT_EQUAL_PTR(Block, Pool_Alloc(LARGE_BLOCK_SIZE, Memory_Handler));
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Corrupt_Blocks(Memory_Handler, 2));
+  // the rest of the list was dropped instead of handing out the stack
+  TEST_ASSERT_NULL(Pool_Alloc(LARGE_BLOCK_SIZE, Memory_Handler));
+  Pool_Free(Block, Memory_Handler);
+}
+
+void test_Hardened_Cache_Rejects_Double_Free() {
+  const PoolClassConfig Classes[] = {{64, 64, 0}};
+  PoolMemoryInfo *Cached_Pool = Pool_Ini_Config(Classes, 1);
+  TEST_ASSERT_NOT_NULL(Cached_Pool);
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Cached_Pool);
+  void *Block = Pool_Cache_Alloc(60, &Cache);
+  Pool_Cache_Free(Block, &Cache);
+  Pool_Cache_Free(Block, &Cache);
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Cached_Pool));
+
+  void *First = Pool_Cache_Alloc(60, &Cache);
+  void *Second = Pool_Cache_Alloc(60, &Cache);
+  TEST_ASSERT_NOT_EQUAL(First, Second);
+  Pool_Cache_Free(First, &Cache);
+  Pool_Cache_Free(Second, &Cache);
+  Pool_Cache_Flush(&Cache);
+  TEST_ASSERT_EQUAL_UINT64(0, helper_Corrupt_Blocks(Cached_Pool, 0));
+  Pool_Destroy(Cached_Pool);
+}
+#endif
+
 // HELPER FUNCTIONS
 void helper_Small_Pool_Exhaustion(size_t Block_Size, size_t Pool_Size) {
   // see what happens if you pull more than the max pool ini values
@@ -214,8 +546,61 @@ void helper_double_free(size_t Memory_Size) {
   // try to free the same one twice
   Pool_Free(Block_Adress_Pointer, Memory_Handler);
   Pool_Free(Block_Adress_Pointer, Memory_Handler);
+#ifdef POOL_HARDENED
+  // the second free must be refused, otherwise the list loops on itself
+  // and the next two allocs hand out the same block
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Memory_Handler));
+  void *First = Pool_Alloc(Memory_Size, Memory_Handler);
+  void *Second = Pool_Alloc(Memory_Size, Memory_Handler);
+  TEST_ASSERT_NOT_NULL(Second);
+  TEST_ASSERT_NOT_EQUAL(First, Second);
+  Pool_Free(First, Memory_Handler);
+  Pool_Free(Second, Memory_Handler);
+  TEST_ASSERT_EQUAL_UINT64(1, helper_Rejected_Frees(Memory_Handler));
+#endif
+}
+
+int helper_Block_In_Class(PoolMemoryInfo *handle, size_t Class_Index,
+                          void *Block) {
+  PoolInfo *Pool = &handle->Pool_Storage[Class_Index];
+  uint8_t *Address = (uint8_t *)Block;
+  return Block != NULL && Address >= Pool->Pool_Start_Address &&
+         Address < Pool->Pool_Start_Address +
+                       (Pool->Total_Blocks * Pool->Block_Size);
 }
 
+void *helper_Backing_Alloc(size_t Size, PoolCapability Capability,
+                           void *Context) {
+  TestBacking *Backing_State = (TestBacking *)Context;
+  if ((int)Capability == Backing_State->Fail_Capability) {
+    return NULL;
+  }
+  Backing_State->Claims[Capability]++;
+  Backing_State->Outstanding++;
+  return malloc(Size);
+}
+
+void helper_Backing_Free(void *Memory, PoolCapability Capability,
+                         void *Context) {
+  TestBacking *Backing_State = (TestBacking *)Context;
+  Backing_State->Outstanding--;
+  free(Memory);
+}
+
+#ifdef POOL_HARDENED
+uint64_t helper_Rejected_Frees(PoolMemoryInfo *handle) {
+  PoolStats Stats;
+  Pool_Get_Stats(handle, &Stats);
+  return Stats.Rejected_Frees;
+}
+
+uint64_t helper_Corrupt_Blocks(PoolMemoryInfo *handle, size_t Class_Index) {
+  PoolStats Stats;
+  Pool_Get_Stats(handle, &Stats);
+  return Stats.Class[Class_Index].Counters.Corrupt_Blocks;
+}
+#endif
+
 // Return pointer in middle and confirm it is added at front of list
 void helper_Interleaved_Allocation_And_Free(size_t Memory_Size) {
   void *Block_Adress_Pointer_1 = Pool_Alloc(Memory_Size, Memory_Handler);
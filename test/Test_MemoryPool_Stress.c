@@ -0,0 +1,312 @@
+/*MemoryPool thread safety stress tests
+    Written by Matthew Ayestaran
+    purpose: hammers one pool from several pthreads, through task caches and
+    through the shared lists, and checks no block is ever handed to two
+    owners at once or lost
+    run with: pio test -e native_stress
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_MEMORY_POOL_STRESS)
+
+#ifndef POOL_THREAD_SAFE
+#error "the stress tests need the pool built with POOL_THREAD_SAFE"
+#endif
+
+#include "MemoryPool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+// standard values
+#define STRESS_THREADS 4
+#define STRESS_HELD_BLOCKS 16 // blocks each thread keeps live at once
+#define STRESS_HANDOFF_SLOTS 64
+static PoolMemoryInfo *Memory_Handler;
+const size_t Stress_Iterations = 50000;
+static const PoolClassConfig Stress_Classes[] = {
+    {64, 256, 0}, {512, 64, 0}, {2048, 32, 0}};
+#define STRESS_CLASS_COUNT (sizeof(Stress_Classes) / sizeof(Stress_Classes[0]))
+
+typedef struct { // what every thread writes into the blocks it owns
+  uint32_t Owner;
+  uint32_t Sequence;
+} StressStamp;
+
+typedef struct {
+  uint32_t Owner;
+  int Use_Cache;
+  size_t Corrupted; // blocks whose stamp changed while we held them
+} StressWorker;
+
+// bounded queue used to pass blocks from one thread to another
+typedef struct {
+  pthread_mutex_t Mutex;
+  void *Slot[STRESS_HANDOFF_SLOTS];
+  size_t Head;
+  size_t Tail;
+  int Done;
+} StressHandoff;
+static StressHandoff Handoff;
+
+// PROTOTYPING HELPERS
+static uint32_t helper_Random(uint32_t *State);
+static size_t helper_Random_Size(uint32_t *State);
+static void *helper_Alloc(StressWorker *Worker, PoolTaskCache *Cache,
+                          size_t Size);
+static void helper_Free(StressWorker *Worker, PoolTaskCache *Cache,
+                        void *Block);
+static void helper_Stamp(void *Block, uint32_t Owner, uint32_t Sequence);
+static int helper_Stamp_Intact(void *Block, uint32_t Owner,
+                               uint32_t Sequence);
+static void *helper_Churn_Thread(void *Argument);
+static void *helper_Producer_Thread(void *Argument);
+static void *helper_Consumer_Thread(void *Argument);
+static void helper_Run_Churn(int Use_Cache);
+static void helper_Confirm_Every_Block_Returned(void);
+
+// PROTOTYPING TESTS
+void test_Stress_Cached_Threads();
+void test_Stress_Shared_Threads();
+void test_Stress_Mixed_Cached_And_Shared();
+void test_Stress_Cross_Thread_Free();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Stress_Classes, STRESS_CLASS_COUNT);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+}
+void tearDown(void) { Pool_Destroy(Memory_Handler); }
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Stress_Cached_Threads);
+  RUN_TEST(test_Stress_Shared_Threads);
+  RUN_TEST(test_Stress_Mixed_Cached_And_Shared);
+  RUN_TEST(test_Stress_Cross_Thread_Free);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+// every thread allocates and frees through its own task cache
+void test_Stress_Cached_Threads() { helper_Run_Churn(1); }
+// every thread goes straight to the locked shared lists
+void test_Stress_Shared_Threads() { helper_Run_Churn(0); }
+// half the threads cache, half don't, all on the same lists
+void test_Stress_Mixed_Cached_And_Shared() { helper_Run_Churn(2); }
+
+// blocks allocated in one thread's cache get freed into another's, the
+// same shape as audio frames going from the capture task to the uploader
+void test_Stress_Cross_Thread_Free() {
+  memset(&Handoff, 0, sizeof(Handoff));
+  pthread_mutex_init(&Handoff.Mutex, NULL);
+  StressWorker Producer = {.Owner = 1, .Use_Cache = 1};
+  StressWorker Consumer = {.Owner = 2, .Use_Cache = 1};
+  pthread_t Producer_Thread;
+  pthread_t Consumer_Thread;
+  pthread_create(&Producer_Thread, NULL, helper_Producer_Thread, &Producer);
+  pthread_create(&Consumer_Thread, NULL, helper_Consumer_Thread, &Consumer);
+  pthread_join(Producer_Thread, NULL);
+  pthread_join(Consumer_Thread, NULL);
+  pthread_mutex_destroy(&Handoff.Mutex);
+
+  TEST_ASSERT_EQUAL_size_t(0, Consumer.Corrupted);
+  helper_Confirm_Every_Block_Returned();
+}
+
+// HELPER FUNCTIONS
+static void helper_Run_Churn(int Use_Cache) {
+  pthread_t Threads[STRESS_THREADS];
+  StressWorker Workers[STRESS_THREADS];
+  for (uint32_t i = 0; i < STRESS_THREADS; i++) {
+    Workers[i] = (StressWorker){.Owner = i + 1,
+                                .Use_Cache = Use_Cache == 2 ? (int)(i & 1)
+                                                            : Use_Cache};
+    pthread_create(&Threads[i], NULL, helper_Churn_Thread, &Workers[i]);
+  }
+  for (size_t i = 0; i < STRESS_THREADS; i++) {
+    pthread_join(Threads[i], NULL);
+    TEST_ASSERT_EQUAL_size_t_MESSAGE(0, Workers[i].Corrupted,
+                                     "block was handed to two owners");
+  }
+  helper_Confirm_Every_Block_Returned();
+}
+
+// keep a ring of live blocks, replacing a random one each step
+static void *helper_Churn_Thread(void *Argument) {
+  StressWorker *Worker = (StressWorker *)Argument;
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Memory_Handler);
+  void *Held[STRESS_HELD_BLOCKS] = {0};
+  uint32_t Held_Sequence[STRESS_HELD_BLOCKS] = {0};
+  uint32_t Random_State = Worker->Owner * 2654435761u;
+
+  for (uint32_t Sequence = 1; Sequence <= Stress_Iterations; Sequence++) {
+    size_t Slot = helper_Random(&Random_State) % STRESS_HELD_BLOCKS;
+    if (Held[Slot] != NULL) {
+      if (!helper_Stamp_Intact(Held[Slot], Worker->Owner,
+                               Held_Sequence[Slot])) {
+        Worker->Corrupted++;
+      }
+      helper_Free(Worker, &Cache, Held[Slot]);
+    }
+    Held[Slot] =
+        helper_Alloc(Worker, &Cache, helper_Random_Size(&Random_State));
+    if (Held[Slot] != NULL) { // running dry under contention is allowed
+      helper_Stamp(Held[Slot], Worker->Owner, Sequence);
+      Held_Sequence[Slot] = Sequence;
+    }
+  }
+  for (size_t i = 0; i < STRESS_HELD_BLOCKS; i++) {
+    helper_Free(Worker, &Cache, Held[i]);
+  }
+  Pool_Cache_Flush(&Cache);
+  return NULL;
+}
+
+static void *helper_Producer_Thread(void *Argument) {
+  StressWorker *Worker = (StressWorker *)Argument;
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Memory_Handler);
+  uint32_t Random_State = 12345;
+  for (uint32_t Sequence = 1; Sequence <= Stress_Iterations; Sequence++) {
+    void *Block =
+        helper_Alloc(Worker, &Cache, helper_Random_Size(&Random_State));
+    if (Block == NULL) {
+      sched_yield();
+      continue;
+    }
+    helper_Stamp(Block, Worker->Owner, Sequence);
+    int Queued = 0;
+    while (!Queued) {
+      pthread_mutex_lock(&Handoff.Mutex);
+      if (Handoff.Head - Handoff.Tail < STRESS_HANDOFF_SLOTS) {
+        Handoff.Slot[Handoff.Head++ % STRESS_HANDOFF_SLOTS] = Block;
+        Queued = 1;
+      }
+      pthread_mutex_unlock(&Handoff.Mutex);
+      if (!Queued) {
+        sched_yield();
+      }
+    }
+  }
+  pthread_mutex_lock(&Handoff.Mutex);
+  Handoff.Done = 1;
+  pthread_mutex_unlock(&Handoff.Mutex);
+  Pool_Cache_Flush(&Cache);
+  return NULL;
+}
+
+static void *helper_Consumer_Thread(void *Argument) {
+  StressWorker *Worker = (StressWorker *)Argument;
+  PoolTaskCache Cache;
+  Pool_Cache_Ini(&Cache, Memory_Handler);
+  uint32_t Last_Sequence = 0;
+  for (;;) {
+    void *Block = NULL;
+    int Done = 0;
+    pthread_mutex_lock(&Handoff.Mutex);
+    if (Handoff.Tail != Handoff.Head) {
+      Block = Handoff.Slot[Handoff.Tail++ % STRESS_HANDOFF_SLOTS];
+    }
+    Done = Handoff.Done;
+    pthread_mutex_unlock(&Handoff.Mutex);
+    if (Block == NULL) {
+      if (Done) {
+        break;
+      }
+      sched_yield();
+      continue;
+    }
+    // producer stamps are strictly increasing, anything else is a block
+    // that got reused while it was still queued
+    StressStamp Stamp;
+    memcpy(&Stamp, (uint8_t *)Block + sizeof(FreeBlock), sizeof(Stamp));
+    if (Stamp.Owner != 1 || Stamp.Sequence <= Last_Sequence ||
+        !helper_Stamp_Intact(Block, Stamp.Owner, Stamp.Sequence)) {
+      Worker->Corrupted++;
+    }
+    Last_Sequence = Stamp.Sequence;
+    helper_Free(Worker, &Cache, Block);
+  }
+  Pool_Cache_Flush(&Cache);
+  return NULL;
+}
+
+// once every cache is flushed the whole pool must be allocatable again
+static void helper_Confirm_Every_Block_Returned(void) {
+  // the counters are only touched under the lock, so they must settle too
+  PoolStats Stats;
+  Pool_Get_Stats(Memory_Handler, &Stats);
+  for (size_t i = 0; i < STRESS_CLASS_COUNT; i++) {
+    TEST_ASSERT_EQUAL_size_t(0, Stats.Class[i].Counters.In_Use);
+  }
+  for (size_t i = 0; i < STRESS_CLASS_COUNT; i++) {
+    void *Blocks[256];
+    TEST_ASSERT_LESS_OR_EQUAL(256, Stress_Classes[i].Block_Count);
+    for (size_t j = 0; j < Stress_Classes[i].Block_Count; j++) {
+      Blocks[j] = Pool_Alloc(Stress_Classes[i].Block_Size, Memory_Handler);
+      TEST_ASSERT_NOT_NULL_MESSAGE(Blocks[j], "block lost after stress run");
+    }
+    TEST_ASSERT_NULL(Pool_Alloc(Stress_Classes[i].Block_Size, Memory_Handler));
+    for (size_t j = 0; j < Stress_Classes[i].Block_Count; j++) {
+      Pool_Free(Blocks[j], Memory_Handler);
+    }
+  }
+}
+
+static void *helper_Alloc(StressWorker *Worker, PoolTaskCache *Cache,
+                          size_t Size) {
+  return Worker->Use_Cache ? Pool_Cache_Alloc(Size, Cache)
+                           : Pool_Alloc(Size, Memory_Handler);
+}
+
+static void helper_Free(StressWorker *Worker, PoolTaskCache *Cache,
+                        void *Block) {
+  if (Worker->Use_Cache) {
+    Pool_Cache_Free(Block, Cache);
+  } else {
+    Pool_Free(Block, Memory_Handler);
+  }
+}
+
+// the stamp sits after the free list pointer and again at the end of the
+// smallest block, so the list link never overwrites it while we own it
+static void helper_Stamp(void *Block, uint32_t Owner, uint32_t Sequence) {
+  StressStamp Stamp = {Owner, Sequence};
+  uint8_t *Bytes = (uint8_t *)Block;
+  memcpy(Bytes + sizeof(FreeBlock), &Stamp, sizeof(Stamp));
+  memcpy(Bytes + Stress_Classes[0].Block_Size - sizeof(Stamp), &Stamp,
+         sizeof(Stamp));
+}
+
+static int helper_Stamp_Intact(void *Block, uint32_t Owner,
+                               uint32_t Sequence) {
+  StressStamp Expected = {Owner, Sequence};
+  uint8_t *Bytes = (uint8_t *)Block;
+  return memcmp(Bytes + sizeof(FreeBlock), &Expected, sizeof(Expected)) == 0 &&
+         memcmp(Bytes + Stress_Classes[0].Block_Size - sizeof(Expected),
+                &Expected, sizeof(Expected)) == 0;
+}
+
+// xorshift, good enough to spread sizes and slots
+static uint32_t helper_Random(uint32_t *State) {
+  uint32_t Value = *State;
+  Value ^= Value << 13;
+  Value ^= Value >> 17;
+  Value ^= Value << 5;
+  *State = Value;
+  return Value;
+}
+
+static size_t helper_Random_Size(uint32_t *State) {
+  size_t Class = helper_Random(State) % STRESS_CLASS_COUNT;
+  return 1 + helper_Random(State) % Stress_Classes[Class].Block_Size;
+}
+
+#endif
@@ -0,0 +1,623 @@
+/*Pipeline unit tests
+    Written by Matthew Ayestaran
+    purpose: runs stage graphs on pthreads with fake stages and checks every
+    message comes out once and in order, that a slow stage holds the ones
+    before it back through the queues and the pool instead of anything
+    growing, that an early end and an error stop the stages before and
+    every block goes back to the pool, then runs the voice stages with fake
+    capture and speech ends and checks their output
+    run with: pio test -e native_pipeline
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_PIPELINE)
+
+#ifndef POOL_THREAD_SAFE
+#error "blocks are freed on other threads, build with POOL_THREAD_SAFE"
+#endif
+
+#include "VoiceStages.h"
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+
+// standard values
+#define FRAME_SAMPLES 320 // 20 ms at 16 kHz
+#define FRAME_BYTES (sizeof(AudioFrame) + FRAME_SAMPLES * sizeof(int32_t))
+#define MAX_SENTENCES 16
+#define MAX_ENCODED 65536
+static PoolMemoryInfo *Memory_Handler;
+static Pipeline Pipe;
+static const PoolClassConfig Pipe_Classes[] = {
+    {64, 32, 0},
+    {VOICE_SENTENCE_MAX, 16, 0},
+    {FRAME_BYTES, 24, 0},
+    {AUDIO_CODEC_OUT_MAX, 12, 0}};
+
+typedef struct { // what a fake stage does and what it saw
+  uint32_t Count;      // source, messages to send
+  uint32_t Stop_After; // messages before Stop_With, 0 for never
+  PipeResult Stop_With;
+  uint32_t Delay_us;   // per message
+  uint32_t Sent;
+  uint32_t Seen;
+  uint32_t Out_Of_Order;
+  uint32_t Flushes;
+} FakeCtx;
+
+typedef struct { // the fake speech end
+  char Sentence[MAX_SENTENCES][VOICE_SENTENCE_MAX];
+  size_t Count;
+} SpokenText;
+
+typedef struct { // text source
+  const char *Text;
+  size_t Piece; // bytes per message
+  size_t Pos;
+} TextSource;
+
+typedef struct { // frame source, slots for a ramp and a tone
+  uint32_t Frames;
+  uint32_t Speech_From; // frames before this and from Speech_To are quiet
+  uint32_t Speech_To;
+  uint32_t Sent;
+} FrameSource;
+
+typedef struct { // collects the encoded file
+  uint8_t Bytes[MAX_ENCODED];
+  size_t Len;
+  uint32_t Frames;
+} ByteSink;
+
+static FakeCtx Fake[PIPE_MAX_STAGES];
+static SpokenText Spoken;
+static TextSource Text_In;
+static FrameSource Frames_In;
+static ByteSink Bytes_Out;
+static VoiceConvertCtx Convert_Ctx;
+static VoiceEncodeCtx Encode_Ctx;
+static VoiceSentenceCtx Sentence_Ctx;
+static VoiceSpeechCtx Speech_Ctx;
+
+// PROTOTYPING HELPERS
+static PipeResult helper_Source(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Pass(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Double(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Sink(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Pull_Sum(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Text_Source(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Frame_Source(PipeStage *Stage, PipeMsg *In);
+static PipeResult helper_Byte_Sink(PipeStage *Stage, PipeMsg *In);
+static bool helper_Speak(void *Ctx, const char *Text, size_t Len);
+static PipeResult helper_Count_And_Stop(FakeCtx *Ctx);
+static int16_t helper_Sample(const FrameSource *Source, uint32_t Index);
+static void helper_Sleep_us(uint32_t Microseconds);
+static PipeStageConfig helper_Stage(PipeProcess Process, void *Ctx,
+                                    size_t Depth);
+static size_t helper_In_Use(void);
+static size_t helper_High_Water(size_t Class);
+static void helper_Run(const PipeStageConfig *Stages, size_t Count,
+                       int Expected);
+static void helper_Speak_Reply(const char *Reply, size_t Piece);
+
+// PROTOTYPING TESTS
+void test_Ini_Rejects_Bad_Graphs();
+void test_Messages_Arrive_Once_And_In_Order();
+void test_Slow_Stage_Holds_The_Source_Back();
+void test_Empty_Pool_Makes_The_Source_Wait();
+void test_Early_End_Stops_The_Stages_Before();
+void test_Error_Aborts_Every_Stage();
+void test_Abort_From_Outside();
+void test_Pull_Stage_Takes_Its_Own_Messages();
+void test_Last_Stage_Latency_Is_Measured();
+void test_Sentence_Stage_Splits_A_Streamed_Reply();
+void test_Sentence_Stage_Cuts_A_Long_Sentence_At_A_Space();
+void test_Convert_And_Encode_Match_The_Encoder();
+void test_Vad_End_Stops_The_Capture();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+  Memory_Handler = Pool_Ini_Config(Pipe_Classes, 4);
+  TEST_ASSERT_NOT_NULL(Memory_Handler);
+  memset(Fake, 0, sizeof(Fake));
+  memset(&Spoken, 0, sizeof(Spoken));
+  memset(&Bytes_Out, 0, sizeof(Bytes_Out));
+  memset(&Sentence_Ctx, 0, sizeof(Sentence_Ctx));
+  Speech_Ctx.Speak = helper_Speak;
+  Speech_Ctx.Ctx = &Spoken;
+}
+void tearDown(void) {
+  Pipeline_Deinit(&Pipe);
+  TEST_ASSERT_EQUAL_size_t(0, helper_In_Use());
+  Pool_Destroy(Memory_Handler);
+}
+
+int main(void) {
+
+  UNITY_BEGIN(); // Starts the test runner
+
+  RUN_TEST(test_Ini_Rejects_Bad_Graphs);
+  RUN_TEST(test_Messages_Arrive_Once_And_In_Order);
+  RUN_TEST(test_Slow_Stage_Holds_The_Source_Back);
+  RUN_TEST(test_Empty_Pool_Makes_The_Source_Wait);
+  RUN_TEST(test_Early_End_Stops_The_Stages_Before);
+  RUN_TEST(test_Error_Aborts_Every_Stage);
+  RUN_TEST(test_Abort_From_Outside);
+  RUN_TEST(test_Pull_Stage_Takes_Its_Own_Messages);
+  RUN_TEST(test_Last_Stage_Latency_Is_Measured);
+  RUN_TEST(test_Sentence_Stage_Splits_A_Streamed_Reply);
+  RUN_TEST(test_Sentence_Stage_Cuts_A_Long_Sentence_At_A_Space);
+  RUN_TEST(test_Convert_And_Encode_Match_The_Encoder);
+  RUN_TEST(test_Vad_End_Stops_The_Capture);
+
+  return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Ini_Rejects_Bad_Graphs() {
+  PipeStageConfig Stages[PIPE_MAX_STAGES + 1];
+  for (size_t i = 0; i < PIPE_MAX_STAGES + 1; i++) {
+    Stages[i] = helper_Stage(helper_Pass, &Fake[0], 4);
+  }
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 0));
+  TEST_ASSERT_EQUAL_INT(
+      -1, Pipeline_Ini(&Pipe, Memory_Handler, Stages, PIPE_MAX_STAGES + 1));
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Ini(&Pipe, NULL, Stages, 2));
+  Stages[1].Process = NULL;
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 2));
+  Stages[1].Process = helper_Pass;
+  Stages[0].Queue_Depth = 0;
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 2));
+  Stages[0].Queue_Depth = PIPE_QUEUE_MAX + 1;
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 2));
+  // the last stage's depth isn't used
+  Stages[0].Queue_Depth = 4;
+  Stages[1].Queue_Depth = 0;
+  TEST_ASSERT_EQUAL_INT(0, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 2));
+}
+
+// the middle stages send on the block they got and new ones, the flush
+// comes once to every stage after the source
+void test_Messages_Arrive_Once_And_In_Order() {
+  Fake[0].Count = 2000;
+  const PipeStageConfig Stages[] = {
+      helper_Stage(helper_Source, &Fake[0], 4),
+      helper_Stage(helper_Double, &Fake[1], 4),
+      helper_Stage(helper_Pass, &Fake[2], 4),
+      helper_Stage(helper_Sink, &Fake[3], 0)};
+  helper_Run(Stages, 4, 0);
+  TEST_ASSERT_EQUAL_UINT32(4000, Fake[3].Seen);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[2].Out_Of_Order);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[3].Out_Of_Order);
+  for (size_t i = 1; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT32(1, Fake[i].Flushes);
+  }
+  PipeStageStats Stats;
+  Pipeline_Get_Stats(&Pipe, 1, &Stats);
+  TEST_ASSERT_EQUAL_UINT32(2000, Stats.In);
+  TEST_ASSERT_EQUAL_UINT32(4000, Stats.Out);
+  TEST_ASSERT_LESS_OR_EQUAL_size_t(4, Stats.Queue_High_Water);
+  Pipeline_Get_Stats(&Pipe, 3, &Stats);
+  TEST_ASSERT_EQUAL_UINT32(4000, Stats.In);
+  TEST_ASSERT_EQUAL_size_t(0, helper_In_Use());
+}
+
+// a sink at 200 us a message. the source spends its time waiting on the
+// queue, and the blocks out at once never pass the queue depths
+void test_Slow_Stage_Holds_The_Source_Back() {
+  Fake[0].Count = 200;
+  Fake[2].Delay_us = 200;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 2),
+                                    helper_Stage(helper_Pass, &Fake[1], 2),
+                                    helper_Stage(helper_Sink, &Fake[2], 0)};
+  helper_Run(Stages, 3, 0);
+  TEST_ASSERT_EQUAL_UINT32(200, Fake[2].Seen);
+  PipeStageStats Source, Sink;
+  Pipeline_Get_Stats(&Pipe, 0, &Source);
+  Pipeline_Get_Stats(&Pipe, 2, &Sink);
+  TEST_ASSERT_EQUAL_size_t(2, Source.Queue_High_Water);
+  TEST_ASSERT_TRUE(Source.Blocked_us > 200 * 100);
+  TEST_ASSERT_TRUE(Sink.Busy_us >= 200 * 200);
+  // two queues of 2, one block in each stage's hands
+  TEST_ASSERT_LESS_OR_EQUAL_size_t(2 + 2 + 3, helper_High_Water(0));
+}
+
+void test_Empty_Pool_Makes_The_Source_Wait() {
+  Pool_Destroy(Memory_Handler);
+  const PoolClassConfig Tiny[] = {{64, 3, 0}};
+  Memory_Handler = Pool_Ini_Config(Tiny, 1);
+  Fake[0].Count = 100;
+  Fake[1].Delay_us = 100;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 8),
+                                    helper_Stage(helper_Sink, &Fake[1], 0)};
+  helper_Run(Stages, 2, 0);
+  TEST_ASSERT_EQUAL_UINT32(100, Fake[1].Seen);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[1].Out_Of_Order);
+  PipeStageStats Stats;
+  Pipeline_Get_Stats(&Pipe, 0, &Stats);
+  TEST_ASSERT_TRUE(Stats.Pool_Waits > 0);
+  TEST_ASSERT_LESS_OR_EQUAL_size_t(3, Stats.Queue_High_Water);
+}
+
+// the middle stage has all it wants after 10, a source that would run for
+// ever stops when its sends fail and the run still counts as a clean end
+void test_Early_End_Stops_The_Stages_Before() {
+  Fake[0].Count = UINT32_MAX;
+  Fake[1].Stop_After = 10;
+  Fake[1].Stop_With = PIPE_END;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 4),
+                                    helper_Stage(helper_Pass, &Fake[1], 4),
+                                    helper_Stage(helper_Sink, &Fake[2], 0)};
+  helper_Run(Stages, 3, 0);
+  TEST_ASSERT_EQUAL_UINT32(10, Fake[2].Seen);
+  TEST_ASSERT_EQUAL_UINT32(1, Fake[2].Flushes);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[1].Flushes); // it ended itself
+  TEST_ASSERT_EQUAL_size_t(0, helper_In_Use());
+}
+
+void test_Error_Aborts_Every_Stage() {
+  Fake[0].Count = UINT32_MAX;
+  Fake[1].Stop_After = 10;
+  Fake[1].Stop_With = PIPE_ERROR;
+  Fake[2].Delay_us = 50;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 4),
+                                    helper_Stage(helper_Pass, &Fake[1], 4),
+                                    helper_Stage(helper_Sink, &Fake[2], 0)};
+  helper_Run(Stages, 3, -1);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(10, Fake[2].Seen);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[2].Flushes);
+  // whatever was still queued goes back with Deinit, see tearDown
+}
+
+void test_Abort_From_Outside() {
+  Fake[0].Count = UINT32_MAX;
+  Fake[1].Delay_us = 100;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 4),
+                                    helper_Stage(helper_Sink, &Fake[1], 0)};
+  TEST_ASSERT_EQUAL_INT(0, Pipeline_Ini(&Pipe, Memory_Handler, Stages, 2));
+  TEST_ASSERT_EQUAL_INT(0, Pipeline_Start(&Pipe));
+  helper_Sleep_us(20000);
+  Pipeline_Abort(&Pipe);
+  TEST_ASSERT_EQUAL_INT(-1, Pipeline_Wait(&Pipe));
+  TEST_ASSERT_TRUE(Fake[1].Seen > 0);
+}
+
+void test_Pull_Stage_Takes_Its_Own_Messages() {
+  Fake[0].Count = 500;
+  PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 4),
+                              helper_Stage(helper_Pull_Sum, &Fake[1], 4),
+                              helper_Stage(helper_Sink, &Fake[2], 0)};
+  Stages[1].Pull = true;
+  helper_Run(Stages, 3, 0);
+  TEST_ASSERT_EQUAL_UINT32(500, Fake[1].Seen);
+  TEST_ASSERT_EQUAL_UINT32(0, Fake[1].Out_Of_Order);
+  TEST_ASSERT_EQUAL_UINT32(1, Fake[2].Seen); // the total
+  TEST_ASSERT_EQUAL_UINT32(500 * 499 / 2, Fake[2].Sent);
+}
+
+// a sink 1 ms a message behind a source that makes them at once, so the
+// last message waited behind all the others
+void test_Last_Stage_Latency_Is_Measured() {
+  Fake[0].Count = 8;
+  Fake[1].Delay_us = 1000;
+  const PipeStageConfig Stages[] = {helper_Stage(helper_Source, &Fake[0], 8),
+                                    helper_Stage(helper_Sink, &Fake[1], 0)};
+  helper_Run(Stages, 2, 0);
+  PipeStageStats Stats;
+  Pipeline_Get_Stats(&Pipe, 1, &Stats);
+  TEST_ASSERT_EQUAL_UINT32(8, Stats.Out);
+  TEST_ASSERT_TRUE(Stats.Max_Latency_us >= 8 * 1000);
+  TEST_ASSERT_TRUE(Stats.First_Out_us >= 1000);
+  TEST_ASSERT_TRUE(Stats.Ended_us >= Stats.First_Out_us);
+}
+
+// the reply comes in pieces of 3 bytes, cut through words and numbers
+void test_Sentence_Stage_Splits_A_Streamed_Reply() {
+  helper_Speak_Reply("Hello there. The answer is 3.5 meters!\n**Bold** line "
+                     "two?  Yes: it is\n\nfine",
+                     3);
+  TEST_ASSERT_EQUAL_size_t(6, Spoken.Count);
+  TEST_ASSERT_EQUAL_STRING("Hello there.", Spoken.Sentence[0]);
+  TEST_ASSERT_EQUAL_STRING("The answer is 3.5 meters!", Spoken.Sentence[1]);
+  TEST_ASSERT_EQUAL_STRING("Bold line two?", Spoken.Sentence[2]);
+  TEST_ASSERT_EQUAL_STRING("Yes:", Spoken.Sentence[3]);
+  TEST_ASSERT_EQUAL_STRING("it is", Spoken.Sentence[4]);
+  TEST_ASSERT_EQUAL_STRING("fine", Spoken.Sentence[5]);
+}
+
+void test_Sentence_Stage_Cuts_A_Long_Sentence_At_A_Space() {
+  static char Long[3 * VOICE_SENTENCE_MAX];
+  size_t Len = 0;
+  for (int i = 0; Len + 8 < sizeof(Long); i++) {
+    Len += (size_t)snprintf(Long + Len, sizeof(Long) - Len, "word%d ", i % 10);
+  }
+  Long[Len - 1] = '\0'; // no space at the end
+  helper_Speak_Reply(Long, 50);
+  TEST_ASSERT_TRUE(Spoken.Count >= 3);
+  static char Joined[3 * VOICE_SENTENCE_MAX];
+  Joined[0] = '\0';
+  for (size_t i = 0; i < Spoken.Count; i++) {
+    TEST_ASSERT_LESS_THAN_size_t(VOICE_SENTENCE_MAX,
+                                 strlen(Spoken.Sentence[i]) + 1);
+    TEST_ASSERT_NOT_EQUAL(' ', Spoken.Sentence[i][0]);
+    if (i > 0) {
+      strcat(Joined, " ");
+    }
+    strcat(Joined, Spoken.Sentence[i]);
+  }
+  TEST_ASSERT_EQUAL_STRING(Long, Joined);
+}
+
+// i2s slots through convert and flac encode on their own threads come out
+// as the very file the encoder makes from the same pcm in one go
+void test_Convert_And_Encode_Match_The_Encoder() {
+  const AudioEncoderConfig Config = {&Audio_Codec_Flac, 16000, 0, 0, 0};
+  Frames_In = (FrameSource){.Frames = 40, .Speech_From = 0, .Speech_To = 40};
+  Convert_Ctx = (VoiceConvertCtx){.Convert = AUDIO_CONVERT_SPH0645};
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encode_Ctx.Encoder, &Config));
+  const PipeStageConfig Stages[] = {
+      helper_Stage(helper_Frame_Source, &Frames_In, 4),
+      helper_Stage(Voice_Convert_Stage, &Convert_Ctx, 4),
+      helper_Stage(Voice_Encode_Stage, &Encode_Ctx, 4),
+      helper_Stage(helper_Byte_Sink, &Bytes_Out, 0)};
+  helper_Run(Stages, 4, 0);
+
+  static AudioEncoder Reference;
+  static int16_t Pcm[40 * FRAME_SAMPLES];
+  static uint8_t Expected[MAX_ENCODED];
+  static uint8_t Out[AUDIO_CODEC_OUT_MAX];
+  size_t Expected_Len = 0;
+  for (uint32_t i = 0; i < 40 * FRAME_SAMPLES; i++) {
+    Pcm[i] = helper_Sample(&Frames_In, i);
+  }
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Reference, &Config));
+  for (size_t Done = 0; Done < 40 * FRAME_SAMPLES; Done += FRAME_SAMPLES) {
+    for (size_t Part = 0; Part < FRAME_SAMPLES;) {
+      size_t Count = FRAME_SAMPLES - Part < Reference.Block_Samples
+                         ? FRAME_SAMPLES - Part
+                         : Reference.Block_Samples;
+      size_t Len = Audio_Encoder_Push(&Reference, Pcm + Done + Part, Count, Out);
+      memcpy(Expected + Expected_Len, Out, Len);
+      Expected_Len += Len;
+      Part += Count;
+    }
+  }
+  size_t Len = Audio_Encoder_Finish(&Reference, Out);
+  memcpy(Expected + Expected_Len, Out, Len);
+  Expected_Len += Len;
+  TEST_ASSERT_EQUAL_size_t(Expected_Len, Bytes_Out.Len);
+  TEST_ASSERT_EQUAL_MEMORY(Expected, Bytes_Out.Bytes, Expected_Len);
+}
+
+// quiet, half a second of tone, then quiet for longer than the hangover.
+// the vad ends the question and the source that would go on for 10 s stops
+void test_Vad_End_Stops_The_Capture() {
+  const AudioVadConfig Vad = AUDIO_VAD_CONFIG_DEFAULT;
+  const AudioEncoderConfig Config = {&Audio_Codec_Wav, 16000, 0, 0, 0};
+  Frames_In = (FrameSource){.Frames = 500, .Speech_From = 10, .Speech_To = 35};
+  Convert_Ctx = (VoiceConvertCtx){.Convert = AUDIO_CONVERT_SPH0645,
+                                  .Use_Vad = true};
+  TEST_ASSERT_EQUAL_INT(0, Audio_Vad_Ini(&Convert_Ctx.Vad, &Vad,
+                                         Memory_Handler, 16000,
+                                         FRAME_SAMPLES));
+  TEST_ASSERT_EQUAL_INT(0, Audio_Encoder_Ini(&Encode_Ctx.Encoder, &Config));
+  const PipeStageConfig Stages[] = {
+      helper_Stage(helper_Frame_Source, &Frames_In, 4),
+      helper_Stage(Voice_Convert_Stage, &Convert_Ctx, 4),
+      helper_Stage(Voice_Encode_Stage, &Encode_Ctx, 4),
+      helper_Stage(helper_Byte_Sink, &Bytes_Out, 0)};
+  helper_Run(Stages, 4, 0);
+  TEST_ASSERT_TRUE(Frames_In.Sent < Frames_In.Frames);
+  AudioVadCounters Counters;
+  Audio_Vad_Get_Counters(&Convert_Ctx.Vad, &Counters);
+  TEST_ASSERT_EQUAL_UINT32(1, Counters.Segments);
+  // the wav holds the frames the vad let through and nothing else
+  TEST_ASSERT_EQUAL_size_t(44 + Counters.Frames_Passed * FRAME_SAMPLES * 2,
+                           Bytes_Out.Len);
+  TEST_ASSERT_TRUE(Counters.Frames_Passed >= 25);
+}
+
+// HELPER FUNCTIONS
+// numbered blocks, as fast as the pipeline takes them
+static PipeResult helper_Source(PipeStage *Stage, PipeMsg *In) {
+  FakeCtx *Ctx = (FakeCtx *)Stage->Config.Ctx;
+  if (Ctx->Sent == Ctx->Count) {
+    return PIPE_END;
+  }
+  uint32_t *Block = Pipe_Alloc(Stage, sizeof(uint32_t));
+  if (Block == NULL) {
+    return PIPE_END;
+  }
+  *Block = Ctx->Sent++;
+  return Pipe_Send(Stage, Block, sizeof(uint32_t)) ? PIPE_MORE : PIPE_END;
+}
+
+static PipeResult helper_Pass(PipeStage *Stage, PipeMsg *In) {
+  FakeCtx *Ctx = (FakeCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    Ctx->Flushes++;
+    return PIPE_END;
+  }
+  if (*(uint32_t *)In->Block != Ctx->Seen) {
+    Ctx->Out_Of_Order++;
+  }
+  if (!Pipe_Send(Stage, In->Block, In->Length)) {
+    return PIPE_END;
+  }
+  return helper_Count_And_Stop(Ctx);
+}
+
+// n in, 2n and 2n + 1 out in new blocks
+static PipeResult helper_Double(PipeStage *Stage, PipeMsg *In) {
+  FakeCtx *Ctx = (FakeCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    Ctx->Flushes++;
+    return PIPE_END;
+  }
+  for (uint32_t i = 0; i < 2; i++) {
+    uint32_t *Block = Pipe_Alloc(Stage, sizeof(uint32_t));
+    if (Block == NULL) {
+      return PIPE_END;
+    }
+    *Block = *(uint32_t *)In->Block * 2 + i;
+    if (!Pipe_Send(Stage, Block, sizeof(uint32_t))) {
+      return PIPE_END;
+    }
+  }
+  return helper_Count_And_Stop(Ctx);
+}
+
+static PipeResult helper_Sink(PipeStage *Stage, PipeMsg *In) {
+  FakeCtx *Ctx = (FakeCtx *)Stage->Config.Ctx;
+  if (In == NULL) {
+    Ctx->Flushes++;
+    return PIPE_END;
+  }
+  if (*(uint32_t *)In->Block != Ctx->Seen) {
+    Ctx->Out_Of_Order++;
+  }
+  Ctx->Sent += *(uint32_t *)In->Block; // the sum, for the pull test
+  return helper_Count_And_Stop(Ctx);
+}
+
+// the way the upload reads its body, then one message with the total
+static PipeResult helper_Pull_Sum(PipeStage *Stage, PipeMsg *In) {
+  FakeCtx *Ctx = (FakeCtx *)Stage->Config.Ctx;
+  uint32_t Sum = 0;
+  PipeMsg Msg;
+  while (Pipe_Receive(Stage, &Msg)) {
+    if (*(uint32_t *)Msg.Block != Ctx->Seen) {
+      Ctx->Out_Of_Order++;
+    }
+    Sum += *(uint32_t *)Msg.Block;
+    Ctx->Seen++;
+    Pipe_Free(Stage, Msg.Block);
+  }
+  uint32_t *Block = Pipe_Alloc(Stage, sizeof(uint32_t));
+  TEST_ASSERT_NOT_NULL(Block);
+  *Block = Sum;
+  Pipe_Send(Stage, Block, sizeof(uint32_t));
+  return PIPE_END;
+}
+
+static PipeResult helper_Text_Source(PipeStage *Stage, PipeMsg *In) {
+  TextSource *Ctx = (TextSource *)Stage->Config.Ctx;
+  const size_t Left = strlen(Ctx->Text) - Ctx->Pos;
+  if (Left == 0) {
+    return PIPE_END;
+  }
+  const size_t Take = Left < Ctx->Piece ? Left : Ctx->Piece;
+  char *Block = Pipe_Alloc(Stage, Take);
+  memcpy(Block, Ctx->Text + Ctx->Pos, Take);
+  Ctx->Pos += Take;
+  return Pipe_Send(Stage, Block, (uint32_t)Take) ? PIPE_MORE : PIPE_END;
+}
+
+// frames of raw slots the way the i2s task hands them over
+static PipeResult helper_Frame_Source(PipeStage *Stage, PipeMsg *In) {
+  FrameSource *Ctx = (FrameSource *)Stage->Config.Ctx;
+  if (Ctx->Sent == Ctx->Frames) {
+    return PIPE_END;
+  }
+  AudioFrame *Frame = Pipe_Alloc(Stage, FRAME_BYTES);
+  if (Frame == NULL) {
+    return PIPE_END;
+  }
+  for (uint32_t i = 0; i < FRAME_SAMPLES; i++) {
+    Frame->Data[i] = (int32_t)((uint32_t)helper_Sample(
+                                   Ctx, Ctx->Sent * FRAME_SAMPLES + i)
+                               << 14);
+  }
+  Frame->Sequence = Ctx->Sent++;
+  Frame->Sample_Count = FRAME_SAMPLES;
+  Frame->Format = AUDIO_FORMAT_I2S32;
+  Frame->Timestamp_us = Pipe_Now_us();
+  return Pipe_Send_At(Stage, Frame, FRAME_BYTES, Frame->Timestamp_us)
+             ? PIPE_MORE
+             : PIPE_END;
+}
+
+static PipeResult helper_Byte_Sink(PipeStage *Stage, PipeMsg *In) {
+  ByteSink *Ctx = (ByteSink *)Stage->Config.Ctx;
+  if (In == NULL) {
+    return PIPE_END;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL_size_t(MAX_ENCODED, Ctx->Len + In->Length);
+  memcpy(Ctx->Bytes + Ctx->Len, In->Block, In->Length);
+  Ctx->Len += In->Length;
+  return PIPE_MORE;
+}
+
+static bool helper_Speak(void *Ctx, const char *Text, size_t Len) {
+  SpokenText *Spoken_Text = (SpokenText *)Ctx;
+  TEST_ASSERT_LESS_THAN_size_t(MAX_SENTENCES, Spoken_Text->Count);
+  TEST_ASSERT_EQUAL_size_t(Len, strlen(Text));
+  memcpy(Spoken_Text->Sentence[Spoken_Text->Count++], Text, Len + 1);
+  return true;
+}
+
+static PipeResult helper_Count_And_Stop(FakeCtx *Ctx) {
+  Ctx->Seen++;
+  if (Ctx->Delay_us > 0) {
+    helper_Sleep_us(Ctx->Delay_us);
+  }
+  return Ctx->Stop_After > 0 && Ctx->Seen == Ctx->Stop_After ? Ctx->Stop_With
+                                                             : PIPE_MORE;
+}
+
+// a 250 Hz tone loud enough for the vad between Speech_From and Speech_To,
+// a quiet ramp the rest of the time
+static int16_t helper_Sample(const FrameSource *Source, uint32_t Index) {
+  const uint32_t Frame = Index / FRAME_SAMPLES;
+  if (Frame < Source->Speech_From || Frame >= Source->Speech_To) {
+    return (int16_t)(Index % 8);
+  }
+  const int16_t Square[] = {6000, 6000, -6000, -6000};
+  return Square[(Index / 16) % 4];
+}
+
+static void helper_Sleep_us(uint32_t Microseconds) {
+  const struct timespec Sleep = {0, (long)Microseconds * 1000};
+  nanosleep(&Sleep, NULL);
+}
+
+static PipeStageConfig helper_Stage(PipeProcess Process, void *Ctx,
+                                    size_t Depth) {
+  return (PipeStageConfig){.Name = "test", .Process = Process, .Ctx = Ctx,
+                           .Queue_Depth = Depth, .Core = -1};
+}
+
+static size_t helper_In_Use(void) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  size_t In_Use = 0;
+  for (size_t i = 0; i < Stats.Class_Count; i++) {
+    In_Use += Stats.Class[i].Counters.In_Use;
+  }
+  return In_Use;
+}
+
+static size_t helper_High_Water(size_t Class) {
+  PoolStats Stats;
+  TEST_ASSERT_TRUE(Pool_Get_Stats(Memory_Handler, &Stats));
+  return Stats.Class[Class].Counters.High_Water;
+}
+
+static void helper_Run(const PipeStageConfig *Stages, size_t Count,
+                       int Expected) {
+  TEST_ASSERT_EQUAL_INT(0,
+                        Pipeline_Ini(&Pipe, Memory_Handler, Stages, Count));
+  TEST_ASSERT_EQUAL_INT(0, Pipeline_Start(&Pipe));
+  TEST_ASSERT_EQUAL_INT(Expected, Pipeline_Wait(&Pipe));
+}
+
+static void helper_Speak_Reply(const char *Reply, size_t Piece) {
+  Text_In = (TextSource){.Text = Reply, .Piece = Piece};
+  const PipeStageConfig Stages[] = {
+      helper_Stage(helper_Text_Source, &Text_In, 4),
+      helper_Stage(Voice_Sentence_Stage, &Sentence_Ctx, 4),
+      helper_Stage(Voice_Speech_Stage, &Speech_Ctx, 0)};
+  helper_Run(Stages, 3, 0);
+}
+
+#endif
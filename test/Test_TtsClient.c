@@ -0,0 +1,562 @@
+/*Text to speech client unit tests
+    Written by Matthew Ayestaran
+    purpose: checks the speech request is framed with the escaped text and
+    the key, that pcm split anywhere by the reads comes back whole, that an
+    error reply keeps its start and hands on no audio, and that sentences
+    go out on one connection against an in-memory fake server. then against
+    the local https stand-in checks a sentence comes back as the stand-in's
+    voice, and runs a streamed reply through the sentence and speech stages
+    into a playback ring read in real time, checking the first sentence is
+    heard before the reply has finished arriving
+    run the stand-in with: python3 test/standin/https_standin.py --port 8443
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_TTS_CLIENT)
+
+#ifndef POOL_THREAD_SAFE
+#error "the pipeline frees blocks on other threads, build with POOL_THREAD_SAFE"
+#endif
+
+#include "AudioPlayback.h"
+#include "TtsClient.h"
+#include "VoiceStages.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <unity.h>
+
+// fake server, every request gets Reply back. binary safe, pcm has zeros
+typedef struct {
+    const uint8_t *Reply;
+    size_t Reply_Len;
+    size_t Reply_Pos;
+    bool Reply_Pending;
+    size_t Read_Step; // most bytes handed out per read, 0 for all
+    int Connects;
+    char Written[4096];
+    size_t Written_Len;
+} FakeServer;
+
+// audio collected by the pcm callback
+typedef struct {
+    int16_t Samples[16384];
+    size_t Count;
+    size_t Stop_After; // samples, 0 never stops
+    int Calls;
+} PcmSink;
+
+// openssl client for the stand-in, as in Test_GeminiSession
+typedef struct {
+    SSL *Tls;
+    SSL_SESSION *Ticket;
+    bool Resumed;
+} TlsClient;
+
+// reply text handed over a piece at a time, as it streams from gemini
+typedef struct {
+    const char *Text;
+    size_t Piece;
+    uint32_t Delay_us; // per piece
+    size_t Pos;
+    int64_t Last_us;   // when the last piece went
+} TextSource;
+
+// the speech end on the host, the client writes into the ring that a
+// reader thread plays out a dma buffer at a time in real time
+typedef struct {
+    tts_client_t *Client;
+    AudioPlayback *Playback;
+    int Sentences;
+    int64_t First_Ttfb_us;
+} RingSpeaker;
+
+typedef struct {
+    AudioPlayback *Playback;
+    atomic_bool Stop;
+    int64_t First_Audio_us; // -1 until the first sample is played
+    size_t Played;
+} RingReader;
+
+// standard values
+#define PCM_SAMPLES 1000
+#define SPEECH_RATE 24000           // as the stand-in
+#define SPEECH_SAMPLES_PER_BYTE 480 // as the stand-in
+#define PLAY_FRAME 480              // 20 ms at 24 kHz
+#define PLAY_RING 32768
+static FakeServer Server;
+static gemini_session_t Session;
+static tts_client_t Client;
+static PcmSink Sink;
+static int64_t Fake_Now_us;
+static uint8_t Reply[PCM_SAMPLES * 2 + 256];
+static const char *Error_Reply =
+    "HTTP/1.1 400 Bad Request\r\nContent-Type: application/json\r\nContent-Length: 56\r\n\r\n"
+    "{\"error\":{\"message\":\"voice not found\",\"type\":\"invalid\"}}";
+static const PoolClassConfig Pipe_Classes[] = {{64, 32, 0}, {VOICE_SENTENCE_MAX, 16, 0}};
+
+// PROTOTYPING HELPERS
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Fake_Close(void *ctx);
+static bool helper_Fake_Resumed(void *ctx);
+static int64_t helper_Fake_Clock(void);
+static int16_t helper_Sample(size_t i);
+static void helper_Pcm_Reply(size_t samples);
+static bool helper_Sink_Pcm(void *ctx, const int16_t *samples, size_t count);
+static int16_t helper_Voice_Sample(const char *text, size_t i);
+static void helper_Sleep_us(uint32_t microseconds);
+static PipeResult helper_Text_Source(PipeStage *stage, PipeMsg *in);
+static bool helper_Ring_Speak(void *ctx, const char *text, size_t len);
+static bool helper_Ring_Pcm(void *ctx, const int16_t *samples, size_t count);
+static void *helper_Ring_Reader(void *arg);
+static bool helper_Standin_Session(gemini_session_t *session, TlsClient *client);
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms);
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len);
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms);
+static void helper_Tls_Close(void *ctx);
+static bool helper_Tls_Resumed(void *ctx);
+
+// PROTOTYPING TESTS
+void test_Request_Is_Framed();
+void test_Pcm_Split_Anywhere_Is_Reassembled();
+void test_Error_Status_Keeps_The_Start_Of_The_Reply();
+void test_Callback_Stops_The_Sentence();
+void test_Text_Too_Long_Is_Refused();
+void test_Sentences_Share_One_Connection();
+void test_Standin_Sentence_Is_Its_Voice();
+void test_Standin_First_Sentence_Heard_Before_The_Reply_Ends();
+
+//================================CODE
+// START=============================================
+void setUp(void) {
+    memset(&Server, 0, sizeof(Server));
+    memset(&Sink, 0, sizeof(Sink));
+    helper_Pcm_Reply(PCM_SAMPLES);
+    Fake_Now_us = 1000000;
+    const gemini_transport_t Transport = {helper_Fake_Connect, helper_Fake_Write, helper_Fake_Read,
+                                          helper_Fake_Close, &Server, helper_Fake_Resumed};
+    gemini_session_init(&Session, &Transport, "speech.example.com", 443, NULL);
+    Session.now_us = helper_Fake_Clock;
+    const tts_config_t Config = {"/v1/audio/speech", "tts-1", "alloy", "sk-test", 24000};
+    tts_client_init(&Client, &Session, &Config);
+}
+void tearDown(void) { gemini_session_close(&Session); }
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Request_Is_Framed);
+    RUN_TEST(test_Pcm_Split_Anywhere_Is_Reassembled);
+    RUN_TEST(test_Error_Status_Keeps_The_Start_Of_The_Reply);
+    RUN_TEST(test_Callback_Stops_The_Sentence);
+    RUN_TEST(test_Text_Too_Long_Is_Refused);
+    RUN_TEST(test_Sentences_Share_One_Connection);
+    RUN_TEST(test_Standin_Sentence_Is_Its_Voice);
+    RUN_TEST(test_Standin_First_Sentence_Heard_Before_The_Reply_Ends);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Request_Is_Framed() {
+    const char *Text = "Say \"hi\"\nthen go.";
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Client, Text, 9, helper_Sink_Pcm, &Sink));
+    Server.Written[Server.Written_Len] = '\0';
+    TEST_ASSERT_EQUAL_INT(0, strncmp("POST /v1/audio/speech HTTP/1.1\r\n", Server.Written, 32));
+    TEST_ASSERT_NOT_NULL(strstr(Server.Written, "\r\nAuthorization: Bearer sk-test\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(Server.Written, "\r\nContent-Type: application/json\r\n"));
+    TEST_ASSERT_NOT_NULL(strstr(Server.Written, "\r\n\r\n{\"model\":\"tts-1\",\"voice\":\"alloy\","
+                                                "\"response_format\":\"pcm\",\"input\":\"Say \\\"hi\\\"\\n\"}"));
+}
+
+// odd reads split samples between them, every one must come back whole
+void test_Pcm_Split_Anywhere_Is_Reassembled() {
+    Server.Read_Step = 7;
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Client, "Hello.", 6, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_EQUAL_size_t(PCM_SAMPLES, Sink.Count);
+    for (size_t i = 0; i < PCM_SAMPLES; i++) {
+        TEST_ASSERT_EQUAL_INT16(helper_Sample(i), Sink.Samples[i]);
+    }
+    TEST_ASSERT_EQUAL_size_t(PCM_SAMPLES, Client.timing.samples);
+    TEST_ASSERT_EQUAL_UINT32(1, Client.sentences);
+}
+
+void test_Error_Status_Keeps_The_Start_Of_The_Reply() {
+    Server.Reply = (const uint8_t *)Error_Reply;
+    Server.Reply_Len = strlen(Error_Reply);
+    TEST_ASSERT_EQUAL_INT(TTS_ERR_STATUS, tts_client_speak(&Client, "Hello.", 6, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_EQUAL_INT(400, Client.status);
+    TEST_ASSERT_EQUAL_INT(0, Sink.Calls);
+    TEST_ASSERT_NOT_NULL(strstr(Client.error_head, "voice not found"));
+    TEST_ASSERT_EQUAL_UINT32(0, Client.sentences);
+}
+
+void test_Callback_Stops_The_Sentence() {
+    Sink.Stop_After = 200;
+    TEST_ASSERT_EQUAL_INT(TTS_ERR_ABORTED, tts_client_speak(&Client, "Hello.", 6, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_LESS_THAN_size_t(PCM_SAMPLES, Sink.Count);
+}
+
+// escaping can push text that fits over the limit, neither goes out
+void test_Text_Too_Long_Is_Refused() {
+    static char Text[TTS_TEXT_MAX + 1];
+    memset(Text, 'a', sizeof(Text));
+    TEST_ASSERT_EQUAL_INT(TTS_ERR_ARG, tts_client_speak(&Client, Text, sizeof(Text), helper_Sink_Pcm, &Sink));
+    memset(Text, '"', TTS_TEXT_MAX / 2 + 1);
+    TEST_ASSERT_EQUAL_INT(TTS_ERR_ARG, tts_client_speak(&Client, Text, TTS_TEXT_MAX / 2 + 1, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_EQUAL_INT(TTS_ERR_ARG, tts_client_speak(&Client, Text, 0, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_EQUAL_INT(0, Server.Connects);
+}
+
+void test_Sentences_Share_One_Connection() {
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Client, "One.", 4, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_FALSE(Client.timing.reused);
+    Sink.Count = 0;
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Client, "Two.", 4, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_TRUE(Client.timing.reused);
+    TEST_ASSERT_EQUAL_size_t(PCM_SAMPLES, Sink.Count);
+    TEST_ASSERT_EQUAL_INT(1, Server.Connects);
+    TEST_ASSERT_EQUAL_UINT32(2, Client.sentences);
+}
+
+// skipped when the stand-in isn't running
+void test_Standin_Sentence_Is_Its_Voice() {
+    TlsClient Tls = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Tls)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    tts_client_t Speech;
+    tts_client_init(&Speech, &Standin, NULL);
+    const char *Text = "Hi there, caf\xc3\xa9!";
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Speech, Text, strlen(Text), helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_EQUAL_size_t(strlen(Text) * SPEECH_SAMPLES_PER_BYTE, Sink.Count);
+    for (size_t i = 0; i < Sink.Count; i++) {
+        TEST_ASSERT_EQUAL_INT16(helper_Voice_Sample(Text, i), Sink.Samples[i]);
+    }
+    Sink.Count = 0;
+    TEST_ASSERT_EQUAL_INT(TTS_OK, tts_client_speak(&Speech, "Ok.", 3, helper_Sink_Pcm, &Sink));
+    TEST_ASSERT_TRUE(Speech.timing.reused);
+
+    char Line[128];
+    snprintf(Line, sizeof(Line), "warm sentence: first byte %lld us, first audio %lld us, all %lld us",
+             (long long)Speech.timing.ttfb_us, (long long)Speech.timing.first_audio_us,
+             (long long)Speech.timing.total_us);
+    TEST_MESSAGE(Line);
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Tls.Ticket);
+}
+
+// the reply streams in over about a second and a half, the sentence stage
+// cuts it and each sentence is spoken while the rest is still coming
+void test_Standin_First_Sentence_Heard_Before_The_Reply_Ends() {
+    TlsClient Tls = {0};
+    gemini_session_t Standin;
+    if (!helper_Standin_Session(&Standin, &Tls)) {
+        TEST_IGNORE_MESSAGE("https stand-in not running, see test/standin/https_standin.py");
+    }
+    tts_client_t Speech;
+    tts_client_init(&Speech, &Standin, NULL);
+    static int16_t Ring[PLAY_RING];
+    AudioPlayback Playback;
+    TEST_ASSERT_EQUAL_INT(0, Audio_Playback_Ini(&Playback, Ring, PLAY_RING, SPEECH_RATE / 10));
+    TEST_ASSERT_EQUAL_INT(GEMINI_SESSION_OK, gemini_session_connect(&Standin)); // the button press prewarm
+
+    const char *Text = "The tide is in. It turns at four! Then the sand bar is dry for an hour.";
+    TextSource Source = {.Text = Text, .Piece = 6, .Delay_us = 100000};
+    RingSpeaker Speaker = {.Client = &Speech, .Playback = &Playback};
+    RingReader Reader = {.Playback = &Playback, .First_Audio_us = -1};
+    VoiceSentenceCtx Sentence_Ctx = {0};
+    VoiceSpeechCtx Speech_Ctx = {.Speak = helper_Ring_Speak, .Ctx = &Speaker};
+    const PipeStageConfig Stages[] = {
+        {.Name = "text", .Process = helper_Text_Source, .Ctx = &Source, .Queue_Depth = 4, .Core = -1},
+        {.Name = "sentence", .Process = Voice_Sentence_Stage, .Ctx = &Sentence_Ctx, .Queue_Depth = 4, .Core = -1},
+        {.Name = "speech", .Process = Voice_Speech_Stage, .Ctx = &Speech_Ctx, .Core = -1},
+    };
+    PoolMemoryInfo *Pool = Pool_Ini_Config(Pipe_Classes, 2);
+    TEST_ASSERT_NOT_NULL(Pool);
+    static Pipeline Pipe;
+    pthread_t Reader_Thread;
+    pthread_create(&Reader_Thread, NULL, helper_Ring_Reader, &Reader);
+    const int64_t Start_us = Pipe_Now_us();
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Ini(&Pipe, Pool, Stages, 3));
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Start(&Pipe));
+    TEST_ASSERT_EQUAL_INT(0, Pipeline_Wait(&Pipe));
+    while (!Audio_Playback_Idle(&Playback)) {
+        helper_Sleep_us(10000);
+    }
+    atomic_store(&Reader.Stop, true);
+    pthread_join(Reader_Thread, NULL);
+    Pipeline_Deinit(&Pipe);
+    Pool_Destroy(Pool);
+
+    AudioPlaybackCounters Counters;
+    Audio_Playback_Get_Counters(&Playback, &Counters);
+    TEST_ASSERT_EQUAL_INT(3, Speaker.Sentences);
+    TEST_ASSERT_EQUAL_size_t((strlen(Text) - 2) * SPEECH_SAMPLES_PER_BYTE, Reader.Played); // the spaces between
+    TEST_ASSERT_TRUE(Reader.First_Audio_us >= 0);
+    TEST_ASSERT_TRUE(Reader.First_Audio_us < Source.Last_us);
+
+    char Line[160];
+    snprintf(Line, sizeof(Line), "first audio heard %lld ms in, last text at %lld ms, first sentence ttfb %lld ms",
+             (long long)(Reader.First_Audio_us - Start_us) / 1000, (long long)(Source.Last_us - Start_us) / 1000,
+             (long long)Speaker.First_Ttfb_us / 1000);
+    TEST_MESSAGE(Line);
+    snprintf(Line, sizeof(Line), "playback: %u starts, %u underruns, ring high water %u samples",
+             (unsigned)Counters.Starts, (unsigned)Counters.Underruns, (unsigned)Counters.High_Water);
+    TEST_MESSAGE(Line);
+    gemini_session_close(&Standin);
+    SSL_SESSION_free(Tls.Ticket);
+}
+
+// HELPER FUNCTIONS
+static int helper_Fake_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    Fake->Connects++;
+    Fake->Reply_Pending = false;
+    Fake_Now_us += 100000;
+    return 0;
+}
+
+static int helper_Fake_Write(void *ctx, const uint8_t *data, size_t len) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    size_t Room = sizeof(Fake->Written) - 1 - Fake->Written_Len;
+    size_t Copy = len < Room ? len : Room;
+    memcpy(Fake->Written + Fake->Written_Len, data, Copy);
+    Fake->Written_Len += Copy;
+    return (int)len;
+}
+
+static int helper_Fake_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    FakeServer *Fake = (FakeServer *)ctx;
+    if (!Fake->Reply_Pending) {
+        Fake->Reply_Pending = true;
+        Fake->Reply_Pos = 0;
+    }
+    size_t Left = Fake->Reply_Len - Fake->Reply_Pos;
+    if (Left == 0) {
+        return GEMINI_TRANSPORT_TIMEOUT;
+    }
+    size_t Step = Fake->Read_Step ? Fake->Read_Step : Left;
+    size_t Copy = Left < Step ? Left : Step;
+    Copy = Copy < len ? Copy : len;
+    memcpy(buf, Fake->Reply + Fake->Reply_Pos, Copy);
+    Fake->Reply_Pos += Copy;
+    Fake_Now_us += 1000;
+    if (Fake->Reply_Pos == Fake->Reply_Len) {
+        Fake->Reply_Pending = false;
+    }
+    return (int)Copy;
+}
+
+static void helper_Fake_Close(void *ctx) {}
+
+static bool helper_Fake_Resumed(void *ctx) { return false; }
+
+static int64_t helper_Fake_Clock(void) { return Fake_Now_us; }
+
+static int16_t helper_Sample(size_t i) { return (int16_t)(i * 2654435761u >> 16); }
+
+// a 200 with samples of little endian pcm after the headers
+static void helper_Pcm_Reply(size_t samples) {
+    int Head = snprintf((char *)Reply, sizeof(Reply),
+                        "HTTP/1.1 200 OK\r\nContent-Type: audio/pcm\r\nContent-Length: %u\r\n\r\n",
+                        (unsigned)(samples * 2));
+    for (size_t i = 0; i < samples; i++) {
+        uint16_t Sample = (uint16_t)helper_Sample(i);
+        Reply[Head + 2 * i] = (uint8_t)Sample;
+        Reply[Head + 2 * i + 1] = (uint8_t)(Sample >> 8);
+    }
+    Server.Reply = Reply;
+    Server.Reply_Len = (size_t)Head + samples * 2;
+}
+
+static bool helper_Sink_Pcm(void *ctx, const int16_t *samples, size_t count) {
+    PcmSink *Pcm = (PcmSink *)ctx;
+    Pcm->Calls++;
+    TEST_ASSERT_TRUE(count > 0);
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(sizeof(Pcm->Samples) / sizeof(Pcm->Samples[0]), Pcm->Count + count);
+    memcpy(Pcm->Samples + Pcm->Count, samples, count * sizeof(int16_t));
+    Pcm->Count += count;
+    return Pcm->Stop_After == 0 || Pcm->Count < Pcm->Stop_After;
+}
+
+// speech_samples in the stand-in
+static int16_t helper_Voice_Sample(const char *text, size_t i) {
+    const uint8_t Byte = (uint8_t)text[i / SPEECH_SAMPLES_PER_BYTE];
+    return (int16_t)((Byte * 37 + (i % SPEECH_SAMPLES_PER_BYTE) * 11) % 2001 - 1000);
+}
+
+static void helper_Sleep_us(uint32_t microseconds) {
+    const struct timespec Sleep = {microseconds / 1000000, (long)(microseconds % 1000000) * 1000};
+    nanosleep(&Sleep, NULL);
+}
+
+static PipeResult helper_Text_Source(PipeStage *stage, PipeMsg *in) {
+    TextSource *Ctx = (TextSource *)stage->Config.Ctx;
+    const size_t Left = strlen(Ctx->Text) - Ctx->Pos;
+    if (Left == 0) {
+        return PIPE_END;
+    }
+    helper_Sleep_us(Ctx->Delay_us);
+    const size_t Take = Left < Ctx->Piece ? Left : Ctx->Piece;
+    char *Block = Pipe_Alloc(stage, Take);
+    memcpy(Block, Ctx->Text + Ctx->Pos, Take);
+    Ctx->Pos += Take;
+    Ctx->Last_us = Pipe_Now_us();
+    return Pipe_Send(stage, Block, (uint32_t)Take) ? PIPE_MORE : PIPE_END;
+}
+
+// a VoiceSpeakFn, what Voice_Tts_Speak does on the board
+static bool helper_Ring_Speak(void *ctx, const char *text, size_t len) {
+    RingSpeaker *Speaker = (RingSpeaker *)ctx;
+    tts_err_t Err = tts_client_speak(Speaker->Client, text, len, helper_Ring_Pcm, Speaker);
+    Audio_Playback_Mark_End(Speaker->Playback);
+    if (Err != TTS_OK) {
+        return false;
+    }
+    if (Speaker->Sentences++ == 0) {
+        Speaker->First_Ttfb_us = Speaker->Client->timing.ttfb_us;
+    }
+    return true;
+}
+
+// waits for room the way I2S_Speaker_Write does
+static bool helper_Ring_Pcm(void *ctx, const int16_t *samples, size_t count) {
+    RingSpeaker *Speaker = (RingSpeaker *)ctx;
+    size_t Done = 0;
+    while (Done < count) {
+        size_t Took = Audio_Playback_Write(Speaker->Playback, samples + Done, count - Done);
+        if (Took == 0) {
+            helper_Sleep_us(5000);
+        }
+        Done += Took;
+    }
+    return true;
+}
+
+// the i2s task, a dma buffer every 20 ms
+static void *helper_Ring_Reader(void *arg) {
+    RingReader *Reader = (RingReader *)arg;
+    int16_t Frame[PLAY_FRAME];
+    int64_t Next_us = Pipe_Now_us();
+    while (!atomic_load(&Reader->Stop)) {
+        size_t Got = Audio_Playback_Read(Reader->Playback, Frame, PLAY_FRAME);
+        if (Got > 0 && Reader->First_Audio_us < 0) {
+            Reader->First_Audio_us = Pipe_Now_us();
+        }
+        Reader->Played += Got;
+        Next_us += PLAY_FRAME * 1000000LL / SPEECH_RATE;
+        int64_t Wait_us = Next_us - Pipe_Now_us();
+        if (Wait_us > 0) {
+            helper_Sleep_us((uint32_t)Wait_us);
+        }
+    }
+    return NULL;
+}
+
+// session on the stand-in, false when it isn't running
+static bool helper_Standin_Session(gemini_session_t *session, TlsClient *client) {
+    const char *Port = getenv("GEMINI_STANDIN_PORT");
+    const gemini_transport_t Transport = {helper_Tls_Connect, helper_Tls_Write, helper_Tls_Read,
+                                          helper_Tls_Close, client, helper_Tls_Resumed};
+    gemini_session_init(session, &Transport, "127.0.0.1", Port ? atoi(Port) : 8443, NULL);
+    if (gemini_session_connect(session) != GEMINI_SESSION_OK) {
+        return false;
+    }
+    gemini_session_close(session);
+    return true;
+}
+
+// openssl transport for the stand-in, its certificate is self signed so it
+// isn't verified
+static int helper_Tls_Connect(void *ctx, const char *host, int port, int timeout_ms) {
+    TlsClient *Client = (TlsClient *)ctx;
+    static SSL_CTX *Tls_Context;
+    if (!Tls_Context) {
+        Tls_Context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_max_proto_version(Tls_Context, TLS1_2_VERSION);
+    }
+    char Port[8];
+    snprintf(Port, sizeof(Port), "%d", port);
+    struct addrinfo Hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *Address;
+    if (getaddrinfo(host, Port, &Hints, &Address) != 0) {
+        return -1;
+    }
+    int Socket = socket(Address->ai_family, Address->ai_socktype, 0);
+    int Connected = Socket >= 0 ? connect(Socket, Address->ai_addr, Address->ai_addrlen) : -1;
+    freeaddrinfo(Address);
+    if (Connected != 0) {
+        if (Socket >= 0) {
+            close(Socket);
+        }
+        return -1;
+    }
+    int No_Delay = 1;
+    setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, &No_Delay, sizeof(No_Delay));
+    Client->Tls = SSL_new(Tls_Context);
+    SSL_set_fd(Client->Tls, Socket);
+    if (Client->Ticket) {
+        SSL_set_session(Client->Tls, Client->Ticket);
+    }
+    if (SSL_connect(Client->Tls) != 1) {
+        helper_Tls_Close(ctx);
+        return -1;
+    }
+    Client->Resumed = SSL_session_reused(Client->Tls);
+    SSL_SESSION_free(Client->Ticket);
+    Client->Ticket = SSL_get1_session(Client->Tls);
+    return 0;
+}
+
+static int helper_Tls_Write(void *ctx, const uint8_t *data, size_t len) {
+    int Sent = SSL_write(((TlsClient *)ctx)->Tls, data, (int)len);
+    return Sent > 0 ? Sent : -1;
+}
+
+static int helper_Tls_Read(void *ctx, uint8_t *buf, size_t len, int timeout_ms) {
+    SSL *Tls = ((TlsClient *)ctx)->Tls;
+    if (SSL_pending(Tls) == 0) {
+        struct pollfd Wait = {.fd = SSL_get_fd(Tls), .events = POLLIN};
+        int Ready = poll(&Wait, 1, timeout_ms);
+        if (Ready == 0) {
+            return GEMINI_TRANSPORT_TIMEOUT;
+        }
+        if (Ready < 0) {
+            return -1;
+        }
+    }
+    int Got = SSL_read(Tls, buf, (int)len);
+    if (Got > 0) {
+        return Got;
+    }
+    return SSL_get_error(Tls, Got) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+}
+
+static void helper_Tls_Close(void *ctx) {
+    TlsClient *Client = (TlsClient *)ctx;
+    if (Client->Tls) {
+        int Socket = SSL_get_fd(Client->Tls);
+        SSL_shutdown(Client->Tls);
+        SSL_free(Client->Tls);
+        close(Socket);
+        Client->Tls = NULL;
+    }
+}
+
+static bool helper_Tls_Resumed(void *ctx) { return ((TlsClient *)ctx)->Resumed; }
+
+#endif
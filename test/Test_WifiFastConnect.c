@@ -0,0 +1,172 @@
+/*Wifi fast connect unit tests
+    Written by Matthew Ayestaran
+    purpose: checks a record is only trusted for the network it was made on
+    and when nothing in it is out of range (it comes back from flash), that
+    the plan only skips the scan and dhcp when the record allows it and a
+    static address always wins, and that an unchanged record compares the
+    same so it isn't written to flash again
+    run with: pio test -e native_wifi_fast
+*/
+
+#if defined(UNIT_TEST) && defined(TEST_WIFI_FAST_CONNECT)
+
+#include "WifiFastConnect.h"
+#include <string.h>
+#include <unity.h>
+
+// standard values
+static const char *Ssid = "HomeNet";
+static const uint8_t Bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+static const wifi_ip_config_t Lease = {0x6401a8c0, 0x00ffffff, 0x0101a8c0, 0x0101a8c0}; // 192.168.1.100/24
+static wifi_fast_record_t Record;
+
+// PROTOTYPING HELPERS
+static void helper_Expect_Plan(bool directed, wifi_ip_mode_t ip_mode, wifi_fast_plan_t plan);
+
+// PROTOTYPING TESTS
+void test_Filled_Record_Is_Valid();
+void test_Record_For_Another_Network_Is_Not_Used();
+void test_Damaged_Record_Is_Not_Used();
+void test_Fill_Rejects_What_Cant_Be_Stored();
+void test_No_Record_Scans_With_Dhcp();
+void test_Valid_Record_Connects_Directed();
+void test_Lease_Only_On_A_Directed_Connect();
+void test_Static_Address_Always_Wins();
+void test_Unchanged_Record_Compares_Same();
+void test_Ip_Mode_Names();
+
+//================================CODE
+// START=============================================
+void setUp(void) { TEST_ASSERT_TRUE(wifi_fast_record_fill(&Record, Ssid, Bssid, 6, &Lease)); }
+void tearDown(void) {}
+
+int main(void) {
+
+    UNITY_BEGIN(); // Starts the test runner
+
+    RUN_TEST(test_Filled_Record_Is_Valid);
+    RUN_TEST(test_Record_For_Another_Network_Is_Not_Used);
+    RUN_TEST(test_Damaged_Record_Is_Not_Used);
+    RUN_TEST(test_Fill_Rejects_What_Cant_Be_Stored);
+    RUN_TEST(test_No_Record_Scans_With_Dhcp);
+    RUN_TEST(test_Valid_Record_Connects_Directed);
+    RUN_TEST(test_Lease_Only_On_A_Directed_Connect);
+    RUN_TEST(test_Static_Address_Always_Wins);
+    RUN_TEST(test_Unchanged_Record_Compares_Same);
+    RUN_TEST(test_Ip_Mode_Names);
+
+    return UNITY_END(); // Ends the test runner and prints a summary
+}
+
+// TEST FUNCTIONS
+void test_Filled_Record_Is_Valid() {
+    TEST_ASSERT_TRUE(wifi_fast_record_valid(&Record, Ssid));
+    TEST_ASSERT_EQUAL_UINT32(WIFI_FAST_RECORD_VERSION, Record.version);
+    TEST_ASSERT_EQUAL_MEMORY(Bssid, Record.bssid, 6);
+    TEST_ASSERT_EQUAL_UINT8(6, Record.channel);
+    TEST_ASSERT_TRUE(Record.has_lease);
+    TEST_ASSERT_EQUAL_HEX32(Lease.ip, Record.lease.ip);
+    wifi_fast_record_t No_Lease;
+    TEST_ASSERT_TRUE(wifi_fast_record_fill(&No_Lease, Ssid, Bssid, 1, NULL));
+    TEST_ASSERT_TRUE(wifi_fast_record_valid(&No_Lease, Ssid));
+    TEST_ASSERT_FALSE(No_Lease.has_lease);
+}
+
+// new credentials for a different network must scan
+void test_Record_For_Another_Network_Is_Not_Used() {
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Record, "HomeNet5G"));
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Record, "HomeNe"));
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Record, NULL));
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(NULL, Ssid));
+}
+
+void test_Damaged_Record_Is_Not_Used() {
+    wifi_fast_record_t Bad = Record;
+    Bad.version = WIFI_FAST_RECORD_VERSION + 1; // layout from another firmware
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad = Record;
+    memset(Bad.ssid, 'a', sizeof(Bad.ssid)); // no nul
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad = Record;
+    memset(Bad.bssid, 0, sizeof(Bad.bssid));
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad = Record;
+    Bad.channel = 0;
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad.channel = 15;
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad = Record;
+    Bad.lease.ip = 0;
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Bad, Ssid));
+    Bad.has_lease = false; // the lease isn't looked at without the flag
+    TEST_ASSERT_TRUE(wifi_fast_record_valid(&Bad, Ssid));
+}
+
+void test_Fill_Rejects_What_Cant_Be_Stored() {
+    wifi_fast_record_t Other;
+    const char *Longest = "0123456789abcdef0123456789abcdef";
+    TEST_ASSERT_TRUE(wifi_fast_record_fill(&Other, Longest, Bssid, 11, NULL));
+    TEST_ASSERT_TRUE(wifi_fast_record_valid(&Other, Longest));
+    TEST_ASSERT_FALSE(wifi_fast_record_fill(&Other, "0123456789abcdef0123456789abcdefX", Bssid, 11, NULL));
+    TEST_ASSERT_FALSE(wifi_fast_record_valid(&Other, Longest)); // a refused fill leaves nothing usable
+    TEST_ASSERT_FALSE(wifi_fast_record_fill(&Other, Ssid, Bssid, 0, NULL));
+    TEST_ASSERT_FALSE(wifi_fast_record_fill(&Other, Ssid, Bssid, 15, NULL));
+    TEST_ASSERT_TRUE(wifi_fast_record_fill(&Other, Ssid, Bssid, 14, NULL));
+}
+
+void test_No_Record_Scans_With_Dhcp() {
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(NULL, Ssid, true, true, false));
+    wifi_fast_record_t Empty = {0}; // nothing in nvs yet
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(&Empty, Ssid, true, true, false));
+}
+
+void test_Valid_Record_Connects_Directed() {
+    helper_Expect_Plan(true, WIFI_IP_DHCP, wifi_fast_plan(&Record, Ssid, true, false, false));
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(&Record, Ssid, false, false, false));
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(&Record, "Other", true, false, false));
+}
+
+// an address is only taken again from the access point that handed it out
+void test_Lease_Only_On_A_Directed_Connect() {
+    helper_Expect_Plan(true, WIFI_IP_LEASE, wifi_fast_plan(&Record, Ssid, true, true, false));
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(&Record, Ssid, false, true, false));
+    helper_Expect_Plan(false, WIFI_IP_DHCP, wifi_fast_plan(&Record, "Other", true, true, false));
+    wifi_fast_record_t No_Lease;
+    wifi_fast_record_fill(&No_Lease, Ssid, Bssid, 6, NULL);
+    helper_Expect_Plan(true, WIFI_IP_DHCP, wifi_fast_plan(&No_Lease, Ssid, true, true, false));
+}
+
+void test_Static_Address_Always_Wins() {
+    helper_Expect_Plan(true, WIFI_IP_STATIC, wifi_fast_plan(&Record, Ssid, true, true, true));
+    helper_Expect_Plan(false, WIFI_IP_STATIC, wifi_fast_plan(NULL, Ssid, true, true, true));
+    helper_Expect_Plan(false, WIFI_IP_STATIC, wifi_fast_plan(&Record, Ssid, false, false, true));
+}
+
+void test_Unchanged_Record_Compares_Same() {
+    wifi_fast_record_t Again;
+    wifi_fast_record_fill(&Again, Ssid, Bssid, 6, &Lease);
+    TEST_ASSERT_TRUE(wifi_fast_record_same(&Record, &Again));
+    Again.lease.gw = 0xfe01a8c0; // renewed onto another network
+    TEST_ASSERT_FALSE(wifi_fast_record_same(&Record, &Again));
+    wifi_fast_record_fill(&Again, Ssid, Bssid, 11, &Lease); // the access point changed channel
+    TEST_ASSERT_FALSE(wifi_fast_record_same(&Record, &Again));
+    const uint8_t Other_Bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x57};
+    wifi_fast_record_fill(&Again, Ssid, Other_Bssid, 6, &Lease); // roamed to a second access point
+    TEST_ASSERT_FALSE(wifi_fast_record_same(&Record, &Again));
+    wifi_fast_record_fill(&Again, Ssid, Bssid, 6, NULL);
+    TEST_ASSERT_FALSE(wifi_fast_record_same(&Record, &Again));
+}
+
+void test_Ip_Mode_Names() {
+    TEST_ASSERT_EQUAL_STRING("dhcp", wifi_ip_mode_name(WIFI_IP_DHCP));
+    TEST_ASSERT_EQUAL_STRING("static", wifi_ip_mode_name(WIFI_IP_STATIC));
+    TEST_ASSERT_EQUAL_STRING("reused lease", wifi_ip_mode_name(WIFI_IP_LEASE));
+}
+
+// HELPER FUNCTIONS
+static void helper_Expect_Plan(bool directed, wifi_ip_mode_t ip_mode, wifi_fast_plan_t plan) {
+    TEST_ASSERT_EQUAL(directed, plan.directed);
+    TEST_ASSERT_EQUAL_STRING(wifi_ip_mode_name(ip_mode), wifi_ip_mode_name(plan.ip_mode));
+}
+
+#endif
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""WAV fixtures for the voice activity tests
+    Written by Matthew Ayestaran
+    purpose: writes the clips test/Test_AudioVad.c runs through the
+    detector, 16 kHz 16-bit mono like the capture task hands over. room
+    noise around voiced phrases (harmonics of a wandering pitch under a
+    syllable envelope), a fricative ahead of a phrase, pauses either side
+    of the hangover and a click that mustn't count as speech. every edge
+    falls on a 20 ms frame so the expected times in the test are exact.
+    the output is the same on every run, a recording from the board can
+    replace any clip as long as its speech still falls where the test
+    expects it
+    run with: python3 test/fixtures/make_vad_fixtures.py
+"""
+
+import math
+import os
+import random
+import struct
+import wave
+
+RATE = 16000
+HERE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "vad")
+
+
+def noise(rng, seconds, rms=60):
+    return [rng.gauss(0, rms) for _ in range(int(seconds * RATE))]
+
+
+def voiced(rng, seconds, rms=3000):
+    out = []
+    phase = 0.0
+    for n in range(int(seconds * RATE)):
+        t = n / RATE
+        pitch = 140 + 20 * math.sin(2 * math.pi * 1.5 * t)
+        phase += 2 * math.pi * pitch / RATE
+        tone = sum(math.sin(k * phase) / k for k in range(1, 7))
+        syllables = 0.55 + 0.45 * abs(math.sin(math.pi * 4 * t))
+        out.append(rms * 0.9 * tone * syllables + rng.gauss(0, 60))
+    return out
+
+
+# differenced white noise, most of its energy up high like an s
+def fricative(rng, seconds, rms=250):
+    white = [rng.gauss(0, rms / math.sqrt(2)) for _ in range(int(seconds * RATE) + 1)]
+    return [white[n + 1] - white[n] for n in range(len(white) - 1)]
+
+
+def click(rng, seconds, rms=4000):
+    samples = int(seconds * RATE)
+    return [rms * math.exp(-6 * n / samples) * rng.choice((-1, 1)) for n in range(samples)]
+
+
+def write(name, pieces):
+    samples = [s for piece in pieces for s in piece]
+    with wave.open(os.path.join(HERE, name), "wb") as out:
+        out.setnchannels(1)
+        out.setsampwidth(2)
+        out.setframerate(RATE)
+        out.writeframes(b"".join(struct.pack("<h", max(-32768, min(32767, int(round(s))))) for s in samples))
+
+
+def main():
+    os.makedirs(HERE, exist_ok=True)
+    rng = random.Random(18)
+    write("room_noise.wav", [noise(rng, 1.0)])
+    write("one_phrase.wav", [noise(rng, 0.6), voiced(rng, 0.8), noise(rng, 0.6)])
+    write("short_pause.wav", [noise(rng, 0.4), voiced(rng, 0.6), noise(rng, 0.24), voiced(rng, 0.6), noise(rng, 0.36)])
+    write("long_pause.wav", [noise(rng, 0.4), voiced(rng, 0.5), noise(rng, 1.0), voiced(rng, 0.5), noise(rng, 0.6)])
+    write("click.wav", [noise(rng, 0.5), click(rng, 0.04), noise(rng, 0.66)])
+    write("fricative_first.wav", [noise(rng, 0.4), fricative(rng, 0.2), voiced(rng, 0.6), noise(rng, 0.6)])
+
+
+if __name__ == "__main__":
+    main()
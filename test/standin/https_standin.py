@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+"""Local HTTPS stand-in for the Gemini API
+    Written by Matthew Ayestaran
+    purpose: lets the session tests on the host talk real TLS to something
+    that behaves like generativelanguage.googleapis.com without a key or a
+    network. keeps connections alive like the real endpoint and can be told
+    to drop idle ones, stream chunked replies or take time to answer.
+    streamGenerateContent?alt=sse answers as server-sent events, a few
+    words per event like the real thing. request bodies can come chunked,
+    /upload answers with the length and sha256 of what it got so the test
+    can check the reassembled body. a generateContent body with an audio
+    inline_data part is decoded and the wav checked, the answer says how
+    many samples were heard and their sha256. /v1/audio/speech stands in
+    for a text to speech service, it answers with raw 24 kHz pcm made from
+    the input text (see speech_samples) a little faster than real time.
+    --handshake-delay-ms holds each new connection back before its tls
+    handshake, for the round trips a connection over wifi to the real
+    endpoint costs that loopback doesn't
+    run with: python3 test/standin/https_standin.py --port 8443
+"""
+
+import argparse
+import base64
+import hashlib
+import http.server
+import json
+import os
+import struct
+import socket
+import ssl
+import subprocess
+import tempfile
+import time
+
+REPLY = {
+    "candidates": [
+        {"content": {"parts": [{"text": "Hello from the stand-in."}], "role": "model"}}
+    ],
+    "cachedContent": "cachedContents/standin",
+}
+
+STREAM_TEXT = ["Hello ", "from the ", "stand-in, ", "one piece ", "at a time."]
+
+SPEECH_RATE = 24000
+SPEECH_SAMPLES_PER_BYTE = 480  # 20 ms of audio for every byte of text
+SPEECH_CHUNK_SAMPLES = 2400    # sent 100 ms of audio at a time
+
+
+def make_certificate(directory):
+    """self signed cert for localhost, made fresh each run"""
+    cert = os.path.join(directory, "standin.pem")
+    key = os.path.join(directory, "standin.key")
+    subprocess.run(
+        ["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt",
+         "ec_paramgen_curve:prime256v1", "-nodes", "-days", "1",
+         "-subj", "/CN=localhost", "-keyout", key, "-out", cert],
+        check=True, capture_output=True)
+    return cert, key
+
+
+def heard_audio(request):
+    """answer text for the wav in an inline_data part, None without one.
+    a data size of 0xffffffff means recorded while sent, the rest is pcm"""
+    parts = [part for content in request.get("contents", []) for part in content.get("parts", [])]
+    for part in parts:
+        inline = part.get("inline_data")
+        if inline is None:
+            continue
+        if inline.get("mime_type") != "audio/wav":
+            raise ValueError("inline_data is not audio/wav")
+        clip = base64.b64decode(inline["data"], validate=True)
+        if len(clip) < 44 or clip[0:4] != b"RIFF" or clip[8:16] != b"WAVEfmt ":
+            raise ValueError("not a wav header")
+        fmt, channels, rate, byte_rate, align, bits = struct.unpack("<HHIIHH", clip[20:36])
+        if (fmt, channels, bits, align, byte_rate) != (1, 1, 16, 2, rate * 2) or clip[36:40] != b"data":
+            raise ValueError("expected 16-bit mono pcm")
+        (size,) = struct.unpack("<I", clip[40:44])
+        pcm = clip[44:] if size == 0xFFFFFFFF else clip[44:44 + size]
+        if len(pcm) != (len(clip) - 44 if size == 0xFFFFFFFF else size) or len(pcm) % 2:
+            raise ValueError("data size doesn't match the clip")
+        return "heard %d samples at %d Hz, sha256 %s" % (
+            len(pcm) // 2, rate, hashlib.sha256(pcm).hexdigest())
+    return None
+
+
+def speech_samples(text):
+    """the stand-in's voice. byte b of the utf-8 text, sample i of it, is
+    (b * 37 + i * 11) % 2001 - 1000, the test makes the same thing"""
+    samples = []
+    for byte in text.encode("utf-8"):
+        samples.extend((byte * 37 + i * 11) % 2001 - 1000 for i in range(SPEECH_SAMPLES_PER_BYTE))
+    return samples
+
+
+class StandinHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive unless the client says close
+    options = None
+
+    def setup(self):
+        # the handshake is done here rather than in accept, so a held back
+        # one doesn't hold up the next connection
+        if self.options.handshake_delay_ms:
+            time.sleep(self.options.handshake_delay_ms / 1000)
+        self.request.do_handshake()
+        super().setup()
+        # streamed events are small writes, nagle would hold each one back
+        # waiting on the ack for the last
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def read_body(self):
+        """whole request body, content-length or chunked"""
+        if "chunked" in self.headers.get("Transfer-Encoding", "").lower():
+            body = bytearray()
+            while True:
+                size = int(self.rfile.readline().split(b";")[0], 16)
+                if size == 0:
+                    while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                        pass  # trailers
+                    return bytes(body)
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def send_json(self, status, reply):
+        body = json.dumps(reply).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json; charset=UTF-8")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        request = self.read_body()
+        if self.path == "/v1/audio/speech":
+            self.speak(request)
+            return
+        if self.path == "/upload":
+            self.send_json(200, {"length": len(request),
+                                 "sha256": hashlib.sha256(request).hexdigest()})
+            return
+        try:
+            heard = heard_audio(json.loads(request.decode("utf-8")))
+        except (ValueError, KeyError, struct.error) as error:  # the real api answers bad json with a 400
+            self.send_json(400, {"error": {"code": 400, "message": str(error),
+                                           "status": "INVALID_ARGUMENT"}})
+            return
+        if self.options.delay_ms:
+            time.sleep(self.options.delay_ms / 1000)
+        if ":streamGenerateContent" in self.path and "alt=sse" in self.path:
+            self.stream_events()
+            return
+        reply = REPLY
+        if heard is not None:
+            reply = json.loads(json.dumps(REPLY))
+            reply["candidates"][0]["content"]["parts"][0]["text"] = heard
+        body = json.dumps(reply).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json; charset=UTF-8")
+        if self.options.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for start in range(0, len(body), 32):
+                piece = body[start:start + 32]
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    def stream_events(self):
+        """one chunk per event, the last carries finishReason and usage"""
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        for index, words in enumerate(STREAM_TEXT):
+            event = {"candidates": [{"content": {"parts": [{"text": words}], "role": "model"}}]}
+            if index == len(STREAM_TEXT) - 1:
+                event["candidates"][0]["finishReason"] = "STOP"
+                event["usageMetadata"] = {"promptTokenCount": 4, "totalTokenCount": 14}
+                event["cachedContent"] = "cachedContents/standin"
+            piece = b"data: " + json.dumps(event).encode() + b"\r\n\r\n"
+            self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+            self.wfile.flush()
+            if index != len(STREAM_TEXT) - 1:
+                time.sleep(self.options.event_delay_ms / 1000)
+        self.wfile.write(b"0\r\n\r\n")
+
+    def speak(self, request):
+        """chunked pcm after the time to first audio, then a chunk every
+        chunk_ms, so the client sees it arrive the way a real service
+        streams it"""
+        try:
+            speech = json.loads(request.decode("utf-8"))
+            text = speech["input"]
+            if speech.get("response_format") != "pcm" or not text:
+                raise ValueError("expected pcm and some input")
+        except (ValueError, KeyError) as error:
+            self.send_json(400, {"error": {"message": str(error), "type": "invalid_request_error"}})
+            return
+        pcm = struct.pack("<%dh" % (len(text.encode("utf-8")) * SPEECH_SAMPLES_PER_BYTE),
+                          *speech_samples(text))
+        time.sleep(self.options.speech_delay_ms / 1000)
+        self.send_response(200)
+        self.send_header("Content-Type", "audio/pcm")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        step = SPEECH_CHUNK_SAMPLES * 2 + 1  # odd, so samples get split
+        for start in range(0, len(pcm), step):
+            piece = pcm[start:start + step]
+            self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+            self.wfile.flush()
+            time.sleep(self.options.speech_chunk_ms / 1000)
+        self.wfile.write(b"0\r\n\r\n")
+
+    def log_message(self, format, *args):
+        if self.options.verbose:
+            super().log_message(format, *args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--idle-timeout", type=float, default=None,
+                        help="seconds before an idle connection is dropped")
+    parser.add_argument("--delay-ms", type=int, default=0,
+                        help="time the model takes to answer")
+    parser.add_argument("--event-delay-ms", type=int, default=40,
+                        help="gap between streamed events")
+    parser.add_argument("--speech-delay-ms", type=int, default=80,
+                        help="time the speech service takes to its first audio")
+    parser.add_argument("--speech-chunk-ms", type=int, default=20,
+                        help="gap between 100 ms pieces of speech")
+    parser.add_argument("--handshake-delay-ms", type=int, default=0,
+                        help="time a new connection takes before its tls handshake")
+    parser.add_argument("--chunked", action="store_true",
+                        help="send replies with chunked transfer encoding")
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    StandinHandler.options = options
+    StandinHandler.timeout = options.idle_timeout
+    with tempfile.TemporaryDirectory() as directory:
+        cert, key = make_certificate(directory)
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(cert, key)
+        server = http.server.ThreadingHTTPServer(("127.0.0.1", options.port), StandinHandler)
+        server.socket = context.wrap_socket(server.socket, server_side=True,
+                                            do_handshake_on_connect=False)
+        print("stand-in listening on https://127.0.0.1:%d" % options.port, flush=True)
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()